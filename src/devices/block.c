@@ -3,7 +3,21 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Most sectors that the request queue merges into one transfer. */
+#define MERGE_SECTORS 64
+
+/* Buckets in the latency and queue depth histograms.  Bucket 0
+   counts zeros and bucket I > 0 counts values from 2**(I-1) to
+   2**I - 1, except that the last bucket counts all larger values
+   too. */
+#define LATENCY_BUCKETS 24              /* Microseconds, to 8 s. */
+#define DEPTH_BUCKETS 8                 /* Requests, to 64. */
 
 /* A block device. */
 struct block
@@ -19,6 +33,36 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+
+    /* Request statistics, each indexed first by whether the
+       requests write. */
+    unsigned latency_hist[2][LATENCY_BUCKETS];  /* Submit to complete. */
+    unsigned class_cnt[2][BLOCK_IO_CLASS_CNT];  /* Requests by source. */
+    unsigned depth_hist[DEPTH_BUCKETS];         /* Depth at submission. */
+    size_t depth;                       /* Requests in flight. */
+    size_t max_depth;                   /* Most requests in flight. */
+
+    /* Requests, for devices without a submit operation. */
+    struct block_queue *queue;          /* Queue that serves BLOCK. */
+    struct list_elem queue_elem;        /* Element in queue's blocks. */
+    struct list requests;               /* Pending, by sector. */
+    block_sector_t head;                /* Sector after last transfer. */
+  };
+
+/* A worker thread that carries out the requests for a group of
+   block devices, one at a time.  Devices that cannot transfer
+   concurrently, such as two disks on one IDE channel, share a
+   queue; devices on separate queues proceed in parallel. */
+struct block_queue
+  {
+    struct lock lock;                   /* Protects the queue and the
+                                           requests of its blocks. */
+    struct condition nonempty;          /* Signaled when pending grows. */
+    struct list blocks;                 /* Blocks served. */
+    size_t pending;                     /* Requests pending in all. */
+    struct block *last;                 /* Block served last. */
+    uint8_t *bounce;                    /* MERGE_SECTORS sectors, for
+                                           merged requests. */
   };
 
 /* List of all block devices. */
@@ -28,6 +72,16 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static list_less_func request_less;
+static thread_func block_worker NO_RETURN;
+static struct block *next_block (struct block_queue *);
+static void driver_transfer (struct block *, block_sector_t, size_t cnt,
+                             void *, bool write);
+static void record_completion (struct block *, const struct block_request *,
+                               int64_t us);
+static size_t log2_bucket (uint64_t, size_t cnt);
+static void print_histogram (const char *title, const unsigned hist[],
+                             size_t cnt);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -120,9 +174,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  block_read_multi (block, sector, 1, buffer);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +185,304 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  block_write_multi (block, sector, 1, buffer);
+}
+
+/* Reads the CNT sectors starting at SECTOR from BLOCK into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE bytes.
+   Drivers that can do so transfer them all in one request.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multi (struct block *block, block_sector_t sector, size_t cnt,
+                  void *buffer)
+{
+  block_transfer (block, sector, cnt, buffer, false, BLOCK_IO_OTHER);
+}
+
+/* Writes the CNT sectors starting at SECTOR to BLOCK from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes, as
+   block_write() does for one sector. */
+void
+block_write_multi (struct block *block, block_sector_t sector, size_t cnt,
+                   const void *buffer)
+{
+  block_transfer (block, sector, cnt, (void *) buffer, true,
+                  BLOCK_IO_OTHER);
+}
+
+/* Transfers the CNT sectors starting at SECTOR between BLOCK and
+   BUFFER on behalf of CLASS, as a request from block_request_init()
+   would, and waits for the transfer to complete. */
+void
+block_transfer (struct block *block, block_sector_t sector, size_t cnt,
+                void *buffer, bool write, enum block_io_class class)
+{
+  struct block_request r;
+
+  if (cnt == 0)
+    return;
+  block_request_init (&r, sector, cnt, buffer, write, class);
+  block_submit (block, &r);
+  block_wait (&r);
+}
+
+/* Initializes R as a request to transfer the CNT sectors
+   starting at SECTOR between a block device and BUFFER, which
+   has room for CNT * BLOCK_SECTOR_SIZE bytes, on behalf of CLASS.
+   The transfer writes BUFFER to the device if WRITE is true and
+   otherwise reads into it. */
+void
+block_request_init (struct block_request *r, block_sector_t sector,
+                    size_t cnt, void *buffer, bool write,
+                    enum block_io_class class)
+{
+  ASSERT (cnt > 0);
+  ASSERT (class < BLOCK_IO_CLASS_CNT);
+
+  r->sector = sector;
+  r->cnt = cnt;
+  r->buffer = buffer;
+  r->write = write;
+  r->class = class;
+  sema_init (&r->done, 0);
+  r->origin = NULL;
+}
+
+/* Starts request R on BLOCK and returns without waiting for it.
+   R and its buffer must stay valid until block_wait() on R
+   returns.  Requests still outstanding are carried out in
+   elevator order rather than in the order submitted, so requests
+   for overlapping sectors should not be outstanding together. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  enum intr_level old_level;
+
+  check_sector (block, r->sector);
+  check_sector (block, r->sector + r->cnt - 1);
+  ASSERT (!r->write || block->type != BLOCK_FOREIGN);
+  if (r->origin == NULL)
+    {
+      struct thread *t = thread_current ();
+
+      r->origin = block;
+      r->start = timer_cycles ();
+
+      /* Charge the I/O to the thread that asked for it, once. */
+      if (r->write)
+        t->usage.sectors_written += r->cnt;
+      else
+        t->usage.sectors_read += r->cnt;
+    }
+
+  old_level = intr_disable ();
+  if (r->write)
+    block->write_cnt += r->cnt;
+  else
+    block->read_cnt += r->cnt;
+  block->class_cnt[r->write][r->class]++;
+  block->depth++;
+  if (block->depth > block->max_depth)
+    block->max_depth = block->depth;
+  block->depth_hist[log2_bucket (block->depth, DEPTH_BUCKETS)]++;
+  intr_set_level (old_level);
+
+  if (block->ops->submit != NULL)
+    block->ops->submit (block->aux, r);
+  else
+    {
+      struct block_queue *q = block->queue;
+
+      lock_acquire (&q->lock);
+      list_insert_ordered (&block->requests, &r->elem, request_less, NULL);
+      q->pending++;
+      cond_signal (&q->nonempty, &q->lock);
+      lock_release (&q->lock);
+    }
+}
+
+/* Waits for request R, submitted with block_submit(), to
+   complete. */
+void
+block_wait (struct block_request *r)
+{
+  sema_down (&r->done);
+}
+
+/* Orders block requests by first sector. */
+static bool
+request_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request, elem);
+  const struct block_request *b = list_entry (b_, struct block_request, elem);
+
+  return a->sector < b->sector;
+}
+
+/* Creates a request queue served by a new thread named NAME.
+   Panics on failure. */
+struct block_queue *
+block_queue_create (const char *name)
+{
+  struct block_queue *q = malloc (sizeof *q);
+
+  if (q == NULL)
+    PANIC ("Failed to allocate block request queue");
+  lock_init_named (&q->lock, "block queue");
+  cond_init (&q->nonempty);
+  list_init (&q->blocks);
+  q->pending = 0;
+  q->last = NULL;
+  q->bounce = malloc (MERGE_SECTORS * BLOCK_SECTOR_SIZE);
+  if (q->bounce == NULL
+      || thread_create (name, PRI_MAX, block_worker, q) == TID_ERROR)
+    PANIC ("Failed to start block request queue");
+  return q;
+}
+
+/* Carries out the requests on queue Q_.  The blocks with pending
+   requests take turns, and each block's requests are served one
+   sweep across the device at a time (C-LOOK): each transfer is the
+   block's request with the lowest sector at or after the end of
+   its previous one, wrapping around to the lowest sector.
+   Following requests in the same direction for the next sectors
+   are merged into it, up to MERGE_SECTORS sectors in all. */
+static void
+block_worker (void *q_)
+{
+  struct block_queue *q = q_;
+
+  for (;;)
+    {
+      struct block_request *batch[MERGE_SECTORS];
+      struct block_request *first;
+      struct block *block;
+      struct list_elem *e;
+      size_t batch_cnt, cnt, i;
+
+      lock_acquire (&q->lock);
+      while (q->pending == 0)
+        cond_wait (&q->nonempty, &q->lock);
+      block = next_block (q);
+
+      for (e = list_begin (&block->requests); e != list_end (&block->requests);
+           e = list_next (e))
+        if (list_entry (e, struct block_request, elem)->sector >= block->head)
+          break;
+      if (e == list_end (&block->requests))
+        e = list_begin (&block->requests);
+
+      first = list_entry (e, struct block_request, elem);
+      e = list_remove (e);
+      batch[0] = first;
+      batch_cnt = 1;
+      cnt = first->cnt;
+      while (e != list_end (&block->requests) && batch_cnt < MERGE_SECTORS)
+        {
+          struct block_request *r = list_entry (e, struct block_request, elem);
+          if (r->sector != first->sector + cnt || r->write != first->write
+              || cnt + r->cnt > MERGE_SECTORS)
+            break;
+          e = list_remove (e);
+          batch[batch_cnt++] = r;
+          cnt += r->cnt;
+        }
+      block->head = first->sector + cnt;
+      q->pending -= batch_cnt;
+      lock_release (&q->lock);
+
+      if (batch_cnt == 1)
+        driver_transfer (block, first->sector, cnt, first->buffer, first->write);
+      else if (first->write)
+        {
+          uint8_t *p = q->bounce;
+          for (i = 0; i < batch_cnt; i++)
+            {
+              memcpy (p, batch[i]->buffer, batch[i]->cnt * BLOCK_SECTOR_SIZE);
+              p += batch[i]->cnt * BLOCK_SECTOR_SIZE;
+            }
+          driver_transfer (block, first->sector, cnt, q->bounce, true);
+        }
+      else
+        {
+          const uint8_t *p = q->bounce;
+          driver_transfer (block, first->sector, cnt, q->bounce, false);
+          for (i = 0; i < batch_cnt; i++)
+            {
+              memcpy (batch[i]->buffer, p, batch[i]->cnt * BLOCK_SECTOR_SIZE);
+              p += batch[i]->cnt * BLOCK_SECTOR_SIZE;
+            }
+        }
+
+      for (i = 0; i < batch_cnt; i++)
+        block_complete (block, batch[i]);
+    }
+}
+
+/* Records that request R, carried out by BLOCK, has completed and
+   wakes its waiter.  Called by the request queue, and by drivers
+   with a submit operation when they finish a request, possibly
+   from an interrupt handler. */
+void
+block_complete (struct block *block, struct block_request *r)
+{
+  int64_t us = timer_cycles_to_us (timer_cycles () - r->start);
+
+  record_completion (block, r, us);
+  if (r->origin != block)
+    record_completion (r->origin, r, us);
+  sema_up (&r->done);
+}
+
+/* Returns the block after Q's last served one, in round-robin
+   order, that has requests pending, and makes it the last served.
+   Q's lock must be held and Q must have requests pending. */
+static struct block *
+next_block (struct block_queue *q)
+{
+  struct list_elem *e = q->last != NULL ? &q->last->queue_elem
+                                        : list_rbegin (&q->blocks);
+
+  ASSERT (lock_held_by_current_thread (&q->lock));
+  ASSERT (q->pending > 0);
+
+  for (;;)
+    {
+      struct block *block;
+
+      e = list_next (e);
+      if (e == list_end (&q->blocks))
+        e = list_begin (&q->blocks);
+      block = list_entry (e, struct block, queue_elem);
+      if (!list_empty (&block->requests))
+        return q->last = block;
+    }
+}
+
+/* Has BLOCK's driver transfer the CNT sectors starting at SECTOR
+   between the device and BUFFER, writing to the device if WRITE
+   is true, in one driver call if the driver supports it. */
+static void
+driver_transfer (struct block *block, block_sector_t sector, size_t cnt,
+                 void *buffer_, bool write)
+{
+  uint8_t *buffer = buffer_;
+  size_t i;
+
+  if (write && block->ops->write_multi != NULL)
+    block->ops->write_multi (block->aux, sector, cnt, buffer);
+  else if (!write && block->ops->read_multi != NULL)
+    block->ops->read_multi (block->aux, sector, cnt, buffer);
+  else
+    for (i = 0; i < cnt; i++)
+      if (write)
+        block->ops->write (block->aux, sector + i,
+                           buffer + i * BLOCK_SECTOR_SIZE);
+      else
+        block->ops->read (block->aux, sector + i,
+                          buffer + i * BLOCK_SECTOR_SIZE);
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -160,10 +506,13 @@ block_type (struct block *block)
   return block->type;
 }
 
-/* Prints statistics for each block device used for a Pintos role. */
+/* Prints statistics for each block device used for a Pintos role,
+   then request latency, queue depth and sources for each block
+   device that has been used. */
 void
 block_print_stats (void)
 {
+  struct list_elem *e;
   int i;
 
   for (i = 0; i < BLOCK_ROLE_CNT; i++)
@@ -176,13 +525,96 @@ block_print_stats (void)
                   block->read_cnt, block->write_cnt);
         }
     }
+
+  for (e = list_begin (&all_blocks); e != list_end (&all_blocks);
+       e = list_next (e))
+    {
+      static const char *class_names[BLOCK_IO_CLASS_CNT] =
+        {"other", "swap", "inode data", "inode metadata", "free map"};
+      struct block *block = list_entry (e, struct block, list_elem);
+      const char *sep = "";
+
+      if (block->read_cnt == 0 && block->write_cnt == 0)
+        continue;
+      printf ("%s: %llu sectors read, %llu written\n",
+              block->name, block->read_cnt, block->write_cnt);
+      print_histogram ("read latency (us)", block->latency_hist[0],
+                       LATENCY_BUCKETS);
+      print_histogram ("write latency (us)", block->latency_hist[1],
+                       LATENCY_BUCKETS);
+      printf ("  queue depth: max %zu;", block->max_depth);
+      print_histogram ("at submission", block->depth_hist, DEPTH_BUCKETS);
+      printf ("  requests (reads/writes):");
+      for (i = 0; i < BLOCK_IO_CLASS_CNT; i++)
+        if (block->class_cnt[0][i] != 0 || block->class_cnt[1][i] != 0)
+          {
+            printf ("%s %s %u/%u", sep, class_names[i],
+                    block->class_cnt[0][i], block->class_cnt[1][i]);
+            sep = ",";
+          }
+      printf ("\n");
+    }
+}
+
+/* Records in BLOCK's statistics that request R completed US
+   microseconds after it was submitted. */
+static void
+record_completion (struct block *block, const struct block_request *r,
+                   int64_t us)
+{
+  enum intr_level old_level = intr_disable ();
+  block->latency_hist[r->write][log2_bucket (us, LATENCY_BUCKETS)]++;
+  block->depth--;
+  intr_set_level (old_level);
+}
+
+/* Returns the bucket, among CNT, of a log2 histogram that X
+   falls into. */
+static size_t
+log2_bucket (uint64_t x, size_t cnt)
+{
+  size_t bucket = 0;
+
+  while (x > 0 && bucket < cnt - 1)
+    {
+      x >>= 1;
+      bucket++;
+    }
+  return bucket;
+}
+
+/* Prints the nonempty buckets of log2 histogram HIST, which has
+   CNT buckets, on a line headed TITLE. */
+static void
+print_histogram (const char *title, const unsigned hist[], size_t cnt)
+{
+  size_t i;
+
+  printf ("  %s:", title);
+  for (i = 0; i < cnt; i++)
+    if (hist[i] != 0)
+      {
+        unsigned long lo = i > 0 ? 1ul << (i - 1) : 0;
+        unsigned long hi = i > 0 ? (1ul << i) - 1 : 0;
+
+        if (i == cnt - 1)
+          printf (" %lu+:%u", lo, hist[i]);
+        else if (lo == hi)
+          printf (" %lu:%u", lo, hist[i]);
+        else
+          printf (" %lu-%lu:%u", lo, hi, hist[i]);
+      }
+  printf ("\n");
 }
 
 /* Registers a new block device with the given NAME.  If
    EXTRA_INFO is non-null, it is printed as part of a user
    message.  The block device's SIZE in sectors and its TYPE must
    be provided, as well as the it operation functions OPS, which
-   will be passed AUX in each function call. */
+   will be passed AUX in each function call.  Unless OPS has a
+   submit operation, requests for the device are queued and
+   carried out by the thread of the queue that OPS's queue
+   operation returns or, failing that, by a thread of its own. */
 struct block *
 block_register (const char *name, enum block_type type,
                 const char *extra_info, block_sector_t size,
@@ -200,6 +632,21 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  memset (block->latency_hist, 0, sizeof block->latency_hist);
+  memset (block->class_cnt, 0, sizeof block->class_cnt);
+  memset (block->depth_hist, 0, sizeof block->depth_hist);
+  block->depth = block->max_depth = 0;
+  if (ops->submit == NULL)
+    {
+      block->queue = (ops->queue != NULL ? ops->queue (aux)
+                      : block_queue_create (block->name));
+      list_init (&block->requests);
+      block->head = 0;
+
+      lock_acquire (&block->queue->lock);
+      list_push_back (&block->queue->blocks, &block->queue_elem);
+      lock_release (&block->queue->lock);
+    }
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
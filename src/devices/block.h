@@ -1,8 +1,11 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -21,6 +24,7 @@ typedef uint32_t block_sector_t;
 /* Higher-level interface for file systems, etc. */
 
 struct block;
+struct block_queue;
 
 /* Type of a block device. */
 enum block_type
@@ -53,7 +57,46 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multi (struct block *, block_sector_t, size_t cnt, void *);
+void block_write_multi (struct block *, block_sector_t, size_t cnt,
+                        const void *);
 const char *block_name (struct block *);
+
+/* Which subsystem a request is on behalf of, for statistics. */
+enum block_io_class
+  {
+    BLOCK_IO_OTHER,             /* Unclassified. */
+    BLOCK_IO_SWAP,              /* Swap slots. */
+    BLOCK_IO_INODE_DATA,        /* File contents. */
+    BLOCK_IO_INODE_META,        /* Inodes, index blocks, directories. */
+    BLOCK_IO_FREE_MAP,          /* Free map contents. */
+    BLOCK_IO_CLASS_CNT
+  };
+
+/* An asynchronous transfer of CNT sectors starting at SECTOR
+   between a block device and BUFFER. */
+struct block_request
+  {
+    struct list_elem elem;      /* Element in a device's queue. */
+    block_sector_t sector;      /* First sector. */
+    size_t cnt;                 /* Number of sectors. */
+    void *buffer;               /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    bool write;                 /* Write BUFFER to the device? */
+    enum block_io_class class;  /* Subsystem that asked. */
+    struct semaphore done;      /* Up'd when the transfer completes. */
+
+    struct block *origin;       /* Device first submitted to. */
+    uint64_t start;             /* timer_cycles() at submission. */
+  };
+
+void block_transfer (struct block *, block_sector_t, size_t cnt, void *,
+                     bool write, enum block_io_class);
+void block_request_init (struct block_request *, block_sector_t,
+                         size_t cnt, void *buffer, bool write,
+                         enum block_io_class);
+void block_submit (struct block *, struct block_request *);
+void block_wait (struct block_request *);
+
 enum block_type block_type (struct block *);
 
 /* Statistics. */
@@ -65,8 +108,29 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Transfer CNT consecutive sectors in one request.  Optional:
+       if null, the block layer uses one read or write per sector. */
+    void (*read_multi) (void *aux, block_sector_t, size_t cnt,
+                        void *buffer);
+    void (*write_multi) (void *aux, block_sector_t, size_t cnt,
+                         const void *buffer);
+
+    /* Optional: starts a request for this device, which the
+       driver finishes by calling block_complete(), or hands it on
+       to another block device.  If non-null, the operations above
+       are not used. */
+    void (*submit) (void *aux, struct block_request *);
+
+    /* Optional: returns the queue, from block_queue_create(),
+       shared with the devices that cannot transfer at the same
+       time as this one. */
+    struct block_queue *(*queue) (void *aux);
   };
 
+struct block_queue *block_queue_create (const char *name);
+void block_complete (struct block *, struct block_request *);
+
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
@@ -5,10 +5,13 @@
 #include <stdio.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -30,10 +33,25 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE port addresses, relative to the channel's
+   bus master base. */
+#define bm_command(CHANNEL) ((CHANNEL)->bm_base + 0)    /* Command. */
+#define bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)     /* Status. */
+#define bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)       /* PRD table. */
+
+/* Bus master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+
+/* Bus master Status Register bits.  Writing 1 clears them. */
+#define BM_STA_ERR 0x02         /* Transfer failed. */
+#define BM_STA_INTR 0x04        /* Disk interrupted. */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +67,32 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Most sectors that one READ or WRITE command can transfer. */
+#define MAX_CMD_SECTORS 256
+
+/* Most sectors per interrupt that we ask a disk to transfer in
+   READ MULTIPLE and WRITE MULTIPLE. */
+#define MAX_MULTIPLE 16
+
+/* A physical region descriptor: one entry of the table that tells
+   the bus master where in memory a DMA transfer goes. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address, even. */
+    uint16_t size;              /* Byte count, 0 meaning 64 kB. */
+    uint16_t flags;             /* PRD_EOT on the last entry. */
+  };
+#define PRD_EOT 0x8000
+
+/* Entries per PRD table.  A command's MAX_CMD_SECTORS sectors
+   span at most this many pages. */
+#define PRD_CNT 64
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +101,9 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    bool use_dma;               /* Transfer by bus master DMA? */
+    size_t multiple;            /* Sectors per interrupt, 1 if the disk
+                                   does not do READ/WRITE MULTIPLE. */
   };
 
 /* An ATA channel (aka controller).
@@ -72,6 +119,12 @@ struct channel
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    struct block_queue *queue;  /* Request queue, once disks exist. */
+    uint16_t bm_base;           /* Bus master base I/O port, or 0. */
+    struct prd prd[PRD_CNT]     /* PRD table for DMA transfers; aligned
+                                   so it does not cross 64 kB. */
+      __attribute__ ((aligned (PRD_CNT * sizeof (struct prd))));
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -85,10 +138,17 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void set_multiple_mode (struct ata_disk *, const char id[]);
+static uint16_t find_bus_master (void);
+
+static bool can_dma (const struct ata_disk *, const void *);
+static void dma_command (struct ata_disk *, block_sector_t, size_t cnt,
+                         const void *, bool to_disk);
+
+static void select_sectors (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
-static void input_sector (struct channel *, void *);
-static void output_sector (struct channel *, const void *);
+static void input_sectors (struct channel *, void *, size_t cnt);
+static void output_sectors (struct channel *, const void *, size_t cnt);
 
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
@@ -101,6 +161,7 @@ static void interrupt_handler (struct intr_frame *);
 void
 ide_init (void) 
 {
+  uint16_t bm_base = find_bus_master ();
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
@@ -123,9 +184,11 @@ ide_init (void)
         default:
           NOT_REACHED ();
         }
-      lock_init (&c->lock);
+      lock_init_named (&c->lock, "ide channel");
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      c->queue = NULL;
+      c->bm_base = bm_base != 0 ? bm_base + chan_no * 8 : 0;
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +199,8 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple = 1;
+          d->use_dma = false;
         }
 
       /* Register interrupt handler. */
@@ -279,7 +344,7 @@ identify_ata_device (struct ata_disk *d)
       d->is_ata = false;
       return;
     }
-  input_sector (c, id);
+  input_sectors (c, id, 1);
 
   /* Calculate capacity.
      Read model name and serial number. */
@@ -303,12 +368,76 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  set_multiple_mode (d, id);
+
+  /* Use DMA if the controller is a bus master and the disk
+     supports DMA (word 49, bit 8). */
+  d->use_dma = c->bm_base != 0 && (id[49 * 2 + 1] & 0x01) != 0;
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
   partition_scan (block);
 }
 
+/* Enables READ MULTIPLE and WRITE MULTIPLE on disk D, whose
+   IDENTIFY DEVICE response is ID, with the largest block size
+   that the disk supports up to MAX_MULTIPLE sectors, and records
+   it in D.  Leaves D transferring one sector per interrupt if the
+   disk does not support them or refuses the block size. */
+static void
+set_multiple_mode (struct ata_disk *d, const char id[])
+{
+  struct channel *c = d->channel;
+  size_t max = (uint8_t) id[47 * 2];
+  size_t cnt;
+
+  if (max < 2)
+    return;
+  for (cnt = 1; cnt * 2 <= max && cnt * 2 <= MAX_MULTIPLE; cnt *= 2)
+    continue;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), cnt);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if ((inb (reg_alt_status (c)) & STA_ERR) == 0)
+    d->multiple = cnt;
+}
+
+/* Looks on PCI bus 0 for an IDE controller that can act as a bus
+   master (class 01h, subclass 01h, programming interface bit 7),
+   enables bus mastering on it, and returns its bus master base
+   I/O port.  Returns 0 if there is none, so that we stay in PIO
+   mode. */
+static uint16_t
+find_bus_master (void)
+{
+  int dev_no;
+
+  for (dev_no = 0; dev_no < PCI_DEV_CNT; dev_no++)
+    {
+      uint32_t class = pci_read_config (dev_no, 0x08);
+      uint32_t bar4;
+
+      if (pci_read_config (dev_no, 0x00) == 0xffffffff
+          || (class >> 16) != 0x0101 || (class & 0x8000) == 0)
+        continue;
+
+      /* BAR 4 must be an I/O space address. */
+      bar4 = pci_read_config (dev_no, 0x20);
+      if ((bar4 & 1) == 0 || (bar4 & ~3u) == 0)
+        continue;
+
+      /* Enable I/O space and bus master in the Command register. */
+      pci_write_config (dev_no, 0x04,
+                        (pci_read_config (dev_no, 0x04) & 0xffff) | 0x05);
+      return bar4 & 0xfffc;
+    }
+  return 0;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -337,63 +466,164 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE bytes.
+   Uses one command per MAX_CMD_SECTORS sectors, moving the data
+   by DMA if possible and otherwise by PIO with one interrupt per
+   D->multiple sectors.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_read_multi (void *d_, block_sector_t sec_no, size_t cnt, void *buffer_)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  uint8_t *buffer = buffer_;
+  bool dma = can_dma (d, buffer);
+
+  TRACE (TRACE_IDE_READ, sec_no, cnt);
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
+  while (cnt > 0)
+    {
+      size_t cmd_cnt = cnt < MAX_CMD_SECTORS ? cnt : MAX_CMD_SECTORS;
+      size_t left;
+
+      if (dma)
+        {
+          dma_command (d, sec_no, cmd_cnt, buffer, false);
+          buffer += cmd_cnt * BLOCK_SECTOR_SIZE;
+          sec_no += cmd_cnt;
+          cnt -= cmd_cnt;
+          continue;
+        }
+
+      select_sectors (d, sec_no, cmd_cnt);
+      issue_pio_command (c, d->multiple > 1
+                            ? CMD_READ_MULTIPLE : CMD_READ_SECTOR_RETRY);
+      for (left = cmd_cnt; left > 0; )
+        {
+          size_t block_cnt = left < d->multiple ? left : d->multiple;
+
+          sema_down (&c->completion_wait);
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                   d->name, sec_no + (cmd_cnt - left));
+          input_sectors (c, buffer, block_cnt);
+          buffer += block_cnt * BLOCK_SECTOR_SIZE;
+          left -= block_cnt;
+        }
+      sec_no += cmd_cnt;
+      cnt -= cmd_cnt;
+    }
   lock_release (&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+/* Writes the CNT sectors starting at SEC_NO to disk D from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the disk has acknowledged receiving the data.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+ide_write_multi (void *d_, block_sector_t sec_no, size_t cnt,
+                 const void *buffer_)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  const uint8_t *buffer = buffer_;
+  bool dma = can_dma (d, buffer);
+
+  TRACE (TRACE_IDE_WRITE, sec_no, cnt);
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
+  while (cnt > 0)
+    {
+      size_t cmd_cnt = cnt < MAX_CMD_SECTORS ? cnt : MAX_CMD_SECTORS;
+      size_t left;
+
+      if (dma)
+        {
+          dma_command (d, sec_no, cmd_cnt, buffer, true);
+          buffer += cmd_cnt * BLOCK_SECTOR_SIZE;
+          sec_no += cmd_cnt;
+          cnt -= cmd_cnt;
+          continue;
+        }
+
+      select_sectors (d, sec_no, cmd_cnt);
+      issue_pio_command (c, d->multiple > 1
+                            ? CMD_WRITE_MULTIPLE : CMD_WRITE_SECTOR_RETRY);
+      for (left = cmd_cnt; left > 0; )
+        {
+          size_t block_cnt = left < d->multiple ? left : d->multiple;
+
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                   d->name, sec_no + (cmd_cnt - left));
+          output_sectors (c, buffer, block_cnt);
+          sema_down (&c->completion_wait);
+          buffer += block_cnt * BLOCK_SECTOR_SIZE;
+          left -= block_cnt;
+        }
+      sec_no += cmd_cnt;
+      cnt -= cmd_cnt;
+    }
   lock_release (&c->lock);
 }
 
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes. */
+static void
+ide_read (void *d, block_sector_t sec_no, void *buffer)
+{
+  ide_read_multi (d, sec_no, 1, buffer);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data. */
+static void
+ide_write (void *d, block_sector_t sec_no, const void *buffer)
+{
+  ide_write_multi (d, sec_no, 1, buffer);
+}
+
+/* Returns the request queue of disk D's channel, creating it if
+   necessary.  The two disks on a channel take turns, but the two
+   channels work in parallel. */
+static struct block_queue *
+ide_queue (void *d_)
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+
+  if (c->queue == NULL)
+    c->queue = block_queue_create (c->name);
+  return c->queue;
+}
+
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multi,
+    ide_write_multi,
+    NULL,
+    ide_queue
   };
-
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
+   writes SEC_NO and CNT, which must be between 1 and
+   MAX_CMD_SECTORS, to the disk's sector selection registers.  (We
    use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sectors (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
-  ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt >= 1 && cnt <= MAX_CMD_SECTORS);
+  ASSERT (sec_no + cnt <= (1UL << 28));
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt == MAX_CMD_SECTORS ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -401,6 +631,69 @@ select_sector (struct ata_disk *d, block_sector_t sec_no)
         DEV_MBS | DEV_LBA | (d->dev_no == 1 ? DEV_DEV : 0) | (sec_no >> 24));
 }
 
+/* Returns true if BUFFER can be the target of a DMA transfer by
+   disk D: D uses DMA and BUFFER is an even kernel address, whose
+   physical address vtop() yields. */
+static bool
+can_dma (const struct ata_disk *d, const void *buffer)
+{
+  return (d->use_dma && is_kernel_vaddr (buffer)
+          && ((uintptr_t) buffer & 1) == 0);
+}
+
+/* Transfers the CNT sectors, at most MAX_CMD_SECTORS, starting at
+   SEC_NO between disk D and BUFFER by bus master DMA, writing to
+   the disk if TO_DISK is true and reading from it otherwise.
+   The CPU is free to run other threads until the disk
+   interrupts.  D's channel lock must be held. */
+static void
+dma_command (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+             const void *buffer, bool to_disk)
+{
+  struct channel *c = d->channel;
+  const uint8_t *p = buffer;
+  size_t size = cnt * BLOCK_SECTOR_SIZE;
+  uint8_t direction = to_disk ? 0 : BM_CMD_READ;
+  uint8_t bm_sta;
+  size_t i;
+
+  ASSERT (cnt >= 1 && cnt <= MAX_CMD_SECTORS);
+
+  /* Describe BUFFER page by page: kernel pages are physically
+     contiguous, but no region may cross a 64 kB boundary. */
+  for (i = 0; size > 0; i++)
+    {
+      size_t chunk = PGSIZE - pg_ofs (p);
+      if (chunk > size)
+        chunk = size;
+
+      ASSERT (i < PRD_CNT);
+      c->prd[i].addr = vtop (p);
+      c->prd[i].size = chunk;
+      c->prd[i].flags = 0;
+      p += chunk;
+      size -= chunk;
+    }
+  c->prd[i - 1].flags = PRD_EOT;
+
+  outl (bm_prdt (c), vtop (c->prd));
+  outb (bm_command (c), direction);
+  outb (bm_status (c), inb (bm_status (c)) | BM_STA_ERR | BM_STA_INTR);
+
+  select_sectors (d, sec_no, cnt);
+  issue_pio_command (c, to_disk ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (bm_command (c), direction | BM_CMD_START);
+  sema_down (&c->completion_wait);
+
+  outb (bm_command (c), direction);
+  bm_sta = inb (bm_status (c));
+  outb (bm_status (c), bm_sta | BM_STA_ERR | BM_STA_INTR);
+  if ((bm_sta & BM_STA_ERR) != 0
+      || (inb (reg_alt_status (c)) & STA_ERR) != 0)
+    PANIC ("%s: disk %s failed, sector=%"PRDSNu,
+           d->name, to_disk ? "write" : "read", sec_no);
+}
+
 /* Writes COMMAND to channel C and prepares for receiving a
    completion interrupt. */
 static void
@@ -414,20 +707,21 @@ issue_pio_command (struct channel *c, uint8_t command)
   outb (reg_command (c), command);
 }
 
-/* Reads a sector from channel C's data register in PIO mode into
-   SECTOR, which must have room for BLOCK_SECTOR_SIZE bytes. */
+/* Reads CNT sectors from channel C's data register in PIO mode
+   into SECTORS, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes. */
 static void
-input_sector (struct channel *c, void *sector) 
+input_sectors (struct channel *c, void *sectors, size_t cnt) 
 {
-  insw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
+  insw (reg_data (c), sectors, cnt * BLOCK_SECTOR_SIZE / 2);
 }
 
-/* Writes SECTOR to channel C's data register in PIO mode.
-   SECTOR must contain BLOCK_SECTOR_SIZE bytes. */
+/* Writes CNT sectors to channel C's data register in PIO mode.
+   SECTORS must contain CNT * BLOCK_SECTOR_SIZE bytes. */
 static void
-output_sector (struct channel *c, const void *sector) 
+output_sectors (struct channel *c, const void *sectors, size_t cnt) 
 {
-  outsw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
+  outsw (reg_data (c), sectors, cnt * BLOCK_SECTOR_SIZE / 2);
 }
 
 /* Low-level ATA primitives. */
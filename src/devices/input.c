@@ -2,15 +2,40 @@
 #include <debug.h>
 #include "devices/intq.h"
 #include "devices/serial.h"
+#include "threads/malloc.h"
+#include "threads/tunable.h"
 
-/* Stores keys from the keyboard and serial port. */
+/* Default size of the input buffer, in bytes, enough for a burst
+   of pasted serial input. */
+#define INPUT_BUFSIZE 1024
+
+/* Stores keys from the keyboard and serial port.  Their interrupt
+   handlers are its only producer, which never runs concurrently
+   with itself. */
 static struct intq buffer;
 
+/* Serializes input_read(), so that concurrent readers each get
+   whole lines and the buffer has a single consumer. */
+static struct lock read_lock;
+
+/* Threads in poll() waiting for a key. */
+static struct poll_queue pollers;
+
 /* Initializes the input buffer. */
 void
 input_init (void) 
 {
-  intq_init (&buffer);
+  size_t size = tunable_int ("input_buf", INPUT_BUFSIZE, INTQ_BUFSIZE, 65536);
+  uint8_t *buf;
+
+  while ((size & (size - 1)) != 0)
+    size &= size - 1;
+  buf = malloc (size);
+  if (buf == NULL)
+    PANIC ("out of memory for the input buffer");
+  intq_init_buf (&buffer, buf, size);
+  lock_init_named (&read_lock, "console input");
+  poll_queue_init (&pollers);
 }
 
 /* Adds a key to the input buffer.
@@ -23,6 +48,7 @@ input_putc (uint8_t key)
 
   intq_putc (&buffer, key);
   serial_notify ();
+  poll_queue_wake (&pollers);
 }
 
 /* Retrieves a key from the input buffer.
@@ -30,15 +56,55 @@ input_putc (uint8_t key)
 uint8_t
 input_getc (void) 
 {
-  enum intr_level old_level;
   uint8_t key;
 
+  input_read (&key, 1);
+  return key;
+}
+
+/* Reads up to SIZE keys into BUF, a line at a time: waits for a
+   key if none is buffered, then takes everything already buffered
+   in bulk, without turning interrupts off, and stops after a
+   new-line or once SIZE keys have been read.  Returns the number of
+   keys read. */
+size_t
+input_read (uint8_t *buf, size_t size) 
+{
+  size_t n = 0;
+
+  lock_acquire (&read_lock);
+  while (n < size && (n == 0 || buf[n - 1] != '\n'))
+    {
+      enum intr_level old_level;
+
+      intq_wait_nonempty (&buffer);
+      n += intq_read (&buffer, buf + n, size - n, '\n');
+
+      /* The serial port stops receiving while the buffer is full. */
+      old_level = intr_disable ();
+      serial_notify ();
+      intr_set_level (old_level);
+    }
+  lock_release (&read_lock);
+
+  return n;
+}
+
+/* Returns true if a key is buffered.  If ENTRY is nonnull, first
+   adds it to the keyboard's poll queue, so that SEMA is raised
+   whenever a key arrives until it is removed. */
+bool
+input_poll (struct poll_entry *entry, struct semaphore *sema) 
+{
+  enum intr_level old_level;
+  bool ready;
+
+  if (entry != NULL)
+    poll_queue_add (&pollers, entry, sema);
   old_level = intr_disable ();
-  key = intq_getc (&buffer);
-  serial_notify ();
+  ready = !intq_empty (&buffer);
   intr_set_level (old_level);
-  
-  return key;
+  return ready;
 }
 
 /* Returns true if the input buffer is full,
@@ -1,34 +1,50 @@
 #include "devices/intq.h"
+#include <atomic.h>
 #include <debug.h>
 #include "threads/thread.h"
 
-static int next (int pos);
 static void wait (struct intq *q, struct thread **waiter);
 static void signal (struct intq *q, struct thread **waiter);
 
-/* Initializes interrupt queue Q. */
+/* Initializes interrupt queue Q with a buffer of INTQ_BUFSIZE
+   bytes. */
 void
 intq_init (struct intq *q) 
 {
+  intq_init_buf (q, q->small_buf, sizeof q->small_buf);
+}
+
+/* Initializes interrupt queue Q to use the SIZE bytes at BUF,
+   where SIZE is a power of 2, for a queue that may have to absorb
+   longer bursts than intq_init() allows for. */
+void
+intq_init_buf (struct intq *q, uint8_t *buf, size_t size) 
+{
+  ASSERT (size > 0 && (size & (size - 1)) == 0);
+
   lock_init (&q->lock);
   q->not_full = q->not_empty = NULL;
+  q->buf = buf;
+  q->size = size;
   q->head = q->tail = 0;
 }
 
-/* Returns true if Q is empty, false otherwise. */
+/* Returns true if Q is empty, false otherwise.  With interrupts
+   on, the consumer may call this too, but the producer may add a
+   byte as soon as it returns. */
 bool
 intq_empty (const struct intq *q) 
 {
-  ASSERT (intr_get_level () == INTR_OFF);
-  return q->head == q->tail;
+  return atomic_read (&q->head) == atomic_read (&q->tail);
 }
 
-/* Returns true if Q is full, false otherwise. */
+/* Returns true if Q is full, false otherwise.  With interrupts
+   on, the producer may call this too, but the consumer may remove
+   a byte as soon as it returns. */
 bool
 intq_full (const struct intq *q) 
 {
-  ASSERT (intr_get_level () == INTR_OFF);
-  return next (q->head) == q->tail;
+  return atomic_read (&q->head) - atomic_read (&q->tail) == q->size;
 }
 
 /* Removes a byte from Q and returns it.
@@ -48,8 +64,8 @@ intq_getc (struct intq *q)
       lock_release (&q->lock);
     }
   
-  byte = q->buf[q->tail];
-  q->tail = next (q->tail);
+  byte = q->buf[q->tail & (q->size - 1)];
+  atomic_set (&q->tail, q->tail + 1);
   signal (q, &q->not_full);
   return byte;
 }
@@ -69,16 +85,69 @@ intq_putc (struct intq *q, uint8_t byte)
       lock_release (&q->lock);
     }
 
-  q->buf[q->head] = byte;
-  q->head = next (q->head);
+  q->buf[q->head & (q->size - 1)] = byte;
+  wmb ();
+  atomic_set (&q->head, q->head + 1);
   signal (q, &q->not_empty);
 }
-
-/* Returns the position after POS within an intq. */
-static int
-next (int pos) 
+
+/* Removes up to SIZE bytes from Q into BUF, stopping after a byte
+   equal to STOP unless STOP is -1, and returns the number removed,
+   which is 0 if Q is empty.  Never sleeps.  Must be called by Q's
+   only consumer, but interrupts may be on or off. */
+size_t
+intq_read (struct intq *q, uint8_t *buf, size_t size, int stop) 
 {
-  return (pos + 1) % INTQ_BUFSIZE;
+  unsigned tail = q->tail;
+  unsigned avail = atomic_read (&q->head) - tail;
+  size_t n = 0;
+
+  /* Read no byte before seeing HEAD cover it. */
+  rmb ();
+  while (n < size && n < avail)
+    {
+      uint8_t byte = q->buf[(tail + n) & (q->size - 1)];
+
+      buf[n++] = byte;
+      if (byte == stop)
+        break;
+    }
+  if (n == 0)
+    return 0;
+
+  /* Copy every byte before freeing its slot.  x86 does not let a
+     store pass an earlier load, so stopping the compiler suffices. */
+  barrier ();
+  atomic_set (&q->tail, tail + n);
+
+  /* Only a thread can wait, not an interrupt handler, so the wait
+     is rare enough to turn interrupts off for. */
+  if (atomic_read (&q->not_full) != NULL)
+    {
+      enum intr_level old_level = intr_disable ();
+      signal (q, &q->not_full);
+      intr_set_level (old_level);
+    }
+  return n;
+}
+
+/* Sleeps until Q is not empty.  Must be called by Q's only
+   consumer, from a kernel thread. */
+void
+intq_wait_nonempty (struct intq *q) 
+{
+  enum intr_level old_level;
+
+  if (!intq_empty (q))
+    return;
+  old_level = intr_disable ();
+  while (intq_empty (q)) 
+    {
+      lock_acquire (&q->lock);
+      wait (q, &q->not_empty);
+      lock_release (&q->lock);
+    }
+  intr_set_level (old_level);
 }
 
 /* WAITER must be the address of Q's not_empty or not_full
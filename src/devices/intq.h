@@ -1,6 +1,7 @@
 #ifndef DEVICES_INTQ_H
 #define DEVICES_INTQ_H
 
+#include <stddef.h>
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 
@@ -9,15 +10,23 @@
 
    Interrupt queue functions can be called from kernel threads or
    from external interrupt handlers.  Except for intq_init(),
-   interrupts must be off in either case.
+   intq_init_buf(), intq_read() and intq_wait_nonempty(), interrupts
+   must be off in either case.
 
    The interrupt queue has the structure of a "monitor".  Locks
    and condition variables from threads/synch.h cannot be used in
    this case, as they normally would, because they can only
    protect kernel threads from one another, not from interrupt
-   handlers. */
+   handlers.
 
-/* Queue buffer size, in bytes. */
+   A queue with a single producer, such as an interrupt handler,
+   and a single consumer may also be drained in bulk by the
+   consumer with intq_read() while interrupts are on.  The
+   producer only ever writes HEAD, after the byte it covers, and
+   the consumer only ever writes TAIL, after it has copied the
+   bytes it covers, so neither has to stop the other. */
+
+/* Size of the buffer that intq_init() provides, in bytes. */
 #define INTQ_BUFSIZE 64
 
 /* A circular queue of bytes. */
@@ -29,15 +38,20 @@ struct intq
     struct thread *not_empty;   /* Thread waiting for not-empty condition. */
 
     /* Queue. */
-    uint8_t buf[INTQ_BUFSIZE];  /* Buffer. */
-    int head;                   /* New data is written here. */
-    int tail;                   /* Old data is read here. */
+    uint8_t *buf;               /* Buffer. */
+    unsigned size;              /* Size of BUF, a power of 2. */
+    unsigned head;              /* Bytes ever added, mod 2**32. */
+    unsigned tail;              /* Bytes ever removed, mod 2**32. */
+    uint8_t small_buf[INTQ_BUFSIZE];    /* Default buffer. */
   };
 
 void intq_init (struct intq *);
+void intq_init_buf (struct intq *, uint8_t *buf, size_t size);
 bool intq_empty (const struct intq *);
 bool intq_full (const struct intq *);
 uint8_t intq_getc (struct intq *);
 void intq_putc (struct intq *, uint8_t);
+size_t intq_read (struct intq *, uint8_t *buf, size_t size, int stop);
+void intq_wait_nonempty (struct intq *);
 
 #endif /* devices/intq.h */
@@ -1,5 +1,6 @@
 #include "devices/partition.h"
 #include <packed.h>
+#include <round.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -13,26 +14,181 @@ struct partition
     block_sector_t start;               /* First sector within device. */
   };
 
+/* Format of a partition table entry.  See [Partitions]. */
+struct partition_table_entry
+  {
+    uint8_t bootable;         /* 0x00=not bootable, 0x80=bootable. */
+    uint8_t start_chs[3];     /* Encoded starting cylinder, head, sector. */
+    uint8_t type;             /* Partition type (see partition_type_name). */
+    uint8_t end_chs[3];       /* Encoded ending cylinder, head, sector. */
+    uint32_t offset;          /* Start sector offset from partition table. */
+    uint32_t size;            /* Number of sectors. */
+  }
+PACKED;
+
+/* Partition table sector. */
+struct partition_table
+  {
+    uint8_t loader[446];      /* Loader, in top-level partition table. */
+    struct partition_table_entry partitions[4];       /* Table entries. */
+    uint16_t signature;       /* Should be 0xaa55. */
+  }
+PACKED;
+
+/* GUID Partition Table header, in sector 1 of a GPT disk, whose
+   MBR holds a single "protective" partition of type 0xee. */
+struct gpt_header
+  {
+    char signature[8];        /* "EFI PART". */
+    uint32_t revision;
+    uint32_t header_size;
+    uint32_t header_crc;
+    uint32_t reserved;
+    uint64_t current_lba;     /* Sector of this header. */
+    uint64_t backup_lba;      /* Sector of the backup header. */
+    uint64_t first_usable_lba;
+    uint64_t last_usable_lba;
+    uint8_t disk_guid[16];
+    uint64_t entries_lba;     /* First sector of the entry array. */
+    uint32_t entry_cnt;       /* Number of entries. */
+    uint32_t entry_size;      /* Bytes per entry, at least 128. */
+    uint32_t entries_crc;
+  }
+PACKED;
+
+/* GUID Partition Table entry. */
+struct gpt_entry
+  {
+    uint8_t type_guid[16];    /* All zeros if unused. */
+    uint8_t unique_guid[16];
+    uint64_t first_lba;       /* First sector. */
+    uint64_t last_lba;        /* Last sector, inclusive. */
+    uint64_t attributes;
+    uint16_t name[36];        /* UTF-16LE. */
+  }
+PACKED;
+
+/* GPT partition types for Pintos are the GUID whose first 15
+   bytes, in on-disk order, are GPT_PINTOS_PREFIX and whose last
+   byte is the corresponding MBR partition type, 0x20 to 0x23. */
+static const uint8_t GPT_PINTOS_PREFIX[15] =
+  {'P', 'I', 'N', 'T', 'O', 'S', 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+/* Largest GPT entry array that we read, in bytes: 128 entries of
+   128 bytes, the usual size. */
+#define GPT_ENTRIES_MAX (128 * 128)
+
 static struct block_operations partition_operations;
 
 static void read_partition_table (struct block *, block_sector_t sector,
                                   block_sector_t primary_extended_sector,
+                                  const struct partition_table *,
                                   int *part_nr);
+static bool read_gpt (struct block *, const struct partition_table *mbr,
+                      const struct gpt_header *, int *part_nr);
 static void found_partition (struct block *, uint8_t type,
                              block_sector_t start, block_sector_t size,
                              int part_nr);
 static const char *partition_type_name (uint8_t);
 
-/* Scans BLOCK for partitions of interest to Pintos. */
+/* Scans BLOCK for partitions of interest to Pintos, in a GUID
+   Partition Table if BLOCK has one and otherwise in its MBR and
+   any extended partition tables. */
 void
 partition_scan (struct block *block)
 {
   int part_nr = 0;
-  read_partition_table (block, 0, 0, &part_nr);
+  uint8_t *head;
+
+  /* Read the MBR and, in case this is a GPT disk, the GPT
+     header together. */
+  ASSERT (sizeof (struct partition_table) == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof (struct gpt_header) <= BLOCK_SECTOR_SIZE);
+  head = malloc (2 * BLOCK_SECTOR_SIZE);
+  if (head == NULL)
+    PANIC ("Failed to allocate memory for partition table.");
+  if (block_size (block) >= 2)
+    block_read_multi (block, 0, 2, head);
+  else
+    block_read (block, 0, head);
+
+  if (block_size (block) < 2
+      || !read_gpt (block, (struct partition_table *) head,
+                    (struct gpt_header *) (head + BLOCK_SECTOR_SIZE),
+                    &part_nr))
+    read_partition_table (block, 0, 0, (struct partition_table *) head,
+                          &part_nr);
+  free (head);
+
   if (part_nr == 0)
     printf ("%s: Device contains no partitions\n", block_name (block));
 }
 
+/* If MBR, sector 0 of BLOCK, is a protective MBR and HEADER,
+   sector 1, is a valid GPT header, registers the Pintos
+   partitions in the GPT entry array, which is read with a single
+   request, and returns true.  Otherwise returns false without
+   registering anything.  PART_NR is as for
+   read_partition_table(). */
+static bool
+read_gpt (struct block *block, const struct partition_table *mbr,
+          const struct gpt_header *header, int *part_nr)
+{
+  size_t bytes, sector_cnt, i;
+  uint8_t *entries;
+
+  if (mbr->signature != 0xaa55 || mbr->partitions[0].type != 0xee
+      || memcmp (header->signature, "EFI PART", 8)
+      || header->entry_size < sizeof (struct gpt_entry)
+      || header->entry_size % 8 != 0
+      || header->entries_lba < 2 || header->entries_lba >= block_size (block))
+    return false;
+
+  /* Read the whole entry array at once. */
+  bytes = (size_t) header->entry_cnt * header->entry_size;
+  if (header->entry_cnt > GPT_ENTRIES_MAX / header->entry_size)
+    {
+      printf ("%s: Only reading the first %zu GPT entries\n",
+              block_name (block), GPT_ENTRIES_MAX / header->entry_size);
+      bytes = GPT_ENTRIES_MAX / header->entry_size * header->entry_size;
+    }
+  sector_cnt = DIV_ROUND_UP (bytes, BLOCK_SECTOR_SIZE);
+  if (header->entries_lba + sector_cnt > block_size (block))
+    {
+      printf ("%s: GPT entries past end of device\n", block_name (block));
+      return true;
+    }
+  entries = malloc (sector_cnt * BLOCK_SECTOR_SIZE);
+  if (entries == NULL)
+    PANIC ("Failed to allocate memory for GPT entries.");
+  block_read_multi (block, header->entries_lba, sector_cnt, entries);
+
+  for (i = 0; i + header->entry_size <= bytes; i += header->entry_size)
+    {
+      const struct gpt_entry *e = (const struct gpt_entry *) (entries + i);
+      static const uint8_t unused[16];
+      uint8_t type;
+
+      if (!memcmp (e->type_guid, unused, sizeof unused))
+        continue;
+
+      ++*part_nr;
+      type = (!memcmp (e->type_guid, GPT_PINTOS_PREFIX,
+                       sizeof GPT_PINTOS_PREFIX)
+              ? e->type_guid[15] : 0xff);
+      if (e->last_lba < e->first_lba || e->last_lba >= block_size (block))
+        printf ("%s%d: Partition end (%"PRIu64") past end of device "
+                "(%"PRDSNu")\n", block_name (block), *part_nr,
+                e->last_lba, block_size (block));
+      else
+        found_partition (block, type, e->first_lba,
+                         e->last_lba - e->first_lba + 1, *part_nr);
+    }
+
+  free (entries);
+  return true;
+}
+
 /* Reads the partition table in the given SECTOR of BLOCK and
    scans it for partitions of interest to Pintos.
 
@@ -43,35 +199,18 @@ partition_scan (struct block *block)
    SECTOR, for use in finding logical partitions (see the large
    comment below).
 
+   If CONTENTS is non-null, it holds SECTOR's contents, already
+   read by the caller.
+
    PART_NR points to the number of non-empty primary or logical
    partitions already encountered on BLOCK.  It is incremented as
    partitions are found. */
 static void
 read_partition_table (struct block *block, block_sector_t sector,
                       block_sector_t primary_extended_sector,
+                      const struct partition_table *contents,
                       int *part_nr)
 {
-  /* Format of a partition table entry.  See [Partitions]. */
-  struct partition_table_entry
-    {
-      uint8_t bootable;         /* 0x00=not bootable, 0x80=bootable. */
-      uint8_t start_chs[3];     /* Encoded starting cylinder, head, sector. */
-      uint8_t type;             /* Partition type (see partition_type_name). */
-      uint8_t end_chs[3];       /* Encoded ending cylinder, head, sector. */
-      uint32_t offset;          /* Start sector offset from partition table. */
-      uint32_t size;            /* Number of sectors. */
-    }
-  PACKED;
-
-  /* Partition table sector. */
-  struct partition_table
-    {
-      uint8_t loader[446];      /* Loader, in top-level partition table. */
-      struct partition_table_entry partitions[4];       /* Table entries. */
-      uint16_t signature;       /* Should be 0xaa55. */
-    }
-  PACKED;
-
   struct partition_table *pt;
   size_t i;
 
@@ -88,7 +227,10 @@ read_partition_table (struct block *block, block_sector_t sector,
   pt = malloc (sizeof *pt);
   if (pt == NULL)
     PANIC ("Failed to allocate memory for partition table.");
-  block_read (block, 0, pt);
+  if (contents != NULL)
+    memcpy (pt, contents, sizeof *pt);
+  else
+    block_read (block, sector, pt);
 
   /* Check signature. */
   if (pt->signature != 0xaa55)
@@ -128,10 +270,11 @@ read_partition_table (struct block *block, block_sector_t sector,
              is nested, the offset is relative to the start of
              the extended partition that the MBR points to. */
           if (sector == 0)
-            read_partition_table (block, e->offset, e->offset, part_nr);
+            read_partition_table (block, e->offset, e->offset, NULL,
+                                  part_nr);
           else
             read_partition_table (block, e->offset + primary_extended_sector,
-                                  primary_extended_sector, part_nr);
+                                  primary_extended_sector, NULL, part_nr);
         }
       else
         {
@@ -298,27 +441,17 @@ partition_type_name (uint8_t type)
   return type_names[type] != NULL ? type_names[type] : "Unknown";
 }
 
-/* Reads sector SECTOR from partition P into BUFFER, which must
-   have room for BLOCK_SECTOR_SIZE bytes. */
-static void
-partition_read (void *p_, block_sector_t sector, void *buffer)
-{
-  struct partition *p = p_;
-  block_read (p->block, p->start + sector, buffer);
-}
-
-/* Write sector SECTOR to partition P from BUFFER, which must
-   contain BLOCK_SECTOR_SIZE bytes.  Returns after the block has
-   acknowledged receiving the data. */
+/* Passes request R for partition P on to the disk that contains
+   P, translating its sector number. */
 static void
-partition_write (void *p_, block_sector_t sector, const void *buffer)
+partition_submit (void *p_, struct block_request *r)
 {
   struct partition *p = p_;
-  block_write (p->block, p->start + sector, buffer);
+  r->sector += p->start;
+  block_submit (p->block, r);
 }
 
 static struct block_operations partition_operations =
   {
-    partition_read,
-    partition_write
+    .submit = partition_submit
   };
@@ -0,0 +1,24 @@
+#include "devices/pci.h"
+#include "threads/io.h"
+
+/* PCI configuration space access ports. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+/* Returns the 32-bit PCI configuration register at offset REG of
+   device DEV_NO on bus 0. */
+uint32_t
+pci_read_config (int dev_no, int reg)
+{
+  outl (PCI_CONFIG_ADDR, 0x80000000 | (dev_no << 11) | (reg & 0xfc));
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the 32-bit PCI configuration register at offset
+   REG of device DEV_NO on bus 0. */
+void
+pci_write_config (int dev_no, int reg, uint32_t value)
+{
+  outl (PCI_CONFIG_ADDR, 0x80000000 | (dev_no << 11) | (reg & 0xfc));
+  outl (PCI_CONFIG_DATA, value);
+}
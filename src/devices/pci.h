@@ -0,0 +1,13 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdint.h>
+
+/* Devices on PCI bus 0, which is the only bus that Pintos looks
+   at, are numbered 0 to PCI_DEV_CNT - 1. */
+#define PCI_DEV_CNT 32
+
+uint32_t pci_read_config (int dev_no, int reg);
+void pci_write_config (int dev_no, int reg, uint32_t value);
+
+#endif /* devices/pci.h */
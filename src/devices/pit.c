@@ -11,9 +11,6 @@
 #define PIT_PORT_CONTROL          0x43                /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
 
@@ -81,3 +78,47 @@ pit_configure_channel (int channel, int mode, int frequency)
   outb (PIT_PORT_COUNTER (channel), count >> 8);
   intr_set_level (old_level);
 }
+
+/* Starts channel 0 counting down from COUNT in mode 0, so that
+   it raises a single interrupt after COUNT PIT cycles and then
+   stays quiet until reconfigured.  Interrupts must be off. */
+void
+pit_start_oneshot (uint16_t count)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (count > 0);
+
+  outb (PIT_PORT_CONTROL, 0x30);
+  outb (PIT_PORT_COUNTER (0), count);
+  outb (PIT_PORT_COUNTER (0), count >> 8);
+}
+
+/* Returns the current value of channel 0's counter.  In modes 2
+   and 3 this is the number of PIT cycles until the next period
+   starts, in mode 0 the number until the interrupt.  Interrupts
+   must be off. */
+uint16_t
+pit_read_count (void)
+{
+  uint16_t count;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  outb (PIT_PORT_CONTROL, 0x00);        /* Latch channel 0's count. */
+  count = inb (PIT_PORT_COUNTER (0));
+  count |= inb (PIT_PORT_COUNTER (0)) << 8;
+  return count;
+}
+
+/* Returns true if channel 0's output is high, which in mode 0
+   means that the count has run out and the interrupt has been
+   raised.  Interrupts must be off. */
+bool
+pit_output (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* Read-back command latching channel 0's status only. */
+  outb (PIT_PORT_CONTROL, 0xe2);
+  return (inb (PIT_PORT_COUNTER (0)) & 0x80) != 0;
+}
@@ -1,8 +1,17 @@
 #ifndef DEVICES_PIT_H
 #define DEVICES_PIT_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
+/* PIT cycles per second. */
+#define PIT_HZ 1193180
+
 void pit_configure_channel (int channel, int mode, int frequency);
 
+/* Channel 0 one-shot support, for tickless idle. */
+void pit_start_oneshot (uint16_t count);
+uint16_t pit_read_count (void);
+bool pit_output (void);
+
 #endif /* devices/pit.h */
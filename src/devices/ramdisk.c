@@ -0,0 +1,81 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A block device kept in kernel memory, for swap and scratch
+   space without the cost of disk I/O.  Its contents do not
+   survive a reboot. */
+
+/* Sectors per page of RAM disk memory. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Reads sector SECTOR of the RAM disk at BASE into BUFFER. */
+static void
+ramdisk_read (void *base, block_sector_t sector, void *buffer)
+{
+  memcpy (buffer, (uint8_t *) base + sector * BLOCK_SECTOR_SIZE,
+          BLOCK_SECTOR_SIZE);
+}
+
+/* Writes BUFFER to sector SECTOR of the RAM disk at BASE. */
+static void
+ramdisk_write (void *base, block_sector_t sector, const void *buffer)
+{
+  memcpy ((uint8_t *) base + sector * BLOCK_SECTOR_SIZE, buffer,
+          BLOCK_SECTOR_SIZE);
+}
+
+/* Reads CNT sectors starting at SECTOR of the RAM disk at BASE
+   into BUFFER. */
+static void
+ramdisk_read_multi (void *base, block_sector_t sector, size_t cnt,
+                    void *buffer)
+{
+  memcpy (buffer, (uint8_t *) base + sector * BLOCK_SECTOR_SIZE,
+          cnt * BLOCK_SECTOR_SIZE);
+}
+
+/* Writes CNT sectors from BUFFER starting at SECTOR of the RAM
+   disk at BASE. */
+static void
+ramdisk_write_multi (void *base, block_sector_t sector, size_t cnt,
+                     const void *buffer)
+{
+  memcpy ((uint8_t *) base + sector * BLOCK_SECTOR_SIZE, buffer,
+          cnt * BLOCK_SECTOR_SIZE);
+}
+
+static struct block_operations ramdisk_operations =
+  {
+    ramdisk_read,
+    ramdisk_write,
+    ramdisk_read_multi,
+    ramdisk_write_multi,
+    NULL,
+    NULL
+  };
+
+/* Creates a RAM disk of KB kilobytes, rounded up to whole pages,
+   and registers it as block device "ram0", which can then be
+   chosen with -swap or -scratch.  Does nothing if KB is 0.
+   Panics if there is not enough contiguous kernel memory. */
+void
+ramdisk_init (size_t kb)
+{
+  size_t page_cnt = DIV_ROUND_UP (kb * 1024, PGSIZE);
+  void *base;
+
+  if (page_cnt == 0)
+    return;
+
+  base = palloc_get_multiple (PAL_ZERO, page_cnt);
+  if (base == NULL)
+    PANIC ("ramdisk: cannot allocate %zu pages", page_cnt);
+  block_register ("ram0", BLOCK_RAW, "RAM disk",
+                  page_cnt * SECTORS_PER_PAGE, &ramdisk_operations, base);
+}
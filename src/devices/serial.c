@@ -1,7 +1,6 @@
 #include "devices/serial.h"
 #include <debug.h>
 #include "devices/input.h"
-#include "devices/intq.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
@@ -33,6 +32,13 @@
 #define MCR_REG (IO_BASE + 4)   /* MODEM Control Register. */
 #define LSR_REG (IO_BASE + 5)   /* Line Status Register (read-only). */
 
+/* FIFO Control Register bits. */
+#define FCR_ENABLE 0x01         /* Enable FIFOs. */
+#define FCR_CLEAR 0x06          /* Clear receive and transmit FIFOs. */
+
+/* Interrupt Identification Register bits. */
+#define IIR_FIFO 0xc0           /* Both set if FIFOs are enabled. */
+
 /* Interrupt Enable Register bits. */
 #define IER_RECV 0x01           /* Interrupt when data received. */
 #define IER_XMIT 0x02           /* Interrupt when transmit finishes. */
@@ -51,12 +57,25 @@
 /* Transmission mode. */
 static enum { UNINIT, POLL, QUEUE } mode;
 
-/* Data to be transmitted. */
-static struct intq txq;
+/* Data to be transmitted, in a circular buffer large enough to
+   absorb bursts of console output.  serial_putc() adds bytes at
+   txq_head and serial_interrupt() removes them at txq_tail; each
+   index is written by only one side. */
+#define TXQ_SIZE 8192           /* Power of 2. */
+static uint8_t txq[TXQ_SIZE];
+static unsigned txq_head;
+static unsigned txq_tail;
+
+/* Bytes to write to the UART per transmit interrupt: the size of
+   the 16550's transmit FIFO, or 1 if it has none. */
+static int xmit_burst = 1;
 
 static void set_serial (int bps);
 static void putc_poll (uint8_t);
 static void write_ier (void);
+static bool txq_empty (void);
+static bool txq_full (void);
+static uint8_t txq_get (void);
 static intr_handler_func serial_interrupt;
 
 /* Initializes the serial port device for polling mode.
@@ -71,7 +90,6 @@ init_poll (void)
   outb (FCR_REG, 0);                    /* Disable FIFO. */
   set_serial (9600);                    /* 9.6 kbps, N-8-1. */
   outb (MCR_REG, MCR_OUT2);             /* Required to enable interrupts. */
-  intq_init (&txq);
   mode = POLL;
 } 
 
@@ -87,6 +105,15 @@ serial_init_queue (void)
     init_poll ();
   ASSERT (mode == POLL);
 
+  /* Use the FIFOs, if the UART has them, to send a burst of bytes
+     per transmit interrupt.  The receive FIFO still interrupts on
+     every byte. */
+  outb (FCR_REG, FCR_ENABLE | FCR_CLEAR);
+  if ((inb (IIR_REG) & IIR_FIFO) == IIR_FIFO)
+    xmit_burst = 16;
+  else
+    outb (FCR_REG, 0);
+
   intr_register_ext (0x20 + 4, serial_interrupt, "serial");
   mode = QUEUE;
   old_level = intr_disable ();
@@ -97,32 +124,39 @@ serial_init_queue (void)
 /* Sends BYTE to the serial port. */
 void
 serial_putc (uint8_t byte) 
+{
+  char c = byte;
+  serial_putbuf (&c, 1);
+}
+
+/* Sends the N bytes in BUFFER to the serial port. */
+void
+serial_putbuf (const char *buffer, size_t n) 
 {
   enum intr_level old_level = intr_disable ();
 
   if (mode != QUEUE)
     {
       /* If we're not set up for interrupt-driven I/O yet,
-         use dumb polling to transmit a byte. */
+         use dumb polling to transmit the bytes. */
       if (mode == UNINIT)
         init_poll ();
-      putc_poll (byte); 
+      while (n-- > 0)
+        putc_poll (*buffer++); 
     }
   else 
     {
-      /* Otherwise, queue a byte and update the interrupt enable
-         register. */
-      if (old_level == INTR_OFF && intq_full (&txq)) 
+      /* Otherwise, queue the bytes and update the interrupt enable
+         register.  If the queue is full, which takes a long burst
+         of output, make room by sending the oldest byte by
+         polling: that takes no longer than waiting for the
+         interrupt handler would. */
+      while (n-- > 0)
         {
-          /* Interrupts are off and the transmit queue is full.
-             If we wanted to wait for the queue to empty,
-             we'd have to reenable interrupts.
-             That's impolite, so we'll send a character via
-             polling instead. */
-          putc_poll (intq_getc (&txq)); 
+          if (txq_full ())
+            putc_poll (txq_get ());
+          txq[txq_head++ % TXQ_SIZE] = *buffer++;
         }
-
-      intq_putc (&txq, byte); 
       write_ier ();
     }
   
@@ -135,8 +169,8 @@ void
 serial_flush (void) 
 {
   enum intr_level old_level = intr_disable ();
-  while (!intq_empty (&txq))
-    putc_poll (intq_getc (&txq));
+  while (!txq_empty ())
+    putc_poll (txq_get ());
   intr_set_level (old_level);
 }
 
@@ -182,7 +216,7 @@ write_ier (void)
 
   /* Enable transmit interrupt if we have any characters to
      transmit. */
-  if (!intq_empty (&txq))
+  if (!txq_empty ())
     ier |= IER_XMIT;
 
   /* Enable receive interrupt if we have room to store any
@@ -218,11 +252,40 @@ serial_interrupt (struct intr_frame *f UNUSED)
   while (!input_full () && (inb (LSR_REG) & LSR_DR) != 0)
     input_putc (inb (RBR_REG));
 
-  /* As long as we have a byte to transmit, and the hardware is
-     ready to accept a byte for transmission, transmit a byte. */
-  while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0) 
-    outb (THR_REG, intq_getc (&txq));
+  /* Whenever the hardware has emptied its transmit FIFO, refill
+     it with up to a burst of bytes. */
+  while (!txq_empty () && (inb (LSR_REG) & LSR_THRE) != 0) 
+    {
+      int i;
+
+      for (i = 0; i < xmit_burst && !txq_empty (); i++)
+        outb (THR_REG, txq_get ());
+    }
 
   /* Update interrupt enable register based on queue status. */
   write_ier ();
 }
+
+/* Returns true if the transmit queue is empty. */
+static bool
+txq_empty (void) 
+{
+  return txq_head == txq_tail;
+}
+
+/* Returns true if the transmit queue is full. */
+static bool
+txq_full (void) 
+{
+  return txq_head - txq_tail == TXQ_SIZE;
+}
+
+/* Removes and returns the oldest byte in the transmit queue,
+   which must not be empty.  Interrupts must be off. */
+static uint8_t
+txq_get (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!txq_empty ());
+  return txq[txq_tail++ % TXQ_SIZE];
+}
@@ -4,8 +4,13 @@
 #include "devices/kbd.h"
 #include "devices/serial.h"
 #include "devices/timer.h"
+#include "threads/gcov.h"
+#include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/profile.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
 #endif
@@ -20,6 +25,9 @@
 /* How to shut down when shutdown() is called. */
 static enum shutdown_type how = SHUTDOWN_NONE;
 
+/* What shutdown_power_off() reports to the simulator. */
+static enum shutdown_verdict verdict = SHUTDOWN_PASS;
+
 static void print_stats (void);
 
 /* Shuts down the machine in the way configured by
@@ -52,6 +60,16 @@ shutdown_configure (enum shutdown_type type)
   how = type;
 }
 
+/* Records V as the outcome of the run.  The first verdict other
+   than SHUTDOWN_PASS sticks, so that the panic that follows a
+   test failure does not hide it. */
+void
+shutdown_set_verdict (enum shutdown_verdict v)
+{
+  if (verdict == SHUTDOWN_PASS)
+    verdict = v;
+}
+
 /* Reboots the machine via the keyboard controller. */
 void
 shutdown_reboot (void)
@@ -95,10 +113,20 @@ shutdown_power_off (void)
 #endif
 
   print_stats ();
+  gcov_dump ();
 
   printf ("Powering off...\n");
   serial_flush ();
 
+  /* QEMU's isa-debug-exit device, which the "pintos" script adds,
+     exits on any write to its port (0x501), with an exit status of
+     double the value plus one, so there is no way to exit with 0.
+     0x31 plus the verdict gives 0x63 for a clean run, 0x65 after a
+     test failure and 0x67 after a panic, which "pintos" turns into
+     its own exit status.  This goes first because it is the only
+     method that carries the verdict. */
+  outb (0x501, 0x31 + verdict);
+
   /* ACPI power-off */
   outw (0xB004, 0x2000);
 
@@ -107,13 +135,6 @@ shutdown_power_off (void)
   for (p = s; *p != '\0'; p++)
     outb (0x8900, *p);
 
-  /* For newer versions of qemu, you must run with -device
-   * isa-debug-exit, which exits on any write to an IO port (by
-   * default 0x501).  Qemu's exit code is double the value plus one,
-   * so there is no way to exit cleanly.  We use 0x31 which should
-   * result in a qemu exit code of 0x63.  */
-  outb (0x501, 0x31);
-
   /* This will power off a VMware VM if "gui.exitOnCLIHLT = TRUE"
      is set in its configuration file.  (The "pintos" script does
      that automatically.)  */
@@ -130,6 +151,17 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  if (trace_enabled)
+    trace_dump ();
+  if (profile_enabled)
+    profile_print_stats ();
+  if (lock_stats_enabled)
+    lock_print_stats ();
+  if (malloc_stats_enabled)
+    malloc_print_stats ();
+  malloc_print_sites ();
+  if (intr_stats_enabled)
+    intr_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
 #endif
@@ -11,8 +11,17 @@ enum shutdown_type
     SHUTDOWN_REBOOT,            /* Reboot the machine (if possible). */
   };
 
+/* Outcome of the run, reported to the simulator at power-off. */
+enum shutdown_verdict
+  {
+    SHUTDOWN_PASS,              /* Nothing went wrong. */
+    SHUTDOWN_FAIL,              /* A test failed. */
+    SHUTDOWN_PANIC,             /* The kernel panicked. */
+  };
+
 void shutdown (void);
 void shutdown_configure (enum shutdown_type);
+void shutdown_set_verdict (enum shutdown_verdict);
 void shutdown_reboot (void) NO_RETURN;
 void shutdown_power_off (void) NO_RETURN;
 
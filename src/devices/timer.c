@@ -1,12 +1,16 @@
 #include "devices/timer.h"
 #include <debug.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <round.h>
 #include <stdio.h>
 #include "devices/pit.h"
 #include "threads/interrupt.h"
+#include "threads/profile.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/tunable.h"
+#include "threads/workqueue.h"
   
 /* See [8254] for hardware details of the 8254 timer chip. */
 
@@ -20,50 +24,295 @@
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* Threads sleeping in timer_sleep(), as a heap ordered by
+   wakeup_tick, then by the order in which they went to sleep. */
+static struct heap sleep_heap;
+static unsigned sleep_seq;
+
+/* Alarms set with timer_alarm_set(), ordered by tick. */
+static struct heap alarm_heap;
+
+/* Wakes the sleepers and fires the alarms that are due, after the
+   timer interrupt handler itself returns. */
+static struct intr_deferred timer_deferred;
+
 /* Number of loops per timer tick.
-   Initialized by timer_calibrate(). */
+   Initialized by timer_calibrate() or timer_preset_calibration(). */
 static unsigned loops_per_tick;
 
+/* Number of CPU time-stamp counter cycles per timer tick.
+   Initialized by timer_calibrate() or timer_preset_calibration(). */
+static uint64_t cycles_per_tick;
+
+/* The clock read by timer_clock_ns(): the tick that began at
+   time-stamp counter value clock_base_cycles.
+   Initialized by timer_calibrate(). */
+static int64_t clock_base_ticks;
+static uint64_t clock_base_cycles;
+
+/* Nanoseconds per timer tick. */
+#define NS_PER_TICK (1000 * 1000 * 1000 / TIMER_FREQ)
+
+/* PIT cycles per timer tick. */
+#define PIT_PER_TICK ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Tickless idle.  While the idle thread runs and no sleeper is due
+   for at least tickless_min ticks, the PIT is in one-shot mode,
+   set to interrupt at the tick boundary ONESHOT_TICKS ticks after
+   it was entered, ONESHOT_COUNT PIT cycles later.  Ticks that pass
+   meanwhile are accounted when it leaves one-shot mode. */
+#define TICKLESS_MIN 2           /* Default for tickless_min. */
+static int64_t tickless_min;
+static bool oneshot;
+static int64_t oneshot_ticks;
+static unsigned oneshot_count;
+
 static intr_handler_func timer_interrupt;
-static bool too_many_loops (unsigned loops);
+static heap_less_func wakeup_less;
+static heap_less_func alarm_less;
+static unsigned time_loops (unsigned loops, uint64_t *cycles);
+static void set_clock_base (void);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
+static void leave_oneshot (void);
+static bool timer_work_due (void);
+static void timer_deferred_work (void *aux);
+static bool wake_sleeper (void);
+static bool fire_alarm (void);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
 void
 timer_init (void) 
 {
+  tickless_min = tunable_int ("tickless_min", TICKLESS_MIN, 2, INT_MAX);
   pit_configure_channel (0, 2, TIMER_FREQ);
+  heap_init (&sleep_heap, wakeup_less, NULL);
+  heap_init (&alarm_heap, alarm_less, NULL);
+  intr_deferred_init (&timer_deferred, timer_deferred_work, NULL);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Uses LOOPS and CYCLES per tick, as printed by timer_calibrate()
+   on an earlier boot of the same machine, instead of measuring
+   them.  Called for the -calibrate option, before
+   timer_calibrate(). */
 void
-timer_calibrate (void) 
+timer_preset_calibration (unsigned loops, unsigned cycles) 
 {
-  unsigned high_bit, test_bit;
+  loops_per_tick = loops;
+  cycles_per_tick = cycles;
+}
+
+/* Calibrates loops_per_tick, used to implement brief delays, and
+   cycles_per_tick, used by timer_clock_ns(), unless
+   timer_preset_calibration() gave them.
 
+   Both are timed against channel 0 of the PIT, which counts down
+   PIT_PER_TICK cycles every tick, over a stretch of a quarter to
+   half a tick, so this takes well under a tick in all. */
+void
+timer_calibrate (void) 
+{
   ASSERT (intr_get_level () == INTR_ON);
-  printf ("Calibrating timer...  ");
 
-  /* Approximate loops_per_tick as the largest power-of-two
-     still less than one timer tick. */
-  loops_per_tick = 1u << 10;
-  while (!too_many_loops (loops_per_tick << 1)) 
+  if (loops_per_tick == 0 || cycles_per_tick == 0)
     {
-      loops_per_tick <<= 1;
-      ASSERT (loops_per_tick != 0);
+      unsigned loops, elapsed;
+      uint64_t cycles;
+
+      printf ("Calibrating timer...  ");
+
+      /* Double LOOPS until it takes at least a quarter of a tick.
+         The last try then took at most about half a tick, which
+         the PIT's count can measure without wrapping around. */
+      for (loops = 1u << 10; ; loops <<= 1)
+        {
+          elapsed = time_loops (loops, &cycles);
+          if (elapsed >= PIT_PER_TICK / 4)
+            break;
+          ASSERT (loops < 1u << 31);
+        }
+      loops_per_tick = (uint64_t) loops * PIT_PER_TICK / elapsed;
+      cycles_per_tick = cycles * PIT_PER_TICK / elapsed;
+
+      printf ("%'"PRIu64" loops/s (-calibrate=%u,%"PRIu64").\n",
+              (uint64_t) loops_per_tick * TIMER_FREQ, loops_per_tick,
+              cycles_per_tick);
     }
+  else
+    printf ("Timer calibration given: %'"PRIu64" loops/s.\n",
+            (uint64_t) loops_per_tick * TIMER_FREQ);
 
-  /* Refine the next 8 bits of loops_per_tick. */
-  high_bit = loops_per_tick;
-  for (test_bit = high_bit >> 1; test_bit != high_bit >> 10; test_bit >>= 1)
-    if (!too_many_loops (loops_per_tick | test_bit))
-      loops_per_tick |= test_bit;
+  set_clock_base ();
+}
 
-  printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+/* Runs LOOPS iterations of busy_wait() with interrupts off.
+   Returns the PIT cycles they took, which must be less than a
+   tick, and stores the time-stamp counter cycles in *CYCLES. */
+static unsigned
+time_loops (unsigned loops, uint64_t *cycles) 
+{
+  enum intr_level old_level = intr_disable ();
+  unsigned start = pit_read_count ();
+  uint64_t start_cycles = timer_cycles ();
+  unsigned end;
+
+  busy_wait (loops);
+  *cycles = timer_cycles () - start_cycles;
+  end = pit_read_count ();
+  intr_set_level (old_level);
+
+  return (start - end + PIT_PER_TICK) % PIT_PER_TICK;
+}
+
+/* Starts the clock read by timer_clock_ns() at the current tick,
+   finding when it began from the PIT's count. */
+static void
+set_clock_base (void) 
+{
+  for (;;)
+    {
+      enum intr_level old_level = intr_disable ();
+      unsigned count = pit_read_count ();
+      int64_t now = ticks;
+      uint64_t now_cycles = timer_cycles ();
+
+      intr_set_level (old_level);
+
+      /* Just after a tick begins, its interrupt may not have
+         counted it in TICKS yet, so wait a little. */
+      if (count <= PIT_PER_TICK - PIT_PER_TICK / 8)
+        {
+          clock_base_ticks = now;
+          clock_base_cycles = (now_cycles - (PIT_PER_TICK - count)
+                               * cycles_per_tick / PIT_PER_TICK);
+          return;
+        }
+    }
+}
+
+/* Returns the CPU's time-stamp counter, which counts cycles
+   since the CPU was reset. */
+uint64_t
+timer_cycles (void) 
+{
+  uint64_t cycles;
+  asm volatile ("rdtsc" : "=A" (cycles));
+  return cycles;
+}
+
+/* Returns the nanoseconds elapsed since boot, as measured by the
+   time-stamp counter against the timer's rate.  Never goes
+   backward.  Before timer_calibrate(), has only tick
+   resolution. */
+int64_t
+timer_clock_ns (void) 
+{
+  uint64_t cycles;
+
+  if (cycles_per_tick == 0)
+    return timer_ticks () * NS_PER_TICK;
+  cycles = timer_cycles () - clock_base_cycles;
+  return ((clock_base_ticks + (int64_t) (cycles / cycles_per_tick))
+          * NS_PER_TICK
+          + (int64_t) (cycles % cycles_per_tick * NS_PER_TICK
+                       / cycles_per_tick));
+}
+
+/* Converts CYCLES, a difference between timer_cycles() values,
+   to microseconds.  Returns 0 before timer_calibrate(). */
+int64_t
+timer_cycles_to_us (uint64_t cycles) 
+{
+  if (cycles_per_tick == 0)
+    return 0;
+  return cycles * (1000 * 1000 / TIMER_FREQ) / cycles_per_tick;
+}
+
+/* Called by the idle thread, with interrupts off, just before it
+   halts the CPU.  If no sleeper or delayed work is due for a
+   while, replaces the periodic timer interrupt by a single one at
+   the tick on which the first is due, or as late as the PIT
+   allows. */
+void
+timer_idle_enter (void) 
+{
+  int64_t delta = INT64_MAX;
+  unsigned first, max_delta;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (oneshot)
+    return;
+  if (!heap_empty (&sleep_heap))
+    delta = heap_entry (heap_top (&sleep_heap),
+                        struct thread, sleep_elem)->wakeup_tick - ticks;
+  if (workqueue_next_due () - ticks < delta)
+    delta = workqueue_next_due () - ticks;
+  if (!heap_empty (&alarm_heap)
+      && heap_entry (heap_top (&alarm_heap),
+                     struct timer_alarm, elem)->tick - ticks < delta)
+    delta = heap_entry (heap_top (&alarm_heap),
+                        struct timer_alarm, elem)->tick - ticks;
+
+  /* The next periodic interrupt is FIRST PIT cycles away, and the
+     ones after it PIT_PER_TICK cycles apart. */
+  first = pit_read_count ();
+  if (first == 0 || first > PIT_PER_TICK)
+    return;
+  max_delta = 1 + (UINT16_MAX - first) / PIT_PER_TICK;
+  if (delta > max_delta)
+    delta = max_delta;
+  if (delta < tickless_min)
+    return;
+
+  oneshot = true;
+  oneshot_ticks = delta;
+  oneshot_count = first + (delta - 1) * PIT_PER_TICK;
+  pit_start_oneshot (oneshot_count);
+}
+
+/* Called by the scheduler, with interrupts off, when the idle
+   thread gives up the CPU, to bring back the periodic timer
+   interrupt. */
+void
+timer_idle_exit (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  leave_oneshot ();
+}
+
+/* Leaves one-shot mode, if the PIT is in it: restarts the periodic
+   timer and accounts for the ticks that passed meanwhile as idle
+   ticks.  If the one-shot interrupt has been raised, the timer
+   interrupt that it causes accounts for the last of them. */
+static void
+leave_oneshot (void) 
+{
+  int64_t passed;
+
+  if (!oneshot)
+    return;
+
+  if (pit_output ())
+    passed = oneshot_ticks - 1;
+  else
+    {
+      unsigned first = oneshot_count - (oneshot_ticks - 1) * PIT_PER_TICK;
+      unsigned elapsed = oneshot_count - pit_read_count ();
+
+      passed = elapsed < first ? 0 : 1 + (elapsed - first) / PIT_PER_TICK;
+    }
+
+  pit_configure_channel (0, 2, TIMER_FREQ);
+  oneshot = false;
+  while (passed-- > 0)
+    {
+      ticks++;
+      thread_idle_tick ();
+    }
 }
 
 /* Returns the number of timer ticks since the OS booted. */
@@ -85,15 +334,62 @@ timer_elapsed (int64_t then)
 }
 
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+   be turned on.
+
+   The calling thread is blocked on sleep_heap until the timer
+   interrupt's deferred work finds its wakeup tick has arrived, so
+   it consumes no CPU time while asleep. */
 void
 timer_sleep (int64_t ticks) 
 {
-  int64_t start = timer_ticks ();
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
   ASSERT (intr_get_level () == INTR_ON);
-  while (timer_elapsed (start) < ticks) 
-    thread_yield ();
+  if (ticks <= 0)
+    return;
+
+  old_level = intr_disable ();
+  cur->wakeup_tick = timer_ticks () + ticks;
+  cur->sleep_seq = sleep_seq++;
+  heap_push (&sleep_heap, &cur->sleep_elem);
+  thread_block ();
+  intr_set_level (old_level);
+}
+
+/* Arranges for FUNC (AUX) to be called from the timer interrupt's
+   deferred work, with interrupts off, TICKS timer ticks from now, or on the next tick if
+   TICKS is not positive.  ALARM must not be set already. */
+void
+timer_alarm_set (struct timer_alarm *alarm, int64_t ticks,
+                 void (*func) (void *aux), void *aux) 
+{
+  enum intr_level old_level;
+
+  ASSERT (alarm != NULL && func != NULL);
+
+  old_level = intr_disable ();
+  alarm->tick = timer_ticks () + (ticks > 0 ? ticks : 1);
+  alarm->func = func;
+  alarm->aux = aux;
+  alarm->armed = true;
+  heap_push (&alarm_heap, &alarm->elem);
+  intr_set_level (old_level);
+}
+
+/* Cancels ALARM if it is set and not yet due.  Once this returns,
+   its function is not running and will not be called. */
+void
+timer_alarm_cancel (struct timer_alarm *alarm) 
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (alarm->armed)
+    {
+      heap_remove (&alarm_heap, &alarm->elem);
+      alarm->armed = false;
+    }
+  intr_set_level (old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -168,29 +464,121 @@ timer_print_stats (void)
 
 /* Timer interrupt handler. */
 static void
-timer_interrupt (struct intr_frame *args UNUSED)
+timer_interrupt (struct intr_frame *args)
 {
+  leave_oneshot ();
   ticks++;
-  thread_tick ();
+  if (profile_enabled)
+    profile_sample (args);
+
+  if (timer_work_due ())
+    intr_defer (&timer_deferred);
+
+  thread_tick ((args->cs & 3) == 3);
+  thread_yield_to_higher ();
 }
 
-/* Returns true if LOOPS iterations waits for more than one timer
-   tick, otherwise false. */
+/* Returns true if a sleeper, alarm, or delayed work is due. */
 static bool
-too_many_loops (unsigned loops) 
+timer_work_due (void) 
 {
-  /* Wait for a timer tick. */
-  int64_t start = ticks;
-  while (ticks == start)
-    barrier ();
+  return ((!heap_empty (&sleep_heap)
+           && heap_entry (heap_top (&sleep_heap),
+                          struct thread, sleep_elem)->wakeup_tick <= ticks)
+          || (!heap_empty (&alarm_heap)
+              && heap_entry (heap_top (&alarm_heap),
+                             struct timer_alarm, elem)->tick <= ticks)
+          || workqueue_next_due () <= ticks);
+}
 
-  /* Run LOOPS loops. */
-  start = ticks;
-  busy_wait (loops);
+/* Deferred part of the timer interrupt.  Wakes every sleeper and
+   fires every alarm whose time has come, earliest first, turning
+   interrupts off for one at a time only, so that however many
+   come due at once, other interrupts wait no longer than for a
+   single one. */
+static void
+timer_deferred_work (void *aux UNUSED) 
+{
+  enum intr_level old_level;
+
+  while (wake_sleeper () || fire_alarm ())
+    continue;
 
-  /* If the tick count changed, we iterated too long. */
-  barrier ();
-  return start != ticks;
+  old_level = intr_disable ();
+  workqueue_tick (ticks);
+  intr_set_level (old_level);
+
+  thread_yield_to_higher ();
+}
+
+/* Wakes the first sleeper if it is due.  Returns true if it
+   woke one. */
+static bool
+wake_sleeper (void) 
+{
+  enum intr_level old_level = intr_disable ();
+  struct thread *t = NULL;
+
+  if (!heap_empty (&sleep_heap))
+    {
+      t = heap_entry (heap_top (&sleep_heap), struct thread, sleep_elem);
+      if (t->wakeup_tick <= ticks)
+        {
+          heap_pop (&sleep_heap);
+          thread_unblock (t);
+        }
+      else
+        t = NULL;
+    }
+  intr_set_level (old_level);
+  return t != NULL;
+}
+
+/* Fires the first alarm if it is due.  Returns true if it fired
+   one. */
+static bool
+fire_alarm (void) 
+{
+  enum intr_level old_level = intr_disable ();
+  struct timer_alarm *alarm = NULL;
+
+  if (!heap_empty (&alarm_heap))
+    {
+      alarm = heap_entry (heap_top (&alarm_heap), struct timer_alarm, elem);
+      if (alarm->tick <= ticks)
+        {
+          heap_pop (&alarm_heap);
+          alarm->armed = false;
+          alarm->func (alarm->aux);
+        }
+      else
+        alarm = NULL;
+    }
+  intr_set_level (old_level);
+  return alarm != NULL;
+}
+
+/* Orders threads in sleep_heap by increasing wakeup_tick.
+   Threads with equal wakeup ticks keep their insertion order. */
+static bool
+wakeup_less (const struct heap_elem *a_, const struct heap_elem *b_,
+             void *aux UNUSED)
+{
+  const struct thread *a = heap_entry (a_, struct thread, sleep_elem);
+  const struct thread *b = heap_entry (b_, struct thread, sleep_elem);
+
+  if (a->wakeup_tick != b->wakeup_tick)
+    return a->wakeup_tick < b->wakeup_tick;
+  return (int) (a->sleep_seq - b->sleep_seq) < 0;
+}
+
+/* Orders alarms in alarm_heap by increasing tick. */
+static bool
+alarm_less (const struct heap_elem *a, const struct heap_elem *b,
+            void *aux UNUSED)
+{
+  return (heap_entry (a, struct timer_alarm, elem)->tick
+          < heap_entry (b, struct timer_alarm, elem)->tick);
 }
 
 /* Iterates through a simple loop LOOPS times, for implementing
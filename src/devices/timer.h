@@ -1,29 +1,56 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <heap.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
 void timer_init (void);
+void timer_preset_calibration (unsigned loops, unsigned cycles);
 void timer_calibrate (void);
 
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
 
+/* Fine-grained time, from the CPU's time-stamp counter. */
+uint64_t timer_cycles (void);
+int64_t timer_cycles_to_us (uint64_t cycles);
+int64_t timer_clock_ns (void);
+
 /* Sleep and yield the CPU to other threads. */
 void timer_sleep (int64_t ticks);
 void timer_msleep (int64_t milliseconds);
 void timer_usleep (int64_t microseconds);
 void timer_nsleep (int64_t nanoseconds);
 
+/* Alarm: calls FUNC (AUX) from the timer interrupt's deferred
+   work once a given tick arrives, unless cancelled first. */
+struct timer_alarm
+  {
+    struct heap_elem elem;      /* Element in alarm heap. */
+    int64_t tick;               /* Tick when due. */
+    void (*func) (void *aux);   /* Function to call. */
+    void *aux;                  /* Its argument. */
+    bool armed;                 /* Set and not yet due or cancelled? */
+  };
+
+void timer_alarm_set (struct timer_alarm *, int64_t ticks,
+                      void (*func) (void *aux), void *aux);
+void timer_alarm_cancel (struct timer_alarm *);
+
 /* Busy waits. */
 void timer_mdelay (int64_t milliseconds);
 void timer_udelay (int64_t microseconds);
 void timer_ndelay (int64_t nanoseconds);
 
+/* Tickless idle, for the scheduler. */
+void timer_idle_enter (void);
+void timer_idle_exit (void);
+
 void timer_print_stats (void);
 
 #endif /* devices/timer.h */
@@ -14,22 +14,35 @@
 #define COL_CNT 80
 #define ROW_CNT 25
 
+/* Rows of video memory that we scroll through.  The display shows
+   ROW_CNT of them starting at row `top', which the CRTC start
+   address selects, so scrolling by a line is a register write.
+   Only when the display reaches the last of these rows are its
+   rows copied back to the start.  vga_putbuf() writes the register
+   once for all the lines it outputs.  The 32 kB of text memory hold
+   204 rows. */
+#define BUF_ROWS 200
+
 /* Current cursor position.  (0,0) is in the upper left corner of
    the display. */
 static size_t cx, cy;
 
+/* Row of video memory shown at the top of the display. */
+static size_t top;
+
 /* Attribute value for gray text on a black background. */
 #define GRAY_ON_BLACK 0x07
 
 /* Framebuffer.  See [FREEVGA] under "VGA Text Mode Operation".
-   The character at (x,y) is fb[y][x][0].
-   The attribute at (x,y) is fb[y][x][1]. */
+   The character at (x,y) on the display is fb[top + y][x][0].
+   The attribute at (x,y) is fb[top + y][x][1]. */
 static uint8_t (*fb)[COL_CNT][2];
 
 static void clear_row (size_t y);
 static void cls (void);
 static void newline (void);
 static void move_cursor (void);
+static void set_start (void);
 static void find_cursor (size_t *x, size_t *y);
 
 /* Initializes the VGA text display. */
@@ -42,6 +55,7 @@ init (void)
     {
       fb = ptov (0xb8000);
       find_cursor (&cx, &cy);
+      set_start ();
       inited = true; 
     }
 }
@@ -50,6 +64,16 @@ init (void)
    characters in the conventional ways.  */
 void
 vga_putc (int c)
+{
+  char ch = c;
+  vga_putbuf (&ch, 1);
+}
+
+/* Writes the N characters in BUFFER to the VGA text display, as
+   vga_putc() would, but moves the hardware cursor and scrolls the
+   display only once. */
+void
+vga_putbuf (const char *buffer, size_t n)
 {
   /* Disable interrupts to lock out interrupt handlers
      that might write to the console. */
@@ -57,51 +81,57 @@ vga_putc (int c)
 
   init ();
   
-  switch (c) 
+  while (n-- > 0)
     {
-    case '\n':
-      newline ();
-      break;
-
-    case '\f':
-      cls ();
-      break;
-
-    case '\b':
-      if (cx > 0)
-        cx--;
-      break;
-      
-    case '\r':
-      cx = 0;
-      break;
-
-    case '\t':
-      cx = ROUND_UP (cx + 1, 8);
-      if (cx >= COL_CNT)
-        newline ();
-      break;
-
-    case '\a':
-      intr_set_level (old_level);
-      speaker_beep ();
-      intr_disable ();
-      break;
-      
-    default:
-      fb[cy][cx][0] = c;
-      fb[cy][cx][1] = GRAY_ON_BLACK;
-      if (++cx >= COL_CNT)
-        newline ();
-      break;
+      uint8_t c = *buffer++;
+
+      switch (c) 
+        {
+        case '\n':
+          newline ();
+          break;
+
+        case '\f':
+          cls ();
+          break;
+
+        case '\b':
+          if (cx > 0)
+            cx--;
+          break;
+          
+        case '\r':
+          cx = 0;
+          break;
+
+        case '\t':
+          cx = ROUND_UP (cx + 1, 8);
+          if (cx >= COL_CNT)
+            newline ();
+          break;
+
+        case '\a':
+          intr_set_level (old_level);
+          speaker_beep ();
+          intr_disable ();
+          break;
+          
+        default:
+          fb[top + cy][cx][0] = c;
+          fb[top + cy][cx][1] = GRAY_ON_BLACK;
+          if (++cx >= COL_CNT)
+            newline ();
+          break;
+        }
     }
 
-  /* Update cursor position. */
+  /* Update the display's start row and cursor position. */
+  set_start ();
   move_cursor ();
 
   intr_set_level (old_level);
 }
-
+
 /* Clears the screen and moves the cursor to the upper left. */
 static void
 cls (void)
@@ -109,13 +139,13 @@ cls (void)
   size_t y;
 
   for (y = 0; y < ROW_CNT; y++)
-    clear_row (y);
+    clear_row (top + y);
 
   cx = cy = 0;
   move_cursor ();
 }
 
-/* Clears row Y to spaces. */
+/* Clears row Y of video memory to spaces. */
 static void
 clear_row (size_t y) 
 {
@@ -139,8 +169,14 @@ newline (void)
   if (cy >= ROW_CNT)
     {
       cy = ROW_CNT - 1;
-      memmove (&fb[0], &fb[1], sizeof fb[0] * (ROW_CNT - 1));
-      clear_row (ROW_CNT - 1);
+      if (top + ROW_CNT < BUF_ROWS)
+        top++;
+      else
+        {
+          memmove (&fb[0], &fb[top + 1], sizeof fb[0] * (ROW_CNT - 1));
+          top = 0;
+        }
+      clear_row (top + ROW_CNT - 1);
     }
 }
 
@@ -149,11 +185,21 @@ static void
 move_cursor (void) 
 {
   /* See [FREEVGA] under "Manipulating the Text-mode Cursor". */
-  uint16_t cp = cx + COL_CNT * cy;
+  uint16_t cp = cx + COL_CNT * (top + cy);
   outw (0x3d4, 0x0e | (cp & 0xff00));
   outw (0x3d4, 0x0f | (cp << 8));
 }
 
+/* Makes the display start at row `top' of video memory. */
+static void
+set_start (void) 
+{
+  /* See [FREEVGA] under "CRTC Registers". */
+  uint16_t start = COL_CNT * top;
+  outw (0x3d4, 0x0c | (start & 0xff00));
+  outw (0x3d4, 0x0d | (start << 8));
+}
+
 /* Reads the current hardware cursor position into (*X,*Y). */
 static void
 find_cursor (size_t *x, size_t *y) 
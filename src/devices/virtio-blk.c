@@ -0,0 +1,412 @@
+#include "devices/virtio-blk.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* The code in this file drives virtio block devices [Virtio], as
+   QEMU offers with "-drive if=virtio", through the legacy I/O port
+   interface of a virtio PCI device.  Each disk has one split
+   virtqueue that it shares with us in memory.  A request goes into
+   it as a chain of descriptors: a header naming the operation and
+   sector, the data buffer page by page, and a status byte for the
+   device to fill in.  Requests bypass the block layer's queue, so
+   that as many are in flight as the virtqueue has room for and the
+   device, which knows the real disk, orders them; the interrupt
+   handler completes each one as the device hands it back. */
+
+/* PCI identity of a virtio block device, transitional so that it
+   has the legacy interface. */
+#define VIRTIO_VENDOR 0x1af4
+#define VIRTIO_BLK_DEVICE 0x1001
+
+/* Legacy virtio registers, relative to the I/O port base in BAR 0. */
+#define REG_DEVICE_FEATURES 0x00        /* Features offered (r/o). */
+#define REG_GUEST_FEATURES 0x04         /* Features accepted. */
+#define REG_QUEUE_PFN 0x08              /* Page number of the queue. */
+#define REG_QUEUE_SIZE 0x0c             /* Entries in the queue (r/o). */
+#define REG_QUEUE_SELECT 0x0e           /* Queue that the above mean. */
+#define REG_QUEUE_NOTIFY 0x10           /* Write to say "look at queue". */
+#define REG_STATUS 0x12                 /* Device status. */
+#define REG_ISR 0x13                    /* Interrupt status, cleared by
+                                           reading (r/o). */
+#define REG_CAPACITY 0x14               /* Disk size in sectors, 64 bits. */
+
+/* Device status bits. */
+#define STATUS_ACKNOWLEDGE 0x01         /* We found the device. */
+#define STATUS_DRIVER 0x02              /* We can drive it. */
+#define STATUS_DRIVER_OK 0x04           /* We are ready. */
+#define STATUS_FAILED 0x80              /* We gave up on it. */
+
+/* Interrupt status bits. */
+#define ISR_QUEUE 0x01                  /* A queue has used entries. */
+
+/* Virtqueue descriptor flags. */
+#define DESC_NEXT 0x01                  /* NEXT is valid. */
+#define DESC_WRITE 0x02                 /* Device writes the buffer. */
+
+/* Virtqueues of the legacy interface start on a page and have
+   their used ring on a page boundary too. */
+#define QUEUE_ALIGN 4096
+
+/* A virtqueue descriptor: one buffer of a request. */
+struct vq_desc
+  {
+    uint64_t addr;                      /* Physical address. */
+    uint32_t len;                       /* Length in bytes. */
+    uint16_t flags;                     /* DESC_*. */
+    uint16_t next;                      /* Next in chain, if DESC_NEXT. */
+  };
+
+/* Ring of chains that we make available to the device. */
+struct vq_avail
+  {
+    uint16_t flags;
+    uint16_t idx;                       /* Where the next entry goes. */
+    uint16_t ring[];                    /* First descriptors of chains. */
+  };
+
+/* Ring of chains that the device has used. */
+struct vq_used
+  {
+    uint16_t flags;
+    uint16_t idx;                       /* Where the next entry goes. */
+    struct
+      {
+        uint32_t id;                    /* First descriptor of chain. */
+        uint32_t len;                   /* Bytes written to it. */
+      }
+    ring[];
+  };
+
+/* Header of a block request, the first buffer of its chain. */
+struct request_header
+  {
+    uint32_t type;                      /* REQ_IN or REQ_OUT. */
+    uint32_t reserved;
+    uint64_t sector;                    /* First sector. */
+  };
+#define REQ_IN 0                        /* Read. */
+#define REQ_OUT 1                       /* Write. */
+#define REQ_OK 0                        /* Status of a success. */
+
+/* Most sectors per virtio request.  A block request for more is
+   carried out a chunk of this many sectors at a time. */
+#define CHUNK_SECTORS 64
+
+/* Descriptors that one chunk's chain can need: the header, a
+   buffer per page that its data touches, and the status byte. */
+#define SLOT_DESCS (CHUNK_SECTORS * BLOCK_SECTOR_SIZE / PGSIZE + 3)
+
+/* Most requests that we keep in flight on a disk. */
+#define SLOT_CNT 16
+
+/* A chunk of a request in flight, with the descriptors numbered
+   from its index times SLOT_DESCS. */
+struct slot
+  {
+    struct request_header header;       /* Read by the device. */
+    uint8_t status;                     /* Written by the device. */
+    struct block_request *request;      /* Request, or null if free. */
+    size_t done;                        /* Sectors of it done before. */
+    size_t cnt;                         /* Sectors in this chunk. */
+  };
+
+/* A virtio disk.  Lives in a page of its own, so that no header
+   or status byte that the device reads or writes crosses a page
+   boundary. */
+struct virtio_disk
+  {
+    char name[8];                       /* Name, e.g. "vda". */
+    uint16_t io_base;                   /* Base I/O port. */
+    uint8_t irq;                        /* Interrupt line. */
+    struct block *block;                /* Our block device. */
+
+    uint16_t queue_size;                /* Entries in the virtqueue. */
+    struct vq_desc *desc;               /* Its descriptor table. */
+    struct vq_avail *avail;             /* Its available ring. */
+    struct vq_used *used;               /* Its used ring. */
+    uint16_t last_used;                 /* Used entries handled so far. */
+
+    size_t slot_cnt;                    /* Slots that fit the queue. */
+    struct slot slots[SLOT_CNT];        /* Requests in flight. */
+    struct list waiting;                /* Requests waiting for a slot. */
+  };
+
+/* Most virtio disks that we drive. */
+#define DISK_CNT 4
+static struct virtio_disk *disks[DISK_CNT];
+static size_t disk_cnt;
+
+/* Interrupt lines with our handler. */
+static bool irq_registered[16];
+
+static struct block_operations virtio_operations;
+
+static void probe (int dev_no);
+static void start_chunk (struct virtio_disk *, struct slot *,
+                         struct block_request *, size_t done);
+static void interrupt_handler (struct intr_frame *);
+
+/* Finds the virtio disks on PCI bus 0 and registers them with the
+   block device layer. */
+void
+virtio_blk_init (void)
+{
+  int dev_no;
+
+  for (dev_no = 0; dev_no < PCI_DEV_CNT; dev_no++)
+    {
+      uint32_t id = pci_read_config (dev_no, 0x00);
+
+      if ((id & 0xffff) == VIRTIO_VENDOR && (id >> 16) == VIRTIO_BLK_DEVICE)
+        probe (dev_no);
+    }
+}
+
+/* Sets up the virtio disk that is PCI device DEV_NO and registers
+   it.  Gives up on the disk, with a message, if that fails. */
+static void
+probe (int dev_no)
+{
+  uint32_t bar0 = pci_read_config (dev_no, 0x10);
+  struct virtio_disk *d;
+  size_t avail_end, ring_bytes;
+  uint64_t capacity;
+  uint8_t *ring;
+  char extra_info[32];
+  size_t i;
+
+  if (disk_cnt >= DISK_CNT)
+    {
+      printf ("virtio-blk: ignoring PCI device %d, too many disks\n", dev_no);
+      return;
+    }
+  if ((bar0 & 1) == 0)
+    return;
+  d = palloc_get_page (PAL_ZERO);
+  if (d == NULL)
+    return;
+  ASSERT (sizeof *d <= PGSIZE);
+  snprintf (d->name, sizeof d->name, "vd%c", 'a' + (int) disk_cnt);
+  d->io_base = bar0 & 0xfffc;
+  d->irq = pci_read_config (dev_no, 0x3c) & 0xff;
+  list_init (&d->waiting);
+
+  /* Enable I/O space and bus master in the Command register, then
+     reset the device and tell it we know how to drive it.  We
+     accept none of the optional features. */
+  pci_write_config (dev_no, 0x04,
+                    (pci_read_config (dev_no, 0x04) & 0xffff) | 0x05);
+  outb (d->io_base + REG_STATUS, 0);
+  outb (d->io_base + REG_STATUS, STATUS_ACKNOWLEDGE);
+  outb (d->io_base + REG_STATUS, STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+  inl (d->io_base + REG_DEVICE_FEATURES);
+  outl (d->io_base + REG_GUEST_FEATURES, 0);
+
+  /* Lay out queue 0, whose size the device dictates, in physically
+     contiguous pages: descriptors, then the available ring, then
+     the used ring at the next page. */
+  outw (d->io_base + REG_QUEUE_SELECT, 0);
+  d->queue_size = inw (d->io_base + REG_QUEUE_SIZE);
+  d->slot_cnt = d->queue_size / SLOT_DESCS;
+  if (d->slot_cnt > SLOT_CNT)
+    d->slot_cnt = SLOT_CNT;
+  avail_end = (d->queue_size * sizeof *d->desc
+               + sizeof *d->avail + (d->queue_size + 1) * sizeof (uint16_t));
+  ring_bytes = (ROUND_UP (avail_end, QUEUE_ALIGN)
+                + sizeof *d->used + d->queue_size * sizeof d->used->ring[0]
+                + sizeof (uint16_t));
+  ring = (d->slot_cnt > 0
+          ? palloc_get_multiple (PAL_ZERO, DIV_ROUND_UP (ring_bytes, PGSIZE))
+          : NULL);
+  if (ring == NULL || d->irq >= 16)
+    {
+      printf ("%s: can't set up PCI device %d\n", d->name, dev_no);
+      outb (d->io_base + REG_STATUS, STATUS_FAILED);
+      palloc_free_page (d);
+      return;
+    }
+  d->desc = (struct vq_desc *) ring;
+  d->avail = (struct vq_avail *) (ring + d->queue_size * sizeof *d->desc);
+  d->used = (struct vq_used *) (ring + ROUND_UP (avail_end, QUEUE_ALIGN));
+  outl (d->io_base + REG_QUEUE_PFN, vtop (ring) / QUEUE_ALIGN);
+
+  /* Chain each slot's descriptors once and for all. */
+  for (i = 0; i < d->slot_cnt * SLOT_DESCS; i++)
+    d->desc[i].next = i + 1;
+
+  if (!irq_registered[d->irq])
+    {
+      intr_register_ext (0x20 + d->irq, interrupt_handler, "virtio-blk");
+      irq_registered[d->irq] = true;
+    }
+  disks[disk_cnt++] = d;
+  outb (d->io_base + REG_STATUS,
+        STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+
+  /* Register. */
+  capacity = (inl (d->io_base + REG_CAPACITY)
+              | (uint64_t) inl (d->io_base + REG_CAPACITY + 4) << 32);
+  if (capacity > UINT32_MAX)
+    capacity = UINT32_MAX;
+  snprintf (extra_info, sizeof extra_info, "virtio, %u requests in flight",
+            (unsigned) d->slot_cnt);
+  d->block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
+                             &virtio_operations, d);
+  partition_scan (d->block);
+}
+
+/* Returns a free slot of disk D, or a null pointer if all are in
+   use.  Interrupts must be off. */
+static struct slot *
+free_slot (struct virtio_disk *d)
+{
+  size_t i;
+
+  for (i = 0; i < d->slot_cnt; i++)
+    if (d->slots[i].request == NULL)
+      return &d->slots[i];
+  return NULL;
+}
+
+/* Starts request R on disk D, or queues it until a slot is free.
+   R's buffer must be in kernel memory, whose physical addresses
+   vtop() yields. */
+static void
+virtio_submit (void *d_, struct block_request *r)
+{
+  struct virtio_disk *d = d_;
+  enum intr_level old_level;
+  struct slot *s;
+
+  ASSERT (is_kernel_vaddr (r->buffer));
+
+  old_level = intr_disable ();
+  s = free_slot (d);
+  if (s != NULL)
+    start_chunk (d, s, r, 0);
+  else
+    list_push_back (&d->waiting, &r->elem);
+  intr_set_level (old_level);
+}
+
+static struct block_operations virtio_operations =
+  {
+    .submit = virtio_submit
+  };
+
+/* Sets descriptor IDX of disk D to the LEN bytes at kernel address
+   P, with FLAGS. */
+static void
+set_desc (struct virtio_disk *d, size_t idx, const void *p, size_t len,
+          uint16_t flags)
+{
+  d->desc[idx].addr = vtop (p);
+  d->desc[idx].len = len;
+  d->desc[idx].flags = flags;
+}
+
+/* Has slot S of disk D carry out the next chunk of request R, the
+   one that follows its first DONE sectors, and tells the device.
+   Interrupts must be off. */
+static void
+start_chunk (struct virtio_disk *d, struct slot *s, struct block_request *r,
+             size_t done)
+{
+  size_t head = (s - d->slots) * SLOT_DESCS;
+  size_t idx = head;
+  uint8_t *p = (uint8_t *) r->buffer + done * BLOCK_SECTOR_SIZE;
+  size_t size;
+
+  s->request = r;
+  s->done = done;
+  s->cnt = r->cnt - done < CHUNK_SECTORS ? r->cnt - done : CHUNK_SECTORS;
+  s->header.type = r->write ? REQ_OUT : REQ_IN;
+  s->header.reserved = 0;
+  s->header.sector = r->sector + done;
+  s->status = 0xff;
+
+  /* The data goes page by page: kernel pages are physically
+     contiguous, but the buffer need not be. */
+  set_desc (d, idx++, &s->header, sizeof s->header, DESC_NEXT);
+  for (size = s->cnt * BLOCK_SECTOR_SIZE; size > 0; )
+    {
+      size_t chunk = PGSIZE - pg_ofs (p);
+      if (chunk > size)
+        chunk = size;
+
+      ASSERT (idx < head + SLOT_DESCS - 1);
+      set_desc (d, idx++, p, chunk, DESC_NEXT | (r->write ? 0 : DESC_WRITE));
+      p += chunk;
+      size -= chunk;
+    }
+  set_desc (d, idx, &s->status, sizeof s->status, DESC_WRITE);
+
+  /* Publish the chain only once it is complete, and the new index
+     only once the ring entry is. */
+  d->avail->ring[d->avail->idx % d->queue_size] = head;
+  barrier ();
+  d->avail->idx++;
+  barrier ();
+  outw (d->io_base + REG_QUEUE_NOTIFY, 0);
+}
+
+/* Handles a chunk that the device has finished in slot S of disk
+   D: starts the next chunk of its request or, if there is none,
+   completes the request and gives the slot to a waiting one. */
+static void
+finish_chunk (struct virtio_disk *d, struct slot *s)
+{
+  struct block_request *r = s->request;
+
+  if (s->status != REQ_OK)
+    PANIC ("%s: disk %s failed, sector=%"PRDSNu,
+           d->name, r->write ? "write" : "read", r->sector + s->done);
+  if (s->done + s->cnt < r->cnt)
+    {
+      start_chunk (d, s, r, s->done + s->cnt);
+      return;
+    }
+
+  s->request = NULL;
+  block_complete (d->block, r);
+  if (!list_empty (&d->waiting))
+    start_chunk (d, s, list_entry (list_pop_front (&d->waiting),
+                                   struct block_request, elem), 0);
+}
+
+/* Virtio interrupt handler, shared by all the disks.  Reading a
+   disk's interrupt status acknowledges the interrupt. */
+static void
+interrupt_handler (struct intr_frame *f UNUSED)
+{
+  size_t i;
+
+  for (i = 0; i < disk_cnt; i++)
+    {
+      struct virtio_disk *d = disks[i];
+
+      if ((inb (d->io_base + REG_ISR) & ISR_QUEUE) == 0)
+        continue;
+      while (d->last_used != d->used->idx)
+        {
+          size_t head;
+
+          /* Read the entry only after its index. */
+          barrier ();
+          head = d->used->ring[d->last_used % d->queue_size].id;
+          d->last_used++;
+          finish_chunk (d, &d->slots[head / SLOT_DESCS]);
+        }
+    }
+}
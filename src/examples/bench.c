@@ -0,0 +1,57 @@
+/* bench.c
+
+   Timing and reporting for the file system benchmarks.  Every
+   result goes on a line of its own as "bench NAME METRIC VALUE",
+   the same format as the kernel's `bench' action. */
+
+#include "bench.h"
+#include <stdio.h>
+#include <syscall.h>
+
+/* Waits for the start of a timer tick and returns it. */
+unsigned
+bench_start (void) 
+{
+  unsigned start = ticks ();
+
+  while (ticks () == start)
+    continue;
+  return start + 1;
+}
+
+/* Reports VALUE for METRIC of benchmark NAME. */
+void
+bench_report (const char *name, const char *metric, long long value) 
+{
+  printf ("bench %s %s %lld\n", name, metric, value);
+}
+
+/* Reports that CNT operations counted in UNIT took place in
+   benchmark NAME since tick START: the count, the ticks elapsed
+   and the rate per second. */
+void
+bench_report_rate (const char *name, const char *unit, long long cnt,
+                   unsigned start) 
+{
+  unsigned elapsed = ticks () - start;
+  char metric[32];
+
+  bench_report (name, unit, cnt);
+  snprintf (metric, sizeof metric, "%s_ticks", unit);
+  bench_report (name, metric, elapsed);
+  snprintf (metric, sizeof metric, "%s_per_sec", unit);
+  bench_report (name, metric,
+                cnt * TICKS_PER_SEC / (elapsed > 0 ? elapsed : 1));
+}
+
+/* Fills SIZE bytes of BUFFER with a pattern, so that the data
+   written is not all zeros. */
+void
+bench_fill (void *buffer, int size) 
+{
+  unsigned char *p = buffer;
+  int i;
+
+  for (i = 0; i < size; i++)
+    p[i] = i * 37 + 11;
+}
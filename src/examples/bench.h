@@ -0,0 +1,12 @@
+#ifndef EXAMPLES_BENCH_H
+#define EXAMPLES_BENCH_H
+
+/* Helpers shared by the file system benchmarks. */
+
+unsigned bench_start (void);
+void bench_report (const char *name, const char *metric, long long value);
+void bench_report_rate (const char *name, const char *unit, long long cnt,
+                        unsigned start);
+void bench_fill (void *buffer, int size);
+
+#endif /* examples/bench.h */
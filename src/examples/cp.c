@@ -9,6 +9,7 @@ int
 main (int argc, char *argv[]) 
 {
   int in_fd, out_fd;
+  int size, copied, bytes_sent;
 
   if (argc != 3) 
     {
@@ -16,6 +17,10 @@ main (int argc, char *argv[])
       return EXIT_FAILURE;
     }
 
+  /* Share the file's sectors if the file system can. */
+  if (clone_file (argv[1], argv[2]))
+    return EXIT_SUCCESS;
+
   /* Open input file. */
   in_fd = open (argv[1]);
   if (in_fd < 0) 
@@ -37,14 +42,12 @@ main (int argc, char *argv[])
       return EXIT_FAILURE;
     }
 
-  /* Copy data. */
-  for (;;) 
+  /* Copy data, inside the kernel. */
+  size = filesize (in_fd);
+  for (copied = 0; copied < size; copied += bytes_sent) 
     {
-      char buffer[1024];
-      int bytes_read = read (in_fd, buffer, sizeof buffer);
-      if (bytes_read == 0)
-        break;
-      if (write (out_fd, buffer, bytes_read) != bytes_read) 
+      bytes_sent = sendfile (out_fd, in_fd, NULL, size - copied);
+      if (bytes_sent <= 0) 
         {
           printf ("%s: write failed\n", argv[2]);
           return EXIT_FAILURE;
@@ -0,0 +1,66 @@
+/* fsbench-files.c
+
+   Creates many small files in a fresh directory, then deletes
+   them, and reports how many of each happen per second. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "bench.h"
+
+#define FILE_SIZE 100
+
+static char buffer[FILE_SIZE];
+
+int
+main (int argc, char *argv[]) 
+{
+  const char *dir_name = "fsbench-files.d";
+  int cnt = argc > 1 ? atoi (argv[1]) : 200;
+  char name[64];
+  unsigned start;
+  int i;
+
+  if (argc > 2 || cnt <= 0) 
+    {
+      printf ("usage: fsbench-files [COUNT]\n");
+      return EXIT_FAILURE;
+    }
+  if (!mkdir (dir_name)) 
+    {
+      printf ("%s: mkdir failed\n", dir_name);
+      return EXIT_FAILURE;
+    }
+  bench_fill (buffer, sizeof buffer);
+
+  start = bench_start ();
+  for (i = 0; i < cnt; i++)
+    {
+      int fd;
+
+      snprintf (name, sizeof name, "%s/f%d", dir_name, i);
+      if (!create (name, 0) || (fd = open (name)) < 0) 
+        {
+          printf ("%s: create failed\n", name);
+          return EXIT_FAILURE;
+        }
+      write (fd, buffer, sizeof buffer);
+      close (fd);
+    }
+  bench_report_rate ("small-files", "creates", cnt, start);
+
+  start = bench_start ();
+  for (i = 0; i < cnt; i++)
+    {
+      snprintf (name, sizeof name, "%s/f%d", dir_name, i);
+      if (!remove (name)) 
+        {
+          printf ("%s: remove failed\n", name);
+          return EXIT_FAILURE;
+        }
+    }
+  bench_report_rate ("small-files", "removes", cnt, start);
+
+  remove (dir_name);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,80 @@
+/* fsbench-lookup.c
+
+   Fills a directory with many empty files, then opens each of
+   them by name a number of times, and looks up as many names
+   that do not exist.  Reports lookups per second for both. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "bench.h"
+
+int
+main (int argc, char *argv[]) 
+{
+  const char *dir_name = "fsbench-lookup.d";
+  int cnt = argc > 1 ? atoi (argv[1]) : 100;
+  int rounds = argc > 2 ? atoi (argv[2]) : 10;
+  char name[64];
+  unsigned start;
+  int i, r;
+
+  if (argc > 3 || cnt <= 0 || rounds <= 0) 
+    {
+      printf ("usage: fsbench-lookup [COUNT [ROUNDS]]\n");
+      return EXIT_FAILURE;
+    }
+  if (!mkdir (dir_name)) 
+    {
+      printf ("%s: mkdir failed\n", dir_name);
+      return EXIT_FAILURE;
+    }
+  for (i = 0; i < cnt; i++)
+    {
+      snprintf (name, sizeof name, "%s/f%d", dir_name, i);
+      if (!create (name, 0)) 
+        {
+          printf ("%s: create failed\n", name);
+          return EXIT_FAILURE;
+        }
+    }
+
+  start = bench_start ();
+  for (r = 0; r < rounds; r++)
+    for (i = 0; i < cnt; i++)
+      {
+        int fd;
+
+        snprintf (name, sizeof name, "%s/f%d", dir_name, i);
+        fd = open (name);
+        if (fd < 0) 
+          {
+            printf ("%s: open failed\n", name);
+            return EXIT_FAILURE;
+          }
+        close (fd);
+      }
+  bench_report ("lookup", "entries", cnt);
+  bench_report_rate ("lookup", "hits", (long long) rounds * cnt, start);
+
+  start = bench_start ();
+  for (r = 0; r < rounds; r++)
+    for (i = 0; i < cnt; i++)
+      {
+        snprintf (name, sizeof name, "%s/missing%d", dir_name, i);
+        if (open (name) >= 0) 
+          {
+            printf ("%s: open succeeded\n", name);
+            return EXIT_FAILURE;
+          }
+      }
+  bench_report_rate ("lookup", "misses", (long long) rounds * cnt, start);
+
+  for (i = 0; i < cnt; i++)
+    {
+      snprintf (name, sizeof name, "%s/f%d", dir_name, i);
+      remove (name);
+    }
+  remove (dir_name);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,64 @@
+/* fsbench-rand.c
+
+   Reads 512-byte sectors at random offsets within a file and
+   reports how many reads per second that achieves. */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "bench.h"
+
+#define SECTOR 512
+
+static char buffer[SECTOR];
+
+int
+main (int argc, char *argv[]) 
+{
+  const char *file_name = "fsbench-rand.tmp";
+  int file_kb = argc > 1 ? atoi (argv[1]) : 512;
+  int reads = argc > 2 ? atoi (argv[2]) : 2000;
+  int sectors = file_kb * 1024 / SECTOR;
+  unsigned start;
+  int fd, i;
+
+  if (argc > 3 || sectors <= 0 || reads <= 0) 
+    {
+      printf ("usage: fsbench-rand [FILE_KB [READS]]\n");
+      return EXIT_FAILURE;
+    }
+
+  /* Lay the file out sequentially first. */
+  bench_fill (buffer, sizeof buffer);
+  if (!create (file_name, 0) || (fd = open (file_name)) < 0) 
+    {
+      printf ("%s: create failed\n", file_name);
+      return EXIT_FAILURE;
+    }
+  for (i = 0; i < sectors; i++)
+    if (write (fd, buffer, SECTOR) != SECTOR) 
+      {
+        printf ("%s: write failed\n", file_name);
+        return EXIT_FAILURE;
+      }
+  sync ();
+
+  random_init (0);
+  start = bench_start ();
+  for (i = 0; i < reads; i++)
+    {
+      unsigned ofs = random_ulong () % sectors * SECTOR;
+      if (pread (fd, buffer, SECTOR, ofs) != SECTOR) 
+        {
+          printf ("%s: read failed at %u\n", file_name, ofs);
+          return EXIT_FAILURE;
+        }
+    }
+  bench_report ("rand-read", "file_kb", file_kb);
+  bench_report_rate ("rand-read", "reads", reads, start);
+  close (fd);
+
+  remove (file_name);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,68 @@
+/* fsbench-seq.c
+
+   Writes a file sequentially in blocks of a given size, then
+   reads it back the same way, and reports the throughput of
+   each pass. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "bench.h"
+
+#define MAX_BLOCK 65536
+
+static char buffer[MAX_BLOCK];
+
+int
+main (int argc, char *argv[]) 
+{
+  const char *file_name = "fsbench-seq.tmp";
+  int file_kb = argc > 1 ? atoi (argv[1]) : 512;
+  int block = argc > 2 ? atoi (argv[2]) : 4096;
+  long long size = file_kb * 1024LL, done;
+  unsigned start;
+  int fd;
+
+  if (argc > 3 || file_kb <= 0 || block <= 0 || block > MAX_BLOCK) 
+    {
+      printf ("usage: fsbench-seq [FILE_KB [BLOCK_SIZE]]\n"
+              "BLOCK_SIZE may be at most %d bytes.\n", MAX_BLOCK);
+      return EXIT_FAILURE;
+    }
+  bench_fill (buffer, block);
+
+  if (!create (file_name, 0) || (fd = open (file_name)) < 0) 
+    {
+      printf ("%s: create failed\n", file_name);
+      return EXIT_FAILURE;
+    }
+  start = bench_start ();
+  for (done = 0; done < size; done += block)
+    {
+      int n = size - done < block ? size - done : block;
+      if (write (fd, buffer, n) != n) 
+        {
+          printf ("%s: write failed at %lld\n", file_name, done);
+          return EXIT_FAILURE;
+        }
+    }
+  fsync (fd);
+  bench_report ("seq-write", "block_size", block);
+  bench_report_rate ("seq-write", "bytes", size, start);
+  close (fd);
+
+  fd = open (file_name);
+  start = bench_start ();
+  for (done = 0; done < size; done += block)
+    if (read (fd, buffer, block) <= 0) 
+      {
+        printf ("%s: read failed at %lld\n", file_name, done);
+        return EXIT_FAILURE;
+      }
+  bench_report ("seq-read", "block_size", block);
+  bench_report_rate ("seq-read", "bytes", size, start);
+  close (fd);
+
+  remove (file_name);
+  return EXIT_SUCCESS;
+}
@@ -6,10 +6,21 @@
    
    Ideally, we could read the matrices off of the file system,
    and store the result back to the file system!
+
+   Run as `matmult bench [DIM [THREADS]]' it is instead a compute
+   benchmark: it multiplies DIM x DIM matrices naively, then in
+   cache-sized tiles, then in tiles with the rows split across
+   THREADS user threads, and reports the multiply-add rate of each
+   in the format of examples/bench.c.  User programs are built with
+   -msoft-float, so the arithmetic is integer; an "op" is one
+   multiplication or addition, as in FLOP/s.
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <syscall.h>
+#include "bench.h"
 
 /* You should define DIM to be large enough that the arrays
    don't fit in physical memory.
@@ -32,11 +43,16 @@ int A[DIM][DIM];
 int B[DIM][DIM];
 int C[DIM][DIM];
 
+static int bench (int argc, char *argv[]);
+
 int
-main (void)
+main (int argc, char *argv[])
 {
   int i, j, k;
 
+  if (argc > 1 && !strcmp (argv[1], "bench"))
+    return bench (argc, argv);
+
   /* Initialize the matrices. */
   for (i = 0; i < DIM; i++)
     for (j = 0; j < DIM; j++)
@@ -55,3 +71,166 @@ main (void)
   /* Done. */
   exit (C[DIM - 1][DIM - 1]);
 }
+
+/* Benchmark mode. */
+
+#define MAX_THREADS 8
+#define TILE 32                 /* 3 int tiles take 12 kB. */
+
+/* Work for one thread: rows [ROW_START, ROW_END) of C = A * B,
+   all DIM x DIM. */
+struct mult
+  {
+    const int *a, *b;
+    int *c;
+    int dim;
+    int row_start, row_end;
+  };
+
+/* Multiplies naively, walking B down its columns. */
+static void
+mult_naive (struct mult *m)
+{
+  int n = m->dim;
+  int i, j, k;
+
+  for (i = m->row_start; i < m->row_end; i++)
+    for (j = 0; j < n; j++)
+      {
+        int sum = 0;
+        for (k = 0; k < n; k++)
+          sum += m->a[i * n + k] * m->b[k * n + j];
+        m->c[i * n + j] = sum;
+      }
+}
+
+/* Multiplies in TILE x TILE blocks, so that the blocks of A, B and
+   C in use stay in the cache, and walks every matrix along its
+   rows. */
+static void
+mult_blocked (void *m_)
+{
+  struct mult *m = m_;
+  int n = m->dim;
+  int i0, j0, k0, i, j, k;
+
+  for (i = m->row_start; i < m->row_end; i++)
+    memset (m->c + i * n, 0, n * sizeof *m->c);
+  for (i0 = m->row_start; i0 < m->row_end; i0 += TILE)
+    for (k0 = 0; k0 < n; k0 += TILE)
+      for (j0 = 0; j0 < n; j0 += TILE)
+        {
+          int i1 = i0 + TILE < m->row_end ? i0 + TILE : m->row_end;
+          int k1 = k0 + TILE < n ? k0 + TILE : n;
+          int j1 = j0 + TILE < n ? j0 + TILE : n;
+
+          for (i = i0; i < i1; i++)
+            for (k = k0; k < k1; k++)
+              {
+                int a = m->a[i * n + k];
+                const int *b = m->b + k * n;
+                int *c = m->c + i * n;
+
+                for (j = j0; j < j1; j++)
+                  c[j] += a * b[j];
+              }
+        }
+}
+
+/* Runs mult_blocked() with the rows of M split across THREAD_CNT
+   user threads, the calling thread taking the first share. */
+static bool
+mult_threaded (struct mult *m, int thread_cnt)
+{
+  struct mult parts[MAX_THREADS];
+  uthread_t tids[MAX_THREADS];
+  bool ok = true;
+  int i;
+
+  for (i = 0; i < thread_cnt; i++)
+    {
+      parts[i] = *m;
+      parts[i].row_start = m->dim * i / thread_cnt;
+      parts[i].row_end = m->dim * (i + 1) / thread_cnt;
+    }
+  for (i = 1; i < thread_cnt; i++)
+    {
+      tids[i] = uthread_create (mult_blocked, &parts[i]);
+      if (tids[i] == UTHREAD_ERROR)
+        {
+          mult_blocked (&parts[i]);
+          ok = false;
+        }
+    }
+  mult_blocked (&parts[0]);
+  for (i = 1; i < thread_cnt; i++)
+    if (tids[i] != UTHREAD_ERROR)
+      uthread_join (tids[i]);
+  return ok;
+}
+
+static int
+bench (int argc, char *argv[])
+{
+  int n = argc > 2 ? atoi (argv[2]) : 256;
+  int thread_cnt = argc > 3 ? atoi (argv[3]) : 4;
+  long long ops = 2LL * n * n * n;
+  struct mult m;
+  int *a, *b, *expected;
+  unsigned start;
+  int i;
+
+  if (argc > 4 || n <= 0 || n > 1024
+      || thread_cnt <= 0 || thread_cnt > MAX_THREADS)
+    {
+      printf ("usage: matmult bench [DIM [THREADS]]\n"
+              "DIM may be at most 1024 and THREADS at most %d.\n",
+              MAX_THREADS);
+      return EXIT_FAILURE;
+    }
+
+  m.dim = n;
+  m.row_start = 0;
+  m.row_end = n;
+  m.a = a = malloc (n * n * sizeof *a);
+  m.b = b = malloc (n * n * sizeof *b);
+  m.c = malloc (n * n * sizeof *m.c);
+  expected = malloc (n * n * sizeof *expected);
+  if (a == NULL || b == NULL || m.c == NULL || expected == NULL)
+    {
+      printf ("matmult: out of memory\n");
+      return EXIT_FAILURE;
+    }
+  for (i = 0; i < n * n; i++)
+    {
+      a[i] = i % 7;
+      b[i] = i % 5 - 2;
+    }
+  bench_report ("matmult", "dim", n);
+
+  start = bench_start ();
+  mult_naive (&m);
+  bench_report_rate ("matmult-naive", "ops", ops, start);
+  memcpy (expected, m.c, n * n * sizeof *m.c);
+
+  start = bench_start ();
+  mult_blocked (&m);
+  bench_report_rate ("matmult-blocked", "ops", ops, start);
+  if (memcmp (expected, m.c, n * n * sizeof *m.c))
+    {
+      printf ("matmult: blocked result differs\n");
+      return EXIT_FAILURE;
+    }
+
+  start = bench_start ();
+  if (!mult_threaded (&m, thread_cnt))
+    printf ("matmult: uthread_create failed, ran some rows inline\n");
+  bench_report_rate ("matmult-threaded", "ops", ops, start);
+  bench_report ("matmult-threaded", "threads", thread_cnt);
+  if (memcmp (expected, m.c, n * n * sizeof *m.c))
+    {
+      printf ("matmult: threaded result differs\n");
+      return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
@@ -3,8 +3,28 @@
 #include <string.h>
 #include <syscall.h>
 
+/* A command line holds up to MAX_STAGES programs joined by `|',
+   each with up to MAX_ARGS words. */
+#define MAX_STAGES 8
+#define MAX_ARGS 16
+
+/* Background jobs, started with a trailing `&'. */
+#define MAX_JOBS 8
+struct job
+  {
+    int stage_cnt;              /* 0 if the slot is free. */
+    pid_t pids[MAX_STAGES];     /* Stages not yet reaped, or 0. */
+    int status;                 /* Exit code of the last stage. */
+    char command[160];          /* Command line, for messages. */
+  };
+static struct job jobs[MAX_JOBS];
+
 static void read_line (char line[], size_t);
 static bool backspace (char **pos, char line[]);
+static void run (char *command, bool timed);
+static bool wait_job (struct job *, bool block);
+static void reap_jobs (void);
+static uint64_t now_ns (void);
 
 int
 main (void)
@@ -12,7 +32,9 @@ main (void)
   printf ("Shell starting...\n");
   for (;;) 
     {
-      char command[80];
+      char command[160];
+
+      reap_jobs ();
 
       /* Read command. */
       printf ("--");
@@ -26,24 +48,205 @@ main (void)
           if (!chdir (command + 3))
             printf ("\"%s\": chdir failed\n", command + 3);
         }
+      else if (!strcmp (command, "wait"))
+        {
+          /* Wait for every background job. */
+          struct job *j;
+
+          for (j = jobs; j < jobs + MAX_JOBS; j++)
+            if (j->stage_cnt > 0)
+              {
+                wait_job (j, true);
+                printf ("[%d] \"%s\": exit code %d\n",
+                        (int) (j - jobs) + 1, j->command, j->status);
+                j->stage_cnt = 0;
+              }
+        }
+      else if (!memcmp (command, "time ", 5))
+        run (command + 5, true);
       else if (command[0] == '\0') 
         {
           /* Empty command. */
         }
       else
-        {
-          pid_t pid = exec (command);
-          if (pid != PID_ERROR)
-            printf ("\"%s\": exit code %d\n", command, wait (pid));
-          else
-            printf ("exec failed\n");
-        }
+        run (command, false);
     }
 
   printf ("Shell exiting.");
   return EXIT_SUCCESS;
 }
 
+/* Runs COMMAND, a pipeline of one or more programs joined by `|'
+   whose stages all run at once, each reading the previous one's
+   output.  With a trailing `&' it runs in the background;
+   otherwise waits for it and, if TIMED, prints how long it took. */
+static void
+run (char *command, bool timed)
+{
+  char *argv[MAX_STAGES][MAX_ARGS + 1];
+  int pipes[MAX_STAGES - 1][2];
+  struct job fg, *job = &fg;
+  bool background = false;
+  int stage_cnt = 0, argc = 0;
+  uint64_t start;
+  char *token, *save_ptr;
+  int i;
+
+  /* Take a trailing `&'. */
+  i = strlen (command);
+  while (i > 0 && command[i - 1] == ' ')
+    i--;
+  if (i > 0 && command[i - 1] == '&')
+    {
+      background = true;
+      command[i - 1] = '\0';
+      for (job = jobs; job < jobs + MAX_JOBS; job++)
+        if (job->stage_cnt == 0)
+          break;
+      if (job == jobs + MAX_JOBS)
+        {
+          printf ("too many background jobs\n");
+          return;
+        }
+    }
+  strlcpy (job->command, command, sizeof job->command);
+
+  /* Split into stages and words.  A `|' must stand apart from the
+     words around it. */
+  for (token = strtok_r (command, " ", &save_ptr); token != NULL;
+       token = strtok_r (NULL, " ", &save_ptr))
+    if (!strcmp (token, "|"))
+      {
+        if (argc == 0 || stage_cnt + 1 >= MAX_STAGES)
+          {
+            printf ("bad pipeline\n");
+            return;
+          }
+        argv[stage_cnt++][argc] = NULL;
+        argc = 0;
+      }
+    else if (argc < MAX_ARGS)
+      argv[stage_cnt][argc++] = token;
+  if (argc == 0)
+    {
+      if (stage_cnt > 0)
+        printf ("bad pipeline\n");
+      return;
+    }
+  argv[stage_cnt++][argc] = NULL;
+
+  for (i = 0; i < stage_cnt - 1; i++)
+    if (!pipe (pipes[i]))
+      {
+        printf ("pipe failed\n");
+        while (i-- > 0)
+          {
+            close (pipes[i][0]);
+            close (pipes[i][1]);
+          }
+        return;
+      }
+
+  /* Start every stage with its neighbors' pipe ends as standard
+     input and output. */
+  start = now_ns ();
+  job->stage_cnt = stage_cnt;
+  job->status = -1;
+  for (i = 0; i < stage_cnt; i++)
+    {
+      struct spawn_fd fds[2];
+      int fd_cnt = 0;
+
+      if (i > 0)
+        fds[fd_cnt++] = (struct spawn_fd) {STDIN_FILENO, pipes[i - 1][0]};
+      if (i < stage_cnt - 1)
+        fds[fd_cnt++] = (struct spawn_fd) {STDOUT_FILENO, pipes[i][1]};
+      job->pids[i] = spawn (argv[i][0], argv[i], fds, fd_cnt);
+      if (job->pids[i] == PID_ERROR)
+        {
+          printf ("\"%s\": spawn failed\n", argv[i][0]);
+          job->pids[i] = 0;
+        }
+    }
+
+  /* Only the stages may hold the pipes now, so that each reader
+     sees end of file once its writer exits. */
+  for (i = 0; i < stage_cnt - 1; i++)
+    {
+      close (pipes[i][0]);
+      close (pipes[i][1]);
+    }
+
+  if (background)
+    {
+      printf ("[%d]", (int) (job - jobs) + 1);
+      for (i = 0; i < stage_cnt; i++)
+        printf (" %d", job->pids[i]);
+      printf ("\n");
+      return;
+    }
+
+  wait_job (job, true);
+  printf ("\"%s\": exit code %d\n", job->command, job->status);
+  if (timed)
+    {
+      uint64_t ns = now_ns () - start;
+      printf ("real %d.%03ds\n", (int) (ns / 1000000000),
+              (int) (ns / 1000000 % 1000));
+    }
+}
+
+/* Reaps the stages of JOB that have exited, waiting for all of
+   them if BLOCK.  Returns true once every stage is reaped. */
+static bool
+wait_job (struct job *job, bool block)
+{
+  bool done = true;
+  int i;
+
+  for (i = 0; i < job->stage_cnt; i++)
+    if (job->pids[i] != 0)
+      {
+        int status;
+        pid_t pid = waitpid (job->pids[i], &status, block ? 0 : WNOHANG);
+
+        if (pid == 0)
+          done = false;
+        else
+          {
+            if (i == job->stage_cnt - 1)
+              job->status = pid == job->pids[i] ? status : -1;
+            job->pids[i] = 0;
+          }
+      }
+  return done;
+}
+
+/* Reports and frees the background jobs that have finished. */
+static void
+reap_jobs (void)
+{
+  struct job *j;
+
+  for (j = jobs; j < jobs + MAX_JOBS; j++)
+    if (j->stage_cnt > 0 && wait_job (j, false))
+      {
+        printf ("[%d] done \"%s\": exit code %d\n",
+                (int) (j - jobs) + 1, j->command, j->status);
+        j->stage_cnt = 0;
+      }
+}
+
+/* Returns the time since boot in nanoseconds. */
+static uint64_t
+now_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (&ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 /* Reads a line of input from the user into LINE, which has room
    for SIZE bytes.  Handles backspace and Ctrl+U in the ways
    expected by Unix users.  On return, LINE will always be
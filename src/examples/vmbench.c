@@ -0,0 +1,128 @@
+/* vmbench.c
+
+   Paging benchmark.  Touches a working set sized as a percentage
+   of the frames in the user pool with a sequential, uniformly
+   random or Zipf-distributed (s = 1) pattern of page writes, and
+   reports faults and swap traffic per second along with the
+   runtime, in the format of examples/bench.c.  For example, with
+   4 MB of RAM and a working set of twice the user pool:
+
+     pintos -m 4 --swap-size=16 -p vmbench -a vmbench -- -q -f
+       run 'vmbench zipf 200'
+
+   Needs a kernel with virtual memory. */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "bench.h"
+
+#define PAGE_SIZE 4096
+#define MAX_PAGES 4096                  /* 16 MB. */
+
+static char region[MAX_PAGES * PAGE_SIZE];
+
+/* Cumulative Zipf weights: zipf_cdf[I] is the sum of the weights
+   1 / (J + 1) for J <= I, scaled to integers. */
+static unsigned zipf_cdf[MAX_PAGES];
+
+/* Random page choices, from a generator cheap enough not to
+   distort the measurement. */
+static struct random_state rs;
+
+/* Returns a page in [0, PAGES) drawn from the Zipf
+   distribution. */
+static int
+zipf_page (int pages) 
+{
+  unsigned r = random_next (&rs) % zipf_cdf[pages - 1];
+  int lo = 0, hi = pages - 1;
+
+  while (lo < hi)
+    {
+      int mid = (lo + hi) / 2;
+      if (zipf_cdf[mid] > r)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+  return lo;
+}
+
+int
+main (int argc, char *argv[]) 
+{
+  const char *pattern = argc > 1 ? argv[1] : "seq";
+  int percent = argc > 2 ? atoi (argv[2]) : 100;
+  int passes = argc > 3 ? atoi (argv[3]) : 4;
+  struct vmstat before, after;
+  char name[32];
+  unsigned start;
+  long long accesses;
+  int pages, i;
+
+  vmstat (&before);
+  pages = (long long) before.frames * percent / 100;
+  if (argc > 4 || pages <= 0 || passes <= 0
+      || (strcmp (pattern, "seq") && strcmp (pattern, "random")
+          && strcmp (pattern, "zipf"))) 
+    {
+      printf ("usage: vmbench [seq|random|zipf [PERCENT [PASSES]]]\n"
+              "PERCENT is the working set as a percentage of "
+              "physical memory.\n");
+      return EXIT_FAILURE;
+    }
+  if (pages > MAX_PAGES) 
+    {
+      printf ("vmbench: working set limited to %d pages\n", MAX_PAGES);
+      pages = MAX_PAGES;
+    }
+
+  if (!strcmp (pattern, "zipf"))
+    for (i = 0; i < pages; i++)
+      zipf_cdf[i] = (i > 0 ? zipf_cdf[i - 1] : 0) + 65536 / (i + 1);
+
+  /* Bring the working set in once before measuring. */
+  for (i = 0; i < pages; i++)
+    region[i * PAGE_SIZE] = 1;
+
+  random_state_init (&rs, 0, 0);
+  accesses = (long long) pages * passes;
+  vmstat (&before);
+  start = bench_start ();
+  if (!strcmp (pattern, "seq"))
+    {
+      int p;
+
+      for (p = 0; p < passes; p++)
+        for (i = 0; i < pages; i++)
+          region[i * PAGE_SIZE]++;
+    }
+  else
+    {
+      long long n;
+
+      for (n = 0; n < accesses; n++)
+        {
+          int page = (!strcmp (pattern, "random")
+                      ? (int) (random_next (&rs) % pages) : zipf_page (pages));
+          region[page * PAGE_SIZE + n % PAGE_SIZE]++;
+        }
+    }
+  vmstat (&after);
+
+  snprintf (name, sizeof name, "vm-%s", pattern);
+  bench_report (name, "frames", before.frames);
+  bench_report (name, "working_set_pages", pages);
+  bench_report_rate (name, "accesses", accesses, start);
+  bench_report_rate (name, "faults",
+                     (after.minor_faults + after.major_faults)
+                     - (before.minor_faults + before.major_faults), start);
+  bench_report_rate (name, "swap_ins", after.swap_ins - before.swap_ins,
+                     start);
+  bench_report_rate (name, "swap_outs", after.swap_outs - before.swap_outs,
+                     start);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,522 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "filesys/journal.h"
+#include "devices/timer.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+
+/* Interval between write-backs of dirty sectors by flush_work,
+   in timer ticks. */
+#define FLUSH_INTERVAL (TIMER_FREQ * 5)
+
+/* A cached copy of one file system sector. */
+struct cache_entry
+  {
+    block_sector_t sector;              /* Sector cached here. */
+    bool valid;                         /* Holds a sector? */
+    bool dirty;                         /* Modified since read? */
+    bool accessed;                      /* Used since last clock sweep? */
+    bool pinned;                        /* In the running transaction? */
+    bool logged;                        /* Dirty, but safe in the
+                                           journal? */
+    enum block_io_class class;          /* Who used it last, for I/O
+                                           statistics. */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Sector contents. */
+  };
+
+/* The cache and the lock that protects all of it. */
+static struct cache_entry cache[CACHE_SIZE];
+static struct lock cache_lock;
+
+/* Dirty entries are written back in order of sector, runs of up
+   to FLUSH_RUN consecutive sectors in one request through
+   flush_buffer. */
+#define FLUSH_RUN 8
+static uint8_t flush_buffer[FLUSH_RUN * BLOCK_SECTOR_SIZE];
+
+/* Runs of up to READ_RUN consecutive sectors that are not cached
+   yet are read in one request through read_buffer, for
+   cache_read_run(). */
+#define READ_RUN 8
+static uint8_t read_buffer[READ_RUN * BLOCK_SECTOR_SIZE];
+
+/* Next entry to be examined by the clock eviction algorithm. */
+static size_t clock_hand;
+
+/* Metadata sectors written since the last commit are pinned in
+   the cache until the transaction that holds them is committed
+   to the journal, so that they never reach their home sectors
+   before the journal.  At most JOURNAL_TXN_MAX are pinned; past
+   that, metadata is written like data.  A write that does not
+   join the transaction to a sector that replaying the journal
+   would overwrite empties the journal first, so that a replay
+   cannot undo it. */
+static size_t txn_cnt;
+
+/* Queue of sectors to be fetched in the background by
+   read_ahead_work.  Requests that arrive while the queue is
+   full are dropped, since read-ahead is only a hint. */
+#define READ_AHEAD_SLOTS 32
+static block_sector_t read_ahead_queue[READ_AHEAD_SLOTS];
+static enum block_io_class read_ahead_class[READ_AHEAD_SLOTS];
+static size_t read_ahead_head;          /* Index of oldest request. */
+static size_t read_ahead_cnt;           /* Number of requests queued. */
+static struct lock read_ahead_lock;
+
+/* Background work, run by the kernel work queue. */
+static struct work flush_work;
+static struct work read_ahead_work;
+static work_func flush_periodic;
+static work_func read_ahead_drain;
+static struct cache_entry *lookup (block_sector_t);
+static struct cache_entry *load (block_sector_t, bool read,
+                                 enum block_io_class);
+static void write_back (struct cache_entry *);
+static void write_back_run (struct cache_entry *[], size_t cnt);
+static void write_back_sorted (struct cache_entry *[], size_t cnt);
+static size_t collect_dirty (struct cache_entry *[], bool logged_only);
+static void checkpoint (void);
+
+/* Initializes the buffer cache and schedules the work that
+   periodically writes dirty sectors back to disk.  Must be called
+   after workqueue_init(). */
+void
+cache_init (void) 
+{
+  size_t i;
+
+  lock_init_named (&cache_lock, "buffer cache");
+  for (i = 0; i < CACHE_SIZE; i++)
+    cache[i].valid = false;
+  clock_hand = 0;
+  txn_cnt = 0;
+
+  lock_init_named (&read_ahead_lock, "read-ahead");
+  read_ahead_head = read_ahead_cnt = 0;
+  work_init (&read_ahead_work, read_ahead_drain, NULL);
+
+  work_init (&flush_work, flush_periodic, NULL);
+  work_queue_delayed (&flush_work, FLUSH_INTERVAL);
+}
+
+/* Reads sector SECTOR into BUFFER, which must have room for
+   BLOCK_SECTOR_SIZE bytes.  CLASS tells what the sector holds,
+   for block device statistics, here and below. */
+void
+cache_read (block_sector_t sector, void *buffer, enum block_io_class class) 
+{
+  cache_read_at (sector, buffer, 0, BLOCK_SECTOR_SIZE, class);
+}
+
+/* Reads SIZE bytes starting at byte offset OFS within sector
+   SECTOR into BUFFER. */
+void
+cache_read_at (block_sector_t sector, void *buffer, int ofs, int size,
+               enum block_io_class class) 
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  lock_acquire (&cache_lock);
+  e = load (sector, true, class);
+  memcpy (buffer, e->data + ofs, size);
+  lock_release (&cache_lock);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes from BUFFER to sector SECTOR.
+   The data reaches the disk when the entry is evicted or
+   flushed. */
+void
+cache_write (block_sector_t sector, const void *buffer,
+             enum block_io_class class) 
+{
+  cache_write_at (sector, buffer, 0, BLOCK_SECTOR_SIZE, class);
+}
+
+/* Writes SIZE bytes from BUFFER into sector SECTOR starting at
+   byte offset OFS.  The rest of the sector is preserved.
+   Metadata joins the running transaction. */
+void
+cache_write_at (block_sector_t sector, const void *buffer,
+                int ofs, int size, enum block_io_class class) 
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  lock_acquire (&cache_lock);
+  e = load (sector, size < BLOCK_SECTOR_SIZE, class);
+
+  /* The journal's copy of a committed sector must reach home
+     before it changes again, or a crash could lose it. */
+  if (e->logged)
+    write_back (e);
+  if (!e->pinned)
+    {
+      bool meta = class == BLOCK_IO_INODE_META || class == BLOCK_IO_FREE_MAP;
+      if (meta && txn_cnt < JOURNAL_TXN_MAX)
+        {
+          e->pinned = true;
+          txn_cnt++;
+        }
+      else if (journal_covers (sector))
+        {
+          checkpoint ();
+          journal_invalidate ();
+        }
+    }
+  memcpy (e->data + ofs, buffer, size);
+  e->dirty = true;
+  lock_release (&cache_lock);
+}
+
+/* Asks a worker thread to bring SECTOR into the cache in the
+   background.  Returns without waiting for the read. */
+void
+cache_read_ahead (block_sector_t sector, enum block_io_class class) 
+{
+  lock_acquire (&read_ahead_lock);
+  if (read_ahead_cnt < READ_AHEAD_SLOTS)
+    {
+      size_t slot = (read_ahead_head + read_ahead_cnt) % READ_AHEAD_SLOTS;
+      read_ahead_queue[slot] = sector;
+      read_ahead_class[slot] = class;
+      read_ahead_cnt++;
+    }
+  lock_release (&read_ahead_lock);
+  work_queue (&read_ahead_work);
+}
+
+/* Returns true if SECTOR is in the cache now. */
+bool
+cache_contains (block_sector_t sector) 
+{
+  bool found;
+
+  lock_acquire (&cache_lock);
+  found = lookup (sector) != NULL;
+  lock_release (&cache_lock);
+  return found;
+}
+
+/* Brings the CNT sectors starting at SECTOR into the cache.  Each
+   run of them that is not cached yet is read with one request of
+   up to READ_RUN sectors, rather than a request per sector. */
+void
+cache_read_run (block_sector_t sector, size_t cnt,
+                enum block_io_class class) 
+{
+  lock_acquire (&cache_lock);
+  while (cnt > 0)
+    {
+      struct cache_entry *run[READ_RUN];
+      size_t n, i;
+
+      if (lookup (sector) != NULL)
+        {
+          sector++;
+          cnt--;
+          continue;
+        }
+      for (n = 0; n < cnt && n < READ_RUN && lookup (sector + n) == NULL; n++)
+        run[n] = load (sector + n, false, class);
+      block_transfer (fs_device, sector, n, read_buffer, false, class);
+
+      /* Finding an entry for one sector of the run may, rarely,
+         have taken the entry just found for another. */
+      for (i = 0; i < n; i++)
+        if (run[i]->sector == sector + i)
+          memcpy (run[i]->data, read_buffer + i * BLOCK_SECTOR_SIZE,
+                  BLOCK_SECTOR_SIZE);
+      sector += n;
+      cnt -= n;
+    }
+  lock_release (&cache_lock);
+}
+
+/* Returns the number of sectors in the running transaction. */
+size_t
+cache_txn_size (void) 
+{
+  size_t cnt;
+
+  lock_acquire (&cache_lock);
+  cnt = txn_cnt;
+  lock_release (&cache_lock);
+  return cnt;
+}
+
+/* Commits the running transaction: checkpoints the previous one,
+   writes the pinned sectors to the journal and unpins them, so
+   that they may go home like any other dirty sector.  Called by
+   journal_commit() while no operation is in progress. */
+void
+cache_commit (void) 
+{
+  block_sector_t sectors[JOURNAL_TXN_MAX];
+  const void *blocks[JOURNAL_TXN_MAX];
+  struct cache_entry *pinned[JOURNAL_TXN_MAX];
+  size_t cnt = 0;
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  checkpoint ();
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].valid && cache[i].pinned)
+      {
+        pinned[cnt] = &cache[i];
+        sectors[cnt] = cache[i].sector;
+        blocks[cnt] = cache[i].data;
+        cnt++;
+      }
+  ASSERT (cnt == txn_cnt);
+  if (cnt > 0)
+    {
+      journal_log (sectors, blocks, cnt);
+      for (i = 0; i < cnt; i++)
+        {
+          pinned[i]->pinned = false;
+          pinned[i]->logged = pinned[i]->dirty;
+        }
+      txn_cnt = 0;
+    }
+  lock_release (&cache_lock);
+}
+
+/* Writes every dirty sector in the cache back to disk, except
+   those in the running transaction. */
+void
+cache_flush (void) 
+{
+  struct cache_entry *dirty[CACHE_SIZE];
+
+  lock_acquire (&cache_lock);
+  write_back_sorted (dirty, collect_dirty (dirty, false));
+  lock_release (&cache_lock);
+}
+
+/* Writes those of the CNT SECTORS that are cached and dirty back
+   to disk, except those in the running transaction. */
+void
+cache_flush_sectors (const block_sector_t sectors[], size_t cnt) 
+{
+  struct cache_entry *dirty[CACHE_SIZE];
+  size_t dirty_cnt = 0;
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < cnt; i++)
+    {
+      struct cache_entry *e = lookup (sectors[i]);
+      if (e != NULL && e->dirty && !e->pinned && dirty_cnt < CACHE_SIZE)
+        dirty[dirty_cnt++] = e;
+    }
+  write_back_sorted (dirty, dirty_cnt);
+  lock_release (&cache_lock);
+}
+
+/* Shuts down the buffer cache, writing dirty sectors to disk. */
+void
+cache_done (void) 
+{
+  cache_flush ();
+}
+
+/* Commits the running transaction and writes dirty sectors back
+   to disk, then queues itself to do so again in FLUSH_INTERVAL
+   ticks, so that a crash loses at most that much work. */
+static void
+flush_periodic (void *aux UNUSED) 
+{
+  journal_commit ();
+  cache_flush ();
+  work_queue_delayed (&flush_work, FLUSH_INTERVAL);
+}
+
+/* Fetches the sectors queued by cache_read_ahead() into the
+   cache, until the queue is empty.  Consecutive sectors queued one
+   after another are read together. */
+static void
+read_ahead_drain (void *aux UNUSED) 
+{
+  for (;;)
+    {
+      block_sector_t sector;
+      enum block_io_class class;
+      size_t cnt;
+
+      lock_acquire (&read_ahead_lock);
+      if (read_ahead_cnt == 0)
+        {
+          lock_release (&read_ahead_lock);
+          return;
+        }
+      sector = read_ahead_queue[read_ahead_head];
+      class = read_ahead_class[read_ahead_head];
+      cnt = 0;
+      do
+        {
+          read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_SLOTS;
+          read_ahead_cnt--;
+          cnt++;
+        }
+      while (read_ahead_cnt > 0 && cnt < READ_RUN
+             && read_ahead_queue[read_ahead_head] == sector + cnt
+             && read_ahead_class[read_ahead_head] == class);
+      lock_release (&read_ahead_lock);
+
+      cache_read_run (sector, cnt, class);
+    }
+}
+
+/* Returns the entry holding SECTOR, or a null pointer if SECTOR
+   is not cached.  cache_lock must be held. */
+static struct cache_entry *
+lookup (block_sector_t sector) 
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].valid && cache[i].sector == sector)
+      return &cache[i];
+  return NULL;
+}
+
+/* Returns the entry holding SECTOR, bringing it into the cache
+   if necessary.  A newly cached sector's data is read from disk
+   if READ is true; otherwise the caller is about to overwrite
+   all of it.  The entry's I/O is accounted to CLASS from now on.
+   cache_lock must be held. */
+static struct cache_entry *
+load (block_sector_t sector, bool read, enum block_io_class class) 
+{
+  struct cache_entry *e;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  e = lookup (sector);
+  if (e == NULL)
+    {
+      /* Clock algorithm: sweep past recently used entries,
+         clearing their accessed bits, until one is found that
+         has not been used since the last sweep.  Pinned entries
+         are passed over; there are always others. */
+      for (;;)
+        {
+          e = &cache[clock_hand];
+          clock_hand = (clock_hand + 1) % CACHE_SIZE;
+          if (!e->valid || (!e->accessed && !e->pinned))
+            break;
+          e->accessed = false;
+        }
+
+      write_back (e);
+      e->sector = sector;
+      e->valid = true;
+      e->dirty = false;
+      e->pinned = e->logged = false;
+      e->class = class;
+      if (read)
+        block_transfer (fs_device, sector, 1, e->data, false, class);
+    }
+  e->accessed = true;
+  e->class = class;
+  return e;
+}
+
+/* Writes E back to disk if it is dirty and not pinned.
+   cache_lock must be held. */
+static void
+write_back (struct cache_entry *e) 
+{
+  if (e->valid && e->dirty && !e->pinned)
+    {
+      block_transfer (fs_device, e->sector, 1, e->data, true, e->class);
+      e->dirty = e->logged = false;
+    }
+}
+
+/* Writes the CNT dirty entries in RUN, which hold consecutive
+   sectors, back to disk in one request.  cache_lock must be
+   held. */
+static void
+write_back_run (struct cache_entry *run[], size_t cnt) 
+{
+  size_t i;
+
+  ASSERT (cnt > 0 && cnt <= FLUSH_RUN);
+
+  if (cnt == 1)
+    {
+      write_back (run[0]);
+      return;
+    }
+  for (i = 0; i < cnt; i++)
+    {
+      memcpy (flush_buffer + i * BLOCK_SECTOR_SIZE, run[i]->data,
+              BLOCK_SECTOR_SIZE);
+      run[i]->dirty = run[i]->logged = false;
+    }
+  block_transfer (fs_device, run[0]->sector, cnt, flush_buffer, true,
+                  run[0]->class);
+}
+
+/* Writes the CNT dirty, unpinned entries in ENTRIES back to disk
+   in order of sector, merging consecutive sectors into runs.
+   Reorders ENTRIES.  cache_lock must be held. */
+static void
+write_back_sorted (struct cache_entry *entries[], size_t cnt) 
+{
+  size_t i, j;
+
+  /* Insertion sort, since there are at most CACHE_SIZE. */
+  for (i = 1; i < cnt; i++)
+    {
+      struct cache_entry *e = entries[i];
+      for (j = i; j > 0 && entries[j - 1]->sector > e->sector; j--)
+        entries[j] = entries[j - 1];
+      entries[j] = e;
+    }
+
+  for (i = 0; i < cnt; i += j)
+    {
+      j = 1;
+      while (j < FLUSH_RUN && i + j < cnt
+             && entries[i + j]->sector == entries[i]->sector + j)
+        j++;
+      write_back_run (entries + i, j);
+    }
+}
+
+/* Stores in ENTRIES the dirty entries that are not pinned, only
+   those that are logged if LOGGED_ONLY is true, and returns how
+   many there are.  cache_lock must be held. */
+static size_t
+collect_dirty (struct cache_entry *entries[], bool logged_only) 
+{
+  size_t cnt = 0;
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+      if (e->valid && e->dirty && !e->pinned && (e->logged || !logged_only))
+        entries[cnt++] = e;
+    }
+  return cnt;
+}
+
+/* Writes the sectors of the last committed transaction that have
+   not yet reached their home sectors back to disk, so that the
+   journal may be reused.  cache_lock must be held. */
+static void
+checkpoint (void) 
+{
+  struct cache_entry *logged[CACHE_SIZE];
+
+  write_back_sorted (logged, collect_dirty (logged, true));
+}
@@ -0,0 +1,27 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Number of sectors held in the buffer cache. */
+#define CACHE_SIZE 64
+
+void cache_init (void);
+void cache_read (block_sector_t, void *, enum block_io_class);
+void cache_read_at (block_sector_t, void *, int ofs, int size,
+                    enum block_io_class);
+void cache_write (block_sector_t, const void *, enum block_io_class);
+void cache_write_at (block_sector_t, const void *, int ofs, int size,
+                     enum block_io_class);
+void cache_read_ahead (block_sector_t, enum block_io_class);
+void cache_read_run (block_sector_t, size_t cnt, enum block_io_class);
+bool cache_contains (block_sector_t);
+size_t cache_txn_size (void);
+void cache_commit (void);
+void cache_flush (void);
+void cache_flush_sectors (const block_sector_t[], size_t);
+void cache_done (void);
+
+#endif /* filesys/cache.h */
@@ -0,0 +1,196 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "filesys/inode.h"
+#include "threads/synch.h"
+
+/* A cached path component: the result of looking up NAME in the
+   directory in sector DIR.  A positive entry keeps the child's
+   inode open, so that its sector cannot be reused while the entry
+   exists; a negative entry records that there is no such name. */
+struct dentry
+  {
+    struct hash_elem hash_elem;         /* Element in dentry_hash. */
+    struct list_elem lru_elem;          /* Element in lru or free_list. */
+    block_sector_t dir;                 /* Sector of parent directory. */
+    char name[NAME_MAX + 1];            /* Name, or "" if unused. */
+    struct inode *inode;                /* Child, or null if absent. */
+  };
+
+/* The entries, those in use hashed by (DIR, NAME) and ordered
+   from most to least recently used, and the lock that protects
+   all of them. */
+static struct dentry dentries[DCACHE_SIZE];
+static struct hash dentry_hash;
+static struct list lru;
+static struct list free_list;
+static struct lock dcache_lock;
+
+/* Bumped by every invalidation.  A lookup that missed may only
+   insert its result if no directory changed while it looked. */
+static unsigned generation;
+
+static unsigned
+dentry_hash_func (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+  return hash_string (d->name) ^ hash_int (d->dir);
+}
+
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+  const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+  if (a->dir != b->dir)
+    return a->dir < b->dir;
+  return strcmp (a->name, b->name) < 0;
+}
+
+/* Returns the entry for NAME in DIR, or a null pointer.
+   Must be called with dcache_lock held. */
+static struct dentry *
+find (block_sector_t dir, const char *name)
+{
+  struct dentry key;
+  struct hash_elem *e;
+
+  key.dir = dir;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dentry_hash, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Drops entry D, closing its inode.
+   Must be called with dcache_lock held. */
+static void
+discard (struct dentry *d)
+{
+  hash_delete (&dentry_hash, &d->hash_elem);
+  list_remove (&d->lru_elem);
+  inode_close (d->inode);
+  d->inode = NULL;
+  d->name[0] = '\0';
+  list_push_front (&free_list, &d->lru_elem);
+}
+
+/* Initializes the dentry cache. */
+void
+dcache_init (void)
+{
+  size_t i;
+
+  if (!hash_init (&dentry_hash, dentry_hash_func, dentry_less, NULL))
+    PANIC ("dentry cache creation failed");
+  list_init (&lru);
+  list_init (&free_list);
+  lock_init_named (&dcache_lock, "dcache");
+  for (i = 0; i < DCACHE_SIZE; i++)
+    list_push_back (&free_list, &dentries[i].lru_elem);
+}
+
+/* Returns the current generation, to be passed to dcache_insert()
+   after a lookup that missed the cache. */
+unsigned
+dcache_generation (void)
+{
+  unsigned gen;
+
+  lock_acquire (&dcache_lock);
+  gen = generation;
+  lock_release (&dcache_lock);
+  return gen;
+}
+
+/* Looks up NAME in the directory in sector DIR.  If the cache
+   knows it, returns a newly opened inode for it, which the caller
+   must close.  Otherwise returns a null pointer and sets *ABSENT
+   to true if the cache knows that there is no such name, to false
+   if it does not know. */
+struct inode *
+dcache_lookup (block_sector_t dir, const char *name, bool *absent)
+{
+  struct inode *inode = NULL;
+  struct dentry *d;
+
+  *absent = false;
+  if (*name == '\0' || strlen (name) > NAME_MAX)
+    return NULL;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d != NULL)
+    {
+      list_remove (&d->lru_elem);
+      list_push_front (&lru, &d->lru_elem);
+      inode = inode_reopen (d->inode);
+      *absent = inode == NULL;
+    }
+  lock_release (&dcache_lock);
+  return inode;
+}
+
+/* Records that NAME in the directory in sector DIR is INODE, or
+   that there is no such name if INODE is a null pointer.  Does
+   nothing if the cache has been invalidated since GENERATION was
+   obtained from dcache_generation(), since the lookup may then be
+   out of date. */
+void
+dcache_insert (unsigned gen, block_sector_t dir, const char *name,
+               struct inode *inode)
+{
+  struct dentry *d;
+
+  if (*name == '\0' || strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  if (gen == generation && find (dir, name) == NULL)
+    {
+      if (list_empty (&free_list))
+        discard (list_entry (list_back (&lru), struct dentry, lru_elem));
+      d = list_entry (list_pop_front (&free_list), struct dentry, lru_elem);
+      d->dir = dir;
+      strlcpy (d->name, name, sizeof d->name);
+      d->inode = inode_reopen (inode);
+      hash_insert (&dentry_hash, &d->hash_elem);
+      list_push_front (&lru, &d->lru_elem);
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Forgets whatever is known about NAME in the directory in sector
+   DIR.  Must be called whenever such an entry is added or
+   removed. */
+void
+dcache_invalidate (block_sector_t dir, const char *name)
+{
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  generation++;
+  d = find (dir, name);
+  if (d != NULL)
+    discard (d);
+  lock_release (&dcache_lock);
+}
+
+/* Forgets every entry of the directory in sector DIR, which is
+   being removed, so that none survives the reuse of its
+   sector. */
+void
+dcache_forget_dir (block_sector_t dir)
+{
+  size_t i;
+
+  lock_acquire (&dcache_lock);
+  generation++;
+  for (i = 0; i < DCACHE_SIZE; i++)
+    if (dentries[i].dir == dir && dentries[i].name[0] != '\0')
+      discard (&dentries[i]);
+  lock_release (&dcache_lock);
+}
@@ -0,0 +1,21 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Number of path components held in the dentry cache. */
+#define DCACHE_SIZE 64
+
+struct inode;
+
+void dcache_init (void);
+unsigned dcache_generation (void);
+struct inode *dcache_lookup (block_sector_t dir, const char *name,
+                             bool *absent);
+void dcache_insert (unsigned generation, block_sector_t dir,
+                    const char *name, struct inode *);
+void dcache_invalidate (block_sector_t dir, const char *name);
+void dcache_forget_dir (block_sector_t dir);
+
+#endif /* filesys/dcache.h */
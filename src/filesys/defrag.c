@@ -0,0 +1,152 @@
+#include "filesys/defrag.h"
+#include <debug.h>
+#include <list.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/directory.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tunable.h"
+
+/* On-line defragmentation.  A pass walks the whole directory tree
+   and has inode_defrag() move each file's data sectors into one
+   run right after its inode.  Besides keeping sequential reads and
+   read-ahead on consecutive sectors, this gathers free space: a
+   file moves only into a free run big enough to hold all of it,
+   and the pieces it leaves behind become free.  Files stay open
+   and in use throughout.
+
+   A pass runs on request with the `defrag' action, and every
+   defrag_interval seconds in a thread of its own if that tunable
+   is set. */
+
+/* Held while a file is being moved, so that defrag_done() can wait
+   for the move in progress. */
+static struct lock defrag_lock;
+
+/* Set by defrag_done() to end all passes. */
+static bool stopped;
+
+/* Seconds between background passes, or 0 for none. */
+static int interval;
+
+static thread_func defrag_daemon NO_RETURN;
+
+/* Starts the background defragmenter, if the defrag_interval
+   tunable asks for one. */
+void
+defrag_init (void) 
+{
+  lock_init_named (&defrag_lock, "defrag");
+  interval = tunable_int ("defrag_interval", 0, 0, 3600);
+  if (interval > 0)
+    thread_create ("defrag", PRI_MIN, defrag_daemon, NULL);
+}
+
+/* Waits for any file being moved and keeps any more from being
+   moved, before the file system shuts down. */
+void
+defrag_done (void) 
+{
+  lock_acquire (&defrag_lock);
+  stopped = true;
+  lock_release (&defrag_lock);
+}
+
+/* Defragments INODE and adds to STATS.  Returns false if
+   defrag_done() has been called. */
+static bool
+defrag_inode (struct inode *inode, struct defrag_stats *stats) 
+{
+  size_t moved;
+
+  lock_acquire (&defrag_lock);
+  if (stopped)
+    {
+      lock_release (&defrag_lock);
+      return false;
+    }
+  moved = inode_defrag (inode);
+  lock_release (&defrag_lock);
+
+  stats->files++;
+  if (moved > 0)
+    {
+      stats->moved_files++;
+      stats->moved_sectors += moved;
+    }
+  return true;
+}
+
+/* A directory waiting to be walked. */
+struct pending_dir
+  {
+    struct list_elem elem;
+    block_sector_t sector;      /* Its inode. */
+  };
+
+/* Adds the directory in SECTOR to DIRS.  A directory is skipped if
+   memory is short. */
+static void
+push_dir (struct list *dirs, block_sector_t sector) 
+{
+  struct pending_dir *p = malloc (sizeof *p);
+  if (p != NULL)
+    {
+      p->sector = sector;
+      list_push_back (dirs, &p->elem);
+    }
+}
+
+/* Defragments every file and directory, breadth first so that the
+   walk needs no stack, and reports what it did in STATS. */
+void
+defrag_all (struct defrag_stats *stats) 
+{
+  struct list dirs;
+  bool running = true;
+
+  memset (stats, 0, sizeof *stats);
+  list_init (&dirs);
+  push_dir (&dirs, ROOT_DIR_SECTOR);
+  while (!list_empty (&dirs))
+    {
+      struct pending_dir *p = list_entry (list_pop_front (&dirs),
+                                          struct pending_dir, elem);
+      struct dir *dir = running ? dir_open (inode_open (p->sector)) : NULL;
+      char name[NAME_MAX + 1];
+      struct inode *inode;
+
+      free (p);
+      if (dir == NULL)
+        continue;
+      running = defrag_inode (dir_get_inode (dir), stats);
+      while (running && dir_readdir_inode (dir, name, &inode))
+        {
+          if (inode == NULL)
+            continue;
+          if (inode_is_dir (inode))
+            push_dir (&dirs, inode_get_inumber (inode));
+          else
+            running = defrag_inode (inode, stats);
+          inode_close (inode);
+        }
+      dir_close (dir);
+    }
+}
+
+/* Body of the background defragmenter. */
+static void
+defrag_daemon (void *aux UNUSED) 
+{
+  for (;;)
+    {
+      struct defrag_stats stats;
+
+      timer_sleep ((int64_t) interval * TIMER_FREQ);
+      defrag_all (&stats);
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef FILESYS_DEFRAG_H
+#define FILESYS_DEFRAG_H
+
+#include <stddef.h>
+
+/* What a pass of defrag_all() did. */
+struct defrag_stats
+  {
+    size_t files;               /* Files and directories visited. */
+    size_t moved_files;         /* Of those, how many were moved. */
+    size_t moved_sectors;       /* Data sectors moved. */
+  };
+
+void defrag_init (void);
+void defrag_done (void);
+void defrag_all (struct defrag_stats *);
+
+#endif /* filesys/defrag.h */
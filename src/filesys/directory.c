@@ -1,7 +1,9 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
@@ -21,12 +23,37 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* Number of entries read at a time when scanning a directory. */
+#define SCAN_CNT (BLOCK_SECTOR_SIZE / sizeof (struct dir_entry))
+
+/* In-memory index of a directory's entries, built by the first
+   lookup and kept by the directory's inode until it is last
+   closed.  Protected by the inode's directory lock. */
+struct dir_index
+  {
+    struct hash names;                  /* dir_nodes of entries in use. */
+    off_t *free_ofs;                    /* Offsets of free entries. */
+    size_t free_cnt;                    /* Number of free entries. */
+    size_t free_cap;                    /* Capacity of FREE_OFS. */
+  };
+
+/* An entry in use, in a directory index. */
+struct dir_node
+  {
+    struct hash_elem elem;              /* Element in dir_index's names. */
+    block_sector_t inode_sector;        /* Sector number of header. */
+    off_t ofs;                          /* Byte offset of the entry. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+  };
+
 /* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+   given SECTOR, whose parent is the directory in sector PARENT.
+   Returns true if successful, false on failure. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector, size_t entry_cnt, block_sector_t parent)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  return inode_create_dir (sector, entry_cnt * sizeof (struct dir_entry),
+                           parent);
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -76,6 +103,22 @@ dir_close (struct dir *dir)
     }
 }
 
+/* Sets the position from which dir_readdir() reads the next
+   entry of DIR to POS, a value returned by dir_tell(). */
+void
+dir_seek (struct dir *dir, off_t pos) 
+{
+  dir->pos = pos;
+}
+
+/* Returns the position from which dir_readdir() reads the next
+   entry of DIR. */
+off_t
+dir_tell (const struct dir *dir) 
+{
+  return dir->pos;
+}
+
 /* Returns the inode encapsulated by DIR. */
 struct inode *
 dir_get_inode (struct dir *dir) 
@@ -83,6 +126,161 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
+/* Reads up to SCAN_CNT entries of INODE starting at byte offset
+   OFS into BUF.  Returns the number of entries read, which is
+   less than SCAN_CNT only at end of file. */
+static size_t
+read_entries (struct inode *inode, struct dir_entry buf[SCAN_CNT], off_t ofs)
+{
+  return inode_read_at (inode, buf, SCAN_CNT * sizeof *buf, ofs) / sizeof *buf;
+}
+
+static unsigned
+node_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_string (hash_entry (e, struct dir_node, elem)->name);
+}
+
+static bool
+node_less (const struct hash_elem *a, const struct hash_elem *b,
+           void *aux UNUSED)
+{
+  return strcmp (hash_entry (a, struct dir_node, elem)->name,
+                 hash_entry (b, struct dir_node, elem)->name) < 0;
+}
+
+static void
+node_free (struct hash_elem *e, void *aux UNUSED)
+{
+  free (hash_entry (e, struct dir_node, elem));
+}
+
+/* Records an entry for NAME, at byte offset OFS and naming
+   INODE_SECTOR, in INDEX.  Returns false if memory is short. */
+static bool
+index_add_name (struct dir_index *index, const char *name,
+                block_sector_t inode_sector, off_t ofs)
+{
+  struct dir_node *node = malloc (sizeof *node);
+  if (node == NULL)
+    return false;
+  strlcpy (node->name, name, sizeof node->name);
+  node->inode_sector = inode_sector;
+  node->ofs = ofs;
+  hash_insert (&index->names, &node->elem);
+  return true;
+}
+
+/* Records a free entry at byte offset OFS in INDEX.  Returns
+   false if memory is short. */
+static bool
+index_add_free (struct dir_index *index, off_t ofs)
+{
+  if (index->free_cnt == index->free_cap)
+    {
+      size_t cap = index->free_cap ? 2 * index->free_cap : SCAN_CNT;
+      off_t *free_ofs = realloc (index->free_ofs, cap * sizeof *free_ofs);
+      if (free_ofs == NULL)
+        return false;
+      index->free_ofs = free_ofs;
+      index->free_cap = cap;
+    }
+  index->free_ofs[index->free_cnt++] = ofs;
+  return true;
+}
+
+/* Frees INDEX, which may be a null pointer. */
+void
+dir_index_destroy (struct dir_index *index) 
+{
+  if (index != NULL)
+    {
+      hash_destroy (&index->names, node_free);
+      free (index->free_ofs);
+      free (index);
+    }
+}
+
+/* Returns the index of DIR, reading the whole directory to build
+   it if DIR's inode does not have one yet, or a null pointer if
+   memory is short.  Must be called with the directory lock
+   held. */
+static struct dir_index *
+get_index (const struct dir *dir) 
+{
+  struct dir_index *index = inode_get_dir_index (dir->inode);
+  struct dir_entry buf[SCAN_CNT];
+  off_t ofs = 0;
+  size_t cnt, i;
+
+  if (index != NULL)
+    return index;
+
+  index = malloc (sizeof *index);
+  if (index == NULL)
+    return NULL;
+  index->free_ofs = NULL;
+  index->free_cnt = index->free_cap = 0;
+  if (!hash_init (&index->names, node_hash, node_less, NULL))
+    {
+      free (index);
+      return NULL;
+    }
+
+  do
+    {
+      cnt = read_entries (dir->inode, buf, ofs);
+      for (i = 0; i < cnt; i++, ofs += sizeof *buf)
+        if (buf[i].in_use
+            ? !index_add_name (index, buf[i].name, buf[i].inode_sector, ofs)
+            : !index_add_free (index, ofs))
+          {
+            dir_index_destroy (index);
+            return NULL;
+          }
+    }
+  while (cnt == SCAN_CNT);
+
+  inode_set_dir_index (dir->inode, index);
+  return index;
+}
+
+/* Throws away DIR's index after a failure to keep it up to date.
+   The next lookup rebuilds it. */
+static void
+drop_index (const struct dir *dir) 
+{
+  dir_index_destroy (inode_get_dir_index (dir->inode));
+  inode_set_dir_index (dir->inode, NULL);
+}
+
+/* Reads DIR a sector's worth of entries at a time looking for
+   NAME, for lookup() when DIR has no index. */
+static bool
+scan_lookup (const struct dir *dir, const char *name,
+             struct dir_entry *ep, off_t *ofsp) 
+{
+  struct dir_entry buf[SCAN_CNT];
+  off_t ofs = 0;
+  size_t cnt, i;
+
+  do
+    {
+      cnt = read_entries (dir->inode, buf, ofs);
+      for (i = 0; i < cnt; i++, ofs += sizeof *buf)
+        if (buf[i].in_use && !strcmp (name, buf[i].name)) 
+          {
+            if (ep != NULL)
+              *ep = buf[i];
+            if (ofsp != NULL)
+              *ofsp = ofs;
+            return true;
+          }
+    }
+  while (cnt == SCAN_CNT);
+  return false;
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
@@ -92,23 +290,74 @@ static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
-  struct dir_entry e;
-  size_t ofs;
+  struct dir_index *index;
+  struct dir_node key;
+  struct dir_node *node;
+  struct hash_elem *e;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
-  return false;
+  if (strlen (name) > NAME_MAX)
+    return false;
+
+  index = get_index (dir);
+  if (index == NULL)
+    return scan_lookup (dir, name, ep, ofsp);
+
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&index->names, &key.elem);
+  if (e == NULL)
+    return false;
+  node = hash_entry (e, struct dir_node, elem);
+  if (ep != NULL)
+    {
+      ep->inode_sector = node->inode_sector;
+      strlcpy (ep->name, node->name, sizeof ep->name);
+      ep->in_use = true;
+    }
+  if (ofsp != NULL)
+    *ofsp = node->ofs;
+  return true;
+}
+
+/* Returns the byte offset of the first free entry in DIR, or the
+   end of the directory if there are no free entries, for
+   find_free() when DIR has no index.
+
+   inode_read_at() will only return a short read at end of file.
+   Otherwise, we'd need to verify that we didn't get a short
+   read due to something intermittent such as low memory. */
+static off_t
+scan_free (const struct dir *dir) 
+{
+  struct dir_entry buf[SCAN_CNT];
+  off_t ofs = 0;
+  size_t cnt, i;
+
+  do
+    {
+      cnt = read_entries (dir->inode, buf, ofs);
+      for (i = 0; i < cnt; i++, ofs += sizeof *buf)
+        if (!buf[i].in_use)
+          return ofs;
+    }
+  while (cnt == SCAN_CNT);
+  return ofs;
+}
+
+/* Returns the byte offset of a free entry in DIR, or the end of
+   the directory if there are no free entries. */
+static off_t
+find_free (const struct dir *dir) 
+{
+  struct dir_index *index = get_index (dir);
+
+  if (index == NULL)
+    return scan_free (dir);
+  return (index->free_cnt > 0
+          ? index->free_ofs[--index->free_cnt]
+          : inode_length (dir->inode));
 }
 
 /* Searches DIR for a file with the given NAME
@@ -124,10 +373,27 @@ dir_lookup (const struct dir *dir, const char *name,
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  /* Concurrent lookups can share an index that is already built.
+     Building one changes the inode, so that needs the lock for
+     writing. */
+  inode_dir_lock_shared (dir->inode);
+  if (inode_get_dir_index (dir->inode) != NULL)
+    {
+      if (lookup (dir, name, &e, NULL))
+        *inode = inode_open (e.inode_sector);
+      else
+        *inode = NULL;
+      inode_dir_unlock_shared (dir->inode);
+      return *inode != NULL;
+    }
+  inode_dir_unlock_shared (dir->inode);
+
+  inode_dir_lock (dir->inode);
   if (lookup (dir, name, &e, NULL))
     *inode = inode_open (e.inode_sector);
   else
     *inode = NULL;
+  inode_dir_unlock (dir->inode);
 
   return *inode != NULL;
 }
@@ -152,21 +418,16 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
-  /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
+  inode_dir_lock (dir->inode);
+
+  /* Check that DIR still exists and that NAME is not in use. */
+  if (inode_is_removed (dir->inode) || lookup (dir, name, NULL, NULL))
     goto done;
 
   /* Set OFS to offset of free slot.
      If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
+     current end-of-file. */
+  ofs = find_free (dir);
 
   /* Write slot. */
   e.in_use = true;
@@ -174,13 +435,79 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   e.inode_sector = inode_sector;
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
+  /* Keep the index up to date. */
+  if (inode_get_dir_index (dir->inode) != NULL
+      && (!success
+          || !index_add_name (inode_get_dir_index (dir->inode), name,
+                              inode_sector, ofs)))
+    drop_index (dir);
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
+
  done:
+  inode_dir_unlock (dir->inode);
   return success;
 }
 
+/* Reads the directory in INODE a sector's worth of entries at a
+   time and returns true if none is in use, for is_empty() when
+   the directory has no index. */
+static bool
+scan_empty (struct inode *inode) 
+{
+  struct dir_entry buf[SCAN_CNT];
+  off_t ofs = 0;
+  size_t cnt, i;
+
+  do
+    {
+      cnt = read_entries (inode, buf, ofs);
+      for (i = 0; i < cnt; i++, ofs += sizeof *buf)
+        if (buf[i].in_use)
+          return false;
+    }
+  while (cnt == SCAN_CNT);
+  return true;
+}
+
+/* Returns true if the directory in INODE has no entries in use.
+   Must be called with INODE's directory lock held. */
+static bool
+is_empty (struct inode *inode) 
+{
+  struct dir dir;
+  struct dir_index *index;
+
+  dir.inode = inode;
+  dir.pos = 0;
+  index = get_index (&dir);
+  if (index == NULL)
+    return scan_empty (inode);
+  return hash_size (&index->names) == 0;
+}
+
+/* Removes NAME, whose entry at byte offset OFS has just been
+   freed, from DIR's index. */
+static void
+remove_from_index (const struct dir *dir, const char *name, off_t ofs) 
+{
+  struct dir_index *index = inode_get_dir_index (dir->inode);
+  struct dir_node key;
+  struct hash_elem *e;
+
+  if (index == NULL)
+    return;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_delete (&index->names, &key.elem);
+  if (e != NULL)
+    node_free (e, NULL);
+  if (!index_add_free (index, ofs))
+    drop_index (dir);
+}
+
 /* Removes any entry for NAME in DIR.
    Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   which occurs only if there is no file with the given NAME or
+   it is a directory that is not empty. */
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
@@ -192,25 +519,45 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  inode_dir_lock (dir->inode);
+
   /* Find directory entry. */
   if (!lookup (dir, name, &e, &ofs))
     goto done;
 
-  /* Open inode. */
+  /* Open inode.  A directory may only be removed while empty, and
+     its lock keeps entries from being added until it is marked
+     removed. */
   inode = inode_open (e.inode_sector);
   if (inode == NULL)
     goto done;
+  if (inode_is_dir (inode)) 
+    {
+      inode_dir_lock (inode);
+      if (!is_empty (inode))
+        goto done;
+    }
 
   /* Erase directory entry. */
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
-    goto done;
+    {
+      drop_index (dir);
+      goto done;
+    }
+  remove_from_index (dir, name, ofs);
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
 
   /* Remove inode. */
+  if (inode_is_dir (inode))
+    dcache_forget_dir (e.inode_sector);
   inode_remove (inode);
   success = true;
 
  done:
+  if (inode != NULL && inode_is_dir (inode))
+    inode_dir_unlock (inode);
+  inode_dir_unlock (dir->inode);
   inode_close (inode);
   return success;
 }
@@ -220,6 +567,45 @@ dir_remove (struct dir *dir, const char *name)
    contains no more entries. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
+{
+  return dir_readdir_inode (dir, name, NULL);
+}
+
+/* Like dir_readdir(), but if INODE is nonnull also opens the
+   entry's inode into *INODE, or sets it to a null pointer if that
+   fails.  The inode is opened under the directory lock, so the
+   entry cannot be removed and its sector reused in between.  The
+   caller must close *INODE. */
+bool
+dir_readdir_inode (struct dir *dir, char name[NAME_MAX + 1],
+                   struct inode **inode)
+{
+  struct dir_entry e;
+  bool found = false;
+
+  inode_dir_lock (dir->inode);
+  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+    {
+      dir->pos += sizeof e;
+      if (e.in_use)
+        {
+          strlcpy (name, e.name, NAME_MAX + 1);
+          if (inode != NULL)
+            *inode = inode_open (e.inode_sector);
+          found = true;
+          break;
+        } 
+    }
+  inode_dir_unlock (dir->inode);
+  return found;
+}
+
+/* Like dir_readdir(), but also stores the sector of the entry's
+   inode into *SECTOR, without opening it, for a file system
+   check. */
+bool
+dir_readdir_sector (struct dir *dir, char name[NAME_MAX + 1],
+                    block_sector_t *sector)
 {
   struct dir_entry e;
 
@@ -229,6 +615,7 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
       if (e.in_use)
         {
           strlcpy (name, e.name, NAME_MAX + 1);
+          *sector = e.inode_sector;
           return true;
         } 
     }
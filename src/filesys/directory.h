@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include "devices/block.h"
+#include "filesys/off_t.h"
 
 /* Maximum length of a file name component.
    This is the traditional UNIX maximum length.
@@ -12,9 +13,11 @@
 #define NAME_MAX 14
 
 struct inode;
+struct dir_index;
 
 /* Opening and closing directories. */
-bool dir_create (block_sector_t sector, size_t entry_cnt);
+bool dir_create (block_sector_t sector, size_t entry_cnt,
+                 block_sector_t parent);
 struct dir *dir_open (struct inode *);
 struct dir *dir_open_root (void);
 struct dir *dir_reopen (struct dir *);
@@ -26,5 +29,14 @@ bool dir_lookup (const struct dir *, const char *name, struct inode **);
 bool dir_add (struct dir *, const char *name, block_sector_t);
 bool dir_remove (struct dir *, const char *name);
 bool dir_readdir (struct dir *, char name[NAME_MAX + 1]);
+bool dir_readdir_inode (struct dir *, char name[NAME_MAX + 1],
+                        struct inode **);
+bool dir_readdir_sector (struct dir *, char name[NAME_MAX + 1],
+                         block_sector_t *);
+void dir_seek (struct dir *, off_t);
+off_t dir_tell (const struct dir *);
+
+/* Cached directory indexes. */
+void dir_index_destroy (struct dir_index *);
 
 #endif /* filesys/directory.h */
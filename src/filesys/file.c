@@ -1,23 +1,40 @@
 #include "filesys/file.h"
 #include <debug.h>
 #include "filesys/inode.h"
-#include "threads/malloc.h"
+#include "filesys/pipe.h"
+#include "lib/user/syscall.h"
+#include "threads/slab.h"
 
-/* An open file. */
+/* An open file, or one end of a pipe.  A pipe end has no inode
+   and no position: reads and writes go to PIPE, and the other
+   functions treat it as an empty file that cannot be changed. */
 struct file 
   {
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    struct read_ahead ra;       /* Read-ahead state of this reader. */
+    struct pipe *pipe;          /* Pipe, if this is a pipe end. */
+    bool pipe_writer;           /* Write end of PIPE? */
   };
 
+/* Cache of open files. */
+static struct kmem_cache file_cache;
+
+/* Initializes the open file cache. */
+void
+file_init (void) 
+{
+  kmem_cache_init (&file_cache, "file", sizeof (struct file), NULL);
+}
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
 struct file *
 file_open (struct inode *inode) 
 {
-  struct file *file = calloc (1, sizeof *file);
+  struct file *file = kmem_cache_zalloc (&file_cache);
   if (inode != NULL && file != NULL)
     {
       file->inode = inode;
@@ -28,16 +45,34 @@ file_open (struct inode *inode)
   else
     {
       inode_close (inode);
-      free (file);
+      kmem_cache_free (&file_cache, file);
       return NULL; 
     }
 }
 
-/* Opens and returns a new file for the same inode as FILE.
+/* Opens and returns the read end of PIPE, or its write end if
+   WRITER is true.  Returns a null pointer if memory is short. */
+struct file *
+file_open_pipe (struct pipe *pipe, bool writer) 
+{
+  struct file *file = kmem_cache_zalloc (&file_cache);
+  if (file != NULL)
+    {
+      file->pipe = pipe;
+      file->pipe_writer = writer;
+      pipe_open_end (pipe, writer);
+    }
+  return file;
+}
+
+/* Opens and returns a new file for the same inode as FILE, or
+   the same end of the same pipe.
    Returns a null pointer if unsuccessful. */
 struct file *
 file_reopen (struct file *file) 
 {
+  if (file->pipe != NULL)
+    return file_open_pipe (file->pipe, file->pipe_writer);
   return file_open (inode_reopen (file->inode));
 }
 
@@ -47,19 +82,40 @@ file_close (struct file *file)
 {
   if (file != NULL)
     {
-      file_allow_write (file);
-      inode_close (file->inode);
-      free (file); 
+      if (file->pipe != NULL)
+        pipe_close_end (file->pipe, file->pipe_writer);
+      else
+        {
+          file_allow_write (file);
+          inode_close (file->inode);
+        }
+      kmem_cache_free (&file_cache, file); 
     }
 }
 
-/* Returns the inode encapsulated by FILE. */
+/* Returns the inode encapsulated by FILE, or a null pointer if
+   FILE is a pipe end. */
 struct inode *
 file_get_inode (struct file *file) 
 {
   return file->inode;
 }
 
+/* Returns the pipe that FILE is an end of, or a null pointer if
+   FILE is not a pipe end. */
+struct pipe *
+file_get_pipe (struct file *file) 
+{
+  return file->pipe;
+}
+
+/* Returns true if FILE is open on a directory. */
+bool
+file_is_dir (struct file *file) 
+{
+  return file->inode != NULL && inode_is_dir (file->inode);
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
    starting at the file's current position.
    Returns the number of bytes actually read,
@@ -68,7 +124,12 @@ file_get_inode (struct file *file)
 off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
-  off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  off_t bytes_read;
+
+  if (file->pipe != NULL)
+    return file->pipe_writer ? 0 : pipe_read (file->pipe, buffer, size);
+  bytes_read = inode_read_ahead_at (file->inode, buffer, size, file->pos,
+                                    &file->ra);
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -81,7 +142,10 @@ file_read (struct file *file, void *buffer, off_t size)
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) 
 {
-  return inode_read_at (file->inode, buffer, size, file_ofs);
+  if (file->pipe != NULL)
+    return 0;
+  return inode_read_ahead_at (file->inode, buffer, size, file_ofs,
+                              &file->ra);
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
@@ -94,7 +158,11 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
 off_t
 file_write (struct file *file, const void *buffer, off_t size) 
 {
-  off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
+  off_t bytes_written;
+
+  if (file->pipe != NULL)
+    return file->pipe_writer ? pipe_write (file->pipe, buffer, size) : 0;
+  bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
   file->pos += bytes_written;
   return bytes_written;
 }
@@ -110,6 +178,8 @@ off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
                off_t file_ofs) 
 {
+  if (file->pipe != NULL)
+    return 0;
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
@@ -119,7 +189,7 @@ void
 file_deny_write (struct file *file) 
 {
   ASSERT (file != NULL);
-  if (!file->deny_write) 
+  if (!file->deny_write && file->pipe == NULL) 
     {
       file->deny_write = true;
       inode_deny_write (file->inode);
@@ -145,9 +215,48 @@ off_t
 file_length (struct file *file) 
 {
   ASSERT (file != NULL);
+  if (file->pipe != NULL)
+    return 0;
   return inode_length (file->inode);
 }
 
+/* Grows FILE to LENGTH bytes if it is shorter, allocating all of
+   the new sectors at once, as contiguously as possible, so that
+   later writes within LENGTH need not extend the file.  The new
+   bytes read as zeros.  The current position is unchanged.
+   Returns false if the disk is full, memory is short or writes to
+   FILE are denied. */
+bool
+file_allocate (struct file *file, off_t length) 
+{
+  ASSERT (file != NULL);
+  if (file->pipe != NULL)
+    return false;
+  return inode_allocate (file->inode, length, true);
+}
+
+/* Sets the length of FILE to LENGTH, dropping its data past LENGTH
+   or extending it with bytes that read as zeros.  The current
+   position is unchanged.  Returns false if memory is short or
+   writes to FILE are denied. */
+bool
+file_truncate (struct file *file, off_t length) 
+{
+  ASSERT (file != NULL);
+  if (file->pipe != NULL)
+    return false;
+  return inode_truncate (file->inode, length);
+}
+
+/* Writes FILE's data and metadata to disk. */
+void
+file_sync (struct file *file) 
+{
+  ASSERT (file != NULL);
+  if (file->pipe == NULL)
+    inode_sync (file->inode);
+}
+
 /* Sets the current position in FILE to NEW_POS bytes from the
    start of the file. */
 void
@@ -166,3 +275,16 @@ file_tell (struct file *file)
   ASSERT (file != NULL);
   return file->pos;
 }
+
+/* Returns the poll() events that FILE is ready for.  If ENTRY is
+   nonnull, it is added to the poll queue of a pipe end, so that
+   SEMA is raised whenever the pipe changes; a file is always
+   ready. */
+int
+file_poll (struct file *file, struct poll_entry *entry,
+           struct semaphore *sema) 
+{
+  if (file->pipe != NULL)
+    return pipe_poll (file->pipe, file->pipe_writer, entry, sema);
+  return POLLIN | POLLOUT;
+}
@@ -1,15 +1,24 @@
 #ifndef FILESYS_FILE_H
 #define FILESYS_FILE_H
 
+#include <stdbool.h>
 #include "filesys/off_t.h"
 
 struct inode;
+struct pipe;
+struct poll_entry;
+struct semaphore;
 
 /* Opening and closing files. */
+void file_init (void);
 struct file *file_open (struct inode *);
 struct file *file_reopen (struct file *);
 void file_close (struct file *);
 struct inode *file_get_inode (struct file *);
+struct file *file_open_pipe (struct pipe *, bool writer);
+struct pipe *file_get_pipe (struct file *);
+bool file_is_dir (struct file *);
+int file_poll (struct file *, struct poll_entry *, struct semaphore *);
 
 /* Reading and writing. */
 off_t file_read (struct file *, void *, off_t);
@@ -25,5 +34,8 @@ void file_allow_write (struct file *);
 void file_seek (struct file *, off_t);
 off_t file_tell (struct file *);
 off_t file_length (struct file *);
+bool file_allocate (struct file *, off_t length);
+bool file_truncate (struct file *, off_t length);
+void file_sync (struct file *);
 
 #endif /* filesys/file.h */
@@ -2,32 +2,58 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
+#include "filesys/defrag.h"
 #include "filesys/file.h"
+#include "filesys/fsck.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "filesys/directory.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tunable.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
-static void do_format (void);
+/* Largest logical block size that the block_size tunable may pick
+   for a newly formatted file system. */
+#define BLOCK_SIZE_MAX 4096
+
+static void do_format (size_t block_size);
 
 /* Initializes the file system module.
    If FORMAT is true, reformats the file system. */
 void
 filesys_init (bool format) 
 {
+  int block_size = tunable_int ("block_size", BLOCK_SECTOR_SIZE,
+                                BLOCK_SECTOR_SIZE, BLOCK_SIZE_MAX);
+
+  if (block_size % BLOCK_SECTOR_SIZE != 0
+      || (block_size & (block_size - 1)) != 0)
+    PANIC ("-o block_size=%d: must be a power of two from %d to %d",
+           block_size, BLOCK_SECTOR_SIZE, BLOCK_SIZE_MAX);
+
   fs_device = block_get_role (BLOCK_FILESYS);
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
+  journal_init (format);
   inode_init ();
+  dcache_init ();
+  file_init ();
   free_map_init ();
 
   if (format) 
-    do_format ();
+    do_format (block_size);
 
   free_map_open ();
+  fsck_init (inode_set_mounted (true));
+  defrag_init ();
 }
 
 /* Shuts down the file system module, writing any unwritten data
@@ -35,9 +61,200 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  defrag_done ();
+  inode_reclaim_wait ();
   free_map_close ();
+  inode_set_mounted (false);
+  journal_commit ();
+  cache_done ();
 }
 
+/* Extracts a file name part from *SRCP into PART, and updates
+   *SRCP so that the next call will return the next file name
+   part.  Returns 1 if successful, 0 at end of string, -1 for a
+   too-long file name part. */
+static int
+get_next_part (char part[NAME_MAX + 1], const char **srcp)
+{
+  const char *src = *srcp;
+  char *dst = part;
+
+  /* Skip leading slashes.  If it's all slashes, we're done. */
+  while (*src == '/')
+    src++;
+  if (*src == '\0')
+    return 0;
+
+  /* Copy up to NAME_MAX character from SRC to DST.  Add null
+     terminator. */
+  while (*src != '/' && *src != '\0') 
+    {
+      if (dst < part + NAME_MAX)
+        *dst++ = *src;
+      else
+        return -1;
+      src++; 
+    }
+  *dst = '\0';
+
+  /* Advance source pointer. */
+  *srcp = src;
+  return 1;
+}
+
+/* Returns a newly opened inode for the directory where the
+   resolution of PATH starts: the root directory if PATH is
+   absolute, otherwise the current process's working directory. */
+static struct inode *
+open_start (const char *path)
+{
+  struct thread *t = thread_current ()->leader;
+  struct inode *inode;
+
+  if (*path == '/')
+    return inode_open (ROOT_DIR_SECTOR);
+
+  lock_acquire (&t->proc_lock);
+  inode = (t->cwd != NULL
+           ? inode_reopen (dir_get_inode (t->cwd))
+           : inode_open (ROOT_DIR_SECTOR));
+  lock_release (&t->proc_lock);
+  return inode;
+}
+
+/* Returns a newly opened inode for the file named NAME in the
+   directory in DIR, or a null pointer if there is none.  Names
+   other than "." and ".." are looked up in the dentry cache
+   first, and the directory is read only if the cache misses. */
+static struct inode *
+lookup_in (struct inode *dir, const char *name) 
+{
+  struct inode *inode;
+  struct dir *d;
+  bool absent;
+  unsigned gen;
+
+  if (!strcmp (name, "."))
+    return inode_reopen (dir);
+  if (!strcmp (name, ".."))
+    return (inode_is_removed (dir)
+            ? NULL : inode_open (inode_get_parent (dir)));
+
+  inode = dcache_lookup (inode_get_inumber (dir), name, &absent);
+  if (inode != NULL || absent)
+    return inode;
+
+  gen = dcache_generation ();
+  d = dir_open (inode_reopen (dir));
+  if (d == NULL)
+    return NULL;
+  dir_lookup (d, name, &inode);
+  dir_close (d);
+  dcache_insert (gen, inode_get_inumber (dir), name, inode);
+  return inode;
+}
+
+/* Resolves all of PATH but its last component, which is stored
+   in NAME, or "." if PATH has none (e.g. "/").  Returns a newly
+   opened inode for the directory that PATH's last component is
+   in, or a null pointer if PATH is empty, a component is too
+   long, or a directory along the way does not exist. */
+static struct inode *
+resolve_parent (const char *path, char name[NAME_MAX + 1])
+{
+  struct inode *dir;
+  char next[NAME_MAX + 1];
+  int result;
+
+  if (*path == '\0')
+    return NULL;
+  dir = open_start (path);
+  strlcpy (name, ".", NAME_MAX + 1);
+  result = get_next_part (name, &path);
+  while (dir != NULL && result > 0
+         && (result = get_next_part (next, &path)) > 0)
+    {
+      struct inode *child = lookup_in (dir, name);
+
+      inode_close (dir);
+      dir = child;
+      if (dir != NULL && !inode_is_dir (dir))
+        {
+          inode_close (dir);
+          dir = NULL;
+        }
+      strlcpy (name, next, NAME_MAX + 1);
+    }
+  if (result < 0)
+    {
+      inode_close (dir);
+      dir = NULL;
+    }
+  return dir;
+}
+
+/* Returns a newly opened inode for the file named by PATH, or a
+   null pointer if there is none. */
+static struct inode *
+open_path (const char *path) 
+{
+  char name[NAME_MAX + 1];
+  struct inode *dir = resolve_parent (path, name);
+  struct inode *inode = NULL;
+
+  if (dir != NULL)
+    inode = lookup_in (dir, name);
+  inode_close (dir);
+  return inode;
+}
+
+/* Opens the directory that the last component of PATH is to be
+   added to or removed from, storing the component in NAME.
+   Returns a null pointer if there is no such directory or if
+   PATH ends in "." or "..". */
+static struct dir *
+open_parent (const char *path, char name[NAME_MAX + 1])
+{
+  struct inode *dir = resolve_parent (path, name);
+
+  if (dir != NULL && (!strcmp (name, ".") || !strcmp (name, "..")))
+    {
+      inode_close (dir);
+      return NULL;
+    }
+  return dir_open (dir);
+}
+
+/* Creates a file named by PATH with the given INITIAL_SIZE, a
+   directory if IS_DIR is true, or a clone of file SRC if SRC is
+   nonnull.  Returns true if successful, false otherwise. */
+static bool
+create (const char *path, off_t initial_size, bool is_dir,
+        struct inode *src) 
+{
+  char name[NAME_MAX + 1];
+  block_sector_t inode_sector = 0;
+  block_sector_t parent;
+  struct dir *dir;
+  bool success;
+
+  journal_begin ();
+  dir = open_parent (path, name);
+  parent = dir != NULL ? inode_get_inumber (dir_get_inode (dir)) : 0;
+  success = (dir != NULL
+              && free_map_allocate_inode (parent, is_dir, &inode_sector)
+              && (is_dir ? dir_create (inode_sector, 16, parent)
+                  : src != NULL ? inode_clone (src, inode_sector)
+                  : inode_create (inode_sector, initial_size))
+              && dir_add (dir, name, inode_sector));
+  if (!success && inode_sector != 0) 
+    free_map_release (inode_sector, 1);
+  dir_close (dir);
+  journal_end ();
+
+  return success;
+}
+
 /* Creates a file named NAME with the given INITIAL_SIZE.
    Returns true if successful, false otherwise.
    Fails if a file named NAME already exists,
@@ -45,16 +262,33 @@ filesys_done (void)
 bool
 filesys_create (const char *name, off_t initial_size) 
 {
-  block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
-  if (!success && inode_sector != 0) 
-    free_map_release (inode_sector, 1);
-  dir_close (dir);
+  return create (name, initial_size, false, NULL);
+}
+
+/* Creates an empty directory named NAME.
+   Returns true if successful, false otherwise.
+   Fails if a file named NAME already exists,
+   or if internal memory allocation fails. */
+bool
+filesys_mkdir (const char *name) 
+{
+  return create (name, 0, true, NULL);
+}
+
+/* Creates a file named TO with the contents of the file named
+   FROM, sharing FROM's data sectors until either file writes to
+   them, so that the copy takes no time or space to speak of.
+   Returns true if successful, false if FROM is not a file, TO
+   exists already, or memory or disk space is short. */
+bool
+filesys_clone (const char *from, const char *to) 
+{
+  struct inode *src = open_path (from);
+  bool success;
 
+  success = src != NULL && !inode_is_dir (src)
+            && create (to, 0, false, src);
+  inode_close (src);
   return success;
 }
 
@@ -66,37 +300,73 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
-  struct inode *inode = NULL;
-
-  if (dir != NULL)
-    dir_lookup (dir, name, &inode);
-  dir_close (dir);
-
-  return file_open (inode);
+  return file_open (open_path (name));
 }
 
 /* Deletes the file named NAME.
    Returns true if successful, false on failure.
-   Fails if no file named NAME exists,
-   or if an internal memory allocation fails. */
+   Fails if no file named NAME exists, if NAME is a directory
+   that is not empty, or if an internal memory allocation
+   fails. */
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  char last[NAME_MAX + 1];
+  struct dir *dir;
+  bool success;
+
+  journal_begin ();
+  dir = open_parent (name, last);
+  success = dir != NULL && dir_remove (dir, last);
   dir_close (dir); 
+  journal_end ();
 
   return success;
 }
-
+
+/* Makes the directory named NAME the current process's working
+   directory.  Returns true if successful, false if there is no
+   such directory or memory is short. */
+bool
+filesys_chdir (const char *name) 
+{
+  struct thread *t = thread_current ()->leader;
+  struct inode *inode = open_path (name);
+  struct dir *dir, *old;
+
+  if (inode != NULL && !inode_is_dir (inode))
+    {
+      inode_close (inode);
+      return false;
+    }
+  dir = dir_open (inode);
+  if (dir == NULL)
+    return false;
+
+  lock_acquire (&t->proc_lock);
+  old = t->cwd;
+  t->cwd = dir;
+  lock_release (&t->proc_lock);
+  dir_close (old);
+  return true;
+}
+
+/* Writes all file system data and metadata to disk. */
+void
+filesys_sync (void) 
+{
+  journal_commit ();
+  cache_flush ();
+}
+
 /* Formats the file system. */
 static void
-do_format (void)
+do_format (size_t block_size)
 {
   printf ("Formatting file system...");
+  inode_set_block_size (block_size);
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  if (!dir_create (ROOT_DIR_SECTOR, 16, ROOT_DIR_SECTOR))
     PANIC ("root directory creation failed");
   free_map_close ();
   printf ("done.\n");
@@ -1,52 +1,487 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
+#include <stdint.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* The disk is divided into allocation groups of GROUP_SECTORS
+   sectors each, the last one possibly shorter, in the manner of
+   the cylinder groups of the BSD fast file system.  A new inode
+   goes into the group of its parent directory and its data right
+   after it, so that a directory, its files and their data share a
+   neighborhood of the disk instead of each taking the first hole
+   from sector 0.  The free count of each group, kept in step with
+   the bitmap, picks a group without scanning it, and lets a
+   search for free sectors skip a full group at once instead of
+   testing each of its bits, which on a nearly full disk would be
+   most of the disk. */
+#define GROUP_SECTORS 512
+
+/* Free sectors that a directory's group must keep for a new
+   subdirectory to go there too, leaving room for the files it is
+   about to get.  Otherwise the subdirectory starts in the group
+   with the most free sectors, spreading a tree across the disk as
+   it fills up. */
+#define GROUP_DIR_RESERVE (GROUP_SECTORS / 8)
+
+/* Data sectors that file clones share (inode_clone()) have a
+   reference count, kept as the number of references beyond the
+   first in a byte per sector that follows the bitmap in the free
+   map file.  Releasing a shared sector only drops a reference; the
+   last release frees it.  Only the sectors of counts that changed
+   are written back, since most stay zero. */
+#define REFCOUNT_MAX UINT8_MAX
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static uint8_t *refcounts;           /* Extra references, per sector. */
+static struct bitmap *refcounts_dirty; /* Changed sectors of refcounts. */
+static size_t *group_free;           /* Free sectors in each group. */
+static size_t group_cnt;             /* Number of groups. */
+static size_t rotor;                 /* Where a search of the whole
+                                        disk starts: just past the
+                                        last run it found. */
+static bool free_map_dirty;          /* Changed since last written? */
+static struct lock free_map_lock;    /* Protects the above. */
+
+static void mark (block_sector_t, size_t cnt, bool used);
+static void count_groups (void);
+static bool write_refcounts (void);
+static void add_ref (block_sector_t, int delta);
 
 /* Initializes the free map. */
 void
 free_map_init (void) 
 {
-  free_map = bitmap_create (block_size (fs_device));
-  if (free_map == NULL)
+  size_t sector_cnt = block_size (fs_device);
+
+  lock_init_named (&free_map_lock, "free map");
+  free_map = bitmap_create (sector_cnt);
+  group_cnt = DIV_ROUND_UP (sector_cnt, GROUP_SECTORS);
+  group_free = malloc (group_cnt * sizeof *group_free);
+  refcounts = calloc (sector_cnt, sizeof *refcounts);
+  refcounts_dirty = bitmap_create (DIV_ROUND_UP (sector_cnt,
+                                                 BLOCK_SECTOR_SIZE));
+  if (free_map == NULL || group_free == NULL || refcounts == NULL
+      || refcounts_dirty == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
+  count_groups ();
+}
+
+/* Writes the sectors of reference counts that changed to the free
+   map file, after the bitmap.  Returns false on failure. */
+static bool
+write_refcounts (void) 
+{
+  size_t end = bitmap_size (free_map);
+  size_t i;
+
+  for (i = 0; i < bitmap_size (refcounts_dirty); i++)
+    if (bitmap_test (refcounts_dirty, i))
+      {
+        size_t ofs = i * BLOCK_SECTOR_SIZE;
+        off_t size = end - ofs < BLOCK_SECTOR_SIZE ? end - ofs
+                                                   : BLOCK_SECTOR_SIZE;
+
+        if (file_write_at (free_map_file, refcounts + ofs, size,
+                           bitmap_file_size (free_map) + ofs) != size)
+          return false;
+        bitmap_reset (refcounts_dirty, i);
+      }
+  return true;
+}
+
+/* Changes SECTOR's count of extra references by DELTA.
+   free_map_lock must be held. */
+static void
+add_ref (block_sector_t sector, int delta) 
+{
+  refcounts[sector] += delta;
+  bitmap_mark (refcounts_dirty, sector / BLOCK_SECTOR_SIZE);
+  free_map_dirty = true;
+}
+
+/* Recomputes the free count of every group from the bitmap. */
+static void
+count_groups (void) 
+{
+  size_t end = bitmap_size (free_map);
+  size_t g;
+
+  for (g = 0; g < group_cnt; g++)
+    {
+      size_t start = g * GROUP_SECTORS;
+      size_t cnt = end - start < GROUP_SECTORS ? end - start : GROUP_SECTORS;
+
+      group_free[g] = bitmap_count (free_map, start, cnt, false);
+    }
+}
+
+/* Marks the CNT sectors starting at SECTOR as USED or free, all of
+   which must be the other way now, and adjusts the group counts.
+   free_map_lock must be held. */
+static void
+mark (block_sector_t sector, size_t cnt, bool used) 
+{
+  ASSERT (!bitmap_contains (free_map, sector, cnt, used));
+  bitmap_set_multiple (free_map, sector, cnt, used);
+  while (cnt > 0)
+    {
+      size_t g = sector / GROUP_SECTORS;
+      size_t n = (g + 1) * GROUP_SECTORS - sector;
+
+      if (n > cnt)
+        n = cnt;
+      if (used)
+        group_free[g] -= n;
+      else
+        group_free[g] += n;
+      sector += n;
+      cnt -= n;
+    }
+  free_map_dirty = true;
+}
+
+/* Returns the number of free sectors in the run that starts at
+   SECTOR, counting no further than MAX sectors.  free_map_lock
+   must be held. */
+static size_t
+free_run_length (block_sector_t sector, size_t max)
+{
+  size_t end = bitmap_size (free_map);
+  size_t cnt = 0;
+
+  while (cnt < max && sector + cnt < end
+         && !bitmap_test (free_map, sector + cnt))
+    cnt++;
+  return cnt;
+}
+
+/* Returns the first sector at or after START, and a multiple of
+   ALIGN, that begins a run of CNT free sectors, or BITMAP_ERROR if
+   there is none.  Groups with no free sector are skipped whole.
+   free_map_lock must be held. */
+static size_t
+scan_free (size_t start, size_t cnt, size_t align)
+{
+  size_t end = bitmap_size (free_map);
+
+  start = ROUND_UP (start, align);
+  while (start + cnt <= end)
+    {
+      size_t g = start / GROUP_SECTORS;
+      size_t run;
+
+      if (group_free[g] == 0)
+        {
+          start = (g + 1) * GROUP_SECTORS;
+          continue;
+        }
+      run = free_run_length (start, cnt);
+      if (run == cnt)
+        return start;
+      start = ROUND_UP (start + run + 1, align);
+    }
+  return BITMAP_ERROR;
+}
+
+/* Returns the first run of CNT free sectors, starting at a multiple
+   of ALIGN, from the rotor on, wrapping around to the start of the
+   disk, or BITMAP_ERROR if there is none, and moves the rotor past
+   it.  free_map_lock must be held. */
+static size_t
+scan_from_rotor (size_t cnt, size_t align)
+{
+  size_t sector = scan_free (rotor, cnt, align);
+
+  if (sector == BITMAP_ERROR && rotor > 0)
+    sector = scan_free (0, cnt, align);
+  if (sector != BITMAP_ERROR)
+    rotor = sector + cnt < bitmap_size (free_map) ? sector + cnt : 0;
+  return sector;
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available.
+
+   The free map is only marked dirty; it reaches the free map
+   file, and through it the buffer cache, at the next
+   free_map_flush(). */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  block_sector_t sector;
+
+  lock_acquire (&free_map_lock);
+  sector = scan_from_rotor (cnt, 1);
+  if (sector != BITMAP_ERROR)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      mark (sector, cnt, true);
+      *sectorp = sector;
     }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
+  lock_release (&free_map_lock);
   return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Returns the group for a new inode whose parent directory's inode
+   is in sector PARENT, as described at the top of this file, or
+   group_cnt if the disk is full.  free_map_lock must be held. */
+static size_t
+choose_group (block_sector_t parent, bool is_dir) 
+{
+  size_t home = parent / GROUP_SECTORS;
+  size_t best, d;
+
+  if (home >= group_cnt)
+    home = 0;
+  if (group_free[home] > (is_dir ? GROUP_DIR_RESERVE : 0))
+    return home;
+
+  best = group_cnt;
+  if (is_dir)
+    {
+      size_t g;
+
+      for (g = 0; g < group_cnt; g++)
+        if (group_free[g] > 0
+            && (best == group_cnt || group_free[g] > group_free[best]))
+          best = g;
+    }
+  else
+    {
+      /* The nearest group with room, on either side. */
+      for (d = 1; d < group_cnt && best == group_cnt; d++)
+        if (home + d < group_cnt && group_free[home + d] > 0)
+          best = home + d;
+        else if (d <= home && group_free[home - d] > 0)
+          best = home - d;
+    }
+  return best;
+}
+
+/* Allocates a sector for a new inode, a directory's if IS_DIR is
+   true, whose parent directory's inode is in sector PARENT, and
+   stores it into *SECTORP.  The sector is the first free one in
+   the group that choose_group() picks.  Returns false if the disk
+   is full. */
+bool
+free_map_allocate_inode (block_sector_t parent, bool is_dir,
+                         block_sector_t *sectorp) 
+{
+  size_t g;
+  block_sector_t sector = BITMAP_ERROR;
+
+  lock_acquire (&free_map_lock);
+  g = choose_group (parent, is_dir);
+  if (g < group_cnt)
+    {
+      sector = bitmap_scan (free_map, g * GROUP_SECTORS, 1, false);
+      ASSERT (sector / GROUP_SECTORS == g);
+      mark (sector, 1, true);
+      *sectorp = sector;
+    }
+  lock_release (&free_map_lock);
+  return sector != BITMAP_ERROR;
+}
+
+/* Allocates an extent of between 1 and WANT consecutive sectors,
+   placed as close after sector HINT as possible, typically the
+   sector just past a file's last data sector.  Stores the first
+   sector into *SECTORP and the number allocated into *CNTP.
+
+   In order of preference, the extent is the run that starts
+   exactly at HINT, the first run of WANT free sectors after
+   HINT, the first such run from the rotor on, and finally
+   the largest free run on the disk if no run of WANT sectors is
+   left.  Returns false only if the disk is full.
+
+   The extent starts at a multiple of ALIGN and is a multiple of
+   ALIGN sectors long, which WANT must be too, so that a file
+   system formatted with a logical block of ALIGN sectors gets its
+   data in whole blocks. */
+bool
+free_map_allocate_extent (size_t want, block_sector_t hint, size_t align,
+                          block_sector_t *sectorp, size_t *cntp)
+{
+  size_t end = bitmap_size (free_map);
+  size_t start, cnt;
+
+  ASSERT (want > 0 && align > 0 && want % align == 0);
+
+  hint = ROUND_UP (hint, align);
+  if (hint >= end)
+    hint = 0;
+
+  lock_acquire (&free_map_lock);
+
+  cnt = ROUND_DOWN (free_run_length (hint, want), align);
+  if (cnt > 0)
+    start = hint;
+  else
+    {
+      start = scan_free (hint, want, align);
+      if (start == BITMAP_ERROR)
+        start = scan_from_rotor (want, align);
+      if (start != BITMAP_ERROR)
+        cnt = want;
+      else
+        {
+          /* Fragmented: settle for the largest run available. */
+          size_t i = 0;
+
+          while (i + align <= end)
+            {
+              size_t run;
+
+              if (group_free[i / GROUP_SECTORS] == 0)
+                {
+                  i = (i / GROUP_SECTORS + 1) * GROUP_SECTORS;
+                  continue;
+                }
+              run = free_run_length (i, want);
+              if (ROUND_DOWN (run, align) > cnt)
+                {
+                  start = i;
+                  cnt = ROUND_DOWN (run, align);
+                }
+              i = ROUND_UP (i + run + 1, align);
+            }
+          if (cnt == 0)
+            {
+              lock_release (&free_map_lock);
+              return false;
+            }
+        }
+    }
+
+  mark (start, cnt, true);
+  lock_release (&free_map_lock);
+  *sectorp = start;
+  *cntp = cnt;
+  return true;
+}
+
+/* Makes CNT sectors starting at SECTOR available for use, except
+   that a shared sector only loses a reference. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
-  ASSERT (bitmap_all (free_map, sector, cnt));
-  bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  block_sector_t end = sector + cnt;
+
+  lock_acquire (&free_map_lock);
+  while (sector < end)
+    {
+      block_sector_t run;
+
+      for (run = sector; run < end && refcounts[run] == 0; run++)
+        continue;
+      if (run > sector)
+        mark (sector, run - sector, false);
+      if (run < end)
+        add_ref (run++, -1);
+      sector = run;
+    }
+  lock_release (&free_map_lock);
+}
+
+/* Adds a reference to allocated SECTOR, for a file clone that is
+   to share it.  Returns false if it already has as many references
+   as can be counted. */
+bool
+free_map_share (block_sector_t sector) 
+{
+  bool success;
+
+  lock_acquire (&free_map_lock);
+  ASSERT (bitmap_test (free_map, sector));
+  success = refcounts[sector] < REFCOUNT_MAX;
+  if (success)
+    add_ref (sector, 1);
+  lock_release (&free_map_lock);
+  return success;
+}
+
+/* Returns true if SECTOR has more than one reference, so that it
+   must be copied before it is written.  Reads the count without
+   the lock: a clone made during a write may or may not see it. */
+bool
+free_map_is_shared (block_sector_t sector) 
+{
+  return refcounts[sector] > 0;
+}
+
+/* Replaces the free map with USED, as rebuilt by a file system
+   check, and sets the reference count of each sector from the
+   number of references to it in REFS.  Stores into *LEAKEDP the
+   number of sectors that were allocated but are no longer used,
+   and into *LOSTP the number that are used but were free, which
+   later allocations would have handed out a second time. */
+void
+free_map_rebuild (const struct bitmap *used, const uint8_t refs[],
+                  size_t *leakedp, size_t *lostp) 
+{
+  size_t end = bitmap_size (free_map);
+  size_t leaked = 0, lost = 0;
+  size_t i;
+
+  ASSERT (bitmap_size (used) == end);
+
+  lock_acquire (&free_map_lock);
+  for (i = 0; i < end; i++)
+    {
+      bool was_used = bitmap_test (free_map, i);
+      bool is_used = bitmap_test (used, i);
+      uint8_t extra = refs[i] > 1 ? refs[i] - 1 : 0;
+
+      if (was_used && !is_used)
+        leaked++;
+      else if (!was_used && is_used)
+        lost++;
+      if (was_used != is_used)
+        {
+          bitmap_set (free_map, i, is_used);
+          free_map_dirty = true;
+        }
+      if (refcounts[i] != extra)
+        {
+          refcounts[i] = extra;
+          bitmap_mark (refcounts_dirty, i / BLOCK_SECTOR_SIZE);
+          free_map_dirty = true;
+        }
+    }
+  count_groups ();
+  rotor = 0;
+  lock_release (&free_map_lock);
+
+  *leakedp = leaked;
+  *lostp = lost;
+}
+
+/* Writes the free map to the free map file if it has changed
+   since it was last written. */
+void
+free_map_flush (void) 
+{
+  lock_acquire (&free_map_lock);
+  if (free_map_dirty && free_map_file != NULL)
+    {
+      if (!bitmap_write (free_map, free_map_file)
+          || !write_refcounts ())
+        PANIC ("can't write free map");
+      free_map_dirty = false;
+    }
+  lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -56,15 +491,22 @@ free_map_open (void)
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_read (free_map, free_map_file))
+  if (!bitmap_read (free_map, free_map_file)
+      || (file_read_at (free_map_file, refcounts, bitmap_size (free_map),
+                        bitmap_file_size (free_map))
+          != (off_t) bitmap_size (free_map)))
     PANIC ("can't read free map");
+  count_groups ();
+  free_map_dirty = false;
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void) 
 {
+  free_map_flush ();
   file_close (free_map_file);
+  free_map_file = NULL;
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -72,14 +514,21 @@ free_map_close (void)
 void
 free_map_create (void) 
 {
+  off_t size = bitmap_file_size (free_map) + bitmap_size (free_map);
+
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create (FREE_MAP_SECTOR, size))
     PANIC ("free map creation failed");
 
-  /* Write bitmap to file. */
+  /* Write bitmap to file.  Its sectors are allocated first, so
+     that later writes never need to allocate from the free map
+     while holding free_map_lock. */
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_write (free_map, free_map_file))
+  if (!file_allocate (free_map_file, size))
+    PANIC ("free map allocation failed");
+  if (!bitmap_write (free_map, free_map_file) || !write_refcounts ())
     PANIC ("can't write free map");
+  free_map_dirty = false;
 }
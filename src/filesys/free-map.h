@@ -3,8 +3,11 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include "devices/block.h"
 
+struct bitmap;
+
 void free_map_init (void);
 void free_map_read (void);
 void free_map_create (void);
@@ -12,6 +15,15 @@ void free_map_open (void);
 void free_map_close (void);
 
 bool free_map_allocate (size_t, block_sector_t *);
+bool free_map_allocate_inode (block_sector_t parent, bool is_dir,
+                              block_sector_t *);
+bool free_map_allocate_extent (size_t want, block_sector_t hint,
+                               size_t align, block_sector_t *, size_t *cnt);
 void free_map_release (block_sector_t, size_t);
+bool free_map_share (block_sector_t);
+bool free_map_is_shared (block_sector_t);
+void free_map_flush (void);
+void free_map_rebuild (const struct bitmap *used, const uint8_t refs[],
+                       size_t *leaked, size_t *lost);
 
 #endif /* filesys/free-map.h */
@@ -0,0 +1,280 @@
+#include "filesys/fsck.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <list.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "filesys/directory.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tunable.h"
+
+/* Mount-time file system check.  Starting from the free map and
+   root directory inodes, it walks every inode reachable through
+   the directory tree, marking in a bitmap of its own each inode,
+   index block and data sector that one uses and counting the
+   references to each data sector, and then replaces the free map
+   and the clones' reference counts with what it found.  This
+   frees the sectors that a crash leaked, such as those of a
+   removed file that was still open or waiting to be reclaimed, and
+   takes back any that a crash left in use but marked free, which
+   would otherwise be allocated twice.
+
+   The walk is shared among fsck_threads kernel threads, which take
+   inodes from a common queue, so that one thread's reads of index
+   blocks and directories overlap with the others' work.  Index
+   blocks and directory data are read a run of consecutive sectors
+   at a time through the buffer cache.
+
+   A check runs after a shutdown that left the free map inode
+   marked mounted if the fsck tunable is 1, its default, on every
+   mount if it is 2, and never if it is 0. */
+
+/* Default number of threads that walk the tree. */
+#define FSCK_THREADS 4
+
+/* An inode waiting to be checked. */
+struct pending_inode
+  {
+    struct list_elem elem;
+    block_sector_t sector;      /* Its sector. */
+    block_sector_t dir;         /* Directory that names it, or 0. */
+  };
+
+/* Counts reported at the end of a check. */
+struct fsck_stats
+  {
+    size_t files;               /* Regular files checked. */
+    size_t dirs;                /* Directories checked. */
+    size_t bad_entries;         /* Entries naming no inode. */
+    size_t bad_pointers;        /* Pointers past the end of the disk. */
+    size_t cross_links;         /* Sectors claimed twice. */
+  };
+
+static struct lock fsck_lock;           /* Protects the members below. */
+static struct condition work_ready;     /* pending gained an inode, or
+                                           the walk is done. */
+static struct condition workers_done;   /* A worker exited. */
+static struct list pending;             /* Inodes waiting for a worker. */
+static int busy;                        /* Workers checking an inode. */
+static int exited;                      /* Workers that have exited. */
+static bool failed;                     /* Memory ran short. */
+static struct bitmap *used;             /* Sectors found in use. */
+static struct bitmap *inodes;           /* Sectors found to hold inodes. */
+static uint8_t *refs;                   /* References to data sectors. */
+static struct fsck_stats stats;
+
+static void push_inode (block_sector_t, block_sector_t dir);
+static thread_func fsck_worker;
+
+/* Checks the file system, which has just been mounted, if the fsck
+   tunable asks for it.  UNCLEAN is true if the file system was not
+   shut down cleanly. */
+void
+fsck_init (bool unclean)
+{
+  int mode = tunable_int ("fsck", 1, 0, 2);
+  int threads = tunable_int ("fsck_threads", FSCK_THREADS, 1, 16);
+  size_t sector_cnt = block_size (fs_device);
+  int i;
+
+  if (mode == 0 || (mode == 1 && !unclean))
+    return;
+
+  printf ("Checking file system...");
+  lock_init_named (&fsck_lock, "fsck");
+  cond_init (&work_ready);
+  cond_init (&workers_done);
+  list_init (&pending);
+  busy = exited = 0;
+  failed = false;
+  used = bitmap_create (sector_cnt);
+  inodes = bitmap_create (sector_cnt);
+  refs = calloc (sector_cnt, sizeof *refs);
+  if (used == NULL || inodes == NULL || refs == NULL)
+    PANIC ("fsck: out of memory");
+
+  bitmap_set_multiple (used, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
+
+  /* Seed the walk with the inodes that no directory names. */
+  lock_acquire (&fsck_lock);
+  push_inode (FREE_MAP_SECTOR, 0);
+  push_inode (ROOT_DIR_SECTOR, 0);
+  lock_release (&fsck_lock);
+  for (i = 0; i < threads; i++)
+    if (thread_create ("fsck", PRI_DEFAULT, fsck_worker, NULL) == TID_ERROR)
+      PANIC ("fsck: can't start thread");
+
+  lock_acquire (&fsck_lock);
+  while (exited < threads)
+    cond_wait (&workers_done, &fsck_lock);
+  lock_release (&fsck_lock);
+
+  if (failed)
+    printf ("out of memory, free map left as is.\n");
+  else
+    {
+      size_t leaked, lost;
+
+      free_map_rebuild (used, refs, &leaked, &lost);
+      free_map_flush ();
+      printf ("%zu files, %zu directories, "
+              "%zu leaked and %zu lost sectors recovered.\n",
+              stats.files, stats.dirs, leaked, lost);
+      if (stats.bad_entries + stats.bad_pointers + stats.cross_links > 0)
+        printf ("fsck: %zu bad entries, %zu bad pointers, "
+                "%zu cross-linked sectors left in place.\n",
+                stats.bad_entries, stats.bad_pointers, stats.cross_links);
+    }
+  bitmap_destroy (used);
+  bitmap_destroy (inodes);
+  free (refs);
+}
+
+/* Queues the inode in SECTOR, named by directory DIR (0 if none),
+   to be checked.  fsck_lock must be held. */
+static void
+push_inode (block_sector_t sector, block_sector_t dir)
+{
+  struct pending_inode *p = malloc (sizeof *p);
+  if (p == NULL)
+    {
+      failed = true;
+      return;
+    }
+  p->sector = sector;
+  p->dir = dir;
+  list_push_back (&pending, &p->elem);
+  cond_signal (&work_ready, &fsck_lock);
+}
+
+/* Marks SECTOR as used by an inode or index block, or as a data
+   sector if IS_DATA is true.  Returns false, and marks nothing, if
+   SECTOR is past the end of the disk or claimed twice in a way
+   that only data sectors shared by clones may be.  fsck_lock must
+   be held. */
+static bool
+claim (block_sector_t sector, bool is_data)
+{
+  if (sector >= bitmap_size (used))
+    {
+      stats.bad_pointers++;
+      return false;
+    }
+  if (bitmap_test (used, sector) && (!is_data || refs[sector] == 0))
+    {
+      stats.cross_links++;
+      return false;
+    }
+  bitmap_mark (used, sector);
+  if (is_data && refs[sector] < UINT8_MAX)
+    refs[sector]++;
+  return true;
+}
+
+/* inode_scan() callback that claims each sector of an inode. */
+static bool
+claim_sector (block_sector_t sector, bool is_data, void *aux UNUSED)
+{
+  bool ok;
+
+  lock_acquire (&fsck_lock);
+  ok = claim (sector, is_data);
+  lock_release (&fsck_lock);
+  return ok;
+}
+
+/* Checks the inode in P's sector and, if it is a directory, queues
+   the inodes that it names. */
+static void
+check_inode (struct pending_inode *p)
+{
+  bool is_dir, first;
+  struct dir *dir;
+  char name[NAME_MAX + 1];
+  block_sector_t sector;
+
+  lock_acquire (&fsck_lock);
+  first = !bitmap_test (inodes, p->sector) && claim (p->sector, false);
+  if (first)
+    bitmap_mark (inodes, p->sector);
+  lock_release (&fsck_lock);
+  if (!first)
+    return;
+
+  if (!inode_scan (p->sector, claim_sector, NULL, &is_dir))
+    {
+      printf ("fsck: directory %u names sector %u, which holds no inode\n",
+              p->dir, p->sector);
+      lock_acquire (&fsck_lock);
+      stats.bad_entries++;
+      bitmap_reset (used, p->sector);
+      bitmap_reset (inodes, p->sector);
+      lock_release (&fsck_lock);
+      return;
+    }
+
+  if (!is_dir)
+    {
+      lock_acquire (&fsck_lock);
+      stats.files++;
+      lock_release (&fsck_lock);
+      return;
+    }
+
+  dir = dir_open (inode_open (p->sector));
+  lock_acquire (&fsck_lock);
+  stats.dirs++;
+  if (dir == NULL)
+    failed = true;
+  lock_release (&fsck_lock);
+  if (dir == NULL)
+    return;
+  while (dir_readdir_sector (dir, name, &sector))
+    {
+      lock_acquire (&fsck_lock);
+      if (sector < bitmap_size (used))
+        push_inode (sector, p->sector);
+      else
+        {
+          printf ("fsck: entry \"%s\" in directory %u names sector %u, "
+                  "past the end of the disk\n", name, p->sector, sector);
+          stats.bad_entries++;
+        }
+      lock_release (&fsck_lock);
+    }
+  dir_close (dir);
+}
+
+/* Body of a thread that checks inodes from the queue until it is
+   empty and no other worker may add to it. */
+static void
+fsck_worker (void *aux UNUSED)
+{
+  lock_acquire (&fsck_lock);
+  for (;;)
+    {
+      struct pending_inode *p;
+
+      while (list_empty (&pending) && busy > 0)
+        cond_wait (&work_ready, &fsck_lock);
+      if (list_empty (&pending))
+        break;
+      p = list_entry (list_pop_front (&pending), struct pending_inode, elem);
+      busy++;
+      lock_release (&fsck_lock);
+      check_inode (p);
+      free (p);
+      lock_acquire (&fsck_lock);
+      if (--busy == 0 && list_empty (&pending))
+        cond_broadcast (&work_ready, &fsck_lock);
+    }
+  exited++;
+  cond_signal (&workers_done, &fsck_lock);
+  lock_release (&fsck_lock);
+}
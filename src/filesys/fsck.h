@@ -0,0 +1,8 @@
+#ifndef FILESYS_FSCK_H
+#define FILESYS_FSCK_H
+
+#include <stdbool.h>
+
+void fsck_init (bool unclean);
+
+#endif /* filesys/fsck.h */
@@ -1,16 +1,24 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ustar.h>
+#include "filesys/defrag.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
 
+/* Number of sectors that fsutil_extract() reads from the scratch
+   device at a time. */
+#define EXTRACT_RUN 64
+
 /* List files in the root directory. */
 void
 fsutil_ls (char **argv UNUSED) 
@@ -79,7 +87,7 @@ fsutil_extract (char **argv UNUSED)
 
   /* Allocate buffers. */
   header = malloc (BLOCK_SECTOR_SIZE);
-  data = malloc (BLOCK_SECTOR_SIZE);
+  data = malloc (EXTRACT_RUN * BLOCK_SECTOR_SIZE);
   if (header == NULL || data == NULL)
     PANIC ("couldn't allocate buffers");
 
@@ -117,20 +125,30 @@ fsutil_extract (char **argv UNUSED)
 
           printf ("Putting '%s' into the file system...\n", file_name);
 
-          /* Create destination file. */
-          if (!filesys_create (file_name, size))
+          /* Create destination file and allocate all of its
+             sectors at once.  They need not be zeroed, since the
+             copy overwrites every byte. */
+          if (!filesys_create (file_name, 0))
             PANIC ("%s: create failed", file_name);
           dst = filesys_open (file_name);
           if (dst == NULL)
             PANIC ("%s: open failed", file_name);
+          if (!inode_allocate (file_get_inode (dst), size, false))
+            PANIC ("%s: allocation failed", file_name);
 
-          /* Do copy. */
+          /* Do copy, EXTRACT_RUN sectors at a time. */
           while (size > 0)
             {
-              int chunk_size = (size > BLOCK_SECTOR_SIZE
-                                ? BLOCK_SECTOR_SIZE
-                                : size);
-              block_read (src, sector++, data);
+              size_t cnt = DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
+              int chunk_size;
+
+              if (cnt > EXTRACT_RUN)
+                cnt = EXTRACT_RUN;
+              chunk_size = (size > (int) (cnt * BLOCK_SECTOR_SIZE)
+                            ? (int) (cnt * BLOCK_SECTOR_SIZE)
+                            : size);
+              block_read_multi (src, sector, cnt, data);
+              sector += cnt;
               if (file_write (dst, data, chunk_size) != chunk_size)
                 PANIC ("%s: write failed with %d bytes unwritten",
                        file_name, size);
@@ -142,6 +160,9 @@ fsutil_extract (char **argv UNUSED)
         }
     }
 
+  /* Write the free map once for the whole archive. */
+  free_map_flush ();
+
   /* Erase the ustar header from the start of the block device,
      so that the extraction operation is idempotent.  We erase
      two blocks because two blocks of zeros are the ustar
@@ -221,3 +242,16 @@ fsutil_append (char **argv)
   file_close (src);
   free (buffer);
 }
+
+/* Moves the data of every file in the file system so that each
+   file's sectors are contiguous. */
+void
+fsutil_defrag (char **argv UNUSED) 
+{
+  struct defrag_stats stats;
+
+  printf ("Defragmenting the file system...\n");
+  defrag_all (&stats);
+  printf ("Moved %zu sectors of %zu of %zu files.\n",
+          stats.moved_sectors, stats.moved_files, stats.files);
+}
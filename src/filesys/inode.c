@@ -1,23 +1,81 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <atomic.h>
 #include <debug.h>
+#include <hash.h>
 #include <round.h>
+#include <stddef.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/directory.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tunable.h"
+#include "threads/vaddr.h"
+#include "threads/workqueue.h"
+#ifdef VM
+#include "vm/frame.h"
+#endif
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Sectors per logical block, chosen when the file system is
+   formatted and kept in the free map inode.  Data sectors are
+   allocated in whole, aligned blocks where possible, and a block
+   whose sectors are consecutive on disk is read into the buffer
+   cache with one request, so that large files take fewer and
+   larger I/Os.  Inodes and index blocks stay one sector each. */
+static size_t block_sectors = 1;
+
+/* Maximum number of sectors to read ahead of a sequential
+   reader, by default and as set by the read_ahead_max tunable. */
+#define READ_AHEAD_MAX 8
+static int read_ahead_max;
+
+/* Block pointers in an inode.  The first INODE_DIRECT_CNT data
+   sectors are named directly by the inode, the next
+   INODE_PTRS_PER_SECTOR through a single indirect block, and the
+   rest through a doubly indirect block, for a maximum file size
+   of a little over 8 MB.  A pointer of 0 means "not allocated";
+   sector 0 always holds the free map inode, so it is never a
+   data or index sector. */
+#define INODE_DIRECT_CNT 120
+#define INODE_PTRS_PER_SECTOR (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+#define INODE_MAX_SECTORS (INODE_DIRECT_CNT + INODE_PTRS_PER_SECTOR \
+                           + INODE_PTRS_PER_SECTOR * INODE_PTRS_PER_SECTOR)
+
+/* A file of up to INODE_INLINE_MAX bytes keeps its contents in
+   the inode sector, in place of the direct pointers, so that it
+   takes no data sectors and is read with a single I/O.  It moves
+   to data sectors once it grows past that; it never moves
+   back. */
+#define INODE_INLINE_MAX (INODE_DIRECT_CNT * sizeof (block_sector_t))
+
 /* On-disk inode.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
+    union
+      {
+        block_sector_t direct[INODE_DIRECT_CNT]; /* Direct data sectors. */
+        uint8_t data[INODE_INLINE_MAX]; /* Contents, if is_inline. */
+      };
+    block_sector_t indirect;            /* Indirect block. */
+    block_sector_t doubly_indirect;     /* Doubly indirect block. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint32_t is_dir;                    /* Nonzero for a directory. */
+    block_sector_t parent;              /* Directory: its parent. */
+    uint32_t is_inline;                 /* Nonzero if contents in data. */
+    uint16_t block_sectors;             /* Free map: sectors per logical
+                                           block, or 0 for 1. */
+    uint16_t mounted;                   /* Free map: nonzero while the
+                                           file system is mounted. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -31,14 +89,374 @@ bytes_to_sectors (off_t size)
 /* In-memory inode. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
-    struct inode_disk data;             /* Inode content. */
+    struct lock lock;                   /* Protects growth, deny_write_cnt. */
+    struct rwlock dir_lock;             /* Serializes directory changes. */
+    unsigned version;                   /* Bumped by every write. */
+    int cached_pages;                   /* Pages in the VM page cache. */
+    struct dir_index *dir_index;        /* Cached index, if a directory. */
+    struct rwlock data_lock;            /* Held for reading to use a data
+                                           sector, for writing to move
+                                           one. */
+
+    /* Copied from the inode_disk, whose block pointers are read
+       through the buffer cache as needed. */
+    off_t length;                       /* File size in bytes. */
+    bool is_dir;                        /* True for a directory. */
+    block_sector_t parent;              /* Directory: its parent. */
+    bool is_inline;                     /* Contents in the inode?  Only
+                                           changes, to false, under
+                                           lock. */
+  };
+
+/* Returns the class of INODE's data sectors.  The contents of the
+   free map and of directories are metadata, which is journaled. */
+static enum block_io_class
+data_class (const struct inode *inode) 
+{
+  if (inode->sector == FREE_MAP_SECTOR)
+    return BLOCK_IO_FREE_MAP;
+  return inode->is_dir ? BLOCK_IO_INODE_META : BLOCK_IO_INODE_DATA;
+}
+
+/* Returns entry IDX of index block SECTOR. */
+static block_sector_t
+index_get (block_sector_t sector, size_t idx) 
+{
+  block_sector_t entry;
+
+  cache_read_at (sector, &entry, idx * sizeof entry, sizeof entry,
+                 BLOCK_IO_INODE_META);
+  return entry;
+}
+
+/* Sets entry IDX of index block SECTOR to ENTRY. */
+static void
+index_set (block_sector_t sector, size_t idx, block_sector_t entry) 
+{
+  cache_write_at (sector, &entry, idx * sizeof entry, sizeof entry,
+                  BLOCK_IO_INODE_META);
+}
+
+/* Returns the sector that holds data sector IDX of DISK_INODE,
+   or 0 if that sector has not been allocated, which makes it a
+   hole that reads as zeros. */
+static block_sector_t
+lookup_sector (const struct inode_disk *disk_inode, size_t idx) 
+{
+  block_sector_t l1;
+
+  if (idx < INODE_DIRECT_CNT)
+    return disk_inode->direct[idx];
+  idx -= INODE_DIRECT_CNT;
+
+  if (idx < INODE_PTRS_PER_SECTOR)
+    return (disk_inode->indirect != 0
+            ? index_get (disk_inode->indirect, idx) : 0);
+  idx -= INODE_PTRS_PER_SECTOR;
+
+  if (idx < INODE_PTRS_PER_SECTOR * INODE_PTRS_PER_SECTOR
+      && disk_inode->doubly_indirect != 0)
+    {
+      l1 = index_get (disk_inode->doubly_indirect,
+                      idx / INODE_PTRS_PER_SECTOR);
+      if (l1 != 0)
+        return index_get (l1, idx % INODE_PTRS_PER_SECTOR);
+    }
+  return 0;
+}
+
+/* Sector full of zeros, for initializing new sectors. */
+static char zeros[BLOCK_SECTOR_SIZE];
+
+/* Allocates an index block near HINT, zeroes it, and stores it
+   into *SECTORP.  Returns true if successful, false if the disk
+   is full. */
+static bool
+allocate_index (block_sector_t hint, block_sector_t *sectorp) 
+{
+  size_t cnt;
+
+  if (!free_map_allocate_extent (1, hint, 1, sectorp, &cnt))
+    return false;
+  cache_write (*sectorp, zeros, BLOCK_IO_INODE_META);
+  return true;
+}
+
+/* Makes data sector IDX of DISK_INODE be SECTOR, allocating
+   index blocks along the way as needed.  Returns true if
+   successful, false if the disk is full or IDX is beyond the
+   largest possible file. */
+static bool
+install_sector (struct inode_disk *disk_inode, size_t idx,
+                block_sector_t sector) 
+{
+  block_sector_t l1;
+
+  if (idx < INODE_DIRECT_CNT)
+    {
+      disk_inode->direct[idx] = sector;
+      return true;
+    }
+  idx -= INODE_DIRECT_CNT;
+
+  if (idx < INODE_PTRS_PER_SECTOR)
+    {
+      if (disk_inode->indirect == 0
+          && !allocate_index (sector, &disk_inode->indirect))
+        return false;
+      index_set (disk_inode->indirect, idx, sector);
+      return true;
+    }
+  idx -= INODE_PTRS_PER_SECTOR;
+
+  if (idx < INODE_PTRS_PER_SECTOR * INODE_PTRS_PER_SECTOR)
+    {
+      if (disk_inode->doubly_indirect == 0
+          && !allocate_index (sector, &disk_inode->doubly_indirect))
+        return false;
+      l1 = index_get (disk_inode->doubly_indirect,
+                      idx / INODE_PTRS_PER_SECTOR);
+      if (l1 == 0)
+        {
+          if (!allocate_index (sector, &l1))
+            return false;
+          index_set (disk_inode->doubly_indirect,
+                     idx / INODE_PTRS_PER_SECTOR, l1);
+        }
+      index_set (l1, idx % INODE_PTRS_PER_SECTOR, sector);
+      return true;
+    }
+  return false;
+}
+
+/* Allocates the data sectors of DISK_INODE, which is stored in
+   sector SECTOR, from FIRST up to but not including LAST that are
+   still holes.  Each run of holes is allocated in extents placed
+   right after the sector before it when possible, or after the
+   inode itself if there is none, so the file tends to stay
+   contiguous and near its inode without needing to be.  The range
+   is widened to whole logical blocks.  New sectors are zeroed,
+   except that if ZERO is false only those outside FIRST up to
+   LAST - 1 are, for callers that are about to overwrite the rest.
+   Does not change the inode's length.
+   Returns true if successful, false if the disk is full or LAST
+   is beyond the largest possible file; sectors allocated before
+   a failure stay installed. */
+static bool
+inode_extend (struct inode_disk *disk_inode, block_sector_t sector,
+              size_t first, size_t last, bool zero) 
+{
+  size_t i = ROUND_DOWN (first, block_sectors);
+  size_t end = ROUND_UP (last, block_sectors);
+
+  if (last > INODE_MAX_SECTORS)
+    return false;
+  if (end > INODE_MAX_SECTORS)
+    end = INODE_MAX_SECTORS;
+
+  while (i < end)
+    {
+      block_sector_t hint, start;
+      size_t want, align, cnt, j;
+
+      if (lookup_sector (disk_inode, i) != 0)
+        {
+          i++;
+          continue;
+        }
+      for (want = 1; i + want < end; want++)
+        if (lookup_sector (disk_inode, i + want) != 0)
+          break;
+
+      /* Holes left by a truncation may be parts of blocks. */
+      align = (i % block_sectors == 0 && want % block_sectors == 0
+               ? block_sectors : 1);
+      hint = i > 0 ? lookup_sector (disk_inode, i - 1) : 0;
+      hint = (hint != 0 ? hint : sector) + 1;
+      if (!free_map_allocate_extent (want, hint, align, &start, &cnt)
+          && (align == 1
+              || !free_map_allocate_extent (want, hint, 1, &start, &cnt)))
+        return false;
+      for (j = 0; j < cnt; j++, i++)
+        {
+          if (zero || i < first || i >= last - 1)
+            cache_write (start + j, zeros, BLOCK_IO_INODE_DATA);
+          if (!install_sector (disk_inode, i, start + j))
+            {
+              free_map_release (start + j, cnt - j);
+              return false;
+            }
+        }
+    }
+  return true;
+}
+
+/* Releases index block SECTOR and everything that it points to.
+   LEVEL is 1 for an indirect block whose entries are data
+   sectors, 2 for a doubly indirect block. */
+static void
+release_index (block_sector_t sector, int level) 
+{
+  block_sector_t *entries = malloc (BLOCK_SECTOR_SIZE);
+  size_t i;
+
+  if (entries != NULL)
+    {
+      cache_read (sector, entries, BLOCK_IO_INODE_META);
+      for (i = 0; i < INODE_PTRS_PER_SECTOR; i++)
+        if (entries[i] != 0)
+          {
+            if (level > 1)
+              release_index (entries[i], level - 1);
+            else
+              free_map_release (entries[i], 1);
+          }
+      free (entries);
+    }
+  free_map_release (sector, 1);
+}
+
+/* Releases all the data and index sectors of DISK_INODE. */
+static void
+inode_deallocate (struct inode_disk *disk_inode) 
+{
+  size_t i;
+
+  if (disk_inode->is_inline)
+    return;
+  for (i = 0; i < INODE_DIRECT_CNT; i++)
+    if (disk_inode->direct[i] != 0)
+      free_map_release (disk_inode->direct[i], 1);
+  if (disk_inode->indirect != 0)
+    release_index (disk_inode->indirect, 1);
+  if (disk_inode->doubly_indirect != 0)
+    release_index (disk_inode->doubly_indirect, 2);
+}
+
+/* Sectors that a removed inode or a truncation gave up, waiting for
+   reclaim_work to release them, so that the last close of a removed
+   file and a truncation return without walking its index blocks.
+   Each tree is a data sector (level 0) or an index block and
+   everything under it (level 1 or 2), as for release_index().  A
+   crash before the work runs leaks the sectors, just as it would
+   for a file still open when the system went down, until fsck
+   next rebuilds the free map. */
+struct reclaim
+  {
+    struct list_elem elem;              /* Element in reclaim_list. */
+    block_sector_t inode_sector;        /* Removed inode, or 0. */
+    size_t tree_cnt;                    /* Number of trees. */
+    struct
+      {
+        block_sector_t sector;
+        int level;
+      }
+    trees[];
   };
 
+/* Most trees that a truncation can detach: direct sectors, the
+   entries of a partly kept index block, and the entries of the
+   doubly indirect block. */
+#define RECLAIM_MAX (INODE_DIRECT_CNT + 2 * INODE_PTRS_PER_SECTOR)
+
+static struct list reclaim_list;        /* Waiting reclaims. */
+static struct lock reclaim_lock;        /* Protects reclaim_list. */
+static struct lock reclaim_run_lock;    /* Held while releasing. */
+static struct work reclaim_work;
+static work_func reclaim_drain;
+
+/* Hands R to reclaim_work. */
+static void
+queue_reclaim (struct reclaim *r) 
+{
+  lock_acquire (&reclaim_lock);
+  list_push_back (&reclaim_list, &r->elem);
+  lock_release (&reclaim_lock);
+  work_queue (&reclaim_work);
+}
+
+/* Releases the sectors of R and frees R. */
+static void
+reclaim (struct reclaim *r) 
+{
+  size_t i;
+
+  if (r->inode_sector != 0)
+    {
+      struct inode_disk *disk_inode = malloc (sizeof *disk_inode);
+      if (disk_inode != NULL)
+        {
+          cache_read (r->inode_sector, disk_inode, BLOCK_IO_INODE_META);
+          inode_deallocate (disk_inode);
+          free (disk_inode);
+        }
+      free_map_release (r->inode_sector, 1);
+    }
+  for (i = 0; i < r->tree_cnt; i++)
+    if (r->trees[i].level > 0)
+      release_index (r->trees[i].sector, r->trees[i].level);
+    else
+      free_map_release (r->trees[i].sector, 1);
+  free (r);
+}
+
+/* Releases the sectors of every waiting reclaim. */
+static void
+reclaim_drain (void *aux UNUSED) 
+{
+  lock_acquire (&reclaim_run_lock);
+  for (;;)
+    {
+      struct reclaim *r = NULL;
+
+      lock_acquire (&reclaim_lock);
+      if (!list_empty (&reclaim_list))
+        r = list_entry (list_pop_front (&reclaim_list),
+                        struct reclaim, elem);
+      lock_release (&reclaim_lock);
+      if (r == NULL)
+        break;
+      reclaim (r);
+    }
+  lock_release (&reclaim_run_lock);
+}
+
+/* Releases the sectors of every removed inode and truncation
+   still waiting, before the free map is written for the last
+   time. */
+void
+inode_reclaim_wait (void) 
+{
+  reclaim_drain (NULL);
+}
+
+/* Reads the on-disk inode of INODE through the buffer cache into
+   a newly allocated buffer, which the caller must free.  Returns a
+   null pointer if memory is short. */
+static struct inode_disk *
+read_disk_inode (const struct inode *inode) 
+{
+  struct inode_disk *disk_inode = malloc (sizeof *disk_inode);
+  if (disk_inode != NULL)
+    cache_read (inode->sector, disk_inode, BLOCK_IO_INODE_META);
+  return disk_inode;
+}
+
+/* Returns the block pointer at byte offset OFS within the on-disk
+   inode in SECTOR, read through the buffer cache. */
+static block_sector_t
+disk_pointer (block_sector_t sector, size_t ofs) 
+{
+  block_sector_t pointer;
+  cache_read_at (sector, &pointer, ofs, sizeof pointer, BLOCK_IO_INODE_META);
+  return pointer;
+}
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
@@ -46,31 +464,117 @@ struct inode
 static block_sector_t
 byte_to_sector (const struct inode *inode, off_t pos) 
 {
+  size_t idx;
+  block_sector_t l1;
+
   ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
-  else
+  ASSERT (!inode->is_inline);
+  if (pos >= inode->length)
     return -1;
+
+  idx = pos / BLOCK_SECTOR_SIZE;
+  if (idx < INODE_DIRECT_CNT)
+    return disk_pointer (inode->sector,
+                         offsetof (struct inode_disk, direct)
+                         + idx * sizeof (block_sector_t));
+  idx -= INODE_DIRECT_CNT;
+
+  if (idx < INODE_PTRS_PER_SECTOR)
+    {
+      l1 = disk_pointer (inode->sector,
+                         offsetof (struct inode_disk, indirect));
+      return l1 != 0 ? index_get (l1, idx) : 0;
+    }
+  idx -= INODE_PTRS_PER_SECTOR;
+
+  l1 = disk_pointer (inode->sector,
+                     offsetof (struct inode_disk, doubly_indirect));
+  if (l1 != 0)
+    l1 = index_get (l1, idx / INODE_PTRS_PER_SECTOR);
+  return l1 != 0 ? index_get (l1, idx % INODE_PTRS_PER_SECTOR) : 0;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Open inodes hashed by sector, so that opening a single inode
+   twice returns the same `struct inode', and the lock that
+   protects it and every inode's open_cnt.  Reopening an inode
+   that is already open only needs the lock for reading, since
+   open_cnt is then incremented atomically; inserting an inode or
+   dropping its last reference needs it for writing. */
+static struct hash open_inodes;
+static struct rwlock open_inodes_lock;
+
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct inode, elem)->sector
+          < hash_entry (b, struct inode, elem)->sector);
+}
+
+/* Cache of in-memory inodes. */
+static struct kmem_cache inode_cache;
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  read_ahead_max = tunable_int ("read_ahead_max", READ_AHEAD_MAX, 1, 64);
+  if (!hash_init (&open_inodes, inode_hash, inode_less, NULL))
+    PANIC ("open inode table creation failed");
+  rwlock_init (&open_inodes_lock);
+  kmem_cache_init (&inode_cache, "inode", sizeof (struct inode), NULL);
+  list_init (&reclaim_list);
+  lock_init_named (&reclaim_lock, "reclaim");
+  lock_init_named (&reclaim_run_lock, "reclaim run");
+  work_init (&reclaim_work, reclaim_drain, NULL);
 }
 
-/* Initializes an inode with LENGTH bytes of data and
-   writes the new inode to sector SECTOR on the file system
-   device.
+/* Sets the logical block size of a file system about to be
+   formatted to SIZE bytes, a power of two multiple of
+   BLOCK_SECTOR_SIZE.  Takes effect when the free map inode is
+   created; opening it later restores the size it was formatted
+   with. */
+void
+inode_set_block_size (size_t size) 
+{
+  ASSERT (size % BLOCK_SECTOR_SIZE == 0);
+  block_sectors = size / BLOCK_SECTOR_SIZE;
+}
+
+/* Records in the free map inode whether the file system is
+   mounted, and commits the change to the journal.  Returns whether
+   it was recorded as mounted before, which on mounting means that
+   the file system was not shut down cleanly. */
+bool
+inode_set_mounted (bool mounted) 
+{
+  size_t ofs = offsetof (struct inode_disk, mounted);
+  uint16_t old, new = mounted;
+
+  journal_begin ();
+  cache_read_at (FREE_MAP_SECTOR, &old, ofs, sizeof old, BLOCK_IO_INODE_META);
+  cache_write_at (FREE_MAP_SECTOR, &new, ofs, sizeof new, BLOCK_IO_INODE_META);
+  journal_end ();
+  journal_commit ();
+  return old != 0;
+}
+
+/* Initializes an inode with LENGTH bytes of data, of type
+   IS_DIR and with parent PARENT, and writes it to sector SECTOR
+   on the file system device.  The data starts out inline if it
+   fits, otherwise as one hole, which gets sectors only as it is
+   written.
    Returns true if successful.
    Returns false if memory or disk allocation fails. */
-bool
-inode_create (block_sector_t sector, off_t length)
+static bool
+create (block_sector_t sector, off_t length, bool is_dir,
+        block_sector_t parent)
 {
   struct inode_disk *disk_inode = NULL;
   bool success = false;
@@ -84,24 +588,97 @@ inode_create (block_sector_t sector, off_t length)
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
-      disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
+      disk_inode->is_dir = is_dir;
+      disk_inode->parent = parent;
+      disk_inode->length = length;
+      disk_inode->is_inline = (size_t) length <= INODE_INLINE_MAX;
+      if (sector == FREE_MAP_SECTOR)
+        disk_inode->block_sectors = block_sectors;
+      cache_write (sector, disk_inode, BLOCK_IO_INODE_META);
+      success = true; 
+      free (disk_inode);
+    }
+  return success;
+}
+
+/* Initializes a file inode with LENGTH bytes of data and
+   writes the new inode to sector SECTOR on the file system
+   device.
+   Returns true if successful.
+   Returns false if memory or disk allocation fails. */
+bool
+inode_create (block_sector_t sector, off_t length)
+{
+  return create (sector, length, false, 0);
+}
+
+/* Initializes a directory inode with LENGTH bytes of data, whose
+   parent directory is in sector PARENT, and writes it to sector
+   SECTOR on the file system device.
+   Returns true if successful.
+   Returns false if memory or disk allocation fails. */
+bool
+inode_create_dir (block_sector_t sector, off_t length, block_sector_t parent)
+{
+  return create (sector, length, true, parent);
+}
+
+/* Writes to sector SECTOR a new file inode with the length and
+   contents of file SRC, sharing its data sectors, each of which
+   gains a reference in the free map until one of the two inodes
+   writes to it and gets a copy of its own.  Index blocks are not
+   shared, so that either inode can replace a pointer without
+   touching the other.  Returns false if a sector has as many
+   references as the free map can count, or if memory or disk
+   space is short. */
+bool
+inode_clone (struct inode *src, block_sector_t sector)
+{
+  struct inode_disk *disk_inode;
+  struct inode_disk *clone = calloc (1, sizeof *clone);
+  bool success = false;
+
+  ASSERT (!src->is_dir);
+  if (clone == NULL)
+    return false;
+
+  /* Keep SRC's pointers from changing under us. */
+  lock_acquire (&src->lock);
+  disk_inode = read_disk_inode (src);
+  if (disk_inode != NULL)
+    {
+      size_t cnt = bytes_to_sectors (disk_inode->length);
+      size_t i;
+
+      memcpy (clone, disk_inode, sizeof *clone);
+      success = true;
+      if (!disk_inode->is_inline)
         {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
+          memset (clone->direct, 0, sizeof clone->direct);
+          clone->indirect = clone->doubly_indirect = 0;
+          for (i = 0; success && i < cnt; i++)
             {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
+              block_sector_t data = lookup_sector (disk_inode, i);
+
+              if (data == 0)
+                continue;
+              success = free_map_share (data);
+              if (success && !install_sector (clone, i, data))
+                {
+                  free_map_release (data, 1);
+                  success = false;
+                }
             }
-          success = true; 
-        } 
-      free (disk_inode);
+          if (!success)
+            inode_deallocate (clone);
+        }
+      if (success)
+        cache_write (sector, clone, BLOCK_IO_INODE_META);
     }
+  lock_release (&src->lock);
+  free (disk_inode);
+  free (clone);
   return success;
 }
 
@@ -111,33 +688,73 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  struct inode key;
+  struct hash_elem *e;
   struct inode *inode;
+  uint32_t is_dir, is_inline;
 
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  key.sector = sector;
+  rwlock_acquire_read (&open_inodes_lock);
+  e = hash_find (&open_inodes, &key.elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
+      inode = hash_entry (e, struct inode, elem);
+      atomic_inc (&inode->open_cnt);
+      rwlock_release_read (&open_inodes_lock);
+      return inode; 
+    }
+  rwlock_release_read (&open_inodes_lock);
+
+  /* Check again, since another thread may have opened it before
+     we got the lock for writing. */
+  rwlock_acquire_write (&open_inodes_lock);
+  e = hash_find (&open_inodes, &key.elem);
+  if (e != NULL)
+    {
+      inode = hash_entry (e, struct inode, elem);
+      inode->open_cnt++;
+      rwlock_release_write (&open_inodes_lock);
+      return inode; 
     }
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  inode = kmem_cache_alloc (&inode_cache);
   if (inode == NULL)
-    return NULL;
+    {
+      rwlock_release_write (&open_inodes_lock);
+      return NULL;
+    }
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
+  hash_insert (&open_inodes, &inode->elem);
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  lock_init_named (&inode->lock, "inode");
+  rwlock_init (&inode->dir_lock);
+  rwlock_init (&inode->data_lock);
+  inode->version = 0;
+  inode->cached_pages = 0;
+  inode->dir_index = NULL;
+  cache_read_at (sector, &inode->length, offsetof (struct inode_disk, length),
+                 sizeof inode->length, BLOCK_IO_INODE_META);
+  cache_read_at (sector, &is_dir, offsetof (struct inode_disk, is_dir),
+                 sizeof is_dir, BLOCK_IO_INODE_META);
+  inode->is_dir = is_dir != 0;
+  cache_read_at (sector, &is_inline, offsetof (struct inode_disk, is_inline),
+                 sizeof is_inline, BLOCK_IO_INODE_META);
+  inode->is_inline = is_inline != 0;
+  inode->parent = disk_pointer (sector, offsetof (struct inode_disk, parent));
+  if (sector == FREE_MAP_SECTOR)
+    {
+      uint16_t cnt;
+      cache_read_at (sector, &cnt, offsetof (struct inode_disk, block_sectors),
+                     sizeof cnt, BLOCK_IO_INODE_META);
+      block_sectors = cnt > 0 ? cnt : 1;
+    }
+  rwlock_release_write (&open_inodes_lock);
   return inode;
 }
 
@@ -146,7 +763,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      rwlock_acquire_read (&open_inodes_lock);
+      atomic_inc (&inode->open_cnt);
+      rwlock_release_read (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -157,6 +778,21 @@ inode_get_inumber (const struct inode *inode)
   return inode->sector;
 }
 
+/* Returns true if INODE is a directory. */
+bool
+inode_is_dir (const struct inode *inode) 
+{
+  return inode->is_dir;
+}
+
+/* Returns the sector of the parent of directory INODE. */
+block_sector_t
+inode_get_parent (const struct inode *inode) 
+{
+  ASSERT (inode_is_dir (inode));
+  return inode->parent;
+}
+
 /* Closes INODE and writes it to disk.
    If this was the last reference to INODE, frees its memory.
    If INODE was also a removed inode, frees its blocks. */
@@ -168,21 +804,41 @@ inode_close (struct inode *inode)
     return;
 
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  rwlock_acquire_write (&open_inodes_lock);
+  if (--inode->open_cnt > 0)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
-      /* Deallocate blocks if removed. */
-      if (inode->removed) 
+      rwlock_release_write (&open_inodes_lock);
+      return;
+    }
+
+  /* Remove from open inode table and release lock. */
+  hash_delete (&open_inodes, &inode->elem);
+  rwlock_release_write (&open_inodes_lock);
+  dir_index_destroy (inode->dir_index);
+
+  /* Deallocate blocks if removed, in the background unless
+     memory is short. */
+  if (inode->removed) 
+    {
+      struct reclaim *r = malloc (sizeof *r);
+
+      if (r != NULL)
+        {
+          r->inode_sector = inode->sector;
+          r->tree_cnt = 0;
+          queue_reclaim (r);
+        }
+      else
         {
+          struct inode_disk *disk_inode = read_disk_inode (inode);
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          if (disk_inode != NULL)
+            inode_deallocate (disk_inode);
+          free (disk_inode);
         }
-
-      free (inode); 
     }
+
+  kmem_cache_free (&inode_cache, inode); 
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -194,20 +850,236 @@ inode_remove (struct inode *inode)
   inode->removed = true;
 }
 
+/* Returns true if INODE has been removed. */
+bool
+inode_is_removed (const struct inode *inode) 
+{
+  return inode->removed;
+}
+
+/* Brings the runs of consecutive sectors among the first CNT
+   pointers in SECTOR, an inode or index block, into the buffer
+   cache with one request per run.  Pointers past the end of the
+   device are skipped. */
+static void
+prefetch_runs (block_sector_t sector, size_t cnt, enum block_io_class class) 
+{
+  block_sector_t end = block_size (fs_device);
+  size_t i = 0;
+
+  while (i < cnt)
+    {
+      block_sector_t start = index_get (sector, i);
+      size_t n = 1;
+
+      if (start == 0 || start >= end)
+        {
+          i++;
+          continue;
+        }
+      while (i + n < cnt && start + n < end
+             && index_get (sector, i + n) == start + n)
+        n++;
+      cache_read_run (start, n, class);
+      i += n;
+    }
+}
+
+/* Calls FUNC for each of the first CNT pointers in SECTOR, an
+   inode or index block, that is not 0, and descends into those for
+   which it returns true if LEVEL is 1 or 2, as for release_index().
+   Index blocks, and the data of a directory if IS_DIR is true, are
+   prefetched a run at a time. */
+static void
+scan_pointers (block_sector_t sector, size_t cnt, int level, bool is_dir,
+               inode_scan_func *func, void *aux) 
+{
+  size_t i;
+
+  if (level > 0 || is_dir)
+    prefetch_runs (sector, cnt, BLOCK_IO_INODE_META);
+  for (i = 0; i < cnt; i++)
+    {
+      block_sector_t entry = index_get (sector, i);
+
+      if (entry != 0 && func (entry, level == 0, aux) && level > 0)
+        scan_pointers (entry, INODE_PTRS_PER_SECTOR, level - 1, is_dir,
+                       func, aux);
+    }
+}
+
+/* Reads the inode in SECTOR straight from the buffer cache,
+   without opening it, for a file system check.  If SECTOR holds an
+   inode, calls FUNC with AUX for each index block and data sector
+   that it uses, with IS_DATA false for an index block, whose
+   entries are scanned only if FUNC returns true, stores whether it
+   is a directory into *IS_DIR, and returns true.  Otherwise
+   returns false. */
+bool
+inode_scan (block_sector_t sector, inode_scan_func *func, void *aux,
+            bool *is_dir) 
+{
+  unsigned magic;
+  uint32_t dir, is_inline;
+  block_sector_t indirect, doubly_indirect;
+
+  cache_read_at (sector, &magic, offsetof (struct inode_disk, magic),
+                 sizeof magic, BLOCK_IO_INODE_META);
+  if (magic != INODE_MAGIC)
+    return false;
+  cache_read_at (sector, &dir, offsetof (struct inode_disk, is_dir),
+                 sizeof dir, BLOCK_IO_INODE_META);
+  cache_read_at (sector, &is_inline, offsetof (struct inode_disk, is_inline),
+                 sizeof is_inline, BLOCK_IO_INODE_META);
+  *is_dir = dir != 0;
+  if (is_inline)
+    return true;
+
+  scan_pointers (sector, INODE_DIRECT_CNT, 0, *is_dir, func, aux);
+  indirect = disk_pointer (sector, offsetof (struct inode_disk, indirect));
+  if (indirect != 0 && func (indirect, false, aux))
+    scan_pointers (indirect, INODE_PTRS_PER_SECTOR, 0, *is_dir, func, aux);
+  doubly_indirect = disk_pointer (sector, offsetof (struct inode_disk,
+                                                    doubly_indirect));
+  if (doubly_indirect != 0 && func (doubly_indirect, false, aux))
+    scan_pointers (doubly_indirect, INODE_PTRS_PER_SECTOR, 1, *is_dir,
+                   func, aux);
+  return true;
+}
+
+/* Brings the logical block that holds data sector IDX of INODE
+   into the buffer cache with one request, as far as its sectors
+   are consecutive on disk, as they are unless a write to a clone,
+   a truncation or defragmentation moved one of them. */
+static void
+read_block (struct inode *inode, size_t idx) 
+{
+  size_t first = ROUND_DOWN (idx, block_sectors);
+  block_sector_t start = byte_to_sector (inode, first * BLOCK_SECTOR_SIZE);
+  size_t cnt;
+
+  if (start == 0 || start == (block_sector_t) -1)
+    return;
+  for (cnt = 1; cnt < block_sectors; cnt++)
+    if (byte_to_sector (inode, (first + cnt) * BLOCK_SECTOR_SIZE)
+        != start + cnt)
+      break;
+  if (idx < first + cnt)
+    cache_read_run (start, cnt, data_class (inode));
+}
+
+/* Updates the read-ahead state RA of a reader of INODE for a read
+   from START up to OFFSET and, if FROM_DISK is true, queues the
+   sectors that follow it for read-ahead.  A read that starts where
+   the previous one ended doubles the read-ahead window, up to
+   read_ahead_max sectors; any other read is taken as a sign of a
+   random reader and closes the window, so that it does not fill
+   the cache with sectors that nobody reads. */
+static void
+read_ahead (struct inode *inode, struct read_ahead *ra, off_t start,
+            off_t offset, bool from_disk) 
+{
+  off_t pos;
+  int i;
+
+  if (start == ra->pos)
+    {
+      ra->window = ra->window > 0 ? ra->window * 2 : 1;
+      if (ra->window > read_ahead_max)
+        ra->window = read_ahead_max;
+    }
+  else
+    ra->window = 0;
+  ra->pos = offset;
+  if (!from_disk)
+    return;
+
+  pos = ROUND_UP (offset, BLOCK_SECTOR_SIZE);
+  for (i = 0; i < ra->window; i++, pos += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector = byte_to_sector (inode, pos);
+      if (sector == (block_sector_t) -1)
+        break;
+      if (sector != 0)
+        cache_read_ahead (sector, data_class (inode));
+    }
+}
+
+/* If INODE's contents are inline, reads up to SIZE bytes of them
+   starting at OFFSET into BUFFER, stores the number of bytes read
+   in *BYTES_READ and returns true.  Otherwise returns false. */
+static bool
+read_inline (struct inode *inode, void *buffer, off_t size, off_t offset,
+             off_t *bytes_read) 
+{
+  bool is_inline;
+
+  lock_acquire (&inode->lock);
+  is_inline = inode->is_inline;
+  if (is_inline)
+    {
+      off_t left = inode->length - offset;
+      *bytes_read = size < left ? size : left;
+      if (*bytes_read > 0)
+        cache_read_at (inode->sector, buffer,
+                       offsetof (struct inode_disk, data) + offset,
+                       *bytes_read, BLOCK_IO_INODE_META);
+      else
+        *bytes_read = 0;
+    }
+  lock_release (&inode->lock);
+  return is_inline;
+}
+
+/* Copies SIZE bytes at OFFSET in INODE, all within one page, to
+   BUFFER, or from it if WRITE, if that page is resident in a frame
+   of the VM page cache, and returns true.  Otherwise returns false.
+   A page that a process maps is the current copy of its data, which
+   read() and write() must see and update; cached_pages saves the
+   lookup for the files no one maps. */
+static bool
+page_cache_copy (struct inode *inode UNUSED, off_t offset UNUSED,
+                 void *buffer UNUSED, int size UNUSED, bool write UNUSED) 
+{
+#ifdef VM
+  if (inode->cached_pages > 0)
+    return (write
+            ? frame_cache_write (inode, offset, buffer, size)
+            : frame_cache_read (inode, offset, buffer, size));
+#endif
+  return false;
+}
+
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
    than SIZE if an error occurs or end of file is reached. */
 off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) 
+{
+  return inode_read_ahead_at (inode, buffer, size, offset, NULL);
+}
+
+/* Like inode_read_at(), but also reads ahead of the read for a
+   reader whose read-ahead state is RA, unless RA is a null
+   pointer. */
+off_t
+inode_read_ahead_at (struct inode *inode, void *buffer_, off_t size,
+                     off_t offset, struct read_ahead *ra) 
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
+  off_t start = offset;
+  bool from_disk = false;
+
+  /* is_inline never becomes true again, so only a file that looks
+     inline needs the lock. */
+  if (inode->is_inline && read_inline (inode, buffer, size, offset,
+                                       &bytes_read))
+    return bytes_read;
 
   while (size > 0) 
     {
-      /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      /* Starting byte offset within sector. */
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -220,23 +1092,26 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      /* Copy the chunk out of the page cache, or else out of the
+         buffer cache.  A hole reads as zeros. */
+      if (!page_cache_copy (inode, offset, buffer + bytes_read,
+                            chunk_size, false))
         {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
+          block_sector_t sector_idx;
+
+          rwlock_acquire_read (&inode->data_lock);
+          sector_idx = byte_to_sector (inode, offset);
+          if (sector_idx != 0)
             {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
+              if (block_sectors > 1 && !cache_contains (sector_idx))
+                read_block (inode, offset / BLOCK_SECTOR_SIZE);
+              cache_read_at (sector_idx, buffer + bytes_read, sector_ofs,
+                             chunk_size, data_class (inode));
+              from_disk = true;
             }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+          else
+            memset (buffer + bytes_read, 0, chunk_size);
+          rwlock_release_read (&inode->data_lock);
         }
       
       /* Advance. */
@@ -244,27 +1119,446 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+
+  if (ra != NULL)
+    read_ahead (inode, ra, start, offset, from_disk);
 
   return bytes_read;
 }
 
+/* Moves the contents of inline DISK_INODE, which is stored in
+   sector SECTOR, to a data sector of class CLASS, leaving block pointers in their place.  Returns
+   false, with DISK_INODE unchanged, if the disk is full or memory
+   is short. */
+static bool
+move_out_inline (struct inode_disk *disk_inode, block_sector_t sector,
+                 enum block_io_class class) 
+{
+  uint8_t *data;
+
+  ASSERT (disk_inode->is_inline);
+
+  data = calloc (1, BLOCK_SECTOR_SIZE);
+  if (data == NULL)
+    return false;
+  memcpy (data, disk_inode->data, INODE_INLINE_MAX);
+  memset (disk_inode->data, 0, INODE_INLINE_MAX);
+  disk_inode->is_inline = false;
+
+  if (disk_inode->length > 0)
+    {
+      if (!inode_extend (disk_inode, sector, 0, 1, false))
+        {
+          memcpy (disk_inode->data, data, INODE_INLINE_MAX);
+          disk_inode->is_inline = true;
+          free (data);
+          return false;
+        }
+      cache_write (disk_inode->direct[0], data, class);
+    }
+  free (data);
+  return true;
+}
+
+/* Allocates the holes among the sectors of INODE that hold bytes
+   OFS up to END, growing INODE to END bytes if it is shorter.  See
+   inode_extend() for ZERO.  An inline INODE stays inline if END
+   fits, and otherwise moves to data sectors first.  Returns false
+   if the disk is full or memory is short.
+
+   The new length is published only after its sectors are
+   installed, so readers, which do not take the lock, never see
+   a sector pointer that is not yet valid. */
+static bool
+fill_holes (struct inode *inode, off_t ofs, off_t end, bool zero) 
+{
+  struct inode_disk *disk_inode;
+  bool success;
+#if THREAD_PAGES > 1
+  struct inode_disk disk_buf;
+#endif
+
+  journal_begin ();
+  lock_acquire (&inode->lock);
+#if THREAD_PAGES > 1
+  /* A large kernel stack has room for the inode, which spares
+     every extending write a trip to malloc(). */
+  disk_inode = &disk_buf;
+  cache_read (inode->sector, disk_inode, BLOCK_IO_INODE_META);
+#else
+  disk_inode = read_disk_inode (inode);
+#endif
+
+  /* Write the inode back even if allocation fails, since it may
+     have gained sectors and index blocks along the way. */
+  success = (disk_inode != NULL
+             && (!disk_inode->is_inline
+                 || (size_t) end <= INODE_INLINE_MAX
+                 || move_out_inline (disk_inode, inode->sector,
+                                     data_class (inode)))
+             && (disk_inode->is_inline
+                 || inode_extend (disk_inode, inode->sector,
+                                  ofs / BLOCK_SECTOR_SIZE,
+                                  bytes_to_sectors (end), zero)));
+  if (success && end > disk_inode->length)
+    disk_inode->length = end;
+  if (disk_inode != NULL)
+    {
+      cache_write (inode->sector, disk_inode, BLOCK_IO_INODE_META);
+      inode->is_inline = disk_inode->is_inline;
+    }
+  if (success && end > inode->length)
+    inode->length = end;
+#if THREAD_PAGES == 1
+  free (disk_inode);
+#endif
+  lock_release (&inode->lock);
+  journal_end ();
+  return success;
+}
+
+/* Grows INODE to LENGTH bytes if it is shorter, and allocates all
+   of its sectors up to LENGTH that are still holes, as
+   contiguously as the free map allows.  The new sectors read as
+   zeros if ZERO is true.  Otherwise they hold whatever they last
+   held, so ZERO may be false only if the caller overwrites all of
+   them before anyone else can read them.  Returns false if the
+   disk is full, memory is short or writes to INODE are denied. */
+bool
+inode_allocate (struct inode *inode, off_t length, bool zero) 
+{
+  if (inode->deny_write_cnt)
+    return false;
+  return fill_holes (inode, 0, length, zero);
+}
+
+/* Adds the tree of level LEVEL at SECTOR, if any, to R. */
+static void
+detach (struct reclaim *r, block_sector_t sector, int level) 
+{
+  if (sector != 0)
+    {
+      ASSERT (r->tree_cnt < RECLAIM_MAX);
+      r->trees[r->tree_cnt].sector = sector;
+      r->trees[r->tree_cnt].level = level;
+      r->tree_cnt++;
+    }
+}
+
+/* Moves entries FROM and up of index block SECTOR, which are trees
+   of level LEVEL, into R, using ENTRIES to hold the block. */
+static void
+cut_index (struct reclaim *r, block_sector_t sector, size_t from,
+           int level, block_sector_t *entries) 
+{
+  size_t i;
+
+  if (from >= INODE_PTRS_PER_SECTOR)
+    return;
+  cache_read (sector, entries, BLOCK_IO_INODE_META);
+  for (i = from; i < INODE_PTRS_PER_SECTOR; i++)
+    {
+      detach (r, entries[i], level);
+      entries[i] = 0;
+    }
+  cache_write (sector, entries, BLOCK_IO_INODE_META);
+}
+
+/* Moves the data sectors of DISK_INODE from KEEP on, and the index
+   blocks that only they use, into R.  ENTRIES is a sector-sized
+   buffer. */
+static void
+cut_sectors (struct inode_disk *disk_inode, size_t keep,
+             struct reclaim *r, block_sector_t *entries) 
+{
+  size_t i;
+
+  for (i = keep; i < INODE_DIRECT_CNT; i++)
+    {
+      detach (r, disk_inode->direct[i], 0);
+      disk_inode->direct[i] = 0;
+    }
+  keep = keep > INODE_DIRECT_CNT ? keep - INODE_DIRECT_CNT : 0;
+
+  if (disk_inode->indirect != 0)
+    {
+      if (keep == 0)
+        {
+          detach (r, disk_inode->indirect, 1);
+          disk_inode->indirect = 0;
+        }
+      else
+        cut_index (r, disk_inode->indirect, keep, 0, entries);
+    }
+  keep = keep > INODE_PTRS_PER_SECTOR ? keep - INODE_PTRS_PER_SECTOR : 0;
+
+  if (disk_inode->doubly_indirect != 0)
+    {
+      if (keep == 0)
+        {
+          detach (r, disk_inode->doubly_indirect, 2);
+          disk_inode->doubly_indirect = 0;
+        }
+      else
+        {
+          size_t l1 = keep / INODE_PTRS_PER_SECTOR;
+
+          if (keep % INODE_PTRS_PER_SECTOR != 0)
+            {
+              block_sector_t partial = index_get (disk_inode->doubly_indirect,
+                                                  l1++);
+              if (partial != 0)
+                cut_index (r, partial, keep % INODE_PTRS_PER_SECTOR, 0,
+                           entries);
+            }
+          cut_index (r, disk_inode->doubly_indirect, l1, 1, entries);
+        }
+    }
+}
+
+/* Zeros bytes OFS and up of data sector IDX of DISK_INODE, whose
+   data is of class CLASS, so that they read as zeros if the file
+   grows again.  A sector shared with a clone gets replaced by a
+   copy of its own, using BUF to hold it.  Returns false if the
+   disk is full. */
+static bool
+zero_tail (struct inode_disk *disk_inode, size_t idx, size_t ofs,
+           enum block_io_class class, uint8_t *buf) 
+{
+  block_sector_t sector = lookup_sector (disk_inode, idx);
+  block_sector_t copy;
+  size_t cnt;
+
+  if (sector == 0)
+    return true;
+  if (!free_map_is_shared (sector))
+    {
+      cache_write_at (sector, zeros, ofs, BLOCK_SECTOR_SIZE - ofs, class);
+      return true;
+    }
+  if (!free_map_allocate_extent (1, sector + 1, 1, &copy, &cnt))
+    return false;
+  cache_read (sector, buf, class);
+  memset (buf + ofs, 0, BLOCK_SECTOR_SIZE - ofs);
+  cache_write (copy, buf, class);
+
+  /* IDX's index blocks exist already, so this cannot fail. */
+  install_sector (disk_inode, idx, copy);
+  free_map_release (sector, 1);
+  return true;
+}
+
+/* Zeros bytes START up to END of INODE in the VM page cache, which
+   would otherwise keep what a truncation dropped. */
+static void
+zero_cached_pages (struct inode *inode, off_t start, off_t end) 
+{
+  while (inode->cached_pages > 0 && start < end)
+    {
+      off_t size = PGSIZE - start % PGSIZE;
+
+      if (size > end - start)
+        size = end - start;
+      if (size > BLOCK_SECTOR_SIZE)
+        size = BLOCK_SECTOR_SIZE;
+      page_cache_copy (inode, start, zeros, size, true);
+      start += size;
+    }
+}
+
+/* Sets the length of INODE to LENGTH.  Growing it adds a hole at
+   its end.  Shrinking it detaches the sectors past the new end for
+   reclaim_work to release, so that the work done here does not
+   grow with the size of the file.  Returns false if writes to
+   INODE are denied, if memory is short, or if the disk is too full
+   to give INODE its own copy of a last sector shared with a
+   clone. */
+bool
+inode_truncate (struct inode *inode, off_t length) 
+{
+  struct inode_disk *disk_inode;
+  struct reclaim *r = malloc (sizeof *r + RECLAIM_MAX * sizeof *r->trees);
+  uint8_t *buf = malloc (BLOCK_SECTOR_SIZE);
+  off_t old_length = 0;
+  bool success = false;
+
+  ASSERT (length >= 0);
+
+  if (inode->deny_write_cnt || r == NULL || buf == NULL)
+    {
+      free (r);
+      free (buf);
+      return false;
+    }
+  r->inode_sector = 0;
+  r->tree_cnt = 0;
+
+  journal_begin ();
+  rwlock_acquire_write (&inode->data_lock);
+  lock_acquire (&inode->lock);
+  disk_inode = read_disk_inode (inode);
+  if (disk_inode != NULL)
+    {
+      old_length = disk_inode->length;
+      if (disk_inode->is_inline)
+        {
+          if ((size_t) length > INODE_INLINE_MAX)
+            success = move_out_inline (disk_inode, inode->sector,
+                                       data_class (inode));
+          else
+            {
+              if (length < old_length)
+                memset (disk_inode->data + length, 0, old_length - length);
+              success = true;
+            }
+        }
+      else if (length < old_length)
+        {
+          size_t keep = bytes_to_sectors (length);
+
+          success = (length % BLOCK_SECTOR_SIZE == 0
+                     || zero_tail (disk_inode, keep - 1,
+                                   length % BLOCK_SECTOR_SIZE,
+                                   data_class (inode), buf));
+          if (success)
+            cut_sectors (disk_inode, keep, r, (block_sector_t *) buf);
+        }
+      else
+        success = true;
+
+      if (success)
+        {
+          disk_inode->length = length;
+          cache_write (inode->sector, disk_inode, BLOCK_IO_INODE_META);
+          inode->is_inline = disk_inode->is_inline;
+          inode->length = length;
+        }
+    }
+  lock_release (&inode->lock);
+  rwlock_release_write (&inode->data_lock);
+  journal_end ();
+  free (disk_inode);
+  free (buf);
+
+  if (r->tree_cnt > 0)
+    queue_reclaim (r);
+  else
+    free (r);
+  if (success && length < old_length)
+    zero_cached_pages (inode, length, old_length);
+  return success;
+}
+
+/* If INODE's contents are inline and bytes OFFSET up to
+   OFFSET + SIZE fit there, writes SIZE bytes from BUFFER to them,
+   growing INODE if necessary, and returns true.  Otherwise
+   returns false. */
+static bool
+write_inline (struct inode *inode, const void *buffer, off_t size,
+              off_t offset) 
+{
+  bool fits;
+
+  lock_acquire (&inode->lock);
+  fits = inode->is_inline && (size_t) (offset + size) <= INODE_INLINE_MAX;
+  if (fits)
+    {
+      cache_write_at (inode->sector, buffer,
+                      offsetof (struct inode_disk, data) + offset, size,
+                      BLOCK_IO_INODE_META);
+      if (offset + size > inode->length)
+        {
+          inode->length = offset + size;
+          cache_write_at (inode->sector, &inode->length,
+                          offsetof (struct inode_disk, length),
+                          sizeof inode->length, BLOCK_IO_INODE_META);
+        }
+    }
+  lock_release (&inode->lock);
+  return fits;
+}
+
+/* Moves data sector IDX of INODE, which holds SECTOR, to a newly
+   allocated sector as close after HINT as possible, and returns the
+   new sector, or 0 if the disk or memory is short.  This gives
+   INODE a copy of its own of a sector shared with a clone, or
+   moves a sector for inode_defrag().  The contents are copied only
+   if COPY is true; otherwise the caller is about to overwrite all
+   of them.  Another thread may have replaced SECTOR already, in
+   which case its replacement is returned.  Holding data_lock for
+   writing keeps readers and writers off SECTOR until it has been
+   replaced, so none touches it after it is freed. */
+static block_sector_t
+move_sector (struct inode *inode, size_t idx, block_sector_t sector,
+             block_sector_t hint, bool copy) 
+{
+  struct inode_disk *disk_inode;
+  uint8_t *data = copy ? malloc (BLOCK_SECTOR_SIZE) : NULL;
+  block_sector_t new = 0;
+  size_t cnt;
+
+  if (copy && data == NULL)
+    return 0;
+  journal_begin ();
+  rwlock_acquire_write (&inode->data_lock);
+  lock_acquire (&inode->lock);
+  disk_inode = read_disk_inode (inode);
+  if (disk_inode != NULL)
+    {
+      block_sector_t cur = lookup_sector (disk_inode, idx);
+
+      if (cur != sector)
+        new = cur;
+      else if (free_map_allocate_extent (1, hint, 1, &new, &cnt))
+        {
+          if (copy)
+            {
+              cache_read (sector, data, data_class (inode));
+              cache_write (new, data, data_class (inode));
+            }
+
+          /* IDX's index blocks exist already, so this cannot fail. */
+          install_sector (disk_inode, idx, new);
+          cache_write (inode->sector, disk_inode, BLOCK_IO_INODE_META);
+          free_map_release (sector, 1);
+        }
+    }
+  free (disk_inode);
+  lock_release (&inode->lock);
+  rwlock_release_write (&inode->data_lock);
+  journal_end ();
+  free (data);
+  return new;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if an error occurs.  A write past end of file
+   extends the inode; the gap, if any, reads back as zeros. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
 
   if (inode->deny_write_cnt)
     return 0;
 
+  /* A small file is written in place in its inode. */
+  if (size > 0 && inode->is_inline
+      && write_inline (inode, buffer, size, offset))
+    {
+      bytes_written = size;
+      size = 0;
+    }
+
+  /* Extend the file if the write goes past EOF.  Only the sectors
+     written get allocated; any gap is left as holes. */
+  if (size > 0 && offset + size > inode_length (inode)
+      && !fill_holes (inode, offset, offset + size, true))
+    return 0;
+
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
@@ -281,49 +1575,162 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      /* Give a hole its sectors, along with any others in the rest
+         of the write. */
+      if (sector_idx == 0)
         {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
+          if (!fill_holes (inode, offset, offset + size, true))
+            break;
+          sector_idx = byte_to_sector (inode, offset);
         }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
 
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
+      /* A sector shared with a clone is copied first. */
+      while (sector_idx != 0 && free_map_is_shared (sector_idx))
+        sector_idx = move_sector (inode, offset / BLOCK_SECTOR_SIZE,
+                                  sector_idx, sector_idx + 1,
+                                  chunk_size < BLOCK_SECTOR_SIZE);
+      if (sector_idx == 0)
+        break;
+
+      /* Copy the chunk into the buffer cache, which preserves
+         the rest of the sector, and into the page cache.  Start
+         over if inode_defrag() moved the sector meanwhile. */
+      rwlock_acquire_read (&inode->data_lock);
+      if (byte_to_sector (inode, offset) != sector_idx)
+        {
+          rwlock_release_read (&inode->data_lock);
+          continue;
         }
+      cache_write_at (sector_idx, buffer + bytes_written, sector_ofs,
+                      chunk_size, data_class (inode));
+      rwlock_release_read (&inode->data_lock);
+      page_cache_copy (inode, offset, (void *) (buffer + bytes_written),
+                       chunk_size, true);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
 
+  /* Bump the version only once the data is in place, so that
+     anything derived from the old contents looks stale. */
+  if (bytes_written > 0)
+    {
+      lock_acquire (&inode->lock);
+      inode->version++;
+      lock_release (&inode->lock);
+    }
   return bytes_written;
 }
 
+/* Moves the data sectors of INODE so that they follow one another
+   on disk in file order, starting as close after the inode as free
+   space allows, and returns the number of sectors moved.  Each is
+   copied through the buffer cache and switched over in a
+   transaction of its own, while INODE stays in use.  Does nothing
+   unless a free run can hold the whole file and the file is in
+   more than one piece, nor for an inline file or one that shares
+   sectors with a clone, which would lose the sharing. */
+size_t
+inode_defrag (struct inode *inode) 
+{
+  struct inode_disk *disk_inode;
+  size_t sector_cnt = bytes_to_sectors (inode_length (inode));
+  size_t used = 0, runs = 0, moved = 0, i;
+  block_sector_t prev = 0, start;
+  size_t cnt;
+
+  if (inode->is_inline || inode->sector == FREE_MAP_SECTOR)
+    return 0;
+  disk_inode = read_disk_inode (inode);
+  if (disk_inode == NULL)
+    return 0;
+  for (i = 0; i < sector_cnt; i++)
+    {
+      block_sector_t sector = lookup_sector (disk_inode, i);
+
+      if (sector == 0)
+        continue;
+      if (free_map_is_shared (sector))
+        {
+          free (disk_inode);
+          return 0;
+        }
+      if (used++ == 0 || sector != prev + 1)
+        runs++;
+      prev = sector;
+    }
+  free (disk_inode);
+  if (runs <= 1)
+    return 0;
+
+  /* Find a run for the whole file, then give it back so that each
+     move allocates its own sector from it.  That way a crash
+     partway leaves nothing allocated that the file does not use;
+     a sector taken meanwhile by another file only costs
+     contiguity. */
+  if (!free_map_allocate_extent (used, inode->sector + 1, 1, &start, &cnt))
+    return 0;
+  free_map_release (start, cnt);
+  if (cnt < used)
+    return 0;
+
+  for (i = used = 0; i < sector_cnt; i++)
+    {
+      block_sector_t sector = byte_to_sector (inode, i * BLOCK_SECTOR_SIZE);
+
+      if (sector == 0)
+        continue;
+      if (sector != start + used
+          && !free_map_is_shared (sector))
+        {
+          if (move_sector (inode, i, sector, start + used, true) == 0)
+            break;
+          moved++;
+        }
+      used++;
+    }
+  return moved;
+}
+
+/* Writes INODE's dirty data sectors back to disk, then commits
+   the journal, which makes its metadata durable too, along with
+   inline contents. */
+void
+inode_sync (struct inode *inode) 
+{
+  block_sector_t sectors[CACHE_SIZE];
+  off_t length = inode->is_inline ? 0 : inode_length (inode);
+  size_t cnt = 0;
+  off_t pos;
+
+  rwlock_acquire_read (&inode->data_lock);
+  for (pos = 0; pos < length; pos += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector = byte_to_sector (inode, pos);
+      if (sector != 0)
+        sectors[cnt++] = sector;
+      if (cnt == CACHE_SIZE)
+        {
+          cache_flush_sectors (sectors, cnt);
+          cnt = 0;
+        }
+    }
+  cache_flush_sectors (sectors, cnt);
+  rwlock_release_read (&inode->data_lock);
+  journal_commit ();
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
 inode_deny_write (struct inode *inode) 
 {
+  lock_acquire (&inode->lock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  lock_release (&inode->lock);
 }
 
 /* Re-enables writes to INODE.
@@ -332,14 +1739,82 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  lock_acquire (&inode->lock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  lock_release (&inode->lock);
+}
+
+/* Acquires INODE's directory lock for changing the directory
+   that INODE holds, excluding all other users of the lock. */
+void
+inode_dir_lock (struct inode *inode) 
+{
+  rwlock_acquire_write (&inode->dir_lock);
+}
+
+/* Releases INODE's directory lock, acquired by inode_dir_lock(). */
+void
+inode_dir_unlock (struct inode *inode) 
+{
+  rwlock_release_write (&inode->dir_lock);
+}
+
+/* Acquires INODE's directory lock for reading the directory that
+   INODE holds, which other readers may do at the same time. */
+void
+inode_dir_lock_shared (struct inode *inode) 
+{
+  rwlock_acquire_read (&inode->dir_lock);
+}
+
+/* Releases INODE's directory lock, acquired by
+   inode_dir_lock_shared(). */
+void
+inode_dir_unlock_shared (struct inode *inode) 
+{
+  rwlock_release_read (&inode->dir_lock);
+}
+
+/* Returns the directory index cached in INODE, or a null pointer
+   if there is none.  Must be called with INODE's directory lock
+   held, which keeps the index from changing if it is held only
+   for reading. */
+struct dir_index *
+inode_get_dir_index (struct inode *inode) 
+{
+  return inode->dir_index;
+}
+
+/* Caches INDEX in INODE, which frees it with dir_index_destroy()
+   when it is last closed.  Must be called with INODE's directory
+   lock held for writing. */
+void
+inode_set_dir_index (struct inode *inode, struct dir_index *index) 
+{
+  inode->dir_index = index;
+}
+
+/* Returns INODE's version, which changes whenever INODE is
+   written.  Only meaningful while INODE is held open. */
+unsigned
+inode_version (const struct inode *inode)
+{
+  return inode->version;
+}
+
+/* Adds DELTA to the count of INODE's pages in the VM page cache,
+   which the page cache keeps up to date. */
+void
+inode_add_cached_pages (struct inode *inode, int delta) 
+{
+  inode->cached_pages += delta;
 }
 
 /* Returns the length, in bytes, of INODE's data. */
 off_t
 inode_length (const struct inode *inode)
 {
-  return inode->data.length;
+  return inode->length;
 }
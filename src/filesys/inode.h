@@ -2,22 +2,58 @@
 #define FILESYS_INODE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "filesys/off_t.h"
 #include "devices/block.h"
 
 struct bitmap;
+struct dir_index;
+
+/* Read-ahead state of one reader of an inode, kept in its open
+   file, so that each reader's pattern is judged on its own. */
+struct read_ahead
+  {
+    off_t pos;                  /* Where a sequential read resumes. */
+    int window;                 /* Sectors to read ahead, 0 if none. */
+  };
+
+/* Called by inode_scan() for each sector that an inode uses. */
+typedef bool inode_scan_func (block_sector_t, bool is_data, void *aux);
 
 void inode_init (void);
+void inode_reclaim_wait (void);
+void inode_set_block_size (size_t);
+bool inode_set_mounted (bool);
+bool inode_scan (block_sector_t, inode_scan_func *, void *aux, bool *is_dir);
 bool inode_create (block_sector_t, off_t);
+bool inode_create_dir (block_sector_t, off_t, block_sector_t parent);
 struct inode *inode_open (block_sector_t);
+bool inode_clone (struct inode *, block_sector_t);
 struct inode *inode_reopen (struct inode *);
 block_sector_t inode_get_inumber (const struct inode *);
+bool inode_is_dir (const struct inode *);
+block_sector_t inode_get_parent (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
+bool inode_is_removed (const struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
+off_t inode_read_ahead_at (struct inode *, void *, off_t size, off_t offset,
+                           struct read_ahead *);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+bool inode_allocate (struct inode *, off_t length, bool zero);
+bool inode_truncate (struct inode *, off_t length);
+size_t inode_defrag (struct inode *);
+void inode_sync (struct inode *);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
+void inode_dir_lock (struct inode *);
+void inode_dir_unlock (struct inode *);
+void inode_dir_lock_shared (struct inode *);
+void inode_dir_unlock_shared (struct inode *);
+struct dir_index *inode_get_dir_index (struct inode *);
+void inode_set_dir_index (struct inode *, struct dir_index *);
+unsigned inode_version (const struct inode *);
 off_t inode_length (const struct inode *);
+void inode_add_cached_pages (struct inode *, int delta);
 
 #endif /* filesys/inode.h */
@@ -0,0 +1,233 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdint.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Identify a transaction's descriptor and commit record. */
+#define DESCRIPTOR_MAGIC 0x4a444553
+#define COMMIT_MAGIC 0x4a434d54
+
+/* First sector of a transaction in the journal: the home sectors
+   of the blocks that follow it.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct descriptor
+  {
+    uint32_t magic;                     /* DESCRIPTOR_MAGIC. */
+    uint32_t seq;                       /* Transaction number. */
+    uint32_t cnt;                       /* Number of blocks logged. */
+    block_sector_t sectors[JOURNAL_TXN_MAX]; /* Their home sectors. */
+    uint32_t unused[125 - JOURNAL_TXN_MAX]; /* Not used. */
+  };
+
+/* Sector that follows a transaction's last block.  Only a
+   transaction whose commit record matches its descriptor and
+   contents is replayed.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct commit_record
+  {
+    uint32_t magic;                     /* COMMIT_MAGIC. */
+    uint32_t seq;                       /* Transaction number. */
+    uint32_t cnt;                       /* Number of blocks logged. */
+    uint32_t checksum;                  /* Of descriptor and blocks. */
+    uint32_t unused[124];               /* Not used. */
+  };
+
+/* A transaction as written to the journal, its descriptor first,
+   and its commit record. */
+static uint8_t log_buffer[(JOURNAL_TXN_MAX + 1) * BLOCK_SECTOR_SIZE];
+static struct commit_record commit_record;
+
+/* Home sectors of the last transaction committed, which replay
+   would write again after a crash. */
+static block_sector_t logged[JOURNAL_TXN_MAX];
+static size_t logged_cnt;
+static uint32_t next_seq;
+
+/* Handles.  A commit waits until no thread holds a handle, and
+   handles are not given out while a commit is in progress, so
+   every commit holds whole operations. */
+static struct lock journal_lock;
+static struct condition handles_done;   /* handle_cnt dropped to 0. */
+static struct condition commit_done;    /* committing became false. */
+static int handle_cnt;
+static bool committing;
+
+static void replay (void);
+
+/* Initializes the journal.  Unless FORMAT is true, first replays
+   the last transaction committed before the system went down. */
+void
+journal_init (bool format)
+{
+  lock_init_named (&journal_lock, "journal");
+  cond_init (&handles_done);
+  cond_init (&commit_done);
+  handle_cnt = 0;
+  committing = false;
+  next_seq = 1;
+
+  if (!format)
+    replay ();
+  journal_invalidate ();
+}
+
+/* Starts a file system operation whose metadata changes must
+   reach the disk together.  Calls nest. */
+void
+journal_begin (void)
+{
+  struct thread *t = thread_current ();
+
+  if (t->journal_depth++ > 0)
+    return;
+  lock_acquire (&journal_lock);
+  while (committing)
+    cond_wait (&commit_done, &journal_lock);
+  handle_cnt++;
+  lock_release (&journal_lock);
+}
+
+/* Ends the operation started by the matching journal_begin().
+   Commits the running transaction if it is getting full. */
+void
+journal_end (void)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->journal_depth > 0);
+  if (--t->journal_depth > 0)
+    return;
+  lock_acquire (&journal_lock);
+  if (--handle_cnt == 0)
+    cond_broadcast (&handles_done, &journal_lock);
+  lock_release (&journal_lock);
+
+  if (cache_txn_size () >= JOURNAL_TXN_MAX / 2)
+    journal_commit ();
+}
+
+/* Waits for the operations in progress to end, then writes the
+   metadata sectors they changed to the journal as one
+   transaction. */
+void
+journal_commit (void)
+{
+  ASSERT (thread_current ()->journal_depth == 0);
+
+  lock_acquire (&journal_lock);
+  while (committing)
+    cond_wait (&commit_done, &journal_lock);
+  committing = true;
+  while (handle_cnt > 0)
+    cond_wait (&handles_done, &journal_lock);
+  lock_release (&journal_lock);
+
+  free_map_flush ();
+  cache_commit ();
+
+  lock_acquire (&journal_lock);
+  committing = false;
+  cond_broadcast (&commit_done, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Writes a transaction of CNT blocks to the journal, block I
+   being BLOCKS[I] bound for sector SECTORS[I], and commits it.
+   The previous transaction must already be checkpointed, since
+   it is overwritten.  Called by the buffer cache with its lock
+   held. */
+void
+journal_log (const block_sector_t sectors[], const void *const blocks[],
+             size_t cnt)
+{
+  struct descriptor *d = (struct descriptor *) log_buffer;
+  size_t i;
+
+  ASSERT (cnt > 0 && cnt <= JOURNAL_TXN_MAX);
+
+  memset (d, 0, sizeof *d);
+  d->magic = DESCRIPTOR_MAGIC;
+  d->seq = next_seq;
+  d->cnt = cnt;
+  for (i = 0; i < cnt; i++)
+    {
+      d->sectors[i] = sectors[i];
+      memcpy (log_buffer + (i + 1) * BLOCK_SECTOR_SIZE, blocks[i],
+              BLOCK_SECTOR_SIZE);
+    }
+  block_transfer (fs_device, JOURNAL_SECTOR, cnt + 1, log_buffer, true,
+                  BLOCK_IO_INODE_META);
+
+  /* The commit record goes out only once the rest is on disk. */
+  memset (&commit_record, 0, sizeof commit_record);
+  commit_record.magic = COMMIT_MAGIC;
+  commit_record.seq = next_seq;
+  commit_record.cnt = cnt;
+  commit_record.checksum = hash_bytes (log_buffer,
+                                       (cnt + 1) * BLOCK_SECTOR_SIZE);
+  block_transfer (fs_device, JOURNAL_SECTOR + cnt + 1, 1, &commit_record,
+                  true, BLOCK_IO_INODE_META);
+
+  memcpy (logged, sectors, cnt * sizeof *sectors);
+  logged_cnt = cnt;
+  next_seq++;
+}
+
+/* Returns true if replaying the journal would overwrite SECTOR.
+   Called by the buffer cache with its lock held. */
+bool
+journal_covers (block_sector_t sector)
+{
+  size_t i;
+
+  for (i = 0; i < logged_cnt; i++)
+    if (logged[i] == sector)
+      return true;
+  return false;
+}
+
+/* Empties the journal, so that nothing is replayed.  The last
+   transaction committed must already be checkpointed. */
+void
+journal_invalidate (void)
+{
+  memset (log_buffer, 0, BLOCK_SECTOR_SIZE);
+  block_transfer (fs_device, JOURNAL_SECTOR, 1, log_buffer, true,
+                  BLOCK_IO_INODE_META);
+  logged_cnt = 0;
+}
+
+/* Writes the blocks of the transaction in the journal to their
+   home sectors, if the transaction was committed completely. */
+static void
+replay (void)
+{
+  struct descriptor *d = (struct descriptor *) log_buffer;
+  size_t i;
+
+  block_transfer (fs_device, JOURNAL_SECTOR, 1, d, false,
+                  BLOCK_IO_INODE_META);
+  if (d->magic != DESCRIPTOR_MAGIC || d->cnt == 0 || d->cnt > JOURNAL_TXN_MAX)
+    return;
+  block_transfer (fs_device, JOURNAL_SECTOR + 1, d->cnt,
+                  log_buffer + BLOCK_SECTOR_SIZE, false, BLOCK_IO_INODE_META);
+  block_transfer (fs_device, JOURNAL_SECTOR + d->cnt + 1, 1, &commit_record,
+                  false, BLOCK_IO_INODE_META);
+  if (commit_record.magic != COMMIT_MAGIC
+      || commit_record.seq != d->seq || commit_record.cnt != d->cnt
+      || (commit_record.checksum
+          != hash_bytes (log_buffer, (d->cnt + 1) * BLOCK_SECTOR_SIZE)))
+    return;
+
+  for (i = 0; i < d->cnt; i++)
+    block_transfer (fs_device, d->sectors[i], 1,
+                    log_buffer + (i + 1) * BLOCK_SECTOR_SIZE, true,
+                    BLOCK_IO_INODE_META);
+  next_seq = d->seq + 1;
+}
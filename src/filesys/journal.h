@@ -0,0 +1,25 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/* The journal occupies JOURNAL_SECTORS sectors starting at
+   JOURNAL_SECTOR: a descriptor, up to JOURNAL_TXN_MAX logged
+   metadata sectors, and a commit record. */
+#define JOURNAL_SECTOR 2
+#define JOURNAL_TXN_MAX 32
+#define JOURNAL_SECTORS (JOURNAL_TXN_MAX + 2)
+
+void journal_init (bool format);
+void journal_begin (void);
+void journal_end (void);
+void journal_commit (void);
+
+/* Used by the buffer cache. */
+void journal_log (const block_sector_t[], const void *const[], size_t);
+bool journal_covers (block_sector_t);
+void journal_invalidate (void);
+
+#endif /* filesys/journal.h */
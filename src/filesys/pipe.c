@@ -0,0 +1,289 @@
+#include "filesys/pipe.h"
+#include <debug.h>
+#include <string.h>
+#include "lib/user/syscall.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* A pipe buffers the bytes written to it in a ring of up to
+   PIPE_BUFS kernel pages, each holding LEN bytes starting at OFS.
+   Writers append to the last page until it is full, then start
+   a new one; readers drain the first page and free it.
+
+   Whole pages can also change hands without being copied:
+   pipe_give_page() queues a page that a writer filled, and
+   pipe_take_page() hands a full page to a reader, so that a
+   page-sized, page-aligned transfer through the system call
+   layer's bounce page copies each byte only from and to user
+   memory. */
+#define PIPE_BUFS 8
+
+struct pipe_buf
+  {
+    uint8_t *page;              /* Kernel page. */
+    size_t ofs;                 /* Offset of first unread byte. */
+    size_t len;                 /* Number of unread bytes. */
+  };
+
+struct pipe
+  {
+    struct lock lock;           /* Protects all the members. */
+    struct condition readable;  /* Signaled when data arrives. */
+    struct condition writable;  /* Signaled when a buffer frees up. */
+    struct pipe_buf bufs[PIPE_BUFS]; /* Ring of buffered pages. */
+    size_t head;                /* Index of first buffer in use. */
+    size_t cnt;                 /* Number of buffers in use. */
+    int readers;                /* Open read ends. */
+    int writers;                /* Open write ends. */
+    struct poll_queue pollers;  /* Woken along with the conditions. */
+  };
+
+/* Returns the Ith buffer in use in P, counting from the oldest. */
+static struct pipe_buf *
+nth_buf (struct pipe *p, size_t i) 
+{
+  return &p->bufs[(p->head + i) % PIPE_BUFS];
+}
+
+/* Creates and returns a pipe with no ends open, or a null pointer
+   if memory is short. */
+struct pipe *
+pipe_create (void) 
+{
+  struct pipe *p = malloc (sizeof *p);
+
+  if (p == NULL)
+    return NULL;
+  lock_init_named (&p->lock, "pipe");
+  cond_init (&p->readable);
+  cond_init (&p->writable);
+  p->head = p->cnt = 0;
+  p->readers = p->writers = 0;
+  poll_queue_init (&p->pollers);
+  return p;
+}
+
+/* Opens another read end of P, or write end if WRITER is true. */
+void
+pipe_open_end (struct pipe *p, bool writer) 
+{
+  lock_acquire (&p->lock);
+  if (writer)
+    p->writers++;
+  else
+    p->readers++;
+  lock_release (&p->lock);
+}
+
+/* Closes a read end of P, or a write end if WRITER is true.  Once
+   the last writer is gone, readers see end of file; once the last
+   reader is gone, writes fail.  Frees P when both are gone. */
+void
+pipe_close_end (struct pipe *p, bool writer) 
+{
+  bool last;
+
+  lock_acquire (&p->lock);
+  if (writer)
+    p->writers--;
+  else
+    p->readers--;
+  cond_broadcast (&p->readable, &p->lock);
+  cond_broadcast (&p->writable, &p->lock);
+  poll_queue_wake (&p->pollers);
+  last = p->readers == 0 && p->writers == 0;
+  lock_release (&p->lock);
+
+  if (last)
+    pipe_destroy (p);
+}
+
+/* Frees P and the data buffered in it.  P must have no ends
+   open. */
+void
+pipe_destroy (struct pipe *p) 
+{
+  ASSERT (p->readers == 0 && p->writers == 0);
+
+  while (p->cnt > 0)
+    {
+      palloc_free_page (nth_buf (p, 0)->page);
+      p->head = (p->head + 1) % PIPE_BUFS;
+      p->cnt--;
+    }
+  free (p);
+}
+
+/* Waits until P has data or no writers.  Returns true if it has
+   data.  P's lock must be held. */
+static bool
+wait_readable (struct pipe *p) 
+{
+  while (p->cnt == 0 && p->writers > 0)
+    cond_wait (&p->readable, &p->lock);
+  return p->cnt > 0;
+}
+
+/* Reads up to SIZE bytes from P into BUFFER, waiting until there
+   is at least one unless no writer is left.  Returns the number of
+   bytes read, 0 meaning end of file. */
+off_t
+pipe_read (struct pipe *p, void *buffer_, off_t size) 
+{
+  uint8_t *buffer = buffer_;
+  off_t n = 0;
+
+  lock_acquire (&p->lock);
+  if (wait_readable (p))
+    {
+      while (n < size && p->cnt > 0)
+        {
+          struct pipe_buf *b = nth_buf (p, 0);
+          size_t left = size - n;
+          size_t chunk = b->len < left ? b->len : left;
+
+          memcpy (buffer + n, b->page + b->ofs, chunk);
+          n += chunk;
+          b->ofs += chunk;
+          b->len -= chunk;
+          if (b->len == 0)
+            {
+              palloc_free_page (b->page);
+              p->head = (p->head + 1) % PIPE_BUFS;
+              p->cnt--;
+            }
+        }
+      cond_broadcast (&p->writable, &p->lock);
+      poll_queue_wake (&p->pollers);
+    }
+  lock_release (&p->lock);
+  return n;
+}
+
+/* Waits until P has data or no writers.  If its oldest buffer is
+   a whole page, removes that page from P and returns it; the
+   caller must free it.  Otherwise returns a null pointer, and the
+   caller should use pipe_read(). */
+void *
+pipe_take_page (struct pipe *p) 
+{
+  void *page = NULL;
+
+  lock_acquire (&p->lock);
+  if (wait_readable (p))
+    {
+      struct pipe_buf *b = nth_buf (p, 0);
+
+      if (b->ofs == 0 && b->len == PGSIZE)
+        {
+          page = b->page;
+          p->head = (p->head + 1) % PIPE_BUFS;
+          p->cnt--;
+          cond_broadcast (&p->writable, &p->lock);
+          poll_queue_wake (&p->pollers);
+        }
+    }
+  lock_release (&p->lock);
+  return page;
+}
+
+/* Writes SIZE bytes from BUFFER to P, waiting for room as needed.
+   Returns the number of bytes written, which is less than SIZE
+   only if the last reader closed its end or memory ran short. */
+off_t
+pipe_write (struct pipe *p, const void *buffer_, off_t size) 
+{
+  const uint8_t *buffer = buffer_;
+  off_t n = 0;
+
+  lock_acquire (&p->lock);
+  while (n < size && p->readers > 0)
+    {
+      struct pipe_buf *b = p->cnt > 0 ? nth_buf (p, p->cnt - 1) : NULL;
+      size_t room, chunk;
+
+      if (b == NULL || b->ofs + b->len == PGSIZE)
+        {
+          if (p->cnt == PIPE_BUFS)
+            {
+              cond_wait (&p->writable, &p->lock);
+              continue;
+            }
+          b = &p->bufs[(p->head + p->cnt) % PIPE_BUFS];
+          b->page = palloc_get_page (0);
+          if (b->page == NULL)
+            break;
+          b->ofs = b->len = 0;
+          p->cnt++;
+        }
+
+      room = PGSIZE - (b->ofs + b->len);
+      chunk = room < (size_t) (size - n) ? room : (size_t) (size - n);
+      memcpy (b->page + b->ofs + b->len, buffer + n, chunk);
+      b->len += chunk;
+      n += chunk;
+      cond_broadcast (&p->readable, &p->lock);
+      poll_queue_wake (&p->pollers);
+    }
+  lock_release (&p->lock);
+  return n;
+}
+
+/* Queues PAGE, filled with PGSIZE bytes of data, on P without
+   copying it, waiting for room as needed.  Returns true if P took
+   ownership of PAGE, false if no reader is left. */
+bool
+pipe_give_page (struct pipe *p, void *page) 
+{
+  bool given = false;
+
+  lock_acquire (&p->lock);
+  while (p->cnt == PIPE_BUFS && p->readers > 0)
+    cond_wait (&p->writable, &p->lock);
+  if (p->readers > 0)
+    {
+      struct pipe_buf *b = &p->bufs[(p->head + p->cnt) % PIPE_BUFS];
+
+      b->page = page;
+      b->ofs = 0;
+      b->len = PGSIZE;
+      p->cnt++;
+      cond_broadcast (&p->readable, &p->lock);
+      poll_queue_wake (&p->pollers);
+      given = true;
+    }
+  lock_release (&p->lock);
+  return given;
+}
+
+/* Returns the poll() events that a read end of P, or a write end
+   if WRITER is true, is ready for.  If ENTRY is nonnull, first adds
+   it to P's poll queue, so that SEMA is raised whenever P changes
+   until it is removed. */
+int
+pipe_poll (struct pipe *p, bool writer, struct poll_entry *entry,
+           struct semaphore *sema) 
+{
+  int events = 0;
+
+  if (entry != NULL)
+    poll_queue_add (&p->pollers, entry, sema);
+  lock_acquire (&p->lock);
+  if (!writer)
+    {
+      if (p->cnt > 0)
+        events |= POLLIN;
+      if (p->writers == 0)
+        events |= POLLHUP;
+    }
+  else if (p->readers == 0)
+    events |= POLLERR;
+  else if (p->cnt < PIPE_BUFS
+           || nth_buf (p, p->cnt - 1)->ofs + nth_buf (p, p->cnt - 1)->len
+              < PGSIZE)
+    events |= POLLOUT;
+  lock_release (&p->lock);
+  return events;
+}
@@ -0,0 +1,22 @@
+#ifndef FILESYS_PIPE_H
+#define FILESYS_PIPE_H
+
+#include <stdbool.h>
+#include "filesys/off_t.h"
+#include "threads/synch.h"
+
+struct pipe;
+
+struct pipe *pipe_create (void);
+void pipe_open_end (struct pipe *, bool writer);
+void pipe_close_end (struct pipe *, bool writer);
+void pipe_destroy (struct pipe *);
+
+off_t pipe_read (struct pipe *, void *, off_t);
+off_t pipe_write (struct pipe *, const void *, off_t);
+void *pipe_take_page (struct pipe *);
+bool pipe_give_page (struct pipe *, void *page);
+int pipe_poll (struct pipe *, bool writer, struct poll_entry *,
+               struct semaphore *);
+
+#endif /* filesys/pipe.h */
@@ -1,3 +1,4 @@
+#include <stdbool.h>
 #include <stdint.h>
 
 /* On x86, division of one 64-bit integer by another cannot be
@@ -72,13 +73,42 @@ nlz (uint32_t x)
   return n;
 }
 
+/* Returns the number of trailing zero bits in X,
+   which must be nonzero. */
+static inline int
+ntz64 (uint64_t x) 
+{
+  uint32_t x0 = x;
+
+  /* GCC expands __builtin_ctz() to a BSF instruction, with no
+     call into libgcc. */
+  return x0 != 0 ? __builtin_ctz (x0) : 32 + __builtin_ctz (x >> 32);
+}
+
+/* Returns true if D is a power of 2. */
+static inline bool
+is_pow2 (uint64_t d) 
+{
+  return d != 0 && (d & (d - 1)) == 0;
+}
+
 /* Divides unsigned 64-bit N by unsigned 64-bit D and returns the
    quotient. */
 static uint64_t
 udiv64 (uint64_t n, uint64_t d)
 {
+  /* Dividing by a power of 2 is a shift. */
+  if (is_pow2 (d))
+    return n >> ntz64 (d);
+
   if ((d >> 32) == 0) 
     {
+      /* The common cases, including any N that fits in 32 bits,
+         have a quotient that fits in 32 bits, which a single DIVL
+         yields. */
+      if ((uint32_t) (n >> 32) < (uint32_t) d)
+        return divl (n, d);
+
       /* Proof of correctness:
 
          Let n, d, b, n1, and n0 be defined as in this function.
@@ -128,9 +158,13 @@ udiv64 (uint64_t n, uint64_t d)
 
 /* Divides unsigned 64-bit N by unsigned 64-bit D and returns the
    remainder. */
-static uint32_t
+static uint64_t
 umod64 (uint64_t n, uint64_t d)
 {
+  if (is_pow2 (d))
+    return n & (d - 1);
+  if ((n >> 32) == 0 && (d >> 32) == 0)
+    return (uint32_t) n % (uint32_t) d;
   return n - d * udiv64 (n, d);
 }
 
@@ -147,7 +181,7 @@ sdiv64 (int64_t n, int64_t d)
 
 /* Divides signed 64-bit N by signed 64-bit D and returns the
    remainder. */
-static int32_t
+static int64_t
 smod64 (int64_t n, int64_t d)
 {
   return n - d * sdiv64 (n, d);
@@ -159,6 +193,9 @@ long long __divdi3 (long long n, long long d);
 long long __moddi3 (long long n, long long d);
 unsigned long long __udivdi3 (unsigned long long n, unsigned long long d);
 unsigned long long __umoddi3 (unsigned long long n, unsigned long long d);
+long long __divmoddi4 (long long n, long long d, long long *r);
+unsigned long long __udivmoddi4 (unsigned long long n, unsigned long long d,
+                                 unsigned long long *r);
 
 /* Signed 64-bit division. */
 long long
@@ -187,3 +224,27 @@ __umoddi3 (unsigned long long n, unsigned long long d)
 {
   return umod64 (n, d);
 }
+
+/* Signed 64-bit division that also stores the remainder in *R,
+   which GCC calls at higher optimization levels when it needs
+   both. */
+long long
+__divmoddi4 (long long n, long long d, long long *r) 
+{
+  long long q = sdiv64 (n, d);
+  if (r != 0)
+    *r = n - q * d;
+  return q;
+}
+
+/* Unsigned 64-bit division that also stores the remainder in
+   *R. */
+unsigned long long
+__udivmoddi4 (unsigned long long n, unsigned long long d,
+              unsigned long long *r) 
+{
+  unsigned long long q = udiv64 (n, d);
+  if (r != 0)
+    *r = n - q * d;
+  return q;
+}
@@ -0,0 +1,117 @@
+#ifndef __LIB_ATOMIC_H
+#define __LIB_ATOMIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Atomic operations and memory barriers for x86, for the kernel
+   and user programs alike.
+
+   The read-modify-write operations below take a pointer P to a
+   32-bit integer or pointer and are atomic with respect to
+   interrupts and to other CPUs, so a shared counter or flag needs
+   neither a lock nor interrupts turned off.  Each one is also a
+   full memory barrier, as the x86 locked instructions are, and an
+   optimization barrier for the compiler. */
+
+/* Optimization barrier.
+
+   The compiler will not reorder operations across an
+   optimization barrier.  See "Optimization Barriers" in the
+   reference guide for more information.*/
+#define barrier() asm volatile ("" : : : "memory")
+
+/* Memory barriers.  x86 only lets a load pass an earlier store to
+   another location, so only mb() needs an instruction; rmb() and
+   wmb() only keep the compiler from reordering. */
+#define mb() asm volatile ("lock addl $0, (%%esp)" : : : "memory", "cc")
+#define rmb() barrier ()
+#define wmb() barrier ()
+
+/* Returns *P, reading it exactly once. */
+#define atomic_read(P) (*(volatile __typeof__ (*(P)) *) (P))
+
+/* Sets *P to V, writing it exactly once. */
+#define atomic_set(P, V) \
+        ((void) (*(volatile __typeof__ (*(P)) *) (P) = (V)))
+
+/* Adds V to *P and returns the old value of *P. */
+#define atomic_fetch_add(P, V)                                  \
+        ({                                                      \
+          __typeof__ (*(P)) atomic_val_ = (V);                  \
+          asm volatile ("lock xaddl %0, %1"                     \
+                        : "+r" (atomic_val_), "+m" (*(P))       \
+                        : : "memory", "cc");                    \
+          atomic_val_;                                          \
+        })
+
+/* Subtracts V from *P and returns the old value of *P. */
+#define atomic_fetch_sub(P, V) atomic_fetch_add (P, -(V))
+
+/* Adds 1 to or subtracts 1 from *P. */
+#define atomic_inc(P) \
+        asm volatile ("lock incl %0" : "+m" (*(P)) : : "memory", "cc")
+#define atomic_dec(P) \
+        asm volatile ("lock decl %0" : "+m" (*(P)) : : "memory", "cc")
+
+/* Stores V in *P and returns the old value of *P. */
+#define atomic_xchg(P, V)                                       \
+        ({                                                      \
+          __typeof__ (*(P)) atomic_val_ = (V);                  \
+          asm volatile ("xchgl %0, %1"                          \
+                        : "+r" (atomic_val_), "+m" (*(P))       \
+                        : : "memory");                          \
+          atomic_val_;                                          \
+        })
+
+/* If *P equals OLD, stores NEW in *P.  Either way, returns the old
+   value of *P, which equals OLD if and only if NEW was stored. */
+#define atomic_cmpxchg(P, OLD, NEW)                             \
+        ({                                                      \
+          __typeof__ (*(P)) atomic_val_ = (OLD);                \
+          asm volatile ("lock cmpxchgl %2, %1"                  \
+                        : "+a" (atomic_val_), "+m" (*(P))       \
+                        : "r" ((__typeof__ (*(P))) (NEW))       \
+                        : "memory", "cc");                      \
+          atomic_val_;                                          \
+        })
+
+/* If *P equals OLD, stores NEW in *P and returns true; otherwise
+   returns false. */
+#define atomic_cas(P, OLD, NEW)                                 \
+        ({                                                      \
+          __typeof__ (*(P)) atomic_old_ = (OLD);                \
+          atomic_cmpxchg (P, atomic_old_, NEW) == atomic_old_;  \
+        })
+
+/* 64-bit versions of atomic_cmpxchg(), atomic_read() and
+   atomic_fetch_add(), for counters that would otherwise tear on a
+   32-bit CPU. */
+static inline uint64_t
+atomic_cmpxchg64 (volatile uint64_t *p, uint64_t old, uint64_t new)
+{
+  asm volatile ("lock cmpxchg8b %1"
+                : "+A" (old), "+m" (*p)
+                : "b" ((uint32_t) new), "c" ((uint32_t) (new >> 32))
+                : "memory", "cc");
+  return old;
+}
+
+static inline uint64_t
+atomic_read64 (volatile uint64_t *p)
+{
+  /* Stores 0 over 0 if it matches, which changes nothing. */
+  return atomic_cmpxchg64 (p, 0, 0);
+}
+
+static inline uint64_t
+atomic_fetch_add64 (volatile uint64_t *p, uint64_t v)
+{
+  uint64_t old = *p, seen;
+
+  while ((seen = atomic_cmpxchg64 (p, old, old + v)) != old)
+    old = seen;
+  return old;
+}
+
+#endif /* lib/atomic.h */
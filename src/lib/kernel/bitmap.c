@@ -69,6 +69,36 @@ last_mask (const struct bitmap *b)
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Returns the index of the first bit in B at or after START, and
+   before END, that is VALUE, or END if there is none.  Examines
+   a whole element at a time, so that elements with no VALUE bits
+   cost a single comparison. */
+static size_t
+next_bit (const struct bitmap *b, size_t start, size_t end, bool value) 
+{
+  elem_type flip = value ? 0 : (elem_type) -1;
+  size_t idx;
+
+  if (start >= end)
+    return end;
+
+  /* Skip the bits before START in its element. */
+  idx = elem_idx (start);
+  for (; idx * ELEM_BITS < end; idx++)
+    {
+      elem_type word = b->bits[idx] ^ flip;
+
+      if (idx == elem_idx (start))
+        word &= (elem_type) -1 << (start % ELEM_BITS);
+      if (word != 0)
+        {
+          size_t bit = idx * ELEM_BITS + __builtin_ctzl (word);
+          return bit < end ? bit : end;
+        }
+    }
+  return end;
+}
+
 /* Creation and destruction. */
 
 /* Creates and returns a pointer to a newly allocated bitmap with room for
@@ -250,16 +280,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return next_bit (b, start, start + cnt, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -298,13 +323,20 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt) 
+  if (cnt == 0)
+    return start;
+  while (start + cnt <= b->bit_cnt)
     {
-      size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      /* Find the next run of VALUE bits and where it ends. */
+      size_t end;
+
+      start = next_bit (b, start, b->bit_cnt, value);
+      if (start + cnt > b->bit_cnt)
+        break;
+      end = next_bit (b, start, start + cnt, !value);
+      if (end - start >= cnt)
+        return start;
+      start = end;
     }
   return BITMAP_ERROR;
 }
@@ -46,6 +46,7 @@ debug_panic (const char *file, int line, const char *function,
     }
 
   serial_flush ();
+  shutdown_set_verdict (SHUTDOWN_PANIC);
   shutdown ();
   for (;;);
 }
@@ -3,7 +3,14 @@
    This data structure is thoroughly documented in the Tour of
    Pintos for Project 3.
 
-   See hash.h for basic information. */
+   See hash.h for basic information.
+
+   Resizing is incremental.  When a table grows or shrinks, its
+   elements stay in the old array of buckets or slots, and each
+   later insertion or deletion moves up to MIGRATE_STEP of them
+   into the new one, so that no single operation pays for moving
+   the whole table.  Until the old array has been emptied and
+   freed, lookups check both arrays. */
 
 #include "hash.h"
 #include "../debug.h"
@@ -12,12 +19,28 @@
 #define list_elem_to_hash_elem(LIST_ELEM)                       \
         list_entry(LIST_ELEM, struct hash_elem, list_elem)
 
-static struct list *find_bucket (struct hash *, struct hash_elem *);
+/* Old buckets or slots moved per insertion or deletion. */
+#define MIGRATE_STEP 8
+
+/* Marks an old slot of an open table whose element has been moved
+   or deleted, so that probes continue past it. */
+static struct hash_elem moved_elem;
+#define MOVED (&moved_elem)
+
+static struct hash_elem *chain_find (struct hash *, struct hash_elem *,
+                                     struct list **bucket);
 static struct hash_elem *find_elem (struct hash *, struct list *,
                                     struct hash_elem *);
 static void insert_elem (struct hash *, struct list *, struct hash_elem *);
 static void remove_elem (struct hash *, struct hash_elem *);
 static void rehash (struct hash *);
+static void migrate (struct hash *, size_t cnt);
+static struct hash_elem **open_find (struct hash *, struct hash_elem *,
+                                     unsigned hash, size_t *slot);
+static struct hash_elem *open_insert (struct hash *, struct hash_elem *,
+                                      bool replace);
+static void open_remove (struct hash *, size_t slot);
+static bool open_resize (struct hash *, size_t slot_cnt);
 
 /* Initializes hash table H to compute hash values using HASH and
    compare hash elements using LESS, given auxiliary data AUX. */
@@ -28,6 +51,9 @@ hash_init (struct hash *h,
   h->elem_cnt = 0;
   h->bucket_cnt = 4;
   h->buckets = malloc (sizeof *h->buckets * h->bucket_cnt);
+  h->slots = NULL;
+  h->old_buckets = NULL;
+  h->old_slots = NULL;
   h->hash = hash;
   h->less = less;
   h->aux = aux;
@@ -41,6 +67,24 @@ hash_init (struct hash *h,
     return false;
 }
 
+/* Initializes hash table H like hash_init(), but to use open
+   addressing instead of chaining.  See hash.h. */
+bool
+hash_init_open (struct hash *h,
+                hash_hash_func *hash, hash_less_func *less, void *aux) 
+{
+  h->elem_cnt = 0;
+  h->bucket_cnt = 0;
+  h->buckets = NULL;
+  h->slots = NULL;
+  h->old_buckets = NULL;
+  h->old_slots = NULL;
+  h->hash = hash;
+  h->less = less;
+  h->aux = aux;
+  return open_resize (h, 8);
+}
+
 /* Removes all the elements from H.
    
    If DESTRUCTOR is non-null, then it is called for each element
@@ -55,6 +99,22 @@ hash_clear (struct hash *h, hash_action_func *destructor)
 {
   size_t i;
 
+  migrate (h, SIZE_MAX);
+
+  if (h->slots != NULL)
+    {
+      for (i = 0; i < h->bucket_cnt; i++)
+        if (h->slots[i].elem != NULL)
+          {
+            struct hash_elem *hash_elem = h->slots[i].elem;
+            h->slots[i].elem = NULL;
+            if (destructor != NULL)
+              destructor (hash_elem, h->aux);
+          }
+      h->elem_cnt = 0;
+      return;
+    }
+
   for (i = 0; i < h->bucket_cnt; i++) 
     {
       struct list *bucket = &h->buckets[i];
@@ -89,6 +149,9 @@ hash_destroy (struct hash *h, hash_action_func *destructor)
   if (destructor != NULL)
     hash_clear (h, destructor);
   free (h->buckets);
+  free (h->slots);
+  free (h->old_buckets);
+  free (h->old_slots);
 }
 
 /* Inserts NEW into hash table H and returns a null pointer, if
@@ -98,9 +161,13 @@ hash_destroy (struct hash *h, hash_action_func *destructor)
 struct hash_elem *
 hash_insert (struct hash *h, struct hash_elem *new)
 {
-  struct list *bucket = find_bucket (h, new);
-  struct hash_elem *old = find_elem (h, bucket, new);
+  struct list *bucket;
+  struct hash_elem *old;
+
+  if (h->slots != NULL)
+    return open_insert (h, new, false);
 
+  old = chain_find (h, new, &bucket);
   if (old == NULL) 
     insert_elem (h, bucket, new);
 
@@ -114,9 +181,13 @@ hash_insert (struct hash *h, struct hash_elem *new)
 struct hash_elem *
 hash_replace (struct hash *h, struct hash_elem *new) 
 {
-  struct list *bucket = find_bucket (h, new);
-  struct hash_elem *old = find_elem (h, bucket, new);
+  struct list *bucket;
+  struct hash_elem *old;
 
+  if (h->slots != NULL)
+    return open_insert (h, new, true);
+
+  old = chain_find (h, new, &bucket);
   if (old != NULL)
     remove_elem (h, old);
   insert_elem (h, bucket, new);
@@ -131,7 +202,14 @@ hash_replace (struct hash *h, struct hash_elem *new)
 struct hash_elem *
 hash_find (struct hash *h, struct hash_elem *e) 
 {
-  return find_elem (h, find_bucket (h, e), e);
+  struct list *bucket;
+
+  if (h->slots != NULL)
+    {
+      struct hash_elem **found = open_find (h, e, h->hash (e, h->aux), NULL);
+      return found != NULL ? *found : NULL;
+    }
+  return chain_find (h, e, &bucket);
 }
 
 /* Finds, removes, and returns an element equal to E in hash
@@ -144,7 +222,30 @@ hash_find (struct hash *h, struct hash_elem *e)
 struct hash_elem *
 hash_delete (struct hash *h, struct hash_elem *e)
 {
-  struct hash_elem *found = find_elem (h, find_bucket (h, e), e);
+  struct hash_elem *found;
+  struct list *bucket;
+
+  if (h->slots != NULL)
+    {
+      size_t slot;
+      struct hash_elem **elemp = open_find (h, e, h->hash (e, h->aux), &slot);
+
+      if (elemp == NULL)
+        return NULL;
+      found = *elemp;
+      if (elemp == &h->slots[slot].elem)
+        open_remove (h, slot);
+      else
+        {
+          /* Still in the old array, where probes must pass it. */
+          *elemp = MOVED;
+          h->elem_cnt--;
+        }
+      migrate (h, MIGRATE_STEP);
+      return found;
+    }
+
+  found = chain_find (h, e, &bucket);
   if (found != NULL) 
     {
       remove_elem (h, found);
@@ -166,6 +267,16 @@ hash_apply (struct hash *h, hash_action_func *action)
   
   ASSERT (action != NULL);
 
+  migrate (h, SIZE_MAX);
+
+  if (h->slots != NULL)
+    {
+      for (i = 0; i < h->bucket_cnt; i++)
+        if (h->slots[i].elem != NULL)
+          action (h->slots[i].elem, h->aux);
+      return;
+    }
+
   for (i = 0; i < h->bucket_cnt; i++) 
     {
       struct list *bucket = &h->buckets[i];
@@ -202,11 +313,20 @@ hash_first (struct hash_iterator *i, struct hash *h)
   ASSERT (i != NULL);
   ASSERT (h != NULL);
 
+  /* Iteration visits every element anyway, so finishing a resize
+     first keeps it to one array. */
+  migrate (h, SIZE_MAX);
+
   i->hash = h;
+  if (h->slots != NULL)
+    {
+      i->slot = (size_t) -1;
+      i->elem = NULL;
+      return;
+    }
   i->bucket = i->hash->buckets;
   i->elem = list_elem_to_hash_elem (list_head (i->bucket));
 }
-
 /* Advances I to the next element in the hash table and returns
    it.  Returns a null pointer if no elements are left.  Elements
    are returned in arbitrary order.
@@ -220,6 +340,20 @@ hash_next (struct hash_iterator *i)
 {
   ASSERT (i != NULL);
 
+  if (i->hash->slots != NULL)
+    {
+      struct hash *h = i->hash;
+
+      i->elem = NULL;
+      while (++i->slot < h->bucket_cnt)
+        if (h->slots[i->slot].elem != NULL)
+          {
+            i->elem = h->slots[i->slot].elem;
+            break;
+          }
+      return i->elem;
+    }
+
   i->elem = list_elem_to_hash_elem (list_next (&i->elem->list_elem));
   while (i->elem == list_elem_to_hash_elem (list_end (i->bucket)))
     {
@@ -261,7 +395,45 @@ hash_empty (struct hash *h)
 #define FNV_32_PRIME 16777619u
 #define FNV_32_BASIS 2166136261u
 
-/* Returns a hash of the SIZE bytes in BUF. */
+/* MurmurHash3 constants. */
+#define MURMUR_C1 0xcc9e2d51u
+#define MURMUR_C2 0x1b873593u
+
+/* Returns X rotated left by N bits. */
+static inline uint32_t
+rotl32 (uint32_t x, int n)
+{
+  return (x << n) | (x >> (32 - n));
+}
+
+/* Mixes 32-bit word K into running hash H, as MurmurHash3 does
+   with each block of its input. */
+static inline uint32_t
+murmur_mix (uint32_t h, uint32_t k)
+{
+  k *= MURMUR_C1;
+  k = rotl32 (k, 15);
+  k *= MURMUR_C2;
+  h ^= k;
+  h = rotl32 (h, 13);
+  return h * 5 + 0xe6546b64;
+}
+
+/* MurmurHash3's finalizer, which makes every bit of H affect every
+   bit of the result. */
+static inline uint32_t
+murmur_fmix (uint32_t h)
+{
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
+
+/* Returns a hash of the SIZE bytes in BUF.  The journal stores
+   this hash on disk as a checksum, so it must not change. */
 unsigned
 hash_bytes (const void *buf_, size_t size)
 {
@@ -278,35 +450,73 @@ hash_bytes (const void *buf_, size_t size)
   return hash;
 } 
 
-/* Returns a hash of string S. */
+/* Returns a hash of string S.  The string is mixed in four bytes
+   at a time, MurmurHash3 style, so that names cost a quarter of the
+   multiplies of a byte-at-a-time hash.  The bytes of each group are
+   loaded one by one, so no read goes past the null terminator. */
 unsigned
 hash_string (const char *s_) 
 {
   const unsigned char *s = (const unsigned char *) s_;
-  unsigned hash;
+  uint32_t hash = 0;
+  size_t len = 0;
 
   ASSERT (s != NULL);
 
-  hash = FNV_32_BASIS;
-  while (*s != '\0')
-    hash = (hash * FNV_32_PRIME) ^ *s++;
+  for (;;)
+    {
+      uint32_t word = 0;
+      int n;
+
+      for (n = 0; n < 4 && s[n] != '\0'; n++)
+        word |= (uint32_t) s[n] << (8 * n);
+      if (n == 0)
+        break;
+      hash = murmur_mix (hash, word);
+      s += n;
+      len += n;
+      if (n < 4)
+        break;
+    }
 
-  return hash;
+  return murmur_fmix (hash ^ len);
 }
 
-/* Returns a hash of integer I. */
+/* Returns a hash of integer I.  Every bit of I reaches every bit of
+   the hash, so values that differ only in high bits, such as page
+   addresses, still spread across buckets. */
 unsigned
 hash_int (int i) 
 {
-  return hash_bytes (&i, sizeof i);
+  return murmur_fmix (i);
+}
+
+/* Returns a hash of pointer P. */
+unsigned
+hash_ptr (const void *p)
+{
+  return murmur_fmix ((uintptr_t) p);
 }
 
-/* Returns the bucket in H that E belongs in. */
-static struct list *
-find_bucket (struct hash *h, struct hash_elem *e) 
+/* Searches chained table H for an element equal to E, in the
+   bucket that E belongs in, which is stored in *BUCKET, and in its
+   bucket in the old array if that has not been moved yet.  Returns
+   the element if found or a null pointer otherwise. */
+static struct hash_elem *
+chain_find (struct hash *h, struct hash_elem *e, struct list **bucket) 
 {
-  size_t bucket_idx = h->hash (e, h->aux) & (h->bucket_cnt - 1);
-  return &h->buckets[bucket_idx];
+  unsigned hash = h->hash (e, h->aux);
+  struct hash_elem *found;
+
+  *bucket = &h->buckets[hash & (h->bucket_cnt - 1)];
+  found = find_elem (h, *bucket, e);
+  if (found == NULL && h->old_buckets != NULL)
+    {
+      size_t idx = hash & (h->old_cnt - 1);
+      if (idx >= h->moved)
+        found = find_elem (h, &h->old_buckets[idx], e);
+    }
+  return found;
 }
 
 /* Searches BUCKET in H for a hash element equal to E.  Returns
@@ -344,22 +554,25 @@ is_power_of_2 (size_t x)
 #define BEST_ELEMS_PER_BUCKET 2 /* Ideal elems/bucket. */
 #define MAX_ELEMS_PER_BUCKET  4 /* Elems/bucket > 4: increase # of buckets. */
 
-/* Changes the number of buckets in hash table H to match the
-   ideal.  This function can fail because of an out-of-memory
+/* Moves some of chained table H's old buckets, if it is being
+   resized, or else starts changing the number of buckets to match
+   the ideal.  This function can fail because of an out-of-memory
    condition, but that'll just make hash accesses less efficient;
    we can still continue. */
 static void
 rehash (struct hash *h) 
 {
-  size_t old_bucket_cnt, new_bucket_cnt;
-  struct list *new_buckets, *old_buckets;
+  size_t new_bucket_cnt;
+  struct list *new_buckets;
   size_t i;
 
   ASSERT (h != NULL);
 
-  /* Save old bucket info for later use. */
-  old_buckets = h->buckets;
-  old_bucket_cnt = h->bucket_cnt;
+  if (h->old_buckets != NULL)
+    {
+      migrate (h, MIGRATE_STEP);
+      return;
+    }
 
   /* Calculate the number of buckets to use now.
      We want one bucket for about every BEST_ELEMS_PER_BUCKET.
@@ -372,7 +585,7 @@ rehash (struct hash *h)
     new_bucket_cnt = turn_off_least_1bit (new_bucket_cnt);
 
   /* Don't do anything if the bucket count wouldn't change. */
-  if (new_bucket_cnt == old_bucket_cnt)
+  if (new_bucket_cnt == h->bucket_cnt)
     return;
 
   /* Allocate new buckets and initialize them as empty. */
@@ -387,29 +600,60 @@ rehash (struct hash *h)
   for (i = 0; i < new_bucket_cnt; i++) 
     list_init (&new_buckets[i]);
 
-  /* Install new bucket info. */
+  /* Install new bucket info, keeping the old buckets to be moved
+     a few at a time. */
+  h->old_buckets = h->buckets;
+  h->old_cnt = h->bucket_cnt;
+  h->moved = 0;
   h->buckets = new_buckets;
   h->bucket_cnt = new_bucket_cnt;
+  migrate (h, MIGRATE_STEP);
+}
 
-  /* Move each old element into the appropriate new bucket. */
-  for (i = 0; i < old_bucket_cnt; i++) 
+/* Moves up to CNT of H's old buckets or slots into its current
+   array, freeing the old array once it is empty. */
+static void
+migrate (struct hash *h, size_t cnt) 
+{
+  for (; cnt > 0 && h->old_buckets != NULL; cnt--)
     {
-      struct list *old_bucket;
-      struct list_elem *elem, *next;
+      struct list *old_bucket = &h->old_buckets[h->moved];
 
-      old_bucket = &old_buckets[i];
-      for (elem = list_begin (old_bucket);
-           elem != list_end (old_bucket); elem = next) 
+      while (!list_empty (old_bucket))
         {
-          struct list *new_bucket
-            = find_bucket (h, list_elem_to_hash_elem (elem));
-          next = list_next (elem);
-          list_remove (elem);
-          list_push_front (new_bucket, elem);
+          struct list_elem *elem = list_pop_front (old_bucket);
+          struct hash_elem *e = list_elem_to_hash_elem (elem);
+          size_t idx = h->hash (e, h->aux) & (h->bucket_cnt - 1);
+          list_push_front (&h->buckets[idx], elem);
+        }
+      if (++h->moved == h->old_cnt)
+        {
+          free (h->old_buckets);
+          h->old_buckets = NULL;
         }
     }
 
-  free (old_buckets);
+  for (; cnt > 0 && h->old_slots != NULL; cnt--)
+    {
+      struct hash_slot *old = &h->old_slots[h->moved];
+
+      if (old->elem != NULL && old->elem != MOVED)
+        {
+          size_t mask = h->bucket_cnt - 1;
+          size_t i;
+
+          for (i = old->hash & mask; h->slots[i].elem != NULL;
+               i = (i + 1) & mask)
+            continue;
+          h->slots[i] = *old;
+          old->elem = MOVED;
+        }
+      if (++h->moved == h->old_cnt)
+        {
+          free (h->old_slots);
+          h->old_slots = NULL;
+        }
+    }
 }
 
 /* Inserts E into BUCKET (in hash table H). */
@@ -428,3 +672,128 @@ remove_elem (struct hash *h, struct hash_elem *e)
   list_remove (&e->list_elem);
 }
 
+/* Searches open table H for an element equal to E, whose hash
+   value is HASH, in its current slots and then in any old slots
+   not yet moved.  Returns a pointer to the slot's element pointer
+   if found, otherwise a null pointer.  If SLOT is nonnull, stores
+   in it the slot in the current array where the probe ended: the
+   element's slot if it was found there, or else an empty one. */
+static struct hash_elem **
+open_find (struct hash *h, struct hash_elem *e, unsigned hash, size_t *slot) 
+{
+  size_t mask = h->bucket_cnt - 1;
+  size_t i;
+
+  for (i = hash & mask; h->slots[i].elem != NULL; i = (i + 1) & mask)
+    {
+      struct hash_elem *hi = h->slots[i].elem;
+      if (h->slots[i].hash == hash
+          && !h->less (hi, e, h->aux) && !h->less (e, hi, h->aux))
+        break;
+    }
+  if (slot != NULL)
+    *slot = i;
+  if (h->slots[i].elem != NULL)
+    return &h->slots[i].elem;
+
+  if (h->old_slots != NULL)
+    {
+      mask = h->old_cnt - 1;
+      for (i = hash & mask; h->old_slots[i].elem != NULL; i = (i + 1) & mask)
+        {
+          struct hash_elem *hi = h->old_slots[i].elem;
+          if (hi != MOVED && h->old_slots[i].hash == hash
+              && !h->less (hi, e, h->aux) && !h->less (e, hi, h->aux))
+            return &h->old_slots[i].elem;
+        }
+    }
+  return NULL;
+}
+
+/* Inserts NEW into open table H.  If an equal element is already
+   in the table, returns it, and replaces it with NEW if REPLACE
+   is true.  Otherwise, returns a null pointer, or NEW if the
+   table is too full to take it and cannot be grown. */
+static struct hash_elem *
+open_insert (struct hash *h, struct hash_elem *new, bool replace) 
+{
+  unsigned hash = h->hash (new, h->aux);
+  size_t slot;
+  struct hash_elem **old = open_find (h, new, hash, &slot);
+
+  if (old != NULL)
+    {
+      struct hash_elem *found = *old;
+      if (replace)
+        *old = new;
+      return found;
+    }
+
+  /* Grow past 3/4 full.  Without memory, keep going as long as at
+     least one slot stays empty to end probes. */
+  if ((h->elem_cnt + 1) * 4 > h->bucket_cnt * 3)
+    {
+      if (open_resize (h, h->bucket_cnt * 2))
+        open_find (h, new, hash, &slot);
+      else if (h->elem_cnt + 1 >= h->bucket_cnt)
+        return new;
+    }
+
+  h->slots[slot].hash = hash;
+  h->slots[slot].elem = new;
+  h->elem_cnt++;
+  migrate (h, MIGRATE_STEP);
+  return NULL;
+}
+
+/* Empties SLOT in the current array of open table H, shifting
+   back later elements of the same probe run so that no probe
+   stops short of them. */
+static void
+open_remove (struct hash *h, size_t slot) 
+{
+  size_t mask = h->bucket_cnt - 1;
+  size_t hole = slot;
+  size_t i;
+
+  for (i = (slot + 1) & mask; h->slots[i].elem != NULL; i = (i + 1) & mask)
+    {
+      size_t home = h->slots[i].hash & mask;
+      if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+          h->slots[hole] = h->slots[i];
+          hole = i;
+        }
+    }
+  h->slots[hole].elem = NULL;
+  h->elem_cnt--;
+
+  /* Shrink below 1/8 full, which can fail harmlessly. */
+  if (h->old_slots == NULL
+      && h->bucket_cnt > 8 && h->elem_cnt * 8 < h->bucket_cnt)
+    open_resize (h, h->bucket_cnt / 2);
+}
+
+/* Starts moving the elements of open table H into a new array of
+   SLOT_CNT slots, a power of 2, finishing any earlier resize
+   first.  Returns false, leaving H unchanged, if memory is not
+   available. */
+static bool
+open_resize (struct hash *h, size_t slot_cnt) 
+{
+  struct hash_slot *new_slots;
+
+  ASSERT (is_power_of_2 (slot_cnt));
+
+  new_slots = calloc (slot_cnt, sizeof *new_slots);
+  if (new_slots == NULL)
+    return false;
+
+  migrate (h, SIZE_MAX);
+  h->old_slots = h->slots;
+  h->old_cnt = h->bucket_cnt;
+  h->moved = 0;
+  h->slots = new_slots;
+  h->bucket_cnt = slot_cnt;
+  return true;
+}
@@ -18,7 +18,15 @@
    conversion from a struct hash_elem back to a structure object
    that contains it.  This is the same technique used in the
    linked list implementation.  Refer to lib/kernel/list.h for a
-   detailed explanation. */
+   detailed explanation.
+
+   A table initialized with hash_init_open() instead uses open
+   addressing: elements are found by linear probing in one flat
+   array of slots, each holding an element pointer and its hash
+   value, so a probe touches an element only when the hash values
+   match.  Such a table never keeps more than 3/4 of its slots in
+   use, and a hash_insert() that needs to grow it but cannot
+   allocate memory fails by returning NEW. */
 
 #include <stdbool.h>
 #include <stddef.h>
@@ -55,12 +63,24 @@ typedef bool hash_less_func (const struct hash_elem *a,
    data AUX. */
 typedef void hash_action_func (struct hash_elem *e, void *aux);
 
+/* Slot in an open-addressed hash table. */
+struct hash_slot
+  {
+    unsigned hash;              /* Hash value of ELEM. */
+    struct hash_elem *elem;     /* Element, or null if slot is empty. */
+  };
+
 /* Hash table. */
 struct hash 
   {
     size_t elem_cnt;            /* Number of elements in table. */
     size_t bucket_cnt;          /* Number of buckets, a power of 2. */
     struct list *buckets;       /* Array of `bucket_cnt' lists. */
+    struct hash_slot *slots;    /* If open: array of `bucket_cnt' slots. */
+    struct list *old_buckets;   /* Buckets being moved by a resize. */
+    struct hash_slot *old_slots; /* Slots being moved by a resize. */
+    size_t old_cnt;             /* Number of old buckets or slots. */
+    size_t moved;               /* Number of them moved so far. */
     hash_hash_func *hash;       /* Hash function. */
     hash_less_func *less;       /* Comparison function. */
     void *aux;                  /* Auxiliary data for `hash' and `less'. */
@@ -72,10 +92,13 @@ struct hash_iterator
     struct hash *hash;          /* The hash table. */
     struct list *bucket;        /* Current bucket. */
     struct hash_elem *elem;     /* Current hash element in current bucket. */
+    size_t slot;                /* Current slot, in an open table. */
   };
 
 /* Basic life cycle. */
 bool hash_init (struct hash *, hash_hash_func *, hash_less_func *, void *aux);
+bool hash_init_open (struct hash *, hash_hash_func *, hash_less_func *,
+                     void *aux);
 void hash_clear (struct hash *, hash_action_func *);
 void hash_destroy (struct hash *, hash_action_func *);
 
@@ -99,5 +122,6 @@ bool hash_empty (struct hash *);
 unsigned hash_bytes (const void *, size_t);
 unsigned hash_string (const char *);
 unsigned hash_int (int);
+unsigned hash_ptr (const void *);
 
 #endif /* lib/kernel/hash.h */
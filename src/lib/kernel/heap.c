@@ -0,0 +1,182 @@
+#include "heap.h"
+#include "../debug.h"
+
+/* Pairing heap.  See heap.h for basic information.
+
+   The root has no siblings.  Removing it melds its children in
+   pairs from left to right, then melds the pairs into one heap
+   from right to left, which is what keeps pops at O(log n)
+   amortized time. */
+
+static struct heap_elem *meld (struct heap *,
+                               struct heap_elem *, struct heap_elem *);
+static struct heap_elem *merge_pairs (struct heap *, struct heap_elem *);
+static void detach (struct heap_elem *);
+
+/* Initializes H as an empty heap ordered by LESS, given
+   auxiliary data AUX. */
+void
+heap_init (struct heap *h, heap_less_func *less, void *aux) 
+{
+  ASSERT (h != NULL);
+  ASSERT (less != NULL);
+
+  h->root = NULL;
+  h->size = 0;
+  h->less = less;
+  h->aux = aux;
+}
+
+/* Inserts E into H. */
+void
+heap_push (struct heap *h, struct heap_elem *e) 
+{
+  ASSERT (e != NULL);
+
+  e->child = e->next = e->prev = NULL;
+  h->root = meld (h, h->root, e);
+  h->size++;
+}
+
+/* Returns the least element in H, or a null pointer if H is
+   empty.  If several elements are least, returns any of them. */
+struct heap_elem *
+heap_top (const struct heap *h) 
+{
+  return h->root;
+}
+
+/* Removes and returns the least element in H, or returns a null
+   pointer if H is empty. */
+struct heap_elem *
+heap_pop (struct heap *h) 
+{
+  struct heap_elem *top = h->root;
+
+  if (top != NULL)
+    heap_remove (h, top);
+  return top;
+}
+
+/* Removes E, which must be in H, from H. */
+void
+heap_remove (struct heap *h, struct heap_elem *e) 
+{
+  struct heap_elem *children;
+
+  ASSERT (h->size > 0);
+
+  children = merge_pairs (h, e->child);
+  if (e == h->root)
+    h->root = children;
+  else
+    {
+      detach (e);
+      h->root = meld (h, h->root, children);
+    }
+  e->child = e->next = e->prev = NULL;
+  h->size--;
+}
+
+/* Restores the heap order of H after the value of E, which must
+   be in H, has been decreased (or left alone).  The value of an
+   element may only be increased by removing it, changing it, and
+   pushing it again. */
+void
+heap_decrease (struct heap *h, struct heap_elem *e) 
+{
+  if (e == h->root)
+    return;
+  detach (e);
+  h->root = meld (h, h->root, e);
+}
+
+/* Returns the number of elements in H. */
+size_t
+heap_size (const struct heap *h) 
+{
+  return h->size;
+}
+
+/* Returns true if H is empty, false otherwise. */
+bool
+heap_empty (const struct heap *h) 
+{
+  return h->root == NULL;
+}
+
+/* Melds heaps A and B, either of which may be empty, whose roots
+   have no siblings, and returns the root of the result. */
+static struct heap_elem *
+meld (struct heap *h, struct heap_elem *a, struct heap_elem *b) 
+{
+  if (a == NULL)
+    return b;
+  if (b == NULL)
+    return a;
+  if (h->less (b, a, h->aux))
+    {
+      struct heap_elem *t = a;
+      a = b;
+      b = t;
+    }
+
+  /* Make B the first child of A. */
+  b->prev = a;
+  b->next = a->child;
+  if (a->child != NULL)
+    a->child->prev = b;
+  a->child = b;
+  a->next = a->prev = NULL;
+  return a;
+}
+
+/* Melds FIRST and its siblings into one heap, two-pass style, and
+   returns its root. */
+static struct heap_elem *
+merge_pairs (struct heap *h, struct heap_elem *first) 
+{
+  struct heap_elem *pairs = NULL;
+  struct heap_elem *root = NULL;
+
+  /* Meld siblings in pairs, stacking the results on PAIRS. */
+  while (first != NULL)
+    {
+      struct heap_elem *a = first;
+      struct heap_elem *b = a->next;
+
+      first = b != NULL ? b->next : NULL;
+      a->next = a->prev = NULL;
+      if (b != NULL)
+        {
+          b->next = b->prev = NULL;
+          a = meld (h, a, b);
+        }
+      a->next = pairs;
+      pairs = a;
+    }
+
+  /* Meld the pairs, last first. */
+  while (pairs != NULL)
+    {
+      struct heap_elem *next = pairs->next;
+      pairs->next = NULL;
+      root = meld (h, root, pairs);
+      pairs = next;
+    }
+  return root;
+}
+
+/* Unlinks E, which is not a root, from its parent and siblings,
+   keeping its children. */
+static void
+detach (struct heap_elem *e) 
+{
+  if (e->prev->child == e)
+    e->prev->child = e->next;
+  else
+    e->prev->next = e->next;
+  if (e->next != NULL)
+    e->next->prev = e->prev;
+  e->next = e->prev = NULL;
+}
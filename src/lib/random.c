@@ -74,6 +74,37 @@ random_bytes (void *buf_, size_t size)
     }
 }
 
+/* PCG32 multiplier.  See M. E. O'Neill, "PCG: A Family of Simple
+   Fast Space-Efficient Statistically Good Algorithms for Random
+   Number Generation" (2014), and http://www.pcg-random.org/. */
+#define PCG_MULT 6364136223846793005ULL
+
+/* Initializes RS with SEED, choosing stream SEQ. */
+void
+random_state_init (struct random_state *rs, uint64_t seed, uint64_t seq) 
+{
+  rs->state = 0;
+  rs->inc = (seq << 1) | 1;
+  random_next (rs);
+  rs->state += seed;
+  random_next (rs);
+}
+
+/* Returns the next pseudo-random 32-bit number from RS.  Its
+   output is a permutation of the high bits of a 64-bit linear
+   congruential generator: XOR-shifted, then rotated by an amount
+   that the top bits choose. */
+uint32_t
+random_next (struct random_state *rs) 
+{
+  uint64_t old = rs->state;
+  uint32_t xorshifted = ((old >> 18) ^ old) >> 27;
+  uint32_t rot = old >> 59;
+
+  rs->state = old * PCG_MULT + rs->inc;
+  return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
 /* Returns a pseudo-random unsigned long.
    Use random_ulong() % n to obtain a random number in the range
    0...n (exclusive). */
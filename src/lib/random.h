@@ -2,9 +2,24 @@
 #define __LIB_RANDOM_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 void random_init (unsigned seed);
 void random_bytes (void *, size_t);
 unsigned long random_ulong (void);
 
+/* A PCG32 generator, whose state belongs to its caller rather than
+   being shared like the RC4 state behind the functions above.  It
+   produces a 32-bit word per call in a few instructions.  Two
+   generators with the same seed but different sequence numbers
+   produce unrelated streams. */
+struct random_state
+  {
+    uint64_t state;             /* Current state. */
+    uint64_t inc;               /* Increment; always odd. */
+  };
+
+void random_state_init (struct random_state *, uint64_t seed, uint64_t seq);
+uint32_t random_next (struct random_state *);
+
 #endif /* lib/random.h */
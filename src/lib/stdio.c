@@ -14,6 +14,11 @@ struct vsnprintf_aux
   };
 
 static void vsnprintf_helper (char, void *);
+static void vsnprintf_put (struct vsnprintf_aux *, const char *, size_t);
+static char *format_unsigned (char *end, unsigned value, unsigned base);
+static const char *format_conversion (const char *format, va_list *,
+                                      void (*output) (char, void *),
+                                      void *aux);
 
 /* Like vprintf(), except that output is stored into BUFFER,
    which must have space for BUF_SIZE characters.  Writes at most
@@ -21,7 +26,12 @@ static void vsnprintf_helper (char, void *);
    terminator.  BUFFER will always be null-terminated unless
    BUF_SIZE is zero.  Returns the number of characters that would
    have been written to BUFFER, not including a null terminator,
-   had there been enough room. */
+   had there been enough room.
+
+   Runs of literal text and plain %d, %u, %x, %s, and %p
+   conversions, with no flags, width, precision, or size, are
+   copied straight into BUFFER.  Anything else is left to
+   __vprintf(), one character at a time, from there on. */
 int
 vsnprintf (char *buffer, size_t buf_size, const char *format, va_list args) 
 {
@@ -31,8 +41,74 @@ vsnprintf (char *buffer, size_t buf_size, const char *format, va_list args)
   aux.length = 0;
   aux.max_length = buf_size > 0 ? buf_size - 1 : 0;
 
-  /* Do most of the work. */
-  __vprintf (format, args, vsnprintf_helper, &aux);
+  for (;;)
+    {
+      const char *start = format;
+      char buf[16], *end = buf + sizeof buf, *cp;
+
+      while (*format != '\0' && *format != '%')
+        format++;
+      vsnprintf_put (&aux, start, format - start);
+      if (*format == '\0')
+        break;
+
+      switch (format[1])
+        {
+        case 'd':
+          {
+            int value = va_arg (args, int);
+            unsigned magnitude = value;
+            cp = format_unsigned (end, value < 0 ? -magnitude : magnitude, 10);
+            if (value < 0)
+              *--cp = '-';
+            vsnprintf_put (&aux, cp, end - cp);
+          }
+          break;
+
+        case 'u':
+        case 'x':
+          cp = format_unsigned (end, va_arg (args, unsigned),
+                                format[1] == 'u' ? 10 : 16);
+          vsnprintf_put (&aux, cp, end - cp);
+          break;
+
+        case 'p':
+          {
+            /* Same as %#x, so a null pointer is just "0". */
+            uintptr_t value = (uintptr_t) va_arg (args, void *);
+            cp = format_unsigned (end, value, 16);
+            if (value != 0)
+              {
+                *--cp = 'x';
+                *--cp = '0';
+              }
+            vsnprintf_put (&aux, cp, end - cp);
+          }
+          break;
+
+        case 's':
+          {
+            const char *s = va_arg (args, char *);
+            if (s == NULL)
+              s = "(null)";
+            vsnprintf_put (&aux, s, strlen (s));
+          }
+          break;
+
+        case '%':
+          vsnprintf_put (&aux, "%", 1);
+          break;
+
+        default:
+          /* Anything else takes the slow way. */
+          format = format_conversion (format + 1, &args,
+                                      vsnprintf_helper, &aux);
+          if (*format != '\0')
+            format++;
+          continue;
+        }
+      format += 2;
+    }
 
   /* Add null terminator. */
   if (buf_size > 0)
@@ -51,6 +127,36 @@ vsnprintf_helper (char ch, void *aux_)
     *aux->p++ = ch;
 }
 
+/* Appends the LENGTH characters at S to the output in AUX, as
+   many as fit. */
+static void
+vsnprintf_put (struct vsnprintf_aux *aux, const char *s, size_t length)
+{
+  if (aux->length < aux->max_length)
+    {
+      size_t room = aux->max_length - aux->length;
+      size_t n = length < room ? length : room;
+      memcpy (aux->p, s, n);
+      aux->p += n;
+    }
+  aux->length += length;
+}
+
+/* Writes VALUE in BASE, 10 or 16, into the bytes just before END
+   and returns a pointer to its first digit.  Unlike
+   format_integer(), divides only 32-bit values. */
+static char *
+format_unsigned (char *end, unsigned value, unsigned base)
+{
+  do
+    {
+      *--end = "0123456789abcdef"[value % base];
+      value /= base;
+    }
+  while (value > 0);
+  return end;
+}
+
 /* Like printf(), except that output is stored into BUFFER,
    which must have space for BUF_SIZE characters.  Writes at most
    BUF_SIZE - 1 characters to BUFFER, followed by a null
@@ -159,8 +265,6 @@ __vprintf (const char *format, va_list args,
 {
   for (; *format != '\0'; format++)
     {
-      struct printf_conversion c;
-
       /* Literally copy non-conversions to output. */
       if (*format != '%') 
         {
@@ -176,160 +280,175 @@ __vprintf (const char *format, va_list args,
           continue;
         }
 
-      /* Parse conversion specifiers. */
-      format = parse_conversion (format, &c, &args);
+      format = format_conversion (format, &args, output, aux);
+    }
+}
 
-      /* Do conversion. */
-      switch (*format) 
-        {
-        case 'd':
-        case 'i': 
-          {
-            /* Signed integer conversions. */
-            intmax_t value;
-            
-            switch (c.type) 
-              {
-              case CHAR: 
-                value = (signed char) va_arg (args, int);
-                break;
-              case SHORT:
-                value = (short) va_arg (args, int);
-                break;
-              case INT:
-                value = va_arg (args, int);
-                break;
-              case INTMAX:
-                value = va_arg (args, intmax_t);
-                break;
-              case LONG:
-                value = va_arg (args, long);
-                break;
-              case LONGLONG:
-                value = va_arg (args, long long);
-                break;
-              case PTRDIFFT:
-                value = va_arg (args, ptrdiff_t);
-                break;
-              case SIZET:
-                value = va_arg (args, size_t);
-                if (value > SIZE_MAX / 2)
-                  value = value - SIZE_MAX - 1;
-                break;
-              default:
-                NOT_REACHED ();
-              }
+/* Formats the conversion whose specification starts at FORMAT,
+   just after its `%', taking its argument from *ARGS.  Writes
+   output to OUTPUT with auxiliary data AUX.  Returns the
+   character in FORMAT that names the conversion. */
+static const char *
+format_conversion (const char *format, va_list *args,
+                   void (*output) (char, void *), void *aux)
+{
+  struct printf_conversion c;
 
-            format_integer (value < 0 ? -value : value,
-                            true, value < 0, &base_d, &c, output, aux);
-          }
-          break;
-          
-        case 'o':
-        case 'u':
-        case 'x':
-        case 'X':
+  /* Parse conversion specifiers. */
+  format = parse_conversion (format, &c, args);
+
+  /* Do conversion. */
+  switch (*format) 
+    {
+    case 'd':
+    case 'i': 
+      {
+        /* Signed integer conversions. */
+        intmax_t value;
+        
+        switch (c.type) 
           {
-            /* Unsigned integer conversions. */
-            uintmax_t value;
-            const struct integer_base *b;
+          case CHAR: 
+            value = (signed char) va_arg (*args, int);
+            break;
+          case SHORT:
+            value = (short) va_arg (*args, int);
+            break;
+          case INT:
+            value = va_arg (*args, int);
+            break;
+          case INTMAX:
+            value = va_arg (*args, intmax_t);
+            break;
+          case LONG:
+            value = va_arg (*args, long);
+            break;
+          case LONGLONG:
+            value = va_arg (*args, long long);
+            break;
+          case PTRDIFFT:
+            value = va_arg (*args, ptrdiff_t);
+            break;
+          case SIZET:
+            value = va_arg (*args, size_t);
+            if (value > SIZE_MAX / 2)
+              value = value - SIZE_MAX - 1;
+            break;
+          default:
+            NOT_REACHED ();
+          }
 
-            switch (c.type) 
-              {
-              case CHAR: 
-                value = (unsigned char) va_arg (args, unsigned);
-                break;
-              case SHORT:
-                value = (unsigned short) va_arg (args, unsigned);
-                break;
-              case INT:
-                value = va_arg (args, unsigned);
-                break;
-              case INTMAX:
-                value = va_arg (args, uintmax_t);
-                break;
-              case LONG:
-                value = va_arg (args, unsigned long);
-                break;
-              case LONGLONG:
-                value = va_arg (args, unsigned long long);
-                break;
-              case PTRDIFFT:
-                value = va_arg (args, ptrdiff_t);
+        format_integer (value < 0 ? -value : value,
+                        true, value < 0, &base_d, &c, output, aux);
+      }
+      break;
+      
+    case 'o':
+    case 'u':
+    case 'x':
+    case 'X':
+      {
+        /* Unsigned integer conversions. */
+        uintmax_t value;
+        const struct integer_base *b;
+
+        switch (c.type) 
+          {
+          case CHAR: 
+            value = (unsigned char) va_arg (*args, unsigned);
+            break;
+          case SHORT:
+            value = (unsigned short) va_arg (*args, unsigned);
+            break;
+          case INT:
+            value = va_arg (*args, unsigned);
+            break;
+          case INTMAX:
+            value = va_arg (*args, uintmax_t);
+            break;
+          case LONG:
+            value = va_arg (*args, unsigned long);
+            break;
+          case LONGLONG:
+            value = va_arg (*args, unsigned long long);
+            break;
+          case PTRDIFFT:
+            value = va_arg (*args, ptrdiff_t);
 #if UINTMAX_MAX != PTRDIFF_MAX
-                value &= ((uintmax_t) PTRDIFF_MAX << 1) | 1;
+            value &= ((uintmax_t) PTRDIFF_MAX << 1) | 1;
 #endif
-                break;
-              case SIZET:
-                value = va_arg (args, size_t);
-                break;
-              default:
-                NOT_REACHED ();
-              }
-
-            switch (*format) 
-              {
-              case 'o': b = &base_o; break;
-              case 'u': b = &base_d; break;
-              case 'x': b = &base_x; break;
-              case 'X': b = &base_X; break;
-              default: NOT_REACHED ();
-              }
-
-            format_integer (value, false, false, b, &c, output, aux);
+            break;
+          case SIZET:
+            value = va_arg (*args, size_t);
+            break;
+          default:
+            NOT_REACHED ();
           }
-          break;
 
-        case 'c': 
+        switch (*format) 
           {
-            /* Treat character as single-character string. */
-            char ch = va_arg (args, int);
-            format_string (&ch, 1, &c, output, aux);
+          case 'o': b = &base_o; break;
+          case 'u': b = &base_d; break;
+          case 'x': b = &base_x; break;
+          case 'X': b = &base_X; break;
+          default: NOT_REACHED ();
           }
-          break;
 
-        case 's':
-          {
-            /* String conversion. */
-            const char *s = va_arg (args, char *);
-            if (s == NULL)
-              s = "(null)";
+        format_integer (value, false, false, b, &c, output, aux);
+      }
+      break;
 
-            /* Limit string length according to precision.
-               Note: if c.precision == -1 then strnlen() will get
-               SIZE_MAX for MAXLEN, which is just what we want. */
-            format_string (s, strnlen (s, c.precision), &c, output, aux);
-          }
-          break;
-          
-        case 'p':
-          {
-            /* Pointer conversion.
-               Format pointers as %#x. */
-            void *p = va_arg (args, void *);
+    case 'c': 
+      {
+        /* Treat character as single-character string. */
+        char ch = va_arg (*args, int);
+        format_string (&ch, 1, &c, output, aux);
+      }
+      break;
 
-            c.flags = POUND;
-            format_integer ((uintptr_t) p, false, false,
-                            &base_x, &c, output, aux);
-          }
-          break;
+    case 's':
+      {
+        /* String conversion. */
+        const char *s = va_arg (*args, char *);
+        if (s == NULL)
+          s = "(null)";
+
+        /* Limit string length according to precision.
+           Note: if c.precision == -1 then strnlen() will get
+           SIZE_MAX for MAXLEN, which is just what we want. */
+        format_string (s, strnlen (s, c.precision), &c, output, aux);
+      }
+      break;
       
-        case 'f':
-        case 'e':
-        case 'E':
-        case 'g':
-        case 'G':
-        case 'n':
-          /* We don't support floating-point arithmetic,
-             and %n can be part of a security hole. */
-          __printf ("<<no %%%c in kernel>>", output, aux, *format);
-          break;
+    case 'p':
+      {
+        /* Pointer conversion.
+           Format pointers as %#x. */
+        void *p = va_arg (*args, void *);
 
-        default:
-          __printf ("<<no %%%c conversion>>", output, aux, *format);
-          break;
-        }
+        c.flags = POUND;
+        format_integer ((uintptr_t) p, false, false,
+                        &base_x, &c, output, aux);
+      }
+      break;
+  
+    case 'f':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'n':
+      /* We don't support floating-point arithmetic,
+         and %n can be part of a security hole. */
+      __printf ("<<no %%%c in kernel>>", output, aux, *format);
+      break;
+
+    default:
+      __printf ("<<no %%%c conversion>>", output, aux, *format);
+      break;
     }
+
+  return format;
 }
 
 /* Parses conversion option characters starting at FORMAT and
@@ -3,6 +3,7 @@
 #include <random.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* Converts a string representation of a signed decimal integer
    in S into an `int', which is returned. */
@@ -52,7 +53,7 @@ compare_thunk (const void *a, const void *b, void *aux)
    using COMPARE.  When COMPARE is passed a pair of elements A
    and B, respectively, it must return a strcmp()-type result,
    i.e. less than zero if A < B, zero if A == B, greater than
-   zero if A > B.  Runs in O(n lg n) time and O(1) space in
+   zero if A > B.  Runs in O(n lg n) time and O(lg n) space in
    CNT. */
 void
 qsort (void *array, size_t cnt, size_t size,
@@ -61,8 +62,13 @@ qsort (void *array, size_t cnt, size_t size,
   sort (array, cnt, size, compare_thunk, &compare);
 }
 
+/* A word that may alias an element of any type. */
+typedef uint32_t __attribute__ ((may_alias)) sort_word;
+
 /* Swaps elements with 1-based indexes A_IDX and B_IDX in ARRAY
-   with elements of SIZE bytes each. */
+   with elements of SIZE bytes each.  Elements made of aligned
+   words, such as ints and pointers, are swapped a word at a
+   time. */
 static void
 do_swap (unsigned char *array, size_t a_idx, size_t b_idx, size_t size)
 {
@@ -70,12 +76,26 @@ do_swap (unsigned char *array, size_t a_idx, size_t b_idx, size_t size)
   unsigned char *b = array + (b_idx - 1) * size;
   size_t i;
 
-  for (i = 0; i < size; i++)
+  if (size % sizeof (sort_word) == 0
+      && ((uintptr_t) a | (uintptr_t) b) % sizeof (sort_word) == 0)
     {
-      unsigned char t = a[i];
-      a[i] = b[i];
-      b[i] = t;
+      sort_word *wa = (sort_word *) a;
+      sort_word *wb = (sort_word *) b;
+
+      for (i = 0; i < size / sizeof (sort_word); i++)
+        {
+          sort_word t = wa[i];
+          wa[i] = wb[i];
+          wb[i] = t;
+        }
     }
+  else
+    for (i = 0; i < size; i++)
+      {
+        unsigned char t = a[i];
+        a[i] = b[i];
+        b[i] = t;
+      }
 }
 
 /* Compares elements with 1-based indexes A_IDX and B_IDX in
@@ -122,33 +142,142 @@ heapify (unsigned char *array, size_t i, size_t cnt, size_t size,
     }
 }
 
+/* Heapsorts ARRAY of CNT elements of SIZE bytes each, using
+   COMPARE to compare elements, passing AUX as auxiliary data. */
+static void
+heap_sort (unsigned char *array, size_t cnt, size_t size,
+           int (*compare) (const void *, const void *, void *aux),
+           void *aux) 
+{
+  size_t i;
+
+  /* Build a heap. */
+  for (i = cnt / 2; i > 0; i--)
+    heapify (array, i, cnt, size, compare, aux);
+
+  /* Sort the heap. */
+  for (i = cnt; i > 1; i--) 
+    {
+      do_swap (array, 1, i, size);
+      heapify (array, 1, i - 1, size, compare, aux); 
+    }
+}
+
+/* Insertion sorts ARRAY of CNT elements of SIZE bytes each,
+   using COMPARE to compare elements, passing AUX as auxiliary
+   data. */
+static void
+insertion_sort (unsigned char *array, size_t cnt, size_t size,
+                int (*compare) (const void *, const void *, void *aux),
+                void *aux) 
+{
+  size_t i, j;
+
+  for (i = 2; i <= cnt; i++)
+    for (j = i; j > 1 && do_compare (array, j - 1, j, size,
+                                     compare, aux) > 0; j--)
+      do_swap (array, j - 1, j, size);
+}
+
+/* Partitions no larger than this are insertion sorted. */
+#define INSERTION_SORT_MAX 12
+
+/* Quicksorts ARRAY of CNT elements of SIZE bytes each, using
+   COMPARE to compare elements, passing AUX as auxiliary data.
+   After DEPTH levels of partitioning, which good pivots never
+   need, heapsorts what is left instead, so that the worst case
+   stays O(n lg n). */
+static void
+intro_sort (unsigned char *array, size_t cnt, size_t size,
+            int (*compare) (const void *, const void *, void *aux),
+            void *aux, unsigned depth) 
+{
+  while (cnt > INSERTION_SORT_MAX)
+    {
+      size_t mid = cnt / 2 + 1;
+      size_t i, j;
+
+      if (depth-- == 0)
+        {
+          heap_sort (array, cnt, size, compare, aux);
+          return;
+        }
+
+      /* Order the first, middle, and last elements, then take
+         their median as the pivot, in element 1.  The last
+         element, no less than the pivot, stops the scan up. */
+      if (do_compare (array, mid, 1, size, compare, aux) < 0)
+        do_swap (array, mid, 1, size);
+      if (do_compare (array, cnt, mid, size, compare, aux) < 0)
+        {
+          do_swap (array, cnt, mid, size);
+          if (do_compare (array, mid, 1, size, compare, aux) < 0)
+            do_swap (array, mid, 1, size);
+        }
+      do_swap (array, 1, mid, size);
+
+      /* Partition around the pivot.  Both scans stop at elements
+         equal to it, which keeps runs of equal elements from
+         making the partitions lopsided. */
+      i = 1;
+      j = cnt;
+      for (;;)
+        {
+          do
+            i++;
+          while (do_compare (array, i, 1, size, compare, aux) < 0);
+          do
+            j--;
+          while (do_compare (array, j, 1, size, compare, aux) > 0);
+          if (i >= j)
+            break;
+          do_swap (array, i, j, size);
+        }
+      do_swap (array, 1, j, size);
+
+      /* Recurse on the smaller side and loop on the larger, so
+         that the stack stays O(lg n) deep. */
+      if (j - 1 < cnt - j)
+        {
+          intro_sort (array, j - 1, size, compare, aux, depth);
+          array += j * size;
+          cnt -= j;
+        }
+      else
+        {
+          intro_sort (array + j * size, cnt - j, size, compare, aux, depth);
+          cnt = j - 1;
+        }
+    }
+  insertion_sort (array, cnt, size, compare, aux);
+}
+
 /* Sorts ARRAY, which contains CNT elements of SIZE bytes each,
    using COMPARE to compare elements, passing AUX as auxiliary
    data.  When COMPARE is passed a pair of elements A and B,
    respectively, it must return a strcmp()-type result, i.e. less
    than zero if A < B, zero if A == B, greater than zero if A >
-   B.  Runs in O(n lg n) time and O(1) space in CNT. */
+   B.  Runs in O(n lg n) time and O(lg n) space in CNT.
+
+   This is an introsort: quicksort with median-of-three pivots,
+   insertion sort for small partitions, and heapsort for any
+   partition that quicksort has split too many times. */
 void
 sort (void *array, size_t cnt, size_t size,
       int (*compare) (const void *, const void *, void *aux),
       void *aux) 
 {
-  size_t i;
+  unsigned depth = 0;
+  size_t n;
 
   ASSERT (array != NULL || cnt == 0);
   ASSERT (compare != NULL);
   ASSERT (size > 0);
 
-  /* Build a heap. */
-  for (i = cnt / 2; i > 0; i--)
-    heapify (array, i, cnt, size, compare, aux);
-
-  /* Sort the heap. */
-  for (i = cnt; i > 1; i--) 
-    {
-      do_swap (array, 1, i, size);
-      heapify (array, 1, i - 1, size, compare, aux); 
-    }
+  /* Allow 2 lg CNT levels of partitioning. */
+  for (n = cnt; n > 1; n /= 2)
+    depth += 2;
+  intro_sort (array, cnt, size, compare, aux, depth);
 }
 
 /* Searches ARRAY, which contains CNT elements of SIZE bytes
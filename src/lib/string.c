@@ -1,5 +1,20 @@
 #include <string.h>
 #include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Blocks at least this long are handled a word at a time with
+   the x86 string instructions, after byte steps up to a word
+   boundary.  Shorter ones aren't worth the setup. */
+#define WORD_MIN 16
+
+/* Strings are scanned a word at a time once aligned.  An aligned
+   word never straddles a page, so reading all of the word that
+   holds a string's null terminator is safe.  HAS_ZERO(W) is
+   nonzero if any byte of W is zero. */
+typedef uint32_t __attribute__ ((may_alias)) str_word;
+#define ONES 0x01010101u
+#define HAS_ZERO(W) (((W) - ONES) & ~(W) & (ONES << 7))
 
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
@@ -12,6 +27,17 @@ memcpy (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
+  if (size >= WORD_MIN && (((uintptr_t) dst ^ (uintptr_t) src) & 3) == 0)
+    {
+      size_t words;
+
+      for (; (uintptr_t) dst & 3; size--)
+        *dst++ = *src++;
+      words = size / 4;
+      size %= 4;
+      asm volatile ("rep movsl"
+                    : "+D" (dst), "+S" (src), "+c" (words) : : "memory");
+    }
   while (size-- > 0)
     *dst++ = *src++;
 
@@ -58,6 +84,25 @@ memcmp (const void *a_, const void *b_, size_t size)
   ASSERT (a != NULL || size == 0);
   ASSERT (b != NULL || size == 0);
 
+  if (size >= WORD_MIN)
+    {
+      /* Skip the equal leading words; if a word differs, back up
+         to it and let the byte loop find the differing byte. */
+      size_t words = size / 4;
+      size_t left = words;
+      bool differ;
+
+      asm ("repe cmpsl; setne %0"
+           : "=q" (differ), "+S" (a), "+D" (b), "+c" (left)
+           : : "cc", "memory");
+      if (differ)
+        {
+          a -= 4;
+          b -= 4;
+          left++;
+        }
+      size -= (words - left) * 4;
+    }
   for (; size-- > 0; a++, b++)
     if (*a != *b)
       return *a > *b ? +1 : -1;
@@ -78,6 +123,21 @@ strcmp (const char *a_, const char *b_)
   ASSERT (a != NULL);
   ASSERT (b != NULL);
 
+  /* If A and B are equally aligned, skip the equal leading words
+     that hold no null terminator. */
+  if ((((uintptr_t) a ^ (uintptr_t) b) & 3) == 0)
+    {
+      for (; (uintptr_t) a & 3; a++, b++)
+        if (*a == '\0' || *a != *b)
+          return *a < *b ? -1 : *a > *b;
+      while (*(const str_word *) a == *(const str_word *) b
+             && !HAS_ZERO (*(const str_word *) a))
+        {
+          a += 4;
+          b += 4;
+        }
+    }
+
   while (*a != '\0' && *a == *b) 
     {
       a++;
@@ -98,6 +158,12 @@ memchr (const void *block_, int ch_, size_t size)
 
   ASSERT (block != NULL || size == 0);
 
+  for (; size > 0 && (uintptr_t) block & 3; size--, block++)
+    if (*block == ch)
+      return (void *) block;
+  for (; size >= 4; size -= 4, block += 4)
+    if (HAS_ZERO (*(const str_word *) block ^ (ch * ONES)))
+      break;
   for (; size-- > 0; block++)
     if (*block == ch)
       return (void *) block;
@@ -113,9 +179,22 @@ char *
 strchr (const char *string, int c_) 
 {
   char c = c_;
+  uint32_t pattern = (unsigned char) c * ONES;
 
   ASSERT (string != NULL);
 
+  for (; (uintptr_t) string & 3; string++)
+    if (*string == c)
+      return (char *) string;
+    else if (*string == '\0')
+      return NULL;
+  for (;; string += 4)
+    {
+      str_word w = *(const str_word *) string;
+      if (HAS_ZERO (w) || HAS_ZERO (w ^ pattern))
+        break;
+    }
+
   for (;;) 
     if (*string == c)
       return (char *) string;
@@ -281,7 +360,19 @@ memset (void *dst_, int value, size_t size)
   unsigned char *dst = dst_;
 
   ASSERT (dst != NULL || size == 0);
-  
+
+  if (size >= WORD_MIN)
+    {
+      uint32_t word = (unsigned char) value * 0x01010101u;
+      size_t words;
+
+      for (; (uintptr_t) dst & 3; size--)
+        *dst++ = value;
+      words = size / 4;
+      size %= 4;
+      asm volatile ("rep stosl"
+                    : "+D" (dst), "+c" (words) : "a" (word) : "memory");
+    }
   while (size-- > 0)
     *dst++ = value;
 
@@ -296,8 +387,13 @@ strlen (const char *string)
 
   ASSERT (string != NULL);
 
-  for (p = string; *p != '\0'; p++)
-    continue;
+  for (p = string; (uintptr_t) p & 3; p++)
+    if (*p == '\0')
+      return p - string;
+  while (!HAS_ZERO (*(const str_word *) p))
+    p += 4;
+  while (*p != '\0')
+    p++;
   return p - string;
 }
 
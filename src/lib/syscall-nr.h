@@ -31,7 +31,51 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_MADVISE,                /* Give paging advice for a mapping. */
+    SYS_VMSTAT,                 /* Get paging statistics. */
+    SYS_READV,                  /* Read a file into several buffers. */
+    SYS_WRITEV,                 /* Write several buffers to a file. */
+    SYS_PREAD,                  /* Read from a file at an offset. */
+    SYS_PWRITE,                 /* Write to a file at an offset. */
+    SYS_FORK,                   /* Duplicate the calling process. */
+    SYS_WAITPID,                /* Wait for a child, optionally any. */
+    SYS_THREAD_CREATE,          /* Start a thread in this process. */
+    SYS_THREAD_JOIN,            /* Wait for a thread to exit. */
+    SYS_THREAD_EXIT,            /* End the calling thread. */
+    SYS_FUTEX_WAIT,             /* Sleep while an int holds a value. */
+    SYS_FUTEX_WAKE,             /* Wake threads sleeping on an int. */
+    SYS_FALLOCATE,              /* Allocate a file's sectors up front. */
+    SYS_FSYNC,                  /* Write a file's data to disk. */
+    SYS_SYNC,                   /* Write all file data to disk. */
+    SYS_TICKS,                  /* Timer ticks since boot. */
+    SYS_CLOCK_GETTIME,          /* Time since boot, in nanoseconds. */
+    SYS_SCHED_SETDEADLINE,      /* Reserve CPU time every period. */
+    SYS_SCHED_SETAFFINITY,      /* Restrict a thread to some CPUs. */
+    SYS_CPU_GROUP_CREATE,       /* Create a CPU quota group. */
+    SYS_CPU_GROUP_JOIN,         /* Move a thread into a quota group. */
+    SYS_PIPE,                   /* Create a pipe. */
+    SYS_SHM_CREATE,             /* Create a shared-memory segment. */
+    SYS_SHM_MAP,                /* Map a shared-memory segment. */
+    SYS_SHM_UNMAP,              /* Unmap a shared-memory segment. */
+    SYS_POLL,                   /* Wait for any of several fds. */
+    SYS_SENDFILE,               /* Copy between fds in the kernel. */
+    SYS_SIGRETURN,              /* Return from a signal handler. */
+    SYS_EXECV,                  /* Start a process with an argv[]. */
+    SYS_SPAWN,                  /* Start a process with some fds. */
+    SYS_SETRLIMIT,              /* Set a resource limit. */
+    SYS_GETRLIMIT,              /* Get a resource limit. */
+    SYS_SBRK,                   /* Move the end of the heap. */
+    SYS_GETDENTS,               /* Read many directory entries. */
+    SYS_RING_SETUP,             /* Map an asynchronous I/O ring. */
+    SYS_RING_ENTER,             /* Submit to and wait on the ring. */
+    SYS_CLONE_FILE,             /* Copy a file by sharing its sectors. */
+    SYS_TRUNCATE,               /* Set the length of a named file. */
+    SYS_FTRUNCATE,              /* Set the length of an open file. */
+    SYS_MEMSTAT,                /* Get kernel memory usage. */
+    SYS_GETRUSAGE               /* Get CPU time and other usage. */
   };
 
 #endif /* lib/syscall-nr.h */
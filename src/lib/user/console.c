@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <syscall.h>
 #include <syscall-nr.h>
@@ -25,13 +26,86 @@ hprintf (int handle, const char *format, ...)
   return retval;
 }
 
+/* Standard output buffer. */
+static char stdout_default[BUFSIZ];
+static char *stdout_buf = stdout_default;
+static size_t stdout_size = sizeof stdout_default;
+static char *stdout_alloc;      /* stdout_buf if from stdout_setvbuf(). */
+static size_t stdout_len;       /* Bytes waiting in stdout_buf. */
+static int stdout_mode = -1;    /* Buffering mode, -1 until first use. */
+
+/* Adds C to the standard output buffer, writing the buffer out
+   when it fills or, if line buffered, at a new-line. */
+static void
+stdout_putc (char c)
+{
+  /* The console has no size; files and pipes do. */
+  if (stdout_mode < 0)
+    stdout_mode = filesize (STDOUT_FILENO) < 0 ? _IOLBF : _IOFBF;
+
+  stdout_buf[stdout_len++] = c;
+  if (stdout_len >= stdout_size || (c == '\n' && stdout_mode == _IOLBF))
+    stdout_flush ();
+}
+
+/* Ends a call that wrote to standard output. */
+static void
+stdout_done (void)
+{
+  if (stdout_mode == _IONBF)
+    stdout_flush ();
+}
+
+/* Writes out whatever is in the standard output buffer. */
+void
+stdout_flush (void)
+{
+  size_t len = stdout_len;
+
+  /* write() flushes first, so empty the buffer before calling it. */
+  stdout_len = 0;
+  if (len > 0)
+    write (STDOUT_FILENO, stdout_buf, len);
+}
+
+/* Sets the buffering MODE of standard output, one of _IOFBF,
+   _IOLBF, or _IONBF, and its buffer to the SIZE bytes at BUF.  If
+   BUF is null, a buffer of SIZE bytes is allocated.  Returns 0 if
+   successful, -1 on failure. */
+int
+stdout_setvbuf (char *buf, int mode, size_t size)
+{
+  char *alloc = NULL;
+
+  if ((mode != _IOFBF && mode != _IOLBF && mode != _IONBF) || size == 0)
+    return -1;
+  if (buf == NULL && size <= sizeof stdout_default)
+    buf = stdout_default;
+  else if (buf == NULL)
+    {
+      buf = alloc = malloc (size);
+      if (buf == NULL)
+        return -1;
+    }
+
+  stdout_flush ();
+  free (stdout_alloc);
+  stdout_alloc = alloc;
+  stdout_buf = buf;
+  stdout_size = size;
+  stdout_mode = mode;
+  return 0;
+}
+
 /* Writes string S to the console, followed by a new-line
    character. */
 int
 puts (const char *s) 
 {
-  write (STDOUT_FILENO, s, strlen (s));
-  putchar ('\n');
+  while (*s != '\0')
+    stdout_putc (*s++);
+  stdout_putc ('\n');
+  stdout_done ();
 
   return 0;
 }
@@ -40,11 +114,11 @@ puts (const char *s)
 int
 putchar (int c) 
 {
-  char c2 = c;
-  write (STDOUT_FILENO, &c2, 1);
+  stdout_putc (c);
+  stdout_done ();
   return c;
 }
-
+
 /* Auxiliary data for vhprintf_helper(). */
 struct vhprintf_aux 
   {
@@ -55,11 +129,12 @@ struct vhprintf_aux
   };
 
 static void add_char (char, void *);
+static void add_stdout_char (char, void *);
 static void flush (struct vhprintf_aux *);
 
 /* Formats the printf() format specification FORMAT with
    arguments given in ARGS and writes the output to the given
-   HANDLE. */
+   HANDLE.  Output to standard output goes through its buffer. */
 int
 vhprintf (int handle, const char *format, va_list args) 
 {
@@ -67,8 +142,16 @@ vhprintf (int handle, const char *format, va_list args)
   aux.p = aux.buf;
   aux.char_cnt = 0;
   aux.handle = handle;
-  __vprintf (format, args, add_char, &aux);
-  flush (&aux);
+  if (handle == STDOUT_FILENO)
+    {
+      __vprintf (format, args, add_stdout_char, &aux);
+      stdout_done ();
+    }
+  else
+    {
+      __vprintf (format, args, add_char, &aux);
+      flush (&aux);
+    }
   return aux.char_cnt;
 }
 
@@ -84,6 +167,15 @@ add_char (char c, void *aux_)
   aux->char_cnt++;
 }
 
+/* Adds C to the standard output buffer and counts it in AUX. */
+static void
+add_stdout_char (char c, void *aux_) 
+{
+  struct vhprintf_aux *aux = aux_;
+  stdout_putc (c);
+  aux->char_cnt++;
+}
+
 /* Flushes the buffer in AUX. */
 static void
 flush (struct vhprintf_aux *aux)
@@ -0,0 +1,492 @@
+#include "gthread.h"
+#include <debug.h>
+#include <round.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <syscall.h>
+
+/* Each green thread lives in an aligned block of GTHREAD_SIZE
+   bytes: its struct gthread at the bottom and its stack growing
+   down from the top, as kernel threads do.  So gthread_self() is
+   just the stack pointer rounded down, and no thread-local storage
+   is needed.  Blocks come from the heap STACK_BATCH at a time and
+   are never given back; exited threads' blocks are reused. */
+#define GTHREAD_SIZE (16 * 1024)
+#define STACK_BATCH 8
+#define GTHREAD_MAGIC 0x6e8d2a51
+
+/* How long, in milliseconds, a worker with nothing to run polls
+   for I/O while other green threads may still become ready. */
+#define POLL_MS 10
+
+/* What a green thread asks of its worker when it switches away. */
+enum gthread_state
+  {
+    GTHREAD_RUNNING,            /* Running on its worker. */
+    GTHREAD_YIELDING,           /* Put it back on the run queue. */
+    GTHREAD_PARKING,            /* Wait for its descriptor. */
+    GTHREAD_EXITING             /* Reclaim it. */
+  };
+
+/* A green thread. */
+struct gthread
+  {
+    uint32_t *esp;              /* Saved stack pointer while switched out. */
+    enum gthread_state state;
+    void (*func) (void *);      /* Function to run, */
+    void *aux;                  /* ...and its argument. */
+    struct worker *worker;      /* Worker running it. */
+    struct gthread *next;       /* In a run queue, io_head, or the cache. */
+    struct pollfd pfd;          /* What it waits for while parked. */
+    unsigned magic;             /* Detects stack overflow. */
+  };
+
+/* A kernel thread that runs green threads. */
+struct worker
+  {
+    int lock;                   /* Spinlock for the run queue. */
+    struct gthread *head;       /* Run queue, taken from the front. */
+    struct gthread *tail;
+    uint32_t *esp;              /* Saved stack pointer while a green
+                                   thread runs. */
+    uthread_t tid;              /* Its user thread. */
+  };
+
+static struct worker workers[GTHREAD_MAX_WORKERS];
+static int worker_cnt;
+
+static int live_cnt;            /* Green threads not yet exited. */
+
+/* Parked green threads and their count, under io_lock.  One
+   worker at a time, the one that set `polling', waits for them. */
+static int io_lock;
+static struct gthread *io_head, *io_tail;
+static int io_cnt;
+static int polling;
+
+/* Idle workers wait on idle_seq, which is bumped to wake them. */
+static int idle_seq;
+static int sleeper_cnt;
+
+/* Thread blocks not in use, under cache_lock. */
+static int cache_lock;
+static struct gthread *cache;
+
+void gthread_switch (uint32_t **old_esp, uint32_t *new_esp);
+static void gthread_start (void);
+
+/* Saves the callee-saved registers and stack pointer in *OLD_ESP
+   and resumes the context saved in NEW_ESP. */
+static void __attribute__ ((used))
+define_gthread_switch (void)
+{
+  asm volatile (".pushsection .text\n"
+                "gthread_switch:\n"
+                "  movl 4(%esp), %eax\n"
+                "  movl 8(%esp), %edx\n"
+                "  pushl %ebp\n"
+                "  pushl %ebx\n"
+                "  pushl %esi\n"
+                "  pushl %edi\n"
+                "  movl %esp, (%eax)\n"
+                "  movl %edx, %esp\n"
+                "  popl %edi\n"
+                "  popl %esi\n"
+                "  popl %ebx\n"
+                "  popl %ebp\n"
+                "  ret\n"
+                ".popsection");
+}
+
+/* Acquires spinlock L.  The holder may be a preempted worker, so
+   give up the CPU rather than spin for a whole time slice. */
+static void
+spin_lock (int *l)
+{
+  while (__sync_lock_test_and_set (l, 1))
+    while (*(volatile int *) l)
+      sched_yield ();
+}
+
+/* Releases spinlock L. */
+static void
+spin_unlock (int *l)
+{
+  __sync_lock_release (l);
+}
+
+/* Returns the running green thread. */
+static struct gthread *
+gthread_self (void)
+{
+  uint32_t esp;
+  struct gthread *g;
+
+  asm ("movl %%esp, %0" : "=g" (esp));
+  g = (struct gthread *) ROUND_DOWN (esp, GTHREAD_SIZE);
+  ASSERT (g->magic == GTHREAD_MAGIC);
+  return g;
+}
+
+/* Returns a thread block, or a null pointer if the heap cannot
+   grow. */
+static struct gthread *
+alloc_gthread (void)
+{
+  struct gthread *g;
+
+  spin_lock (&cache_lock);
+  if (cache == NULL)
+    {
+      /* One extra block's worth of address space leaves room to
+         align; it is never touched. */
+      uint8_t *p = sbrk ((STACK_BATCH + 1) * GTHREAD_SIZE);
+      int i;
+
+      if (p != (void *) -1)
+        {
+          p = (uint8_t *) ROUND_UP ((uintptr_t) p, GTHREAD_SIZE);
+          for (i = 0; i < STACK_BATCH; i++, p += GTHREAD_SIZE)
+            {
+              g = (struct gthread *) p;
+              g->next = cache;
+              cache = g;
+            }
+        }
+    }
+  g = cache;
+  if (g != NULL)
+    cache = g->next;
+  spin_unlock (&cache_lock);
+  return g;
+}
+
+/* Returns G's block to the cache. */
+static void
+free_gthread (struct gthread *g)
+{
+  g->magic = 0;
+  spin_lock (&cache_lock);
+  g->next = cache;
+  cache = g;
+  spin_unlock (&cache_lock);
+}
+
+/* Wakes up to CNT idle workers. */
+static void
+wake_idle (int cnt)
+{
+  if (sleeper_cnt > 0)
+    {
+      __sync_fetch_and_add (&idle_seq, 1);
+      futex_wake (&idle_seq, cnt);
+    }
+}
+
+/* Adds G to the back of W's run queue. */
+static void
+push_ready (struct worker *w, struct gthread *g)
+{
+  g->next = NULL;
+  spin_lock (&w->lock);
+  if (w->head == NULL)
+    w->head = g;
+  else
+    w->tail->next = g;
+  w->tail = g;
+  spin_unlock (&w->lock);
+  wake_idle (1);
+}
+
+/* Removes and returns the front of W's run queue, or a null
+   pointer if it is empty. */
+static struct gthread *
+pop_ready (struct worker *w)
+{
+  struct gthread *g;
+
+  if (w->head == NULL)
+    return NULL;
+  spin_lock (&w->lock);
+  g = w->head;
+  if (g != NULL)
+    w->head = g->next;
+  spin_unlock (&w->lock);
+  return g;
+}
+
+/* Returns a green thread for W to run: its own oldest, or else
+   one taken from another worker, or a null pointer. */
+static struct gthread *
+take_work (struct worker *w)
+{
+  struct gthread *g = pop_ready (w);
+  int i;
+
+  for (i = 1; g == NULL && i < worker_cnt; i++)
+    g = pop_ready (&workers[(w - workers + i) % worker_cnt]);
+  return g;
+}
+
+/* Parks G until its descriptor is ready. */
+static void
+park (struct gthread *g)
+{
+  g->next = NULL;
+  spin_lock (&io_lock);
+  if (io_head == NULL)
+    io_head = g;
+  else
+    io_tail->next = g;
+  io_tail = g;
+  spin_unlock (&io_lock);
+  __sync_fetch_and_add (&io_cnt, 1);
+}
+
+/* Polls up to POLL_MAX parked green threads for TIMEOUT_MS and
+   moves the ready ones to W's run queue.  Returns false if another
+   worker is polling already. */
+static bool
+poll_io (struct worker *w, int timeout_ms)
+{
+  struct gthread *g[POLL_MAX];
+  struct pollfd pfds[POLL_MAX];
+  int cnt, i;
+
+  if (__sync_lock_test_and_set (&polling, 1))
+    return false;
+
+  spin_lock (&io_lock);
+  for (cnt = 0; cnt < POLL_MAX && io_head != NULL; cnt++)
+    {
+      g[cnt] = io_head;
+      io_head = io_head->next;
+      pfds[cnt] = g[cnt]->pfd;
+    }
+  spin_unlock (&io_lock);
+
+  if (cnt > 0)
+    poll (pfds, cnt, timeout_ms);
+
+  for (i = 0; i < cnt; i++)
+    {
+      __sync_fetch_and_sub (&io_cnt, 1);
+      if (pfds[i].revents != 0)
+        {
+          g[i]->pfd.revents = pfds[i].revents;
+          push_ready (w, g[i]);
+        }
+      else
+        park (g[i]);
+    }
+  __sync_lock_release (&polling);
+  return true;
+}
+
+/* Waits until W might have something to do. */
+static void
+idle (struct worker *w)
+{
+  int seq = idle_seq;
+  int i;
+
+  /* Poll parked threads.  A lone worker whose threads are all
+     parked and polled at once can wait in poll() for as long as it
+     takes; otherwise, a thread may become ready meanwhile, here or
+     among the parked threads left out. */
+  if (io_cnt > 0)
+    {
+      int timeout = (worker_cnt == 1 && io_cnt == live_cnt
+                     && io_cnt <= POLL_MAX) ? -1 : POLL_MS;
+      if (poll_io (w, timeout))
+        return;
+    }
+
+  /* Sleep until a run queue gets a thread.  Counting ourselves
+     before checking means a pusher that comes after the check
+     bumps idle_seq, so futex_wait() returns at once. */
+  __sync_fetch_and_add (&sleeper_cnt, 1);
+  for (i = 0; i < worker_cnt; i++)
+    if (workers[i].head != NULL)
+      break;
+  if (i == worker_cnt && live_cnt > 0 && io_cnt == 0)
+    futex_wait (&idle_seq, seq);
+  else if (i == worker_cnt && live_cnt > 0)
+    sched_yield ();             /* Another worker is polling. */
+  __sync_fetch_and_sub (&sleeper_cnt, 1);
+}
+
+/* Runs green threads on W until all of them have exited. */
+static void
+worker_loop (struct worker *w)
+{
+  while (live_cnt > 0)
+    {
+      struct gthread *g = take_work (w);
+
+      if (g == NULL)
+        {
+          idle (w);
+          continue;
+        }
+
+      ASSERT (g->magic == GTHREAD_MAGIC);
+      g->worker = w;
+      g->state = GTHREAD_RUNNING;
+      gthread_switch (&w->esp, g->esp);
+
+      /* G is off its stack now, so it is safe to queue, park, or
+         reuse it. */
+      switch (g->state)
+        {
+        case GTHREAD_YIELDING:
+          push_ready (w, g);
+          break;
+        case GTHREAD_PARKING:
+          park (g);
+          break;
+        case GTHREAD_EXITING:
+          free_gthread (g);
+          if (__sync_sub_and_fetch (&live_cnt, 1) == 0)
+            wake_idle (GTHREAD_MAX_WORKERS);
+          break;
+        default:
+          NOT_REACHED ();
+        }
+    }
+}
+
+/* Where a worker's user thread starts. */
+static void
+worker_start (void *w)
+{
+  worker_loop (w);
+}
+
+/* Switches from the running green thread back to its worker,
+   asking it for STATE. */
+static void
+schedule (enum gthread_state state)
+{
+  struct gthread *g = gthread_self ();
+
+  g->state = state;
+  gthread_switch (&g->esp, g->worker->esp);
+}
+
+/* Where a new green thread starts. */
+static void
+gthread_start (void)
+{
+  struct gthread *g = gthread_self ();
+
+  g->func (g->aux);
+  gthread_exit ();
+}
+
+/* Makes a green thread that runs FUNC(AUX) and queues it on W.
+   Returns false if memory is not available. */
+static bool
+create_on (struct worker *w, void (*func) (void *), void *aux)
+{
+  struct gthread *g = alloc_gthread ();
+  uint32_t *esp;
+
+  if (g == NULL)
+    return false;
+  g->func = func;
+  g->aux = aux;
+  g->magic = GTHREAD_MAGIC;
+
+  /* Frame for gthread_switch() to "return" into gthread_start():
+     four zeroed registers, then the return address, then a fake
+     return address for gthread_start() itself. */
+  esp = (uint32_t *) ((uint8_t *) g + GTHREAD_SIZE);
+  *--esp = 0;
+  *--esp = (uint32_t) gthread_start;
+  esp -= 4;
+  esp[0] = esp[1] = esp[2] = esp[3] = 0;
+  g->esp = esp;
+
+  __sync_fetch_and_add (&live_cnt, 1);
+  push_ready (w, g);
+  return true;
+}
+
+/* Runs FUNC(AUX) as a green thread, and any that it creates, on
+   WORKER_CNT kernel threads: the caller's and WORKER_CNT - 1 new
+   ones.  Returns once all of them have exited. */
+void
+gthread_run (int worker_cnt_, void (*func) (void *), void *aux)
+{
+  int i;
+
+  ASSERT (worker_cnt_ >= 1 && worker_cnt_ <= GTHREAD_MAX_WORKERS);
+  ASSERT (live_cnt == 0);
+
+  worker_cnt = worker_cnt_;
+  if (!create_on (&workers[0], func, aux))
+    return;
+  for (i = 1; i < worker_cnt; i++)
+    workers[i].tid = uthread_create (worker_start, &workers[i]);
+
+  worker_loop (&workers[0]);
+  for (i = 1; i < worker_cnt; i++)
+    if (workers[i].tid != UTHREAD_ERROR)
+      uthread_join (workers[i].tid);
+}
+
+/* Makes a green thread that runs FUNC(AUX).  Returns false if
+   memory is not available. */
+bool
+gthread_create (void (*func) (void *), void *aux)
+{
+  return create_on (gthread_self ()->worker, func, aux);
+}
+
+/* Lets other green threads run. */
+void
+gthread_yield (void)
+{
+  schedule (GTHREAD_YIELDING);
+}
+
+/* Ends the running green thread. */
+void
+gthread_exit (void)
+{
+  schedule (GTHREAD_EXITING);
+  NOT_REACHED ();
+}
+
+/* Waits, without blocking the worker, until FD is ready for any
+   of EVENTS, as for poll().  Returns the events that are ready. */
+int
+gthread_poll (int fd, short events)
+{
+  struct gthread *g = gthread_self ();
+
+  g->pfd.fd = fd;
+  g->pfd.events = events;
+  g->pfd.revents = 0;
+  if (poll (&g->pfd, 1, 0) == 0)
+    schedule (GTHREAD_PARKING);
+  return g->pfd.revents;
+}
+
+/* Like read(), but waits for data without blocking the worker. */
+int
+gthread_read (int fd, void *buffer, unsigned size)
+{
+  gthread_poll (fd, POLLIN);
+  return read (fd, buffer, size);
+}
+
+/* Like write(), but waits for room without blocking the
+   worker. */
+int
+gthread_write (int fd, const void *buffer, unsigned size)
+{
+  gthread_poll (fd, POLLOUT);
+  return write (fd, buffer, size);
+}
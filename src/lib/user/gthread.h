@@ -0,0 +1,35 @@
+#ifndef __LIB_USER_GTHREAD_H
+#define __LIB_USER_GTHREAD_H
+
+#include <debug.h>
+#include <stdbool.h>
+
+/* Green threads: many cheap threads run by a few kernel threads.
+
+   gthread_run() starts WORKER_CNT workers, each a user thread from
+   uthread_create(), runs FUNC(AUX) as the first green thread, and
+   returns once every green thread has exited.  Green threads
+   switch in user mode, without a system call, and each one costs
+   only a 16 kB stack on the heap, whose untouched pages take no
+   memory.  A worker that runs out of green threads takes some from
+   the others.
+
+   A green thread that reads or writes a pipe or the console with
+   gthread_read() or gthread_write() waits for it without blocking
+   its worker: it is set aside until poll() finds its descriptor
+   ready, while the worker runs other green threads.  Plain read()
+   and write() block the whole worker.
+
+   The other functions here may be called only from green
+   threads. */
+#define GTHREAD_MAX_WORKERS 8
+
+void gthread_run (int worker_cnt, void (*func) (void *), void *aux);
+bool gthread_create (void (*func) (void *), void *aux);
+void gthread_yield (void);
+void gthread_exit (void) NO_RETURN;
+int gthread_poll (int fd, short events);
+int gthread_read (int fd, void *buffer, unsigned size);
+int gthread_write (int fd, const void *buffer, unsigned size);
+
+#endif /* lib/user/gthread.h */
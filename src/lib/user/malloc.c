@@ -0,0 +1,354 @@
+#include <stdlib.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "../kernel/list.h"
+
+/* User-space malloc(), on the same plan as the kernel's in
+   threads/malloc.c.
+
+   Requests of up to 2 kB are rounded up to a power of 2 and served
+   from the free list of that size class.  When the list is empty a
+   page, called an arena, is taken from the heap and cut into
+   blocks of the class.  An arena whose blocks are all free again is
+   set aside for any class to reuse.
+
+   Bigger requests get whole pages of their own, with the size in
+   the arena header.  Freed ones are kept for reuse, unless they end
+   the heap, in which case they are given back with sbrk().
+
+   The heap grows with sbrk() one page or big block at a time.  Its
+   pages take memory only once touched, so a program pays only for
+   what it uses.  Calls are serialized by a futex-based lock, so
+   user threads may share the heap. */
+
+#define PGSIZE 4096
+#define pg_ofs(P) ((uintptr_t) (P) & (PGSIZE - 1))
+#define pg_round_down(P) ((void *) ((uintptr_t) (P) & ~(uintptr_t) (PGSIZE - 1)))
+#define ARENA_MAGIC 0x9a548eed
+
+/* Smallest and largest size classes. */
+#define MIN_BLOCK 16
+#define MAX_BLOCK 2048
+#define DESC_CNT 8              /* 16, 32, ..., 2048. */
+
+/* Free block, linked into its class's free list. */
+struct block
+  {
+    struct list_elem free_elem;
+  };
+
+/* Size class. */
+struct desc
+  {
+    size_t block_size;          /* Size of each block in bytes. */
+    size_t blocks_per_arena;    /* Number of blocks in an arena. */
+    struct list free_list;      /* Free blocks. */
+  };
+
+/* Header at the start of each arena's page. */
+struct arena
+  {
+    unsigned magic;             /* Always ARENA_MAGIC. */
+    struct desc *desc;          /* Size class, null for a big block. */
+    size_t free_cnt;            /* Free blocks; pages in a big block. */
+    struct list_elem elem;      /* In empty_list or big_list when free. */
+  };
+
+static struct desc descs[DESC_CNT];
+static bool initialized;
+static struct list empty_list;  /* Arenas with no blocks in use. */
+static struct list big_list;    /* Freed big blocks. */
+
+/* 0: unlocked, 1: locked, 2: locked with waiters. */
+static int heap_lock;
+
+static struct arena *block_to_arena (struct block *);
+static struct block *arena_to_block (struct arena *, size_t idx);
+
+/* Acquires heap_lock. */
+static void
+lock_heap (void)
+{
+  int c = __sync_val_compare_and_swap (&heap_lock, 0, 1);
+
+  while (c != 0)
+    {
+      if (c == 2 || __sync_val_compare_and_swap (&heap_lock, 1, 2) != 0)
+        futex_wait (&heap_lock, 2);
+      c = __sync_val_compare_and_swap (&heap_lock, 0, 2);
+    }
+}
+
+/* Releases heap_lock. */
+static void
+unlock_heap (void)
+{
+  if (__sync_fetch_and_sub (&heap_lock, 1) != 1)
+    {
+      heap_lock = 0;
+      futex_wake (&heap_lock, 1);
+    }
+}
+
+/* Sets up the size classes on first use. */
+static void
+init_heap (void)
+{
+  size_t size;
+  struct desc *d = descs;
+
+  for (size = MIN_BLOCK; size <= MAX_BLOCK; size *= 2, d++)
+    {
+      d->block_size = size;
+      d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / size;
+      list_init (&d->free_list);
+    }
+  list_init (&empty_list);
+  list_init (&big_list);
+  initialized = true;
+}
+
+/* Returns PAGE_CNT new pages from the end of the heap, or a null
+   pointer if it cannot grow.  The first call aligns the heap's end
+   to a page boundary. */
+static void *
+heap_pages (size_t page_cnt)
+{
+  uintptr_t end = (uintptr_t) sbrk (0);
+  size_t pad = ROUND_UP (end, PGSIZE) - end;
+  uint8_t *pages;
+
+  if (end == (uintptr_t) -1)
+    return NULL;
+  pages = sbrk (pad + page_cnt * PGSIZE);
+  return pages != (void *) -1 ? pages + pad : NULL;
+}
+
+/* Returns a new big block of at least SIZE bytes, or a null pointer
+   if the heap cannot grow. */
+static void *
+big_alloc (size_t size)
+{
+  size_t page_cnt = DIV_ROUND_UP (size + sizeof (struct arena), PGSIZE);
+  struct list_elem *e;
+  struct arena *a;
+
+  /* Reuse a freed big block that is large enough but not wasteful. */
+  for (e = list_begin (&big_list); e != list_end (&big_list);
+       e = list_next (e))
+    {
+      a = list_entry (e, struct arena, elem);
+      if (a->free_cnt >= page_cnt && a->free_cnt <= 2 * page_cnt)
+        {
+          list_remove (e);
+          return a + 1;
+        }
+    }
+
+  a = heap_pages (page_cnt);
+  if (a == NULL)
+    return NULL;
+  a->magic = ARENA_MAGIC;
+  a->desc = NULL;
+  a->free_cnt = page_cnt;
+  return a + 1;
+}
+
+/* Frees big block arena A, giving it back to the system if it ends
+   the heap. */
+static void
+big_free (struct arena *a)
+{
+  if ((uint8_t *) a + a->free_cnt * PGSIZE == sbrk (0))
+    {
+      a->magic = 0;
+      sbrk (-(intptr_t) (a->free_cnt * PGSIZE));
+    }
+  else
+    list_push_front (&big_list, &a->elem);
+}
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available. */
+void *
+malloc (size_t size)
+{
+  struct desc *d;
+  struct block *b;
+  struct arena *a;
+  void *p = NULL;
+
+  if (size == 0)
+    return NULL;
+
+  lock_heap ();
+  if (!initialized)
+    init_heap ();
+
+  for (d = descs; d < descs + DESC_CNT; d++)
+    if (d->block_size >= size)
+      break;
+  if (d == descs + DESC_CNT)
+    {
+      p = big_alloc (size);
+      unlock_heap ();
+      return p;
+    }
+
+  if (list_empty (&d->free_list))
+    {
+      size_t i;
+
+      if (!list_empty (&empty_list))
+        a = list_entry (list_pop_front (&empty_list), struct arena, elem);
+      else
+        a = heap_pages (1);
+      if (a == NULL)
+        {
+          unlock_heap ();
+          return NULL;
+        }
+
+      a->magic = ARENA_MAGIC;
+      a->desc = d;
+      a->free_cnt = d->blocks_per_arena;
+      for (i = 0; i < d->blocks_per_arena; i++)
+        {
+          b = arena_to_block (a, i);
+          list_push_back (&d->free_list, &b->free_elem);
+        }
+    }
+
+  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
+  a = block_to_arena (b);
+  a->free_cnt--;
+  unlock_heap ();
+  return b;
+}
+
+/* Allocates and returns A times B bytes initialized to zeros.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b)
+{
+  void *p;
+  size_t size;
+
+  size = a * b;
+  if (size < a || size < b)
+    return NULL;
+
+  p = malloc (size);
+  if (p != NULL)
+    memset (p, 0, size);
+  return p;
+}
+
+/* Returns the number of bytes allocated for BLOCK. */
+static size_t
+block_size (void *block)
+{
+  struct block *b = block;
+  struct arena *a = block_to_arena (b);
+  struct desc *d = a->desc;
+
+  return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly moving
+   it in the process.  If successful, returns the new block; on
+   failure, returns a null pointer.  A call with null OLD_BLOCK is
+   equivalent to malloc(NEW_SIZE).  A call with zero NEW_SIZE is
+   equivalent to free(OLD_BLOCK). */
+void *
+realloc (void *old_block, size_t new_size)
+{
+  if (new_size == 0)
+    {
+      free (old_block);
+      return NULL;
+    }
+  else
+    {
+      void *new_block = malloc (new_size);
+      if (old_block != NULL && new_block != NULL)
+        {
+          size_t old_size = block_size (old_block);
+          size_t min_size = new_size < old_size ? new_size : old_size;
+          memcpy (new_block, old_block, min_size);
+          free (old_block);
+        }
+      return new_block;
+    }
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p)
+{
+  struct block *b = p;
+  struct arena *a;
+  struct desc *d;
+
+  if (p == NULL)
+    return;
+
+  lock_heap ();
+  a = block_to_arena (b);
+  d = a->desc;
+  if (d == NULL)
+    {
+      big_free (a);
+      unlock_heap ();
+      return;
+    }
+
+  list_push_front (&d->free_list, &b->free_elem);
+
+  /* Set the arena aside once all of its blocks are free. */
+  if (++a->free_cnt >= d->blocks_per_arena)
+    {
+      size_t i;
+
+      ASSERT (a->free_cnt == d->blocks_per_arena);
+      for (i = 0; i < d->blocks_per_arena; i++)
+        list_remove (&arena_to_block (a, i)->free_elem);
+      a->desc = NULL;
+      list_push_front (&empty_list, &a->elem);
+    }
+  unlock_heap ();
+}
+
+/* Returns the arena that block B is inside. */
+static struct arena *
+block_to_arena (struct block *b)
+{
+  struct arena *a = pg_round_down (b);
+
+  /* Check that the arena is valid. */
+  ASSERT (a != NULL);
+  ASSERT (a->magic == ARENA_MAGIC);
+
+  /* Check that the block is properly aligned for the arena. */
+  ASSERT (a->desc == NULL
+          || (pg_ofs (b) - sizeof *a) % a->desc->block_size == 0);
+  ASSERT (a->desc != NULL || pg_ofs (b) == sizeof *a);
+
+  return a;
+}
+
+/* Returns the (IDX - 1)'th block within arena A. */
+static struct block *
+arena_to_block (struct arena *a, size_t idx)
+{
+  ASSERT (a != NULL);
+  ASSERT (a->magic == ARENA_MAGIC);
+  ASSERT (idx < a->desc->blocks_per_arena);
+  return (struct block *) ((uint8_t *) a
+                           + sizeof *a
+                           + idx * a->desc->block_size);
+}
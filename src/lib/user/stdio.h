@@ -4,4 +4,18 @@
 int hprintf (int, const char *, ...) PRINTF_FORMAT (2, 3);
 int vhprintf (int, const char *, va_list) PRINTF_FORMAT (2, 0);
 
+/* Standard output is buffered.  By default it is written out at
+   each new-line when it is the console and only when the buffer
+   fills when it is a file; stdout_setvbuf() changes the mode and
+   the buffer.  exit() and any write() to standard output flush it
+   first, so output keeps its order.  The buffer is not locked:
+   user threads that print must take turns. */
+#define BUFSIZ 1024             /* Default buffer size. */
+#define _IOFBF 0                /* Write when the buffer fills. */
+#define _IOLBF 1                /* Also write at each new-line. */
+#define _IONBF 2                /* Write at the end of each call. */
+
+int stdout_setvbuf (char *buf, int mode, size_t size);
+void stdout_flush (void);
+
 #endif /* lib/user/stdio.h */
@@ -1,16 +1,62 @@
 #include <syscall.h>
+#include <stdio.h>
 #include "../syscall-nr.h"
 
+/* The syscallN() macros push the call number and arguments and
+   call syscall_entry, which enters the kernel with SYSENTER if
+   the processor has it, or `int $0x30' otherwise.  Either way
+   ECX and EDX are clobbered. */
+
+void syscall_probe (void);
+
+/* True if syscall_entry uses SYSENTER.  Set by syscall_probe(). */
+static bool use_sysenter __attribute__ ((used));
+
+/* syscall_entry finds the call number just above its return
+   address.  The kernel goes back from SYSENTER with SYSEXIT, which
+   jumps to the address in EDX with the stack pointer in ECX, so we
+   pop the return address into EDX and leave ESP pointing at the
+   call number, as the kernel expects with `int $0x30' too. */
+static void __attribute__ ((used))
+define_syscall_entry (void)
+{
+  asm volatile (".pushsection .text\n"
+                "syscall_entry:\n"
+                "  popl %edx\n"
+                "  cmpb $0, use_sysenter\n"
+                "  je 1f\n"
+                "  movl %esp, %ecx\n"
+                "  sysenter\n"
+                "1:int $0x30\n"
+                "  jmp *%edx\n"
+                ".popsection");
+}
+
+/* Uses SYSENTER for system calls if the processor has it, on the
+   same test as the kernel's syscall_init(), which enables it in
+   exactly that case.  Called by _start(). */
+void
+syscall_probe (void)
+{
+  unsigned eax, ebx, ecx, edx;
+
+  asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+  use_sysenter = (edx & (1u << 11)) != 0
+                 && !((eax & 0xf0f00) == 0x600 && (eax & 0xf0) < 0x30
+                      && (eax & 0xf) < 3);
+}
+
 /* Invokes syscall NUMBER, passing no arguments, and returns the
    return value as an `int'. */
 #define syscall0(NUMBER)                                        \
         ({                                                      \
           int retval;                                           \
           asm volatile                                          \
-            ("pushl %[number]; int $0x30; addl $4, %%esp"       \
+            ("pushl %[number]; call syscall_entry; "             \
+             "addl $4, %%esp"                                   \
                : "=a" (retval)                                  \
                : [number] "i" (NUMBER)                          \
-               : "memory");                                     \
+               : "ecx", "edx", "memory");                       \
           retval;                                               \
         })
 
@@ -20,11 +66,12 @@
         ({                                                               \
           int retval;                                                    \
           asm volatile                                                   \
-            ("pushl %[arg0]; pushl %[number]; int $0x30; addl $8, %%esp" \
+            ("pushl %[arg0]; pushl %[number]; "                          \
+             "call syscall_entry; addl $8, %%esp"                        \
                : "=a" (retval)                                           \
                : [number] "i" (NUMBER),                                  \
                  [arg0] "g" (ARG0)                                       \
-               : "memory");                                              \
+               : "ecx", "edx", "memory");                                \
           retval;                                                        \
         })
 
@@ -35,12 +82,13 @@
           int retval;                                           \
           asm volatile                                          \
             ("pushl %[arg1]; pushl %[arg0]; "                   \
-             "pushl %[number]; int $0x30; addl $12, %%esp"      \
+             "pushl %[number]; call syscall_entry; "            \
+             "addl $12, %%esp"                                  \
                : "=a" (retval)                                  \
                : [number] "i" (NUMBER),                         \
                  [arg0] "r" (ARG0),                             \
                  [arg1] "r" (ARG1)                              \
-               : "memory");                                     \
+               : "ecx", "edx", "memory");                       \
           retval;                                               \
         })
 
@@ -51,19 +99,41 @@
           int retval;                                           \
           asm volatile                                          \
             ("pushl %[arg2]; pushl %[arg1]; pushl %[arg0]; "    \
-             "pushl %[number]; int $0x30; addl $16, %%esp"      \
+             "pushl %[number]; call syscall_entry; "            \
+             "addl $16, %%esp"                                  \
                : "=a" (retval)                                  \
                : [number] "i" (NUMBER),                         \
                  [arg0] "r" (ARG0),                             \
                  [arg1] "r" (ARG1),                             \
                  [arg2] "r" (ARG2)                              \
-               : "memory");                                     \
+               : "ecx", "edx", "memory");                       \
+          retval;                                               \
+        })
+
+/* Invokes syscall NUMBER, passing arguments ARG0, ARG1, ARG2,
+   and ARG3, and returns the return value as an `int'. */
+#define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3)                \
+        ({                                                      \
+          int retval;                                           \
+          asm volatile                                          \
+            ("pushl %[arg3]; pushl %[arg2]; pushl %[arg1]; "    \
+             "pushl %[arg0]; pushl %[number]; "                 \
+             "call syscall_entry; "                             \
+             "addl $20, %%esp"                                  \
+               : "=a" (retval)                                  \
+               : [number] "i" (NUMBER),                         \
+                 [arg0] "r" (ARG0),                             \
+                 [arg1] "r" (ARG1),                             \
+                 [arg2] "r" (ARG2),                             \
+                 [arg3] "r" (ARG3)                              \
+               : "ecx", "edx", "memory");                       \
           retval;                                               \
         })
 
 void
 halt (void) 
 {
+  stdout_flush ();
   syscall0 (SYS_HALT);
   NOT_REACHED ();
 }
@@ -71,6 +141,7 @@ halt (void)
 void
 exit (int status)
 {
+  stdout_flush ();
   syscall1 (SYS_EXIT, status);
   NOT_REACHED ();
 }
@@ -78,15 +149,45 @@ exit (int status)
 pid_t
 exec (const char *file)
 {
+  stdout_flush ();
   return (pid_t) syscall1 (SYS_EXEC, file);
 }
 
+pid_t
+execv (const char *file, char *const argv[])
+{
+  stdout_flush ();
+  return (pid_t) syscall2 (SYS_EXECV, file, argv);
+}
+
+pid_t
+spawn (const char *file, char *const argv[],
+       const struct spawn_fd *fds, int fd_cnt)
+{
+  stdout_flush ();
+  return (pid_t) syscall4 (SYS_SPAWN, file, argv, fds, fd_cnt);
+}
+
+pid_t
+fork (void)
+{
+  /* The child would print the buffer a second time. */
+  stdout_flush ();
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
 int
 wait (pid_t pid)
 {
   return syscall1 (SYS_WAIT, pid);
 }
 
+pid_t
+waitpid (pid_t pid, int *status, int options)
+{
+  return (pid_t) syscall3 (SYS_WAITPID, pid, status, options);
+}
+
 bool
 create (const char *file, unsigned initial_size)
 {
@@ -114,12 +215,17 @@ filesize (int fd)
 int
 read (int fd, void *buffer, unsigned size)
 {
+  /* Show a prompt before waiting for its answer. */
+  if (fd == STDIN_FILENO)
+    stdout_flush ();
   return syscall3 (SYS_READ, fd, buffer, size);
 }
 
 int
 write (int fd, const void *buffer, unsigned size)
 {
+  if (fd == STDOUT_FILENO)
+    stdout_flush ();
   return syscall3 (SYS_WRITE, fd, buffer, size);
 }
 
@@ -141,9 +247,24 @@ close (int fd)
   syscall1 (SYS_CLOSE, fd);
 }
 
+/* Where a signal handler returns to.  The kernel leaves the
+   interrupted registers just above, for SYS_SIGRETURN to restore. */
+extern char sig_trampoline[];
+
+static void __attribute__ ((used))
+define_sig_trampoline (void)
+{
+  asm volatile (".pushsection .text\n"
+                "sig_trampoline:\n"
+                "  pushl %0\n"
+                "  int $0x30\n"
+                ".popsection"
+                : : "i" (SYS_SIGRETURN));
+}
+
 void sigaction (int signum, void (*handler) (void))
 {
-  syscall2 (SYS_SIGACTION, signum, handler);
+  syscall3 (SYS_SIGACTION, signum, handler, sig_trampoline);
 }
 
 void sendsig (pid_t pid, int signum)
@@ -151,7 +272,178 @@ void sendsig (pid_t pid, int signum)
   syscall2 (SYS_SENDSIG, pid, signum);
 }
 
-void sched_yield ()
+int
+readv (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_READV, fd, iov, iovcnt);
+}
+
+int
+writev (int fd, const struct iovec *iov, int iovcnt)
+{
+  if (fd == STDOUT_FILENO)
+    stdout_flush ();
+  return syscall3 (SYS_WRITEV, fd, iov, iovcnt);
+}
+
+int
+pread (int fd, void *buffer, unsigned size, unsigned offset)
+{
+  return syscall4 (SYS_PREAD, fd, buffer, size, offset);
+}
+
+int
+pwrite (int fd, const void *buffer, unsigned size, unsigned offset)
+{
+  return syscall4 (SYS_PWRITE, fd, buffer, size, offset);
+}
+
+int
+sendfile (int out_fd, int in_fd, unsigned *offset, unsigned count)
+{
+  return syscall4 (SYS_SENDFILE, out_fd, in_fd, offset, count);
+}
+
+bool
+fallocate (int fd, unsigned length)
+{
+  return syscall2 (SYS_FALLOCATE, fd, length);
+}
+
+bool
+truncate (const char *file, unsigned length)
+{
+  return syscall2 (SYS_TRUNCATE, file, length);
+}
+
+bool
+ftruncate (int fd, unsigned length)
+{
+  return syscall2 (SYS_FTRUNCATE, fd, length);
+}
+
+bool
+fsync (int fd)
+{
+  return syscall1 (SYS_FSYNC, fd);
+}
+
+void
+sync (void)
+{
+  syscall0 (SYS_SYNC);
+}
+
+void
+memstat (struct memstat *st)
+{
+  syscall1 (SYS_MEMSTAT, st);
+}
+
+unsigned
+ticks (void)
+{
+  return syscall0 (SYS_TICKS);
+}
+
+int
+getrusage (int who, struct rusage *usage)
+{
+  return syscall2 (SYS_GETRUSAGE, who, usage);
+}
+
+void
+clock_gettime (struct timespec *ts)
+{
+  syscall1 (SYS_CLOCK_GETTIME, ts);
+}
+
+bool
+sched_setdeadline (unsigned period_ms, unsigned budget_ms)
+{
+  return syscall2 (SYS_SCHED_SETDEADLINE, period_ms, budget_ms);
+}
+
+bool
+sched_setaffinity (unsigned mask)
+{
+  return syscall1 (SYS_SCHED_SETAFFINITY, mask);
+}
+
+int
+cpu_group_create (unsigned quota_ms, unsigned period_ms)
+{
+  return syscall2 (SYS_CPU_GROUP_CREATE, quota_ms, period_ms);
+}
+
+bool
+cpu_group_join (int group)
+{
+  return syscall1 (SYS_CPU_GROUP_JOIN, group);
+}
+
+bool
+pipe (int fds[2])
+{
+  return syscall1 (SYS_PIPE, fds);
+}
+
+int
+poll (struct pollfd *fds, unsigned nfds, int timeout_ms)
+{
+  return syscall3 (SYS_POLL, fds, nfds, timeout_ms);
+}
+
+bool
+shm_create (const char *name, unsigned size)
+{
+  return syscall2 (SYS_SHM_CREATE, name, size);
+}
+
+void *
+shm_map (const char *name, void *addr)
+{
+  return (void *) syscall2 (SYS_SHM_MAP, name, addr);
+}
+
+bool
+shm_unmap (void *addr)
+{
+  return syscall1 (SYS_SHM_UNMAP, addr);
+}
+
+struct ring *
+ring_setup (unsigned entries, void *addr)
+{
+  return (struct ring *) syscall2 (SYS_RING_SETUP, entries, addr);
+}
+
+int
+ring_enter (unsigned to_submit, unsigned min_complete)
+{
+  return syscall2 (SYS_RING_ENTER, to_submit, min_complete);
+}
+
+bool
+setrlimit (int resource, unsigned limit)
+{
+  return syscall2 (SYS_SETRLIMIT, resource, limit);
+}
+
+unsigned
+getrlimit (int resource)
+{
+  return syscall1 (SYS_GETRLIMIT, resource);
+}
+
+void *
+sbrk (intptr_t increment)
+{
+  return (void *) syscall1 (SYS_SBRK, increment);
+}
+
+void
+sched_yield (void)
 {
   syscall0 (SYS_YIELD);
 }
@@ -168,6 +460,57 @@ munmap (mapid_t mapid)
   syscall1 (SYS_MUNMAP, mapid);
 }
 
+int
+madvise (void *addr, unsigned length, int advice)
+{
+  return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
+bool
+vmstat (struct vmstat *st)
+{
+  return syscall1 (SYS_VMSTAT, st);
+}
+
+/* Where a thread made by uthread_create() starts. */
+static void
+uthread_start (void (*func) (void *), void *aux)
+{
+  func (aux);
+  uthread_exit ();
+}
+
+uthread_t
+uthread_create (void (*func) (void *), void *aux)
+{
+  return (uthread_t) syscall3 (SYS_THREAD_CREATE, uthread_start, func, aux);
+}
+
+int
+uthread_join (uthread_t tid)
+{
+  return syscall1 (SYS_THREAD_JOIN, tid);
+}
+
+void
+uthread_exit (void)
+{
+  syscall0 (SYS_THREAD_EXIT);
+  NOT_REACHED ();
+}
+
+int
+futex_wait (int *addr, int val)
+{
+  return syscall2 (SYS_FUTEX_WAIT, addr, val);
+}
+
+int
+futex_wake (int *addr, int cnt)
+{
+  return syscall2 (SYS_FUTEX_WAKE, addr, cnt);
+}
+
 bool
 chdir (const char *dir)
 {
@@ -180,6 +523,12 @@ mkdir (const char *dir)
   return syscall1 (SYS_MKDIR, dir);
 }
 
+bool
+clone_file (const char *from, const char *to)
+{
+  return syscall2 (SYS_CLONE_FILE, from, to);
+}
+
 bool
 readdir (int fd, char name[READDIR_MAX_LEN + 1]) 
 {
@@ -197,3 +546,9 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+int
+getdents (int fd, struct dirent *entries, int cnt)
+{
+  return syscall3 (SYS_GETDENTS, fd, entries, cnt);
+}
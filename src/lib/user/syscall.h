@@ -2,19 +2,67 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <debug.h>
 
 /* Process identifier. */
 typedef int pid_t;
 #define PID_ERROR ((pid_t) -1)
 
+/* User thread identifier. */
+typedef int uthread_t;
+#define UTHREAD_ERROR ((uthread_t) -1)
+
 /* Map region identifier. */
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 
+/* Advice for madvise(). */
+#define MADV_NORMAL 0           /* No special treatment. */
+#define MADV_SEQUENTIAL 1       /* Read ahead of each fault. */
+#define MADV_WILLNEED 2         /* Read the pages in now. */
+#define MADV_DONTNEED 3         /* Write back and drop the pages now. */
+
+/* Paging statistics of the calling process, from vmstat(). */
+struct vmstat
+  {
+    unsigned minor_faults;      /* Faults served without I/O. */
+    unsigned major_faults;      /* Faults that read a page in. */
+    unsigned swap_ins;          /* Pages read back from swap. */
+    unsigned swap_outs;         /* Pages written to swap. */
+    unsigned evictions;         /* Frames lost to eviction. */
+    unsigned resident;          /* Frames currently held. */
+    unsigned frames;            /* Frames in the user pool. */
+    unsigned swap_slots;        /* Swap slots holding own pages. */
+    unsigned swap_used;         /* Swap slots in use system-wide. */
+    unsigned swap_free;         /* Swap slots free system-wide. */
+  };
+
+/* One buffer of a readv() or writev() request. */
+struct iovec
+  {
+    void *iov_base;             /* Start of the buffer. */
+    unsigned iov_len;           /* Size of the buffer in bytes. */
+  };
+
+/* Maximum number of buffers in a readv() or writev() request. */
+#define IOV_MAX 16
+
+/* Options for waitpid(). */
+#define WNOHANG 1               /* Return 0 rather than block. */
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
+/* A directory entry, as stored by getdents(). */
+struct dirent
+  {
+    int inumber;                /* Inode number. */
+    int size;                   /* Length in bytes. */
+    bool is_dir;                /* True for a directory. */
+    char name[READDIR_MAX_LEN + 1];
+  };
+
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /* Successful execution. */
 #define EXIT_FAILURE 1          /* Unsuccessful execution. */
@@ -23,7 +71,14 @@ typedef int mapid_t;
 void halt (void) NO_RETURN;
 void exit (int status) NO_RETURN;
 pid_t exec (const char *file);
+
+/* Like exec(), but runs FILE with the null-terminated ARGV as its
+   arguments instead of splitting a command line. */
+pid_t execv (const char *file, char *const argv[]);
+
+pid_t fork (void);
 int wait (pid_t);
+pid_t waitpid (pid_t, int *status, int options);
 bool create (const char *file, unsigned initial_size);
 bool remove (const char *file);
 int open (const char *file);
@@ -35,14 +90,104 @@ unsigned tell (int fd);
 void close (int fd);
 void sigaction (int signum, void (*handler) (void));
 void sendsig (pid_t, int signum);
+int readv (int fd, const struct iovec *, int iovcnt);
+int writev (int fd, const struct iovec *, int iovcnt);
+int pread (int fd, void *buffer, unsigned length, unsigned offset);
+int pwrite (int fd, const void *buffer, unsigned length, unsigned offset);
+
+/* Copies up to COUNT bytes from IN_FD to OUT_FD without passing
+   them through user memory.  Reads IN_FD from its position, or
+   from *OFFSET if OFFSET is nonnull, in which case *OFFSET is
+   advanced instead of the position.  Returns the number of bytes
+   copied, or -1 on error. */
+int sendfile (int out_fd, int in_fd, unsigned *offset, unsigned count);
 #define SIGONE 1
 #define SIGTWO 2
 #define SIGTHREE 3
+#define SIGKILL 9               /* Ends the process; cannot be handled. */
 
 
 /* Project 3 and optionally project 4. */
 mapid_t mmap (int fd, void *addr);
 void munmap (mapid_t);
+int madvise (void *addr, unsigned length, int advice);
+bool vmstat (struct vmstat *);
+
+/* Moves the end of the calling process's heap, which starts just
+   past its executable's data, by INCREMENT bytes and returns the
+   old end, or (void *) -1 on failure.  New heap pages read as zeros
+   and take memory only once touched. */
+void *sbrk (intptr_t increment);
+uthread_t uthread_create (void (*func) (void *), void *aux);
+int uthread_join (uthread_t);
+void uthread_exit (void) NO_RETURN;
+int futex_wait (int *addr, int val);
+int futex_wake (int *addr, int cnt);
+void sched_yield (void);
+
+/* Named shared-memory segments.  shm_create() makes a zero-filled
+   segment of SIZE bytes, which keeps its NAME until the creating
+   process exits.  shm_map() maps all of it at page-aligned ADDR and
+   returns ADDR, or a null pointer on failure; every process that
+   maps a segment sees the others' stores at once.  shm_unmap()
+   removes the mapping that starts at ADDR. */
+bool shm_create (const char *name, unsigned size);
+void *shm_map (const char *name, void *addr);
+bool shm_unmap (void *addr);
+
+/* Asynchronous I/O through a page shared with the kernel, which
+   holds a submission ring and a completion ring of ENTRIES slots
+   each.  The program fills SQ[SQ_TAIL % ENTRIES] and advances
+   SQ_TAIL for each request, then calls ring_enter(), which hands
+   up to TO_SUBMIT of them to a pool of kernel threads and returns
+   the number taken, or -1 if there is no ring.  Each request
+   finished posts its USER_DATA and the value the matching system
+   call would have returned at CQ[CQ_TAIL % ENTRIES], in whatever
+   order the requests finish; the program advances CQ_HEAD past the
+   completions it has read.  ring_enter() then waits until
+   MIN_COMPLETE completions are waiting or no request is left in
+   flight.  Requests are taken only while the completion ring has
+   room for them, so at most ENTRIES are in flight or waiting to be
+   read at once.
+
+   ring_setup() maps the ring at page-aligned ADDR and returns
+   ADDR, or a null pointer if ENTRIES is not a power of 2 up to
+   RING_MAX_ENTRIES, the pages at ADDR are in use, or the process
+   already has a ring. */
+#define RING_MAX_ENTRIES 64
+#define RING_OP_NOP 0           /* Does nothing, returns 0. */
+#define RING_OP_OPEN 1          /* open (BUF). */
+#define RING_OP_READ 2          /* read (FD, BUF, LEN). */
+#define RING_OP_WRITE 3         /* write (FD, BUF, LEN). */
+#define RING_OP_PREAD 4         /* pread (FD, BUF, LEN, OFFSET). */
+#define RING_OP_PWRITE 5        /* pwrite (FD, BUF, LEN, OFFSET). */
+#define RING_OP_FSYNC 6         /* fsync (FD), as 0 or -1. */
+struct ring_sqe
+  {
+    int op;                     /* RING_OP_*. */
+    int fd;                     /* File descriptor. */
+    void *buf;                  /* Buffer, or file name to open. */
+    unsigned len;               /* Size of BUF in bytes. */
+    unsigned offset;            /* File offset for PREAD and PWRITE. */
+    unsigned user_data;         /* Copied to the completion. */
+  };
+struct ring_cqe
+  {
+    unsigned user_data;         /* From the request. */
+    int result;                 /* What the system call returned. */
+  };
+struct ring
+  {
+    volatile unsigned sq_head;  /* Next request the kernel takes. */
+    volatile unsigned sq_tail;  /* Next request the program fills. */
+    volatile unsigned cq_head;  /* Next completion the program reads. */
+    volatile unsigned cq_tail;  /* Next completion the kernel posts. */
+    unsigned entries;           /* Slots in each ring. */
+    struct ring_sqe sq[RING_MAX_ENTRIES];
+    struct ring_cqe cq[RING_MAX_ENTRIES];
+  };
+struct ring *ring_setup (unsigned entries, void *addr);
+int ring_enter (unsigned to_submit, unsigned min_complete);
 
 /* Project 4 only. */
 bool chdir (const char *dir);
@@ -51,4 +196,164 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Reads up to CNT entries of the directory open as FD, starting
+   where the last readdir() or getdents() left off, into ENTRIES.
+   Returns the number read, 0 at the end of the directory, or -1 if
+   FD is not a directory.  Saves a readdir() plus an open(), isdir(),
+   filesize() and inumber() per entry. */
+int getdents (int fd, struct dirent *entries, int cnt);
+
+/* Creates file TO with the contents of file FROM, at once: the two
+   share FROM's disk sectors until either writes to one, which then
+   gets a copy of its own.  Fails if TO exists already. */
+bool clone_file (const char *from, const char *to);
+bool fallocate (int fd, unsigned length);
+
+/* Set the length of file FILE, or of the file open as FD, to
+   LENGTH bytes, dropping the data past LENGTH or extending the
+   file with bytes that read as zeros.  The space given up is
+   freed in the background, so even a large file is truncated
+   quickly. */
+bool truncate (const char *file, unsigned length);
+bool ftruncate (int fd, unsigned length);
+bool fsync (int fd);
+void sync (void);
+
+/* Limits on what the calling process may use, inherited by the
+   processes it creates.  setrlimit() returns false if RESOURCE is
+   unknown; a limit below current use only stops further growth.
+   getrlimit() returns 0 for an unknown RESOURCE.  With virtual
+   memory, a process at its RLIMIT_RSS pages against itself. */
+#define RLIMIT_RSS 0            /* Frames resident at once. */
+#define RLIMIT_SWAP 1           /* Swap slots in use at once. */
+#define RLIMIT_NOFILE 2         /* Open files, besides the console. */
+#define RLIM_INFINITY 0xffffffffu
+bool setrlimit (int resource, unsigned limit);
+unsigned getrlimit (int resource);
+
+/* Kernel memory usage, from memstat(), for sizing the kernel and
+   user pools.  Small blocks come in size classes of powers of two,
+   each carved from pages called arenas; larger blocks take whole
+   pages of their own. */
+#define MEMSTAT_CLASSES 10
+struct memstat_class
+  {
+    unsigned block_size;        /* Bytes in each block. */
+    unsigned in_use;            /* Blocks allocated. */
+    unsigned arenas;            /* Arenas, counting empty ones. */
+    unsigned partial_free;      /* Free blocks in partly used arenas. */
+  };
+struct memstat
+  {
+    unsigned kernel_pages;      /* Pages in the kernel pool. */
+    unsigned kernel_used;       /* Of those, pages allocated. */
+    unsigned user_pages;        /* Pages in the user pool. */
+    unsigned user_used;         /* Of those, pages allocated. */
+    unsigned big_blocks;        /* Blocks too big for a size class. */
+    unsigned big_pages;         /* Pages they take. */
+    unsigned class_cnt;         /* Size classes in CLASSES. */
+    struct memstat_class classes[MEMSTAT_CLASSES];
+  };
+void memstat (struct memstat *);
+
+/* Timer ticks since boot, TICKS_PER_SEC per second, for timing. */
+#define TICKS_PER_SEC 100
+unsigned ticks (void);
+
+/* Resource usage, from getrusage(), of the calling process's
+   threads (RUSAGE_SELF), of its children that have been waited for
+   and their descendants (RUSAGE_CHILDREN), or of the calling thread
+   alone (RUSAGE_THREAD).  Times are in timer ticks, each charged to
+   the thread it interrupted.  Page faults are counted per process.
+   Returns -1 if WHO is none of these, otherwise 0. */
+#define RUSAGE_SELF 0
+#define RUSAGE_CHILDREN (-1)
+#define RUSAGE_THREAD 1
+struct rusage
+  {
+    unsigned utime;             /* Ticks spent in user code. */
+    unsigned stime;             /* Ticks spent in the kernel. */
+    unsigned nvcsw;             /* Switches away to block or exit. */
+    unsigned nivcsw;            /* Switches away while runnable. */
+    unsigned minflt;            /* Page faults served without I/O. */
+    unsigned majflt;            /* Page faults that read a page in. */
+    unsigned inblock;           /* Block device sectors read. */
+    unsigned oublock;           /* Block device sectors written. */
+  };
+int getrusage (int who, struct rusage *);
+
+/* Time since boot, with the resolution of the CPU's cycle
+   counter, for timing events shorter than a tick. */
+struct timespec
+  {
+    long tv_sec;                /* Seconds. */
+    long tv_nsec;               /* Nanoseconds, 0 to 999,999,999. */
+  };
+void clock_gettime (struct timespec *);
+
+/* Lets the calling thread run for BUDGET_MS milliseconds in every
+   PERIOD_MS ahead of all other threads, earliest deadline first,
+   or stop doing so if PERIOD_MS is 0.  Both round up to whole
+   ticks.  Fails if the CPU time already reserved leaves too
+   little room. */
+bool sched_setdeadline (unsigned period_ms, unsigned budget_ms);
+
+/* Restricts the calling thread, and the threads and processes it
+   starts later, to the CPUs whose bits are set in MASK.  Fails if
+   MASK names no CPU that runs threads. */
+bool sched_setaffinity (unsigned mask);
+
+/* CPU quota groups.  The threads in a group may run for at most
+   QUOTA_MS milliseconds in every PERIOD_MS between them; after
+   that they wait for the next period.  cpu_group_create() returns
+   a group number, or -1 on failure.  cpu_group_join() moves the
+   calling thread, and the threads and processes it starts later,
+   into GROUP, or out of any group if GROUP is -1. */
+int cpu_group_create (unsigned quota_ms, unsigned period_ms);
+bool cpu_group_join (int group);
+
+/* Creates a pipe and stores a descriptor for its read end in
+   FDS[0] and one for its write end in FDS[1].  Reads wait for
+   data and return 0 once every write end is closed; writes wait
+   for room and return 0 once every read end is closed. */
+bool pipe (int fds[2]);
+
+/* Waits until one of the NFDS descriptors in FDS is ready for the
+   EVENTS asked for, or for TIMEOUT_MS milliseconds, forever if it
+   is negative.  Stores the ready events in each REVENTS and returns
+   the number of descriptors with any, 0 on timeout, or -1 if NFDS
+   exceeds POLL_MAX.  Negative descriptors are skipped.  The
+   console, pipes and files can be polled; files are always
+   ready. */
+#define POLL_MAX 16
+#define POLLIN 0x01             /* Data to read. */
+#define POLLOUT 0x04            /* Room to write. */
+#define POLLERR 0x08            /* Write end with no reader left. */
+#define POLLHUP 0x10            /* Read end with no writer left. */
+#define POLLNVAL 0x20           /* Not an open descriptor. */
+struct pollfd
+  {
+    int fd;                     /* Descriptor to wait for. */
+    short events;               /* Events of interest. */
+    short revents;              /* Events ready. */
+  };
+int poll (struct pollfd *fds, unsigned nfds, int timeout_ms);
+
+/* Starts FILE with arguments ARGV, as execv() does, and gives it a
+   copy of each FDS[I].parent_fd as its FDS[I].child_fd, for I <
+   FD_CNT.  A child descriptor of 0 or 1 replaces the console as the
+   child's standard input or output.  Returns the new process's pid
+   without waiting for it to load, so that the loads of several
+   children overlap; a child that fails to load exits with -1, as
+   reported through wait().  Returns PID_ERROR if the child cannot
+   be started at all. */
+#define SPAWN_FD_MAX 16
+struct spawn_fd
+  {
+    int child_fd;               /* Descriptor in the child. */
+    int parent_fd;              /* Descriptor it copies. */
+  };
+pid_t spawn (const char *file, char *const argv[],
+             const struct spawn_fd *fds, int fd_cnt);
+
 #endif /* lib/user/syscall.h */
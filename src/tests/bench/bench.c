@@ -0,0 +1,82 @@
+#include "tests/bench/bench.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/synch.h"
+
+struct bench 
+  {
+    const char *name;
+    bench_func *function;
+  };
+
+static const struct bench benches[] = 
+  {
+    {"sema-pingpong", bench_sema_pingpong},
+    {"lock-handoff", bench_lock_handoff},
+    {"malloc-churn", bench_malloc_churn},
+    {"palloc-pages", bench_palloc_pages},
+    {"hash-ops", bench_hash_ops},
+    {"sleep-accuracy", bench_sleep_accuracy},
+  };
+
+static const char *bench_name;
+
+/* Runs the benchmark named NAME, or all of them if NAME is
+   "all".  Each result is printed on a line of its own as
+   "bench NAME METRIC VALUE", for scripts to compare between
+   builds. */
+void
+run_bench (const char *name) 
+{
+  const struct bench *b;
+  bool found = false;
+
+  for (b = benches; b < benches + sizeof benches / sizeof *benches; b++)
+    if (!strcmp (name, "all") || !strcmp (name, b->name))
+      {
+        bench_name = b->name;
+        b->function ();
+        found = true;
+      }
+  if (!found)
+    PANIC ("no benchmark named \"%s\"", name);
+}
+
+/* Waits for the start of a timer tick and returns it, so that
+   a measurement does not begin partway through a tick. */
+int64_t
+bench_start (void) 
+{
+  int64_t start = timer_ticks ();
+
+  while (timer_ticks () == start)
+    barrier ();
+  return start + 1;
+}
+
+/* Reports VALUE for METRIC of the running benchmark. */
+void
+bench_report (const char *metric, int64_t value) 
+{
+  printf ("bench %s %s %"PRId64"\n", bench_name, metric, value);
+}
+
+/* Reports that CNT operations counted in UNIT took place since
+   tick START, which came from bench_start(): the count, the
+   ticks elapsed and the rate per second. */
+void
+bench_report_rate (const char *unit, int64_t cnt, int64_t start) 
+{
+  int64_t ticks = timer_elapsed (start);
+  char metric[32];
+
+  bench_report (unit, cnt);
+  snprintf (metric, sizeof metric, "%s_ticks", unit);
+  bench_report (metric, ticks);
+  snprintf (metric, sizeof metric, "%s_per_sec", unit);
+  bench_report (metric, cnt * TIMER_FREQ / (ticks > 0 ? ticks : 1));
+}
@@ -0,0 +1,21 @@
+#ifndef TESTS_BENCH_BENCH_H
+#define TESTS_BENCH_BENCH_H
+
+#include <stdint.h>
+
+void run_bench (const char *);
+
+typedef void bench_func (void);
+
+extern bench_func bench_sema_pingpong;
+extern bench_func bench_lock_handoff;
+extern bench_func bench_malloc_churn;
+extern bench_func bench_palloc_pages;
+extern bench_func bench_hash_ops;
+extern bench_func bench_sleep_accuracy;
+
+int64_t bench_start (void);
+void bench_report (const char *metric, int64_t value);
+void bench_report_rate (const char *unit, int64_t cnt, int64_t start);
+
+#endif /* tests/bench/bench.h */
@@ -0,0 +1,69 @@
+/* Measures the hash table: inserts ELEM_CNT elements, finds each
+   of them ROUNDS times, and deletes them. */
+
+#include <debug.h>
+#include <hash.h>
+#include "tests/bench/bench.h"
+#include "threads/malloc.h"
+
+#define ELEM_CNT 4096
+#define ROUNDS 4
+
+struct elem 
+  {
+    struct hash_elem hash_elem;
+    int key;
+  };
+
+static unsigned
+elem_hash (const struct hash_elem *e, void *aux UNUSED) 
+{
+  return hash_int (hash_entry (e, struct elem, hash_elem)->key);
+}
+
+static bool
+elem_less (const struct hash_elem *a, const struct hash_elem *b,
+           void *aux UNUSED) 
+{
+  return (hash_entry (a, struct elem, hash_elem)->key
+          < hash_entry (b, struct elem, hash_elem)->key);
+}
+
+void
+bench_hash_ops (void) 
+{
+  struct hash hash;
+  struct elem *elems = malloc (ELEM_CNT * sizeof *elems);
+  int64_t start;
+  int i, r;
+
+  if (elems == NULL || !hash_init (&hash, elem_hash, elem_less, NULL))
+    PANIC ("out of memory");
+
+  start = bench_start ();
+  for (i = 0; i < ELEM_CNT; i++)
+    {
+      elems[i].key = i * 7919;
+      hash_insert (&hash, &elems[i].hash_elem);
+    }
+  bench_report_rate ("inserts", ELEM_CNT, start);
+
+  start = bench_start ();
+  for (r = 0; r < ROUNDS; r++)
+    for (i = 0; i < ELEM_CNT; i++)
+      {
+        struct elem key;
+        key.key = i * 7919;
+        if (hash_find (&hash, &key.hash_elem) == NULL)
+          PANIC ("element %d missing", i);
+      }
+  bench_report_rate ("finds", ROUNDS * ELEM_CNT, start);
+
+  start = bench_start ();
+  for (i = 0; i < ELEM_CNT; i++)
+    hash_delete (&hash, &elems[i].hash_elem);
+  bench_report_rate ("deletes", ELEM_CNT, start);
+
+  hash_destroy (&hash, NULL);
+  free (elems);
+}
@@ -0,0 +1,59 @@
+/* Measures locks: first uncontended acquire/release pairs, then
+   two threads that each yield while holding the lock, so that
+   every release hands it to a waiter. */
+
+#include "tests/bench/bench.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define UNCONTENDED 200000
+#define ROUNDS 10000
+
+static struct lock lock;
+static struct semaphore done;
+
+/* Acquires the lock ROUNDS times, giving the other thread the
+   chance to block on it each time. */
+static void
+contend (void) 
+{
+  int i;
+
+  for (i = 0; i < ROUNDS; i++)
+    {
+      lock_acquire (&lock);
+      thread_yield ();
+      lock_release (&lock);
+    }
+}
+
+static void
+contender (void *aux UNUSED) 
+{
+  contend ();
+  sema_up (&done);
+}
+
+void
+bench_lock_handoff (void) 
+{
+  int64_t start;
+  int i;
+
+  lock_init (&lock);
+  sema_init (&done, 0);
+
+  start = bench_start ();
+  for (i = 0; i < UNCONTENDED; i++)
+    {
+      lock_acquire (&lock);
+      lock_release (&lock);
+    }
+  bench_report_rate ("uncontended", UNCONTENDED, start);
+
+  start = bench_start ();
+  thread_create ("contender", thread_get_priority (), contender, NULL);
+  contend ();
+  sema_down (&done);
+  bench_report_rate ("contended", 2 * ROUNDS, start);
+}
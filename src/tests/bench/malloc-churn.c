@@ -0,0 +1,34 @@
+/* Measures malloc() and free(): keeps SLOTS blocks of random
+   sizes live, replacing a random one at each step. */
+
+#include <random.h>
+#include "tests/bench/bench.h"
+#include "threads/malloc.h"
+
+#define SLOTS 64
+#define STEPS 50000
+#define MAX_SIZE 2048
+
+void
+bench_malloc_churn (void) 
+{
+  static void *blocks[SLOTS];
+  int64_t start;
+  int i;
+
+  random_init (0);
+  start = bench_start ();
+  for (i = 0; i < STEPS; i++)
+    {
+      size_t slot = random_ulong () % SLOTS;
+      free (blocks[slot]);
+      blocks[slot] = malloc (random_ulong () % MAX_SIZE + 1);
+    }
+  bench_report_rate ("steps", STEPS, start);
+
+  for (i = 0; i < SLOTS; i++)
+    {
+      free (blocks[i]);
+      blocks[i] = NULL;
+    }
+}
@@ -0,0 +1,37 @@
+/* Measures the page allocator: allocates BATCH single pages and
+   frees them again, then the same with runs of RUN pages. */
+
+#include "tests/bench/bench.h"
+#include "threads/palloc.h"
+
+#define BATCH 32
+#define ROUNDS 2000
+#define RUN 4
+
+void
+bench_palloc_pages (void) 
+{
+  static void *pages[BATCH];
+  int64_t start;
+  int i, j;
+
+  start = bench_start ();
+  for (i = 0; i < ROUNDS; i++)
+    {
+      for (j = 0; j < BATCH; j++)
+        pages[j] = palloc_get_page (0);
+      for (j = 0; j < BATCH; j++)
+        palloc_free_page (pages[j]);
+    }
+  bench_report_rate ("pages", ROUNDS * BATCH, start);
+
+  start = bench_start ();
+  for (i = 0; i < ROUNDS; i++)
+    {
+      for (j = 0; j < BATCH / RUN; j++)
+        pages[j] = palloc_get_multiple (0, RUN);
+      for (j = 0; j < BATCH / RUN; j++)
+        palloc_free_multiple (pages[j], RUN);
+    }
+  bench_report_rate ("runs", ROUNDS * (BATCH / RUN), start);
+}
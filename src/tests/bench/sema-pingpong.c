@@ -0,0 +1,44 @@
+/* Measures context switches: two threads hand control back and
+   forth through a pair of semaphores, two switches per round. */
+
+#include "tests/bench/bench.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define ROUNDS 20000
+
+static struct semaphore ping, pong, done;
+
+static void
+ponger (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < ROUNDS; i++)
+    {
+      sema_down (&ping);
+      sema_up (&pong);
+    }
+  sema_up (&done);
+}
+
+void
+bench_sema_pingpong (void) 
+{
+  int64_t start;
+  int i;
+
+  sema_init (&ping, 0);
+  sema_init (&pong, 0);
+  sema_init (&done, 0);
+  thread_create ("ponger", thread_get_priority (), ponger, NULL);
+
+  start = bench_start ();
+  for (i = 0; i < ROUNDS; i++)
+    {
+      sema_up (&ping);
+      sema_down (&pong);
+    }
+  bench_report_rate ("switches", 2 * ROUNDS, start);
+  sema_down (&done);
+}
@@ -0,0 +1,41 @@
+/* Measures how late timer_sleep() wakes a thread, in ticks, for
+   a few sleep lengths. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/bench/bench.h"
+#include "devices/timer.h"
+
+#define SAMPLES 10
+
+void
+bench_sleep_accuracy (void) 
+{
+  static const int64_t lengths[] = {1, 2, 5, 10};
+  size_t i;
+
+  for (i = 0; i < sizeof lengths / sizeof *lengths; i++)
+    {
+      int64_t total = 0, max = 0;
+      char metric[32];
+      int j;
+
+      for (j = 0; j < SAMPLES; j++)
+        {
+          int64_t start = bench_start ();
+          int64_t late;
+
+          timer_sleep (lengths[i]);
+          late = timer_elapsed (start) - lengths[i];
+          total += late;
+          if (late > max)
+            max = late;
+        }
+      snprintf (metric, sizeof metric, "sleep_%"PRId64"_late_total",
+                lengths[i]);
+      bench_report (metric, total);
+      snprintf (metric, sizeof metric, "sleep_%"PRId64"_late_max",
+                lengths[i]);
+      bench_report (metric, max);
+    }
+}
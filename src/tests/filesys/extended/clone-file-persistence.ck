@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($orig) = random_bytes (3000);
+my ($clone) = $orig;
+substr ($clone, 100, 5) = "clone";
+substr ($clone, 1024, 512) = 'z' x 512;
+check_archive ({"a" => [$orig], "b" => [$clone], "d" => {}});
+pass;
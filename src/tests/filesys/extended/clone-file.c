@@ -0,0 +1,48 @@
+/* Clones a file with clone_file(), writes part of a sector and a
+   whole sector of the clone, and checks that the clone changed
+   while the original did not.  Cloning onto an existing file or
+   cloning a directory must fail. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[3000];
+static char clone[sizeof buf];
+
+void
+test_main (void) 
+{
+  static const char word[] = "clone";
+  int fd;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create ("a", sizeof buf), "create \"a\"");
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"a\"");
+  close (fd);
+
+  CHECK (clone_file ("a", "b"), "clone \"a\" to \"b\"");
+  check_file ("b", buf, sizeof buf);
+
+  memcpy (clone, buf, sizeof buf);
+  memcpy (clone + 100, word, strlen (word));
+  memset (clone + 1024, 'z', 512);
+  CHECK ((fd = open ("b")) > 1, "open \"b\"");
+  seek (fd, 100);
+  CHECK (write (fd, word, strlen (word)) == (int) strlen (word),
+         "write part of a sector of \"b\"");
+  seek (fd, 1024);
+  CHECK (write (fd, clone + 1024, 512) == 512,
+         "write a whole sector of \"b\"");
+  close (fd);
+
+  check_file ("a", buf, sizeof buf);
+  check_file ("b", clone, sizeof clone);
+
+  CHECK (!clone_file ("a", "b"), "clone onto \"b\" (must fail)");
+  CHECK (mkdir ("d"), "mkdir \"d\"");
+  CHECK (!clone_file ("d", "e"), "clone \"d\" (must fail)");
+}
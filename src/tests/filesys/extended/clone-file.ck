@@ -0,0 +1,28 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(clone-file) begin
+(clone-file) create "a"
+(clone-file) open "a"
+(clone-file) write "a"
+(clone-file) clone "a" to "b"
+(clone-file) open "b" for verification
+(clone-file) verified contents of "b"
+(clone-file) close "b"
+(clone-file) open "b"
+(clone-file) write part of a sector of "b"
+(clone-file) write a whole sector of "b"
+(clone-file) open "a" for verification
+(clone-file) verified contents of "a"
+(clone-file) close "a"
+(clone-file) open "b" for verification
+(clone-file) verified contents of "b"
+(clone-file) close "b"
+(clone-file) clone onto "b" (must fail)
+(clone-file) mkdir "d"
+(clone-file) clone "d" (must fail)
+(clone-file) end
+EOF
+pass;
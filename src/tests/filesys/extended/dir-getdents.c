@@ -0,0 +1,75 @@
+/* Lists a directory with getdents(), two entries per call, and
+   checks each entry's inode number, type and length against
+   open().  getdents() on a file must fail. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static const struct
+  {
+    const char *name;
+    bool is_dir;
+    int size;
+  }
+expected[] = {{"a", false, 100}, {"b", false, 0}, {"c", true, 0}};
+
+#define EXPECTED_CNT (sizeof expected / sizeof *expected)
+
+void
+test_main (void) 
+{
+  bool seen[EXPECTED_CNT] = {false};
+  struct dirent entries[2];
+  int dir_fd, fd, cnt, total = 0;
+  size_t i;
+
+  CHECK (mkdir ("d"), "mkdir \"d\"");
+  CHECK (create ("d/a", 100), "create \"d/a\"");
+  CHECK (create ("d/b", 0), "create \"d/b\"");
+  CHECK (mkdir ("d/c"), "mkdir \"d/c\"");
+
+  CHECK ((dir_fd = open ("d")) > 1, "open \"d\"");
+  while ((cnt = getdents (dir_fd, entries, 2)) > 0)
+    {
+      int j;
+
+      for (j = 0; j < cnt; j++)
+        {
+          struct dirent *e = &entries[j];
+          char full_name[READDIR_MAX_LEN + 3];
+
+          for (i = 0; i < EXPECTED_CNT; i++)
+            if (!strcmp (e->name, expected[i].name))
+              break;
+          if (i == EXPECTED_CNT || seen[i])
+            fail ("unexpected entry \"%s\"", e->name);
+          seen[i] = true;
+
+          if (e->is_dir != expected[i].is_dir)
+            fail ("\"%s\" has the wrong type", e->name);
+          if (!e->is_dir && e->size != expected[i].size)
+            fail ("\"%s\" has size %d, expected %d",
+                  e->name, e->size, expected[i].size);
+          snprintf (full_name, sizeof full_name, "d/%s", e->name);
+          fd = open (full_name);
+          if (fd < 0 || inumber (fd) != e->inumber)
+            fail ("\"%s\" has the wrong inumber", e->name);
+          close (fd);
+          total++;
+        }
+    }
+  if (cnt < 0)
+    fail ("getdents \"d\" failed");
+  if (total != EXPECTED_CNT)
+    fail ("found %d entries, expected %d", total, (int) EXPECTED_CNT);
+  msg ("getdents \"d\" found every entry");
+  CHECK (getdents (dir_fd, entries, 2) == 0, "getdents at end of \"d\"");
+  close (dir_fd);
+
+  CHECK ((fd = open ("d/a")) > 1, "open \"d/a\"");
+  CHECK (getdents (fd, entries, 2) == -1, "getdents \"d/a\" must fail");
+  close (fd);
+}
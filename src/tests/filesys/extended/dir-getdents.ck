@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-getdents) begin
+(dir-getdents) mkdir "d"
+(dir-getdents) create "d/a"
+(dir-getdents) create "d/b"
+(dir-getdents) mkdir "d/c"
+(dir-getdents) open "d"
+(dir-getdents) getdents "d" found every entry
+(dir-getdents) getdents at end of "d"
+(dir-getdents) open "d/a"
+(dir-getdents) getdents "d/a" must fail
+(dir-getdents) end
+EOF
+pass;
@@ -0,0 +1,42 @@
+/* Preallocates a file with fallocate(), checks that it reads back
+   as zeros at its new size, then overwrites it sequentially and
+   checks that the size stays put. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[9000];
+static char zeros[sizeof buf];
+
+void
+test_main (void) 
+{
+  const char *file_name = "testfile";
+  size_t ofs;
+  int fd;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (fallocate (fd, sizeof buf), "fallocate \"%s\"", file_name);
+  if (tell (fd) != 0)
+    fail ("fallocate moved the file position to %u", tell (fd));
+  check_file_handle (fd, file_name, zeros, sizeof zeros);
+
+  random_bytes (buf, sizeof buf);
+  msg ("writing \"%s\"", file_name);
+  seek (fd, 0);
+  for (ofs = 0; ofs < sizeof buf; ofs += 1000)
+    {
+      size_t block_size = sizeof buf - ofs < 1000 ? sizeof buf - ofs : 1000;
+      if (write (fd, buf + ofs, block_size) != (int) block_size)
+        fail ("write %zu bytes at offset %zu in \"%s\" failed",
+              block_size, ofs, file_name);
+      if (filesize (fd) != sizeof buf)
+        fail ("filesize changed to %d", filesize (fd));
+    }
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  check_file (file_name, buf, sizeof buf);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-fallocate) begin
+(grow-fallocate) create "testfile"
+(grow-fallocate) open "testfile"
+(grow-fallocate) fallocate "testfile"
+(grow-fallocate) verified contents of "testfile"
+(grow-fallocate) writing "testfile"
+(grow-fallocate) close "testfile"
+(grow-fallocate) open "testfile" for verification
+(grow-fallocate) verified contents of "testfile"
+(grow-fallocate) close "testfile"
+(grow-fallocate) end
+EOF
+pass;
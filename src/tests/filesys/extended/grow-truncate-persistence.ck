@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($data) = random_bytes (9000);
+check_archive ({"testfile" => [substr ($data, 0, 1000)]});
+pass;
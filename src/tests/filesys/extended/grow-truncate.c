@@ -0,0 +1,45 @@
+/* Writes a file, shrinks it with ftruncate(), grows it again and
+   checks that the regrown part reads as zeros, then shrinks it by
+   name with truncate(). */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[9000];
+static char expected[6000];
+
+void
+test_main (void) 
+{
+  const char *file_name = "testfile";
+  int fd;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf,
+         "write \"%s\"", file_name);
+
+  CHECK (ftruncate (fd, 3000), "ftruncate \"%s\" to 3000 bytes", file_name);
+  if (filesize (fd) != 3000)
+    fail ("filesize is %d after ftruncate", filesize (fd));
+  if (tell (fd) != sizeof buf)
+    fail ("ftruncate moved the file position to %u", tell (fd));
+  seek (fd, 0);
+  check_file_handle (fd, file_name, buf, 3000);
+
+  CHECK (ftruncate (fd, sizeof expected),
+         "ftruncate \"%s\" to %zu bytes", file_name, sizeof expected);
+  memcpy (expected, buf, 3000);
+  seek (fd, 0);
+  check_file_handle (fd, file_name, expected, sizeof expected);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  CHECK (truncate (file_name, 1000), "truncate \"%s\" to 1000 bytes",
+         file_name);
+  check_file (file_name, buf, 1000);
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'END']);
+(grow-truncate) begin
+(grow-truncate) create "testfile"
+(grow-truncate) open "testfile"
+(grow-truncate) write "testfile"
+(grow-truncate) ftruncate "testfile" to 3000 bytes
+(grow-truncate) verified contents of "testfile"
+(grow-truncate) ftruncate "testfile" to 6000 bytes
+(grow-truncate) verified contents of "testfile"
+(grow-truncate) close "testfile"
+(grow-truncate) truncate "testfile" to 1000 bytes
+(grow-truncate) open "testfile" for verification
+(grow-truncate) verified contents of "testfile"
+(grow-truncate) close "testfile"
+(grow-truncate) end
+END
+pass;
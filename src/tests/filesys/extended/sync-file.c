@@ -0,0 +1,30 @@
+/* Writes a file, makes it durable with fsync() and sync(), and
+   checks that it reads back intact.  fsync() on a closed
+   descriptor must fail. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[6000];
+
+void
+test_main (void) 
+{
+  const char *file_name = "testfile";
+  int fd;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  if (write (fd, buf, sizeof buf) != (int) sizeof buf)
+    fail ("write \"%s\" failed", file_name);
+  CHECK (fsync (fd), "fsync \"%s\"", file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  CHECK (!fsync (fd), "fsync closed descriptor");
+  msg ("sync");
+  sync ();
+  check_file (file_name, buf, sizeof buf);
+}
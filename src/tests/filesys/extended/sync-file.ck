@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sync-file) begin
+(sync-file) create "testfile"
+(sync-file) open "testfile"
+(sync-file) fsync "testfile"
+(sync-file) close "testfile"
+(sync-file) fsync closed descriptor
+(sync-file) sync
+(sync-file) open "testfile" for verification
+(sync-file) verified contents of "testfile"
+(sync-file) close "testfile"
+(sync-file) end
+EOF
+pass;
@@ -610,9 +610,93 @@ sub finish {
     }
     print STDOUT "$_\n" foreach @messages;
 
+    write_stats ($verdict);
     exit 0;
 }
 
+# Statistics.
+
+# Writes $test.json with VERDICT, the wall-clock time of the run
+# from $test.time, and the statistics that the kernel printed at
+# shutdown and, with -vmstat or -rusage, as each process exited, so
+# that they can be charted from run to run.  Counters the kernel did
+# not print are left out.
+sub write_stats {
+    my ($verdict) = @_;
+    my (%stats) = (test => $test, verdict => $verdict);
+
+    if (-e "$test.time") {
+	my ($ms) = read_text_file ("$test.time");
+	$stats{wall_ms} = $ms if defined $ms && $ms =~ /^\d+$/;
+    }
+
+    if (-e "$test.output") {
+	my (@block, @processes);
+	for (read_text_file ("$test.output")) {
+	    if (/^Timer: (\d+) ticks$/) {
+		$stats{ticks} = $1;
+	    } elsif (/^Thread: (\d+) idle ticks, (\d+) kernel ticks, (\d+) user ticks$/) {
+		@stats{qw (idle_ticks kernel_ticks user_ticks)} = ($1, $2, $3);
+	    } elsif (/^Exception: (\d+) page faults$/) {
+		$stats{page_faults} = $1;
+	    } elsif (/^Console: (\d+) characters output$/) {
+		$stats{console_chars} = $1;
+	    } elsif (/^Keyboard: (\d+) keys pressed$/) {
+		$stats{keys} = $1;
+	    } elsif (/^(\S+) \((.+)\): (\d+) reads, (\d+) writes$/) {
+		push (@block, {device => $1, role => $2,
+			       sectors_read => $3, sectors_written => $4});
+	    } elsif (/^(\S+): vm: (\d+) minor, (\d+) major faults, (\d+) swap-ins, (\d+) swap-outs, (\d+) evictions/) {
+		push (@processes, {name => $1, kind => 'vm',
+				   minor_faults => $2, major_faults => $3,
+				   swap_ins => $4, swap_outs => $5,
+				   evictions => $6});
+	    } elsif (/^(\S+): rusage: (\d+) user, (\d+) system ticks, (\d+) voluntary, (\d+) involuntary switches, (\d+) minor, (\d+) major faults, (\d+) sectors read, (\d+) written$/) {
+		push (@processes, {name => $1, kind => 'rusage',
+				   user_ticks => $2, system_ticks => $3,
+				   voluntary_switches => $4,
+				   involuntary_switches => $5,
+				   minor_faults => $6, major_faults => $7,
+				   sectors_read => $8, sectors_written => $9});
+	    }
+	}
+	$stats{block} = \@block if @block;
+	$stats{processes} = \@processes if @processes;
+    }
+
+    my ($stats_fn) = "$test.json";
+    open (STATS, '>', $stats_fn) or die "$stats_fn: create: $!\n";
+    print STATS to_json (\%stats), "\n";
+    close (STATS);
+}
+
+# Returns VALUE, an integer, string, or reference to an array or
+# hash of them, as JSON, with hash keys in sorted order.  Only the
+# names of processes are strings that may look like integers, so
+# they are always quoted.
+sub to_json {
+    my ($value, $key) = @_;
+    if (ref ($value) eq 'HASH') {
+	return "{" . join (", ", map (json_string ($_) . ": "
+				      . to_json ($value->{$_}, $_),
+				      sort keys %$value)) . "}";
+    } elsif (ref ($value) eq 'ARRAY') {
+	return "[" . join (", ", map (to_json ($_), @$value)) . "]";
+    } elsif ($value =~ /^-?\d+$/ && !(defined $key && $key eq 'name')) {
+	return $value;
+    } else {
+	return json_string ($value);
+    }
+}
+
+# Returns string S as a JSON string.
+sub json_string {
+    my ($s) = @_;
+    $s =~ s/([\\"])/\\$1/g;
+    $s =~ s/([\x00-\x1f])/sprintf ("\\u%04x", ord ($1))/ge;
+    return "\"$s\"";
+}
+
 sub read_text_file {
     my ($file_name) = @_;
     open (FILE, '<', $file_name) or die "$file_name: open: $!\n";
@@ -2,6 +2,7 @@
 #include <debug.h>
 #include <string.h>
 #include <stdio.h>
+#include "devices/shutdown.h"
 
 struct test 
   {
@@ -90,6 +91,7 @@ fail (const char *format, ...)
   va_end (args);
   putchar ('\n');
 
+  shutdown_set_verdict (SHUTDOWN_FAIL);
   PANIC ("test failed");
 }
 
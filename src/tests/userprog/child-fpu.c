@@ -0,0 +1,19 @@
+/* Child process run by fpu-switch.
+   Fills its own FPU register stack with a different value. */
+
+#include "tests/lib.h"
+
+//const char *test_name = "child-fpu";
+
+int
+main (void) 
+{
+  int value = 777;
+  int i;
+
+  asm volatile ("fninit");
+  for (i = 0; i < 8; i++)
+    asm volatile ("fildl %0" : : "m" (value));
+  msg ("run");
+  return 81;
+}
@@ -0,0 +1,13 @@
+/* Child process run by spawn-batch.  Writes its one-digit
+   argument to descriptor 5, which spawn-batch gave it, and exits
+   with the digit's value. */
+
+#include <syscall.h>
+
+int
+main (int argc, char *argv[]) 
+{
+  if (argc != 2 || write (5, argv[1], 1) != 1)
+    return -1;
+  return argv[1][0] - '0';
+}
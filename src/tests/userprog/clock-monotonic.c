@@ -0,0 +1,51 @@
+/* Reads the high-resolution clock many times and checks that it
+   never goes backward and that it agrees with the tick count. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Returns TS in nanoseconds. */
+static long long
+ts_ns (const struct timespec *ts) 
+{
+  return ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+void
+test_main (void) 
+{
+  struct timespec ts;
+  long long prev, now, start_ns;
+  unsigned start;
+  int i;
+
+  clock_gettime (&ts);
+  prev = ts_ns (&ts);
+  for (i = 0; i < 10000; i++)
+    {
+      clock_gettime (&ts);
+      if (ts.tv_nsec < 0 || ts.tv_nsec >= 1000000000)
+        fail ("tv_nsec is %ld", ts.tv_nsec);
+      now = ts_ns (&ts);
+      if (now < prev)
+        fail ("clock went back by %lld ns", prev - now);
+      prev = now;
+    }
+  msg ("clock never went backward");
+
+  /* Two tick boundaries are at least one tick apart. */
+  start = ticks ();
+  while (ticks () == start)
+    continue;
+  clock_gettime (&ts);
+  start_ns = ts_ns (&ts);
+  start = ticks ();
+  while (ticks () == start)
+    continue;
+  clock_gettime (&ts);
+  now = ts_ns (&ts);
+  if (now - start_ns < 1000000000LL / TICKS_PER_SEC / 2)
+    fail ("a tick took only %lld ns", now - start_ns);
+  msg ("clock agrees with ticks");
+}
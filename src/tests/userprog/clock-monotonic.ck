@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(clock-monotonic) begin
+(clock-monotonic) clock never went backward
+(clock-monotonic) clock agrees with ticks
+(clock-monotonic) end
+clock-monotonic: exit(0)
+EOF
+pass;
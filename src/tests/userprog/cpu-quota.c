@@ -0,0 +1,32 @@
+/* Checks CPU affinity and quota groups: invalid requests fail,
+   and a thread whose group allows it a fifth of the CPU still
+   makes progress through several throttled periods. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  unsigned start;
+  int group;
+
+  CHECK (!sched_setaffinity (0), "refuse empty CPU mask");
+  CHECK (sched_setaffinity (1), "run on CPU 0 only");
+  CHECK (cpu_group_create (200, 100) == -1,
+         "refuse quota longer than period");
+  CHECK (!cpu_group_join (99), "refuse joining a missing group");
+
+  group = cpu_group_create (20, 100);
+  CHECK (group >= 0, "create group with 20 ms every 100 ms");
+  CHECK (cpu_group_join (group), "join group");
+
+  /* Spin through several periods, being throttled in each. */
+  start = ticks ();
+  while (ticks () - start < TICKS_PER_SEC / 2)
+    continue;
+  msg ("ran through several periods");
+
+  CHECK (cpu_group_join (-1), "leave group");
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(cpu-quota) begin
+(cpu-quota) refuse empty CPU mask
+(cpu-quota) run on CPU 0 only
+(cpu-quota) refuse quota longer than period
+(cpu-quota) refuse joining a missing group
+(cpu-quota) create group with 20 ms every 100 ms
+(cpu-quota) join group
+(cpu-quota) ran through several periods
+(cpu-quota) leave group
+(cpu-quota) end
+cpu-quota: exit(0)
+EOF
+pass;
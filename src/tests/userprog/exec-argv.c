@@ -0,0 +1,13 @@
+/* Passes arguments with spaces, and an empty one, to a child
+   through execv(), which does not split them. */
+
+#include <stddef.h>
+#include <syscall.h>
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char *argv[] = {"args", "two words", "", "last", NULL};
+  wait (execv ("child-args", argv));
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(exec-argv) begin
+(args) begin
+(args) argc = 4
+(args) argv[0] = 'args'
+(args) argv[1] = 'two words'
+(args) argv[2] = ''
+(args) argv[3] = 'last'
+(args) argv[4] = null
+(args) end
+child-args: exit(0)
+(exec-argv) end
+exec-argv: exit(0)
+EOF
+pass;
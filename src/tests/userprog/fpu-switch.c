@@ -0,0 +1,20 @@
+/* Loads a value into the FPU, runs a child process that loads
+   different values into its own FPU registers, and checks that
+   the value survived the context switches. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int in = 12345, out = 0;
+
+  asm volatile ("fninit; fildl %0" : : "m" (in));
+  CHECK (wait (exec ("child-fpu")) == 81, "wait for child-fpu");
+  asm volatile ("fistpl %0" : "=m" (out));
+  if (out != in)
+    fail ("FPU held %d, not %d, after child ran", out, in);
+  msg ("FPU state preserved");
+}
@@ -0,0 +1,48 @@
+/* Checks that memstat() reports consistent kernel memory usage and
+   that opening files shows up as more small blocks in use. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 16
+
+/* Returns the number of small blocks in use in ST. */
+static unsigned
+blocks_in_use (const struct memstat *st)
+{
+  unsigned total = 0;
+  unsigned i;
+
+  for (i = 0; i < st->class_cnt; i++)
+    total += st->classes[i].in_use;
+  return total;
+}
+
+void
+test_main (void)
+{
+  struct memstat before, after;
+  int fds[FILE_CNT];
+  unsigned i;
+
+  memstat (&before);
+  CHECK (before.kernel_used <= before.kernel_pages
+         && before.user_used <= before.user_pages, "pools add up");
+  CHECK (before.class_cnt > 0 && before.class_cnt <= MEMSTAT_CLASSES,
+         "size classes reported");
+  for (i = 0; i < before.class_cnt; i++)
+    if (i > 0 && before.classes[i].block_size
+                 != 2 * before.classes[i - 1].block_size)
+      fail ("class %u has %u-byte blocks", i, before.classes[i].block_size);
+
+  for (i = 0; i < FILE_CNT; i++)
+    fds[i] = open ("sample.txt");
+  memstat (&after);
+  if (blocks_in_use (&after) <= blocks_in_use (&before))
+    fail ("%u blocks in use before opening files, %u after",
+          blocks_in_use (&before), blocks_in_use (&after));
+  msg ("open files use heap blocks");
+  for (i = 0; i < FILE_CNT; i++)
+    close (fds[i]);
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(memstat) begin
+(memstat) pools add up
+(memstat) size classes reported
+(memstat) open files use heap blocks
+(memstat) end
+memstat: exit(0)
+EOF
+pass;
@@ -0,0 +1,59 @@
+/* Sends two whole pages and a few bytes through a pipe to a
+   forked child, which checks them and sees end of file once the
+   parent closes the write end.  Then checks that a write fails
+   once the read end is closed. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE 4096
+#define SIZE (2 * PAGE + 100)
+
+static char buf[SIZE];
+
+/* Reads the pipe's read end READ_FD in page-sized pieces and
+   returns 0 if it held exactly the bytes the parent sent. */
+static int
+child (int read_fd) 
+{
+  size_t ofs = 0;
+  int n;
+
+  while ((n = read (read_fd, buf + ofs, ofs + PAGE <= SIZE
+                    ? PAGE : SIZE - ofs)) > 0)
+    ofs += n;
+  if (n < 0 || ofs != SIZE)
+    return 1;
+  for (ofs = 0; ofs < SIZE; ofs++)
+    if (buf[ofs] != (char) (ofs * 7))
+      return 2;
+  return 0;
+}
+
+void
+test_main (void) 
+{
+  int fds[2];
+  pid_t pid;
+  size_t i;
+
+  CHECK (pipe (fds), "pipe");
+  CHECK ((pid = fork ()) != PID_ERROR, "fork");
+  if (pid == 0)
+    {
+      close (fds[1]);
+      exit (child (fds[0]));
+    }
+  close (fds[0]);
+  for (i = 0; i < SIZE; i++)
+    buf[i] = i * 7;
+  CHECK (write (fds[1], buf, SIZE) == SIZE, "write %d bytes", SIZE);
+  close (fds[1]);
+  CHECK (wait (pid) == 0, "child read the same bytes");
+
+  CHECK (pipe (fds), "pipe");
+  close (fds[0]);
+  CHECK (write (fds[1], buf, 1) == 0, "write with no reader fails");
+  close (fds[1]);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pipe-rw) begin
+(pipe-rw) pipe
+(pipe-rw) fork
+(pipe-rw) write 8292 bytes
+pipe-rw: exit(0)
+(pipe-rw) child read the same bytes
+(pipe-rw) pipe
+(pipe-rw) write with no reader fails
+(pipe-rw) end
+pipe-rw: exit(0)
+EOF
+pass;
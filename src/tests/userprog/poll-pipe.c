@@ -0,0 +1,52 @@
+/* Polls the two ends of a pipe: a timeout expires while the pipe
+   is empty, a forked child's write wakes a poll that would wait
+   forever, and closing the write end shows as a hang-up. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct pollfd pfd[2];
+  unsigned start;
+  int fds[2];
+  pid_t pid;
+  char c;
+
+  CHECK (pipe (fds), "pipe");
+  pfd[0].fd = fds[0];
+  pfd[0].events = POLLIN;
+  pfd[1].fd = fds[1];
+  pfd[1].events = POLLOUT;
+  CHECK (poll (pfd, 1, 0) == 0, "empty pipe is not readable");
+  CHECK (poll (pfd, 2, 0) == 1 && pfd[1].revents == POLLOUT,
+         "empty pipe is writable");
+
+  start = ticks ();
+  CHECK (poll (pfd, 1, 100) == 0, "poll times out");
+  CHECK (ticks () - start >= TICKS_PER_SEC / 10 - 1,
+         "timeout waited long enough");
+
+  CHECK ((pid = fork ()) != PID_ERROR, "fork");
+  if (pid == 0)
+    {
+      start = ticks ();
+      while (ticks () - start < TICKS_PER_SEC / 10)
+        continue;
+      exit (write (fds[1], "x", 1) == 1 ? 0 : 1);
+    }
+  CHECK (poll (pfd, 1, -1) == 1 && pfd[0].revents == POLLIN,
+         "child's write wakes poll");
+  CHECK (read (fds[0], &c, 1) == 1 && c == 'x', "read child's byte");
+  CHECK (wait (pid) == 0, "wait for child");
+
+  close (fds[1]);
+  CHECK (poll (pfd, 1, -1) == 1 && pfd[0].revents == POLLHUP,
+         "closed write end hangs up");
+  pfd[0].fd = 99;
+  CHECK (poll (pfd, 1, -1) == 1 && pfd[0].revents == POLLNVAL,
+         "bad fd is reported");
+  close (fds[0]);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(poll-pipe) begin
+(poll-pipe) pipe
+(poll-pipe) empty pipe is not readable
+(poll-pipe) empty pipe is writable
+(poll-pipe) poll times out
+(poll-pipe) timeout waited long enough
+(poll-pipe) fork
+(poll-pipe) child's write wakes poll
+(poll-pipe) read child's byte
+(poll-pipe) wait for child
+(poll-pipe) closed write end hangs up
+(poll-pipe) bad fd is reported
+(poll-pipe) end
+EOF
+pass;
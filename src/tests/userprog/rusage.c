@@ -0,0 +1,35 @@
+/* Checks that getrusage() charges a busy loop to the process and
+   reports a child's usage once it has been waited for. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  struct rusage self, thread, children;
+  unsigned start = ticks ();
+  volatile int i;
+
+  /* Spin in user code for a few ticks. */
+  while (ticks () - start < 5)
+    for (i = 0; i < 10000; i++)
+      continue;
+  CHECK (getrusage (RUSAGE_SELF, &self) == 0, "getrusage(RUSAGE_SELF)");
+  if (self.utime + self.stime < 5)
+    fail ("%u user and %u system ticks after spinning for 5",
+          self.utime, self.stime);
+  if (self.utime == 0)
+    fail ("no user ticks after spinning in user code");
+  CHECK (getrusage (RUSAGE_THREAD, &thread) == 0, "getrusage(RUSAGE_THREAD)");
+  if (thread.utime < self.utime)
+    fail ("thread has fewer user ticks than its process");
+
+  CHECK (getrusage (RUSAGE_CHILDREN, &children) == 0
+         && children.nvcsw == 0, "no children yet");
+  wait (exec ("child-simple"));
+  CHECK (getrusage (RUSAGE_CHILDREN, &children) == 0
+         && children.nvcsw > 0, "waited-for child counted");
+  CHECK (getrusage (42, &self) == -1, "getrusage(42) fails");
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rusage) begin
+(rusage) getrusage(RUSAGE_SELF)
+(rusage) getrusage(RUSAGE_THREAD)
+(rusage) no children yet
+(child-simple) run
+child-simple: exit(81)
+(rusage) waited-for child counted
+(rusage) getrusage(42) fails
+(rusage) end
+rusage: exit(0)
+EOF
+pass;
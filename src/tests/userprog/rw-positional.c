@@ -0,0 +1,33 @@
+/* Reads and writes sample.txt at offsets with pread() and pwrite()
+   and checks that the file position does not move. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char buf[sizeof sample];
+  int handle, byte_cnt;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  byte_cnt = pread (handle, buf, 20, 100);
+  if (byte_cnt != 20)
+    fail ("pread() returned %d instead of 20", byte_cnt);
+  compare_bytes (buf, sample + 100, 20, 100, "sample.txt");
+
+  byte_cnt = pwrite (handle, sample + 50, 30, 50);
+  if (byte_cnt != 30)
+    fail ("pwrite() returned %d instead of 30", byte_cnt);
+
+  byte_cnt = pread (handle, buf, sizeof buf, 200);
+  if (byte_cnt != sizeof sample - 1 - 200)
+    fail ("pread() past end returned %d instead of %zu",
+          byte_cnt, sizeof sample - 1 - 200);
+
+  CHECK (tell (handle) == 0, "file position is still 0");
+  check_file_handle (handle, "sample.txt", sample, sizeof sample - 1);
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rw-positional) begin
+(rw-positional) open "sample.txt"
+(rw-positional) file position is still 0
+(rw-positional) verified contents of "sample.txt"
+(rw-positional) end
+rw-positional: exit(0)
+EOF
+pass;
@@ -0,0 +1,42 @@
+/* Writes sample.txt's contents to a file in three fragments with
+   writev(), then reads it back into two buffers with readv(). */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char buf[sizeof sample];
+  struct iovec out[3], in[2];
+  int handle, byte_cnt;
+
+  out[0].iov_base = (char *) sample;
+  out[0].iov_len = 10;
+  out[1].iov_base = (char *) sample + 10;
+  out[1].iov_len = 0;
+  out[2].iov_base = (char *) sample + 10;
+  out[2].iov_len = sizeof sample - 1 - 10;
+  in[0].iov_base = buf;
+  in[0].iov_len = 100;
+  in[1].iov_base = buf + 100;
+  in[1].iov_len = sizeof buf - 100;
+
+  CHECK (create ("test.txt", 0), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+
+  byte_cnt = writev (handle, out, 3);
+  if (byte_cnt != sizeof sample - 1)
+    fail ("writev() returned %d instead of %zu", byte_cnt, sizeof sample - 1);
+
+  msg ("seek \"test.txt\" to 0");
+  seek (handle, 0);
+  memset (buf, 0, sizeof buf);
+  byte_cnt = readv (handle, in, 2);
+  if (byte_cnt != sizeof sample - 1)
+    fail ("readv() returned %d instead of %zu", byte_cnt, sizeof sample - 1);
+  compare_bytes (buf, sample, sizeof sample - 1, 0, "test.txt");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rw-vector) begin
+(rw-vector) create "test.txt"
+(rw-vector) open "test.txt"
+(rw-vector) seek "test.txt" to 0
+(rw-vector) end
+rw-vector: exit(0)
+EOF
+pass;
@@ -0,0 +1,26 @@
+/* Reserves CPU time with sched_setdeadline(), checks that
+   admission control refuses reservations that do not fit, and
+   that a deadline thread still gets to run. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  unsigned start;
+
+  CHECK (sched_setdeadline (100, 20), "reserve 20 ms every 100 ms");
+  CHECK (!sched_setdeadline (100, 100), "refuse the whole CPU");
+  CHECK (!sched_setdeadline (10, 20), "refuse budget longer than period");
+  CHECK (!sched_setdeadline (100, 0), "refuse empty budget");
+
+  /* Spin through several periods, running out of budget in each. */
+  start = ticks ();
+  while (ticks () - start < TICKS_PER_SEC / 2)
+    continue;
+  msg ("ran through several periods");
+
+  CHECK (sched_setdeadline (0, 0), "return to ordinary scheduling");
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sched-deadline) begin
+(sched-deadline) reserve 20 ms every 100 ms
+(sched-deadline) refuse the whole CPU
+(sched-deadline) refuse budget longer than period
+(sched-deadline) refuse empty budget
+(sched-deadline) ran through several periods
+(sched-deadline) return to ordinary scheduling
+(sched-deadline) end
+sched-deadline: exit(0)
+EOF
+pass;
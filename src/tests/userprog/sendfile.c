@@ -0,0 +1,39 @@
+/* Copies sample.txt to a new file with sendfile(), first from an
+   offset and then from the file position, and sends it through a
+   pipe as well. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char buf[sizeof sample];
+  int in, out, fds[2];
+  unsigned ofs = 100;
+  int size = sizeof sample - 1;
+
+  CHECK ((in = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (create ("copy", 0), "create \"copy\"");
+  CHECK ((out = open ("copy")) > 1, "open \"copy\"");
+
+  seek (out, 100);
+  CHECK (sendfile (out, in, &ofs, 1000) == size - 100,
+         "send from offset 100");
+  CHECK (ofs == (unsigned) size && tell (in) == 0,
+         "offset advanced, file position did not");
+  seek (out, 0);
+  CHECK (sendfile (out, in, NULL, 100) == 100, "send first 100 bytes");
+  CHECK (tell (in) == 100, "file position advanced");
+  close (out);
+  check_file ("copy", sample, size);
+
+  CHECK (pipe (fds), "pipe");
+  seek (in, 0);
+  CHECK (sendfile (fds[1], in, NULL, size) == size, "send into pipe");
+  CHECK (read (fds[0], buf, sizeof buf) == size, "read from pipe");
+  compare_bytes (buf, sample, size, 0, "pipe");
+  CHECK (sendfile (fds[1], fds[0], &ofs, 1) == -1, "refuse offset in pipe");
+}
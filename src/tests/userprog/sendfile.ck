@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sendfile) begin
+(sendfile) open "sample.txt"
+(sendfile) create "copy"
+(sendfile) open "copy"
+(sendfile) send from offset 100
+(sendfile) offset advanced, file position did not
+(sendfile) send first 100 bytes
+(sendfile) file position advanced
+(sendfile) open "copy" for verification
+(sendfile) verified contents of "copy"
+(sendfile) close "copy"
+(sendfile) pipe
+(sendfile) send into pipe
+(sendfile) read from pipe
+(sendfile) refuse offset in pipe
+(sendfile) end
+sendfile: exit(0)
+EOF
+pass;
@@ -0,0 +1,41 @@
+/* Sends two signals to a forked child that spins in user mode
+   until both handlers, inherited from the parent, have run. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static volatile int got;
+
+static void
+on_one (void) 
+{
+  got |= 1;
+}
+
+static void
+on_two (void) 
+{
+  got |= 2;
+}
+
+void
+test_main (void) 
+{
+  pid_t pid;
+
+  sigaction (SIGONE, on_one);
+  sigaction (SIGTWO, on_two);
+  CHECK ((pid = fork ()) != PID_ERROR, "fork");
+  if (pid == 0)
+    {
+      int spins = 0;
+      while (got != 3)
+        spins++;
+      exit (spins >= 0 ? got : -1);
+    }
+  msg ("send SIGONE and SIGTWO");
+  sendsig (pid, SIGONE);
+  sendsig (pid, SIGTWO);
+  CHECK (wait (pid) == 3, "child ran both handlers");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sig-deliver) begin
+(sig-deliver) fork
+(sig-deliver) send SIGONE and SIGTWO
+sig-deliver: exit(3)
+(sig-deliver) child ran both handlers
+(sig-deliver) end
+sig-deliver: exit(0)
+EOF
+pass;
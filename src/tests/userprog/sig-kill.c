@@ -0,0 +1,27 @@
+/* Kills a forked child that spins in user mode with SIGKILL, which
+   a handler cannot catch, and checks that it exits with -1. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static void
+on_kill (void) 
+{
+  exit (1);
+}
+
+void
+test_main (void) 
+{
+  pid_t pid;
+
+  sigaction (SIGKILL, on_kill);
+  CHECK ((pid = fork ()) != PID_ERROR, "fork");
+  if (pid == 0)
+    for (;;)
+      continue;
+  msg ("send SIGKILL");
+  sendsig (pid, SIGKILL);
+  CHECK (wait (pid) == -1, "child was killed");
+}
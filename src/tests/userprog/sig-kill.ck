@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sig-kill) begin
+(sig-kill) fork
+(sig-kill) send SIGKILL
+sig-kill: exit(-1)
+(sig-kill) child was killed
+(sig-kill) end
+sig-kill: exit(0)
+EOF
+pass;
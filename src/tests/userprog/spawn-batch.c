@@ -0,0 +1,51 @@
+/* Spawns several children at once, each with the write end of a
+   pipe as its descriptor 5, then collects a byte from each through
+   the pipe and their exit codes through wait(). */
+
+#include <stddef.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 4
+
+void
+test_main (void) 
+{
+  char *argv[CHILD_CNT][3];
+  char digits[CHILD_CNT][2];
+  pid_t pids[CHILD_CNT];
+  struct spawn_fd fd;
+  int fds[2];
+  int got = 0;
+  char c;
+  int i;
+
+  CHECK (pipe (fds), "pipe");
+  fd.child_fd = 5;
+  fd.parent_fd = fds[1];
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      digits[i][0] = '0' + i;
+      digits[i][1] = '\0';
+      argv[i][0] = "child-spawn";
+      argv[i][1] = digits[i];
+      argv[i][2] = NULL;
+      pids[i] = spawn ("child-spawn", argv[i], &fd, 1);
+      if (pids[i] == PID_ERROR)
+        fail ("spawn child %d", i);
+    }
+  msg ("spawned %d children", CHILD_CNT);
+  close (fds[1]);
+
+  while (read (fds[0], &c, 1) == 1)
+    got |= 1 << (c - '0');
+  CHECK (got == (1 << CHILD_CNT) - 1, "each child wrote its digit");
+  for (i = 0; i < CHILD_CNT; i++)
+    if (wait (pids[i]) != i)
+      fail ("wrong exit code from child %d", i);
+  msg ("each child exited with its digit");
+
+  CHECK (spawn ("no-such-file", argv[0], NULL, 0) == PID_ERROR,
+         "spawn of a missing file fails");
+}
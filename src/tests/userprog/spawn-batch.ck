@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(spawn-batch) begin
+(spawn-batch) pipe
+(spawn-batch) spawned 4 children
+(spawn-batch) each child wrote its digit
+(spawn-batch) each child exited with its digit
+(spawn-batch) spawn of a missing file fails
+(spawn-batch) end
+EOF
+pass;
@@ -0,0 +1,27 @@
+/* Reaps children with waitpid(), both polling with WNOHANG and
+   blocking for any child. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  pid_t pid, child;
+  int status;
+
+  pid = exec ("child-simple");
+  while ((child = waitpid (-1, &status, WNOHANG)) == 0)
+    continue;
+  msg ("waitpid(-1, WNOHANG) = %s, status %d",
+       child == pid ? "child" : "wrong", status);
+
+  pid = exec ("child-simple");
+  child = waitpid (-1, &status, 0);
+  msg ("waitpid(-1, 0) = %s, status %d",
+       child == pid ? "child" : "wrong", status);
+
+  msg ("waitpid(reaped) = %d", waitpid (pid, &status, WNOHANG));
+  msg ("waitpid(-1) = %d", waitpid (-1, &status, 0));
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(wait-any) begin
+(child-simple) run
+child-simple: exit(81)
+(wait-any) waitpid(-1, WNOHANG) = child, status 81
+(child-simple) run
+child-simple: exit(81)
+(wait-any) waitpid(-1, 0) = child, status 81
+(wait-any) waitpid(reaped) = -1
+(wait-any) waitpid(-1) = -1
+(wait-any) end
+wait-any: exit(0)
+EOF
+pass;
@@ -0,0 +1,19 @@
+/* Child process of shm-share.
+   Maps the parent's segment, checks what the parent stored in it
+   and replies in its second page. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SEG ((char *) 0x20000000)
+
+void
+test_main (void)
+{
+  CHECK (shm_map ("shm-seg", SEG) == SEG, "map segment");
+  CHECK (!strcmp (SEG, "hello"), "parent's data is visible");
+  strlcpy (SEG + 4096, "goodbye", 4096);
+  CHECK (shm_unmap (SEG), "unmap segment");
+}
@@ -0,0 +1,31 @@
+/* Child process of swap-exit.
+   Caps its resident frames so that touching many pages sends most
+   of them to swap, then exits with them still there. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_CNT 64
+#define PAGE 4096
+
+static char buf[PAGE_CNT * PAGE];
+
+void
+test_main (void)
+{
+  struct vmstat st;
+  size_t i;
+
+  vmstat (&st);
+  CHECK (setrlimit (RLIMIT_RSS, st.resident + 8), "limit resident frames");
+  for (i = 0; i < PAGE_CNT; i++)
+    buf[i * PAGE] = i;
+  vmstat (&st);
+  if (st.swap_slots == 0)
+    fail ("no pages in swap");
+  if (st.swap_used < st.swap_slots)
+    fail ("%u slots in use system-wide, %u owned", st.swap_used,
+          st.swap_slots);
+  msg ("pages went to swap");
+}
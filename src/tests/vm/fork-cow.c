@@ -0,0 +1,41 @@
+/* Forks a child that overwrites a buffer it shares copy-on-write
+   with its parent, and checks that each side sees its own data. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (64 * 1024)
+
+static char buf[SIZE];
+
+static void
+check_buf (char c) 
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != c)
+      fail ("byte %zu is %d instead of %d", i, buf[i], c);
+}
+
+void
+test_main (void)
+{
+  pid_t child;
+
+  memset (buf, 'a', sizeof buf);
+  CHECK ((child = fork ()) != PID_ERROR, "fork");
+  if (child == 0)
+    {
+      check_buf ('a');
+      memset (buf, 'b', sizeof buf);
+      check_buf ('b');
+      msg ("child wrote its copy");
+      exit (81);
+    }
+  CHECK (wait (child) == 81, "wait for child");
+  check_buf ('a');
+  msg ("parent's copy is unchanged");
+}
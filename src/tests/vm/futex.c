@@ -0,0 +1,76 @@
+/* Several threads increment a counter under a mutex built on
+   futex_wait() and futex_wake(), and the total must come out
+   exact. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define THREAD_CNT 4
+#define ITERS 2000
+
+/* 0: unlocked, 1: locked, 2: locked with waiters. */
+static int mutex;
+static volatile int counter;
+
+static void
+lock (void) 
+{
+  int c = __sync_val_compare_and_swap (&mutex, 0, 1);
+
+  if (c != 0)
+    {
+      if (c != 2)
+        c = __sync_lock_test_and_set (&mutex, 2);
+      while (c != 0)
+        {
+          futex_wait (&mutex, 2);
+          c = __sync_lock_test_and_set (&mutex, 2);
+        }
+    }
+}
+
+static void
+unlock (void) 
+{
+  if (__sync_fetch_and_sub (&mutex, 1) != 1)
+    {
+      mutex = 0;
+      futex_wake (&mutex, 1);
+    }
+}
+
+static void
+count (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < ITERS; i++)
+    {
+      int c;
+
+      lock ();
+      /* Widen the window for a preemption inside the lock. */
+      c = counter;
+      counter = c + 1;
+      unlock ();
+    }
+}
+
+void
+test_main (void)
+{
+  uthread_t tids[THREAD_CNT];
+  int i;
+
+  for (i = 0; i < THREAD_CNT; i++)
+    CHECK ((tids[i] = uthread_create (count, NULL)) != UTHREAD_ERROR,
+           "create thread %d", i);
+  for (i = 0; i < THREAD_CNT; i++)
+    CHECK (uthread_join (tids[i]) == 0, "join thread %d", i);
+  if (counter != THREAD_CNT * ITERS)
+    fail ("counter is %d instead of %d", counter, THREAD_CNT * ITERS);
+  msg ("counter is %d", counter);
+  msg ("futex_wait with a stale value: %d", futex_wait (&mutex, 1));
+  msg ("futex_wake with no waiters: %d", futex_wake (&mutex, 1));
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(futex) begin
+(futex) create thread 0
+(futex) create thread 1
+(futex) create thread 2
+(futex) create thread 3
+(futex) join thread 0
+(futex) join thread 1
+(futex) join thread 2
+(futex) join thread 3
+(futex) counter is 8000
+(futex) futex_wait with a stale value: -1
+(futex) futex_wake with no waiters: 0
+(futex) end
+futex: exit(0)
+EOF
+pass;
@@ -0,0 +1,68 @@
+/* Runs many green threads over a few workers, each yielding as it
+   goes, and passes a message through a pipe between two of them
+   while the reader waits without holding up its worker. */
+
+#include <gthread.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define WORKER_CNT 3
+#define THREAD_CNT 100
+#define YIELDS 10
+
+static int counter;
+static int fds[2];
+static char received[16];
+
+static void
+count (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < YIELDS; i++)
+    {
+      __sync_fetch_and_add (&counter, 1);
+      gthread_yield ();
+    }
+}
+
+static void
+reader (void *aux UNUSED) 
+{
+  gthread_read (fds[0], received, sizeof received);
+}
+
+static void
+writer (void *aux UNUSED) 
+{
+  int i;
+
+  /* Give the reader time to park. */
+  for (i = 0; i < YIELDS; i++)
+    gthread_yield ();
+  gthread_write (fds[1], "ping", 5);
+}
+
+static void
+start (void *aux UNUSED) 
+{
+  int i;
+
+  if (!gthread_create (reader, NULL) || !gthread_create (writer, NULL))
+    fail ("create pipe threads");
+  for (i = 0; i < THREAD_CNT; i++)
+    if (!gthread_create (count, NULL))
+      fail ("create thread %d", i);
+}
+
+void
+test_main (void)
+{
+  CHECK (pipe (fds), "create pipe");
+  gthread_run (WORKER_CNT, start, NULL);
+  msg ("all green threads exited");
+  CHECK (counter == THREAD_CNT * YIELDS, "counter is %d", counter);
+  CHECK (!strcmp (received, "ping"), "reader got \"%s\"", received);
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(gthread) begin
+(gthread) create pipe
+(gthread) all green threads exited
+(gthread) counter is 1000
+(gthread) reader got "ping"
+(gthread) end
+gthread: exit(0)
+EOF
+pass;
@@ -0,0 +1,66 @@
+/* Grows the heap with sbrk(), checks that its new pages read as
+   zeros and take no frames until touched, then uses malloc() and
+   free() on blocks of many sizes and checks that none overlap. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE 4096
+#define GROW (256 * PAGE)
+#define BLOCK_CNT 64
+
+static char *blocks[BLOCK_CNT];
+
+void
+test_main (void)
+{
+  struct vmstat st;
+  unsigned resident;
+  char *start, *p;
+  size_t i;
+
+  start = sbrk (0);
+  CHECK (start != (void *) -1, "find end of heap");
+  CHECK (sbrk (GROW) == start, "grow heap by 1 MB");
+  vmstat (&st);
+  resident = st.resident;
+  for (i = 0; i < GROW; i += PAGE)
+    if (start[i] != 0)
+      fail ("heap byte %zu is not zero", i);
+  start[GROW - 1] = 1;
+  vmstat (&st);
+  if (st.resident > resident + 2)
+    fail ("reading the heap took %u frames", st.resident - resident);
+  msg ("new heap reads as zeros");
+  CHECK (sbrk (-GROW) == start + GROW, "shrink heap");
+  CHECK (sbrk (-PAGE) == (void *) -1, "refuse to shrink below start");
+
+  for (i = 0; i < BLOCK_CNT; i++)
+    {
+      size_t size = 1 + (i * 997) % (3 * PAGE);
+      blocks[i] = malloc (size);
+      if (blocks[i] == NULL)
+        fail ("malloc of %zu bytes failed", size);
+      memset (blocks[i], i, size);
+    }
+  for (i = 0; i < BLOCK_CNT; i += 2)
+    free (blocks[i]);
+  for (i = 1; i < BLOCK_CNT; i += 2)
+    {
+      size_t size = 1 + (i * 997) % (3 * PAGE);
+      for (p = blocks[i]; p < blocks[i] + size; p++)
+        if (*p != (char) i)
+          fail ("block %zu was overwritten", i);
+      free (blocks[i]);
+    }
+  msg ("malloc blocks keep their data");
+
+  p = calloc (PAGE, 4);
+  CHECK (p != NULL && p[0] == 0 && p[4 * PAGE - 1] == 0, "calloc");
+  p = realloc (p, 8 * PAGE);
+  CHECK (p != NULL, "realloc");
+  free (p);
+}
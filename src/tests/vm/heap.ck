@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(heap) begin
+(heap) find end of heap
+(heap) grow heap by 1 MB
+(heap) new heap reads as zeros
+(heap) shrink heap
+(heap) refuse to shrink below start
+(heap) malloc blocks keep their data
+(heap) calloc
+(heap) realloc
+(heap) end
+heap: exit(0)
+EOF
+pass;
@@ -0,0 +1,45 @@
+/* Checks that a file's mapping and read() and write() see the
+   same data while the file stays mapped, since both go through
+   the page cache. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+#define PAGE 4096
+
+void
+test_main (void)
+{
+  static const char through_map[] = "written through the mapping";
+  static const char through_write[] = "written with write()";
+  char buf[sizeof through_map];
+  int handle;
+  mapid_t map;
+
+  CHECK (create ("coherent", 2 * PAGE), "create \"coherent\"");
+  CHECK ((handle = open ("coherent")) > 1, "open \"coherent\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"coherent\"");
+
+  /* Store through the mapping, read back with read(). */
+  memcpy (ACTUAL + 100, through_map, sizeof through_map);
+  seek (handle, 100);
+  CHECK (read (handle, buf, sizeof through_map) == sizeof through_map,
+         "read \"coherent\"");
+  if (memcmp (buf, through_map, sizeof through_map))
+    fail ("read() does not see store through mapping");
+
+  /* Write with write() to a resident page, load from the mapping. */
+  if (ACTUAL[PAGE + 200] != 0)
+    fail ("second page not zero");
+  seek (handle, PAGE + 200);
+  CHECK (write (handle, through_write, sizeof through_write)
+         == sizeof through_write, "write \"coherent\"");
+  if (memcmp (ACTUAL + PAGE + 200, through_write, sizeof through_write))
+    fail ("mapping does not see write()");
+
+  munmap (map);
+  close (handle);
+}
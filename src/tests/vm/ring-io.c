@@ -0,0 +1,100 @@
+/* Writes a file through the asynchronous I/O ring with several
+   requests in flight at once, syncs it, reads it back the same
+   way and checks both the completions and the data. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define RING ((void *) 0x10000000)
+#define ENTRIES 16
+#define BLOCK_CNT 8
+#define BLOCK_SIZE 512
+
+static char out[BLOCK_CNT][BLOCK_SIZE];
+static char in[BLOCK_CNT][BLOCK_SIZE];
+
+/* Queues a request on R, to be submitted by ring_enter(). */
+static void
+queue (struct ring *r, int op, int fd, void *buf, unsigned len,
+       unsigned offset, unsigned user_data)
+{
+  struct ring_sqe *sqe = &r->sq[r->sq_tail % r->entries];
+
+  sqe->op = op;
+  sqe->fd = fd;
+  sqe->buf = buf;
+  sqe->len = len;
+  sqe->offset = offset;
+  sqe->user_data = user_data;
+  r->sq_tail++;
+}
+
+/* Reads CNT completions from R, which must carry the user data 0
+   through CNT - 1 in any order, each with result RESULT. */
+static void
+reap (struct ring *r, unsigned cnt, int result)
+{
+  unsigned seen = 0;
+  unsigned i;
+
+  if (r->cq_tail - r->cq_head != cnt)
+    fail ("%u completions waiting, expected %u",
+          r->cq_tail - r->cq_head, cnt);
+  for (i = 0; i < cnt; i++)
+    {
+      struct ring_cqe *cqe = &r->cq[r->cq_head % r->entries];
+
+      if (cqe->user_data >= cnt || (seen & (1u << cqe->user_data)))
+        fail ("unexpected completion %u", cqe->user_data);
+      if (cqe->result != result)
+        fail ("request %u returned %d, expected %d",
+              cqe->user_data, cqe->result, result);
+      seen |= 1u << cqe->user_data;
+      r->cq_head++;
+    }
+}
+
+void
+test_main (void)
+{
+  struct ring *r;
+  int fd;
+  int i;
+
+  CHECK (ring_setup (ENTRIES - 1, RING) == NULL,
+         "refuse size not a power of 2");
+  CHECK ((r = ring_setup (ENTRIES, RING)) == RING, "ring_setup");
+  CHECK (ring_setup (ENTRIES, RING) == NULL, "refuse second ring");
+  CHECK (create ("ring", 0), "create \"ring\"");
+
+  queue (r, RING_OP_OPEN, 0, "ring", 0, 0, 0);
+  CHECK (ring_enter (1, 1) == 1, "submit open");
+  fd = r->cq[r->cq_head % r->entries].result;
+  CHECK (fd > 1, "open \"ring\"");
+  r->cq_head++;
+
+  for (i = 0; i < BLOCK_CNT; i++)
+    {
+      memset (out[i], 'a' + i, BLOCK_SIZE);
+      queue (r, RING_OP_PWRITE, fd, out[i], BLOCK_SIZE, i * BLOCK_SIZE, i);
+    }
+  CHECK (ring_enter (BLOCK_CNT, BLOCK_CNT) == BLOCK_CNT,
+         "submit %d writes", BLOCK_CNT);
+  reap (r, BLOCK_CNT, BLOCK_SIZE);
+
+  queue (r, RING_OP_FSYNC, fd, NULL, 0, 0, 0);
+  CHECK (ring_enter (1, 1) == 1, "submit fsync");
+  reap (r, 1, 0);
+
+  for (i = 0; i < BLOCK_CNT; i++)
+    queue (r, RING_OP_PREAD, fd, in[i], BLOCK_SIZE, i * BLOCK_SIZE, i);
+  CHECK (ring_enter (BLOCK_CNT, BLOCK_CNT) == BLOCK_CNT,
+         "submit %d reads", BLOCK_CNT);
+  reap (r, BLOCK_CNT, BLOCK_SIZE);
+  if (memcmp (in, out, sizeof out))
+    fail ("data read differs from data written");
+  CHECK (filesize (fd) == BLOCK_CNT * BLOCK_SIZE, "file size");
+  close (fd);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(ring-io) begin
+(ring-io) refuse size not a power of 2
+(ring-io) ring_setup
+(ring-io) refuse second ring
+(ring-io) create "ring"
+(ring-io) submit open
+(ring-io) open "ring"
+(ring-io) submit 8 writes
+(ring-io) submit fsync
+(ring-io) submit 8 reads
+(ring-io) file size
+(ring-io) end
+ring-io: exit(0)
+EOF
+pass;
@@ -0,0 +1,40 @@
+/* Caps the process's resident frames and open files, then checks
+   that touching many pages keeps it under the frame limit with its
+   data intact, and that opening a file past the file limit fails. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_CNT 64
+#define PAGE 4096
+
+static char buf[PAGE_CNT * PAGE];
+
+void
+test_main (void)
+{
+  struct vmstat st;
+  unsigned limit;
+  size_t i;
+
+  vmstat (&st);
+  limit = st.resident + 8;
+  CHECK (setrlimit (RLIMIT_RSS, limit), "limit resident frames");
+  CHECK (getrlimit (RLIMIT_RSS) == limit, "read limit back");
+
+  for (i = 0; i < PAGE_CNT; i++)
+    buf[i * PAGE] = i;
+  for (i = 0; i < PAGE_CNT; i++)
+    if (buf[i * PAGE] != (char) i)
+      fail ("page %zu lost its data", i);
+  vmstat (&st);
+  if (st.resident > limit)
+    fail ("%u frames resident, limit %u", st.resident, limit);
+  msg ("pages survive under the limit");
+
+  CHECK (setrlimit (RLIMIT_NOFILE, 1), "limit open files");
+  CHECK (open ("sample.txt") > 1, "open sample.txt");
+  CHECK (open ("sample.txt") == -1, "second open fails");
+  CHECK (!setrlimit (99, 0), "unknown resource");
+}
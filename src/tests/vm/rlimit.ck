@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rlimit) begin
+(rlimit) limit resident frames
+(rlimit) read limit back
+(rlimit) pages survive under the limit
+(rlimit) limit open files
+(rlimit) open sample.txt
+(rlimit) second open fails
+(rlimit) unknown resource
+(rlimit) end
+rlimit: exit(0)
+EOF
+pass;
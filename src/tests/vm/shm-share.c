@@ -0,0 +1,24 @@
+/* Shares a segment with a child process, which maps it at another
+   address, reads what the parent stored there and replies in the
+   segment's second page. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SEG ((char *) 0x10000000)
+
+void
+test_main (void)
+{
+  CHECK (shm_create ("shm-seg", 2 * 4096), "create segment");
+  CHECK (!shm_create ("shm-seg", 4096), "refuse duplicate name");
+  CHECK (shm_map ("shm-seg", SEG + 1) == NULL, "refuse misaligned map");
+  CHECK (shm_map ("shm-seg", SEG) == SEG, "map segment");
+  strlcpy (SEG, "hello", 4096);
+  CHECK (wait (exec ("child-shm")) == 0, "wait for child-shm");
+  CHECK (!strcmp (SEG + 4096, "goodbye"), "child's reply is visible");
+  CHECK (shm_unmap (SEG), "unmap segment");
+  CHECK (!shm_unmap (SEG), "refuse second unmap");
+}
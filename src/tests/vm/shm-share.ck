@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(shm-share) begin
+(shm-share) create segment
+(shm-share) refuse duplicate name
+(shm-share) refuse misaligned map
+(shm-share) map segment
+(child-shm) begin
+(child-shm) map segment
+(child-shm) parent's data is visible
+(child-shm) unmap segment
+(child-shm) end
+child-shm: exit(0)
+(shm-share) wait for child-shm
+(shm-share) child's reply is visible
+(shm-share) unmap segment
+(shm-share) refuse second unmap
+(shm-share) end
+shm-share: exit(0)
+EOF
+pass;
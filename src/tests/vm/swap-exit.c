@@ -0,0 +1,21 @@
+/* Runs a child process that exits with many of its pages in swap,
+   then checks that the child's swap slots were all released. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  struct vmstat before, after;
+
+  vmstat (&before);
+  CHECK (before.swap_used + before.swap_free > 0, "swap is present");
+  CHECK (wait (exec ("child-swap")) == 0, "wait for child-swap");
+  vmstat (&after);
+  if (after.swap_used != before.swap_used)
+    fail ("%u swap slots in use before child, %u after",
+          before.swap_used, after.swap_used);
+  msg ("child's swap slots released");
+}
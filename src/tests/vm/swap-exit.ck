@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(swap-exit) begin
+(swap-exit) swap is present
+(child-swap) begin
+(child-swap) limit resident frames
+(child-swap) pages went to swap
+(child-swap) end
+child-swap: exit(0)
+(swap-exit) wait for child-swap
+(swap-exit) child's swap slots released
+(swap-exit) end
+swap-exit: exit(0)
+EOF
+pass;
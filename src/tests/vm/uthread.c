@@ -0,0 +1,49 @@
+/* Runs several threads in one process, each filling its own part of
+   a shared buffer from its own stack, and checks the result after
+   joining them. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define THREAD_CNT 4
+#define PART_SIZE 4096
+
+static char buf[THREAD_CNT][PART_SIZE];
+static int ids[THREAD_CNT];
+
+static void
+fill (void *aux) 
+{
+  int id = *(int *) aux;
+  char local[PART_SIZE];
+
+  /* Goes through a page of this thread's stack. */
+  memset (local, 'a' + id, sizeof local);
+  memcpy (buf[id], local, sizeof local);
+}
+
+void
+test_main (void)
+{
+  uthread_t tids[THREAD_CNT];
+  int i, j;
+
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      ids[i] = i;
+      CHECK ((tids[i] = uthread_create (fill, &ids[i])) != UTHREAD_ERROR,
+             "create thread %d", i);
+    }
+  for (i = 0; i < THREAD_CNT; i++)
+    CHECK (uthread_join (tids[i]) == 0, "join thread %d", i);
+
+  for (i = 0; i < THREAD_CNT; i++)
+    for (j = 0; j < PART_SIZE; j++)
+      if (buf[i][j] != 'a' + i)
+        fail ("byte %d of part %d is %d", j, i, buf[i][j]);
+  msg ("shared buffer filled");
+
+  CHECK (uthread_join (tids[0]) == -1, "join thread 0 again");
+}
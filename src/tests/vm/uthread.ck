@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(uthread) begin
+(uthread) create thread 0
+(uthread) create thread 1
+(uthread) create thread 2
+(uthread) create thread 3
+(uthread) join thread 0
+(uthread) join thread 1
+(uthread) join thread 2
+(uthread) join thread 3
+(uthread) shared buffer filled
+(uthread) join thread 0 again
+(uthread) end
+uthread: exit(0)
+EOF
+pass;
@@ -0,0 +1,208 @@
+#include "threads/fpu.h"
+#include <debug.h>
+#include <round.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/slab.h"
+#include "threads/thread.h"
+
+/* Lazy saving of floating-point state.
+
+   The FPU registers belong to at most one thread, fpu_owner.
+   Switching to any other thread sets CR0.TS, so that its first
+   FPU or SSE instruction raises #NM.  fpu_trap() then saves the
+   owner's registers, loads the faulting thread's, and makes it
+   the owner.  A thread that never touches the FPU costs nothing
+   beyond the CR0 update, and has no save area: that is allocated
+   on its first #NM.
+
+   The kernel itself is compiled with -msoft-float and never
+   touches the FPU. */
+
+/* CR0 bits. */
+#define CR0_MP 0x00000002       /* Monitor coprocessor: WAIT obeys TS. */
+#define CR0_EM 0x00000004       /* Emulation: all FPU instructions trap. */
+#define CR0_TS 0x00000008       /* Task switched: next FPU use traps. */
+#define CR0_NE 0x00000020       /* Report FPU errors as #MF. */
+
+/* CR4 bits. */
+#define CR4_OSFXSR 0x00000200   /* FXSAVE, FXRSTOR and SSE enabled. */
+#define CR4_OSXMMEXCPT 0x00000400 /* SSE errors raise #XF. */
+
+/* CPUID leaf 1 EDX bit for FXSAVE and FXRSTOR. */
+#define CPUID_FXSR (1u << 24)
+
+/* Bytes saved by FXSAVE, which must be 16-byte aligned, and by
+   FNSAVE on processors that lack it. */
+#define FXSAVE_SIZE 512
+#define FNSAVE_SIZE 108
+#define FXSAVE_ALIGN 16
+
+/* Save areas, with room to align them. */
+static struct kmem_cache fpu_cache;
+
+/* Thread whose state the FPU registers hold, or a null
+   pointer. */
+static struct thread *fpu_owner;
+
+/* Use FXSAVE and FXRSTOR? */
+static bool use_fxsr;
+
+/* Is CR0.TS set? */
+static bool ts_set;
+
+static intr_handler_func fpu_trap;
+
+static inline uint32_t
+read_cr0 (void) 
+{
+  uint32_t cr0;
+  asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+  return cr0;
+}
+
+static inline void
+write_cr0 (uint32_t cr0) 
+{
+  asm volatile ("movl %0, %%cr0" : : "r" (cr0));
+}
+
+/* Returns the aligned save area within AREA. */
+static void *
+save_area (void *area) 
+{
+  return (void *) ROUND_UP ((uintptr_t) area, FXSAVE_ALIGN);
+}
+
+/* Saves the FPU registers into AREA. */
+static void
+fpu_save (void *area) 
+{
+  void *p = save_area (area);
+
+  if (use_fxsr)
+    asm volatile ("fxsave (%0)" : : "r" (p) : "memory");
+  else
+    asm volatile ("fnsave (%0)" : : "r" (p) : "memory");
+}
+
+/* Loads the FPU registers from AREA. */
+static void
+fpu_restore (void *area) 
+{
+  void *p = save_area (area);
+
+  if (use_fxsr)
+    asm volatile ("fxrstor (%0)" : : "r" (p) : "memory");
+  else
+    asm volatile ("frstor (%0)" : : "r" (p) : "memory");
+}
+
+/* Enables the FPU, and SSE if the processor has FXSAVE, for lazy
+   switching, and registers the #NM handler.  Must be called
+   after intr_init(). */
+void
+fpu_init (void) 
+{
+  uint32_t eax, ebx, ecx, edx;
+
+  asm volatile ("cpuid"
+                : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+                : "a" (1));
+  use_fxsr = (edx & CPUID_FXSR) != 0;
+  if (use_fxsr)
+    {
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4));
+    }
+
+  kmem_cache_init (&fpu_cache, "fpu state",
+                   (use_fxsr ? FXSAVE_SIZE : FNSAVE_SIZE) + FXSAVE_ALIGN - 1,
+                   NULL);
+  write_cr0 ((read_cr0 () & ~CR0_EM) | CR0_MP | CR0_NE | CR0_TS);
+  ts_set = true;
+
+  intr_register_int (7, 0, INTR_ON, fpu_trap,
+                     "#NM Device Not Available Exception");
+}
+
+/* Arms #NM for T, which is about to run, unless T owns the FPU
+   registers already.  Called by the scheduler with interrupts
+   off. */
+void
+fpu_switch (struct thread *t) 
+{
+  bool want_ts = t != fpu_owner;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (want_ts != ts_set)
+    {
+      if (want_ts)
+        write_cr0 (read_cr0 () | CR0_TS);
+      else
+        asm volatile ("clts");
+      ts_set = want_ts;
+    }
+}
+
+/* Releases the current thread's FPU state.  Called by
+   thread_exit() before the thread is destroyed. */
+void
+fpu_exit (void) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  void *area;
+
+  old_level = intr_disable ();
+  if (fpu_owner == cur)
+    fpu_owner = NULL;
+  area = cur->fpu;
+  cur->fpu = NULL;
+  intr_set_level (old_level);
+
+  if (area != NULL)
+    kmem_cache_free (&fpu_cache, area);
+}
+
+/* #NM handler: gives the FPU registers to the current thread,
+   saving the previous owner's state first. */
+static void
+fpu_trap (struct intr_frame *f UNUSED) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  bool fresh = false;
+
+  /* First use: allocate a save area, which may sleep. */
+  if (cur->fpu == NULL)
+    {
+      cur->fpu = kmem_cache_alloc (&fpu_cache);
+      if (cur->fpu == NULL)
+        {
+          printf ("%s: out of memory for FPU state\n", thread_name ());
+          thread_exit ();
+        }
+      fresh = true;
+    }
+
+  old_level = intr_disable ();
+  asm volatile ("clts");
+  ts_set = false;
+  if (fpu_owner != cur)
+    {
+      if (fpu_owner != NULL)
+        fpu_save (fpu_owner->fpu);
+      if (fresh)
+        asm volatile ("fninit");
+      else
+        fpu_restore (cur->fpu);
+      fpu_owner = cur;
+    }
+  intr_set_level (old_level);
+}
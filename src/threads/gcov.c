@@ -0,0 +1,126 @@
+#include "threads/gcov.h"
+
+#ifdef GCOV
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/malloc.h"
+
+/* From GCC's <gcov.h>, which -nostdinc keeps out of reach. */
+struct gcov_info;
+void __gcov_info_to_gcda (const struct gcov_info *,
+                          void (*filename_fn) (const char *, void *),
+                          void (*dump_fn) (const void *, unsigned, void *),
+                          void *(*allocate_fn) (unsigned, void *),
+                          void *arg);
+
+/* Pointers to the profile of each object file, which
+   -fprofile-info-section puts in the .gcov_info section and
+   kernel.lds.S brackets with these symbols. */
+extern const struct gcov_info *const __gcov_info_start[];
+extern const struct gcov_info *const __gcov_info_end[];
+
+/* Bytes of profile data per line of output. */
+#define LINE_BYTES 32
+
+/* Profile data waiting to be printed. */
+static uint8_t line[LINE_BYTES];
+static size_t line_cnt;
+
+static void flush_line (void);
+
+/* Called by __gcov_info_to_gcda() with the .gcda file name that
+   the profile that follows belongs in. */
+static void
+dump_filename (const char *name, void *aux UNUSED) 
+{
+  printf ("gcov: %s\n", name);
+}
+
+/* Called by __gcov_info_to_gcda() with SIZE bytes of .gcda file
+   data at DATA. */
+static void
+dump_data (const void *data_, unsigned size, void *aux UNUSED) 
+{
+  const uint8_t *data = data_;
+
+  while (size-- > 0)
+    {
+      line[line_cnt++] = *data++;
+      if (line_cnt == LINE_BYTES)
+        flush_line ();
+    }
+}
+
+/* Called by __gcov_info_to_gcda() for memory it needs. */
+static void *
+dump_allocate (unsigned size, void *aux UNUSED) 
+{
+  return malloc (size);
+}
+
+/* Prints the profile data waiting in LINE, in hex. */
+static void
+flush_line (void) 
+{
+  size_t i;
+
+  if (line_cnt == 0)
+    return;
+  printf ("gcov-data: ");
+  for (i = 0; i < line_cnt; i++)
+    printf ("%02x", line[i]);
+  printf ("\n");
+  line_cnt = 0;
+}
+
+/* Prints the branch counts of every object file in the kernel. */
+void
+gcov_dump (void) 
+{
+  const struct gcov_info *const *info;
+
+  for (info = __gcov_info_start; info < __gcov_info_end; info++)
+    {
+      __gcov_info_to_gcda (*info, dump_filename, dump_data,
+                           dump_allocate, NULL);
+      flush_line ();
+    }
+  printf ("gcov: end\n");
+}
+
+/* libgcov's version of this merges counts with an existing .gcda
+   file, which utils/pintos-gcov does on the host instead.  Having
+   our own keeps the rest of libgcov, which needs a C library, out
+   of the kernel. */
+void __gcov_merge_add (int64_t *, unsigned);
+
+void
+__gcov_merge_add (int64_t *counters UNUSED, unsigned cnt UNUSED) 
+{
+  NOT_REACHED ();
+}
+
+/* __gcov_info_to_gcda() refers to these for value profiles, which
+   -fprofile-arcs does not collect. */
+void abort (void) NO_RETURN;
+void *mmap (void *, size_t, int, int, int, long);
+
+void
+abort (void) 
+{
+  PANIC ("gcov: abort");
+}
+
+void *
+mmap (void *addr UNUSED, size_t size UNUSED, int prot UNUSED,
+      int flags UNUSED, int fd UNUSED, long ofs UNUSED) 
+{
+  return (void *) -1;
+}
+#else /* !GCOV */
+void
+gcov_dump (void) 
+{
+}
+#endif /* !GCOV */
@@ -0,0 +1,11 @@
+#ifndef THREADS_GCOV_H
+#define THREADS_GCOV_H
+
+/* Profile-guided optimization.  A kernel built with "make opt
+   PGO=gen" counts how often each branch is taken; gcov_dump()
+   prints the counts, which utils/pintos-gcov turns back into the
+   .gcda files that "make opt PGO=use" reads.  In any other kernel
+   it does nothing. */
+void gcov_dump (void);
+
+#endif /* threads/gcov.h */
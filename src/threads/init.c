@@ -15,32 +15,51 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
+#include "threads/mp.h"
 #include "threads/palloc.h"
+#include "threads/profile.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/tunable.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
+#include "userprog/futex.h"
 #include "userprog/gdt.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
 #else
 #include "tests/threads/tests.h"
 #endif
+#include "tests/bench/bench.h"
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/virtio-blk.h"
+#include "devices/ramdisk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/shm.h"
+#include "vm/swap.h"
+#endif
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
 
+/* Whether the CPU allows 4 MB pages. */
+bool init_large_pages;
+
 #ifdef FILESYS
 /* -f: Format the file system? */
 static bool format_filesys;
@@ -49,6 +68,9 @@ static bool format_filesys;
    overriding the defaults. */
 static const char *filesys_bdev_name;
 static const char *scratch_bdev_name;
+
+/* -ramdisk: Size of the RAM disk in kB, or 0 for none. */
+static size_t ramdisk_kb;
 #ifdef VM
 static const char *swap_bdev_name;
 #endif
@@ -57,13 +79,42 @@ static const char *swap_bdev_name;
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+/* -trace: Record trace events? */
+static bool trace_requested;
+
+/* -profile: Sample the running code on every timer tick? */
+static bool profile_requested;
+
+/* -boottime: Print how long each phase of booting took? */
+static bool boottime_requested;
+
+/* -serial-actions: Once booted, read the actions from the serial
+   port instead of taking them from the kernel command line? */
+static bool serial_actions;
+
+/* Phases of booting, each recorded by boot_phase() as it ends,
+   and the time-stamp counter when the last one ended. */
+#define BOOT_PHASE_MAX 32
+struct boot_phase
+  {
+    const char *name;           /* What ran. */
+    uint64_t cycles;            /* How long it took. */
+  };
+static struct boot_phase boot_phases[BOOT_PHASE_MAX];
+static size_t boot_phase_cnt;
+static uint64_t boot_phase_end;
+
 static void bss_init (void);
 static void paging_init (void);
 
 static char **read_command_line (void);
+static char **read_serial_actions (void);
+static void print_words (const char *heading, char **argv);
 static char **parse_options (char **argv);
 static void run_actions (char **argv);
 static void usage (void);
+static void boot_phase (const char *name);
+static void print_boot_phases (void);
 
 #ifdef FILESYS
 static void locate_block_devices (void);
@@ -80,6 +131,7 @@ main (void)
 
   /* Clear BSS. */  
   bss_init ();
+  boot_phase ("firmware and loader");
 
   /* Break command line into arguments and parse options. */
   argv = read_command_line ();
@@ -93,11 +145,26 @@ main (void)
   /* Greet user. */
   printf ("Pintos booting with %'"PRIu32" kB RAM...\n",
           init_ram_pages * PGSIZE / 1024);
+  boot_phase ("thread_init, console_init");
 
   /* Initialize memory system. */
   palloc_init (user_page_limit);
+  boot_phase ("palloc_init");
   malloc_init ();
+  boot_phase ("malloc_init");
   paging_init ();
+  boot_phase ("paging_init");
+  mp_init ();
+  if (trace_requested)
+    trace_init ();
+  if (profile_requested)
+    profile_init ();
+#ifdef VM
+  frame_table_init ();
+  vm_page_init ();
+  vm_shm_init ();
+  boot_phase ("frame_table_init, vm_page_init, vm_shm_init");
+#endif
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -107,29 +174,52 @@ main (void)
 
   /* Initialize interrupt handlers. */
   intr_init ();
+  fpu_init ();
   timer_init ();
   kbd_init ();
   input_init ();
 #ifdef USERPROG
   exception_init ();
   syscall_init ();
+  process_init ();
+  futex_init ();
 #endif
+  boot_phase ("interrupt handlers");
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
   serial_init_queue ();
+  workqueue_init ();
+  boot_phase ("thread_start");
   timer_calibrate ();
+  boot_phase ("timer_calibrate");
 
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init ();
+  boot_phase ("ide_init");
+  virtio_blk_init ();
+  boot_phase ("virtio_blk_init");
+  ramdisk_init (ramdisk_kb);
   locate_block_devices ();
+  boot_phase ("locate_block_devices");
   filesys_init (format_filesys);
+  boot_phase ("filesys_init");
+#endif
+#ifdef VM
+  vm_swap_init (swap_bdev_name);
+  frame_cleaner_init ();
+  boot_phase ("vm_swap_init, frame_cleaner_init");
 #endif
 
+  tunable_check ();
   printf ("Boot complete.\n");
+  if (boottime_requested)
+    print_boot_phases ();
   
   /* Run actions specified on kernel command line. */
+  if (serial_actions)
+    argv = read_serial_actions ();
   run_actions (argv);
 
   /* Finish up. */
@@ -150,17 +240,43 @@ bss_init (void)
   memset (&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/* CR4 bits. */
+#define CR4_PSE 0x00000010      /* 4 MB pages allowed in PDEs. */
+#define CR4_PGE 0x00000080      /* Global pages enabled. */
+
+/* CPUID leaf 1 EDX bits for CR4_PSE and CR4_PGE. */
+#define CPUID_PSE (1u << 3)
+#define CPUID_PGE (1u << 13)
+
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   Where the processor allows, and unless threads have guard pages
+   (see THREAD_PAGES in threads/thread.h), each 4 MB of RAM that
+   holds no kernel text, which must stay read-only, is mapped by a single
+   large page, and all kernel mappings are global, so that they
+   survive the CR3 load on a switch between processes. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
+  uint32_t eax, ebx, ecx, edx;
+  uint32_t cr4, global;
+  bool use_pse, map_large;
   size_t page;
   extern char _start, _end_kernel_text;
 
+  asm volatile ("cpuid"
+                : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+                : "a" (1));
+  use_pse = init_large_pages = (edx & CPUID_PSE) != 0;
+  global = edx & CPUID_PGE ? PTE_G : 0;
+
+  /* Threads' guard pages must be unmapped one at a time. */
+  map_large = use_pse && THREAD_PAGES == 1;
+
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
   for (page = 0; page < init_ram_pages; page++)
@@ -171,13 +287,30 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (map_large && pte_idx == 0 && page + PTSPAN / PGSIZE <= init_ram_pages
+          && (vaddr + PTSPAN <= &_start || vaddr >= &_end_kernel_text))
+        {
+          pd[pde_idx] = paddr | PTE_PS | PTE_P | PTE_W | global;
+          page += PTSPAN / PGSIZE - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text) | global;
+    }
+
+  /* 4 MB pages must be allowed before the page directory is
+     loaded, and global pages are enabled once it is. */
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  if (use_pse)
+    {
+      cr4 |= CR4_PSE;
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4));
     }
 
   /* Store the physical address of the page directory into CR3
@@ -186,6 +319,12 @@ paging_init (void)
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
      of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
+
+  if (global)
+    {
+      cr4 |= CR4_PGE;
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4));
+    }
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -211,18 +350,76 @@ read_command_line (void)
     }
   argv[argc] = NULL;
 
-  /* Print kernel command line. */
-  printf ("Kernel command line:");
-  for (i = 0; i < argc; i++)
-    if (strchr (argv[i], ' ') == NULL)
-      printf (" %s", argv[i]);
-    else
-      printf (" '%s'", argv[i]);
-  printf ("\n");
+  print_words ("Kernel command line", argv);
+  return argv;
+}
+
+/* Reads a line of actions from the serial port, as sent
+   by the pintos script's --snapshot mode to a kernel resumed
+   from a snapshot taken while it waited here, and breaks it
+   into words.  Words are separated by spaces, except within
+   single quotes. */
+static char **
+read_serial_actions (void)
+{
+  static char line[LOADER_ARGS_LEN];
+  static char *argv[LOADER_ARGS_LEN / 2 + 1];
+  char *src, *dst;
+  size_t len = 0;
+  int argc = 0;
+
+  printf ("Waiting for actions on serial port.\n");
+  for (;;)
+    {
+      uint8_t c = input_getc ();
+      if (c == '\n' || c == '\r')
+        break;
+      if (len >= sizeof line - 1)
+        PANIC ("actions overflow");
+      line[len++] = c;
+    }
+  line[len] = '\0';
+
+  /* Words are unquoted in place, so DST never passes SRC. */
+  for (src = dst = line; *src != '\0'; )
+    {
+      bool quoted = false;
+
+      if (*src == ' ')
+        {
+          src++;
+          continue;
+        }
+      argv[argc++] = dst;
+      for (; *src != '\0' && (quoted || *src != ' '); src++)
+        if (*src == '\'')
+          quoted = !quoted;
+        else
+          *dst++ = *src;
+      if (*src != '\0')
+        src++;
+      *dst++ = '\0';
+    }
+  argv[argc] = NULL;
 
+  print_words ("Actions", argv);
   return argv;
 }
 
+/* Prints HEADING and then the words in ARGV[], quoting those
+   that contain spaces. */
+static void
+print_words (const char *heading, char **argv)
+{
+  printf ("%s:", heading);
+  for (; *argv != NULL; argv++)
+    if (strchr (*argv, ' ') == NULL)
+      printf (" %s", *argv);
+    else
+      printf (" '%s'", *argv);
+  printf ("\n");
+}
+
 /* Parses options in ARGV[]
    and returns the first non-option argument. */
 static char **
@@ -247,18 +444,62 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-ramdisk"))
+        ramdisk_kb = atoi (value);
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
+      else if (!strcmp (name, "-vmstat"))
+        vm_print_stats = true;
+      else if (!strcmp (name, "-merge"))
+        frame_merge_enabled = true;
+      else if (!strcmp (name, "-loadctl"))
+        frame_loadctl_enabled = true;
+      else if (!strcmp (name, "-largepages"))
+        vm_large_pages = true;
 #endif
 #endif
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-schedstat"))
+        thread_sched_stats = true;
+      else if (!strcmp (name, "-trace"))
+        trace_requested = true;
+      else if (!strcmp (name, "-profile"))
+        profile_requested = true;
+      else if (!strcmp (name, "-lockstat"))
+        lock_stats_enabled = true;
+      else if (!strcmp (name, "-memstat"))
+        malloc_stats_enabled = true;
+      else if (!strcmp (name, "-intrstat"))
+        intr_stats_enabled = true;
+      else if (!strcmp (name, "-boottime"))
+        boottime_requested = true;
+      else if (!strcmp (name, "-serial-actions"))
+        serial_actions = true;
+      else if (!strcmp (name, "-o"))
+        {
+          /* Takes NAME=VALUE as the next argument or after "=". */
+          const char *assignment = value != NULL ? value : argv[1];
+          if (assignment == NULL || !tunable_set (assignment))
+            PANIC ("-o needs NAME=VALUE");
+          if (value == NULL)
+            argv++;
+        }
+      else if (!strcmp (name, "-calibrate"))
+        {
+          char *cycles = value != NULL ? strchr (value, ',') : NULL;
+          if (cycles == NULL)
+            PANIC ("-calibrate needs LOOPS,CYCLES");
+          timer_preset_calibration (atoi (value), atoi (cycles + 1));
+        }
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+      else if (!strcmp (name, "-rusage"))
+        process_print_usage = true;
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -292,6 +533,22 @@ run_task (char **argv)
   printf ("Execution of '%s' complete.\n", task);
 }
 
+/* Runs the benchmark named in ARGV[1]. */
+static void
+run_benchmark (char **argv)
+{
+  run_bench (argv[1]);
+}
+
+#ifdef VM
+/* Adds the swap device named in ARGV[1]. */
+static void
+run_swapon (char **argv)
+{
+  vm_swap_add_devices (argv[1]);
+}
+#endif
+
 /* Executes all of the actions specified in ARGV[]
    up to the null pointer sentinel. */
 static void
@@ -309,12 +566,17 @@ run_actions (char **argv)
   static const struct action actions[] = 
     {
       {"run", 2, run_task},
+      {"bench", 2, run_benchmark},
 #ifdef FILESYS
       {"ls", 1, fsutil_ls},
       {"cat", 2, fsutil_cat},
       {"rm", 2, fsutil_rm},
       {"extract", 1, fsutil_extract},
       {"append", 2, fsutil_append},
+      {"defrag", 1, fsutil_defrag},
+#endif
+#ifdef VM
+      {"swapon", 2, run_swapon},
 #endif
       {NULL, 0, NULL},
     };
@@ -343,6 +605,41 @@ run_actions (char **argv)
   
 }
 
+/* Records that the boot phase NAME, which should be a string
+   literal, has just ended. */
+static void
+boot_phase (const char *name)
+{
+  uint64_t now = timer_cycles ();
+
+  if (boot_phase_cnt < BOOT_PHASE_MAX)
+    {
+      boot_phases[boot_phase_cnt].name = name;
+      boot_phases[boot_phase_cnt].cycles = now - boot_phase_end;
+      boot_phase_cnt++;
+    }
+  boot_phase_end = now;
+}
+
+/* Prints the time taken by each boot phase.  Must be called
+   after timer_calibrate(). */
+static void
+print_boot_phases (void)
+{
+  uint64_t total = 0;
+  size_t i;
+
+  for (i = 0; i < boot_phase_cnt; i++)
+    total += boot_phases[i].cycles;
+  printf ("Boot profile: %"PRId64" us since CPU reset\n",
+          timer_cycles_to_us (total));
+  for (i = 0; i < boot_phase_cnt; i++)
+    printf ("  %10"PRId64" us %3d%%  %s\n",
+            timer_cycles_to_us (boot_phases[i].cycles),
+            (int) (boot_phases[i].cycles * 100 / (total > 0 ? total : 1)),
+            boot_phases[i].name);
+}
+
 /* Prints a kernel command line help message and powers off the
    machine. */
 static void
@@ -357,10 +654,15 @@ usage (void)
 #else
           "  run TEST           Run TEST.\n"
 #endif
+          "  bench NAME         Run benchmark NAME, or `all'.\n"
 #ifdef FILESYS
           "  ls                 List files in the root directory.\n"
           "  cat FILE           Print FILE to the console.\n"
           "  rm FILE            Delete FILE.\n"
+          "  defrag             Make each file's sectors contiguous.\n"
+#ifdef VM
+          "  swapon BDEV[:PRIO] Add BDEV as a swap device, as for -swap.\n"
+#endif
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  extract            Untar from scratch device into file system.\n"
           "  append FILE        Append FILE to tar file on scratch device.\n"
@@ -373,14 +675,56 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -ramdisk=KB        Create KB kB RAM disk ram0, e.g. for -swap.\n"
 #ifdef VM
-          "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+          "  -swap=BDEV[:PRIO],...\n"
+          "                     Use BDEVs for swap instead of every swap\n"
+          "                     partition, higher PRIO (default 0) first,\n"
+          "                     striped among equal PRIO.\n"
+          "  -vmstat            Print paging statistics at process exit.\n"
+          "  -merge             Share identical anonymous pages copy-on-write.\n"
+          "  -loadctl           Suspend processes whose memory demand thrashes.\n"
+          "  -largepages        Map large zero-fill regions with 4 MB pages.\n"
 #endif
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -schedstat         Print scheduling latency statistics at shutdown.\n"
+          "  -trace             Record trace events, print them at shutdown.\n"
+          "  -profile           Sample kernel code, print a histogram at shutdown.\n"
+          "  -lockstat          Print lock contention statistics at shutdown.\n"
+          "  -memstat           Print kernel heap and page pool usage at shutdown.\n"
+          "  -intrstat          Print interrupt handler and masking times at shutdown.\n"
+          "  -boottime          Print how long each phase of booting took.\n"
+          "  -serial-actions    Once booted, read actions from the serial port.\n"
+          "  -calibrate=L,C     Skip timer calibration, using L loops and C TSC\n"
+          "                     cycles per tick as printed by an earlier boot.\n"
+          "  -o NAME=VALUE      Set tunable NAME to VALUE:\n"
+          "                       time_slice     Ticks per time slice (4).\n"
+          "                       tickless_min   Fewest idle ticks to stop the\n"
+          "                                      periodic timer for (2).\n"
+          "                       input_buf      Bytes of buffered keyboard and\n"
+          "                                      serial input, a power of 2 (1024).\n"
+#ifdef FILESYS
+          "                       read_ahead_max Sectors read ahead of a\n"
+          "                                      sequential reader (8).\n"
+          "                       block_size     Bytes per logical block for -f:\n"
+          "                                      512, 1024, 2048 or 4096 (512).\n"
+          "                       fsck           Check the file system at mount:\n"
+          "                                      0 = never, 1 = after an unclean\n"
+          "                                      shutdown, 2 = always (1).\n"
+          "                       fsck_threads   Threads that share the check (4).\n"
+          "                       defrag_interval Seconds between background\n"
+          "                                      defragmentation passes (0 = off).\n"
+#endif
+#ifdef VM
+          "                       mmf_prefetch   Pages read ahead of a fault in a\n"
+          "                                      MADV_SEQUENTIAL mapping (4).\n"
+          "                       exec_prefetch  Pages read in at exec (8).\n"
+#endif
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+          "  -rusage            Print resource usage at process exit.\n"
 #endif
           );
   shutdown_power_off ();
@@ -393,9 +737,6 @@ locate_block_devices (void)
 {
   locate_block_device (BLOCK_FILESYS, filesys_bdev_name);
   locate_block_device (BLOCK_SCRATCH, scratch_bdev_name);
-#ifdef VM
-  locate_block_device (BLOCK_SWAP, swap_bdev_name);
-#endif
 }
 
 /* Figures out what block device to use for the given ROLE: the
@@ -9,6 +9,10 @@
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "devices/timer.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#include "userprog/signal.h"
+#endif
 
 /* Programmable Interrupt Controller (PIC) registers.
    A PC has two PICs, called the master and slave PICs, with the
@@ -37,6 +41,19 @@ static const char *intr_names[INTR_CNT];
    unexpected interrupt is one that has no registered handler. */
 static unsigned int unexpected_cnt[INTR_CNT];
 
+/* Interrupt statistics, kept if intr_stats_enabled is true: for
+   each vector, how often its handler ran and the time-stamp
+   counter cycles it took, and how long interrupts stayed off. */
+bool intr_stats_enabled;
+static uint64_t handler_cnt[INTR_CNT];
+static uint64_t handler_cycles[INTR_CNT];
+static uint64_t handler_max_cycles[INTR_CNT];
+static uint64_t off_start;              /* When they went off, or 0. */
+static uint64_t off_cycles;             /* Total time off. */
+static uint64_t off_max_cycles;         /* Longest time off. */
+static uint64_t deferred_cnt;           /* Deferred work calls. */
+static uint64_t deferred_cycles;        /* Time spent in them. */
+
 /* External interrupts are those generated by devices outside the
    CPU, such as the timer.  External interrupts run with
    interrupts turned off, so they never nest, nor are they ever
@@ -47,6 +64,13 @@ static unsigned int unexpected_cnt[INTR_CNT];
 static bool in_external_intr;   /* Are we processing an external interrupt? */
 static bool yield_on_return;    /* Should we yield on interrupt return? */
 
+/* Deferred work queued by external interrupt handlers, and
+   whether it is being run.  It runs with interrupts on, so other
+   external interrupts may arrive meanwhile; those leave their own
+   deferred work and any yield to the outermost interrupt. */
+static struct list deferred_list;
+static bool in_deferred;
+
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
 static void pic_end_of_interrupt (int irq);
@@ -59,6 +83,12 @@ static inline uint64_t make_idtr_operand (uint16_t limit, void *base);
 /* Interrupt handlers. */
 void intr_handler (struct intr_frame *args);
 static void unexpected_interrupt (const struct intr_frame *);
+
+static void run_deferred (void);
+
+/* Interrupt statistics helpers. */
+static void off_begin (void);
+static void off_end (void);
 
 /* Returns the current interrupt status. */
 enum intr_level
@@ -88,7 +118,10 @@ enum intr_level
 intr_enable (void) 
 {
   enum intr_level old_level = intr_get_level ();
-  ASSERT (!intr_context ());
+  ASSERT (!in_external_intr);
+
+  if (intr_stats_enabled && old_level == INTR_OFF)
+    off_end ();
 
   /* Enable interrupts by setting the interrupt flag.
 
@@ -110,6 +143,8 @@ intr_disable (void)
      Hardware Interrupts". */
   asm volatile ("cli" : : : "memory");
 
+  if (intr_stats_enabled && old_level == INTR_ON)
+    off_begin ();
   return old_level;
 }
 
@@ -122,6 +157,7 @@ intr_init (void)
 
   /* Initialize interrupt controller. */
   pic_init ();
+  list_init (&deferred_list);
 
   /* Initialize IDT. */
   for (i = 0; i < INTR_CNT; i++)
@@ -206,24 +242,52 @@ intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
   register_handler (vec_no, dpl, level, handler, name);
 }
 
-/* Returns true during processing of an external interrupt
-   and false at all other times. */
+/* Returns true during processing of an external interrupt or
+   of its deferred work and false at all other times. */
 bool
 intr_context (void) 
 {
-  return in_external_intr;
+  return in_external_intr || in_deferred;
 }
 
-/* During processing of an external interrupt, directs the
-   interrupt handler to yield to a new process just before
-   returning from the interrupt.  May not be called at any other
-   time. */
+/* During processing of an external interrupt or its deferred
+   work, directs the interrupt handler to yield to a new process
+   just before returning from the interrupt.  May not be called at
+   any other time. */
 void
 intr_yield_on_return (void) 
 {
   ASSERT (intr_context ());
   yield_on_return = true;
 }
+
+/* Initializes D to call FUNC (AUX) when deferred. */
+void
+intr_deferred_init (struct intr_deferred *d,
+                    void (*func) (void *aux), void *aux) 
+{
+  ASSERT (d != NULL && func != NULL);
+
+  d->func = func;
+  d->aux = aux;
+  d->pending = false;
+}
+
+/* Queues D to run when the current external interrupt returns,
+   unless it is already queued.  Called outside an interrupt, D
+   runs when the next one returns. */
+void
+intr_defer (struct intr_deferred *d) 
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (!d->pending)
+    {
+      d->pending = true;
+      list_push_back (&deferred_list, &d->elem);
+    }
+  intr_set_level (old_level);
+}
 
 /* 8259A Programmable Interrupt Controller. */
 
@@ -355,15 +419,34 @@ intr_handler (struct intr_frame *frame)
   if (external) 
     {
       ASSERT (intr_get_level () == INTR_OFF);
-      ASSERT (!intr_context ());
+      ASSERT (!in_external_intr);
 
       in_external_intr = true;
-      yield_on_return = false;
+      if (!in_deferred)
+        yield_on_return = false;
     }
 
+  /* An interrupt gate turned interrupts off in code that had them
+     on. */
+  if (intr_stats_enabled && (frame->eflags & FLAG_IF)
+      && intr_get_level () == INTR_OFF)
+    off_begin ();
+
   /* Invoke the interrupt's handler. */
   handler = intr_handlers[frame->vec_no];
-  if (handler != NULL)
+  if (handler != NULL && intr_stats_enabled)
+    {
+      uint64_t start = timer_cycles ();
+      uint64_t cycles;
+
+      handler (frame);
+      cycles = timer_cycles () - start;
+      handler_cnt[frame->vec_no]++;
+      handler_cycles[frame->vec_no] += cycles;
+      if (cycles > handler_max_cycles[frame->vec_no])
+        handler_max_cycles[frame->vec_no] = cycles;
+    }
+  else if (handler != NULL)
     handler (frame);
   else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f)
     {
@@ -383,9 +466,106 @@ intr_handler (struct intr_frame *frame)
       in_external_intr = false;
       pic_end_of_interrupt (frame->vec_no); 
 
-      if (yield_on_return) 
-        thread_yield (); 
+      /* An interrupt taken during deferred work returns to it
+         straight away; the outermost one finishes the job. */
+      if (!in_deferred)
+        {
+          run_deferred ();
+          if (yield_on_return && thread_preemptible ())
+            thread_yield (); 
+        }
     }
+
+#ifdef USERPROG
+  /* Run any signal handler before going back to user code. */
+  if (frame->cs == SEL_UCSEG)
+    signal_deliver (frame);
+#endif
+
+  /* Returning turns interrupts back on. */
+  if (intr_stats_enabled && (frame->eflags & FLAG_IF)
+      && intr_get_level () == INTR_OFF)
+    off_end ();
+}
+
+/* Calls each queued deferred work function in turn with
+   interrupts on, including any queued meanwhile.  Interrupts must
+   be off, and are off again on return. */
+static void
+run_deferred (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  in_deferred = true;
+  while (!list_empty (&deferred_list))
+    {
+      struct intr_deferred *d = list_entry (list_pop_front (&deferred_list),
+                                            struct intr_deferred, elem);
+      d->pending = false;
+      intr_enable ();
+      if (intr_stats_enabled)
+        {
+          uint64_t start = timer_cycles ();
+          d->func (d->aux);
+          deferred_cycles += timer_cycles () - start;
+          deferred_cnt++;
+        }
+      else
+        d->func (d->aux);
+      intr_disable ();
+    }
+  in_deferred = false;
+}
+
+/* Notes that interrupts just went off. */
+static void
+off_begin (void) 
+{
+  off_start = timer_cycles ();
+}
+
+/* Notes that interrupts are about to come back on, and counts the
+   time they were off. */
+static void
+off_end (void) 
+{
+  uint64_t cycles;
+
+  if (off_start == 0)
+    return;
+  cycles = timer_cycles () - off_start;
+  off_start = 0;
+  off_cycles += cycles;
+  if (cycles > off_max_cycles)
+    off_max_cycles = cycles;
+}
+
+/* Prints how often each interrupt's handler ran and how long it
+   took, and how long interrupts were off.  The times of handlers
+   that may sleep, such as system calls and page faults, include
+   the time slept. */
+void
+intr_print_stats (void) 
+{
+  uint64_t total = 0;
+  int i;
+
+  for (i = 0; i < INTR_CNT; i++)
+    total += handler_cnt[i];
+  printf ("Interrupts: %"PRIu64" handled, %"PRId64" us with interrupts "
+          "off, %"PRId64" us longest:\n", total,
+          timer_cycles_to_us (off_cycles),
+          timer_cycles_to_us (off_max_cycles));
+  for (i = 0; i < INTR_CNT; i++)
+    if (handler_cnt[i] > 0)
+      printf ("  %#04x %-28s %8"PRIu64" times, %"PRId64" us, "
+              "%"PRId64" us longest\n",
+              i, intr_names[i], handler_cnt[i],
+              timer_cycles_to_us (handler_cycles[i]),
+              timer_cycles_to_us (handler_max_cycles[i]));
+  if (deferred_cnt > 0)
+    printf ("  deferred work %25"PRIu64" times, %"PRId64" us\n",
+            deferred_cnt, timer_cycles_to_us (deferred_cycles));
 }
 
 /* Handles an unexpected interrupt with interrupt frame F.  An
@@ -1,6 +1,7 @@
 #ifndef THREADS_INTERRUPT_H
 #define THREADS_INTERRUPT_H
 
+#include <list.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -64,7 +65,29 @@ void intr_register_int (uint8_t vec, int dpl, enum intr_level,
 bool intr_context (void);
 void intr_yield_on_return (void);
 
+/* Deferred interrupt work ("bottom half").  An external interrupt
+   handler queues it with intr_defer() to have FUNC (AUX) called
+   once the handler has finished and the PIC has been acknowledged,
+   with interrupts on, before the interrupt returns or yields.
+   Deferred work is in interrupt context, so it may not sleep, but
+   other interrupts can be taken while it runs. */
+struct intr_deferred
+  {
+    struct list_elem elem;      /* Element in the pending list. */
+    void (*func) (void *aux);   /* Function to call. */
+    void *aux;                  /* Its argument. */
+    bool pending;               /* Queued and not yet called? */
+  };
+
+void intr_deferred_init (struct intr_deferred *,
+                         void (*func) (void *aux), void *aux);
+void intr_defer (struct intr_deferred *);
+
 void intr_dump_frame (const struct intr_frame *);
 const char *intr_name (uint8_t vec);
 
+/* -intrstat: Time interrupt handlers and interrupts off? */
+extern bool intr_stats_enabled;
+void intr_print_stats (void);
+
 #endif /* threads/interrupt.h */
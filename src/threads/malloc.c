@@ -1,12 +1,15 @@
 #include "threads/malloc.h"
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
 #include <round.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
@@ -26,7 +29,16 @@
    When we free a block, we add it to its descriptor's free list.
    But if the arena that the block was in now has no in-use
    blocks, we remove all of the arena's blocks from the free list
-   and give the arena back to the page allocator.
+   and set the arena aside, to be reused before a new page is
+   obtained.  Once too many arenas are set aside, most of them
+   are given back to the page allocator at once.
+
+   In front of each descriptor's lock sits a "magazine", a small
+   stack of blocks that are free but still counted as in use by
+   their arenas.  Most calls just push or pop the magazine with
+   interrupts briefly disabled.  Only when it is empty (or full)
+   do we take the lock and move half a magazine of blocks from
+   (or to) the free list.
 
    We can't handle blocks bigger than 2 kB using this scheme,
    because they're too big to fit in a single page with a
@@ -34,13 +46,31 @@
    with the page allocator and sticking the allocation size at
    the beginning of the allocated block's arena header. */
 
+/* Blocks in each descriptor's magazine. */
+#define MAG_SIZE 16
+
+/* Once more than EMPTY_HIGH arenas are set aside, all but
+   EMPTY_LOW are freed. */
+#define EMPTY_HIGH 4
+#define EMPTY_LOW 1
+
+struct block;
+
 /* Descriptor. */
 struct desc
   {
     size_t block_size;          /* Size of each element in bytes. */
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
     struct list free_list;      /* List of free blocks. */
+    struct list empty_list;     /* Arenas with no blocks in use. */
+    size_t empty_cnt;           /* Number of arenas in empty_list. */
+    size_t arena_cnt;           /* Arenas, including empty ones. */
     struct lock lock;           /* Lock. */
+
+    /* Protected by disabling preemption, not by LOCK. */
+    struct block *mag[MAG_SIZE]; /* Magazine of free blocks. */
+    size_t mag_cnt;             /* Number of blocks in MAG. */
+    size_t in_use;              /* Blocks handed out and not freed. */
   };
 
 /* Magic number for detecting arena corruption. */
@@ -52,6 +82,7 @@ struct arena
     unsigned magic;             /* Always set to ARENA_MAGIC. */
     struct desc *desc;          /* Owning descriptor, null for big block. */
     size_t free_cnt;            /* Free blocks; pages in big block. */
+    struct list_elem empty_elem; /* Element in desc's empty_list. */
   };
 
 /* Free block. */
@@ -61,11 +92,21 @@ struct block
   };
 
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
+static struct desc descs[MALLOC_CLASS_MAX]; /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Big blocks and the pages they take, protected by disabling
+   preemption. */
+static size_t big_cnt;
+static size_t big_pages;
+
+/* -memstat: Print heap and page pool usage at shutdown? */
+bool malloc_stats_enabled;
+
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static void release_block (struct desc *, struct block *);
+static void heap_free (void *);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -80,14 +121,19 @@ malloc_init (void)
       d->block_size = block_size;
       d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
       list_init (&d->free_list);
-      lock_init (&d->lock);
+      list_init (&d->empty_list);
+      d->empty_cnt = 0;
+      d->arena_cnt = 0;
+      lock_init_named (&d->lock, "malloc");
+      d->mag_cnt = 0;
+      d->in_use = 0;
     }
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
    Returns a null pointer if memory is not available. */
-void *
-malloc (size_t size) 
+static void *
+heap_alloc (size_t size) 
 {
   struct desc *d;
   struct block *b;
@@ -116,28 +162,54 @@ malloc (size_t size)
       a->magic = ARENA_MAGIC;
       a->desc = NULL;
       a->free_cnt = page_cnt;
+      thread_preempt_disable ();
+      big_cnt++;
+      big_pages += page_cnt;
+      thread_preempt_enable ();
       return a + 1;
     }
 
+  /* Take a block from the magazine if we can. */
+  thread_preempt_disable ();
+  if (d->mag_cnt > 0)
+    {
+      b = d->mag[--d->mag_cnt];
+      d->in_use++;
+      thread_preempt_enable ();
+      return b;
+    }
+  thread_preempt_enable ();
+
   lock_acquire (&d->lock);
 
-  /* If the free list is empty, create a new arena. */
+  /* If the free list is empty, reuse an empty arena or create a
+     new one. */
   if (list_empty (&d->free_list))
     {
       size_t i;
 
-      /* Allocate a page. */
-      a = palloc_get_page (0);
-      if (a == NULL) 
+      if (!list_empty (&d->empty_list))
         {
-          lock_release (&d->lock);
-          return NULL; 
+          a = list_entry (list_pop_front (&d->empty_list),
+                          struct arena, empty_elem);
+          d->empty_cnt--;
+        }
+      else
+        {
+          /* Allocate a page. */
+          a = palloc_get_page (0);
+          if (a == NULL) 
+            {
+              lock_release (&d->lock);
+              return NULL; 
+            }
+          a->magic = ARENA_MAGIC;
+          a->desc = d;
+          a->free_cnt = d->blocks_per_arena;
+          d->arena_cnt++;
         }
 
-      /* Initialize arena and add its blocks to the free list. */
-      a->magic = ARENA_MAGIC;
-      a->desc = d;
-      a->free_cnt = d->blocks_per_arena;
+      /* Add the arena's blocks to the free list. */
       for (i = 0; i < d->blocks_per_arena; i++) 
         {
           struct block *b = arena_to_block (a, i);
@@ -145,17 +217,127 @@ malloc (size_t size)
         }
     }
 
-  /* Get a block from free list and return it. */
+  /* Get a block from free list to return, and refill up to half
+     the magazine behind it. */
   b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-  a = block_to_arena (b);
-  a->free_cnt--;
+  block_to_arena (b)->free_cnt--;
+  while (!list_empty (&d->free_list))
+    {
+      struct block *m = list_entry (list_front (&d->free_list),
+                                    struct block, free_elem);
+      bool stored;
+
+      thread_preempt_disable ();
+      stored = d->mag_cnt < MAG_SIZE / 2;
+      if (stored)
+        d->mag[d->mag_cnt++] = m;
+      thread_preempt_enable ();
+      if (!stored)
+        break;
+      list_pop_front (&d->free_list);
+      block_to_arena (m)->free_cnt--;
+    }
+  thread_preempt_disable ();
+  d->in_use++;
+  thread_preempt_enable ();
   lock_release (&d->lock);
   return b;
 }
 
+#ifdef MALLOC_SITES
+/* Allocation-site profiling, built in with "make MALLOC_SITES=1".
+   Each block carries a tag in front of it that names the site, the
+   return address of the call to malloc(), calloc() or realloc()
+   that allocated it, in a small open-addressed table of sites that
+   counts calls and live blocks and bytes.  The table is printed at
+   shutdown, largest live bytes first, for backtrace to translate.
+   It is protected by disabling preemption, like the magazines. */
+
+/* Tag in front of each block. */
+struct site_tag
+  {
+    struct alloc_site *site;    /* Where it was allocated. */
+    size_t size;                /* Bytes requested. */
+  };
+
+/* An allocation site. */
+struct alloc_site
+  {
+    void *caller;               /* Return address, or null if unused. */
+    size_t calls;               /* Allocations made. */
+    size_t live_cnt;            /* Blocks not yet freed. */
+    size_t live_bytes;          /* Bytes requested in those blocks. */
+  };
+
+/* Sites tracked, a power of 2.  Calls from any further sites are
+   all charged to the extra entry at the end, whose caller stays
+   null. */
+#define SITE_CNT 256
+static struct alloc_site sites[SITE_CNT + 1];
+
+/* Sites printed at shutdown. */
+#define SITES_SHOWN 20
+
+/* Returns the entry for CALLER, adding it if it is new.
+   Preemption must be disabled. */
+static struct alloc_site *
+find_site (void *caller)
+{
+  size_t i = hash_ptr (caller) & (SITE_CNT - 1);
+  size_t probes;
+
+  for (probes = 0; probes < SITE_CNT; probes++)
+    {
+      struct alloc_site *s = &sites[(i + probes) & (SITE_CNT - 1)];
+      if (s->caller == caller)
+        return s;
+      if (s->caller == NULL)
+        {
+          s->caller = caller;
+          return s;
+        }
+    }
+  return &sites[SITE_CNT];
+}
+#endif
+
+/* Allocates a block of SIZE bytes for CALLER. */
+static void *
+alloc_at (size_t size, void *caller UNUSED)
+{
+#ifdef MALLOC_SITES
+  struct site_tag *t;
+
+  if (size == 0)
+    return NULL;
+  t = heap_alloc (size + sizeof *t);
+  if (t == NULL)
+    return NULL;
+  t->size = size;
+  thread_preempt_disable ();
+  t->site = find_site (caller);
+  t->site->calls++;
+  t->site->live_cnt++;
+  t->site->live_bytes += size;
+  thread_preempt_enable ();
+  return t + 1;
+#else
+  return heap_alloc (size);
+#endif
+}
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available.  Never
+   inlined, so that it sees its caller's return address. */
+NO_INLINE void *
+malloc (size_t size) 
+{
+  return alloc_at (size, __builtin_return_address (0));
+}
+
 /* Allocates and return A times B bytes initialized to zeroes.
    Returns a null pointer if memory is not available. */
-void *
+NO_INLINE void *
 calloc (size_t a, size_t b) 
 {
   void *p;
@@ -167,16 +349,24 @@ calloc (size_t a, size_t b)
     return NULL;
 
   /* Allocate and zero memory. */
-  p = malloc (size);
+  p = alloc_at (size, __builtin_return_address (0));
   if (p != NULL)
     memset (p, 0, size);
 
   return p;
 }
 
+#ifdef MALLOC_SITES
+/* Returns the number of bytes requested for BLOCK. */
+static size_t
+usable_size (void *block)
+{
+  return ((struct site_tag *) block - 1)->size;
+}
+#else
 /* Returns the number of bytes allocated for BLOCK. */
 static size_t
-block_size (void *block) 
+usable_size (void *block) 
 {
   struct block *b = block;
   struct arena *a = block_to_arena (b);
@@ -184,6 +374,7 @@ block_size (void *block)
 
   return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
 }
+#endif
 
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
    moving it in the process.
@@ -191,7 +382,7 @@ block_size (void *block)
    null pointer.
    A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
    A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
-void *
+NO_INLINE void *
 realloc (void *old_block, size_t new_size) 
 {
   if (new_size == 0) 
@@ -201,10 +392,10 @@ realloc (void *old_block, size_t new_size)
     }
   else 
     {
-      void *new_block = malloc (new_size);
+      void *new_block = alloc_at (new_size, __builtin_return_address (0));
       if (old_block != NULL && new_block != NULL)
         {
-          size_t old_size = block_size (old_block);
+          size_t old_size = usable_size (old_block);
           size_t min_size = new_size < old_size ? new_size : old_size;
           memcpy (new_block, old_block, min_size);
           free (old_block);
@@ -217,6 +408,25 @@ realloc (void *old_block, size_t new_size)
    malloc(), calloc(), or realloc(). */
 void
 free (void *p) 
+{
+#ifdef MALLOC_SITES
+  if (p != NULL)
+    {
+      struct site_tag *t = (struct site_tag *) p - 1;
+
+      thread_preempt_disable ();
+      t->site->live_cnt--;
+      t->site->live_bytes -= t->size;
+      thread_preempt_enable ();
+      p = t;
+    }
+#endif
+  heap_free (p);
+}
+
+/* Frees block P, which heap_alloc() returned. */
+static void
+heap_free (void *p) 
 {
   if (p != NULL)
     {
@@ -227,42 +437,184 @@ free (void *p)
       if (d != NULL) 
         {
           /* It's a normal block.  We handle it here. */
+          struct block *batch[MAG_SIZE / 2];
+          size_t i;
 
 #ifndef NDEBUG
           /* Clear the block to help detect use-after-free bugs. */
           memset (b, 0xcc, d->block_size);
 #endif
-  
-          lock_acquire (&d->lock);
-
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
 
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
+          /* Put the block in the magazine if there is room.
+             Otherwise, take half of the magazine back to the
+             free list along with it. */
+          thread_preempt_disable ();
+          d->in_use--;
+          if (d->mag_cnt < MAG_SIZE)
             {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
+              d->mag[d->mag_cnt++] = b;
+              thread_preempt_enable ();
+              return;
             }
+          d->mag_cnt -= MAG_SIZE / 2;
+          memcpy (batch, d->mag + d->mag_cnt, sizeof batch);
+          thread_preempt_enable ();
 
+          lock_acquire (&d->lock);
+          release_block (d, b);
+          for (i = 0; i < MAG_SIZE / 2; i++)
+            release_block (d, batch[i]);
+
+          /* Give surplus empty arenas back all at once. */
+          if (d->empty_cnt > EMPTY_HIGH)
+            while (d->empty_cnt > EMPTY_LOW)
+              {
+                a = list_entry (list_pop_front (&d->empty_list),
+                                struct arena, empty_elem);
+                d->empty_cnt--;
+                d->arena_cnt--;
+                palloc_free_page (a);
+              }
           lock_release (&d->lock);
         }
       else
         {
           /* It's a big block.  Free its pages. */
+          thread_preempt_disable ();
+          big_cnt--;
+          big_pages -= a->free_cnt;
+          thread_preempt_enable ();
           palloc_free_multiple (a, a->free_cnt);
           return;
         }
     }
 }
 
+/* Stores a snapshot of heap usage in *ST.  It is taken with
+   interrupts off and without the descriptors' locks, so that it
+   can be taken while panicking; a thread in the middle of moving
+   blocks between a free list and its magazine may put it off by a
+   few blocks. */
+void
+malloc_get_stats (struct malloc_stats *st)
+{
+  enum intr_level old_level = intr_disable ();
+  size_t i;
+
+  st->class_cnt = desc_cnt;
+  for (i = 0; i < desc_cnt; i++)
+    {
+      struct desc *d = &descs[i];
+      struct malloc_class_stats *c = &st->classes[i];
+      size_t held = (d->arena_cnt - d->empty_cnt) * d->blocks_per_arena;
+
+      c->block_size = d->block_size;
+      c->in_use = d->in_use;
+      c->arena_cnt = d->arena_cnt;
+      c->empty_cnt = d->empty_cnt;
+      c->partial_free = (held > d->in_use + d->mag_cnt
+                         ? held - d->in_use - d->mag_cnt : 0);
+    }
+  st->big_cnt = big_cnt;
+  st->big_pages = big_pages;
+  intr_set_level (old_level);
+}
+
+/* Prints heap usage by size class, then page pool usage. */
+void
+malloc_print_stats (void)
+{
+  struct malloc_stats st;
+  size_t live = 0, blocks = 0, arenas = 0, partial = 0;
+  size_t i;
+
+  malloc_get_stats (&st);
+  for (i = 0; i < st.class_cnt; i++)
+    {
+      const struct malloc_class_stats *c = &st.classes[i];
+
+      live += c->in_use * c->block_size;
+      blocks += c->in_use;
+      arenas += c->arena_cnt;
+      partial += c->partial_free * c->block_size;
+    }
+  printf ("Heap: %zu bytes in %zu blocks, %zu arenas, "
+          "%zu bytes free in partly used arenas, "
+          "%zu big blocks in %zu pages\n",
+          live, blocks, arenas, partial, st.big_cnt, st.big_pages);
+  for (i = 0; i < st.class_cnt; i++)
+    {
+      const struct malloc_class_stats *c = &st.classes[i];
+
+      if (c->arena_cnt > 0)
+        printf ("  %4zu-byte blocks: %6zu in use, %4zu arenas "
+                "(%zu empty), %5zu free in partly used arenas\n",
+                c->block_size, c->in_use, c->arena_cnt, c->empty_cnt,
+                c->partial_free);
+    }
+  palloc_print_stats ();
+}
+
+/* Prints the allocation sites with the most bytes live, if built
+   with MALLOC_SITES. */
+void
+malloc_print_sites (void)
+{
+#ifdef MALLOC_SITES
+  bool shown[SITE_CNT + 1];
+  size_t used = 0, i, n;
+
+  memset (shown, 0, sizeof shown);
+  for (i = 0; i <= SITE_CNT; i++)
+    if (sites[i].calls > 0)
+      used++;
+  printf ("Allocation sites: %zu, top %d by bytes live:\n",
+          used, used < SITES_SHOWN ? (int) used : SITES_SHOWN);
+  for (n = 0; n < SITES_SHOWN; n++)
+    {
+      struct alloc_site *max = NULL;
+
+      for (i = 0; i <= SITE_CNT; i++)
+        if (!shown[i] && sites[i].calls > 0
+            && (max == NULL || sites[i].live_bytes > max->live_bytes))
+          max = &sites[i];
+      if (max == NULL)
+        break;
+      shown[max - sites] = true;
+      if (max->caller != NULL)
+        printf ("  %p", max->caller);
+      else
+        printf ("  %-10s", "(others)");
+      printf (": %8zu bytes live in %6zu blocks, %8zu calls\n",
+              max->live_bytes, max->live_cnt, max->calls);
+    }
+#endif
+}
+
+/* Adds B to D's free list.  If that leaves B's arena with no
+   blocks in use, moves the arena to D's empty list instead.
+   D's lock must be held. */
+static void
+release_block (struct desc *d, struct block *b)
+{
+  struct arena *a = block_to_arena (b);
+
+  list_push_front (&d->free_list, &b->free_elem);
+  if (++a->free_cnt >= d->blocks_per_arena) 
+    {
+      size_t i;
+
+      ASSERT (a->free_cnt == d->blocks_per_arena);
+      for (i = 0; i < d->blocks_per_arena; i++) 
+        {
+          struct block *b = arena_to_block (a, i);
+          list_remove (&b->free_elem);
+        }
+      list_push_back (&d->empty_list, &a->empty_elem);
+      d->empty_cnt++;
+    }
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
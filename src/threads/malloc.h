@@ -2,12 +2,41 @@
 #define THREADS_MALLOC_H
 
 #include <debug.h>
+#include <stdbool.h>
 #include <stddef.h>
 
+/* Most size classes of small blocks. */
+#define MALLOC_CLASS_MAX 10
+
+/* Usage of one size class. */
+struct malloc_class_stats
+  {
+    size_t block_size;          /* Bytes in each block. */
+    size_t in_use;              /* Blocks allocated. */
+    size_t arena_cnt;           /* Pages holding blocks of this size. */
+    size_t empty_cnt;           /* Arenas set aside with none in use. */
+    size_t partial_free;        /* Free blocks in partly used arenas. */
+  };
+
+/* Heap usage, from malloc_get_stats(). */
+struct malloc_stats
+  {
+    size_t class_cnt;           /* Size classes in CLASSES. */
+    struct malloc_class_stats classes[MALLOC_CLASS_MAX];
+    size_t big_cnt;             /* Blocks too big for a class. */
+    size_t big_pages;           /* Pages they take. */
+  };
+
+/* -memstat: Print heap and page pool usage at shutdown? */
+extern bool malloc_stats_enabled;
+
 void malloc_init (void);
 void *malloc (size_t) __attribute__ ((malloc));
 void *calloc (size_t, size_t) __attribute__ ((malloc));
 void *realloc (void *, size_t);
 void free (void *);
+void malloc_get_stats (struct malloc_stats *);
+void malloc_print_stats (void);
+void malloc_print_sites (void);
 
 #endif /* threads/malloc.h */
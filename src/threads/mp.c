@@ -0,0 +1,184 @@
+#include "threads/mp.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/loader.h"
+#include "threads/vaddr.h"
+
+/* Detection of the processors in the machine, from the tables
+   that the BIOS leaves in memory as described by the Intel
+   MultiProcessor Specification, version 1.4.
+
+   Pintos only records what it finds.  The application
+   processors are not started: the kernel still relies on
+   disabling interrupts for mutual exclusion, which does not
+   exclude other processors. */
+
+/* MP floating pointer structure, which the BIOS places on a 16-byte
+   boundary in one of the areas searched by find_fps(). */
+struct mp_fps
+  {
+    char signature[4];          /* "_MP_". */
+    uint32_t config;            /* Physical address of mp_config. */
+    uint8_t length;             /* In 16-byte units, always 1. */
+    uint8_t spec_rev;           /* Version of the specification. */
+    uint8_t checksum;           /* Makes all bytes sum to 0. */
+    uint8_t features[5];        /* Default configuration, if nonzero. */
+  } __attribute__ ((packed));
+
+/* MP configuration table header, followed by ENTRY_CNT entries. */
+struct mp_config
+  {
+    char signature[4];          /* "PCMP". */
+    uint16_t length;            /* Of header and entries, in bytes. */
+    uint8_t spec_rev;           /* Version of the specification. */
+    uint8_t checksum;           /* Makes all LENGTH bytes sum to 0. */
+    char oem_id[8];
+    char product_id[12];
+    uint32_t oem_table;
+    uint16_t oem_table_size;
+    uint16_t entry_cnt;         /* Number of entries. */
+    uint32_t lapic_addr;        /* Physical address of the local APIC. */
+    uint16_t ext_length;
+    uint8_t ext_checksum;
+    uint8_t reserved;
+  } __attribute__ ((packed));
+
+/* Processor entry in the configuration table.  Entries of all
+   other types are 8 bytes long. */
+#define MP_PROCESSOR 0
+struct mp_processor
+  {
+    uint8_t type;               /* MP_PROCESSOR. */
+    uint8_t apic_id;            /* Its local APIC's id. */
+    uint8_t apic_version;
+    uint8_t flags;              /* MP_ENABLED, MP_BSP. */
+    uint32_t signature;
+    uint32_t features;
+    uint32_t reserved[2];
+  } __attribute__ ((packed));
+#define MP_ENABLED 0x01         /* Usable. */
+#define MP_BSP 0x02             /* The bootstrap processor. */
+
+int mp_cpu_cnt = 1;
+uint8_t mp_apic_ids[MP_CPU_MAX];
+uint32_t mp_lapic_addr;
+
+/* Returns true if the SIZE bytes at P sum to 0. */
+static bool
+checksum_ok (const void *p_, size_t size)
+{
+  const uint8_t *p = p_;
+  uint8_t sum = 0;
+
+  while (size-- > 0)
+    sum += *p++;
+  return sum == 0;
+}
+
+/* Returns physical address PADDR as a kernel virtual address, or
+   a null pointer if the SIZE bytes there lie outside RAM. */
+static void *
+phys (uint32_t paddr, size_t size)
+{
+  if (paddr == 0 || paddr + size > init_ram_pages * PGSIZE)
+    return NULL;
+  return ptov (paddr);
+}
+
+/* Searches the SIZE bytes at physical address PADDR for the MP
+   floating pointer structure. */
+static struct mp_fps *
+search_fps (uint32_t paddr, size_t size)
+{
+  uint8_t *p = phys (paddr, size);
+  size_t ofs;
+
+  if (p == NULL)
+    return NULL;
+  for (ofs = 0; ofs + sizeof (struct mp_fps) <= size; ofs += 16)
+    {
+      struct mp_fps *fps = (struct mp_fps *) (p + ofs);
+      if (!memcmp (fps->signature, "_MP_", 4)
+          && checksum_ok (fps, sizeof *fps))
+        return fps;
+    }
+  return NULL;
+}
+
+/* Finds the MP floating pointer structure in the first kB of the
+   extended BIOS data area, in the last kB of base memory, or in
+   the BIOS ROM, in that order. */
+static struct mp_fps *
+find_fps (void)
+{
+  uint16_t ebda_seg = *(uint16_t *) ptov (0x40e);
+  uint16_t base_kb = *(uint16_t *) ptov (0x413);
+  struct mp_fps *fps;
+
+  fps = search_fps (ebda_seg << 4, 1024);
+  if (fps == NULL)
+    fps = search_fps (base_kb * 1024 - 1024, 1024);
+  if (fps == NULL)
+    fps = search_fps (0xf0000, 0x10000);
+  return fps;
+}
+
+/* Finds the processors in the machine.  Must be called after
+   paging_init(), since it reads the tables through the kernel's
+   mapping of physical memory. */
+void
+mp_init (void)
+{
+  struct mp_fps *fps = find_fps ();
+  struct mp_config *config;
+  uint8_t *entry;
+  int cnt = 0;
+  int i;
+
+  if (fps == NULL || fps->features[0] != 0)
+    {
+      printf ("MP: no configuration table, 1 CPU assumed.\n");
+      return;
+    }
+  config = phys (fps->config, sizeof *config);
+  if (config == NULL || memcmp (config->signature, "PCMP", 4)
+      || phys (fps->config, config->length) == NULL
+      || !checksum_ok (config, config->length))
+    {
+      printf ("MP: bad configuration table, 1 CPU assumed.\n");
+      return;
+    }
+  mp_lapic_addr = config->lapic_addr;
+
+  entry = (uint8_t *) (config + 1);
+  for (i = 0; i < config->entry_cnt; i++)
+    {
+      if (*entry == MP_PROCESSOR)
+        {
+          struct mp_processor *p = (struct mp_processor *) entry;
+          if ((p->flags & MP_ENABLED) && cnt < MP_CPU_MAX)
+            {
+              /* Keep the bootstrap processor first. */
+              if (p->flags & MP_BSP)
+                {
+                  mp_apic_ids[cnt] = mp_apic_ids[0];
+                  mp_apic_ids[0] = p->apic_id;
+                }
+              else
+                mp_apic_ids[cnt] = p->apic_id;
+              cnt++;
+            }
+          entry += sizeof *p;
+        }
+      else
+        entry += 8;
+    }
+
+  if (cnt > 0)
+    mp_cpu_cnt = cnt;
+  printf ("MP: %d CPU%s found, running on CPU 0 (APIC id %d) only.\n",
+          mp_cpu_cnt, mp_cpu_cnt != 1 ? "s" : "", mp_apic_ids[0]);
+}
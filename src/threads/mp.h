@@ -0,0 +1,19 @@
+#ifndef THREADS_MP_H
+#define THREADS_MP_H
+
+#include <stdint.h>
+
+/* Most processors that mp_init() records. */
+#define MP_CPU_MAX 8
+
+/* Processors found by mp_init(), the bootstrap processor first.
+   Only the bootstrap processor runs Pintos. */
+extern int mp_cpu_cnt;
+extern uint8_t mp_apic_ids[MP_CPU_MAX];
+
+/* Physical address of the local APIC, or 0 if unknown. */
+extern uint32_t mp_lapic_addr;
+
+void mp_init (void);
+
+#endif /* threads/mp.h */
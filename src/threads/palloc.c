@@ -2,12 +2,14 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/loader.h"
+#include "threads/interrupt.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
@@ -25,11 +27,38 @@
    half to the user pool.  That should be huge overkill for the
    kernel pool, but that's just fine for demonstration purposes. */
 
-/* A memory pool. */
+/* Free pages are kept in a binary buddy system: a free block of
+   order K is 2**K pages long and starts at a page index, relative
+   to the pool base, that is a multiple of 2**K.  Each order has its
+   own free list, threaded through the first page of each block, so
+   allocating and freeing take O(log n) time. */
+#define MAX_ORDER 16                    /* Largest block: 2**16 pages. */
+#define NOT_FREE 0xff                   /* ORDER entry for other pages. */
+
+/* The idle thread zeroes up to this many free pages in each pool
+   ahead of time, so that PAL_ZERO requests for one page can skip
+   the memset.  They are taken out of the buddy system meanwhile,
+   and given back if it runs dry. */
+#define ZEROED_MAX 32
+
+/* Header at the start of each free block. */
+struct free_block
+  {
+    struct list_elem elem;              /* Element in pool's free list. */
+  };
+
+/* A memory pool.  Its free lists are guarded by a spinlock
+   rather than a lock, because thread_schedule_tail() frees the
+   page of a dying thread from inside the scheduler. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
+    struct spinlock lock;               /* Guards all the rest. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
+    uint8_t *order;                     /* Order of each free block head. */
+    struct list free[MAX_ORDER + 1];    /* Free blocks of each order. */
+    struct list zeroed;                 /* Free pages known to be zero. */
+    size_t zeroed_cnt;                  /* Number of pages in ZEROED. */
+    size_t used_cnt;                    /* Pages allocated. */
     uint8_t *base;                      /* Base of pool. */
   };
 
@@ -39,6 +68,11 @@ static struct pool kernel_pool, user_pool;
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t alloc_block (struct pool *, size_t page_cnt);
+static size_t alloc_aligned (struct pool *, size_t page_cnt);
+static void free_range (struct pool *, size_t page_idx, size_t page_cnt);
+static size_t take_zeroed (struct pool *);
+static void release_zeroed (struct pool *);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -71,15 +105,28 @@ void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  enum intr_level old_level;
   void *pages;
-  size_t page_idx;
+  size_t page_idx = BITMAP_ERROR;
+  bool zeroed;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  old_level = spin_lock_irqsave (&pool->lock);
+  if (page_cnt == 1 && (flags & PAL_ZERO))
+    page_idx = take_zeroed (pool);
+  zeroed = page_idx != BITMAP_ERROR;
+  if (!zeroed)
+    page_idx = alloc_block (pool, page_cnt);
+  if (page_idx == BITMAP_ERROR && pool->zeroed_cnt > 0)
+    {
+      release_zeroed (pool);
+      page_idx = alloc_block (pool, page_cnt);
+    }
+  if (page_idx != BITMAP_ERROR)
+    pool->used_cnt += page_cnt;
+  spin_unlock_irqrestore (&pool->lock, old_level);
 
   if (page_idx != BITMAP_ERROR)
     pages = pool->base + PGSIZE * page_idx;
@@ -88,7 +135,7 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 
   if (pages != NULL) 
     {
-      if (flags & PAL_ZERO)
+      if ((flags & PAL_ZERO) && !zeroed)
         memset (pages, 0, PGSIZE * page_cnt);
     }
   else 
@@ -113,11 +160,50 @@ palloc_get_page (enum palloc_flags flags)
   return palloc_get_multiple (flags, 1);
 }
 
+/* Obtains PAGE_CNT contiguous free pages, a power of two, whose
+   physical address is a multiple of PAGE_CNT pages, as a large
+   page mapping needs.  Pages come from the pool that FLAGS selects
+   and are zeroed if PAL_ZERO is set, as in palloc_get_multiple().
+   Returns a null pointer if no free block holds such a run. */
+void *
+palloc_get_aligned (enum palloc_flags flags, size_t page_cnt)
+{
+  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  enum intr_level old_level;
+  size_t page_idx;
+  void *pages;
+
+  ASSERT (page_cnt > 0 && (page_cnt & (page_cnt - 1)) == 0);
+
+  old_level = spin_lock_irqsave (&pool->lock);
+  page_idx = alloc_aligned (pool, page_cnt);
+  if (page_idx == BITMAP_ERROR && pool->zeroed_cnt > 0)
+    {
+      release_zeroed (pool);
+      page_idx = alloc_aligned (pool, page_cnt);
+    }
+  if (page_idx != BITMAP_ERROR)
+    pool->used_cnt += page_cnt;
+  spin_unlock_irqrestore (&pool->lock, old_level);
+
+  if (page_idx == BITMAP_ERROR)
+    {
+      if (flags & PAL_ASSERT)
+        PANIC ("palloc_get_aligned: out of pages");
+      return NULL;
+    }
+  pages = pool->base + PGSIZE * page_idx;
+  if (flags & PAL_ZERO)
+    memset (pages, 0, PGSIZE * page_cnt);
+  return pages;
+}
+
 /* Frees the PAGE_CNT pages starting at PAGES. */
 void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
   struct pool *pool;
+  enum intr_level old_level;
   size_t page_idx;
 
   ASSERT (pg_ofs (pages) == 0);
@@ -137,8 +223,11 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  old_level = spin_lock_irqsave (&pool->lock);
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  free_range (pool, page_idx, page_cnt);
+  pool->used_cnt -= page_cnt;
+  spin_unlock_irqrestore (&pool->lock, old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -148,6 +237,98 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Zeroes one free page ahead of a PAL_ZERO request, in whichever
+   pool is short of them.  Called by the idle thread with
+   interrupts on.  Returns false if there was nothing to do. */
+bool
+palloc_zero_page (void)
+{
+  struct pool *pools[] = { &user_pool, &kernel_pool };
+  size_t i;
+
+  for (i = 0; i < sizeof pools / sizeof *pools; i++)
+    {
+      struct pool *pool = pools[i];
+      enum intr_level old_level;
+      size_t page_idx;
+      void *page;
+
+      if (pool->zeroed_cnt >= ZEROED_MAX)
+        continue;
+      old_level = spin_lock_irqsave (&pool->lock);
+      page_idx = alloc_block (pool, 1);
+      spin_unlock_irqrestore (&pool->lock, old_level);
+      if (page_idx == BITMAP_ERROR)
+        continue;
+
+      /* The page is ours, so it can be zeroed with interrupts on. */
+      page = pool->base + PGSIZE * page_idx;
+      memset (page, 0, PGSIZE);
+
+      old_level = spin_lock_irqsave (&pool->lock);
+      list_push_front (&pool->zeroed, &((struct free_block *) page)->elem);
+      pool->zeroed_cnt++;
+      spin_unlock_irqrestore (&pool->lock, old_level);
+      return true;
+    }
+  return false;
+}
+
+/* Returns the address of the first page in the user pool. */
+void *
+palloc_user_base (void) 
+{
+  return user_pool.base;
+}
+
+/* Returns the number of pages in the user pool, fixed by
+   palloc_init(). */
+size_t
+palloc_user_page_cnt (void) 
+{
+  return bitmap_size (user_pool.used_map);
+}
+
+/* Stores the occupancy of the pool that FLAGS selects, the user
+   pool if PAL_USER is set and otherwise the kernel pool, in *ST. */
+void
+palloc_get_stats (enum palloc_flags flags, struct palloc_stats *st)
+{
+  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  enum intr_level old_level;
+  int k;
+
+  old_level = spin_lock_irqsave (&pool->lock);
+  st->page_cnt = bitmap_size (pool->used_map);
+  st->used_cnt = pool->used_cnt;
+  st->largest_free = pool->zeroed_cnt > 0;
+  for (k = MAX_ORDER; k >= 0; k--)
+    if (!list_empty (&pool->free[k]))
+      {
+        st->largest_free = (size_t) 1 << k;
+        break;
+      }
+  spin_unlock_irqrestore (&pool->lock, old_level);
+}
+
+/* Prints how much of each pool is in use. */
+void
+palloc_print_stats (void)
+{
+  static const char *names[] = {"Kernel", "User"};
+  int i;
+
+  for (i = 0; i < 2; i++)
+    {
+      struct palloc_stats st;
+
+      palloc_get_stats (i ? PAL_USER : 0, &st);
+      printf ("%s pool: %zu of %zu pages in use, "
+              "largest free run %zu pages\n",
+              names[i], st.used_cnt, st.page_cnt, st.largest_free);
+    }
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
@@ -156,17 +337,193 @@ init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
   /* We'll put the pool's used_map at its base.
      Calculate the space needed for the bitmap
      and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
+  size_t bm_size = bitmap_buf_size (page_cnt);
+  size_t bm_pages = DIV_ROUND_UP (bm_size + page_cnt, PGSIZE);
+  int k;
+
   if (bm_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
   page_cnt -= bm_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
-  /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
+  /* Initialize the pool, with every page in use, then free them
+     all to build the free lists. */
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_size);
+  bitmap_set_all (p->used_map, true);
+  p->order = (uint8_t *) base + bm_size;
+  memset (p->order, NOT_FREE, page_cnt);
+  for (k = 0; k <= MAX_ORDER; k++)
+    list_init (&p->free[k]);
+  list_init (&p->zeroed);
+  p->zeroed_cnt = 0;
+  p->used_cnt = 0;
+  spin_init (&p->lock);
   p->base = base + bm_pages * PGSIZE;
+  free_range (p, 0, page_cnt);
+}
+
+/* Returns the first page of free block IDX in POOL. */
+static struct free_block *
+block_at (struct pool *pool, size_t idx)
+{
+  return (struct free_block *) (pool->base + PGSIZE * idx);
+}
+
+/* Removes the free block at IDX from POOL's free lists. */
+static void
+take_block (struct pool *pool, size_t idx)
+{
+  list_remove (&block_at (pool, idx)->elem);
+  pool->order[idx] = NOT_FREE;
+}
+
+/* Adds a free block of order K at IDX to POOL's free lists. */
+static void
+put_block (struct pool *pool, size_t idx, int k)
+{
+  pool->order[idx] = k;
+  list_push_front (&pool->free[k], &block_at (pool, idx)->elem);
+}
+
+/* Frees the block of order K at IDX in POOL, merging it with its
+   buddy for as long as the buddy is also free. */
+static void
+free_block (struct pool *pool, size_t idx, int k)
+{
+  size_t page_cnt = bitmap_size (pool->used_map);
+
+  bitmap_set_multiple (pool->used_map, idx, (size_t) 1 << k, false);
+  for (; k < MAX_ORDER; k++)
+    {
+      size_t buddy = idx ^ ((size_t) 1 << k);
+      if (buddy + ((size_t) 1 << k) > page_cnt || pool->order[buddy] != k)
+        break;
+      take_block (pool, buddy);
+      if (buddy < idx)
+        idx = buddy;
+    }
+  put_block (pool, idx, k);
+}
+
+/* Frees the PAGE_CNT pages at PAGE_IDX in POOL, as the largest
+   aligned blocks that they can be split into. */
+static void
+free_range (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  size_t end = page_idx + page_cnt;
+
+  while (page_idx < end)
+    {
+      int k = 0;
+      while (k < MAX_ORDER
+             && page_idx % ((size_t) 2 << k) == 0
+             && page_idx + ((size_t) 2 << k) <= end)
+        k++;
+      free_block (pool, page_idx, k);
+      page_idx += (size_t) 1 << k;
+    }
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first, or BITMAP_ERROR if there is no free block
+   large enough.  The smallest suitable block is split, and pages
+   past PAGE_CNT are given back. */
+static size_t
+alloc_block (struct pool *pool, size_t page_cnt)
+{
+  int order = 0;
+  int k;
+  size_t idx;
+
+  while (((size_t) 1 << order) < page_cnt)
+    if (++order > MAX_ORDER)
+      return BITMAP_ERROR;
+  for (k = order; k <= MAX_ORDER && list_empty (&pool->free[k]); k++)
+    continue;
+  if (k > MAX_ORDER)
+    return BITMAP_ERROR;
+
+  idx = pg_no (list_entry (list_front (&pool->free[k]),
+                           struct free_block, elem)) - pg_no (pool->base);
+  take_block (pool, idx);
+  while (k > order)
+    {
+      k--;
+      put_block (pool, idx + ((size_t) 1 << k), k);
+    }
+
+  bitmap_set_multiple (pool->used_map, idx, (size_t) 1 << order, true);
+  if (((size_t) 1 << order) > page_cnt)
+    free_range (pool, idx + page_cnt, ((size_t) 1 << order) - page_cnt);
+  return idx;
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL starting at a page
+   whose physical page number is a multiple of PAGE_CNT, and returns
+   the index of the first, or BITMAP_ERROR if no free block holds
+   such a run.  Blocks are only aligned relative to the pool base,
+   so each large enough block is checked, smallest first, and the
+   pages of the chosen one on either side of the run are given
+   back. */
+static size_t
+alloc_aligned (struct pool *pool, size_t page_cnt)
+{
+  int order = 0;
+  int k;
+
+  while (((size_t) 1 << order) < page_cnt)
+    if (++order > MAX_ORDER)
+      return BITMAP_ERROR;
+  for (k = order; k <= MAX_ORDER; k++)
+    {
+      struct list_elem *e;
+
+      for (e = list_begin (&pool->free[k]); e != list_end (&pool->free[k]);
+           e = list_next (e))
+        {
+          size_t block_no = pg_no (list_entry (e, struct free_block, elem));
+          size_t run_no = ROUND_UP (block_no, page_cnt);
+          size_t idx = block_no - pg_no (pool->base);
+          size_t run_idx = run_no - pg_no (pool->base);
+          size_t end = idx + ((size_t) 1 << k);
+
+          if (run_idx + page_cnt > end)
+            continue;
+          take_block (pool, idx);
+          bitmap_set_multiple (pool->used_map, idx, end - idx, true);
+          free_range (pool, idx, run_idx - idx);
+          free_range (pool, run_idx + page_cnt, end - run_idx - page_cnt);
+          return run_idx;
+        }
+    }
+  return BITMAP_ERROR;
+}
+
+/* Removes a page from POOL's zeroed pages and returns its index,
+   with the list link wiped so the page is all zeros again.
+   Returns BITMAP_ERROR if there are none. */
+static size_t
+take_zeroed (struct pool *pool)
+{
+  struct free_block *b;
+
+  if (list_empty (&pool->zeroed))
+    return BITMAP_ERROR;
+  b = list_entry (list_pop_front (&pool->zeroed), struct free_block, elem);
+  pool->zeroed_cnt--;
+  memset (b, 0, sizeof *b);
+  return pg_no (b) - pg_no (pool->base);
+}
+
+/* Gives all of POOL's zeroed pages back to the buddy system. */
+static void
+release_zeroed (struct pool *pool)
+{
+  size_t page_idx;
+
+  while ((page_idx = take_zeroed (pool)) != BITMAP_ERROR)
+    free_range (pool, page_idx, 1);
 }
 
 /* Returns true if PAGE was allocated from POOL,
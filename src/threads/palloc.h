@@ -1,6 +1,7 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 /* How to allocate pages. */
@@ -11,10 +12,24 @@ enum palloc_flags
     PAL_USER = 004              /* User page. */
   };
 
+/* Occupancy of a pool, from palloc_get_stats(). */
+struct palloc_stats
+  {
+    size_t page_cnt;            /* Pages in the pool. */
+    size_t used_cnt;            /* Pages allocated. */
+    size_t largest_free;        /* Pages in the largest free block. */
+  };
+
 void palloc_init (size_t user_page_limit);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
+void *palloc_get_aligned (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+bool palloc_zero_page (void);
+void *palloc_user_base (void);
+size_t palloc_user_page_cnt (void);
+void palloc_get_stats (enum palloc_flags, struct palloc_stats *);
+void palloc_print_stats (void);
 
 #endif /* threads/palloc.h */
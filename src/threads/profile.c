@@ -0,0 +1,69 @@
+#include "threads/profile.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Bytes of kernel code counted together in one bucket. */
+#define PROFILE_GRAIN 16
+
+/* Kernel code, from the linker script. */
+extern char _start, _end_kernel_text;
+
+bool profile_enabled;
+
+/* Samples per PROFILE_GRAIN bytes of kernel code, starting at
+   _start, and their number. */
+static uint32_t *buckets;
+static size_t bucket_cnt;
+
+/* Samples taken in total and while running user code. */
+static uint32_t sample_cnt;
+static uint32_t user_cnt;
+
+/* Allocates the histogram and starts sampling.  Must be called
+   after palloc_init(). */
+void
+profile_init (void)
+{
+  size_t page_cnt;
+
+  bucket_cnt = DIV_ROUND_UP (&_end_kernel_text - &_start, PROFILE_GRAIN);
+  page_cnt = DIV_ROUND_UP (bucket_cnt * sizeof *buckets, PGSIZE);
+  buckets = palloc_get_multiple (PAL_ASSERT | PAL_ZERO, page_cnt);
+  profile_enabled = true;
+}
+
+/* Counts one sample of the code interrupted by F.  Called by the
+   timer interrupt handler on every tick. */
+void
+profile_sample (const struct intr_frame *f)
+{
+  const char *eip = (const char *) f->eip;
+
+  sample_cnt++;
+  if (is_user_vaddr (eip))
+    user_cnt++;
+  else if (eip >= &_start && eip < &_end_kernel_text)
+    buckets[(eip - &_start) / PROFILE_GRAIN]++;
+}
+
+/* Prints the histogram, one "profile ADDRESS COUNT" line per
+   bucket that was hit.  Run "backtrace --profile" on the output
+   to turn it into a flat profile by function. */
+void
+profile_print_stats (void)
+{
+  size_t i;
+
+  profile_enabled = false;
+  printf ("Profile: %"PRIu32" samples, %"PRIu32" in user programs.\n",
+          sample_cnt, user_cnt);
+  for (i = 0; i < bucket_cnt; i++)
+    if (buckets[i] != 0)
+      printf ("profile %#"PRIxPTR" %"PRIu32"\n",
+              (uintptr_t) (&_start + i * PROFILE_GRAIN), buckets[i]);
+}
@@ -0,0 +1,204 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Slab allocator for frequently allocated kernel objects.
+
+   malloc() rounds every request up to a power of 2, so an object
+   of, say, 48 bytes takes a 64-byte block.  A kmem_cache instead
+   hands out objects of one exact size (rounded up only to pointer
+   alignment), packed into page-sized "slabs" that hold nothing
+   else, which both saves memory and keeps like objects together.
+
+   Each slab starts with a header, followed by as many objects as
+   fit.  Free objects are chained through their first word, or
+   through a word just past the object if the cache has a
+   constructor, since the link must not clobber constructed state.
+   Slabs with free objects are on the cache's partial list; full
+   slabs are on no list.  When a slab becomes entirely free it is kept as
+   the cache's spare, or given back to the page allocator if a
+   spare is already kept.
+
+   If the cache has a constructor, it is run on each object once,
+   when its slab is created, and objects must be freed back in
+   their constructed state. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Slab header. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in cache's partial list. */
+    size_t free_cnt;            /* Number of free objects. */
+    void *free;                 /* First free object. */
+  };
+
+static struct slab *new_slab (struct kmem_cache *);
+static struct slab *obj_to_slab (struct kmem_cache *, void *);
+
+/* Returns the free-chain link of OBJ in CACHE. */
+static void **
+obj_link (struct kmem_cache *cache, void *obj)
+{
+  return (void **) ((uint8_t *) obj + cache->link_ofs);
+}
+
+/* Initializes CACHE to hand out objects of SIZE bytes, naming it
+   NAME for debugging purposes.  If CTOR is nonnull, it is called
+   on each object when its slab is created. */
+void
+kmem_cache_init (struct kmem_cache *cache, const char *name, size_t size,
+                 void (*ctor) (void *))
+{
+  size_t stride;
+
+  size = ROUND_UP (size < sizeof (void *) ? sizeof (void *) : size,
+                   sizeof (void *));
+  stride = ctor != NULL ? size + sizeof (void *) : size;
+  ASSERT (stride <= (PGSIZE - sizeof (struct slab)) / 2);
+
+  cache->name = name;
+  cache->obj_size = size;
+  cache->link_ofs = ctor != NULL ? size : 0;
+  cache->stride = stride;
+  cache->objs_per_slab = (PGSIZE - sizeof (struct slab)) / stride;
+  cache->ctor = ctor;
+  list_init (&cache->partial);
+  cache->spare = NULL;
+  lock_init_named (&cache->lock, name);
+}
+
+/* Obtains and returns an object from CACHE, or a null pointer if
+   memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *cache)
+{
+  struct slab *s;
+  void *obj;
+
+  lock_acquire (&cache->lock);
+  if (!list_empty (&cache->partial))
+    s = list_entry (list_front (&cache->partial), struct slab, elem);
+  else
+    {
+      if (cache->spare != NULL)
+        {
+          s = cache->spare;
+          cache->spare = NULL;
+        }
+      else
+        {
+          s = new_slab (cache);
+          if (s == NULL)
+            {
+              lock_release (&cache->lock);
+              return NULL;
+            }
+        }
+      list_push_front (&cache->partial, &s->elem);
+    }
+
+  obj = s->free;
+  s->free = *obj_link (cache, obj);
+  if (--s->free_cnt == 0)
+    list_remove (&s->elem);
+  lock_release (&cache->lock);
+
+  return obj;
+}
+
+/* Obtains and returns an object from CACHE, which must not have a
+   constructor, filled with zeros.  Returns a null pointer if
+   memory is not available. */
+void *
+kmem_cache_zalloc (struct kmem_cache *cache)
+{
+  void *obj;
+
+  ASSERT (cache->ctor == NULL);
+  obj = kmem_cache_alloc (cache);
+  if (obj != NULL)
+    memset (obj, 0, cache->obj_size);
+  return obj;
+}
+
+/* Frees OBJ, which must have been allocated from CACHE.  A null
+   pointer is ignored. */
+void
+kmem_cache_free (struct kmem_cache *cache, void *obj)
+{
+  struct slab *s;
+
+  if (obj == NULL)
+    return;
+  s = obj_to_slab (cache, obj);
+
+#ifndef NDEBUG
+  /* Clear the object to help detect use-after-free bugs. */
+  if (cache->ctor == NULL)
+    memset (obj, 0xcc, cache->obj_size);
+#endif
+
+  lock_acquire (&cache->lock);
+  *obj_link (cache, obj) = s->free;
+  s->free = obj;
+  if (s->free_cnt++ == 0)
+    list_push_front (&cache->partial, &s->elem);
+  if (s->free_cnt == cache->objs_per_slab)
+    {
+      list_remove (&s->elem);
+      if (cache->spare == NULL)
+        cache->spare = s;
+      else
+        palloc_free_page (s);
+    }
+  lock_release (&cache->lock);
+}
+
+/* Allocates a new slab for CACHE, with all of its objects
+   constructed and free.  Returns a null pointer if no page is
+   available. */
+static struct slab *
+new_slab (struct kmem_cache *cache)
+{
+  struct slab *s = palloc_get_page (0);
+  uint8_t *obj;
+  size_t i;
+
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = cache;
+  s->free_cnt = cache->objs_per_slab;
+  s->free = NULL;
+  obj = (uint8_t *) (s + 1) + cache->stride * cache->objs_per_slab;
+  for (i = 0; i < cache->objs_per_slab; i++)
+    {
+      obj -= cache->stride;
+      if (cache->ctor != NULL)
+        cache->ctor (obj);
+      *obj_link (cache, obj) = s->free;
+      s->free = obj;
+    }
+  return s;
+}
+
+/* Returns the slab that OBJ, from CACHE, is inside. */
+static struct slab *
+obj_to_slab (struct kmem_cache *cache, void *obj)
+{
+  struct slab *s = pg_round_down (obj);
+
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == cache);
+  ASSERT ((pg_ofs (obj) - sizeof *s) % cache->stride == 0);
+  return s;
+}
@@ -0,0 +1,31 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stddef.h>
+#include "threads/synch.h"
+
+struct slab;
+
+/* A cache of objects of one exact size, carved out of whole
+   pages.  See slab.c. */
+struct kmem_cache
+  {
+    const char *name;           /* For debugging. */
+    size_t obj_size;            /* Size of each object in bytes. */
+    size_t link_ofs;            /* Offset of free-chain link in object. */
+    size_t stride;              /* Distance between objects. */
+    size_t objs_per_slab;       /* Number of objects in a slab. */
+    void (*ctor) (void *);      /* Constructor, or a null pointer. */
+    struct list partial;        /* Slabs with some free objects. */
+    struct slab *spare;         /* One fully free slab kept back. */
+    struct lock lock;           /* Lock. */
+  };
+
+void kmem_cache_init (struct kmem_cache *, const char *name, size_t size,
+                      void (*ctor) (void *));
+void *kmem_cache_alloc (struct kmem_cache *);
+void *kmem_cache_zalloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+
+#endif /* threads/slab.h */
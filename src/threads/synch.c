@@ -27,10 +27,39 @@
 */
 
 #include "threads/synch.h"
+#include <atomic.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+
+/* Maximum length of a chain of lock holders that a donation is
+   propagated along.  Bounds the work done by lock_acquire() and
+   protects against donation cycles. */
+#define DONATION_MAX_DEPTH 8
+
+/* Times lock_acquire() looks again at a lock whose holder is
+   running on another CPU before it goes to sleep. */
+#define LOCK_SPIN_MAX 1000
+
+/* Lock classes, and the number reported by lock_print_stats(). */
+#define LOCK_CLASS_MAX 64
+#define LOCK_STATS_TOP 10
+
+bool lock_stats_enabled;
+
+static struct lock_class lock_classes[LOCK_CLASS_MAX];
+static size_t lock_class_cnt;
+
+static bool thread_priority_less (const struct list_elem *,
+                                  const struct list_elem *, void *aux);
+static bool sema_elem_priority_less (const struct list_elem *,
+                                     const struct list_elem *, void *aux);
+static bool lock_take (struct lock *, struct thread *);
+static bool lock_spin (struct lock *, struct thread *);
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -48,6 +77,20 @@ sema_init (struct semaphore *sema, unsigned value)
 
   sema->value = value;
   list_init (&sema->waiters);
+  sema->handoff = false;
+}
+
+/* Initializes SEMA to VALUE like sema_init(), except that
+   sema_up() with a thread waiting gives the unit straight to that
+   thread instead of adding it to the value.  Otherwise a thread
+   that runs before the woken one could take the unit first, and
+   the woken thread would only find the value 0 again and go back
+   to sleep, for a wasted pair of context switches each time. */
+void
+sema_init_handoff (struct semaphore *sema, unsigned value) 
+{
+  sema_init (sema, value);
+  sema->handoff = true;
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -60,18 +103,21 @@ sema_init (struct semaphore *sema, unsigned value)
 void
 sema_down (struct semaphore *sema) 
 {
+  struct thread *cur = thread_current ();
   enum intr_level old_level;
 
   ASSERT (sema != NULL);
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
-  while (sema->value == 0) 
+  cur->sema_handoff = false;
+  while (!cur->sema_handoff && sema->value == 0) 
     {
-      list_push_back (&sema->waiters, &thread_current ()->elem);
+      list_push_back (&sema->waiters, &cur->elem);
       thread_block ();
     }
-  sema->value--;
+  if (!cur->sema_handoff)
+    sema->value--;
   intr_set_level (old_level);
 }
 
@@ -102,7 +148,11 @@ sema_try_down (struct semaphore *sema)
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any.  The waiter is chosen at wakeup time, so priority
+   donated to a waiter while it sleeps is taken into account; ties
+   go to the thread that has waited longest.  If the woken thread has a higher priority than the caller, the
+   caller yields to it.
 
    This function may be called from an interrupt handler. */
 void
@@ -114,10 +164,34 @@ sema_up (struct semaphore *sema)
 
   old_level = intr_disable ();
   if (!list_empty (&sema->waiters)) 
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
-  sema->value++;
+    {
+      struct list_elem *e = list_max (&sema->waiters,
+                                      thread_priority_less, NULL);
+      struct thread *t = list_entry (e, struct thread, elem);
+
+      list_remove (e);
+      if (sema->handoff)
+        t->sema_handoff = true;
+      else
+        sema->value++;
+      thread_unblock (t);
+    }
+  else
+    sema->value++;
   intr_set_level (old_level);
+  thread_yield_to_higher ();
+}
+
+/* Orders threads, linked through their `elem' members, by
+   increasing priority. */
+static bool
+thread_priority_less (const struct list_elem *a_,
+                      const struct list_elem *b_, void *aux UNUSED)
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->priority < b->priority;
 }
 
 static void sema_test_helper (void *sema_);
@@ -175,16 +249,58 @@ sema_test_helper (void *sema_)
 void
 lock_init (struct lock *lock)
 {
+  lock_init_named (lock, NULL);
+}
+
+/* Initializes LOCK like lock_init(), and with -lockstat counts
+   its contention together with that of every other lock named
+   NAME, which should be a string literal.  Locks without a name
+   are not counted. */
+void
+lock_init_named (struct lock *lock, const char *name)
+{
+  enum intr_level old_level;
+  size_t i;
+
   ASSERT (lock != NULL);
 
   lock->holder = NULL;
-  sema_init (&lock->semaphore, 1);
+  sema_init_handoff (&lock->semaphore, 1);
+  lock->class = NULL;
+  lock->acquired = 0;
+  if (name == NULL || !lock_stats_enabled)
+    return;
+
+  old_level = intr_disable ();
+  for (i = 0; i < lock_class_cnt; i++)
+    if (!strcmp (lock_classes[i].name, name))
+      break;
+  if (i == lock_class_cnt && lock_class_cnt < LOCK_CLASS_MAX)
+    lock_classes[lock_class_cnt++].name = name;
+  if (i < lock_class_cnt)
+    lock->class = &lock_classes[i];
+  intr_set_level (old_level);
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
 
+   If LOCK is held by a lower-priority thread, the current
+   thread donates its priority to the holder, and on down the
+   chain of holders if the holder is itself waiting for a lock,
+   up to DONATION_MAX_DEPTH levels.  Donation is not used in
+   MLFQS mode.
+
+   A free lock is taken with a single compare-and-swap, without
+   going through the semaphore.  A lock whose holder is running on
+   another CPU is spun on for a while, since it will likely be
+   released sooner than we could sleep and be woken.  Locks that
+   keep -lockstat statistics always take the slow path.  A lock
+   released while threads wait is handed to the highest-priority
+   waiter, which the releaser yields to if it has a higher
+   priority, so no other thread can take it in between.
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -192,12 +308,103 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  bool contended;
+  uint64_t start = 0;
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
+  if (lock->class == NULL
+      && (lock_take (lock, cur) || lock_spin (lock, cur)))
+    {
+      TRACE (TRACE_LOCK_ACQUIRE, lock, 0);
+      return;
+    }
+
+  old_level = intr_disable ();
+  TRACE (TRACE_LOCK_ACQUIRE, lock,
+         lock->holder != NULL ? lock->holder->tid : 0);
+  contended = lock->semaphore.value == 0;
+  if (lock->class != NULL && contended)
+    start = timer_cycles ();
+  if (lock->holder != NULL && !thread_mlfqs)
+    {
+      struct lock *l = lock;
+      int depth;
+
+      cur->waiting_lock = lock;
+      for (depth = 0; depth < DONATION_MAX_DEPTH; depth++)
+        {
+          if (l == NULL || l->holder == NULL)
+            break;
+          thread_donate_priority (l->holder, cur->priority);
+          l = l->holder->waiting_lock;
+        }
+    }
+
   sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  cur->waiting_lock = NULL;
+  lock->holder = cur;
+  list_push_back (&cur->held_locks, &lock->elem);
+  if (lock->class != NULL)
+    {
+      lock->acquired = timer_cycles ();
+      lock->class->acquire_cnt++;
+      if (contended)
+        {
+          lock->class->contended_cnt++;
+          lock->class->wait_cycles += lock->acquired - start;
+        }
+    }
+  intr_set_level (old_level);
+}
+
+/* Takes LOCK for CUR if it is free and returns true, or returns
+   false if it is held.  The lock word is claimed with a single
+   compare-and-swap; interrupts are only turned off to add LOCK to
+   CUR's held_locks, which lock_try_acquire() in a handler could
+   also be changing. */
+static bool
+lock_take (struct lock *lock, struct thread *cur)
+{
+  enum intr_level old_level;
+
+  if (!atomic_cas (&lock->semaphore.value, 1u, 0u))
+    return false;
+  old_level = intr_disable ();
+  lock->holder = cur;
+  list_push_back (&cur->held_locks, &lock->elem);
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Spins on LOCK for CUR as long as its holder is running, which
+   can only be on another CPU, up to LOCK_SPIN_MAX times.  Returns
+   true if CUR took the lock, false if it should sleep instead. */
+static bool
+lock_spin (struct lock *lock, struct thread *cur)
+{
+  int i;
+
+  for (i = 0; i < LOCK_SPIN_MAX; i++)
+    {
+      struct thread *holder;
+
+      if (atomic_read (&lock->semaphore.value) != 0
+          && lock_take (lock, cur))
+        return true;
+
+      /* A lock with no holder and no unit either has just been
+         handed to a waiter, which has yet to run. */
+      holder = atomic_read (&lock->holder);
+      if (holder == NULL || holder->status != THREAD_RUNNING)
+        return false;
+      asm volatile ("pause");
+    }
+  return false;
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -216,11 +423,24 @@ lock_try_acquire (struct lock *lock)
 
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+      enum intr_level old_level = intr_disable ();
+      lock->holder = thread_current ();
+      list_push_back (&thread_current ()->held_locks, &lock->elem);
+      if (lock->class != NULL)
+        {
+          lock->acquired = timer_cycles ();
+          lock->class->acquire_cnt++;
+        }
+      intr_set_level (old_level);
+    }
   return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
+   Any priority donated through LOCK is given up, so the current
+   thread drops back to the highest of its base priority and the
+   donations through the locks that it still holds.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
@@ -228,11 +448,24 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock) 
 {
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+  if (lock->class != NULL)
+    {
+      uint64_t held = timer_cycles () - lock->acquired;
+      if (held > lock->class->max_hold_cycles)
+        lock->class->max_hold_cycles = held;
+    }
+  list_remove (&lock->elem);
   lock->holder = NULL;
+  if (!thread_mlfqs)
+    thread_refresh_priority ();
   sema_up (&lock->semaphore);
+  intr_set_level (old_level);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -245,14 +478,131 @@ lock_held_by_current_thread (const struct lock *lock)
 
   return lock->holder == thread_current ();
 }
+
+/* Prints the LOCK_STATS_TOP lock classes that were waited for
+   longest. */
+void
+lock_print_stats (void)
+{
+  struct lock_class *top[LOCK_STATS_TOP];
+  bool shown[LOCK_CLASS_MAX];
+  size_t top_cnt, i;
+
+  memset (shown, 0, sizeof shown);
+  for (top_cnt = 0; top_cnt < LOCK_STATS_TOP; top_cnt++)
+    {
+      struct lock_class *max = NULL;
+      for (i = 0; i < lock_class_cnt; i++)
+        if (!shown[i] && lock_classes[i].acquire_cnt > 0
+            && (max == NULL
+                || lock_classes[i].wait_cycles > max->wait_cycles))
+          max = &lock_classes[i];
+      if (max == NULL)
+        break;
+      shown[max - lock_classes] = true;
+      top[top_cnt] = max;
+    }
+
+  printf ("Lock contention: %zu classes, top %zu by time waited:\n",
+          lock_class_cnt, top_cnt);
+  for (i = 0; i < top_cnt; i++)
+    printf ("  %-16s %8llu acquires, %8llu contended, "
+            "%"PRId64" us waited, %"PRId64" us longest hold\n",
+            top[i]->name, top[i]->acquire_cnt, top[i]->contended_cnt,
+            timer_cycles_to_us (top[i]->wait_cycles),
+            timer_cycles_to_us (top[i]->max_hold_cycles));
+}
 
+/* Initializes spinlock LOCK, which is not held to begin with. */
+void
+spin_init (struct spinlock *lock)
+{
+  ASSERT (lock != NULL);
+
+  lock->next_ticket = 0;
+  lock->now_serving = 0;
+}
+
+/* Acquires LOCK, spinning until it is free.  Interrupts must be
+   off, and stay off until spin_unlock(): a holder that was
+   switched out would keep every waiter spinning.  While only one
+   CPU runs, LOCK can only be found held by a recursive
+   acquisition, which would spin forever. */
+void
+spin_lock (struct spinlock *lock)
+{
+  unsigned ticket;
+
+  ASSERT (lock != NULL);
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  ticket = atomic_fetch_add (&lock->next_ticket, 1);
+  while (atomic_read (&lock->now_serving) != ticket)
+    asm volatile ("pause");
+  barrier ();
+}
+
+/* Releases LOCK, which the caller must hold, to the waiter that
+   has waited longest. */
+void
+spin_unlock (struct spinlock *lock)
+{
+  ASSERT (spin_is_locked (lock));
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  barrier ();
+  atomic_set (&lock->now_serving, lock->now_serving + 1);
+}
+
+/* Disables interrupts, acquires LOCK and returns the previous
+   interrupt level, to be passed to spin_unlock_irqrestore(). */
+enum intr_level
+spin_lock_irqsave (struct spinlock *lock)
+{
+  enum intr_level old_level = intr_disable ();
+  spin_lock (lock);
+  return old_level;
+}
+
+/* Releases LOCK and restores interrupt level OLD_LEVEL. */
+void
+spin_unlock_irqrestore (struct spinlock *lock, enum intr_level old_level)
+{
+  spin_unlock (lock);
+  intr_set_level (old_level);
+}
+
+/* Returns true if some thread holds LOCK. */
+bool
+spin_is_locked (const struct spinlock *lock)
+{
+  ASSERT (lock != NULL);
+
+  return lock->next_ticket != lock->now_serving;
+}
+
 /* One semaphore in a list. */
 struct semaphore_elem 
   {
     struct list_elem elem;              /* List element. */
     struct semaphore semaphore;         /* This semaphore. */
+    struct thread *thread;              /* Thread waiting on it. */
   };
 
+/* Orders condition variable waiters by increasing priority of
+   the waiting thread. */
+static bool
+sema_elem_priority_less (const struct list_elem *a_,
+                         const struct list_elem *b_, void *aux UNUSED)
+{
+  const struct semaphore_elem *a
+    = list_entry (a_, struct semaphore_elem, elem);
+  const struct semaphore_elem *b
+    = list_entry (b_, struct semaphore_elem, elem);
+
+  return a->thread->priority < b->thread->priority;
+}
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -295,6 +645,7 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   
   sema_init (&waiter.semaphore, 0);
+  waiter.thread = thread_current ();
   list_push_back (&cond->waiters, &waiter.elem);
   lock_release (lock);
   sema_down (&waiter.semaphore);
@@ -302,8 +653,9 @@ cond_wait (struct condition *cond, struct lock *lock)
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
-   LOCK must be held before calling this function.
+   this function signals the highest-priority one of them to wake
+   up from its wait.  LOCK must be held before calling this
+   function.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to signal a condition variable within an
@@ -317,8 +669,12 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (lock_held_by_current_thread (lock));
 
   if (!list_empty (&cond->waiters)) 
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+    {
+      struct list_elem *e = list_max (&cond->waiters,
+                                      sema_elem_priority_less, NULL);
+      list_remove (e);
+      sema_up (&list_entry (e, struct semaphore_elem, elem)->semaphore);
+    }
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -336,3 +692,140 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes RWLOCK, which no thread holds to begin with. */
+void
+rwlock_init (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  lock_init (&rwlock->lock);
+  cond_init (&rwlock->readers_ok);
+  cond_init (&rwlock->writer_ok);
+  rwlock->reader_cnt = 0;
+  rwlock->writer_wait_cnt = 0;
+  rwlock->writer = NULL;
+}
+
+/* Acquires RWLOCK for reading, sleeping while a writer holds it
+   or waits for it.  The current thread must not hold it. */
+void
+rwlock_acquire_read (struct rwlock *rwlock)
+{
+  ASSERT (!rwlock_held_for_write (rwlock));
+
+  lock_acquire (&rwlock->lock);
+  while (rwlock->writer != NULL || rwlock->writer_wait_cnt > 0)
+    cond_wait (&rwlock->readers_ok, &rwlock->lock);
+  rwlock->reader_cnt++;
+  lock_release (&rwlock->lock);
+}
+
+/* Releases RWLOCK, which the current thread holds for reading. */
+void
+rwlock_release_read (struct rwlock *rwlock)
+{
+  lock_acquire (&rwlock->lock);
+  ASSERT (rwlock->reader_cnt > 0);
+  if (--rwlock->reader_cnt == 0 && rwlock->writer_wait_cnt > 0)
+    cond_signal (&rwlock->writer_ok, &rwlock->lock);
+  lock_release (&rwlock->lock);
+}
+
+/* Acquires RWLOCK for writing, sleeping until no reader or writer
+   holds it.  Waiting writers are woken highest priority first.
+   The current thread must not hold it. */
+void
+rwlock_acquire_write (struct rwlock *rwlock)
+{
+  ASSERT (!rwlock_held_for_write (rwlock));
+
+  lock_acquire (&rwlock->lock);
+  rwlock->writer_wait_cnt++;
+  while (rwlock->writer != NULL || rwlock->reader_cnt > 0)
+    cond_wait (&rwlock->writer_ok, &rwlock->lock);
+  rwlock->writer_wait_cnt--;
+  rwlock->writer = thread_current ();
+  lock_release (&rwlock->lock);
+}
+
+/* Releases RWLOCK, which the current thread holds for writing.
+   Hands it to the next writer if one is waiting, otherwise to all
+   the waiting readers. */
+void
+rwlock_release_write (struct rwlock *rwlock)
+{
+  ASSERT (rwlock_held_for_write (rwlock));
+
+  lock_acquire (&rwlock->lock);
+  rwlock->writer = NULL;
+  if (rwlock->writer_wait_cnt > 0)
+    cond_signal (&rwlock->writer_ok, &rwlock->lock);
+  else
+    cond_broadcast (&rwlock->readers_ok, &rwlock->lock);
+  lock_release (&rwlock->lock);
+}
+
+/* Returns true if the current thread holds RWLOCK for writing. */
+bool
+rwlock_held_for_write (const struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  return rwlock->writer == thread_current ();
+}
+
+/* Initializes poll queue Q as empty. */
+void
+poll_queue_init (struct poll_queue *q)
+{
+  ASSERT (q != NULL);
+
+  list_init (&q->entries);
+}
+
+/* Adds ENTRY to Q, so that SEMA is raised whenever Q is woken
+   until ENTRY is removed. */
+void
+poll_queue_add (struct poll_queue *q, struct poll_entry *entry,
+                struct semaphore *sema)
+{
+  enum intr_level old_level;
+
+  ASSERT (q != NULL && entry != NULL && sema != NULL);
+
+  old_level = intr_disable ();
+  entry->queue = q;
+  entry->sema = sema;
+  list_push_back (&q->entries, &entry->elem);
+  intr_set_level (old_level);
+}
+
+/* Removes ENTRY from its queue, if it is on one. */
+void
+poll_queue_remove (struct poll_entry *entry)
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (entry->queue != NULL)
+    {
+      list_remove (&entry->elem);
+      entry->queue = NULL;
+    }
+  intr_set_level (old_level);
+}
+
+/* Raises the semaphore of every entry in Q.  The waiters then
+   check for themselves whether the object is ready.  May be
+   called from an interrupt handler. */
+void
+poll_queue_wake (struct poll_queue *q)
+{
+  enum intr_level old_level = intr_disable ();
+  struct list_elem *e;
+
+  for (e = list_begin (&q->entries); e != list_end (&q->entries);
+       e = list_next (e))
+    sema_up (list_entry (e, struct poll_entry, elem)->sema);
+  intr_set_level (old_level);
+}
@@ -1,34 +1,75 @@
 #ifndef THREADS_SYNCH_H
 #define THREADS_SYNCH_H
 
+#include <atomic.h>
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
 
 /* A counting semaphore. */
 struct semaphore 
   {
     unsigned value;             /* Current value. */
     struct list waiters;        /* List of waiting threads. */
+    bool handoff;               /* Hand units straight to waiters? */
   };
 
 void sema_init (struct semaphore *, unsigned value);
+void sema_init_handoff (struct semaphore *, unsigned value);
 void sema_down (struct semaphore *);
 bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
 void sema_self_test (void);
 
+/* Contention statistics shared by all the locks initialized
+   with the same name, kept when -lockstat is given. */
+struct lock_class
+  {
+    const char *name;                   /* Name given to lock_init_named(). */
+    unsigned long long acquire_cnt;     /* Times acquired. */
+    unsigned long long contended_cnt;   /* Times found already held. */
+    uint64_t wait_cycles;               /* Total time spent waiting. */
+    uint64_t max_hold_cycles;           /* Longest time held. */
+  };
+
 /* Lock. */
 struct lock 
   {
-    struct thread *holder;      /* Thread holding lock (for debugging). */
+    struct thread *holder;      /* Thread holding lock. */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct list_elem elem;      /* Element in holder's held_locks. */
+    struct lock_class *class;   /* Statistics, or a null pointer. */
+    uint64_t acquired;          /* timer_cycles() when last acquired. */
   };
 
+/* -lockstat: Keep statistics for named locks? */
+extern bool lock_stats_enabled;
+
 void lock_init (struct lock *);
+void lock_init_named (struct lock *, const char *name);
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
+void lock_print_stats (void);
+
+/* Spinlock, for short critical sections.  A thread busy-waits for
+   it instead of sleeping, and holds it with interrupts off, so it
+   may be taken by interrupt handlers and the scheduler.  Waiters
+   get it in the order they arrived. */
+struct spinlock
+  {
+    unsigned next_ticket;       /* Ticket handed to the next waiter. */
+    unsigned now_serving;       /* Ticket of the holder. */
+  };
+
+void spin_init (struct spinlock *);
+void spin_lock (struct spinlock *);
+void spin_unlock (struct spinlock *);
+enum intr_level spin_lock_irqsave (struct spinlock *);
+void spin_unlock_irqrestore (struct spinlock *, enum intr_level);
+bool spin_is_locked (const struct spinlock *);
 
 /* Condition variable. */
 struct condition 
@@ -41,11 +82,46 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
-/* Optimization barrier.
+/* Reader-writer lock.  Any number of readers may hold it at once,
+   or a single writer.  Writers take precedence: once one is
+   waiting, new readers wait behind it. */
+struct rwlock
+  {
+    struct lock lock;           /* Guards the members below. */
+    struct condition readers_ok; /* Writer released, none waiting. */
+    struct condition writer_ok; /* Last reader or writer released. */
+    int reader_cnt;             /* Readers holding the lock. */
+    int writer_wait_cnt;        /* Writers waiting for it. */
+    struct thread *writer;      /* Writer holding it, or null. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_for_write (const struct rwlock *);
+
+/* Poll queue: the threads waiting in poll() for an object to
+   become ready.  Each waiter adds an entry that names the
+   semaphore to raise when the object's state changes.  May be
+   woken from interrupt handlers. */
+struct poll_queue
+  {
+    struct list entries;        /* List of struct poll_entry. */
+  };
+
+struct poll_entry
+  {
+    struct list_elem elem;      /* Element in queue's entries. */
+    struct poll_queue *queue;   /* Queue it is on, or null. */
+    struct semaphore *sema;     /* Raised by poll_queue_wake(). */
+  };
 
-   The compiler will not reorder operations across an
-   optimization barrier.  See "Optimization Barriers" in the
-   reference guide for more information.*/
-#define barrier() asm volatile ("" : : : "memory")
+void poll_queue_init (struct poll_queue *);
+void poll_queue_add (struct poll_queue *, struct poll_entry *,
+                     struct semaphore *);
+void poll_queue_remove (struct poll_entry *);
+void poll_queue_wake (struct poll_queue *);
 
 #endif /* threads/synch.h */
@@ -1,15 +1,27 @@
 #include "threads/thread.h"
+#include <atomic.h>
 #include <debug.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <stddef.h>
 #include <random.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
+#include "threads/fixed-point.h"
 #include "threads/flags.h"
+#include "threads/fpu.h"
+#include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/mp.h"
 #include "threads/palloc.h"
+#include "threads/pte.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/tunable.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 
 #include "filesys/file.h"
@@ -23,22 +35,59 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Scheduling state of one CPU.
+
+   Its run queues hold the processes in THREAD_READY state that
+   will run on it, that is, processes that are ready to run but
+   not actually running.  There is one FIFO queue per priority
+   level, and bit P of ready_bitmap is set if and only if
+   ready_queues[P] is nonempty, so the highest-priority ready
+   thread can be found with a single find-first-set.
+
+   Deadline threads with budget left in their period are kept on
+   rt_queue instead, ordered by deadline, and run before any
+   thread in ready_queues.
+
+   Only the bootstrap processor runs threads for now (see
+   threads/mp.c), so only cpus[0] is used. */
+#define READY_WORDS ((PRI_MAX + 32) / 32)
+struct cpu
+  {
+    struct list ready_queues[PRI_MAX + 1];
+    uint32_t ready_bitmap[READY_WORDS];
+    int ready_cnt;              /* Number of threads in ready_queues. */
+    struct list rt_queue;       /* Deadline threads, earliest first. */
+    struct thread *idle_thread; /* Runs when ready_queues are empty. */
+  };
+static struct cpu cpus[MP_CPU_MAX];
+static int cpu_online_cnt = 1;  /* CPUs in cpus[] that run threads. */
+
+/* Load balancing.  A CPU whose run queues are empty steals half of
+   the threads ready on the busiest CPU, and every
+   BALANCE_INTERVAL ticks threads move from the busiest CPU to the
+   least busy one if they differ by more than one ready thread. */
+#define BALANCE_INTERVAL 20
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
 
-/* Idle thread. */
-static struct thread *idle_thread;
-
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
-/* Lock used by allocate_tid(). */
-static struct lock tid_lock;
+/* Threads in all_list hashed by tid, for thread_get_by_id().
+   Tids are handed out in sequence, so the low bits spread them
+   evenly.  Protected, like all_list, by disabling interrupts. */
+#define TID_BUCKET_CNT 64
+static struct list tid_buckets[TID_BUCKET_CNT];
+
+/* Pages of threads that have exited, kept for thread_create() to
+   reuse without going through palloc and zeroing them again.
+   init_thread() clears everything but the stack, which needs no
+   clearing.  Protected by disabling interrupts. */
+#define THREAD_CACHE_MAX 8
+static struct thread *thread_cache[THREAD_CACHE_MAX];
+static size_t thread_cache_cnt;
 
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame 
@@ -53,8 +102,50 @@ static long long idle_ticks;    /* # of timer ticks spent idle. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
 
+/* Scheduling statistics, kept if thread_sched_stats is true.
+   latency_hist[I] counts the threads that waited between 2**I
+   and 2**(I+1) TSC cycles on the run queue, the last bucket also
+   counting longer waits.  runq_hist[N] counts the times the
+   scheduler found N threads ready, the last bucket also counting
+   more. */
+#define LATENCY_BUCKETS 32
+#define RUNQ_BUCKETS 16
+bool thread_sched_stats;
+static unsigned long long latency_hist[LATENCY_BUCKETS];
+static unsigned long long runq_hist[RUNQ_BUCKETS];
+
+/* Deadline scheduling.  A thread given a period and a budget by
+   thread_set_deadline() runs ahead of all priorities, earliest
+   deadline first, for up to its budget in each period.  Once the
+   budget is spent it runs at its ordinary priority until the next
+   period starts.  rt_util is the CPU share in thousandths that
+   the threads on rt_list have reserved; thread_set_deadline()
+   refuses to raise it past RT_UTIL_MAX, leaving the rest for
+   everyone else. */
+#define RT_UTIL_MAX 900
+static struct list rt_list;
+static int rt_util;
+
+/* CPU quota groups.  The threads in a group together may run for
+   at most QUOTA ticks in each PERIOD ticks.  A thread picked to
+   run while its group has used up its quota is blocked on the
+   group's throttled list instead, until thread_tick() starts the
+   group's next period.  Groups are never destroyed. */
+#define CPU_GROUP_MAX 16
+struct cpu_group
+  {
+    int64_t quota;              /* Ticks allowed per period. */
+    int64_t period;             /* Length of a period in ticks. */
+    int64_t period_end;         /* Tick when this period ends. */
+    int64_t used;               /* Ticks used in this period. */
+    struct list throttled;      /* Threads waiting for next period. */
+  };
+static struct cpu_group cpu_groups[CPU_GROUP_MAX];
+static int cpu_group_cnt;
+
 /* Scheduling. */
-#define TIME_SLICE 4            /* # of timer ticks to give each thread. */
+#define TIME_SLICE 4            /* Default for time_slice. */
+static unsigned time_slice;     /* # of timer ticks to give each thread. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
 /* If false (default), use round-robin scheduler.
@@ -62,37 +153,55 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* MLFQS state.  LOAD_AVG is a fixed-point number.  Threads whose
+   recent_cpu changed since their priority was last computed are
+   kept on mlfqs_stale_list, so that the 4-tick priority update
+   only touches those threads instead of all of all_list. */
+#define MLFQS_PRIORITY_INTERVAL 4
+static int load_avg;
+static struct list mlfqs_stale_list;
+
+static void mlfqs_update_priority (struct thread *);
+static void mlfqs_update_recent_cpu (struct thread *, void *aux);
+static void mlfqs_second (void);
+static void account_tick (struct thread *, bool user);
+static void change_priority (struct thread *, int priority);
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
 static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
 static void init_thread (struct thread *, const char *name, int priority);
+static struct cpu *cpu_current (void);
+static bool is_idle_thread (const struct thread *);
+static void ready_queue_push (struct thread *);
+static void ready_queue_remove (struct thread *);
+static struct thread *ready_queue_pop (struct cpu *, int priority);
+static int ready_queue_max_priority (const struct cpu *);
+static bool should_preempt (struct cpu *, struct thread *);
+static bool rt_runnable (const struct thread *);
+static int rt_share (int64_t budget, int64_t period);
+static void rt_refresh (struct thread *, int64_t now);
+static void rt_tick (struct thread *);
+static void group_tick (struct thread *);
+static uint32_t cpu_bit (const struct cpu *);
+static list_less_func deadline_less;
+static void migrate_threads (struct cpu *from, struct cpu *to, int cnt);
+static bool steal_threads (struct cpu *);
+static void balance_cpus (void);
+static int log2_floor (uint64_t);
+static void print_sched_stats (void);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static struct thread *alloc_thread_page (void);
+static void free_thread_page (struct thread *);
 
 
 
-void sendsig_thread (tid_t tid, int signum){
-	struct list_elem *e;
-	for (e = list_begin(&all_list); e != list_end(&all_list); e = list_next(e)){
-		struct thread *t = list_entry(e, struct thread, allelem);
-		if (t->tid == tid){
-			for(int i=0; i<10; i++){
-				if (t->save_signal[i] == NULL)
-					return;
-				if (t->save_signal[i]->signum == signum){
-					printf("Signum: %d, Action: %p\n", signum, t->save_signal[i]->sig_handler);
-					return;
-				}
-			}
-		}
-	}
-	return ;
-}	
 
 
 /* Initializes the threading system by transforming the code
@@ -111,17 +220,27 @@ void sendsig_thread (tid_t tid, int signum){
 void
 thread_init (void) 
 {
+  int c, i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
-  lock_init (&tid_lock);
-  list_init (&ready_list);
+  time_slice = tunable_int ("time_slice", TIME_SLICE, 1, TIMER_FREQ);
+  for (c = 0; c < MP_CPU_MAX; c++)
+    {
+      for (i = 0; i <= PRI_MAX; i++)
+        list_init (&cpus[c].ready_queues[i]);
+      list_init (&cpus[c].rt_queue);
+    }
   list_init (&all_list);
+  for (i = 0; i < TID_BUCKET_CNT; i++)
+    list_init (&tid_buckets[i]);
+  list_init (&mlfqs_stale_list);
+  list_init (&rt_list);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
   init_thread (initial_thread, "main", PRI_DEFAULT);
   initial_thread->status = THREAD_RUNNING;
-  initial_thread->tid = allocate_tid ();
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -141,15 +260,45 @@ thread_start (void)
   sema_down (&idle_started);
 }
 
-/* Called by the timer interrupt handler at each timer tick.
-   Thus, this function runs in an external interrupt context. */
+/* Called by the timer interrupt handler at each timer tick, with
+   USER true if the tick interrupted user code.  Thus, this
+   function runs in an external interrupt context. */
 void
-thread_tick (void) 
+thread_tick (bool user) 
 {
-  struct thread *t = thread_current ();
+  account_tick (thread_current (), user);
+  if (!list_empty (&rt_list))
+    rt_tick (thread_current ());
+  if (cpu_group_cnt > 0)
+    group_tick (thread_current ());
 
+  /* Enforce preemption. */
+  if (++thread_ticks >= time_slice)
+    intr_yield_on_return ();
+}
+
+/* Accounts for one timer tick that passed while the idle thread
+   ran but the timer did not interrupt, because the CPU was idle
+   in tickless mode.  Interrupts must be off. */
+void
+thread_idle_tick (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  account_tick (cpu_current ()->idle_thread, false);
+}
+
+/* Charges the timer tick that just passed to T, the thread that
+   ran during it, in user code if USER is true, and does the
+   scheduler's periodic work. */
+static void
+account_tick (struct thread *t, bool user) 
+{
   /* Update statistics. */
-  if (t == idle_thread)
+  if (user)
+    t->usage.user_ticks++;
+  else
+    t->usage.sys_ticks++;
+  if (is_idle_thread (t))
     idle_ticks++;
 #ifdef USERPROG
   else if (t->pagedir != NULL)
@@ -158,9 +307,34 @@ thread_tick (void)
   else
     kernel_ticks++;
 
-  /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
-    intr_yield_on_return ();
+  if (thread_mlfqs)
+    {
+      int64_t now = timer_ticks ();
+
+      if (!is_idle_thread (t))
+        {
+          t->recent_cpu = ADD_INT (t->recent_cpu, 1);
+          if (!t->mlfqs_stale)
+            {
+              t->mlfqs_stale = true;
+              list_push_back (&mlfqs_stale_list, &t->mlfqs_elem);
+            }
+        }
+
+      if (now % TIMER_FREQ == 0)
+        mlfqs_second ();
+      if (now % MLFQS_PRIORITY_INTERVAL == 0)
+        while (!list_empty (&mlfqs_stale_list))
+          {
+            struct thread *s = list_entry (list_pop_front (&mlfqs_stale_list),
+                                           struct thread, mlfqs_elem);
+            s->mlfqs_stale = false;
+            mlfqs_update_priority (s);
+          }
+    }
+
+  if (cpu_online_cnt > 1 && timer_ticks () % BALANCE_INTERVAL == 0)
+    balance_cpus ();
 }
 
 /* Prints thread statistics. */
@@ -169,6 +343,26 @@ thread_print_stats (void)
 {
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  if (thread_sched_stats)
+    print_sched_stats ();
+}
+
+/* Prints the nonempty buckets of the scheduling histograms. */
+static void
+print_sched_stats (void)
+{
+  int i;
+
+  printf ("Scheduling latency (time on run queue before running):\n");
+  for (i = 0; i < LATENCY_BUCKETS; i++)
+    if (latency_hist[i] != 0)
+      printf ("  %10llu+ cycles (%7"PRId64"+ us): %llu\n",
+              1ULL << i, timer_cycles_to_us (1ULL << i), latency_hist[i]);
+  printf ("Run queue length when scheduling:\n");
+  for (i = 0; i < RUNQ_BUCKETS; i++)
+    if (runq_hist[i] != 0)
+      printf ("  %2d%s ready: %llu\n", i, i < RUNQ_BUCKETS - 1 ? " " : "+",
+              runq_hist[i]);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -183,9 +377,8 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   If the new thread has a higher priority than the running
+   thread, the running thread yields to it immediately. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux) 
@@ -202,14 +395,14 @@ thread_create (const char *name, int priority,
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = alloc_thread_page ();
   if (t == NULL)
     return TID_ERROR;
 
 
   /* Initialize thread. */
   init_thread (t, name, priority);
-  tid = t->tid = allocate_tid ();
+  tid = t->tid;
 
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
@@ -229,6 +422,7 @@ thread_create (const char *name, int priority,
  
   /* Add to run queue. */
   thread_unblock (t);
+  thread_yield_to_higher ();
 
   return tid;
 }
@@ -244,6 +438,7 @@ thread_block (void)
 {
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (thread_current ()->preempt_count == 0);
 
   thread_current ()->status = THREAD_BLOCKED;
   schedule ();
@@ -266,7 +461,9 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  if (thread_sched_stats)
+    t->ready_since = timer_cycles ();
+  ready_queue_push (t);
   t->status = THREAD_READY;
   intr_set_level (old_level);
 }
@@ -314,12 +511,22 @@ thread_exit (void)
 #ifdef USERPROG
   process_exit ();
 #endif
+  fpu_exit ();
 
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
   intr_disable ();
   list_remove (&thread_current()->allelem);
+  list_remove (&thread_current ()->tid_elem);
+  if (thread_current ()->rt_period > 0)
+    {
+      list_remove (&thread_current ()->rt_elem);
+      rt_util -= rt_share (thread_current ()->rt_budget,
+                           thread_current ()->rt_period);
+    }
+  if (thread_current ()->mlfqs_stale)
+    list_remove (&thread_current ()->mlfqs_elem);
   thread_current ()->status = THREAD_DYING;
   schedule ();
   NOT_REACHED ();
@@ -334,15 +541,104 @@ thread_yield (void)
   enum intr_level old_level;
   
   ASSERT (!intr_context ());
+  ASSERT (cur->preempt_count == 0);
 
   old_level = intr_disable ();
-  if (cur != idle_thread) 
-    list_push_back (&ready_list, &cur->elem);
+  if (thread_sched_stats)
+    cur->ready_since = timer_cycles ();
+  if (!is_idle_thread (cur)) 
+    ready_queue_push (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
 }
 
+/* Yields the CPU if some ready thread has a higher priority than
+   the running thread.  Call this after making a thread ready or
+   lowering the running thread's priority.
+
+   In an interrupt handler, the yield is deferred until the
+   handler returns, and with preemption disabled, until it is
+   enabled again. */
+void
+thread_yield_to_higher (void)
+{
+  enum intr_level old_level = intr_disable ();
+  bool preempt = should_preempt (cpu_current (), thread_current ());
+  intr_set_level (old_level);
+
+  if (!preempt)
+    return;
+  if (intr_context ())
+    intr_yield_on_return ();
+  else if (thread_preemptible ())
+    thread_yield ();
+}
+
+/* Returns a pseudo-random 32-bit number from the running thread's
+   own generator, which is cheaper than random_ulong() and shares
+   no state with other threads.  Not for interrupt handlers, which
+   would disturb the interrupted thread's sequence. */
+uint32_t
+thread_random (void) 
+{
+  return random_next (&thread_current ()->random);
+}
+
+/* Keeps the running thread from being preempted by another
+   thread until the matching thread_preempt_enable(), without
+   turning interrupts off.  Calls nest.  Interrupt handlers still
+   run; a yield that one asks for meanwhile waits for preemption
+   to be enabled.  The thread must not sleep or yield until then. */
+void
+thread_preempt_disable (void) 
+{
+  thread_current ()->preempt_count++;
+  barrier ();
+}
+
+/* Undoes one thread_preempt_disable().  If that enables
+   preemption and a yield was put off meanwhile, yields now,
+   unless interrupts are off, in which case the next timer tick
+   will. */
+void
+thread_preempt_enable (void) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  bool yield;
+
+  ASSERT (cur->preempt_count > 0);
+
+  barrier ();
+  old_level = intr_disable ();
+  cur->preempt_count--;
+  yield = (cur->preempt_count == 0 && cur->preempt_pending
+           && old_level == INTR_ON && !intr_context ());
+  if (yield)
+    cur->preempt_pending = false;
+  intr_set_level (old_level);
+
+  if (yield)
+    thread_yield ();
+}
+
+/* Returns true if the running thread may be preempted now.  If
+   not, notes that a yield is wanted, so that
+   thread_preempt_enable() yields once it may. */
+bool
+thread_preemptible (void) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level = intr_disable ();
+  bool preemptible = cur->preempt_count == 0;
+
+  if (!preemptible)
+    cur->preempt_pending = true;
+  intr_set_level (old_level);
+  return preemptible;
+}
+
 /* Invoke function 'func' on all threads, passing along 'aux'.
    This function must be called with interrupts off. */
 void
@@ -360,11 +656,82 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's base priority to NEW_PRIORITY.  The
+   effective priority stays raised while a higher priority is
+   being donated to it.  Yields if the running thread no longer
+   has the highest priority. */
 void
 thread_set_priority (int new_priority) 
 {
-  thread_current ()->priority = new_priority;
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  /* The MLFQS scheduler computes priorities itself. */
+  if (thread_mlfqs)
+    return;
+
+  thread_current ()->base_priority = new_priority;
+  thread_refresh_priority ();
+  thread_yield_to_higher ();
+}
+
+/* Changes T's effective priority to PRIORITY, moving T to the
+   matching run queue if it is ready.  Interrupts must be off. */
+static void
+change_priority (struct thread *t, int priority)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->priority == priority)
+    return;
+  if (t->status == THREAD_READY && !t->rt_queued)
+    {
+      ready_queue_remove (t);
+      t->priority = priority;
+      ready_queue_push (t);
+    }
+  else
+    t->priority = priority;
+}
+
+/* Raises T's effective priority to PRIORITY, if it is not
+   already at least that high.  Interrupts must be off. */
+void
+thread_donate_priority (struct thread *t, int priority)
+{
+  ASSERT (is_thread (t));
+
+  if (priority > t->priority)
+    change_priority (t, priority);
+}
+
+/* Recomputes the running thread's effective priority as the
+   maximum of its base priority and the priorities of all the
+   threads waiting for locks that it holds. */
+void
+thread_refresh_priority (void)
+{
+  struct thread *cur = thread_current ();
+  int priority = cur->base_priority;
+  struct list_elem *e, *w;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  for (e = list_begin (&cur->held_locks); e != list_end (&cur->held_locks);
+       e = list_next (e))
+    {
+      struct lock *lock = list_entry (e, struct lock, elem);
+      struct list *waiters = &lock->semaphore.waiters;
+
+      for (w = list_begin (waiters); w != list_end (waiters);
+           w = list_next (w))
+        {
+          struct thread *t = list_entry (w, struct thread, elem);
+          if (t->priority > priority)
+            priority = t->priority;
+        }
+    }
+  change_priority (cur, priority);
+  intr_set_level (old_level);
 }
 
 /* Returns the current thread's priority. */
@@ -374,35 +741,116 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE and recomputes
+   its priority, yielding if it no longer has the highest
+   priority. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-  /* Not yet implemented. */
+  enum intr_level old_level;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  thread_current ()->nice = nice;
+  mlfqs_update_priority (thread_current ());
+  intr_set_level (old_level);
+  thread_yield_to_higher ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int value = CONVERT_TO_INT_NEAREST (MULT_INT (load_avg, 100));
+  intr_set_level (old_level);
+  return value;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int value = CONVERT_TO_INT_NEAREST (MULT_INT (thread_current ()->recent_cpu,
+                                                100));
+  intr_set_level (old_level);
+  return value;
+}
+
+/* Recomputes T's MLFQS priority from its recent_cpu and nice
+   values:
+
+       priority = PRI_MAX - (recent_cpu / 4) - (nice * 2)
+
+   clamped to PRI_MIN...PRI_MAX.  Interrupts must be off. */
+static void
+mlfqs_update_priority (struct thread *t)
+{
+  int priority;
+
+  if (is_idle_thread (t))
+    return;
+
+  priority = PRI_MAX - CONVERT_TO_INT_ZERO (DIV_INT (t->recent_cpu, 4))
+             - t->nice * 2;
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+  change_priority (t, priority);
+}
+
+/* Decays T's recent_cpu by the load average:
+
+       recent_cpu = (2*load_avg)/(2*load_avg + 1) * recent_cpu + nice
+
+   and recomputes its priority.  Interrupts must be off. */
+static void
+mlfqs_update_recent_cpu (struct thread *t, void *aux UNUSED)
+{
+  int twice_load = MULT_INT (load_avg, 2);
+  int coefficient = DIVIDE (twice_load, ADD_INT (twice_load, 1));
+
+  if (is_idle_thread (t))
+    return;
+
+  t->recent_cpu = ADD_INT (MULTIPLE (coefficient, t->recent_cpu), t->nice);
+  mlfqs_update_priority (t);
+  if (t->mlfqs_stale)
+    {
+      t->mlfqs_stale = false;
+      list_remove (&t->mlfqs_elem);
+    }
+}
+
+/* Once-per-second MLFQS update: recomputes the load average
+
+       load_avg = (59/60)*load_avg + (1/60)*ready_threads
+
+   then every thread's recent_cpu and priority.  Called from the
+   timer interrupt. */
+static void
+mlfqs_second (void)
+{
+  int ready_threads = 0;
+  int c;
+
+  for (c = 0; c < mp_cpu_cnt; c++)
+    ready_threads += cpus[c].ready_cnt;
+  if (!is_idle_thread (running_thread ()))
+    ready_threads++;
+  load_avg = ADD (DIV_INT (MULT_INT (load_avg, 59), 60),
+                  DIV_INT (CONVERT_TO_FP (ready_threads), 60));
+  thread_foreach (mlfqs_update_recent_cpu, NULL);
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -418,15 +866,25 @@ static void
 idle (void *idle_started_ UNUSED) 
 {
   struct semaphore *idle_started = idle_started_;
-  idle_thread = thread_current ();
+  struct cpu *c = cpu_current ();
+
+  c->idle_thread = thread_current ();
   sema_up (idle_started);
 
   for (;;) 
     {
+      /* Spend otherwise idle time zeroing free pages, until some
+         other thread is ready. */
+      while (c->ready_cnt == 0 && palloc_zero_page ())
+        continue;
+
       /* Let someone else run. */
       intr_disable ();
       thread_block ();
 
+      /* Stop the periodic tick if nothing is due for a while. */
+      timer_idle_enter ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -465,7 +923,32 @@ running_thread (void)
      always at the beginning of a page and the stack pointer is
      somewhere in the middle, this locates the curent thread. */
   asm ("mov %%esp, %0" : "=g" (esp));
-  return pg_round_down (esp);
+  return thread_of_stack (esp);
+}
+
+/* Returns the thread whose kernel stack holds ESP.  Unlike
+   thread_current(), makes no checks, so it works in the middle of
+   a thread switch. */
+struct thread *
+thread_of_stack (const void *esp) 
+{
+  struct thread *t = pg_round_down (esp);
+
+#if THREAD_PAGES > 1
+  /* Only the initial thread lives in a single page. */
+  if (initial_thread != NULL && t != initial_thread)
+    t = (struct thread *) ROUND_DOWN ((uintptr_t) esp,
+                                      THREAD_PAGES * PGSIZE);
+#endif
+  return t;
+}
+
+/* Returns the top of thread T's kernel stack. */
+uint8_t *
+thread_stack_top (struct thread *t) 
+{
+  return (uint8_t *) t + (t == initial_thread ? PGSIZE
+                                              : THREAD_PAGES * PGSIZE);
 }
 
 /* Returns true if T appears to point to a valid thread. */
@@ -480,45 +963,111 @@ is_thread (struct thread *t)
 static void
 init_thread (struct thread *t, const char *name, int priority)
 {
+  struct thread *parent = running_thread ();
   enum intr_level old_level;
+  int nice = NICE_DEFAULT;
+  int recent_cpu = 0;
+  uint32_t cpu_mask = UINT32_MAX;
+  struct cpu_group *group = NULL;
 
   ASSERT (t != NULL);
   ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
   ASSERT (name != NULL);
 
+  /* In MLFQS mode a new thread inherits its parent's nice and
+     recent_cpu values, and its priority follows from them. */
+  if (thread_mlfqs && parent != t && is_thread (parent))
+    {
+      nice = parent->nice;
+      recent_cpu = parent->recent_cpu;
+    }
+
+  /* A new thread inherits its creator's CPU affinity and quota
+     group. */
+  if (parent != t && is_thread (parent))
+    {
+      cpu_mask = parent->cpu_mask;
+      group = parent->group;
+    }
+
   memset (t, 0, sizeof *t);
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
-  t->stack = (uint8_t *) t + PGSIZE;
+  t->stack = thread_stack_top (t);
   t->priority = priority;
+  t->base_priority = priority;
+  t->cpu = cpu_current ();
+  t->cpu_mask = cpu_mask;
+  t->group = group;
+  list_init (&t->held_locks);
+  t->nice = nice;
+  t->recent_cpu = recent_cpu;
   t->magic = THREAD_MAGIC;
 
+  if (thread_mlfqs)
+    {
+      old_level = intr_disable ();
+      mlfqs_update_priority (t);
+      t->base_priority = t->priority;
+      intr_set_level (old_level);
+    }
+
+  t->tid = allocate_tid ();
+
+  /* Seed the new thread's generator from its creator's, so that a
+     -rs seed makes the whole run repeatable. */
+  if (parent != t && is_thread (parent))
+    random_state_init (&t->random,
+                       ((uint64_t) random_next (&parent->random) << 32)
+                       | random_next (&parent->random), t->tid);
+  else
+    random_state_init (&t->random, random_ulong (), t->tid);
+
   old_level = intr_disable ();
   list_push_back (&all_list, &t->allelem);
+  list_push_back (&tid_buckets[(unsigned) t->tid % TID_BUCKET_CNT],
+                  &t->tid_elem);
   intr_set_level (old_level);
 
 #ifdef USERPROG
   list_init(&(t->child));
   list_push_back(&(running_thread()->child), &(t->child_elem));
 
-  sema_init(&(t->child_lock), 0);
+  list_init(&t->exited_child);
+  lock_init_named(&t->wait_lock, "thread wait");
+  cond_init(&t->child_exited);
+  t->exited = false;
+  t->leader = t;
+  lock_init_named(&t->proc_lock, "thread proc");
+  list_init(&t->uthreads);
+  list_init(&t->exited_uthreads);
+  t->stack_slots = 1;
+  t->dying = false;
+  t->stack_slot = 0;
   sema_init(&(t->memory_lock), 0);
   sema_init(&(t->exec_lock), 0);
 
   //modified
   t->parent = running_thread();
 
-  // File Descriptor Table
-  for (int i =0; i<64; i++){
-	t->fdt[i] = NULL;
-  }
-  t->fdt[0] = 1;
-  t->fdt[1] = 2;
+  // File Descriptor Table, allocated on first open
+  t->fdt = NULL;
+  t->fdt_size = 0;
+  t->fd_cnt = 0;
   t->next_fd = 2;
+  t->cwd = NULL;
+  list_init (&t->mmap_list);
 
-  for (int j =0; j<10; j++){
-	t->save_signal[j]=NULL;
-  }
+  /* Limits are those of the creating process.  The initial thread
+     is its own parent and has none. */
+  if (t->parent != t)
+    {
+      t->rlimit_rss = t->parent->leader->rlimit_rss;
+      t->rlimit_swap = t->parent->leader->rlimit_swap;
+      t->rlimit_nofile = t->parent->leader->rlimit_nofile;
+    }
+  else
+    t->rlimit_rss = t->rlimit_swap = t->rlimit_nofile = UINT_MAX;
 
 
 #endif
@@ -540,18 +1089,489 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
+/* Returns the CPU we are running on. */
+static struct cpu *
+cpu_current (void)
+{
+  return &cpus[0];
+}
+
+/* Returns true if T is the idle thread of its CPU. */
+static bool
+is_idle_thread (const struct thread *t)
+{
+  return t == t->cpu->idle_thread;
+}
+
+/* Appends T to the back of its CPU's run queue for its priority
+   and marks that level nonempty, or, if T is a deadline thread
+   with budget left, inserts it into the CPU's rt_queue.
+   Interrupts must be off. */
+static void
+ready_queue_push (struct thread *t)
+{
+  struct cpu *c = t->cpu;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->rt_period > 0)
+    rt_refresh (t, timer_ticks ());
+  t->rt_queued = rt_runnable (t);
+  if (t->rt_queued)
+    {
+      list_insert_ordered (&c->rt_queue, &t->elem, deadline_less, NULL);
+      return;
+    }
+
+  list_push_back (&c->ready_queues[t->priority], &t->elem);
+  c->ready_bitmap[t->priority / 32] |= 1u << (t->priority % 32);
+  c->ready_cnt++;
+}
+
+/* Removes T, which must be in one of its CPU's ready_queues, from
+   it.  Interrupts must be off. */
+static void
+ready_queue_remove (struct thread *t)
+{
+  struct cpu *c = t->cpu;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_READY && !t->rt_queued);
+
+  list_remove (&t->elem);
+  c->ready_cnt--;
+  if (list_empty (&c->ready_queues[t->priority]))
+    c->ready_bitmap[t->priority / 32] &= ~(1u << (t->priority % 32));
+}
+
+/* Removes and returns the thread at the front of C's run queue
+   for PRIORITY, which must be nonempty.  Interrupts must be
+   off. */
+static struct thread *
+ready_queue_pop (struct cpu *c, int priority)
+{
+  struct list *queue = &c->ready_queues[priority];
+  struct thread *t;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!list_empty (queue));
+
+  t = list_entry (list_pop_front (queue), struct thread, elem);
+  c->ready_cnt--;
+  if (list_empty (queue))
+    c->ready_bitmap[priority / 32] &= ~(1u << (priority % 32));
+  return t;
+}
+
+/* Returns the highest priority of any thread ready on C, or -1 if
+   no thread is ready.  Interrupts must be off. */
+static int
+ready_queue_max_priority (const struct cpu *c)
+{
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (i = READY_WORDS - 1; i >= 0; i--)
+    if (c->ready_bitmap[i] != 0)
+      return i * 32 + (31 - __builtin_clz (c->ready_bitmap[i]));
+  return -1;
+}
+
+/* Returns true if CUR, running on C, should give the CPU to a
+   ready thread: one with an earlier deadline if CUR is a deadline
+   thread with budget left, otherwise any deadline thread or one
+   of higher priority.  Interrupts must be off. */
+static bool
+should_preempt (struct cpu *c, struct thread *cur)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (is_idle_thread (cur))
+    return false;
+  if (!list_empty (&c->rt_queue))
+    {
+      struct thread *first = list_entry (list_front (&c->rt_queue),
+                                         struct thread, elem);
+      if (!rt_runnable (cur) || first->rt_deadline < cur->rt_deadline)
+        return true;
+    }
+  return !rt_runnable (cur) && ready_queue_max_priority (c) > cur->priority;
+}
+
+/* Returns true if T is a deadline thread with budget left in its
+   current period. */
+static bool
+rt_runnable (const struct thread *t) 
+{
+  return t->rt_period > 0 && t->rt_left > 0;
+}
+
+/* Returns the CPU share, in thousandths, that running for BUDGET
+   ticks in every PERIOD ticks takes. */
+static int
+rt_share (int64_t budget, int64_t period) 
+{
+  return DIV_ROUND_UP (budget * 1000, period);
+}
+
+/* Starts a new period for deadline thread T, with a full budget,
+   if its current one ended by tick NOW.  Periods that passed
+   while T was asleep are skipped. */
+static void
+rt_refresh (struct thread *t, int64_t now) 
+{
+  if (now < t->rt_deadline)
+    return;
+  t->rt_deadline += (((now - t->rt_deadline) / t->rt_period + 1)
+                     * t->rt_period);
+  t->rt_left = t->rt_budget;
+}
+
+/* Charges the tick that just passed to CUR's budget, if it is a
+   deadline thread, and starts new periods for the deadline threads
+   whose periods ended, moving the ready ones ahead of ordinary
+   threads.  Called from the timer interrupt. */
+static void
+rt_tick (struct thread *cur) 
+{
+  int64_t now = timer_ticks ();
+  struct list_elem *e;
+
+  if (rt_runnable (cur) && --cur->rt_left == 0)
+    intr_yield_on_return ();
+
+  for (e = list_begin (&rt_list); e != list_end (&rt_list);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, rt_elem);
+
+      if (now < t->rt_deadline)
+        continue;
+      if (t->status == THREAD_READY)
+        {
+          if (t->rt_queued)
+            list_remove (&t->elem);
+          else
+            ready_queue_remove (t);
+          ready_queue_push (t);
+        }
+      else
+        rt_refresh (t, now);
+    }
+
+  if (should_preempt (cpu_current (), cur))
+    intr_yield_on_return ();
+}
+
+/* Orders threads, linked through their `elem' members, by
+   increasing deadline.  Threads with equal deadlines keep the
+   order in which they were queued. */
+static bool
+deadline_less (const struct list_elem *a_, const struct list_elem *b_,
+               void *aux UNUSED) 
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->rt_deadline < b->rt_deadline;
+}
+
+/* Makes the running thread a deadline thread that may run for
+   BUDGET ticks in every PERIOD ticks ahead of all ordinary
+   threads, or, if PERIOD is 0, an ordinary thread again.  Returns
+   false, changing nothing, if BUDGET is not between 1 and PERIOD
+   or if admitting the thread would reserve more than RT_UTIL_MAX
+   thousandths of the CPU for deadline threads. */
+bool
+thread_set_deadline (int64_t period, int64_t budget) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int share = 0;
+
+  if (period < 0 || (period > 0 && (budget < 1 || budget > period)))
+    return false;
+
+  old_level = intr_disable ();
+  if (period > 0)
+    {
+      int old_share = (cur->rt_period > 0
+                       ? rt_share (cur->rt_budget, cur->rt_period) : 0);
+
+      share = rt_share (budget, period);
+      if (rt_util - old_share + share > RT_UTIL_MAX)
+        {
+          intr_set_level (old_level);
+          return false;
+        }
+    }
+
+  if (cur->rt_period > 0)
+    {
+      list_remove (&cur->rt_elem);
+      rt_util -= rt_share (cur->rt_budget, cur->rt_period);
+    }
+  cur->rt_period = period;
+  cur->rt_budget = budget;
+  cur->rt_deadline = timer_ticks () + period;
+  cur->rt_left = budget;
+  if (period > 0)
+    {
+      list_push_back (&rt_list, &cur->rt_elem);
+      rt_util += share;
+    }
+  intr_set_level (old_level);
+
+  thread_yield_to_higher ();
+  return true;
+}
+
+/* Returns C's bit in a thread's cpu_mask. */
+static uint32_t
+cpu_bit (const struct cpu *c) 
+{
+  return 1u << (c - cpus);
+}
+
+/* Charges the tick that just passed to CUR's quota group, making
+   CUR yield if that used up the quota, and starts new periods for
+   the groups whose periods ended, releasing their throttled
+   threads.  Called from the timer interrupt. */
+static void
+group_tick (struct thread *cur) 
+{
+  int64_t now = timer_ticks ();
+  int i;
+
+  if (cur->group != NULL && !is_idle_thread (cur)
+      && ++cur->group->used >= cur->group->quota)
+    intr_yield_on_return ();
+
+  for (i = 0; i < cpu_group_cnt; i++)
+    {
+      struct cpu_group *g = &cpu_groups[i];
+
+      if (now < g->period_end)
+        continue;
+      g->period_end += ((now - g->period_end) / g->period + 1) * g->period;
+      g->used = 0;
+      while (!list_empty (&g->throttled))
+        thread_unblock (list_entry (list_pop_front (&g->throttled),
+                                    struct thread, elem));
+    }
+}
+
+/* Restricts the running thread, and the threads it creates later,
+   to the CPUs whose bits are set in MASK, moving it if it is on
+   another.  Returns false, changing nothing, if MASK names no
+   CPU that runs threads. */
+bool
+thread_set_affinity (uint32_t mask) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int i;
+
+  mask &= cpu_online_cnt < 32 ? (1u << cpu_online_cnt) - 1 : UINT32_MAX;
+  if (mask == 0)
+    return false;
+
+  old_level = intr_disable ();
+  cur->cpu_mask = mask;
+  if (!(mask & cpu_bit (cur->cpu)))
+    {
+      for (i = 0; !(mask & (1u << i)); i++)
+        continue;
+      cur->cpu = &cpus[i];
+      thread_yield ();
+    }
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Creates a CPU quota group whose threads may run for QUOTA ticks
+   in every PERIOD ticks between them, and returns its number, or
+   -1 if QUOTA is not between 1 and PERIOD or there is no room for
+   another group. */
+int
+thread_group_create (int64_t quota, int64_t period) 
+{
+  enum intr_level old_level;
+  struct cpu_group *g;
+  int group;
+
+  if (quota < 1 || quota > period)
+    return -1;
+
+  old_level = intr_disable ();
+  if (cpu_group_cnt >= CPU_GROUP_MAX)
+    {
+      intr_set_level (old_level);
+      return -1;
+    }
+  group = cpu_group_cnt;
+  g = &cpu_groups[group];
+  g->quota = quota;
+  g->period = period;
+  g->period_end = timer_ticks () + period;
+  g->used = 0;
+  list_init (&g->throttled);
+  cpu_group_cnt++;
+  intr_set_level (old_level);
+  return group;
+}
+
+/* Moves the running thread, and the threads it creates later,
+   into quota group GROUP, or out of any group if GROUP is -1.
+   Returns false if there is no such group. */
+bool
+thread_group_join (int group) 
+{
+  enum intr_level old_level = intr_disable ();
+  bool ok = group >= -1 && group < cpu_group_cnt;
+
+  if (ok)
+    thread_current ()->group = group >= 0 ? &cpu_groups[group] : NULL;
+  intr_set_level (old_level);
+  return ok;
+}
+
+/* Moves up to CNT ready threads from FROM's run queues to TO's,
+   highest priority first, taking from the back of each queue the
+   threads that would have waited longest.  Threads that may not
+   run on TO stay put.  Interrupts must be off. */
+static void
+migrate_threads (struct cpu *from, struct cpu *to, int cnt)
+{
+  int priority;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (priority = PRI_MAX; priority >= PRI_MIN && cnt > 0; priority--)
+    {
+      struct list *queue = &from->ready_queues[priority];
+      struct list_elem *e = list_rbegin (queue);
+
+      while (e != list_rend (queue) && cnt > 0)
+        {
+          struct thread *t = list_entry (e, struct thread, elem);
+
+          e = list_prev (e);
+          if (!(t->cpu_mask & cpu_bit (to)))
+            continue;
+          list_remove (&t->elem);
+          from->ready_cnt--;
+          t->cpu = to;
+          ready_queue_push (t);
+          cnt--;
+        }
+      if (list_empty (queue))
+        from->ready_bitmap[priority / 32] &= ~(1u << (priority % 32));
+    }
+}
+
+/* Moves half of the threads ready on the busiest other CPU to C,
+   whose run queues are empty.  Returns true if any moved.
+   Interrupts must be off. */
+static bool
+steal_threads (struct cpu *c)
+{
+  struct cpu *busiest = NULL;
+  int i;
+
+  for (i = 0; i < cpu_online_cnt; i++)
+    if (&cpus[i] != c && cpus[i].ready_cnt > 0
+        && (busiest == NULL || cpus[i].ready_cnt > busiest->ready_cnt))
+      busiest = &cpus[i];
+  if (busiest == NULL)
+    return false;
+
+  migrate_threads (busiest, c, (busiest->ready_cnt + 1) / 2);
+  return true;
+}
+
+/* Evens out the number of ready threads on the busiest and least
+   busy CPUs.  Called from the timer interrupt every
+   BALANCE_INTERVAL ticks. */
+static void
+balance_cpus (void)
+{
+  struct cpu *busiest = &cpus[0], *idlest = &cpus[0];
+  int i;
+
+  for (i = 1; i < cpu_online_cnt; i++)
+    {
+      if (cpus[i].ready_cnt > busiest->ready_cnt)
+        busiest = &cpus[i];
+      if (cpus[i].ready_cnt < idlest->ready_cnt)
+        idlest = &cpus[i];
+    }
+  if (busiest->ready_cnt - idlest->ready_cnt > 1)
+    migrate_threads (busiest, idlest,
+                     (busiest->ready_cnt - idlest->ready_cnt) / 2);
+}
+
 /* Chooses and returns the next thread to be scheduled.  Should
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
    will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   the CPU's idle thread.  The thread chosen is the one that has
+   waited longest among those with the highest priority. */
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
-    return idle_thread;
+  struct cpu *c = cpu_current ();
+  struct thread *t;
+
+  if (thread_sched_stats)
+    runq_hist[c->ready_cnt < RUNQ_BUCKETS
+              ? c->ready_cnt : RUNQ_BUCKETS - 1]++;
+  for (;;)
+    {
+      if (!list_empty (&c->rt_queue))
+        {
+          t = list_entry (list_pop_front (&c->rt_queue),
+                          struct thread, elem);
+          t->rt_queued = false;
+        }
+      else
+        {
+          int priority = ready_queue_max_priority (c);
+
+          if (priority < 0 && steal_threads (c))
+            priority = ready_queue_max_priority (c);
+          if (priority < 0)
+            return c->idle_thread;
+          t = ready_queue_pop (c, priority);
+        }
+
+      /* Park threads whose group has used up its quota. */
+      if (t->group == NULL || t->group->used < t->group->quota)
+        break;
+      t->status = THREAD_BLOCKED;
+      list_push_back (&t->group->throttled, &t->elem);
+    }
+  if (thread_sched_stats)
+    latency_hist[log2_floor (timer_cycles () - t->ready_since)]++;
+  return t;
+}
+
+/* Returns the index of the highest set bit in CYCLES, limited to
+   LATENCY_BUCKETS - 1, or 0 if CYCLES is 0. */
+static int
+log2_floor (uint64_t cycles)
+{
+  uint32_t hi = cycles >> 32, lo = cycles;
+  int bit;
+
+  if (hi != 0)
+    bit = 63 - __builtin_clz (hi);
+  else if (lo != 0)
+    bit = 31 - __builtin_clz (lo);
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    bit = 0;
+  return bit < LATENCY_BUCKETS ? bit : LATENCY_BUCKETS - 1;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -582,6 +1602,7 @@ thread_schedule_tail (struct thread *prev)
 
   /* Start new time slice. */
   thread_ticks = 0;
+  fpu_switch (cur);
 
 #ifdef USERPROG
   /* Activate the new address space. */
@@ -596,8 +1617,82 @@ thread_schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      if (thread_cache_cnt < THREAD_CACHE_MAX)
+        {
+          /* Keep stale pointers from passing is_thread(). */
+          prev->magic = 0;
+          thread_cache[thread_cache_cnt++] = prev;
+        }
+      else
+        free_thread_page (prev);
+    }
+}
+
+#if THREAD_PAGES > 1
+/* Returns the kernel page table entry for thread T's guard page.
+   paging_init() maps the kernel with 4 kB pages in this build, so
+   there is one. */
+static uint32_t *
+guard_pte (struct thread *t) 
+{
+  uint8_t *guard = (uint8_t *) t + PGSIZE;
+  uint32_t pde = init_page_dir[pd_no (guard)];
+
+  ASSERT (!(pde & PTE_PS));
+  return &pde_get_pt (pde)[pt_no (guard)];
+}
+
+/* Drops any TLB entry for PAGE. */
+static void
+invalidate_page (void *page) 
+{
+  asm volatile ("invlpg (%0)" : : "r" (page) : "memory");
+}
+#endif
+
+/* Returns a page for a new thread, recycled from one that exited
+   if possible, or a null pointer if memory is short.  Built with
+   KSTACK, returns a block of THREAD_PAGES pages instead, with its
+   guard page unmapped. */
+static struct thread *
+alloc_thread_page (void) 
+{
+  enum intr_level old_level = intr_disable ();
+  struct thread *t = NULL;
+
+  if (thread_cache_cnt > 0)
+    t = thread_cache[--thread_cache_cnt];
+  intr_set_level (old_level);
+
+#if THREAD_PAGES > 1
+  /* Unmap the guard page.  Every page directory shares the kernel's
+     page tables, so one PTE covers them all. */
+  if (t == NULL)
+    {
+      t = palloc_get_aligned (0, THREAD_PAGES);
+      if (t != NULL)
+        {
+          *guard_pte (t) &= ~PTE_P;
+          invalidate_page ((uint8_t *) t + PGSIZE);
+        }
     }
+  return t;
+#else
+  return t != NULL ? t : palloc_get_page (PAL_ZERO);
+#endif
+}
+
+/* Frees thread T's page, or its block and guard page. */
+static void
+free_thread_page (struct thread *t) 
+{
+#if THREAD_PAGES > 1
+  /* The PTE was not present, so no TLB holds it. */
+  *guard_pte (t) |= PTE_P;
+  palloc_free_multiple (t, THREAD_PAGES);
+#else
+  palloc_free_page (t);
+#endif
 }
 
 /* Schedules a new process.  At entry, interrupts must be off and
@@ -618,43 +1713,60 @@ schedule (void)
   ASSERT (cur->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
 
+  TRACE (TRACE_SCHEDULE, next->tid, cur->status);
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      if (cur->status == THREAD_READY)
+        cur->usage.invol_switches++;
+      else
+        cur->usage.vol_switches++;
+      if (is_idle_thread (cur))
+        timer_idle_exit ();
+      prev = switch_threads (cur, next);
+    }
   thread_schedule_tail (prev);
 }
 
-/* Returns a tid to use for a new thread. */
+/* Returns a tid to use for a new thread.  Takes no lock, so that
+   init_thread() can call it before thread_current() works. */
 static tid_t
 allocate_tid (void) 
 {
   static tid_t next_tid = 1;
-  tid_t tid;
 
-  lock_acquire (&tid_lock);
-  tid = next_tid++;
-  lock_release (&tid_lock);
-
-  return tid;
+  return atomic_fetch_add (&next_tid, 1);
 }
 
 /* Offset of `stack' member within `struct thread'.
    Used by switch.S, which can't figure it out on its own. */
 uint32_t thread_stack_ofs = offsetof (struct thread, stack);
 
-/* Get the thread by its tid */
-struct thread
-*thread_get_by_id (tid_t id)
+/* Returns the thread whose tid is ID, or a null pointer if there
+   is none or it has begun to exit.  The thread can only be
+   relied on to stay alive while interrupts are off, or while
+   something else keeps it from exiting. */
+struct thread *
+thread_get_by_id (tid_t id)
 {
-  ASSERT (id != TID_ERROR);
+  struct list *bucket = &tid_buckets[(unsigned) id % TID_BUCKET_CNT];
+  enum intr_level old_level;
   struct list_elem *e;
-  struct thread *t;
-  e = list_tail (&all_list);
-  while ((e = list_prev (e)) != list_head (&all_list))
+  struct thread *found = NULL;
+
+  ASSERT (id != TID_ERROR);
+
+  old_level = intr_disable ();
+  for (e = list_begin (bucket); e != list_end (bucket); e = list_next (e))
     {
-      t = list_entry (e, struct thread, allelem);
-      if (t->tid == id && t->status != THREAD_DYING)
-        return t;
+      struct thread *t = list_entry (e, struct thread, tid_elem);
+      if (t->tid == id)
+        {
+          if (t->status != THREAD_DYING)
+            found = t;
+          break;
+        }
     }
-  return NULL;
+  intr_set_level (old_level);
+  return found;
 }
 
@@ -3,11 +3,14 @@
 
 #include <debug.h>
 #include <hash.h>
+#include <heap.h>
 #include <list.h>
+#include <random.h>
 #include <stdint.h>
 //modified
 #include "threads/synch.h"
 #include "filesys/file.h"
+#include "vm/spt.h"
 
 
 
@@ -32,6 +35,24 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread niceness, used by the MLFQS scheduler. */
+#define NICE_MIN -20                    /* Nicest to other threads. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Least nice. */
+
+/* Pages that hold each thread: 1 by default, or with "make
+   KSTACK=8" or "make KSTACK=16" a block of 4 or 8 pages that gives
+   at least that many kB of kernel stack (see below). */
+#ifndef KSTACK
+#define THREAD_PAGES 1
+#elif KSTACK == 8
+#define THREAD_PAGES 4
+#elif KSTACK == 16
+#define THREAD_PAGES 8
+#else
+#error KSTACK must be 8 or 16
+#endif
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -81,7 +102,27 @@ typedef int tid_t;
    an assertion failure in thread_current(), which checks that
    the `magic' member of the running thread's `struct thread' is
    set to THREAD_MAGIC.  Stack overflow will normally change this
-   value, triggering the assertion. */
+   value, triggering the assertion.
+
+   Built with KSTACK, each thread instead takes an aligned block of
+   THREAD_PAGES pages.  `struct thread' still sits at the bottom of
+   its first page, the second page is left unmapped as a guard, and
+   the stack grows down from the top of the block into the rest:
+
+             +---------------------------------+
+             |          kernel stack           |
+             |                |                |
+             |                V                |
+        8 kB +---------------------------------+
+             |     guard page (not mapped)     |
+        4 kB +---------------------------------+
+             |          struct thread          |
+        0 kB +---------------------------------+
+
+   A stack that overflows then faults on the guard page rather
+   than overwriting the thread, so code on deep paths may keep
+   sector-sized buffers on the stack.  The initial thread keeps the
+   4 kB page the loader gave it. */
 /* The `elem' member has a dual purpose.  It can be an element in
    the run queue (thread.c), or it can be an element in a
    semaphore wait list (synch.c).  It can be used these two ways
@@ -89,11 +130,24 @@ typedef int tid_t;
    ready state is on the run queue, whereas only a thread in the
    blocked state is on a semaphore wait list. */
 
-struct signal{
-	int signum;
-	void (*sig_handler)(void);
-};
+/* Signals are numbered 1 through SIG_CNT - 1 (userprog/signal.c). */
+#define SIG_CNT 32
 
+struct cpu;
+struct cpu_group;
+struct tlb_batch;
+struct io_ring;
+
+/* Resource usage of a thread, or summed over several. */
+struct thread_usage
+  {
+    int64_t user_ticks;                 /* Ticks that interrupted user code. */
+    int64_t sys_ticks;                  /* Other ticks it was charged. */
+    unsigned vol_switches;              /* Switches away to block or exit. */
+    unsigned invol_switches;            /* Switches away while runnable. */
+    unsigned sectors_read;              /* Block device sectors read. */
+    unsigned sectors_written;           /* Block device sectors written. */
+  };
 
 struct thread{
     /* Owned by thread.c. */
@@ -101,30 +155,139 @@ struct thread{
     enum thread_status status;          /* Thread state. */
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
+    int priority;                       /* Effective priority. */
     struct list_elem allelem;           /* List element for all threads list. */
+    struct list_elem tid_elem;          /* tid_buckets element. */
+    struct cpu *cpu;                    /* CPU whose run queue it uses. */
+    uint32_t cpu_mask;                  /* CPUs it may run on, 1 bit each. */
+    struct cpu_group *group;            /* CPU quota group, or null. */
+    void *fpu;                          /* FPU save area, owned by fpu.c. */
+    int preempt_count;                  /* thread_preempt_disable() depth. */
+    bool preempt_pending;               /* Yield put off by preempt_count? */
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
+    bool sema_handoff;                  /* Handed a semaphore's unit? */
+
+    /* Priority donation, shared between thread.c and synch.c. */
+    int base_priority;                  /* Priority before donation. */
+    struct lock *waiting_lock;          /* Lock being waited for. */
+    struct list held_locks;             /* Locks held, for donation. */
+
+    /* Owned by thread.c, used only in MLFQS mode. */
+    int nice;                           /* Niceness. */
+    int recent_cpu;                     /* Recent CPU time, fixed-point. */
+    bool mlfqs_stale;                   /* On mlfqs_stale_list? */
+    struct list_elem mlfqs_elem;        /* mlfqs_stale_list element. */
+
+    /* Owned by thread.c, used only by deadline threads. */
+    int64_t rt_period;                  /* Ticks per period, 0 if none. */
+    int64_t rt_budget;                  /* Ticks it may run per period. */
+    int64_t rt_deadline;                /* Tick when this period ends. */
+    int64_t rt_left;                    /* Budget left in this period. */
+    bool rt_queued;                     /* On its CPU's rt_queue? */
+    struct list_elem rt_elem;           /* rt_list element. */
+
+    /* Owned by thread.c. */
+    struct random_state random;         /* For thread_random(). */
+
+    /* Owned by thread.c, used only with thread_sched_stats. */
+    uint64_t ready_since;               /* timer_cycles() when made ready. */
+
+    /* Owned by thread.c, except the sector counts, which belong to
+       devices/block.c. */
+    struct thread_usage usage;          /* For getrusage(). */
+
+    /* Owned by devices/timer.c. */
+    int64_t wakeup_tick;                /* Tick at which to wake up. */
+    unsigned sleep_seq;                 /* Breaks ties in wakeup_tick. */
+    struct heap_elem sleep_elem;        /* Element in timer's sleep heap. */
+
+    /* Owned by filesys/journal.c. */
+    int journal_depth;                  /* Nesting of journal_begin(). */
 
 //#ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
+    struct tlb_batch *tlb_batch;        /* Deferred TLB invalidations. */
     //Making Child list!!!
 
 	struct thread *parent;
 	struct list child;
 	struct list_elem child_elem;
 
-	struct semaphore child_lock;
+	struct list exited_child;	/* Exited children not yet reaped. */
+	struct list_elem exited_elem;	/* Element in parent's exited_child. */
+	struct lock wait_lock;		/* Guards exited_child and exited. */
+	struct condition child_exited;	/* Signaled when a child exits. */
+	bool exited;			/* On parent's exited_child. */
 	struct semaphore memory_lock;
 	struct semaphore exec_lock;	
+
+	/* User threads (userprog/process.c).  The address space, open
+	   files and thread bookkeeping belong to the process's initial
+	   thread, its leader; the fields marked "Leader" are only used
+	   there. */
+	struct thread *leader;		/* Itself, unless a user thread. */
+	struct lock proc_lock;		/* Leader: guards address space, fds. */
+	struct list uthreads;		/* Leader: its other threads. */
+	struct list exited_uthreads;	/* Leader: exited, not yet joined. */
+	unsigned stack_slots;		/* Leader: user stacks in use. */
+	bool dying;			/* Leader: the process is exiting. */
+	int stack_slot;			/* User thread: its stack. */
 	
 	//Project 2 User program
-	struct file *fdt[64];
-	int next_fd;
-	struct hash suppl_page_table;
-	struct signal *save_signal[10];
+	struct file **fdt;		/* Open files by fd (userprog/fdtable.c). */
+	int fdt_size;			/* Number of slots in fdt. */
+	int fd_cnt;			/* Number of open files in fdt. */
+	int next_fd;			/* No lower fd is free. */
+	struct dir *cwd;		/* Leader: working directory, or null
+					   for the root (filesys/filesys.c). */
+	struct spt suppl_page_table;	/* Supplemental page table. */
+	struct file *exec_file;		/* Executable, kept open for paging. */
+	void *user_esp;			/* User %esp saved on syscall entry. */
+	struct list mmap_list;		/* Memory-mapped files (vm/page.c). */
+	int next_mapid;			/* Next mapping identifier. */
+	uint8_t *heap_start;		/* Leader: first page of the heap. */
+	uint8_t *heap_brk;		/* Leader: end of the heap (vm/page.c). */
+	struct io_ring *ring;		/* Leader: asynchronous I/O ring
+					   (vm/ring.c), or null. */
+
+	/* Resource usage of threads that have been reaped, for
+	   getrusage().  Leader only. */
+	struct thread_usage exited_usage;	/* Its own user threads. */
+	struct thread_usage child_usage;	/* Its children and their
+						   descendants. */
+	unsigned child_minor_faults;	/* The same for vm_minor_faults. */
+	unsigned child_major_faults;	/* The same for vm_major_faults. */
+
+	/* Paging statistics, owned by vm/. */
+	unsigned vm_minor_faults;	/* Faults served without I/O. */
+	unsigned vm_major_faults;	/* Faults that read a page in. */
+	unsigned vm_swap_ins;		/* Pages read from swap. */
+	unsigned vm_swap_outs;		/* Pages written to swap. */
+	unsigned vm_evictions;		/* Own frames taken by eviction. */
+	int vm_resident;		/* Frames currently owned. */
+	unsigned vm_swap_slots;		/* Swap slots holding own pages. */
+
+	/* Load control, owned by vm/frame.c.  Leader only. */
+	unsigned vm_ws_frames;		/* Own frames used lately, counted
+					   by the ager. */
+	unsigned vm_fault_mark;		/* vm_major_faults at the last scan. */
+	unsigned vm_wss;		/* Working set estimate, in frames. */
+	bool vm_suspended;		/* Waiting for memory to free up. */
+
+	/* Resource limits, UINT_MAX if none, inherited from the
+	   creating process.  Leader only. */
+	unsigned rlimit_rss;		/* Most frames vm_resident may reach. */
+	unsigned rlimit_swap;		/* Most swap slots. */
+	unsigned rlimit_nofile;		/* Most open files, not counting
+					   the console. */
+	void (*sig_handlers[SIG_CNT])(void); /* Leader: by signal number. */
+	void *sig_trampoline;		/* Leader: user code that returns
+					   from a handler. */
+	uint32_t sig_pending;		/* Leader: bit N set if signal N is
+					   waiting to be delivered. */
 
 	int exit_status;
 
@@ -139,14 +302,17 @@ struct thread{
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
-//extra
-void sendsig_thread(tid_t pid, int signum);
+
+/* If true, keep histograms of scheduling latency and run queue
+   length.  Controlled by kernel command-line option "-schedstat". */
+extern bool thread_sched_stats;
 
 
 void thread_init (void);
 void thread_start (void);
 
-void thread_tick (void);
+void thread_tick (bool user);
+void thread_idle_tick (void);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -156,11 +322,22 @@ void thread_block (void);
 void thread_unblock (struct thread *);
 
 struct thread *thread_current (void);
+struct thread *thread_of_stack (const void *esp);
+uint8_t *thread_stack_top (struct thread *);
 tid_t thread_tid (void);
 const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
+void thread_yield_to_higher (void);
+uint32_t thread_random (void);
+
+/* Preemption control: critical sections that only need to keep
+   other threads out, not interrupt handlers, can turn preemption
+   off instead of interrupts.  They may not sleep. */
+void thread_preempt_disable (void);
+void thread_preempt_enable (void);
+bool thread_preemptible (void);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
@@ -168,10 +345,16 @@ void thread_foreach (thread_action_func *, void *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_donate_priority (struct thread *, int);
+void thread_refresh_priority (void);
 struct thread * thread_get_by_id (tid_t);
 int thread_get_nice (void);
 void thread_set_nice (int);
 int thread_get_recent_cpu (void);
 int thread_get_load_avg (void);
+bool thread_set_deadline (int64_t period, int64_t budget);
+bool thread_set_affinity (uint32_t mask);
+int thread_group_create (int64_t quota, int64_t period);
+bool thread_group_join (int group);
 
 #endif /* threads/thread.h */
@@ -0,0 +1,109 @@
+#include "threads/trace.h"
+#include <atomic.h>
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Pages in the ring buffer, and the records they hold. */
+#define TRACE_PAGES 8
+#define TRACE_SIZE (TRACE_PAGES * PGSIZE / sizeof (struct trace_record))
+
+/* One event.  Must be a power of two bytes long, so that records
+   do not straddle pages. */
+struct trace_record
+  {
+    int64_t ticks;              /* timer_ticks() at the event. */
+    uint64_t cycles;            /* Time-stamp counter at the event. */
+    uint32_t event;             /* An enum trace_event. */
+    tid_t tid;                  /* Running thread. */
+    uint32_t arg1;              /* Event-specific arguments. */
+    uint32_t arg2;
+  };
+
+bool trace_enabled;
+
+/* The ring buffer, and the number of records ever claimed in it.
+   Record N is kept in slot N % TRACE_SIZE until overwritten. */
+static struct trace_record *records;
+static uint32_t record_cnt;
+
+static const char *event_names[TRACE_EVENT_CNT] =
+  {
+    "schedule", "lock_acquire", "page_fault",
+    "ide_read", "ide_write", "syscall",
+  };
+
+/* Allocates the ring buffer and starts tracing.  Must be called
+   after palloc_init(). */
+void
+trace_init (void)
+{
+  ASSERT (sizeof (struct trace_record) == 32);
+
+  records = palloc_get_multiple (PAL_ASSERT | PAL_ZERO, TRACE_PAGES);
+  record_cnt = 0;
+  trace_enabled = true;
+}
+
+/* Returns the tid of the running thread.  Unlike thread_current(),
+   works in the middle of a thread switch. */
+static tid_t
+running_tid (void)
+{
+  uint32_t *esp;
+
+  asm ("mov %%esp, %0" : "=g" (esp));
+  return thread_of_stack (esp)->tid;
+}
+
+/* Appends a record of EVENT with ARG1 and ARG2 to the ring buffer,
+   overwriting the oldest one if it is full.  Takes no lock and
+   leaves the interrupt level alone: a slot is claimed with one
+   atomic increment, so a handler that interrupts us just takes
+   the next one. */
+void
+trace_event (enum trace_event event, uint32_t arg1, uint32_t arg2)
+{
+  uint32_t n = atomic_fetch_add (&record_cnt, 1);
+  struct trace_record *r = &records[n % TRACE_SIZE];
+
+  r->ticks = timer_ticks ();
+  r->cycles = timer_cycles ();
+  r->event = event;
+  r->tid = running_tid ();
+  r->arg1 = arg1;
+  r->arg2 = arg2;
+}
+
+/* Prints the records in the ring buffer, oldest first, with their
+   time-stamp counters relative to the oldest.  Tracing is
+   suspended meanwhile so that the dump does not trace itself. */
+void
+trace_dump (void)
+{
+  bool was_enabled = trace_enabled;
+  uint32_t first, i;
+
+  if (records == NULL)
+    return;
+  trace_enabled = false;
+
+  first = record_cnt > TRACE_SIZE ? record_cnt - TRACE_SIZE : 0;
+  printf ("Trace: %"PRIu32" events, last %"PRIu32" shown.\n",
+          record_cnt, record_cnt - first);
+  for (i = first; i < record_cnt; i++)
+    {
+      const struct trace_record *r = &records[i % TRACE_SIZE];
+
+      printf ("trace %"PRIu32" %"PRId64" %"PRIu64" %d %s %#"PRIx32
+              " %#"PRIx32"\n",
+              i, r->ticks, r->cycles - records[first % TRACE_SIZE].cycles,
+              r->tid, event_names[r->event], r->arg1, r->arg2);
+    }
+
+  trace_enabled = was_enabled;
+}
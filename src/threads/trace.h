@@ -0,0 +1,36 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Kinds of trace record. */
+enum trace_event
+  {
+    TRACE_SCHEDULE,             /* Next thread's tid, old status. */
+    TRACE_LOCK_ACQUIRE,         /* Lock, holder's tid or 0. */
+    TRACE_PAGE_FAULT,           /* Fault address, error code. */
+    TRACE_IDE_READ,             /* First sector, sector count. */
+    TRACE_IDE_WRITE,            /* First sector, sector count. */
+    TRACE_SYSCALL,              /* System call number, first argument. */
+    TRACE_EVENT_CNT
+  };
+
+/* True once trace_init() has set up the ring buffer. */
+extern bool trace_enabled;
+
+/* Records EVENT with arguments ARG1 and ARG2 if tracing is on.
+   Costs a single test otherwise. */
+#define TRACE(EVENT, ARG1, ARG2)                                        \
+        do                                                              \
+          {                                                             \
+            if (trace_enabled)                                          \
+              trace_event (EVENT, (uint32_t) (ARG1), (uint32_t) (ARG2)); \
+          }                                                             \
+        while (0)
+
+void trace_init (void);
+void trace_event (enum trace_event, uint32_t arg1, uint32_t arg2);
+void trace_dump (void);
+
+#endif /* threads/trace.h */
@@ -0,0 +1,132 @@
+#include "threads/tunable.h"
+#include <debug.h>
+#include <limits.h>
+#include <stddef.h>
+#include <string.h>
+
+/* Maximum number of tunables set, and the maximum lengths of a
+   name and of a value. */
+#define TUNABLE_MAX 32
+#define TUNABLE_NAME_MAX 31
+#define TUNABLE_VALUE_MAX 15
+
+/* A tunable set on the command line. */
+struct tunable
+  {
+    char name[TUNABLE_NAME_MAX + 1];    /* Name. */
+    char value[TUNABLE_VALUE_MAX + 1];  /* Value, as given. */
+    bool used;                          /* Read by some module? */
+  };
+
+static struct tunable tunables[TUNABLE_MAX];
+static size_t tunable_cnt;
+
+static struct tunable *find_tunable (const char *name);
+static bool parse_int (const char *, int *);
+
+/* Records ASSIGNMENT, of the form NAME=VALUE, from a -o option.
+   A later assignment to NAME replaces an earlier one.  Returns
+   false if ASSIGNMENT is malformed or too long, or if too many
+   tunables are set. */
+bool
+tunable_set (const char *assignment) 
+{
+  const char *value = strchr (assignment, '=');
+  char name[TUNABLE_NAME_MAX + 1];
+  size_t name_len;
+  struct tunable *t;
+
+  if (value == NULL)
+    return false;
+  name_len = value++ - assignment;
+  if (name_len == 0 || name_len > TUNABLE_NAME_MAX
+      || strlen (value) > TUNABLE_VALUE_MAX)
+    return false;
+  strlcpy (name, assignment, name_len + 1);
+
+  t = find_tunable (name);
+  if (t == NULL)
+    {
+      if (tunable_cnt >= TUNABLE_MAX)
+        return false;
+      t = &tunables[tunable_cnt++];
+      strlcpy (t->name, name, sizeof t->name);
+    }
+  strlcpy (t->value, value, sizeof t->value);
+  return true;
+}
+
+/* Returns the value of integer tunable NAME, or DEF if it was not
+   set.  Panics if it was set to anything but an integer between
+   MIN and MAX, inclusive. */
+int
+tunable_int (const char *name, int def, int min, int max) 
+{
+  struct tunable *t = find_tunable (name);
+  int value;
+
+  ASSERT (min <= def && def <= max);
+
+  if (t == NULL)
+    return def;
+  t->used = true;
+  if (!parse_int (t->value, &value) || value < min || value > max)
+    PANIC ("-o %s=%s: value must be an integer from %d to %d",
+           name, t->value, min, max);
+  return value;
+}
+
+/* Panics if a tunable was set that no module has read: most
+   likely a misspelling, or one for a part of the kernel that this
+   build leaves out.  Called once the kernel is initialized. */
+void
+tunable_check (void) 
+{
+  size_t i;
+
+  for (i = 0; i < tunable_cnt; i++)
+    if (!tunables[i].used)
+      PANIC ("unknown tunable `%s' (use -h for help)", tunables[i].name);
+}
+
+/* Returns the tunable named NAME, or a null pointer if it was not
+   set. */
+static struct tunable *
+find_tunable (const char *name) 
+{
+  size_t i;
+
+  for (i = 0; i < tunable_cnt; i++)
+    if (!strcmp (tunables[i].name, name))
+      return &tunables[i];
+  return NULL;
+}
+
+/* Parses S as a decimal integer with an optional sign and stores
+   it in *VALUE.  Returns false if S is anything else or too
+   large. */
+static bool
+parse_int (const char *s, int *value) 
+{
+  bool negative = *s == '-';
+  long long v = 0;
+
+  if (*s == '-' || *s == '+')
+    s++;
+  if (*s == '\0')
+    return false;
+  for (; *s != '\0'; s++)
+    {
+      if (*s < '0' || *s > '9')
+        return false;
+      v = v * 10 + (*s - '0');
+      if (v > (long long) INT_MAX + 1)
+        return false;
+    }
+  if (negative)
+    v = -v;
+  if (v > INT_MAX)
+    return false;
+  *value = v;
+  return true;
+}
@@ -0,0 +1,14 @@
+#ifndef THREADS_TUNABLE_H
+#define THREADS_TUNABLE_H
+
+#include <stdbool.h>
+
+/* Kernel tunables: parameters that would otherwise be
+   compile-time constants, set at boot with -o NAME=VALUE.  Each
+   module reads its own once, while it initializes, getting the
+   compiled-in default for any that no option set. */
+bool tunable_set (const char *assignment);
+int tunable_int (const char *name, int def, int min, int max);
+void tunable_check (void);
+
+#endif /* threads/tunable.h */
@@ -0,0 +1,181 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Number of worker threads. */
+#define WORKER_CNT 2
+
+/* Work ready to run, in the order queued, and delayed work,
+   ordered by increasing due tick.  Both are touched by the timer
+   interrupt handler, so they are protected by disabling
+   interrupts. */
+static struct list ready_list;
+static struct list delayed_list;
+
+/* Counts the items on ready_list, or more after work_cancel(). */
+static struct semaphore ready_sema;
+
+static thread_func worker NO_RETURN;
+static list_less_func due_less;
+
+/* Initializes the work queue and starts its worker threads.
+   Must be called after thread_start(). */
+void
+workqueue_init (void) 
+{
+  int i;
+
+  list_init (&ready_list);
+  list_init (&delayed_list);
+  sema_init (&ready_sema, 0);
+  for (i = 0; i < WORKER_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "worker%d", i);
+      if (thread_create (name, PRI_DEFAULT, worker, NULL) == TID_ERROR)
+        PANIC ("could not start work queue thread");
+    }
+}
+
+/* Initializes W to call FUNC with AUX when it runs. */
+void
+work_init (struct work *w, work_func *func, void *aux) 
+{
+  ASSERT (w != NULL);
+  ASSERT (func != NULL);
+
+  w->func = func;
+  w->aux = aux;
+  w->pending = false;
+}
+
+/* Queues W to run as soon as a worker is free.  Returns false,
+   without doing anything, if W was already queued.  May be called
+   from an interrupt handler. */
+bool
+work_queue (struct work *w) 
+{
+  enum intr_level old_level = intr_disable ();
+  bool queued = !w->pending;
+
+  if (queued)
+    {
+      w->pending = true;
+      list_push_back (&ready_list, &w->elem);
+      sema_up (&ready_sema);
+    }
+  intr_set_level (old_level);
+  return queued;
+}
+
+/* Queues W to run once TICKS timer ticks have passed, or at once
+   if TICKS is not positive.  Returns false, without doing
+   anything, if W was already queued. */
+bool
+work_queue_delayed (struct work *w, int64_t ticks) 
+{
+  enum intr_level old_level;
+  bool queued;
+
+  if (ticks <= 0)
+    return work_queue (w);
+
+  old_level = intr_disable ();
+  queued = !w->pending;
+  if (queued)
+    {
+      w->pending = true;
+      w->due = timer_ticks () + ticks;
+      list_insert_ordered (&delayed_list, &w->elem, due_less, NULL);
+    }
+  intr_set_level (old_level);
+  return queued;
+}
+
+/* Takes W off its queue, if it is on one, and returns true if
+   it was.  Does not wait for W if it is already running. */
+bool
+work_cancel (struct work *w) 
+{
+  enum intr_level old_level = intr_disable ();
+  bool was_pending = w->pending;
+
+  if (was_pending)
+    {
+      list_remove (&w->elem);
+      w->pending = false;
+    }
+  intr_set_level (old_level);
+  return was_pending;
+}
+
+/* Moves delayed work that is due at tick NOW to the ready list.
+   Called by the timer interrupt handler on every tick. */
+void
+workqueue_tick (int64_t now) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (!list_empty (&delayed_list))
+    {
+      struct work *w = list_entry (list_front (&delayed_list),
+                                   struct work, elem);
+      if (w->due > now)
+        break;
+      list_pop_front (&delayed_list);
+      list_push_back (&ready_list, &w->elem);
+      sema_up (&ready_sema);
+    }
+}
+
+/* Returns the tick when the first delayed work is due, or
+   INT64_MAX if there is none, for tickless idle.  Interrupts
+   must be off. */
+int64_t
+workqueue_next_due (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (list_empty (&delayed_list))
+    return INT64_MAX;
+  return list_entry (list_front (&delayed_list), struct work, elem)->due;
+}
+
+/* Worker thread: runs ready work, one item at a time. */
+static void
+worker (void *aux UNUSED) 
+{
+  for (;;)
+    {
+      enum intr_level old_level;
+      struct work *w = NULL;
+
+      sema_down (&ready_sema);
+      old_level = intr_disable ();
+      if (!list_empty (&ready_list))
+        {
+          w = list_entry (list_pop_front (&ready_list), struct work, elem);
+          w->pending = false;
+        }
+      intr_set_level (old_level);
+
+      if (w != NULL)
+        w->func (w->aux);
+    }
+}
+
+/* Orders work items by increasing due tick, keeping work due on
+   the same tick in the order it was queued. */
+static bool
+due_less (const struct list_elem *a_, const struct list_elem *b_,
+          void *aux UNUSED) 
+{
+  const struct work *a = list_entry (a_, struct work, elem);
+  const struct work *b = list_entry (b_, struct work, elem);
+
+  return a->due < b->due;
+}
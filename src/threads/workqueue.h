@@ -0,0 +1,34 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Function that a worker thread runs for a work item. */
+typedef void work_func (void *aux);
+
+/* Deferred work, which one of a small pool of kernel worker
+   threads runs on behalf of a background subsystem, so that the
+   subsystem does not need a thread of its own.  A work item is
+   queued at most once at a time; it may queue itself again from
+   its own function. */
+struct work
+  {
+    struct list_elem elem;      /* Ready or delayed list element. */
+    work_func *func;            /* Function to run. */
+    void *aux;                  /* Its argument. */
+    int64_t due;                /* Tick when delayed work is due. */
+    bool pending;               /* On the ready or delayed list? */
+  };
+
+void workqueue_init (void);
+void work_init (struct work *, work_func *, void *aux);
+bool work_queue (struct work *);
+bool work_queue_delayed (struct work *, int64_t ticks);
+bool work_cancel (struct work *);
+
+void workqueue_tick (int64_t now);
+int64_t workqueue_next_due (void);
+
+#endif /* threads/workqueue.h */
@@ -1,13 +1,20 @@
 #include "userprog/exception.h"
+#include <atomic.h>
 #include <inttypes.h>
 #include <stdio.h>
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
+#include "userprog/usercopy.h"
+#ifdef VM
+#include "vm/page.h"
+#include "vm/frame.h"
+#endif
 
 /* Number of page faults processed. */
-static long long page_fault_cnt;
+static uint64_t page_fault_cnt;
 
 static void kill(struct intr_frame *);
 static void page_fault(struct intr_frame *);
@@ -45,8 +52,6 @@ void exception_init(void)
    intr_register_int(0, 0, INTR_ON, kill, "#DE Divide Error");
    intr_register_int(1, 0, INTR_ON, kill, "#DB Debug Exception");
    intr_register_int(6, 0, INTR_ON, kill, "#UD Invalid Opcode Exception");
-   intr_register_int(7, 0, INTR_ON, kill,
-                     "#NM Device Not Available Exception");
    intr_register_int(11, 0, INTR_ON, kill, "#NP Segment Not Present");
    intr_register_int(12, 0, INTR_ON, kill, "#SS Stack Fault Exception");
    intr_register_int(13, 0, INTR_ON, kill, "#GP General Protection Exception");
@@ -63,7 +68,7 @@ void exception_init(void)
 /* Prints exception statistics. */
 void exception_print_stats(void)
 {
-   printf("Exception: %lld page faults\n", page_fault_cnt);
+   printf("Exception: %"PRIu64" page faults\n", atomic_read64(&page_fault_cnt));
 }
 
 /* Handler for an exception (probably) caused by a user process. */
@@ -140,13 +145,35 @@ page_fault(struct intr_frame *f)
    intr_enable();
 
    /* Count page faults. */
-   page_fault_cnt++;
+   atomic_fetch_add64(&page_fault_cnt, 1);
+   TRACE(TRACE_PAGE_FAULT, fault_addr, f->error_code);
 
    /* Determine cause. */
    not_present = (f->error_code & PF_P) == 0;
    write = (f->error_code & PF_W) != 0;
    user = (f->error_code & PF_U) != 0;
 
+#ifdef VM
+   /* A process suspended by the load controller stops here. */
+   if (user)
+      frame_load_wait();
+
+   /* Bring in the page from the supplemental page table, grow the
+      stack, or copy a zero page on write.  Kernel-mode faults on user
+      addresses happen while a system call touches user memory, so
+      use the %esp saved at syscall entry. */
+   if ((not_present || write) && is_user_vaddr(fault_addr)
+       && vm_handle_fault(fault_addr,
+                          user ? f->esp : thread_current()->user_esp,
+                          write))
+      return;
+#endif
+
+   /* A system call's access to bad user memory fails with an
+      error instead of killing the process. */
+   if (!user && usercopy_fixup(f))
+      return;
+
    if (!user || is_kernel_vaddr(fault_addr) || not_present)
    {
       f->eip = (void *)f->eax;
@@ -0,0 +1,176 @@
+#include "userprog/fdtable.h"
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "userprog/process.h"
+
+/* Each process's open files live in an array indexed by file
+   descriptor, allocated from the kernel heap on the first open and
+   doubled whenever it fills up.  Descriptors 0 and 1 are the
+   console unless spawn() gave the process a file in their slot, as
+   a shell does for a pipeline; fd_install() never hands them out.
+   The table is the leader's, shared by all of the process's threads
+   under its proc_lock. */
+
+/* Slots in a process's first table. */
+#define FDT_INITIAL_SIZE 16
+
+/* Most descriptors a process may have. */
+#define FDT_MAX_SIZE 1024
+
+/* Grows the current process's table so that it has a slot FD.
+   Returns false if memory is short or FD is too large. */
+static bool
+grow(int fd)
+{
+  struct thread *t = process_current();
+  struct file **fdt;
+  int size = t->fdt_size > 0 ? t->fdt_size : FDT_INITIAL_SIZE;
+  int i;
+
+  while (size <= fd)
+    size *= 2;
+  if (size > FDT_MAX_SIZE)
+    return false;
+  fdt = realloc(t->fdt, size * sizeof *fdt);
+  if (fdt == NULL)
+    return false;
+  for (i = t->fdt_size; i < size; i++)
+    fdt[i] = NULL;
+  t->fdt = fdt;
+  t->fdt_size = size;
+  return true;
+}
+
+/* Gives FILE the lowest free descriptor of the current process and
+   returns it, or returns -1 if none can be allocated or the process
+   is at its open file limit. */
+int fd_install(struct file *file)
+{
+  struct thread *t = process_current();
+  int fd;
+
+  lock_acquire(&t->proc_lock);
+  fd = t->next_fd;
+  while (fd < t->fdt_size && t->fdt[fd] != NULL)
+    fd++;
+  if ((unsigned)t->fd_cnt >= t->rlimit_nofile)
+    fd = -1;
+  else if (fd < t->fdt_size || grow(fd))
+  {
+    t->fdt[fd] = file;
+    t->fd_cnt++;
+    t->next_fd = fd + 1;
+  }
+  else
+    fd = -1;
+  lock_release(&t->proc_lock);
+  return fd;
+}
+
+/* Gives FILE descriptor FD of the current process.  Returns false
+   if FD is in use or cannot be allocated, or at the open file
+   limit. */
+bool fd_install_at(int fd, struct file *file)
+{
+  struct thread *t = process_current();
+  bool success = false;
+
+  lock_acquire(&t->proc_lock);
+  if (fd >= 0 && (unsigned)t->fd_cnt < t->rlimit_nofile
+      && (fd < t->fdt_size || grow(fd)) && t->fdt[fd] == NULL)
+  {
+    t->fdt[fd] = file;
+    t->fd_cnt++;
+    success = true;
+  }
+  lock_release(&t->proc_lock);
+  return success;
+}
+
+/* Returns the file open as FD in the current process, or a null
+   pointer if FD is not open. */
+struct file *
+fd_lookup(int fd)
+{
+  struct thread *t = process_current();
+  struct file *file = NULL;
+
+  lock_acquire(&t->proc_lock);
+  if (fd >= 0 && fd < t->fdt_size)
+    file = t->fdt[fd];
+  lock_release(&t->proc_lock);
+  return file;
+}
+
+/* Frees descriptor FD of the current process and returns the file
+   that was open as FD, which the caller must close, or a null
+   pointer if FD was not open. */
+struct file *
+fd_remove(int fd)
+{
+  struct thread *t = process_current();
+  struct file *file = NULL;
+
+  lock_acquire(&t->proc_lock);
+  if (fd >= 0 && fd < t->fdt_size && t->fdt[fd] != NULL)
+  {
+    file = t->fdt[fd];
+    t->fdt[fd] = NULL;
+    t->fd_cnt--;
+    if (fd >= 2 && fd < t->next_fd)
+      t->next_fd = fd;
+  }
+  lock_release(&t->proc_lock);
+  return file;
+}
+
+/* Opens, for the current process, each file that PARENT has open,
+   under the same descriptor and at the same position.  The files
+   are opened anew, so the two processes' positions then move
+   independently.  PARENT must be a leader, with its proc_lock held.
+   Returns false if memory runs out. */
+bool fd_duplicate(struct thread *parent)
+{
+  struct thread *t = thread_current();
+  int fd, left = parent->fd_cnt;
+
+  for (fd = 0; left > 0; fd++)
+    if (parent->fdt[fd] != NULL)
+    {
+      struct file *file = file_reopen(parent->fdt[fd]);
+
+      left--;
+      if (file == NULL || (fd >= t->fdt_size && !grow(fd)))
+      {
+        file_close(file);
+        return false;
+      }
+      file_seek(file, file_tell(parent->fdt[fd]));
+      t->fdt[fd] = file;
+      t->fd_cnt++;
+    }
+  t->next_fd = parent->next_fd;
+  return true;
+}
+
+/* Closes every file the current process has open and frees its
+   table.  The scan stops as soon as the last open file is closed;
+   since the lowest free descriptor is always reused, that is
+   rarely far beyond the number of open files. */
+void fd_close_all(void)
+{
+  struct thread *t = thread_current();
+  int fd;
+
+  for (fd = 0; t->fd_cnt > 0; fd++)
+    if (t->fdt[fd] != NULL)
+    {
+      file_close(t->fdt[fd]);
+      t->fd_cnt--;
+    }
+  free(t->fdt);
+  t->fdt = NULL;
+  t->fdt_size = 0;
+  t->next_fd = 2;
+}
@@ -0,0 +1,16 @@
+#ifndef USERPROG_FDTABLE_H
+#define USERPROG_FDTABLE_H
+
+#include <stdbool.h>
+
+struct file;
+struct thread;
+
+int fd_install(struct file *);
+bool fd_install_at(int fd, struct file *);
+struct file *fd_lookup(int fd);
+struct file *fd_remove(int fd);
+bool fd_duplicate(struct thread *);
+void fd_close_all(void);
+
+#endif /* userprog/fdtable.h */
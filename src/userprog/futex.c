@@ -0,0 +1,177 @@
+#include "userprog/futex.h"
+#include <hash.h>
+#include <limits.h>
+#include <list.h>
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/process.h"
+#include "userprog/usercopy.h"
+
+/* Threads blocked in futex_sleep() on one user address of one
+   process.  A queue exists only while it has waiters, so a futex
+   nobody waits on costs the kernel nothing. */
+struct futex_queue
+{
+  struct thread *proc;   /* Leader of the process. */
+  const int *uaddr;      /* User address waited on. */
+  struct list waiters;   /* struct futex_waiter, oldest first. */
+  struct hash_elem elem; /* Element in futex_queues. */
+};
+
+/* A thread blocked in futex_sleep(), on its own kernel stack. */
+struct futex_waiter
+{
+  struct list_elem elem;
+  struct semaphore sema; /* Upped by the thread that wakes it. */
+};
+
+/* All populated queues, and the lock that guards them and every
+   check of a futex word against the value expected. */
+static struct hash futex_queues;
+static struct lock futex_lock;
+
+static unsigned
+queue_hash(const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct futex_queue *q = hash_entry(e, struct futex_queue, elem);
+  return hash_ptr(q->proc) ^ hash_ptr(q->uaddr);
+}
+
+static bool
+queue_less(const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct futex_queue *a = hash_entry(a_, struct futex_queue, elem);
+  const struct futex_queue *b = hash_entry(b_, struct futex_queue, elem);
+
+  if (a->proc != b->proc)
+    return a->proc < b->proc;
+  return a->uaddr < b->uaddr;
+}
+
+/* Returns the current process's queue for UADDR, or a null pointer
+   if nobody waits there.  Must be called with futex_lock held. */
+static struct futex_queue *
+find_queue(const int *uaddr)
+{
+  struct futex_queue key;
+  struct hash_elem *e;
+
+  key.proc = process_current();
+  key.uaddr = uaddr;
+  e = hash_find(&futex_queues, &key.elem);
+  return e != NULL ? hash_entry(e, struct futex_queue, elem) : NULL;
+}
+
+/* Wakes up to CNT of Q's waiters, oldest first, and frees Q if
+   that leaves it empty.  Returns how many were woken.  Must be
+   called with futex_lock held. */
+static int
+wake_queue(struct futex_queue *q, int cnt)
+{
+  int woken = 0;
+
+  while (woken < cnt && !list_empty(&q->waiters))
+  {
+    struct futex_waiter *w = list_entry(list_pop_front(&q->waiters),
+                                        struct futex_waiter, elem);
+    sema_up(&w->sema);
+    woken++;
+  }
+  if (list_empty(&q->waiters))
+  {
+    hash_delete(&futex_queues, &q->elem);
+    free(q);
+  }
+  return woken;
+}
+
+void futex_init(void)
+{
+  hash_init(&futex_queues, queue_hash, queue_less, NULL);
+  lock_init_named(&futex_lock, "futex");
+}
+
+/* Blocks the current thread on UADDR until futex_wakeup(), as long as
+   the int there still holds VAL; the check and the blocking are
+   atomic with respect to futex_wakeup().  Returns 0 once woken, or -1
+   without blocking if the value differs, UADDR cannot be read or
+   memory is short, or the process is exiting. */
+int futex_sleep(const int *uaddr, int val)
+{
+  struct thread *proc = process_current();
+  struct futex_queue *q;
+  struct futex_waiter w;
+  int cur;
+
+  lock_acquire(&futex_lock);
+  if (proc->dying || !copy_from_user(&cur, uaddr, sizeof cur) || cur != val)
+  {
+    lock_release(&futex_lock);
+    return -1;
+  }
+  q = find_queue(uaddr);
+  if (q == NULL)
+  {
+    q = malloc(sizeof *q);
+    if (q == NULL)
+    {
+      lock_release(&futex_lock);
+      return -1;
+    }
+    q->proc = proc;
+    q->uaddr = uaddr;
+    list_init(&q->waiters);
+    hash_insert(&futex_queues, &q->elem);
+  }
+  sema_init(&w.sema, 0);
+  list_push_back(&q->waiters, &w.elem);
+  lock_release(&futex_lock);
+
+  sema_down(&w.sema);
+  return 0;
+}
+
+/* Wakes up to CNT threads of the current process waiting on UADDR.
+   Returns how many were woken. */
+int futex_wakeup(const int *uaddr, int cnt)
+{
+  struct futex_queue *q;
+  int woken = 0;
+
+  lock_acquire(&futex_lock);
+  q = find_queue(uaddr);
+  if (q != NULL && cnt > 0)
+    woken = wake_queue(q, cnt);
+  lock_release(&futex_lock);
+  return woken;
+}
+
+/* Wakes every waiter in PROC, a leader whose process is exiting, so
+   that its threads get to end.  Waits started afterwards fail. */
+void futex_wakeup_all(struct thread *proc)
+{
+  struct hash_iterator i;
+  bool found;
+
+  lock_acquire(&futex_lock);
+  do
+  {
+    found = false;
+    hash_first(&i, &futex_queues);
+    while (hash_next(&i))
+    {
+      struct futex_queue *q = hash_entry(hash_cur(&i), struct futex_queue,
+                                         elem);
+      if (q->proc == proc)
+      {
+        /* Freeing Q invalidates the iterator, so start over. */
+        wake_queue(q, INT_MAX);
+        found = true;
+        break;
+      }
+    }
+  } while (found);
+  lock_release(&futex_lock);
+}
@@ -0,0 +1,11 @@
+#ifndef USERPROG_FUTEX_H
+#define USERPROG_FUTEX_H
+
+struct thread;
+
+void futex_init(void);
+int futex_sleep(const int *uaddr, int val);
+int futex_wakeup(const int *uaddr, int cnt);
+void futex_wakeup_all(struct thread *);
+
+#endif /* userprog/futex.h */
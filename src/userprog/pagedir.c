@@ -3,11 +3,36 @@
 #include <stddef.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* A 4 MB user page, with the page table of 4 kB pages that replaces
+   it when any one of its pages is changed on its own.  The table is
+   allocated and filled along with the large page, so that splitting
+   it cannot fail. */
+struct large_page
+{
+  uint32_t *pde;            /* Its page directory entry */
+  uint32_t *pt;             /* Page table that maps the same frames */
+  struct list_elem elem;    /* Element in large_pages */
+};
+static struct list large_pages = LIST_INITIALIZER(large_pages);
+static struct spinlock large_pages_lock;
 
 static uint32_t *active_pd(void);
+static void load_pd(uint32_t *);
 static void invalidate_pagedir(uint32_t *);
+static void invalidate_page(uint32_t *, const void *);
+static uint32_t *lookup_large(uint32_t *, const void *);
+static struct large_page *take_large(uint32_t *);
+static void split_large(uint32_t *, uint32_t *);
+
+/* Number of threads inside a TLB batch. */
+static int batch_cnt;
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -33,7 +58,14 @@ void pagedir_destroy(uint32_t *pd)
 
   ASSERT(pd != init_page_dir);
   for (pde = pd; pde < pd + pd_no(PHYS_BASE); pde++)
-    if (*pde & PTE_P)
+    if (*pde & PTE_PS)
+    {
+      /* The frame table owns the frames of a large page. */
+      struct large_page *lp = take_large(pde);
+      palloc_free_page(lp->pt);
+      free(lp);
+    }
+    else if (*pde & PTE_P)
     {
       uint32_t *pt = pde_get_pt(*pde);
       uint32_t *pte;
@@ -51,7 +83,8 @@ void pagedir_destroy(uint32_t *pd)
    If PD does not have a page table for VADDR, behavior depends
    on CREATE.  If CREATE is true, then a new page table is
    created and a pointer into it is returned.  Otherwise, a null
-   pointer is returned. */
+   pointer is returned.  A large page at VADDR is split into 4 kB
+   pages first. */
 static uint32_t *
 lookup_page(uint32_t *pd, const void *vaddr, bool create)
 {
@@ -65,6 +98,8 @@ lookup_page(uint32_t *pd, const void *vaddr, bool create)
   /* Check for a page table for VADDR.
      If one is missing, create one if requested. */
   pde = pd + pd_no(vaddr);
+  if (*pde & PTE_PS)
+    split_large(pd, pde);
   if (*pde == 0)
   {
     if (create)
@@ -127,6 +162,9 @@ pagedir_get_page(uint32_t *pd, const void *uaddr)
 
   ASSERT(is_user_vaddr(uaddr));
 
+  pte = lookup_large(pd, uaddr);
+  if (pte != NULL)
+    return pte_get_page(*pte) + ((uintptr_t) uaddr & (PTSPAN - 1));
   pte = lookup_page(pd, uaddr, false);
   if (pte != NULL && (*pte & PTE_P) != 0)
     return pte_get_page(*pte) + pg_ofs(uaddr);
@@ -149,7 +187,7 @@ void pagedir_clear_page(uint32_t *pd, void *upage)
   if (pte != NULL && (*pte & PTE_P) != 0)
   {
     *pte &= ~PTE_P;
-    invalidate_pagedir(pd);
+    invalidate_page(pd, upage);
   }
 }
 
@@ -159,7 +197,9 @@ void pagedir_clear_page(uint32_t *pd, void *upage)
    Returns false if PD contains no PTE for VPAGE. */
 bool pagedir_is_dirty(uint32_t *pd, const void *vpage)
 {
-  uint32_t *pte = lookup_page(pd, vpage, false);
+  uint32_t *pte = lookup_large(pd, vpage);
+  if (pte == NULL)
+    pte = lookup_page(pd, vpage, false);
   return pte != NULL && (*pte & PTE_D) != 0;
 }
 
@@ -175,7 +215,7 @@ void pagedir_set_dirty(uint32_t *pd, const void *vpage, bool dirty)
     else
     {
       *pte &= ~(uint32_t)PTE_D;
-      invalidate_pagedir(pd);
+      invalidate_page(pd, vpage);
     }
   }
 }
@@ -183,18 +223,23 @@ void pagedir_set_dirty(uint32_t *pd, const void *vpage, bool dirty)
 /* Returns true if the PTE for virtual page VPAGE in PD has been
    accessed recently, that is, between the time the PTE was
    installed and the last time it was cleared.  Returns false if
-   PD contains no PTE for VPAGE. */
+   PD contains no PTE for VPAGE.  The pages of a large page share
+   one accessed bit, and one dirty bit. */
 bool pagedir_is_accessed(uint32_t *pd, const void *vpage)
 {
-  uint32_t *pte = lookup_page(pd, vpage, false);
+  uint32_t *pte = lookup_large(pd, vpage);
+  if (pte == NULL)
+    pte = lookup_page(pd, vpage, false);
   return pte != NULL && (*pte & PTE_A) != 0;
 }
 
 /* Sets the accessed bit to ACCESSED in the PTE for virtual page
-   VPAGE in PD. */
+   VPAGE in PD, or for all of the large page that holds VPAGE. */
 void pagedir_set_accessed(uint32_t *pd, const void *vpage, bool accessed)
 {
-  uint32_t *pte = lookup_page(pd, vpage, false);
+  uint32_t *pte = lookup_large(pd, vpage);
+  if (pte == NULL)
+    pte = lookup_page(pd, vpage, false);
   if (pte != NULL)
   {
     if (accessed)
@@ -202,23 +247,198 @@ void pagedir_set_accessed(uint32_t *pd, const void *vpage, bool accessed)
     else
     {
       *pte &= ~(uint32_t)PTE_A;
-      invalidate_pagedir(pd);
+      invalidate_page(pd, vpage);
     }
   }
 }
 
+/* Returns true if virtual page VPAGE is mapped writable in PD. */
+bool pagedir_is_writable(uint32_t *pd, const void *vpage)
+{
+  uint32_t *pte = lookup_large(pd, vpage);
+  if (pte == NULL)
+    pte = lookup_page(pd, vpage, false);
+  return pte != NULL && (*pte & (PTE_P | PTE_W)) == (PTE_P | PTE_W);
+}
+
+/* Makes the PTE for virtual page VPAGE in PD writable if
+   WRITABLE is true, read-only otherwise. */
+void pagedir_set_writable(uint32_t *pd, const void *vpage, bool writable)
+{
+  uint32_t *pte = lookup_page(pd, vpage, false);
+  if (pte != NULL)
+  {
+    if (writable)
+      *pte |= PTE_W;
+    else
+      *pte &= ~(uint32_t)PTE_W;
+    invalidate_page(pd, vpage);
+  }
+}
+
+/* Returns true if the 4 MB aligned region of user virtual memory
+   that holds UPAGE may be mapped by pagedir_set_large(): the CPU
+   allows large pages and no page of the region is mapped, nor has
+   a page table. */
+bool pagedir_can_map_large(uint32_t *pd, const void *upage)
+{
+  ASSERT(is_user_vaddr(upage));
+  return init_large_pages && pd[pd_no(upage)] == 0;
+}
+
+/* Maps the 4 MB aligned region at user virtual address UPAGE in PD
+   to the PTSPAN / PGSIZE frames at kernel virtual address KPAGE,
+   which must also be 4 MB aligned, as one large page.  If WRITABLE
+   is true the pages are read/write, otherwise read-only.  Returns
+   false if pagedir_can_map_large() does not allow it or memory
+   runs out. */
+bool pagedir_set_large(uint32_t *pd, void *upage, void *kpage,
+                       bool writable)
+{
+  struct large_page *lp;
+  enum intr_level old_level;
+  size_t i;
+
+  ASSERT(((uintptr_t) upage & (PTSPAN - 1)) == 0);
+  ASSERT((vtop(kpage) & (PTSPAN - 1)) == 0);
+  ASSERT(pd != init_page_dir);
+
+  if (!pagedir_can_map_large(pd, upage))
+    return false;
+  lp = malloc(sizeof *lp);
+  if (lp == NULL)
+    return false;
+  lp->pt = palloc_get_page(0);
+  if (lp->pt == NULL)
+  {
+    free(lp);
+    return false;
+  }
+  for (i = 0; i < PGSIZE / sizeof *lp->pt; i++)
+    lp->pt[i] = pte_create_user((uint8_t *) kpage + i * PGSIZE, writable);
+  lp->pde = pd + pd_no(upage);
+
+  old_level = spin_lock_irqsave(&large_pages_lock);
+  list_push_front(&large_pages, &lp->elem);
+  spin_unlock_irqrestore(&large_pages_lock, old_level);
+  *lp->pde = vtop(kpage) | PTE_PS | PTE_U | PTE_P | (writable ? PTE_W : 0);
+  return true;
+}
+
+/* Returns true if user virtual address VADDR is mapped in PD by a
+   large page. */
+bool pagedir_is_large(uint32_t *pd, const void *vaddr)
+{
+  return lookup_large(pd, vaddr) != NULL;
+}
+
+/* Maps a copy of every user page of SRC at the same address and
+   with the same writability in DST, using new pages from the
+   user pool.  Returns false if memory runs out; the pages copied
+   so far stay in DST, where pagedir_destroy() frees them. */
+bool pagedir_copy(uint32_t *dst, uint32_t *src)
+{
+  uint32_t *pde;
+
+  for (pde = src; pde < src + pd_no(PHYS_BASE); pde++)
+    if (*pde & PTE_P)
+    {
+      uint32_t *pt = pde_get_pt(*pde);
+      size_t i;
+
+      for (i = 0; i < PGSIZE / sizeof *pt; i++)
+        if (pt[i] & PTE_P)
+        {
+          void *upage = (void *)(((uintptr_t)(pde - src) << PDSHIFT)
+                                 | (i << PTSHIFT));
+          void *kpage = palloc_get_page(PAL_USER);
+
+          if (kpage == NULL)
+            return false;
+          memcpy(kpage, pte_get_page(pt[i]), PGSIZE);
+          if (!pagedir_set_page(dst, upage, kpage, (pt[i] & PTE_W) != 0))
+          {
+            palloc_free_page(kpage);
+            return false;
+          }
+        }
+    }
+  return true;
+}
+
+/* Returns the page directory entry of the large page that maps
+   VADDR in PD, or a null pointer if there is none. */
+static uint32_t *
+lookup_large(uint32_t *pd, const void *vaddr)
+{
+  uint32_t *pde = pd + pd_no(vaddr);
+
+  return (*pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS) ? pde : NULL;
+}
+
+/* Removes the record of the large page mapped by PDE from
+   large_pages and returns it. */
+static struct large_page *
+take_large(uint32_t *pde)
+{
+  struct large_page *lp = NULL;
+  enum intr_level old_level;
+  struct list_elem *e;
+
+  old_level = spin_lock_irqsave(&large_pages_lock);
+  for (e = list_begin(&large_pages); e != list_end(&large_pages);
+       e = list_next(e))
+    if (list_entry(e, struct large_page, elem)->pde == pde)
+    {
+      lp = list_entry(e, struct large_page, elem);
+      list_remove(e);
+      break;
+    }
+  spin_unlock_irqrestore(&large_pages_lock, old_level);
+  ASSERT(lp != NULL);
+  return lp;
+}
+
+/* Replaces the large page mapped by PDE in PD with its page table
+   of 4 kB pages, each of which gets the large page's accessed,
+   dirty and writable bits. */
+static void
+split_large(uint32_t *pd, uint32_t *pde)
+{
+  struct large_page *lp = take_large(pde);
+  uint32_t bits = *pde & (PTE_A | PTE_D | PTE_W);
+  size_t i;
+
+  for (i = 0; i < PGSIZE / sizeof *lp->pt; i++)
+    lp->pt[i] = (lp->pt[i] & ~(uint32_t) (PTE_A | PTE_D | PTE_W)) | bits;
+  *pde = pde_create(lp->pt);
+  invalidate_page(pd, (void *) ((uintptr_t) (pde - pd) << PDSHIFT));
+  free(lp);
+}
+
 /* Loads page directory PD into the CPU's page directory base
-   register. */
+   register, unless it is already there: switching between
+   threads that share an address space, or between kernel
+   threads, then keeps the TLB.  While some thread is inside a
+   TLB batch, PD is always reloaded, so that no other thread runs
+   with the entries the batch has yet to invalidate. */
 void pagedir_activate(uint32_t *pd)
 {
   if (pd == NULL)
     pd = init_page_dir;
+  if (active_pd() != pd || batch_cnt > 0)
+    load_pd(pd);
+}
 
-  /* Store the physical address of the page directory into CR3
-     aka PDBR (page directory base register).  This activates our
-     new page tables immediately.  See [IA32-v2a] "MOV--Move
-     to/from Control Registers" and [IA32-v3a] 3.7.5 "Base
-     Address of the Page Directory". */
+/* Stores the physical address of page directory PD into CR3 aka
+   PDBR (page directory base register).  This activates the new
+   page tables immediately, and flushes every TLB entry that is
+   not global.  See [IA32-v2a] "MOV--Move to/from Control
+   Registers" and [IA32-v3a] 3.7.5 "Base Address of the Page
+   Directory". */
+static void
+load_pd(uint32_t *pd)
+{
   asm volatile("movl %0, %%cr3" : : "r"(vtop(pd)) : "memory");
 }
 
@@ -238,7 +458,7 @@ active_pd(void)
 /* Seom page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
    table.  When this happens, we have to "invalidate" the TLB by
-   re-activating it.
+   reloading it.
 
    This function invalidates the TLB if PD is the active page
    directory.  (If PD is not active then its entries are not in
@@ -248,8 +468,67 @@ invalidate_pagedir(uint32_t *pd)
 {
   if (active_pd() == pd)
   {
-    /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
+    /* Reloading PD clears the TLB.  See [IA32-v3a] 3.12
        "Translation Lookaside Buffers (TLBs)". */
-    pagedir_activate(pd);
+    load_pd(pd);
+  }
+}
+
+/* Invalidates the TLB entry for user page UPAGE if PD is the
+   active page directory.  Inside a batch the page is only
+   recorded, and pagedir_batch_end() invalidates it. */
+static void
+invalidate_page(uint32_t *pd, const void *upage)
+{
+  struct tlb_batch *b = thread_current()->tlb_batch;
+
+  if (active_pd() != pd)
+    return;
+  if (b != NULL)
+  {
+    if (b->page_cnt < TLB_BATCH_MAX)
+      b->pages[b->page_cnt] = upage;
+    b->page_cnt++;
+    return;
   }
+
+  /* See [IA32-v2a] "INVLPG--Invalidate TLB Entry". */
+  asm volatile("invlpg (%0)" : : "r"(upage) : "memory");
+}
+
+/* Starts collecting the current thread's TLB invalidations in B,
+   to be issued together by pagedir_batch_end().  Until then the
+   caller must not touch the pages it changes, since the CPU may
+   still use their old entries.  Batches do not nest. */
+void pagedir_batch_begin(struct tlb_batch *b)
+{
+  struct thread *t = thread_current();
+  enum intr_level old_level;
+
+  ASSERT(t->tlb_batch == NULL);
+  b->page_cnt = 0;
+  t->tlb_batch = b;
+  old_level = intr_disable();
+  batch_cnt++;
+  intr_set_level(old_level);
+}
+
+/* Ends batch B, invalidating each page it collected, or the whole
+   TLB if there were more than TLB_BATCH_MAX of them. */
+void pagedir_batch_end(struct tlb_batch *b)
+{
+  struct thread *t = thread_current();
+  enum intr_level old_level;
+  size_t i;
+
+  ASSERT(t->tlb_batch == b);
+  t->tlb_batch = NULL;
+  if (b->page_cnt > TLB_BATCH_MAX)
+    invalidate_pagedir(t->pagedir);
+  else
+    for (i = 0; i < b->page_cnt; i++)
+      asm volatile("invlpg (%0)" : : "r"(b->pages[i]) : "memory");
+  old_level = intr_disable();
+  batch_cnt--;
+  intr_set_level(old_level);
 }
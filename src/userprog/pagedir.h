@@ -2,8 +2,20 @@
 #define USERPROG_PAGEDIR_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/* Most pages a batch invalidates one at a time.  Beyond this,
+   reloading the page directory is cheaper. */
+#define TLB_BATCH_MAX 32
+
+/* TLB invalidations deferred by pagedir_batch_begin(). */
+struct tlb_batch
+  {
+    size_t page_cnt;                    /* Pages invalidated. */
+    const void *pages[TLB_BATCH_MAX];   /* The first TLB_BATCH_MAX. */
+  };
+
 uint32_t *pagedir_create (void);
 void pagedir_destroy (uint32_t *pd);
 bool pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool rw);
@@ -13,6 +25,14 @@ bool pagedir_is_dirty (uint32_t *pd, const void *upage);
 void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
+bool pagedir_is_writable (uint32_t *pd, const void *upage);
+void pagedir_set_writable (uint32_t *pd, const void *upage, bool writable);
+bool pagedir_can_map_large (uint32_t *pd, const void *upage);
+bool pagedir_set_large (uint32_t *pd, void *upage, void *kpage, bool rw);
+bool pagedir_is_large (uint32_t *pd, const void *vaddr);
+bool pagedir_copy (uint32_t *dst, uint32_t *src);
 void pagedir_activate (uint32_t *pd);
+void pagedir_batch_begin (struct tlb_batch *);
+void pagedir_batch_end (struct tlb_batch *);
 
 #endif /* userprog/pagedir.h */
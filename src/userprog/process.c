@@ -5,57 +5,211 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "userprog/fdtable.h"
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
+#include "userprog/signal.h"
 #include "userprog/tss.h"
+#include "userprog/usercopy.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "lib/user/syscall.h"
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/ring.h"
+#include "vm/shm.h"
+#include "vm/swap.h"
+#endif
 
 static thread_func start_process NO_RETURN;
+static thread_func start_fork NO_RETURN;
+static bool duplicate_process(struct thread *parent);
+static tid_t reap(struct thread *owner, struct list *live,
+                  struct list *exited, tid_t tid, int *status,
+                  int options);
+static void publish_exit(struct thread *owner, struct list *exited);
+static void wait_to_be_reaped(struct thread *owner, struct list *exited);
+static void exit_uthread(void);
+#ifdef VM
+static thread_func start_uthread NO_RETURN;
+static thread_func start_kthread NO_RETURN;
+static void join_process(struct thread *creator);
+static bool setup_thread_stack(void **esp);
+#endif
 static bool load(const char *cmdline, void (**eip)(void), void **esp);
+static bool inherit_cwd(struct thread *parent);
+static void usage_add(struct thread_usage *, const struct thread_usage *);
+static void print_usage(struct thread *leader);
+static struct lock elf_cache_lock;
 
-/* Starts a new thread running a user program loaded from
-   FILENAME.  The new thread may be scheduled (and may even exit)
-   before process_execute() returns.  Returns the new process's
-   thread id, or TID_ERROR if the thread cannot be created. */
-tid_t process_execute(const char *file_name)
+/* Print each process's resource usage as it exits, if -rusage was
+   given. */
+bool process_print_usage;
+
+/* Initializes the process subsystem. */
+void process_init(void)
 {
-  char *fn_copy;
-  tid_t tid;
+  lock_init_named(&elf_cache_lock, "elf cache");
+}
 
-  /* Make a copy of FILE_NAME.
-     Otherwise there's a race between the caller and load(). */
-  fn_copy = palloc_get_page(0);
-  if (fn_copy == NULL)
-    return TID_ERROR;
-  strlcpy(fn_copy, file_name, PGSIZE);
+/* A new process's arguments, laid out by process_execute() or
+   process_execv() as they will sit at the top of its user stack:
+   the strings, then argv[], argv, argc and a null return address.
+   The structure heads a page whose last SIZE bytes are that image,
+   so start_process() sets up the stack with one copy.  Until
+   args_finish(), OFS[I] is how far below the page's end the I'th
+   string starts, and the strings grow down from there. */
+struct exec_args
+{
+  const char *file;  /* Executable to load. */
+  bool wait;         /* Parent waits for the load to finish. */
+  int fd_cnt;        /* Files to open in the child. */
+  int fds[SPAWN_FD_MAX];               /* Descriptor for each. */
+  struct file *files[SPAWN_FD_MAX];    /* Reopened by the parent. */
+  size_t size;       /* Bytes of stack image, or of strings so far. */
+  int argc;          /* Strings so far. */
+  uint32_t ofs[];    /* Offset of each string from the end. */
+};
 
-  char *save_ptr;
-  char *token = strtok_r(file_name, " ", &save_ptr);
+/* Returns a page for a new process's arguments, or a null pointer
+   if memory is short. */
+static struct exec_args *
+args_create(void)
+{
+  struct exec_args *args = palloc_get_page(0);
 
-  if (filesys_open(token) == NULL)
+  if (args != NULL)
   {
-    palloc_free_page(fn_copy);
-    return -1;
+    args->wait = true;
+    args->fd_cnt = 0;
+    args->size = 0;
+    args->argc = 0;
+  }
+  return args;
+}
+
+/* Closes the files in ARGS and frees it. */
+static void
+args_destroy(struct exec_args *args)
+{
+  int i;
+
+  for (i = 0; i < args->fd_cnt; i++)
+    file_close(args->files[i]);
+  palloc_free_page(args);
+}
+
+/* Returns the free bytes between ARGS's offsets and its strings. */
+static size_t
+args_room(const struct exec_args *args)
+{
+  size_t used = args->size + offsetof(struct exec_args, ofs[args->argc + 1]);
+  return used < PGSIZE ? PGSIZE - used : 0;
+}
+
+/* Appends the LEN bytes at S, and a null, as the next argument.
+   Returns false if the page is full. */
+static bool
+args_push(struct exec_args *args, const char *s, size_t len)
+{
+  if (len + 1 > args_room(args))
+    return false;
+  args->size += len + 1;
+  args->ofs[args->argc++] = args->size;
+  memmove((char *)args + PGSIZE - args->size, s, len);
+  ((char *)args)[PGSIZE - args->size + len] = '\0';
+  return true;
+}
+
+/* Appends the user string USTR as the next argument.  Returns false
+   if the page is full.  A bad pointer kills the process. */
+static bool
+args_push_user(struct exec_args *args, const char *ustr)
+{
+  char *dst = (char *)&args->ofs[args->argc + 1];
+  size_t room = args_room(args);
+  int len;
+
+  len = strncpy_from_user(dst, ustr, room);
+  if (len < 0)
+  {
+    args_destroy(args);
+    exit(-1);
   }
+  return (size_t)len < room && args_push(args, dst, len);
+}
+
+/* Lays argv[], argv, argc and the return address out below the
+   strings, completing the stack image.  Returns false if they do
+   not fit. */
+static bool
+args_finish(struct exec_args *args)
+{
+  size_t strings = ROUND_UP(args->size, sizeof(uint32_t));
+  size_t size = strings + (args->argc + 4) * sizeof(uint32_t);
+  uint8_t *end = (uint8_t *)args + PGSIZE;
+  uint32_t *image = (uint32_t *)(end - size);
+  int i;
+
+  if (size > PGSIZE - offsetof(struct exec_args, ofs[args->argc]))
+    return false;
+  memset(end - strings, 0, strings - args->size);
+  image[0] = 0;
+  image[1] = args->argc;
+  image[2] = (uint32_t)PHYS_BASE - size + 3 * sizeof(uint32_t);
+  for (i = 0; i < args->argc; i++)
+    image[3 + i] = (uint32_t)PHYS_BASE - args->ofs[i];
+  image[3 + args->argc] = 0;
+  args->size = size;
+  return true;
+}
 
-  /* Create a new thread to execute FILE_NAME. */
+/* Starts a thread running ARGS->file with the arguments in ARGS,
+   which it frees.  Returns the new process's thread id, or
+   TID_ERROR if the thread cannot be created. */
+static tid_t
+start_exec(struct exec_args *args)
+{
   struct thread *cur = thread_current();
-  tid = thread_create(token, PRI_DEFAULT, start_process, fn_copy);
-  sema_down(&cur->exec_lock);
+  struct file *file;
+  bool wait_load;
+  tid_t tid;
 
+  if (!args_finish(args))
+  {
+    args_destroy(args);
+    return TID_ERROR;
+  }
+  /* Fail now if there is no such program. */
+  file = filesys_open(args->file);
+  if (file == NULL)
+  {
+    args_destroy(args);
+    return TID_ERROR;
+  }
+  file_close(file);
+
+  wait_load = args->wait;
+  tid = thread_create(args->file, PRI_DEFAULT, start_process, args);
   if (tid == TID_ERROR)
   {
-    palloc_free_page(fn_copy);
+    args_destroy(args);
+    return TID_ERROR;
   }
+  if (!wait_load)
+    return tid;
+  sema_down(&cur->exec_lock);
 
   struct list_elem *e = NULL;
   struct thread *child_temp = NULL;
@@ -70,14 +224,122 @@ tid_t process_execute(const char *file_name)
   return tid;
 }
 
+/* Starts a new thread running a user program, loaded from the
+   first word of CMD_LINE, with the words of CMD_LINE as its
+   arguments.  The new thread may be scheduled (and may even exit)
+   before process_execute() returns.  Returns the new process's
+   thread id, or TID_ERROR if the thread cannot be created. */
+tid_t process_execute(const char *cmd_line)
+{
+  struct exec_args *args = args_create();
+  const char *p = cmd_line;
+
+  if (args == NULL)
+    return TID_ERROR;
+  for (;;)
+  {
+    const char *word;
+
+    while (*p == ' ')
+      p++;
+    if (*p == '\0')
+      break;
+    for (word = p; *p != ' ' && *p != '\0'; p++)
+      continue;
+    if (!args_push(args, word, p - word))
+    {
+      args_destroy(args);
+      return TID_ERROR;
+    }
+  }
+  if (args->argc == 0)
+  {
+    args_destroy(args);
+    return TID_ERROR;
+  }
+  args->file = (char *)args + PGSIZE - args->ofs[0];
+  return start_exec(args);
+}
+
+/* Starts a new thread running the program named by user string
+   UFILE with the arguments in the null-terminated user array UARGV,
+   or none if UARGV is null.  Returns as process_execute() does.  A
+   bad pointer kills the process. */
+tid_t process_execv(const char *ufile, char *const uargv[])
+{
+  return process_spawn(ufile, uargv, NULL, 0, true);
+}
+
+/* Like process_execv(), but also gives the child, as descriptor
+   FDS[I].child_fd, a copy of each FDS[I].parent_fd of the current
+   process, for I < FD_CNT.  Unless WAIT_LOAD, returns as soon as the
+   child exists, without waiting for its load; then only wait()
+   tells whether it succeeded. */
+tid_t process_spawn(const char *ufile, char *const uargv[],
+                    const struct spawn_fd *fds, int fd_cnt,
+                    bool wait_load)
+{
+  struct exec_args *args;
+  char *uarg;
+
+  if (fd_cnt < 0 || fd_cnt > SPAWN_FD_MAX)
+    return TID_ERROR;
+  args = args_create();
+  if (args == NULL)
+    return TID_ERROR;
+  args->wait = wait_load;
+  for (; args->fd_cnt < fd_cnt; args->fd_cnt++)
+  {
+    const struct spawn_fd *fd = &fds[args->fd_cnt];
+    struct file *parent_file = fd_lookup(fd->parent_fd);
+    struct file *file;
+
+    if (parent_file == NULL || fd->child_fd < 0
+        || (file = file_reopen(parent_file)) == NULL)
+    {
+      args_destroy(args);
+      return TID_ERROR;
+    }
+    file_seek(file, file_tell(parent_file));
+    args->fds[args->fd_cnt] = fd->child_fd;
+    args->files[args->fd_cnt] = file;
+  }
+
+  /* The name goes at the very top of the stack, above argv[0]. */
+  if (!args_push_user(args, ufile))
+  {
+    args_destroy(args);
+    return TID_ERROR;
+  }
+  args->file = (char *)args + PGSIZE - args->ofs[0];
+  args->argc = 0;
+  for (; uargv != NULL; uargv++)
+  {
+    if (!copy_from_user(&uarg, uargv, sizeof uarg))
+    {
+      args_destroy(args);
+      exit(-1);
+    }
+    if (uarg == NULL)
+      break;
+    if (!args_push_user(args, uarg))
+    {
+      args_destroy(args);
+      return TID_ERROR;
+    }
+  }
+  return start_exec(args);
+}
+
 /* A thread function that loads a user process and starts it
    running. */
 static void
-start_process(void *file_name_)
+start_process(void *args_)
 {
-  char *file_name = file_name_;
+  struct exec_args *args = args_;
+  struct thread *cur = thread_current();
   struct intr_frame if_;
-  bool success;
+  bool success, wait_load;
 
   /* Initialize interrupt frame and load executable. */
   memset(&if_, 0, sizeof if_);
@@ -85,49 +347,31 @@ start_process(void *file_name_)
   if_.cs = SEL_UCSEG;
   if_.eflags = FLAG_IF | FLAG_MBS;
 
-  // parse to token
-  char file_name_use[128];
-
-  strlcpy(file_name_use, file_name, strlen(file_name) + 1);
-  int num_token = 0;
-  char *token, *save_ptr;
-
-  for (token = strtok_r(file_name_use, " ", &save_ptr); token != NULL; token = strtok_r(NULL, " ", &save_ptr))
-  {
-    num_token++;
-  }
-
-  char **token_array = (char **)malloc(sizeof(char *) * num_token);
-  strlcpy(file_name_use, file_name, strlen(file_name) + 1);
-  int i = 0;
-
-  for (token = strtok_r(file_name_use, " ", &save_ptr); token != NULL; token = strtok_r(NULL, " ", &save_ptr))
+  success = inherit_cwd(cur->parent->leader)
+            && load(args->file, &if_.eip, &if_.esp);
+  if (success)
   {
-    token_array[i] = token;
-    i++;
+    uint8_t *image = (uint8_t *)args + PGSIZE - args->size;
+    if_.esp = (uint8_t *)PHYS_BASE - args->size;
+    success = copy_to_user(if_.esp, image, args->size);
   }
-
-  success = load(token_array[0], &if_.eip, &if_.esp);
-  struct thread *cur = thread_current();
-  if (success)
+  while (success && args->fd_cnt > 0)
   {
-    argument_stack(token_array, num_token, &if_.esp);
-    free(token_array);
+    int i = args->fd_cnt - 1;
+    success = fd_install_at(args->fds[i], args->files[i]);
+    if (success)
+      args->fd_cnt = i;
   }
 
-  palloc_free_page(file_name);
-  // wake-up the sema_down while loop in process execute
-  sema_up(&cur->parent->exec_lock);
+  wait_load = args->wait;
+  args_destroy(args);
+  if (wait_load)
+    sema_up(&cur->parent->exec_lock);
 
   /* If load failed, quit. */
   if (!success)
-  {
-    // free(file_name_use);
-    free(token_array);
     exit(-1);
-  }
 
-  // hex_dump(if_.esp, if_.esp, PHYS_BASE - if_.esp, true);
   /* Start the user process by simulating a return from an
      interrupt, implemented by intr_exit (in
      threads/intr-stubs.S).  Because intr_exit takes all of its
@@ -138,56 +382,115 @@ start_process(void *file_name_)
   NOT_REACHED();
 }
 
-void argument_stack(char **parse, int count, void **esp)
+/* Arguments to start_fork(). */
+struct fork_args
 {
+  struct thread *parent;  /* Process being forked. */
+  struct intr_frame if_;  /* Its user registers at the system call. */
+  bool success;           /* Set by the child once it is set up. */
+};
 
-  int stack_len = 0;
-  int token_len;
+/* Creates a child of the current process with a copy of its
+   address space and open files, which returns 0 from the system
+   call that the current process is in.  Returns the child's
+   thread id, or TID_ERROR if it could not be set up. */
+tid_t process_fork(void)
+{
+  struct thread *cur = thread_current();
+  struct fork_args args;
+  tid_t tid;
 
-  for (int i = count - 1; i >= 0; i--)
-  {
-    token_len = strlen(parse[i]) + 1;
-    stack_len += token_len;
-    *esp -= token_len;
-    strlcpy(*esp, parse[i], token_len);
-    parse[i] = *esp;
-  }
+  /* A system call from user mode saves the user registers at the
+     top of the kernel stack. */
+  args.parent = cur;
+  args.if_ = ((struct intr_frame *)thread_stack_top(cur))[-1];
+  args.success = false;
 
-  // 4Byte align
-  if (stack_len % 4 != 0)
+  tid = thread_create(cur->name, PRI_DEFAULT, start_fork, &args);
+  if (tid == TID_ERROR)
+    return TID_ERROR;
+  sema_down(&cur->exec_lock);
+  if (!args.success)
   {
-    int align = 4 - (stack_len % 4);
-    for (int i = 0; i < align; i++)
-    {
-      *esp -= sizeof(unsigned char);
-      **(unsigned char **)esp = 0;
-    }
+    process_wait(tid);
+    return TID_ERROR;
   }
+  return tid;
+}
 
-  // push null
-  *esp -= 4;
-  *(uint32_t *)*esp = 0;
+/* A thread function that copies the process that forked it and
+   returns to user mode where it made the system call. */
+static void
+start_fork(void *args_)
+{
+  struct fork_args *args = args_;
+  struct thread *parent = args->parent;
+  struct intr_frame if_ = args->if_;
 
-  // push address parse[i]
-  for (int i = count - 1; i >= 0; i--)
+  args->success = duplicate_process(parent);
+  if (!args->success)
   {
-    *esp -= 4;
-    *(uint32_t *)*esp = parse[i];
+    sema_up(&parent->exec_lock);
+    exit(-1);
   }
+  sema_up(&parent->exec_lock);
 
-  char *addr_parse = *esp;
+  if_.eax = 0;
+  asm volatile("movl %0, %%esp; jmp intr_exit" : : "g"(&if_) : "memory");
+  NOT_REACHED();
+}
 
-  // push address parse
-  *esp -= 4;
-  *(uint32_t *)*esp = addr_parse;
+/* Gives the current process the working directory of PARENT's
+   process.  Returns false if memory is short. */
+static bool
+inherit_cwd(struct thread *parent)
+{
+  struct thread *t = thread_current();
 
-  // push num_token
-  *esp -= 4;
-  *(uint32_t *)*esp = count;
+  lock_acquire(&parent->proc_lock);
+  t->cwd = dir_reopen(parent->cwd);
+  lock_release(&parent->proc_lock);
+  return t->cwd != NULL || parent->cwd == NULL;
+}
 
-  // push fake return address
-  *esp -= 4;
-  *(uint32_t *)*esp = 0;
+/* Gives the current thread a copy of the address space and open
+   files of PARENT's process.  Under VM, pages are shared
+   copy-on-write.  Whatever was set up before a failure is freed by
+   process_exit(). */
+static bool
+duplicate_process(struct thread *parent)
+{
+  struct thread *t = thread_current();
+  bool success;
+
+  t->pagedir = pagedir_create();
+  if (t->pagedir == NULL)
+    return false;
+#ifdef VM
+  if (!spt_init(&t->suppl_page_table))
+    return false;
+#endif
+  process_activate();
+
+  /* Keep PARENT's other threads from changing what we copy. */
+  parent = parent->leader;
+  lock_acquire(&parent->proc_lock);
+#ifdef VM
+  t->exec_file = file_reopen(parent->exec_file);
+  success = t->exec_file != NULL;
+  if (success)
+  {
+    file_deny_write(t->exec_file);
+    success = vm_fork(parent);
+  }
+#else
+  success = pagedir_copy(t->pagedir, parent->pagedir);
+#endif
+  success = success && fd_duplicate(parent);
+  signal_inherit(parent);
+  lock_release(&parent->proc_lock);
+  success = success && inherit_cwd(parent);
+  return success;
 }
 
 /* Waits for thread TID to die and returns its exit status.  If
@@ -195,41 +498,393 @@ void argument_stack(char **parse, int count, void **esp)
    exception), returns -1.  If TID is invalid or if it was not a
    child of the calling process, or if process_wait() has already
    been successfully called for the given TID, returns -1
-   immediately, without waiting.
+   immediately, without waiting. */
+int process_wait(tid_t child_tid)
+{
+  int status;
+
+  if (child_tid < 0 || process_waitpid(child_tid, &status, 0) != child_tid)
+    return -1;
+  return status;
+}
 
-   This function will be implemented in problem 2-2.  For now, it
-   does nothing. */
-int process_wait(tid_t child_tid UNUSED)
+/* Waits for child CHILD_TID, or for any child if CHILD_TID is -1,
+   to exit, reaps it and stores its exit status in *STATUS.
+   Returns the tid reaped, 0 if WNOHANG is in OPTIONS and no such
+   child has exited yet, or -1 if there is no such child.
+   Children are reaped in the order they exit. */
+tid_t process_waitpid(tid_t child_tid, int *status, int options)
 {
   struct thread *cur = thread_current();
-  struct list_elem *e = NULL;
-  struct thread *child_temp = NULL;
-  int exit_status;
 
-  for (e = list_begin(&(cur->child)); e != list_end(&(cur->child)); e = list_next(e))
+  return reap(cur, &cur->child, &cur->exited_child, child_tid, status,
+              options);
+}
+
+/* Reaps thread TID from LIVE, or the first thread on EXITED if TID
+   is -1, once it has exited, and stores its exit status in *STATUS.
+   LIVE holds threads by child_elem, including those on EXITED, and
+   both are guarded by OWNER's wait_lock.  Returns the tid reaped,
+   0 if WNOHANG is in OPTIONS and it has not exited yet, or -1 if
+   there is no such thread. */
+static tid_t
+reap(struct thread *owner, struct list *live, struct list *exited,
+     tid_t tid, int *status, int options)
+{
+  struct thread *t;
+
+  lock_acquire(&owner->wait_lock);
+  for (;;)
   {
-    child_temp = list_entry(e, struct thread, child_elem);
-    if (child_tid == child_temp->tid)
+    t = NULL;
+    if (tid != -1)
+    {
+      struct list_elem *e;
+
+      for (e = list_begin(live); e != list_end(live); e = list_next(e))
+        if (list_entry(e, struct thread, child_elem)->tid == tid)
+        {
+          t = list_entry(e, struct thread, child_elem);
+          break;
+        }
+      if (t == NULL || t->exited)
+        break;
+    }
+    else if (!list_empty(exited))
     {
-      sema_down(&(child_temp->child_lock));
-      exit_status = child_temp->exit_status;
-      list_remove(&(child_temp->child_elem));
-      sema_up(&(child_temp->memory_lock));
-      return exit_status;
+      t = list_entry(list_front(exited), struct thread, exited_elem);
+      break;
     }
+    else if (list_empty(live))
+      break;
+
+    if (options & WNOHANG)
+    {
+      lock_release(&owner->wait_lock);
+      return 0;
+    }
+    cond_wait(&owner->child_exited, &owner->wait_lock);
+  }
+  if (t == NULL)
+  {
+    lock_release(&owner->wait_lock);
+    return -1;
+  }
+  list_remove(&t->exited_elem);
+  list_remove(&t->child_elem);
+
+  /* Keep T's resource usage for getrusage().  A child process has
+     reaped its own threads by now. */
+  if (live == &owner->uthreads)
+    usage_add(&owner->exited_usage, &t->usage);
+  else
+  {
+    usage_add(&owner->child_usage, &t->usage);
+    usage_add(&owner->child_usage, &t->exited_usage);
+    usage_add(&owner->child_usage, &t->child_usage);
+    owner->child_minor_faults += t->vm_minor_faults + t->child_minor_faults;
+    owner->child_major_faults += t->vm_major_faults + t->child_major_faults;
+  }
+  lock_release(&owner->wait_lock);
+
+  /* T is gone once it is let go, so read it first. */
+  *status = t->exit_status;
+  tid = t->tid;
+  sema_up(&t->memory_lock);
+  return tid;
+}
+
+/* Queues the current thread on EXITED, guarded by OWNER's
+   wait_lock, so that OWNER may reap it.  Its exit status must be
+   final.  The thread lives on until it waits on its memory_lock. */
+static void
+publish_exit(struct thread *owner, struct list *exited)
+{
+  struct thread *cur = thread_current();
+
+  lock_acquire(&owner->wait_lock);
+  cur->exited = true;
+  list_push_back(exited, &cur->exited_elem);
+  cond_broadcast(&owner->child_exited, &owner->wait_lock);
+  lock_release(&owner->wait_lock);
+}
+
+/* Queues the current thread on EXITED, guarded by OWNER's
+   wait_lock, and waits until it is reaped. */
+static void
+wait_to_be_reaped(struct thread *owner, struct list *exited)
+{
+  publish_exit(owner, exited);
+  sema_down(&thread_current()->memory_lock);
+}
+
+/* Returns the leader of the current thread's process, which holds
+   its address space and open files. */
+struct thread *
+process_current(void)
+{
+  return thread_current()->leader;
+}
+
+#ifdef VM
+/* Arguments to start_uthread(). */
+struct uthread_args
+{
+  struct thread *creator; /* Thread that made the call. */
+  void *start;            /* User code to run... */
+  void *func, *arg;       /* ...and its arguments. */
+  bool success;           /* Set by the thread once it is set up. */
+};
+
+/* Creates a thread in the current process that runs START (FUNC,
+   ARG) in user mode, on a stack of its own.  Returns its thread id,
+   or TID_ERROR if it could not be set up. */
+tid_t process_thread_create(void *start, void *func, void *arg)
+{
+  struct thread *cur = thread_current();
+  struct uthread_args args;
+  tid_t tid;
+
+  args.creator = cur;
+  args.start = start;
+  args.func = func;
+  args.arg = arg;
+  args.success = false;
+
+  tid = thread_create(cur->leader->name, PRI_DEFAULT, start_uthread, &args);
+  if (tid == TID_ERROR)
+    return TID_ERROR;
+  sema_down(&cur->exec_lock);
+  if (!args.success)
+  {
+    process_thread_join(tid);
+    return TID_ERROR;
+  }
+  return tid;
+}
+
+/* Arguments to start_kthread(). */
+struct kthread_args
+{
+  struct thread *creator; /* Thread that made the call. */
+  thread_func *func;      /* Function to run... */
+  void *aux;              /* ...and its argument. */
+};
+
+/* Creates a thread in the current process that runs FUNC (AUX) in
+   the kernel, with the process's address space and open files, and
+   ends when FUNC returns.  The process's exit waits for it, like
+   for a user thread.  Returns its thread id, or TID_ERROR. */
+tid_t process_kthread_create(thread_func *func, void *aux)
+{
+  struct thread *cur = thread_current();
+  struct kthread_args args;
+  tid_t tid;
+
+  args.creator = cur;
+  args.func = func;
+  args.aux = aux;
+
+  tid = thread_create(cur->leader->name, PRI_DEFAULT, start_kthread, &args);
+  if (tid != TID_ERROR)
+    sema_down(&cur->exec_lock);
+  return tid;
+}
+
+/* A thread function that joins the process of the thread that
+   created it and runs the function given there. */
+static void
+start_kthread(void *args_)
+{
+  struct kthread_args *args = args_;
+  thread_func *func = args->func;
+  void *aux = args->aux;
+
+  join_process(args->creator);
+  sema_up(&args->creator->exec_lock);
+  func(aux);
+  thread_exit();
+}
+
+/* Moves the current thread, just created by CREATOR, from
+   CREATOR's children to the threads of CREATOR's process, and
+   switches to the process's address space.  CREATOR must be
+   waiting for us, so that its list is not in use. */
+static void
+join_process(struct thread *creator)
+{
+  struct thread *cur = thread_current();
+  struct thread *leader = creator->leader;
+
+  cur->leader = leader;
+  list_remove(&cur->child_elem);
+  lock_acquire(&leader->wait_lock);
+  list_push_back(&leader->uthreads, &cur->child_elem);
+  lock_release(&leader->wait_lock);
+  cur->pagedir = leader->pagedir;
+  process_activate();
+}
+
+/* A thread function that joins the process of the thread that
+   created it and enters user mode there. */
+static void
+start_uthread(void *args_)
+{
+  struct uthread_args *args = args_;
+  struct thread *creator = args->creator;
+  struct intr_frame if_;
+  uint32_t frame[3];
+  bool success;
+
+  join_process(creator);
+
+  memset(&if_, 0, sizeof if_);
+  if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
+  if_.cs = SEL_UCSEG;
+  if_.eflags = FLAG_IF | FLAG_MBS;
+  if_.eip = args->start;
+
+  /* Call START (FUNC, ARG) with a null return address. */
+  frame[0] = 0;
+  frame[1] = (uint32_t)args->func;
+  frame[2] = (uint32_t)args->arg;
+  success = setup_thread_stack(&if_.esp);
+  if (success)
+  {
+    if_.esp = (uint8_t *)if_.esp - sizeof frame;
+    success = copy_to_user(if_.esp, frame, sizeof frame);
   }
-  return -1;
+  args->success = success;
+  sema_up(&creator->exec_lock);
+  if (!success)
+    thread_exit();
+
+  asm volatile("movl %0, %%esp; jmp intr_exit" : : "g"(&if_) : "memory");
+  NOT_REACHED();
 }
 
-/* Free the current process's resources. */
+/* Gives the current user thread a stack slot of its own, with its
+   top page present, and points *ESP at its top.  A slot that was
+   used before keeps its pages.  Returns false if every slot is
+   taken or memory is short. */
+static bool
+setup_thread_stack(void **esp)
+{
+  struct thread *cur = thread_current();
+  struct thread *leader = cur->leader;
+  uint8_t *top;
+  bool success = true;
+  int slot;
+
+  lock_acquire(&leader->proc_lock);
+  for (slot = 1; slot < THREAD_STACK_CNT; slot++)
+    if (!(leader->stack_slots & (1u << slot)))
+      break;
+  if (slot == THREAD_STACK_CNT)
+  {
+    lock_release(&leader->proc_lock);
+    return false;
+  }
+
+  top = (uint8_t *)PHYS_BASE - slot * THREAD_STACK_SIZE;
+  if (get_suppl_pte(&leader->suppl_page_table, top - PGSIZE) == NULL)
+    success = grow_stack(top - PGSIZE);
+  if (success)
+  {
+    leader->stack_slots |= 1u << slot;
+    cur->stack_slot = slot;
+    *esp = top;
+  }
+  lock_release(&leader->proc_lock);
+  return success;
+}
+#endif
+
+/* Waits for thread TID of the current process to exit.  Returns
+   0, or -1 if TID is not another thread of the current process or
+   has already been joined. */
+int process_thread_join(tid_t tid)
+{
+  struct thread *leader = process_current();
+  int status;
+
+  if (tid < 0 || tid == thread_current()->tid)
+    return -1;
+  return reap(leader, &leader->uthreads, &leader->exited_uthreads, tid,
+              &status, 0) == tid
+             ? 0
+             : -1;
+}
+
+/* Ends the current user thread, leaving the address space and open
+   files to the rest of its process. */
+static void
+exit_uthread(void)
+{
+  struct thread *cur = thread_current();
+  struct thread *leader = cur->leader;
+
+  if (cur->stack_slot != 0)
+  {
+    lock_acquire(&leader->proc_lock);
+    leader->stack_slots &= ~(1u << cur->stack_slot);
+    lock_release(&leader->proc_lock);
+  }
+  cur->pagedir = NULL;
+  pagedir_activate(NULL);
+  wait_to_be_reaped(leader, &leader->exited_uthreads);
+}
+
+/* Free the current process's resources.  Whatever the parent may
+   observe, such as mapped files written back and the executable
+   open for writing again, is done before the exit status is
+   published; the page directory, frames and swap slots, which take
+   time in proportion to the process's size, are freed after, so that
+   the parent's wait() does not wait for them. */
 void process_exit(void)
 {
   struct thread *cur = thread_current();
   uint32_t *pd;
+  int status;
+
+  if (cur != cur->leader)
+  {
+    exit_uthread();
+    return;
+  }
+
+  /* The other threads of the process go first. */
+  cur->dying = true;
+#ifdef VM
+  vm_ring_stop(cur);
+#endif
+  while (reap(cur, &cur->uthreads, &cur->exited_uthreads, -1, &status, 0)
+         != -1)
+    continue;
+  if (process_print_usage && cur->pagedir != NULL)
+    print_usage(cur);
+
+  pd = cur->pagedir;
+#ifdef VM
+  /* Mapped files are written back first. */
+  if (pd != NULL)
+  {
+    vm_munmap_all();
+    vm_shm_exit(cur);
+    vm_ring_exit(cur);
+    vm_print_process_stats();
+  }
+  if (cur->exec_file != NULL)
+    file_allow_write(cur->exec_file);
+#endif
+  fd_close_all();
+  dir_close(cur->cwd);
+  cur->cwd = NULL;
+
+  publish_exit(cur->parent, &cur->parent->exited_child);
 
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
-  pd = cur->pagedir;
   if (pd != NULL)
   {
     /* Correct ordering here is crucial.  We must set
@@ -239,19 +894,113 @@ void process_exit(void)
        directory before destroying the process's page
        directory, or our active page directory will be one
        that's been freed (and cleared). */
+#ifdef VM
+    /* The rest of the address space goes while the page directory
+       is still valid. */
+    free_suppl_pt(&cur->suppl_page_table);
+    vm_swap_exit(cur);
+#endif
     cur->pagedir = NULL;
     pagedir_activate(NULL);
     pagedir_destroy(pd);
   }
+#ifdef VM
+  file_close(cur->exec_file);
+  cur->exec_file = NULL;
+#endif
 
-  int fd;
-  for (int i = 2; i < cur->next_fd; i++)
+  sema_down(&cur->memory_lock);
+}
+
+/* Adds the counts in B to those in A. */
+static void
+usage_add(struct thread_usage *a, const struct thread_usage *b)
+{
+  a->user_ticks += b->user_ticks;
+  a->sys_ticks += b->sys_ticks;
+  a->vol_switches += b->vol_switches;
+  a->invol_switches += b->invol_switches;
+  a->sectors_read += b->sectors_read;
+  a->sectors_written += b->sectors_written;
+}
+
+/* Stores in *U the resource usage of process LEADER's threads, the
+   live ones and those reaped. */
+static void
+process_usage(struct thread *leader, struct thread_usage *u)
+{
+  struct list_elem *e;
+  enum intr_level old_level;
+
+  lock_acquire(&leader->wait_lock);
+
+  /* The timer interrupt updates the tick counts. */
+  old_level = intr_disable();
+  *u = leader->exited_usage;
+  usage_add(u, &leader->usage);
+  for (e = list_begin(&leader->uthreads); e != list_end(&leader->uthreads);
+       e = list_next(e))
+    usage_add(u, &list_entry(e, struct thread, child_elem)->usage);
+  intr_set_level(old_level);
+  lock_release(&leader->wait_lock);
+}
+
+/* Stores in *RU the resource usage of the current process if WHO
+   is RUSAGE_SELF, of its children that have been waited for and
+   their descendants if it is RUSAGE_CHILDREN, or of the current
+   thread if it is RUSAGE_THREAD.  Page faults are only counted per
+   process, so RUSAGE_THREAD reports those of the process.  Returns
+   false if WHO is none of these. */
+bool process_getrusage(int who, struct rusage *ru)
+{
+  struct thread *leader = process_current();
+  struct thread_usage u;
+  enum intr_level old_level;
+
+  ru->minflt = leader->vm_minor_faults;
+  ru->majflt = leader->vm_major_faults;
+  if (who == RUSAGE_SELF)
+    process_usage(leader, &u);
+  else if (who == RUSAGE_THREAD)
+  {
+    old_level = intr_disable();
+    u = thread_current()->usage;
+    intr_set_level(old_level);
+  }
+  else if (who == RUSAGE_CHILDREN)
   {
-    file_close(cur->fdt[i]);
+    lock_acquire(&leader->wait_lock);
+    u = leader->child_usage;
+    ru->minflt = leader->child_minor_faults;
+    ru->majflt = leader->child_major_faults;
+    lock_release(&leader->wait_lock);
   }
+  else
+    return false;
+
+  ru->utime = u.user_ticks;
+  ru->stime = u.sys_ticks;
+  ru->nvcsw = u.vol_switches;
+  ru->nivcsw = u.invol_switches;
+  ru->inblock = u.sectors_read;
+  ru->oublock = u.sectors_written;
+  return true;
+}
 
-  sema_up(&(cur->child_lock));
-  sema_down(&(cur->memory_lock));
+/* Prints the resource usage of exiting process LEADER, whose other
+   threads have been reaped. */
+static void
+print_usage(struct thread *leader)
+{
+  struct thread_usage u;
+
+  process_usage(leader, &u);
+  printf("%s: rusage: %" PRId64 " user, %" PRId64 " system ticks, "
+         "%u voluntary, %u involuntary switches, %u minor, %u major "
+         "faults, %u sectors read, %u written\n",
+         leader->name, u.user_ticks, u.sys_ticks, u.vol_switches,
+         u.invol_switches, leader->vm_minor_faults, leader->vm_major_faults,
+         u.sectors_read, u.sectors_written);
 }
 
 /* Sets up the CPU for running user code in the current
@@ -332,46 +1081,104 @@ struct Elf32_Phdr
 #define PF_W 2 /* Writable. */
 #define PF_R 4 /* Readable. */
 
+/* A PT_LOAD segment, in the form load_segment() takes. */
+struct elf_segment
+{
+  off_t file_page;
+  uint8_t *mem_page;
+  uint32_t read_bytes;
+  uint32_t zero_bytes;
+  bool writable;
+};
+
+/* Parsed and validated layout of an executable, so that repeated
+   execs of one binary skip reading and checking its headers. */
+struct elf_image
+{
+  struct inode *inode;      /* Executable, held open while cached. */
+  unsigned version;         /* inode_version() when it was parsed. */
+  int ref_cnt;              /* Cache slot plus loads using it. */
+  void (*entry)(void);      /* Entry point. */
+  int seg_cnt;              /* Number of loadable segments. */
+  struct elf_segment segs[]; /* Loadable segments. */
+};
+
+/* Most recently used images, newest first. */
+#define ELF_CACHE_SIZE 16
+static struct elf_image *elf_cache[ELF_CACHE_SIZE];
+
 static bool setup_stack(void **esp);
 static bool validate_segment(const struct Elf32_Phdr *, struct file *);
 static bool load_segment(struct file *file, off_t ofs, uint8_t *upage,
                          uint32_t read_bytes, uint32_t zero_bytes,
                          bool writable);
 
-/* Loads an ELF executable from FILE_NAME into the current thread.
-   Stores the executable's entry point into *EIP
-   and its initial stack pointer into *ESP.
-   Returns true if successful, false otherwise. */
-bool load(const char *file_name, void (**eip)(void), void **esp)
+/* Drops a reference to IMAGE, freeing it if it was the last. */
+static void
+elf_image_put(struct elf_image *image)
 {
-  struct thread *t = thread_current();
-  struct Elf32_Ehdr ehdr;
-  struct file *file = NULL;
-  off_t file_ofs;
-  bool success = false;
-  int i;
+  bool last;
 
-  /* Allocate and activate page directory. */
-  t->pagedir = pagedir_create();
-  if (t->pagedir == NULL)
-    goto done;
-  process_activate();
-
-  /* Open executable file. */
-  file = filesys_open(file_name);
-  if (file == NULL)
+  lock_acquire(&elf_cache_lock);
+  last = --image->ref_cnt == 0;
+  lock_release(&elf_cache_lock);
+  if (last)
   {
-    printf("load: %s: open failed\n", file_name);
-    goto done;
+    inode_close(image->inode);
+    free(image);
   }
+}
+
+/* Removes cache slot I, moving the slots after it up.
+   Returns the image that was there, whose cache reference the
+   caller must drop.  Must be called with elf_cache_lock held. */
+static struct elf_image *
+elf_cache_take(int i)
+{
+  struct elf_image *image = elf_cache[i];
+
+  memmove(elf_cache + i, elf_cache + i + 1,
+          (ELF_CACHE_SIZE - i - 1) * sizeof *elf_cache);
+  elf_cache[ELF_CACHE_SIZE - 1] = NULL;
+  return image;
+}
+
+/* Puts IMAGE in the first cache slot.  The last slot must be free.
+   Must be called with elf_cache_lock held. */
+static void
+elf_cache_push(struct elf_image *image)
+{
+  ASSERT(elf_cache[ELF_CACHE_SIZE - 1] == NULL);
+  memmove(elf_cache + 1, elf_cache,
+          (ELF_CACHE_SIZE - 1) * sizeof *elf_cache);
+  elf_cache[0] = image;
+}
+
+/* Reads and validates the headers of executable FILE, named
+   FILE_NAME, and returns its layout, or a null pointer if it is
+   not a loadable executable or memory is short. */
+static struct elf_image *
+elf_image_parse(struct file *file, const char *file_name)
+{
+  struct elf_image *image;
+  struct Elf32_Ehdr ehdr;
+  off_t file_ofs;
+  int i;
 
   /* Read and verify executable header. */
+  file_seek(file, 0);
   if (file_read(file, &ehdr, sizeof ehdr) != sizeof ehdr || memcmp(ehdr.e_ident, "\177ELF\1\1\1", 7) || ehdr.e_type != 2 || ehdr.e_machine != 3 || ehdr.e_version != 1 || ehdr.e_phentsize != sizeof(struct Elf32_Phdr) || ehdr.e_phnum > 1024)
   {
     printf("load: %s: error loading executable\n", file_name);
-    goto done;
+    return NULL;
   }
 
+  image = malloc(sizeof *image + ehdr.e_phnum * sizeof *image->segs);
+  if (image == NULL)
+    return NULL;
+  image->entry = (void (*)(void))ehdr.e_entry;
+  image->seg_cnt = 0;
+
   /* Read program headers. */
   file_ofs = ehdr.e_phoff;
   for (i = 0; i < ehdr.e_phnum; i++)
@@ -379,11 +1186,11 @@ bool load(const char *file_name, void (**eip)(void), void **esp)
     struct Elf32_Phdr phdr;
 
     if (file_ofs < 0 || file_ofs > file_length(file))
-      goto done;
+      goto error;
     file_seek(file, file_ofs);
 
     if (file_read(file, &phdr, sizeof phdr) != sizeof phdr)
-      goto done;
+      goto error;
     file_ofs += sizeof phdr;
     switch (phdr.p_type)
     {
@@ -397,58 +1204,197 @@ bool load(const char *file_name, void (**eip)(void), void **esp)
     case PT_DYNAMIC:
     case PT_INTERP:
     case PT_SHLIB:
-      goto done;
+      goto error;
     case PT_LOAD:
       if (validate_segment(&phdr, file))
       {
-        bool writable = (phdr.p_flags & PF_W) != 0;
-        uint32_t file_page = phdr.p_offset & ~PGMASK;
-        uint32_t mem_page = phdr.p_vaddr & ~PGMASK;
+        struct elf_segment *seg = &image->segs[image->seg_cnt++];
         uint32_t page_offset = phdr.p_vaddr & PGMASK;
-        uint32_t read_bytes, zero_bytes;
+
+        seg->writable = (phdr.p_flags & PF_W) != 0;
+        seg->file_page = phdr.p_offset & ~PGMASK;
+        seg->mem_page = (uint8_t *)(phdr.p_vaddr & ~PGMASK);
         if (phdr.p_filesz > 0)
         {
           /* Normal segment.
              Read initial part from disk and zero the rest. */
-          read_bytes = page_offset + phdr.p_filesz;
-          zero_bytes = (ROUND_UP(page_offset + phdr.p_memsz, PGSIZE) - read_bytes);
+          seg->read_bytes = page_offset + phdr.p_filesz;
+          seg->zero_bytes = (ROUND_UP(page_offset + phdr.p_memsz, PGSIZE) - seg->read_bytes);
         }
         else
         {
           /* Entirely zero.
              Don't read anything from disk. */
-          read_bytes = 0;
-          zero_bytes = ROUND_UP(page_offset + phdr.p_memsz, PGSIZE);
+          seg->read_bytes = 0;
+          seg->zero_bytes = ROUND_UP(page_offset + phdr.p_memsz, PGSIZE);
         }
-        if (!load_segment(file, file_page, (void *)mem_page,
-                          read_bytes, zero_bytes, writable))
-          goto done;
       }
       else
-        goto done;
+        goto error;
       break;
     }
   }
+  return image;
+
+error:
+  free(image);
+  return NULL;
+}
+
+/* Returns the layout of executable FILE, named FILE_NAME, from the
+   cache if it has not been written since it was parsed, or else by
+   parsing it and caching the result.  Returns a null pointer if
+   FILE is not a loadable executable.  The caller must release the
+   image with elf_image_put(). */
+static struct elf_image *
+elf_image_get(struct file *file, const char *file_name)
+{
+  struct inode *inode = file_get_inode(file);
+  struct elf_image *image = NULL;
+  struct elf_image *dropped[ELF_CACHE_SIZE];
+  int drop_cnt = 0;
+  unsigned version;
+  int i;
+
+  /* Look for a current entry, and drop stale and removed ones so
+     they do not keep their inodes open. */
+  lock_acquire(&elf_cache_lock);
+  for (i = 0; i < ELF_CACHE_SIZE && elf_cache[i] != NULL;)
+  {
+    struct elf_image *e = elf_cache[i];
+
+    if (image == NULL && e->inode == inode
+        && e->version == inode_version(inode))
+    {
+      image = elf_cache_take(i);
+      elf_cache_push(image);
+      image->ref_cnt++;
+      i++;
+    }
+    else if (e->inode == inode || inode_is_removed(e->inode))
+      dropped[drop_cnt++] = elf_cache_take(i);
+    else
+      i++;
+  }
+  lock_release(&elf_cache_lock);
+  for (i = 0; i < drop_cnt; i++)
+    elf_image_put(dropped[i]);
+  if (image != NULL)
+    return image;
+
+  /* Parse it.  A write that races with parsing changes the version
+     after we read it, so the result is never mistaken for current. */
+  version = inode_version(inode);
+  image = elf_image_parse(file, file_name);
+  if (image == NULL)
+    return NULL;
+  image->inode = inode_reopen(inode);
+  image->version = version;
+  image->ref_cnt = 2;
+
+  /* Cache it in front, evicting the oldest entry if full. */
+  lock_acquire(&elf_cache_lock);
+  dropped[0] = elf_cache_take(ELF_CACHE_SIZE - 1);
+  elf_cache_push(image);
+  lock_release(&elf_cache_lock);
+  if (dropped[0] != NULL)
+    elf_image_put(dropped[0]);
+  return image;
+}
+
+/* Loads an ELF executable from FILE_NAME into the current thread.
+   Stores the executable's entry point into *EIP
+   and its initial stack pointer into *ESP.
+   Returns true if successful, false otherwise. */
+bool load(const char *file_name, void (**eip)(void), void **esp)
+{
+  struct thread *t = thread_current();
+  struct elf_image *image = NULL;
+  struct file *file = NULL;
+  bool success = false;
+  int i;
+
+  /* Allocate and activate page directory. */
+  t->pagedir = pagedir_create();
+  if (t->pagedir == NULL)
+    goto done;
+#ifdef VM
+  if (!spt_init(&t->suppl_page_table))
+    goto done;
+#endif
+  process_activate();
+
+  /* Open executable file. */
+  file = filesys_open(file_name);
+  if (file == NULL)
+  {
+    printf("load: %s: open failed\n", file_name);
+    goto done;
+  }
+
+  /* Find its layout. */
+  image = elf_image_get(file, file_name);
+  if (image == NULL)
+    goto done;
+
+  /* Load its segments. */
+  for (i = 0; i < image->seg_cnt; i++)
+  {
+    const struct elf_segment *seg = &image->segs[i];
+
+    if (!load_segment(file, seg->file_page, seg->mem_page,
+                      seg->read_bytes, seg->zero_bytes, seg->writable))
+      goto done;
+#ifdef VM
+    /* The heap starts past the last segment. */
+    if (seg->mem_page + seg->read_bytes + seg->zero_bytes > t->heap_start)
+      t->heap_start = t->heap_brk
+        = seg->mem_page + seg->read_bytes + seg->zero_bytes;
+#endif
+  }
+
+#ifdef VM
+  /* Every page is read in when it faults, but the code the process
+     starts with is needed at once, so read it in now. */
+  vm_prefetch(pg_round_down((void *) image->entry), vm_exec_prefetch);
+#endif
 
   /* Set up stack. */
   if (!setup_stack(esp))
     goto done;
 
   /* Start address. */
-  *eip = (void (*)(void))ehdr.e_entry;
+  *eip = image->entry;
 
   success = true;
 
 done:
   /* We arrive here whether the load is successful or not. */
+  if (image != NULL)
+    elf_image_put(image);
 
+#ifdef VM
+  /* Pages are read from the executable on demand, and read-only ones
+     are shared with other processes, so keep it open and unchanged
+     until the process exits. */
+  if (success)
+  {
+    file_deny_write(file);
+    t->exec_file = file;
+  }
+  else
+    file_close(file);
+#else
   file_close(file);
+#endif
   return success;
 }
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page(void *upage, void *kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -526,6 +1472,13 @@ load_segment(struct file *file, off_t ofs, uint8_t *upage,
     size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
     size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+#ifdef VM
+    /* Record where the page comes from; page_fault() reads it in. */
+    if (!suppl_pt_insert_file(file, ofs, upage, page_read_bytes,
+                              page_zero_bytes, writable))
+      return false;
+    ofs += page_read_bytes;
+#else
     /* Get a page of memory. */
     uint8_t *kpage = palloc_get_page(PAL_USER);
     if (kpage == NULL)
@@ -545,6 +1498,7 @@ load_segment(struct file *file, off_t ofs, uint8_t *upage,
       palloc_free_page(kpage);
       return false;
     }
+#endif
 
     /* Advance. */
     read_bytes -= page_read_bytes;
@@ -559,10 +1513,14 @@ load_segment(struct file *file, off_t ofs, uint8_t *upage,
 static bool
 setup_stack(void **esp)
 {
-  uint8_t *kpage;
   bool success = false;
 
-  kpage = palloc_get_page(PAL_USER | PAL_ZERO);
+#ifdef VM
+  success = grow_stack(((uint8_t *)PHYS_BASE) - PGSIZE);
+  if (success)
+    *esp = PHYS_BASE;
+#else
+  uint8_t *kpage = palloc_get_page(PAL_USER | PAL_ZERO);
   if (kpage != NULL)
   {
     success = install_page(((uint8_t *)PHYS_BASE) - PGSIZE, kpage, true);
@@ -571,9 +1529,11 @@ setup_stack(void **esp)
     else
       palloc_free_page(kpage);
   }
+#endif
   return success;
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -592,3 +1552,4 @@ install_page(void *upage, void *kpage, bool writable)
      address, then map our page there. */
   return (pagedir_get_page(t->pagedir, upage) == NULL && pagedir_set_page(t->pagedir, upage, kpage, writable));
 }
+#endif
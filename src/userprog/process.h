@@ -3,9 +3,25 @@
 
 #include "threads/thread.h"
 
-tid_t process_execute(const char *file_name);
+struct spawn_fd;
+
+void process_init(void);
+tid_t process_execute(const char *cmd_line);
+tid_t process_execv(const char *file, char *const argv[]);
+tid_t process_spawn(const char *file, char *const argv[],
+                    const struct spawn_fd *, int fd_cnt, bool wait_load);
+tid_t process_fork(void);
 int process_wait(tid_t);
+tid_t process_waitpid(tid_t, int *status, int options);
 void process_exit(void);
+struct thread *process_current(void);
+tid_t process_thread_create(void *start, void *func, void *arg);
+tid_t process_kthread_create(thread_func *, void *aux);
+int process_thread_join(tid_t);
 void process_activate(void);
 
+struct rusage;
+extern bool process_print_usage;
+bool process_getrusage(int who, struct rusage *);
+
 #endif /* userprog/process.h */
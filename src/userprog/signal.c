@@ -0,0 +1,171 @@
+#include "userprog/signal.h"
+#include <string.h>
+#include "threads/flags.h"
+#include "threads/interrupt.h"
+#include "userprog/gdt.h"
+#include "userprog/syscall.h"
+#include "userprog/usercopy.h"
+
+/* A process's handlers are an array indexed by signal number and
+   its pending signals a bitmask, both in the leader, so sending a
+   signal sets one bit and allocates nothing.  Pending signals are
+   delivered, lowest number first, by whichever of the process's
+   threads next returns to user mode: the thread's registers are
+   saved on its user stack under a return address that points to
+   the process's trampoline, which calls SYS_SIGRETURN once the
+   handler returns.  SIGKILL, which the kernel also sends to a
+   process it kills for want of memory, takes no handler: it makes
+   the process exit at its next return to user mode or system call. */
+
+/* The user registers that a handler must not disturb. */
+struct sigcontext
+{
+  uint32_t edi, esi, ebp, ebx, edx, ecx, eax;
+  uint32_t eflags;
+  void (*eip)(void);
+  void *esp;
+};
+
+/* What signal_deliver() pushes on the user stack. */
+struct sigframe
+{
+  void *ret;              /* The trampoline, as the handler's return. */
+  struct sigcontext ctx;  /* Restored by signal_return(). */
+};
+
+/* EFLAGS bits that user code may set: the arithmetic flags and the
+   direction flag. */
+#define FLAGS_USER 0x00000cd5
+
+/* Registers HANDLER for SIGNUM in the current process, to return
+   through TRAMPOLINE.  A null HANDLER makes the signal ignored
+   again.  Returns false if SIGNUM is out of range. */
+bool signal_set_handler(int signum, void (*handler)(void), void *trampoline)
+{
+  struct thread *leader = thread_current()->leader;
+  enum intr_level old_level;
+
+  if (signum <= 0 || signum >= SIG_CNT || signum == SIGKILL)
+    return false;
+  old_level = intr_disable();
+  leader->sig_handlers[signum] = handler;
+  leader->sig_trampoline = trampoline;
+  if (handler == NULL)
+    leader->sig_pending &= ~(1u << signum);
+  intr_set_level(old_level);
+  return true;
+}
+
+/* Makes SIGNUM pending in process PID, unless it is ignored there.
+   Returns false if there is no such process or SIGNUM is out of
+   range. */
+bool signal_send(tid_t pid, int signum)
+{
+  struct thread *t;
+  enum intr_level old_level;
+  bool found;
+
+  if (signum <= 0 || signum >= SIG_CNT)
+    return false;
+  old_level = intr_disable();
+  t = thread_get_by_id(pid);
+  found = t != NULL && t->leader == t && t->pagedir != NULL;
+  if (found && (t->sig_handlers[signum] != NULL || signum == SIGKILL))
+    t->sig_pending |= 1u << signum;
+  intr_set_level(old_level);
+  return found;
+}
+
+/* Returns true if process LEADER has been sent SIGKILL. */
+bool signal_killed(const struct thread *leader)
+{
+  return (leader->sig_pending & (1u << SIGKILL)) != 0;
+}
+
+/* Gives the current process the handlers of PARENT's process.
+   Pending signals are not inherited. */
+void signal_inherit(const struct thread *parent)
+{
+  struct thread *t = thread_current();
+
+  memcpy(t->sig_handlers, parent->sig_handlers, sizeof t->sig_handlers);
+  t->sig_trampoline = parent->sig_trampoline;
+}
+
+/* Runs the handler of the current process's lowest pending signal,
+   if any, when F is about to return to user mode.  Called at the
+   end of every interrupt, so the common case of nothing pending is
+   a single test. */
+void signal_deliver(struct intr_frame *f)
+{
+  struct thread *leader = thread_current()->leader;
+  struct sigframe frame;
+  void (*handler)(void) = NULL;
+  enum intr_level old_level;
+
+  if (leader->sig_pending == 0)
+    return;
+  if (signal_killed(leader))
+  {
+    intr_enable();
+    exit(-1);
+  }
+  old_level = intr_disable();
+  if (leader->sig_pending != 0 && !leader->dying)
+  {
+    int signum = __builtin_ctz(leader->sig_pending);
+    leader->sig_pending &= ~(1u << signum);
+    handler = leader->sig_handlers[signum];
+  }
+  if (handler == NULL)
+  {
+    intr_set_level(old_level);
+    return;
+  }
+
+  frame.ret = leader->sig_trampoline;
+  frame.ctx.edi = f->edi;
+  frame.ctx.esi = f->esi;
+  frame.ctx.ebp = f->ebp;
+  frame.ctx.ebx = f->ebx;
+  frame.ctx.edx = f->edx;
+  frame.ctx.ecx = f->ecx;
+  frame.ctx.eax = f->eax;
+  frame.ctx.eflags = f->eflags;
+  frame.ctx.eip = f->eip;
+  frame.ctx.esp = f->esp;
+
+  /* The stack may have to be paged in, which needs interrupts.  An
+     external interrupt has been acknowledged by now. */
+  intr_enable();
+  if (!copy_to_user((struct sigframe *)f->esp - 1, &frame, sizeof frame))
+    exit(-1);
+  intr_set_level(old_level);
+  f->esp = (struct sigframe *)f->esp - 1;
+  f->eip = handler;
+}
+
+/* Handles SYS_SIGRETURN, made by the trampoline with F's stack
+   pointer just above the system call number, where the handler
+   returned from the frame pushed by signal_deliver().  Restores the
+   registers saved there, except that the segments and privileged
+   flags stay those of user mode. */
+void signal_return(struct intr_frame *f)
+{
+  struct sigcontext ctx;
+
+  if (!copy_from_user(&ctx, (uint32_t *)f->esp + 1, sizeof ctx))
+    exit(-1);
+  f->edi = ctx.edi;
+  f->esi = ctx.esi;
+  f->ebp = ctx.ebp;
+  f->ebx = ctx.ebx;
+  f->edx = ctx.edx;
+  f->ecx = ctx.ecx;
+  f->eax = ctx.eax;
+  f->eflags = (ctx.eflags & FLAGS_USER) | FLAG_IF | FLAG_MBS;
+  f->eip = ctx.eip;
+  f->esp = ctx.esp;
+  f->cs = SEL_UCSEG;
+  f->ds = f->es = f->fs = f->gs = f->ss = SEL_UDSEG;
+}
@@ -0,0 +1,17 @@
+#ifndef USERPROG_SIGNAL_H
+#define USERPROG_SIGNAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/thread.h"
+
+struct intr_frame;
+
+bool signal_set_handler(int signum, void (*handler)(void), void *trampoline);
+bool signal_send(tid_t pid, int signum);
+bool signal_killed(const struct thread *);
+void signal_inherit(const struct thread *parent);
+void signal_deliver(struct intr_frame *);
+void signal_return(struct intr_frame *);
+
+#endif /* userprog/signal.h */
@@ -1,326 +1,1544 @@
 #include "userprog/syscall.h"
+#include <limits.h>
 #include <stdio.h>
 #include <syscall-nr.h>
+#include "devices/input.h"
+#include "devices/timer.h"
+#include "filesys/directory.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "filesys/pipe.h"
 #include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
-
-struct lock filesys_lock;
+#include "userprog/fdtable.h"
+#include "userprog/futex.h"
+#include "userprog/process.h"
+#include "userprog/signal.h"
+#include "userprog/tss.h"
+#include "userprog/usercopy.h"
+#ifdef VM
+#include "vm/page.h"
+#include "vm/ring.h"
+#include "vm/shm.h"
+#endif
 
 static void syscall_handler(struct intr_frame *);
+static void end_thread(void) NO_RETURN;
+
+/* A system call handler receives the call's arguments as copied
+   from the user stack and returns the value for %eax. */
+typedef uint32_t syscall_func(const uint32_t *args);
+
+static uint32_t sys_halt(const uint32_t *args UNUSED)
+{
+	halt();
+}
+
+static uint32_t sys_exit(const uint32_t *args)
+{
+	exit((int)args[0]);
+}
+
+static uint32_t sys_exec(const uint32_t *args)
+{
+	return exec((const char *)args[0]);
+}
+
+static uint32_t sys_execv(const uint32_t *args)
+{
+	return execv((const char *)args[0], (char *const *)args[1]);
+}
+
+static uint32_t sys_spawn(const uint32_t *args)
+{
+	return spawn((const char *)args[0], (char *const *)args[1],
+		     (const struct spawn_fd *)args[2], (int)args[3]);
+}
+
+static uint32_t sys_fork(const uint32_t *args UNUSED)
+{
+	return fork();
+}
+
+static uint32_t sys_wait(const uint32_t *args)
+{
+	return wait((pid_t)args[0]);
+}
+
+static uint32_t sys_waitpid(const uint32_t *args)
+{
+	return waitpid((pid_t)args[0], (int *)args[1], (int)args[2]);
+}
+
+static uint32_t sys_create(const uint32_t *args)
+{
+	return create((const char *)args[0], (unsigned)args[1]);
+}
+
+static uint32_t sys_remove(const uint32_t *args)
+{
+	return remove((const char *)args[0]);
+}
+
+static uint32_t sys_open(const uint32_t *args)
+{
+	return open((const char *)args[0]);
+}
+
+static uint32_t sys_filesize(const uint32_t *args)
+{
+	return filesize((int)args[0]);
+}
+
+static uint32_t sys_read(const uint32_t *args)
+{
+	return read((int)args[0], (void *)args[1], (unsigned)args[2]);
+}
+
+static uint32_t sys_write(const uint32_t *args)
+{
+	return write((int)args[0], (const void *)args[1], (unsigned)args[2]);
+}
+
+static uint32_t sys_readv(const uint32_t *args)
+{
+	return readv((int)args[0], (const struct iovec *)args[1], (int)args[2]);
+}
+
+static uint32_t sys_writev(const uint32_t *args)
+{
+	return writev((int)args[0], (const struct iovec *)args[1], (int)args[2]);
+}
+
+static uint32_t sys_pread(const uint32_t *args)
+{
+	return pread((int)args[0], (void *)args[1], (unsigned)args[2], (unsigned)args[3]);
+}
+
+static uint32_t sys_pwrite(const uint32_t *args)
+{
+	return pwrite((int)args[0], (const void *)args[1], (unsigned)args[2], (unsigned)args[3]);
+}
+
+static uint32_t sys_seek(const uint32_t *args)
+{
+	seek((int)args[0], (unsigned)args[1]);
+	return 0;
+}
+
+static uint32_t sys_tell(const uint32_t *args)
+{
+	return tell((int)args[0]);
+}
+
+static uint32_t sys_close(const uint32_t *args)
+{
+	close((int)args[0]);
+	return 0;
+}
+
+static uint32_t sys_chdir(const uint32_t *args)
+{
+	return chdir((const char *)args[0]);
+}
+
+static uint32_t sys_mkdir(const uint32_t *args)
+{
+	return mkdir((const char *)args[0]);
+}
+
+static uint32_t sys_clone_file(const uint32_t *args)
+{
+	return clone_file((const char *)args[0], (const char *)args[1]);
+}
+
+static uint32_t sys_readdir(const uint32_t *args)
+{
+	return readdir((int)args[0], (char *)args[1]);
+}
+
+static uint32_t sys_isdir(const uint32_t *args)
+{
+	return isdir((int)args[0]);
+}
+
+static uint32_t sys_inumber(const uint32_t *args)
+{
+	return inumber((int)args[0]);
+}
+
+static uint32_t sys_getdents(const uint32_t *args)
+{
+	return getdents((int)args[0], (struct dirent *)args[1], (int)args[2]);
+}
+
+static uint32_t sys_fallocate(const uint32_t *args)
+{
+	return fallocate((int)args[0], (unsigned)args[1]);
+}
+
+static uint32_t sys_truncate(const uint32_t *args)
+{
+	return truncate((const char *)args[0], (unsigned)args[1]);
+}
+
+static uint32_t sys_ftruncate(const uint32_t *args)
+{
+	return ftruncate((int)args[0], (unsigned)args[1]);
+}
+
+static uint32_t sys_fsync(const uint32_t *args)
+{
+	return fsync((int)args[0]);
+}
+
+static uint32_t sys_sync(const uint32_t *args UNUSED)
+{
+	sync();
+	return 0;
+}
+
+static uint32_t sys_memstat(const uint32_t *args)
+{
+	memstat((struct memstat *)args[0]);
+	return 0;
+}
+
+static uint32_t sys_getrusage(const uint32_t *args)
+{
+	return getrusage((int)args[0], (struct rusage *)args[1]);
+}
+
+static uint32_t sys_ticks(const uint32_t *args UNUSED)
+{
+	return ticks();
+}
+
+static uint32_t sys_clock_gettime(const uint32_t *args)
+{
+	clock_gettime((struct timespec *)args[0]);
+	return 0;
+}
+
+static uint32_t sys_sigaction(const uint32_t *args)
+{
+	signal_set_handler((int)args[0], (void (*)(void))args[1], (void *)args[2]);
+	return 0;
+}
+
+static uint32_t sys_sendsig(const uint32_t *args)
+{
+	sendsig((pid_t)args[0], (int)args[1]);
+	return 0;
+}
+
+static uint32_t sys_setrlimit(const uint32_t *args)
+{
+	return setrlimit((int)args[0], (unsigned)args[1]);
+}
+
+static uint32_t sys_getrlimit(const uint32_t *args)
+{
+	return getrlimit((int)args[0]);
+}
+
+static uint32_t sys_yield(const uint32_t *args UNUSED)
+{
+	thread_yield();
+	return 0;
+}
+
+/* Milliseconds to timer ticks, rounded up. */
+static int64_t ms_to_ticks(uint32_t ms)
+{
+	return ((int64_t)ms * TIMER_FREQ + 999) / 1000;
+}
+
+static uint32_t sys_sched_setdeadline(const uint32_t *args)
+{
+	return thread_set_deadline(ms_to_ticks(args[0]), ms_to_ticks(args[1]));
+}
+
+static uint32_t sys_sched_setaffinity(const uint32_t *args)
+{
+	return thread_set_affinity(args[0]);
+}
+
+static uint32_t sys_cpu_group_create(const uint32_t *args)
+{
+	return thread_group_create(ms_to_ticks(args[0]), ms_to_ticks(args[1]));
+}
+
+static uint32_t sys_cpu_group_join(const uint32_t *args)
+{
+	return thread_group_join((int)args[0]);
+}
+
+static uint32_t sys_pipe(const uint32_t *args)
+{
+	return pipe((int *)args[0]);
+}
+
+static uint32_t sys_sendfile(const uint32_t *args)
+{
+	return sendfile((int)args[0], (int)args[1], (unsigned *)args[2], args[3]);
+}
+
+static uint32_t sys_poll(const uint32_t *args)
+{
+	return poll((struct pollfd *)args[0], args[1], (int)args[2]);
+}
+
+#ifdef VM
+static uint32_t sys_mmap(const uint32_t *args)
+{
+	return mmap((int)args[0], (void *)args[1]);
+}
+
+static uint32_t sys_munmap(const uint32_t *args)
+{
+	munmap((mapid_t)args[0]);
+	return 0;
+}
+
+static uint32_t sys_madvise(const uint32_t *args)
+{
+	return madvise((void *)args[0], (unsigned)args[1], (int)args[2]);
+}
+
+static uint32_t sys_vmstat(const uint32_t *args)
+{
+	return vmstat((struct vmstat *)args[0]);
+}
+
+static uint32_t sys_sbrk(const uint32_t *args)
+{
+	return (uint32_t)sbrk((intptr_t)args[0]);
+}
+
+/* The user library passes its own start routine ahead of the
+   function and argument that uthread_create() was given. */
+static uint32_t sys_thread_create(const uint32_t *args)
+{
+	tid_t tid = process_thread_create((void *)args[0], (void *)args[1], (void *)args[2]);
+	return tid == TID_ERROR ? UTHREAD_ERROR : tid;
+}
+
+static uint32_t sys_thread_join(const uint32_t *args)
+{
+	return uthread_join((uthread_t)args[0]);
+}
+
+static uint32_t sys_thread_exit(const uint32_t *args UNUSED)
+{
+	uthread_exit();
+}
+
+static uint32_t sys_futex_wait(const uint32_t *args)
+{
+	return futex_sleep((const int *)args[0], (int)args[1]);
+}
+
+static uint32_t sys_futex_wake(const uint32_t *args)
+{
+	return futex_wakeup((const int *)args[0], (int)args[1]);
+}
+
+static uint32_t sys_shm_create(const uint32_t *args)
+{
+	return shm_create((const char *)args[0], args[1]);
+}
+
+static uint32_t sys_shm_map(const uint32_t *args)
+{
+	return (uint32_t)shm_map((const char *)args[0], (void *)args[1]);
+}
+
+static uint32_t sys_shm_unmap(const uint32_t *args)
+{
+	return shm_unmap((void *)args[0]);
+}
+
+static uint32_t sys_ring_setup(const uint32_t *args)
+{
+	return (uint32_t)ring_setup(args[0], (void *)args[1]);
+}
+
+static uint32_t sys_ring_enter(const uint32_t *args)
+{
+	return ring_enter(args[0], args[1]);
+}
+#endif
+
+/* Most arguments any system call takes. */
+#define SYSCALL_MAX_ARGS 4
+
+/* Number of arguments and handler of each system call.  Numbers
+   without a handler are invalid. */
+static const struct syscall
+{
+	int argc;
+	syscall_func *func;
+} syscall_table[] = {
+	[SYS_HALT] = {0, sys_halt},
+	[SYS_EXIT] = {1, sys_exit},
+	[SYS_EXEC] = {1, sys_exec},
+	[SYS_EXECV] = {2, sys_execv},
+	[SYS_SPAWN] = {4, sys_spawn},
+	[SYS_WAIT] = {1, sys_wait},
+	[SYS_CREATE] = {2, sys_create},
+	[SYS_REMOVE] = {1, sys_remove},
+	[SYS_OPEN] = {1, sys_open},
+	[SYS_FILESIZE] = {1, sys_filesize},
+	[SYS_READ] = {3, sys_read},
+	[SYS_WRITE] = {3, sys_write},
+	[SYS_SEEK] = {2, sys_seek},
+	[SYS_TELL] = {1, sys_tell},
+	[SYS_CLOSE] = {1, sys_close},
+	[SYS_SIGACTION] = {3, sys_sigaction},
+	[SYS_SENDSIG] = {2, sys_sendsig},
+	[SYS_YIELD] = {0, sys_yield},
+	[SYS_SETRLIMIT] = {2, sys_setrlimit},
+	[SYS_GETRLIMIT] = {1, sys_getrlimit},
+	[SYS_SCHED_SETDEADLINE] = {2, sys_sched_setdeadline},
+	[SYS_SCHED_SETAFFINITY] = {1, sys_sched_setaffinity},
+	[SYS_CPU_GROUP_CREATE] = {2, sys_cpu_group_create},
+	[SYS_CPU_GROUP_JOIN] = {1, sys_cpu_group_join},
+	[SYS_PIPE] = {1, sys_pipe},
+	[SYS_POLL] = {3, sys_poll},
+	[SYS_SENDFILE] = {4, sys_sendfile},
+	[SYS_READV] = {3, sys_readv},
+	[SYS_WRITEV] = {3, sys_writev},
+	[SYS_PREAD] = {4, sys_pread},
+	[SYS_PWRITE] = {4, sys_pwrite},
+	[SYS_FORK] = {0, sys_fork},
+	[SYS_WAITPID] = {3, sys_waitpid},
+	[SYS_CHDIR] = {1, sys_chdir},
+	[SYS_MKDIR] = {1, sys_mkdir},
+	[SYS_CLONE_FILE] = {2, sys_clone_file},
+	[SYS_READDIR] = {2, sys_readdir},
+	[SYS_ISDIR] = {1, sys_isdir},
+	[SYS_INUMBER] = {1, sys_inumber},
+	[SYS_GETDENTS] = {3, sys_getdents},
+	[SYS_FALLOCATE] = {2, sys_fallocate},
+	[SYS_TRUNCATE] = {2, sys_truncate},
+	[SYS_FTRUNCATE] = {2, sys_ftruncate},
+	[SYS_FSYNC] = {1, sys_fsync},
+	[SYS_SYNC] = {0, sys_sync},
+	[SYS_MEMSTAT] = {1, sys_memstat},
+	[SYS_GETRUSAGE] = {2, sys_getrusage},
+	[SYS_TICKS] = {0, sys_ticks},
+	[SYS_CLOCK_GETTIME] = {1, sys_clock_gettime},
+#ifdef VM
+	[SYS_MMAP] = {2, sys_mmap},
+	[SYS_MUNMAP] = {1, sys_munmap},
+	[SYS_MADVISE] = {3, sys_madvise},
+	[SYS_VMSTAT] = {1, sys_vmstat},
+	[SYS_SBRK] = {1, sys_sbrk},
+	[SYS_THREAD_CREATE] = {3, sys_thread_create},
+	[SYS_THREAD_JOIN] = {1, sys_thread_join},
+	[SYS_THREAD_EXIT] = {0, sys_thread_exit},
+	[SYS_FUTEX_WAIT] = {2, sys_futex_wait},
+	[SYS_FUTEX_WAKE] = {2, sys_futex_wake},
+	[SYS_SHM_CREATE] = {2, sys_shm_create},
+	[SYS_SHM_MAP] = {2, sys_shm_map},
+	[SYS_SHM_UNMAP] = {1, sys_shm_unmap},
+	[SYS_RING_SETUP] = {2, sys_ring_setup},
+	[SYS_RING_ENTER] = {2, sys_ring_enter},
+#endif
+};
+
+/* MSRs that set up SYSENTER.  See [IA32-v3a] 4.8.7
+   "Performing Fast Calls to System Procedures with the SYSENTER
+   and SYSEXIT Instructions". */
+#define MSR_SYSENTER_CS 0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
+/* CPUID leaf 1 EDX bit for SYSENTER and SYSEXIT. */
+#define CPUID_SEP (1u << 11)
+
+static void wrmsr(uint32_t msr, uint32_t value)
+{
+	asm volatile("wrmsr" : : "c"(msr), "a"(value), "d"(0));
+}
+
+/* Registers the `int $0x30' entry and, if the processor has them,
+   enables SYSENTER and SYSEXIT as a faster one.  User programs
+   check CPUID the same way to pick one (see lib/user/syscall.c). */
+void syscall_init(void)
+{
+	extern char sysenter_entry[];
+	uint32_t eax, ebx, ecx, edx;
+
+	intr_register_int(0x30, 3, INTR_ON, syscall_handler, "syscall");
+
+	asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+	/* Early Pentium Pros (family 6, model and stepping below 3)
+	   report SEP but lack the instructions. */
+	if ((edx & CPUID_SEP) == 0
+	    || ((eax & 0xf0f00) == 0x600 && (eax & 0xf0) < 0x30 && (eax & 0xf) < 3))
+		return;
+	wrmsr(MSR_SYSENTER_CS, SEL_KCSEG);
+	wrmsr(MSR_SYSENTER_ESP, (uint32_t)tss_esp0());
+	wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_entry);
+}
+
+/* Handles a system call made with SYSENTER, from sysenter_entry
+   in threads/intr-stubs.S, which lays out F just as `int $0x30'
+   would.  Returns true if the stub may go back with SYSEXIT, which
+   restores only the user's EIP and ESP, or false if it must use
+   `iret' because a signal handler or sigreturn changed them. */
+bool syscall_sysenter(struct intr_frame *f)
+{
+	void (*eip)(void) = f->eip;
+	void *esp = f->esp;
+
+	syscall_handler(f);
+	signal_deliver(f);
+	return f->eip == eip && f->esp == esp;
+}
+
+/* Looks up the system call numbered at the top of the user stack,
+   copies in all of its arguments at once and runs its handler.
+   A bad stack pointer or an unknown number kills the process. */
+static void
+syscall_handler(struct intr_frame *f)
+{
+	const struct syscall *sc;
+	uint32_t nr, args[SYSCALL_MAX_ARGS];
+
+#ifdef VM
+	thread_current()->user_esp = f->esp;
+#endif
+	/* The other threads of an exiting process end here. */
+	if (process_current()->dying)
+		end_thread();
+	if (signal_killed(process_current()))
+		exit(-1);
+	if (!copy_from_user(&nr, f->esp, sizeof nr))
+		exit(-1);
+	/* Only this call replaces the registers wholesale. */
+	if (nr == SYS_SIGRETURN)
+	{
+		signal_return(f);
+		return;
+	}
+	if (nr >= sizeof syscall_table / sizeof *syscall_table || syscall_table[nr].func == NULL)
+		exit(-1);
+	sc = &syscall_table[nr];
+	if (!copy_from_user(args, (uint32_t *)f->esp + 1, sc->argc * sizeof *args))
+		exit(-1);
+	TRACE(TRACE_SYSCALL, nr, sc->argc > 0 ? args[0] : 0);
+	f->eax = sc->func(args);
+}
+
+/* Returns a copy of the user string USTR in a new page, which the
+   caller must free, or a null pointer if it does not fit in a page
+   or memory is short.  A bad pointer kills the process. */
+static char *copy_in_string(const char *ustr)
+{
+	char *kstr = palloc_get_page(0);
+	int len;
+
+	if (kstr == NULL)
+		return NULL;
+	len = strncpy_from_user(kstr, ustr, PGSIZE);
+	if (len < 0)
+	{
+		palloc_free_page(kstr);
+		exit(-1);
+	}
+	if (len == PGSIZE)
+	{
+		palloc_free_page(kstr);
+		return NULL;
+	}
+	return kstr;
+}
+
+void halt(void)
+{
+	shutdown_power_off();
+}
+
+void exit(int status)
+{
+	struct thread *leader = process_current();
+	bool first;
+
+	/* The first thread to exit ends the process, with its status.
+	   The others end at their next system call. */
+	lock_acquire(&leader->wait_lock);
+	first = !leader->dying;
+	if (first)
+	{
+		leader->dying = true;
+		leader->exit_status = status;
+	}
+	lock_release(&leader->wait_lock);
+	if (first)
+	{
+		printf("%s: exit(%d)\n", leader->name, status);
+		futex_wakeup_all(leader);
+#ifdef VM
+		vm_ring_stop(leader);
+#endif
+	}
+	end_thread();
+}
+
+/* Ends the current thread, once its children have exited. */
+static void end_thread(void)
+{
+	int child_status;
+
+	/* Reap our children as they finish. */
+	while (process_waitpid(-1, &child_status, 0) != -1)
+		continue;
+	thread_exit();
+}
+
+pid_t exec(const char *command)
+{
+	char *file_name = copy_in_string(command);
+	if (file_name == NULL)
+		return -1;
+	pid_t pid = process_execute(file_name);
+	palloc_free_page(file_name);
+
+	return pid;
+}
+
+pid_t execv(const char *file, char *const argv[])
+{
+	return process_execv(file, argv);
+}
+
+pid_t spawn(const char *file, char *const argv[], const struct spawn_fd *ufds, int fd_cnt)
+{
+	struct spawn_fd fds[SPAWN_FD_MAX];
+
+	if (fd_cnt < 0 || fd_cnt > SPAWN_FD_MAX)
+		return PID_ERROR;
+	if (!copy_from_user(fds, ufds, fd_cnt * sizeof *fds))
+		exit(-1);
+	return process_spawn(file, argv, fds, fd_cnt, false);
+}
+
+pid_t fork(void)
+{
+	tid_t tid = process_fork();
+	return tid == TID_ERROR ? PID_ERROR : tid;
+}
+
+int wait(pid_t pid)
+{
+	return process_wait(pid);
+}
+
+pid_t waitpid(pid_t pid, int *status, int options)
+{
+	int child_status;
+	pid_t child;
+
+	if (options & ~WNOHANG)
+		return -1;
+	child = process_waitpid(pid, &child_status, options);
+	if (child > 0 && status != NULL
+	    && !copy_to_user(status, &child_status, sizeof child_status))
+		exit(-1);
+	return child;
+}
+
+bool create(const char *file, unsigned initial_size)
+{
+	char *name = copy_in_string(file);
+	if (name == NULL)
+		return false;
+	bool success = filesys_create(name, initial_size);
+	palloc_free_page(name);
+	return success;
+}
+
+bool remove(const char *file)
+{
+	char *name = copy_in_string(file);
+	if (name == NULL)
+		return false;
+	bool success = filesys_remove(name);
+	palloc_free_page(name);
+	return success;
+}
+
+int open(const char *file)
+{
+	struct thread *cur = thread_current();
+	int fd = -1;
+
+	char *name = copy_in_string(file);
+	if (name == NULL)
+		return -1;
+	struct file *open_file = filesys_open(name);
+	if (open_file != NULL)
+	{
+		if (strcmp(cur->name, name) == 0)
+			file_deny_write(open_file);
+		fd = fd_install(open_file);
+		if (fd < 0)
+			file_close(open_file);
+	}
+	palloc_free_page(name);
+	return fd;
+}
+
+int filesize(int fd)
+{
+
+	struct file *file = fd_lookup(fd);
+	if (file == NULL)
+		return -1;
+	off_t length = file_length(file);
+	return length;
+}
+
+/* Position within a list of user buffers. */
+struct iov_cursor
+{
+	const struct iovec *iov; /* Current buffer. */
+	unsigned ofs;		 /* Offset within it. */
+};
+
+/* Copies SIZE bytes between kernel buffer KBUF and the user buffers
+   at CUR, which must hold at least that many more bytes, and
+   advances CUR.  TO_USER selects the direction.  Returns false if a
+   user buffer is not valid memory. */
+static bool iov_copy(struct iov_cursor *cur, void *kbuf, unsigned size, bool to_user)
+{
+	uint8_t *kbyte = kbuf;
+
+	while (size > 0)
+	{
+		if (cur->ofs == cur->iov->iov_len)
+		{
+			cur->iov++;
+			cur->ofs = 0;
+			continue;
+		}
+
+		uint8_t *ubyte = (uint8_t *)cur->iov->iov_base + cur->ofs;
+		unsigned chunk = cur->iov->iov_len - cur->ofs;
+		if (chunk > size)
+			chunk = size;
+		if (!(to_user ? copy_to_user(ubyte, kbyte, chunk)
+			      : copy_from_user(kbyte, ubyte, chunk)))
+			return false;
+		cur->ofs += chunk;
+		kbyte += chunk;
+		size -= chunk;
+	}
+	return true;
+}
+
+/* Returns the total size of the IOVCNT buffers in IOV, or -1 if it
+   does not fit in an int. */
+static int iov_total(const struct iovec *iov, int iovcnt)
+{
+	unsigned total = 0;
+
+	for (int i = 0; i < iovcnt; i++)
+	{
+		if (iov[i].iov_len > INT_MAX - total)
+			return -1;
+		total += iov[i].iov_len;
+	}
+	return total;
+}
+
+/* Reads from FD into the IOVCNT user buffers described by the
+   kernel array IOV, starting at byte OFS of the file, or at the
+   file's position if OFS is negative.  Data goes through a kernel
+   bounce page, a page at a time, so that the file system never
+   touches user memory while it holds its locks.  The console
+   returns at most a line per read, without touching any file
+   system lock.  A pipe hands over whole pages that a writer
+   filled, which then serve as the bounce page themselves. */
+static int read_iov(int fd, const struct iovec *iov, int iovcnt, off_t ofs)
+{
+	struct iov_cursor cur = {iov, 0};
+	struct file *file = NULL;
+	int total = iov_total(iov, iovcnt);
+	int count = 0;
+
+	if (total < 0 || (ofs >= 0 && total > INT_MAX - ofs))
+		return -1;
+	file = fd_lookup(fd);
+	if (file == NULL ? fd != 0 || ofs >= 0
+	    : ofs >= 0 && file_get_pipe(file) != NULL)
+		return -1;
+
+	uint8_t *bounce = palloc_get_page(0);
+	if (bounce == NULL)
+		return -1;
+	while (count < total)
+	{
+		int chunk = total - count < PGSIZE ? total - count : PGSIZE;
+		uint8_t *page;
+		int n;
 
-void syscall_init(void)
-{
-	lock_init(&filesys_lock);
-	intr_register_int(0x30, 3, INTR_ON, syscall_handler, "syscall");
+		if (file == NULL)
+			n = input_read(bounce, chunk);
+		else if (chunk == PGSIZE && file_get_pipe(file) != NULL
+			 && (page = pipe_take_page(file_get_pipe(file))) != NULL)
+		{
+			palloc_free_page(bounce);
+			bounce = page;
+			n = PGSIZE;
+		}
+		else if (ofs < 0)
+			n = file_read(file, bounce, chunk);
+		else
+			n = file_read_at(file, bounce, chunk, ofs + count);
+		if (!iov_copy(&cur, bounce, n, true))
+		{
+			palloc_free_page(bounce);
+			exit(-1);
+		}
+		count += n;
+		if (n < chunk)
+			break;
+	}
+	palloc_free_page(bounce);
+	return count;
 }
 
-static void
-syscall_handler(struct intr_frame *f UNUSED)
+/* Writes the IOVCNT user buffers described by the kernel array IOV
+   to FD at byte OFS, or at the file's position if OFS is negative.
+   The buffers are gathered into a kernel bounce page, so that small
+   fragments reach the file system a page at a time.  A full bounce
+   page written to a pipe is handed to the pipe as it is, and a
+   fresh one takes its place. */
+static int write_iov(int fd, const struct iovec *iov, int iovcnt, off_t ofs)
 {
-	switch (*(uint32_t *)(f->esp))
+	struct iov_cursor cur = {iov, 0};
+	struct file *file = NULL;
+	int total = iov_total(iov, iovcnt);
+	int count = 0;
+
+	if (total < 0 || (ofs >= 0 && total > INT_MAX - ofs))
+		return -1;
+	file = fd_lookup(fd);
+	if (file == NULL ? fd != 1 || ofs >= 0
+	    : file_is_dir(file) || (ofs >= 0 && file_get_pipe(file) != NULL))
+		return -1;
+
+	uint8_t *bounce = palloc_get_page(0);
+	if (bounce == NULL)
+		return -1;
+	while (count < total)
 	{
-	case SYS_HALT:
-		halt();
-		break;
-
-	case SYS_EXIT:
-		validate_user_vaddr(f->esp + 4);
-		exit(*(uint32_t *)(f->esp + 4));
-		break;
-
-	case SYS_EXEC:
-		validate_user_vaddr(f->esp + 4);
-		f->eax = exec((const char *)*(uint32_t *)(f->esp + 4));
-		break;
-
-	case SYS_WAIT:
-		validate_user_vaddr(f->esp + 4);
-		f->eax = wait((pid_t *)*(uint32_t *)(f->esp + 4));
-		break;
-
-	case SYS_CREATE:
-		validate_user_vaddr(f->esp + 4);
-		validate_user_vaddr(f->esp + 8);
-		f->eax = create((const char *)*(uint32_t *)(f->esp + 4), (unsigned)*(uint32_t *)(f->esp + 8));
-		break;
-
-	case SYS_REMOVE:
-		validate_user_vaddr(f->esp + 4);
-		f->eax = remove((const char *)*(uint32_t *)(f->esp + 4));
-		break;
-
-	case SYS_OPEN:
-		validate_user_vaddr(f->esp + 4);
-		f->eax = open((const char *)*(uint32_t *)(f->esp + 4));
-		break;
-
-	case SYS_FILESIZE:
-		validate_user_vaddr(f->esp + 4);
-		f->eax = filesize((int)*(uint32_t *)(f->esp + 4));
-		break;
-
-	case SYS_READ:
-		validate_user_vaddr(f->esp + 4);
-		validate_user_vaddr(f->esp + 8);
-		validate_user_vaddr(f->esp + 12);
-		f->eax = read((int)*(uint32_t *)(f->esp + 4), (void *)*(uint32_t *)(f->esp + 8), (unsigned)*(uint32_t *)(f->esp + 12));
-		break;
-
-	case SYS_WRITE:
-		validate_user_vaddr(f->esp + 4);
-		validate_user_vaddr(f->esp + 8);
-		validate_user_vaddr(f->esp + 12);
-		f->eax = write((int)*(uint32_t *)(f->esp + 4), (void *)*(uint32_t *)(f->esp + 8), (unsigned)*((uint32_t *)(f->esp + 12)));
-		break;
-
-	case SYS_SEEK:
-		validate_user_vaddr(f->esp + 4);
-		validate_user_vaddr(f->esp + 8);
-		seek((int)*(uint32_t *)(f->esp + 4), (unsigned)*(uint32_t *)(f->esp + 8));
-		break;
-
-	case SYS_TELL:
-		validate_user_vaddr(f->esp + 4);
-		f->eax = tell((int)*(uint32_t *)(f->esp + 4));
-		break;
-
-	case SYS_CLOSE:
-		validate_user_vaddr(f->esp + 4);
-		close((int)*(uint32_t *)(f->esp + 4));
-		break;
-
-	case SYS_SIGACTION:
-		validate_user_vaddr(f->esp + 4);
-		validate_user_vaddr(f->esp + 8);
-
-		sigaction((int)*(uint32_t *)(f->esp + 4), (void *)*(uint32_t *)(f->esp + 8));
-
-		break;
-
-	case SYS_SENDSIG:
-		validate_user_vaddr(f->esp + 4);
-		validate_user_vaddr(f->esp + 8);
-
-		sendsig((pid_t) * (uint32_t *)(f->esp + 4), (int)*(uint32_t *)(f->esp + 8));
-
-		break;
-
-	case SYS_YIELD:
-		thread_yield();
-		break;
+		int chunk = total - count < PGSIZE ? total - count : PGSIZE;
+		int n;
+
+		if (!iov_copy(&cur, bounce, chunk, false))
+		{
+			palloc_free_page(bounce);
+			exit(-1);
+		}
+		if (file == NULL)
+		{
+			putbuf((const char *)bounce, chunk);
+			n = chunk;
+		}
+		else if (chunk == PGSIZE && file_get_pipe(file) != NULL)
+		{
+			if (!pipe_give_page(file_get_pipe(file), bounce))
+				break;
+			n = PGSIZE;
+			bounce = palloc_get_page(0);
+			if (bounce == NULL)
+				return count + n;
+		}
+		else if (ofs < 0)
+			n = file_write(file, bounce, chunk);
+		else
+			n = file_write_at(file, bounce, chunk, ofs + count);
+		count += n;
+		if (n < chunk)
+			break;
 	}
+	palloc_free_page(bounce);
+	return count;
 }
 
-void validate_user_vaddr(const void *vaddr)
+/* Copies the user array of IOVCNT buffers UIOV into IOV, which has
+   room for IOV_MAX.  Returns false if IOVCNT is out of range; a bad
+   array kills the process. */
+static bool copy_in_iov(struct iovec *iov, const struct iovec *uiov, int iovcnt)
 {
-	if (!is_user_vaddr(vaddr) || vaddr == NULL)
-	{
+	if (iovcnt < 0 || iovcnt > IOV_MAX)
+		return false;
+	if (!copy_from_user(iov, uiov, iovcnt * sizeof *iov))
 		exit(-1);
-	}
+	return true;
 }
 
-void halt(void)
+int read(int fd, void *buffer, unsigned size)
 {
-	shutdown_power_off();
+	struct iovec iov = {buffer, size};
+	return read_iov(fd, &iov, 1, -1);
 }
 
-void exit(int status)
+int write(int fd, const void *buffer, unsigned size)
 {
-	struct thread *cur = thread_current();
-	struct list_elem *e;
+	struct iovec iov = {(void *)buffer, size};
+	return write_iov(fd, &iov, 1, -1);
+}
+
+int readv(int fd, const struct iovec *uiov, int iovcnt)
+{
+	struct iovec iov[IOV_MAX];
+
+	if (!copy_in_iov(iov, uiov, iovcnt))
+		return -1;
+	return read_iov(fd, iov, iovcnt, -1);
+}
+
+int writev(int fd, const struct iovec *uiov, int iovcnt)
+{
+	struct iovec iov[IOV_MAX];
+
+	if (!copy_in_iov(iov, uiov, iovcnt))
+		return -1;
+	return write_iov(fd, iov, iovcnt, -1);
+}
+
+/* Reads or writes at OFFSET without moving the file position, so
+   that several threads can share one descriptor.  The console has
+   no position to read or write at. */
+int pread(int fd, void *buffer, unsigned size, unsigned offset)
+{
+	struct iovec iov = {buffer, size};
+
+	if (offset > INT_MAX)
+		return -1;
+	return read_iov(fd, &iov, 1, offset);
+}
+
+int pwrite(int fd, const void *buffer, unsigned size, unsigned offset)
+{
+	struct iovec iov = {(void *)buffer, size};
+
+	if (offset > INT_MAX)
+		return -1;
+	return write_iov(fd, &iov, 1, offset);
+}
 
-	cur->exit_status = status;
-	printf("%s: exit(%d)\n", cur->name, status);
+/* Copies through one kernel page: the input file system fills it
+   from the buffer cache and the output one empties it there, so no
+   byte crosses into user memory.  Whole pages written to a pipe are
+   handed over as they are, as in write_iov(). */
+int sendfile(int out_fd, int in_fd, unsigned *offset, unsigned count)
+{
+	struct file *in = fd_lookup(in_fd);
+	struct file *out = NULL;
+	unsigned kofs = 0;
+	int total = 0;
 
-	for (e = list_begin(&cur->child); e != list_end(&cur->child); e = list_next(e))
+	if (in == NULL || file_is_dir(in) || count > INT_MAX)
+		return -1;
+	out = fd_lookup(out_fd);
+	if (out == NULL ? out_fd != 1 : file_is_dir(out))
+		return -1;
+	if (offset != NULL)
 	{
-		struct thread *t = list_entry(e, struct thread, child_elem);
-		wait(t->tid);
+		if (!copy_from_user(&kofs, offset, sizeof kofs))
+			exit(-1);
+		if (kofs > INT_MAX || file_get_pipe(in) != NULL)
+			return -1;
+		if (count > INT_MAX - kofs)
+			count = INT_MAX - kofs;
 	}
 
-	for (int i = 0; i < 10; i++)
+	uint8_t *page = palloc_get_page(0);
+	if (page == NULL)
+		return -1;
+	while ((unsigned)total < count)
 	{
-		if (cur->save_signal[i] == NULL)
+		int chunk = count - total < PGSIZE ? count - total : PGSIZE;
+		int n, w;
+
+		if (offset != NULL)
+			n = file_read_at(in, page, chunk, kofs + total);
+		else
+			n = file_read(in, page, chunk);
+		if (n <= 0)
+			break;
+		if (out == NULL)
+		{
+			putbuf((const char *)page, n);
+			w = n;
+		}
+		else if (n == PGSIZE && file_get_pipe(out) != NULL)
+		{
+			w = pipe_give_page(file_get_pipe(out), page) ? n : 0;
+			if (w == n && (page = palloc_get_page(0)) == NULL)
+			{
+				total += w;
+				break;
+			}
+		}
+		else
+			w = file_write(out, page, n);
+		total += w;
+
+		/* Leave unwritten input to be read again. */
+		if (w < n)
+		{
+			if (offset == NULL && file_get_pipe(in) == NULL)
+				file_seek(in, file_tell(in) - (n - w));
+			break;
+		}
+		if (n < chunk)
 			break;
-		free(cur->save_signal[i]);
 	}
-	thread_exit();
+	palloc_free_page(page);
+
+	if (offset != NULL)
+	{
+		kofs += total;
+		if (!copy_to_user(offset, &kofs, sizeof kofs))
+			exit(-1);
+	}
+	return total;
 }
 
-pid_t exec(const char *command)
+void seek(int fd, unsigned position)
 {
-	char *file_name[128];
-	memcpy(file_name, command, strlen(command) + 1);
-	pid_t pid = process_execute(file_name);
+	struct file *f_path = fd_lookup(fd);
+	if (f_path == NULL)
+	{
+		return;
+	}
+	return file_seek(f_path, position);
+}
 
-	return pid;
+unsigned tell(int fd)
+{
+	struct file *f_path = fd_lookup(fd);
+	if (f_path == NULL)
+	{
+		return -1;
+	}
+	return file_tell(f_path);
 }
 
-int wait(pid_t pid)
+void close(int fd)
 {
-	return process_wait(pid);
+	file_close(fd_remove(fd));
 }
 
-bool create(const char *file, unsigned initial_size)
+bool chdir(const char *dir)
 {
-	if (file == NULL)
-		exit(-1);
-	return filesys_create(file, initial_size);
+	char *name = copy_in_string(dir);
+	if (name == NULL)
+		return false;
+	bool success = filesys_chdir(name);
+	palloc_free_page(name);
+	return success;
 }
 
-bool remove(const char *file)
+bool mkdir(const char *dir)
 {
-	if (file == NULL)
-		exit(-1);
-	return filesys_remove(file);
+	char *name = copy_in_string(dir);
+	if (name == NULL)
+		return false;
+	bool success = filesys_mkdir(name);
+	palloc_free_page(name);
+	return success;
 }
 
-int open(const char *file)
+bool clone_file(const char *from, const char *to)
 {
-	struct thread *cur = thread_current();
-	int fd;
+	char *kfrom = copy_in_string(from);
+	char *kto;
+	bool success = false;
 
-	if (file == NULL)
-		exit(-1);
-	lock_acquire(&filesys_lock);
-	struct file *open_file = filesys_open(file);
-	lock_release(&filesys_lock);
-	if (open_file == NULL)
+	if (kfrom == NULL)
+		return false;
+	kto = copy_in_string(to);
+	if (kto != NULL)
 	{
-		return -1;
+		success = filesys_clone(kfrom, kto);
+		palloc_free_page(kto);
 	}
-	else
+	palloc_free_page(kfrom);
+	return success;
+}
+
+/* Reads the next entry of the directory open as FD, starting at
+   the descriptor's position, and advances the position past it. */
+bool readdir(int fd, char name[READDIR_MAX_LEN + 1])
+{
+	char kname[READDIR_MAX_LEN + 1];
+	struct file *file = fd_lookup(fd);
+	struct dir *dir;
+	bool success;
+
+	if (file == NULL || !file_is_dir(file))
+		return false;
+	dir = dir_open(inode_reopen(file_get_inode(file)));
+	if (dir == NULL)
+		return false;
+	dir_seek(dir, file_tell(file));
+	success = dir_readdir(dir, kname);
+	file_seek(file, dir_tell(dir));
+	dir_close(dir);
+	if (success && !copy_to_user(name, kname, strlen(kname) + 1))
+		exit(-1);
+	return success;
+}
+
+/* Number of entries getdents() gathers before copying them out. */
+#define GETDENTS_BATCH 16
+
+/* Reads up to CNT entries of the directory open as FD into
+   UENTRIES, with each entry's inode number, type and length, and
+   advances the descriptor's position past them. */
+int getdents(int fd, struct dirent *uentries, int cnt)
+{
+	struct dirent entries[GETDENTS_BATCH];
+	struct file *file = fd_lookup(fd);
+	struct dir *dir;
+	int done = 0;
+
+	if (file == NULL || !file_is_dir(file) || cnt < 0)
+		return -1;
+	dir = dir_open(inode_reopen(file_get_inode(file)));
+	if (dir == NULL)
+		return -1;
+	dir_seek(dir, file_tell(file));
+	while (done < cnt)
 	{
-		int next_fd = cur->next_fd;
-		if (next_fd >= 2 && next_fd < 64)
+		int n = 0;
+
+		while (n < GETDENTS_BATCH && done + n < cnt)
+		{
+			struct dirent *e = &entries[n];
+			struct inode *inode;
+
+			if (!dir_readdir_inode(dir, e->name, &inode))
+				break;
+			if (inode == NULL)
+				continue;
+			e->inumber = inode_get_inumber(inode);
+			e->is_dir = inode_is_dir(inode);
+			e->size = inode_length(inode);
+			inode_close(inode);
+			n++;
+		}
+		if (n > 0 && !copy_to_user(uentries + done, entries,
+					   n * sizeof *entries))
 		{
-			if (strcmp(cur->name, file) == 0)
-				file_deny_write(open_file);
-			cur->fdt[next_fd] = open_file;
-			thread_current()->next_fd = next_fd + 1;
-			return next_fd;
+			dir_close(dir);
+			exit(-1);
 		}
+		done += n;
+		if (n < GETDENTS_BATCH)
+			break;
 	}
-	return -1;
+	file_seek(file, dir_tell(dir));
+	dir_close(dir);
+	return done;
 }
 
-int filesize(int fd)
+bool isdir(int fd)
+{
+	struct file *file = fd_lookup(fd);
+	return file != NULL && file_is_dir(file);
+}
+
+/* Allocates the sectors of the file open as FD up to LENGTH bytes
+   at once, growing it to that length if it is shorter. */
+bool fallocate(int fd, unsigned length)
+{
+	struct file *file = fd_lookup(fd);
+
+	if (file == NULL || length > INT_MAX || file_is_dir(file))
+		return false;
+	return file_allocate(file, length);
+}
+
+/* Sets the length of the file named FILE to LENGTH bytes. */
+bool truncate(const char *file, unsigned length)
+{
+	char *kfile = copy_in_string(file);
+	struct file *f;
+	bool success = false;
+
+	if (kfile == NULL)
+		return false;
+	f = filesys_open(kfile);
+	palloc_free_page(kfile);
+	if (f != NULL)
+	{
+		success = (length <= INT_MAX && !file_is_dir(f)
+		           && file_truncate(f, length));
+		file_close(f);
+	}
+	return success;
+}
+
+/* Sets the length of the file open as FD to LENGTH bytes. */
+bool ftruncate(int fd, unsigned length)
+{
+	struct file *file = fd_lookup(fd);
+
+	if (file == NULL || length > INT_MAX || file_is_dir(file))
+		return false;
+	return file_truncate(file, length);
+}
+
+/* Writes the data and metadata of the file open as FD to disk. */
+bool fsync(int fd)
 {
+	struct file *file = fd_lookup(fd);
 
-	struct file *file = thread_current()->fdt[fd];
 	if (file == NULL)
-		return -1;
-	off_t length = file_length(file);
-	return length;
+		return false;
+	file_sync(file);
+	return true;
 }
 
-int read(int fd, void *buffer, unsigned size)
+void sync(void)
 {
-	validate_user_vaddr(buffer);
-	int return_val;
-	lock_acquire(&filesys_lock);
-	if (fd == 0)
+	filesys_sync();
+}
+
+/* Creates a pipe and installs descriptors for its two ends. */
+bool pipe(int fds[2])
+{
+	struct pipe *p = pipe_create();
+	struct file *ends[2] = {NULL, NULL};
+	int kfds[2] = {-1, -1};
+
+	if (p == NULL)
+		return false;
+	ends[0] = file_open_pipe(p, false);
+	ends[1] = file_open_pipe(p, true);
+	if (ends[0] != NULL && ends[1] != NULL)
 	{
-		int count = 0;
-		while (count < size)
-		{
-			*(uint8_t *)(buffer + count) = input_getc();
-			count++;
-		}
-		return_val = count;
+		kfds[0] = fd_install(ends[0]);
+		kfds[1] = fd_install(ends[1]);
 	}
-	else
+	if (kfds[0] < 0 || kfds[1] < 0)
 	{
-		struct file *file = thread_current()->fdt[fd];
-		if (file == NULL)
-		{
-			lock_release(&filesys_lock);
-			return -1;
-		}
-		return_val = file_read(file, buffer, size);
+		for (int i = 0; i < 2; i++)
+			if (kfds[i] >= 0)
+				fd_remove(kfds[i]);
+		if (ends[0] == NULL && ends[1] == NULL)
+			pipe_destroy(p);
+		file_close(ends[0]);
+		file_close(ends[1]);
+		return false;
 	}
-	lock_release(&filesys_lock);
-	return return_val;
+	if (!copy_to_user(fds, kfds, sizeof kfds))
+		exit(-1);
+	return true;
 }
 
-int write(int fd, const void *buffer, unsigned size)
+/* Semaphore raised by the objects that poll() waits for, and by
+   its timeout alarm, which also sets TIMED_OUT. */
+struct poll_wait
+{
+	struct semaphore sema;
+	bool timed_out;
+};
+
+static void poll_timeout(void *wait_)
+{
+	struct poll_wait *wait = wait_;
+
+	wait->timed_out = true;
+	sema_up(&wait->sema);
+}
+
+/* Returns the poll() events that FD is ready for.  If ENTRY is
+   nonnull, it is first added to the poll queue of the console or
+   pipe behind FD, if any, to raise SEMA. */
+static int poll_fd(int fd, struct poll_entry *entry, struct semaphore *sema)
 {
-	lock_acquire(&filesys_lock);
-	int return_val = -1;
+	struct file *file = fd_lookup(fd);
+
+	if (file != NULL)
+		return file_poll(file, entry, sema);
+	if (fd == 0)
+		return input_poll(entry, sema) ? POLLIN : 0;
 	if (fd == 1)
-	{
-		putbuf(buffer, size);
-		return_val = size;
-	}
+		return POLLOUT;
+	return POLLNVAL;
+}
+
+/* Registers on the poll queue of each object polled, then sleeps
+   until one of them or the timeout alarm wakes it, so a process
+   waiting on several descriptors uses no CPU time meanwhile. */
+int poll(struct pollfd *ufds, unsigned nfds, int timeout)
+{
+	struct pollfd fds[POLL_MAX];
+	struct poll_entry entries[POLL_MAX];
+	struct timer_alarm alarm;
+	struct poll_wait wait;
+	int ready;
+
+	if (nfds > POLL_MAX)
+		return -1;
+	if (!copy_from_user(fds, ufds, nfds * sizeof *fds))
+		exit(-1);
 
-	else
+	sema_init(&wait.sema, 0);
+	wait.timed_out = timeout == 0;
+	alarm.armed = false;
+	if (timeout > 0)
+		timer_alarm_set(&alarm, ms_to_ticks(timeout), poll_timeout, &wait);
+	for (unsigned i = 0; i < nfds; i++)
+		entries[i].queue = NULL;
+
+	for (bool first = true;; first = false)
 	{
-		struct file *f_path = thread_current()->fdt[fd];
-		if (f_path == NULL)
+		ready = 0;
+		for (unsigned i = 0; i < nfds; i++)
 		{
-			lock_release(&filesys_lock);
-			return -1;
+			int events = 0;
+
+			if (fds[i].fd >= 0)
+				events = poll_fd(fds[i].fd, first ? &entries[i] : NULL,
+						 &wait.sema);
+			fds[i].revents = events & (fds[i].events | POLLERR | POLLHUP
+						   | POLLNVAL);
+			if (fds[i].revents != 0)
+				ready++;
 		}
-		return_val = file_write(f_path, buffer, size);
+		if (ready > 0 || wait.timed_out)
+			break;
+		sema_down(&wait.sema);
 	}
-	lock_release(&filesys_lock);
-	return return_val;
+
+	timer_alarm_cancel(&alarm);
+	for (unsigned i = 0; i < nfds; i++)
+		poll_queue_remove(&entries[i]);
+	if (!copy_to_user(ufds, fds, nfds * sizeof *fds))
+		exit(-1);
+	return ready;
 }
 
-void seek(int fd, unsigned position)
+#if TIMER_FREQ != TICKS_PER_SEC
+#error TICKS_PER_SEC must match TIMER_FREQ
+#endif
+
+/* Copies kernel heap and page pool usage to *ST. */
+void memstat(struct memstat *st)
 {
-	struct file *f_path = thread_current()->fdt[fd];
-	if (f_path == NULL)
+	struct memstat kst;
+	struct malloc_stats ms;
+	struct palloc_stats ps;
+	size_t i;
+
+	palloc_get_stats(0, &ps);
+	kst.kernel_pages = ps.page_cnt;
+	kst.kernel_used = ps.used_cnt;
+	palloc_get_stats(PAL_USER, &ps);
+	kst.user_pages = ps.page_cnt;
+	kst.user_used = ps.used_cnt;
+
+	malloc_get_stats(&ms);
+	kst.big_blocks = ms.big_cnt;
+	kst.big_pages = ms.big_pages;
+	kst.class_cnt = ms.class_cnt < MEMSTAT_CLASSES ? ms.class_cnt
+						       : MEMSTAT_CLASSES;
+	for (i = 0; i < kst.class_cnt; i++)
 	{
-		return;
+		kst.classes[i].block_size = ms.classes[i].block_size;
+		kst.classes[i].in_use = ms.classes[i].in_use;
+		kst.classes[i].arenas = ms.classes[i].arena_cnt;
+		kst.classes[i].partial_free = ms.classes[i].partial_free;
 	}
-	return file_seek(f_path, position);
+	if (!copy_to_user(st, &kst, sizeof kst))
+		exit(-1);
 }
 
-unsigned tell(int fd)
+unsigned ticks(void)
 {
-	struct file *f_path = thread_current()->fdt[fd];
-	if (f_path == NULL)
-	{
+	return timer_ticks();
+}
+
+int getrusage(int who, struct rusage *usage)
+{
+	struct rusage kru;
+
+	if (!process_getrusage(who, &kru))
 		return -1;
-	}
-	return file_tell(f_path);
+	if (!copy_to_user(usage, &kru, sizeof kru))
+		exit(-1);
+	return 0;
 }
 
-void close(int fd)
+void clock_gettime(struct timespec *ts)
 {
-	struct file *f_path = thread_current()->fdt[fd];
-	if (f_path == NULL)
-	{
-		return;
-	}
-	file_close(f_path);
-	thread_current()->fdt[fd] = NULL;
+	int64_t ns = timer_clock_ns();
+	struct timespec kts;
+
+	kts.tv_sec = ns / 1000000000;
+	kts.tv_nsec = ns % 1000000000;
+	if (!copy_to_user(ts, &kts, sizeof kts))
+		exit(-1);
+}
+
+int inumber(int fd)
+{
+	struct file *file = fd_lookup(fd);
+	if (file == NULL || file_get_pipe(file) != NULL)
+		return -1;
+	return inode_get_inumber(file_get_inode(file));
+}
+
+#ifdef VM
+mapid_t mmap(int fd, void *addr)
+{
+	if (fd_lookup(fd) == NULL)
+		return MAP_FAILED;
+
+	/* The mapping outlives the descriptor, so it gets its own handle. */
+	struct file *file = file_reopen(fd_lookup(fd));
+	if (file == NULL)
+		return MAP_FAILED;
+	mapid_t mapid = vm_mmap(file, addr);
+	if (mapid == MAP_FAILED)
+		file_close(file);
+	return mapid;
+}
+
+void munmap(mapid_t mapid)
+{
+	vm_munmap(mapid);
+}
+
+int madvise(void *addr, unsigned length, int advice)
+{
+	return vm_madvise(addr, length, advice) ? 0 : -1;
+}
+
+bool vmstat(struct vmstat *st)
+{
+	struct vmstat kst;
+
+	vm_get_stats(&kst);
+	if (!copy_to_user(st, &kst, sizeof kst))
+		exit(-1);
+	return true;
+}
+
+void *sbrk(intptr_t increment)
+{
+	return vm_sbrk(increment);
+}
+
+int uthread_join(uthread_t tid)
+{
+	return process_thread_join(tid);
+}
+
+bool shm_create(const char *name, unsigned size)
+{
+	char *kname = copy_in_string(name);
+	if (kname == NULL)
+		return false;
+	bool success = vm_shm_create(kname, size);
+	palloc_free_page(kname);
+	return success;
+}
+
+void *shm_map(const char *name, void *addr)
+{
+	char *kname = copy_in_string(name);
+	if (kname == NULL)
+		return NULL;
+	void *uaddr = vm_shm_map(kname, addr);
+	palloc_free_page(kname);
+	return uaddr;
+}
+
+bool shm_unmap(void *addr)
+{
+	return vm_unmap_shared(addr);
+}
+
+struct ring *ring_setup(unsigned entries, void *addr)
+{
+	return vm_ring_setup(entries, addr);
+}
+
+int ring_enter(unsigned to_submit, unsigned min_complete)
+{
+	return vm_ring_enter(to_submit, min_complete);
 }
 
+/* In a process's initial thread, the same as exit(0). */
+void uthread_exit(void)
+{
+	if (process_current() == thread_current())
+		exit(0);
+	end_thread();
+}
+#endif
+
 void sched_yield(void)
 {
 	thread_yield();
 }
 
-void sigaction(int signum, void (*handler)(void))
+/* Returns the current process's limit on RESOURCE, or a null pointer
+   if there is no such resource. */
+static unsigned *rlimit_of(int resource)
 {
-	struct thread *cur = thread_current();
+	struct thread *leader = process_current();
 
-	int i = 0;
-	while (cur->save_signal[i] != NULL)
-		i++;
+	switch (resource)
+	{
+	case RLIMIT_RSS:
+		return &leader->rlimit_rss;
+	case RLIMIT_SWAP:
+		return &leader->rlimit_swap;
+	case RLIMIT_NOFILE:
+		return &leader->rlimit_nofile;
+	default:
+		return NULL;
+	}
+}
+
+bool setrlimit(int resource, unsigned limit)
+{
+	unsigned *rlimit = rlimit_of(resource);
+
+	if (rlimit == NULL)
+		return false;
+	*rlimit = limit;
+	return true;
+}
 
-	struct signal *sig_struct = (struct signal *)malloc(sizeof(struct signal));
+unsigned getrlimit(int resource)
+{
+	unsigned *rlimit = rlimit_of(resource);
 
-	sig_struct->signum = signum;
-	sig_struct->sig_handler = handler;
-	(cur->save_signal[i]) = sig_struct;
+	return rlimit != NULL ? *rlimit : 0;
 }
 
 void sendsig(pid_t pid, int signum)
 {
-	sendsig_thread(pid, signum);
+	signal_send(pid, signum);
 }
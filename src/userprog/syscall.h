@@ -1,10 +1,12 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include <stdbool.h>
 #include "lib/user/syscall.h"
 
-void syscall_init(void);
+struct intr_frame;
 
-extern struct lock filesys_lock;
+void syscall_init(void);
+bool syscall_sysenter(struct intr_frame *);
 
 #endif /* userprog/syscall.h */
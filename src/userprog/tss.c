@@ -4,7 +4,6 @@
 #include "userprog/gdt.h"
 #include "threads/thread.h"
 #include "threads/palloc.h"
-#include "threads/vaddr.h"
 
 /* The Task-State Segment (TSS).
 
@@ -96,11 +95,22 @@ tss_get (void)
   return tss;
 }
 
+/* Returns the address of the TSS's ring 0 stack pointer, which
+   always holds the running thread's kernel stack.  The SYSENTER
+   entry loads its stack from there, because SYSENTER itself can
+   only load a fixed stack pointer. */
+void **
+tss_esp0 (void) 
+{
+  ASSERT (tss != NULL);
+  return &tss->esp0;
+}
+
 /* Sets the ring 0 stack pointer in the TSS to point to the end
    of the thread stack. */
 void
 tss_update (void) 
 {
   ASSERT (tss != NULL);
-  tss->esp0 = (uint8_t *) thread_current () + PGSIZE;
+  tss->esp0 = thread_stack_top (thread_current ());
 }
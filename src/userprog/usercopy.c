@@ -0,0 +1,118 @@
+#include "userprog/usercopy.h"
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/vaddr.h"
+
+/* User memory is accessed only by the instructions below, with
+   the address to resume at loaded into %eax beforehand.  The MMU
+   does the checking: if the access faults and the page cannot be
+   brought in, usercopy_fixup() recognizes the faulting instruction
+   and continues at the resume address with %eax set to -1. */
+
+/* Reads the byte at user address UADDR, which must be below
+   PHYS_BASE.  Returns the byte value if successful, -1 if a
+   page fault occurred. */
+int usercopy_get_byte(const uint8_t *uaddr);
+extern const char usercopy_get_insn[];
+
+/* Copies SIZE bytes from SRC to DST, one of which is in user
+   memory.  Returns 0 if successful, -1 if a page fault occurred. */
+int usercopy_move(void *dst, const void *src, size_t size);
+extern const char usercopy_move_insn[];
+
+asm(".text\n"
+    ".globl usercopy_get_byte\n"
+    "usercopy_get_byte:\n"
+    "  movl 4(%esp), %edx\n"
+    "  movl $1f, %eax\n"
+    ".globl usercopy_get_insn\n"
+    "usercopy_get_insn:\n"
+    "  movzbl (%edx), %eax\n"
+    "1:\n"
+    "  ret\n"
+    "\n"
+    ".globl usercopy_move\n"
+    "usercopy_move:\n"
+    "  pushl %esi\n"
+    "  pushl %edi\n"
+    "  movl 12(%esp), %edi\n"
+    "  movl 16(%esp), %esi\n"
+    "  movl 20(%esp), %ecx\n"
+    "  movl $1f, %eax\n"
+    ".globl usercopy_move_insn\n"
+    "usercopy_move_insn:\n"
+    "  rep movsb\n"
+    "  xorl %eax, %eax\n"
+    "1:\n"
+    "  popl %edi\n"
+    "  popl %esi\n"
+    "  ret\n");
+
+/* Returns true if [UADDR, UADDR + SIZE) lies entirely in user
+   virtual memory. */
+static bool
+is_user_range(const void *uaddr, size_t size)
+{
+  return uaddr != NULL && is_user_vaddr(uaddr)
+         && size <= (size_t)((const uint8_t *)PHYS_BASE - (const uint8_t *)uaddr);
+}
+
+/* Copies SIZE bytes from user address USRC to kernel address DST.
+   Returns false without copying everything if any part of the
+   source is not valid, mapped user memory. */
+bool copy_from_user(void *dst, const void *usrc, size_t size)
+{
+  if (size == 0)
+    return true;
+  return is_user_range(usrc, size) && usercopy_move(dst, usrc, size) == 0;
+}
+
+/* Copies SIZE bytes from kernel address SRC to user address UDST.
+   Returns false without copying everything if any part of the
+   destination is not valid, writable user memory. */
+bool copy_to_user(void *udst, const void *src, size_t size)
+{
+  if (size == 0)
+    return true;
+  return is_user_range(udst, size) && usercopy_move(udst, src, size) == 0;
+}
+
+/* Copies the null-terminated string at user address USRC into DST,
+   which has room for SIZE bytes.  Returns the length of the string,
+   or SIZE if it did not fit, in which case DST is not terminated.
+   Returns -1 if the string is not in valid user memory. */
+int strncpy_from_user(char *dst, const char *usrc, size_t size)
+{
+  const uint8_t *src = (const uint8_t *)usrc;
+  size_t i;
+
+  if (usrc == NULL)
+    return -1;
+  for (i = 0; i < size; i++)
+  {
+    int byte;
+
+    if (!is_user_vaddr(src + i))
+      return -1;
+    byte = usercopy_get_byte(src + i);
+    if (byte < 0)
+      return -1;
+    dst[i] = byte;
+    if (byte == '\0')
+      return i;
+  }
+  return size;
+}
+
+/* Called by the page fault handler for a kernel-mode fault.  If
+   the fault happened at one of the user access instructions above,
+   arranges for the access to return -1 and returns true. */
+bool usercopy_fixup(struct intr_frame *f)
+{
+  if (f->eip != (void *)usercopy_get_insn
+      && f->eip != (void *)usercopy_move_insn)
+    return false;
+  f->eip = (void *)f->eax;
+  f->eax = 0xffffffff;
+  return true;
+}
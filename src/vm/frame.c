@@ -1,67 +1,374 @@
 #include <debug.h>
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
 #include "threads/palloc.h"
-#include "lib/kernel/list.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+#include "filesys/inode.h"
 #include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "userprog/signal.h"
+#include "userprog/syscall.h"
 #include "vm/page.h"
 #include "threads/pte.h"
 #include "vm/swap.h"
 #include "vm/frame.h"
 
-struct list frame_table;
+/* One entry per user pool page, indexed by
+   (frame - frame_base) / PGSIZE. */
+static struct frame_table_entry *frame_table;
+static size_t frame_cnt;
+static uint8_t *frame_base;
 
-/* Synchronization lock for the frame table */
+/* Extra mappings of shared frames */
+static struct kmem_cache mapping_cache;
+
+/* Clock hand: index of the frame select_frames_for_eviction() starts
+   its sweep at, so that equally old frames are taken in turn.
+   Protected by frame_table_lock. */
+static size_t clock_hand;
+
+/* Page ager.  Every AGE_INTERVAL ticks the "page-ager" thread shifts
+   each frame's accessed bits into the top of its age, so that a frame
+   used in every recent interval has a high age and one untouched for
+   AGE_BITS intervals has age 0.  Eviction takes the youngest frame. */
+#define AGE_BITS 8
+#define AGE_INTERVAL (TIMER_FREQ / 4)
+static thread_func ager_daemon NO_RETURN;
+static unsigned frame_age(struct frame_table_entry *);
+
+/* Load control.  With -loadctl, after each pass of the ager a
+   process's working set is estimated as its frames used in the last
+   AGE_BITS intervals plus its major faults in the last interval.
+   While the working sets of the running processes add up to more
+   than the user pool, the lowest-priority one is suspended: its
+   frames are evicted, and its threads wait in frame_load_wait() at
+   their next page fault from user mode.  A suspended process is
+   resumed, highest priority first, once its working set at
+   suspension fits beside the others', or when no other process is
+   left running. */
+bool frame_loadctl_enabled;
+static struct condition load_resumed;   /* Signaled on resumption. */
+struct load_scan
+{
+  size_t demand;            /* Working sets of running processes */
+  unsigned running;         /* Number of running processes */
+  struct thread *victim;    /* Process to suspend */
+  struct thread *resume;    /* Suspended process to resume first */
+};
+static void load_control(void);
+
+/* Number of frames in use.  Protected by frame_table_lock. */
+static size_t frame_used_cnt;
+
+/* Synchronization lock for the frame table.  Also held across
+   eviction, so that a frame cannot change owner while its content
+   is being saved. */
 static struct lock frame_table_lock;
 
-/* Lock to ensure atomicity during frame eviction */
-static struct lock eviction_lock;
+/* Page cleaner.  When fewer than cleaner_low_water frames are free,
+   the "page-cleaner" thread writes back dirty frames that have not
+   been accessed recently, every CLEAN_INTERVAL ticks, until it sees
+   CLEAN_TARGET frames that could be evicted without any I/O. */
+#define CLEAN_TARGET 8
+#define CLEAN_BATCH 4
+#define CLEAN_INTERVAL (TIMER_FREQ / 10)
+static size_t cleaner_low_water;
+static size_t cleaner_hand;
+static struct condition cleaner_wake;   /* Signaled when frames run low. */
+static struct condition cleaning_done;  /* Signaled when a write-back ends. */
+static thread_func cleaner_daemon NO_RETURN;
+static bool frame_needs_write(struct frame_table_entry *);
+static bool clean_frames(struct frame_table_entry *[], size_t);
+
+/* Page merger.  With -merge, the "page-merger" thread hashes every
+   anonymous frame each MERGE_INTERVAL ticks.  A frame whose hash has
+   not changed since the previous pass is stable; one that is
+   byte-identical to another stable frame gives up its frame and maps
+   the other one copy-on-write, as a fork would.  Only frames with a
+   single mapping are given up.  merge_table, protected by
+   frame_table_lock, holds the stable frames of the current pass. */
+#define MERGE_INTERVAL TIMER_FREQ
+bool frame_merge_enabled;
+static struct hash merge_table;
+static hash_hash_func merge_hash;
+static hash_less_func merge_less;
+static thread_func merge_daemon NO_RETURN;
 
 /* Functions for managing frame table entries */
 static bool add_frame_to_table(void *);
+static void init_frame_entry(struct frame_table_entry *, struct thread *);
+static void release_frame_entry(struct frame_table_entry *);
 static void remove_frame_from_table(void *);
 /* Retrieve the frame table entry for a given frame */
 static struct frame_table_entry *get_frame_table_entry(void *);
+static bool is_frame(const void *);
+
+/* The page cache: shareable frames, keyed by inode and offset.
+   Protected by frame_table_lock. */
+static struct hash share_table;
+static hash_hash_func share_hash;
+static hash_less_func share_less;
+static bool frame_accessed(struct frame_table_entry *, bool);
+static void unshare_frame(struct frame_table_entry *);
+static bool cache_copy(struct inode *, off_t, void *, size_t, bool);
+static bool drop_mapping(struct frame_table_entry *, struct thread *,
+                         void *);
+static void shm_unref(struct frame_table_entry *);
+
+/* Out-of-memory killer.  When no frame can be allocated or evicted,
+   the process with the most frames and swap slots is sent SIGKILL,
+   and the allocation is retried once it has exited or OOM_WAIT ticks
+   have passed.  A process that has already exited but is still
+   freeing its frames is waited for instead of killing another. */
+#define OOM_WAIT (TIMER_FREQ / 10)
+struct oom_victim
+{
+  struct thread *t;         /* Process chosen so far */
+  tid_t tid;                /* Its pid */
+  unsigned score;           /* Its frames plus swap slots */
+  bool exited;              /* Already exited, freeing its frames? */
+};
+static bool oom_kill(struct thread *);
 
 /* Functions for frame eviction */
-static struct frame_table_entry *select_frame_for_eviction(void); // Select a frame to evict
+static size_t evict_frames(struct thread *, void *[], size_t);
+static size_t select_frames_for_eviction(struct thread *,
+                                         struct frame_table_entry *[],
+                                         size_t);
+static bool swap_blocked(struct frame_table_entry *);
 /* Save the content of the evicted frame for future use */
-static bool save_evicted_frame_content(struct frame_table_entry *);
+static void save_evicted_frame_content(struct frame_table_entry *);
+static void save_page(struct frame_table_entry *, struct suppl_pte *,
+                      struct thread *, bool);
 
 
 /* Initialize the frame table and necessary data structures */
 void
 frame_table_init()
 {
-  list_init(&frame_table);
-  lock_init(&frame_table_lock);
-  lock_init(&eviction_lock);
+  frame_base = palloc_user_base();
+  frame_cnt = palloc_user_page_cnt();
+  frame_table = calloc(frame_cnt, sizeof *frame_table);
+  kmem_cache_init(&mapping_cache, "frame_mapping",
+                  sizeof(struct frame_mapping), NULL);
+  if (frame_table == NULL)
+    PANIC("Failed to allocate the frame table");
+  hash_init(&share_table, share_hash, share_less, NULL);
+  lock_init_named(&frame_table_lock, "frame table");
+  cond_init(&cleaner_wake);
+  cond_init(&cleaning_done);
+  cond_init(&load_resumed);
+  cleaner_low_water = frame_cnt / 16 + 1;
+  hash_init(&merge_table, merge_hash, merge_less, NULL);
+}
+
+/* Start the page cleaner.  Needs the swap device, so it runs after
+   vm_swap_init(). */
+void
+frame_cleaner_init(void)
+{
+  thread_create("page-cleaner", PRI_DEFAULT, cleaner_daemon, NULL);
+  thread_create("page-ager", PRI_DEFAULT, ager_daemon, NULL);
+  if (frame_merge_enabled)
+    thread_create("page-merger", PRI_DEFAULT, merge_daemon, NULL);
+}
+
+/* Returns true if T may not take another frame without giving one
+   up. */
+static bool
+at_rss_limit(struct thread *t)
+{
+  return (unsigned)t->vm_resident >= t->rlimit_rss;
 }
 
-/* Allocate a page from the USER_POOL and add an entry to the frame table */
+/* Allocate a page from the USER_POOL and add an entry to the frame table.
+   A process at its resident limit gets one of its own frames back,
+   unless none can be evicted.  Evicted frames come back zeroed.  When
+   nothing can be evicted either, the OOM killer makes room; returns a
+   null pointer if it chose the current process or found no victim. */
 void *
 allocate_frame(enum palloc_flags flags)
 {
-  void *frame = NULL;
+  struct thread *t = process_current();
+  void *frame;
 
-  /* Try to allocate a page from the user pool */
-  if (flags & PAL_USER)
+  ASSERT(flags & PAL_USER);
+  if (at_rss_limit(t) && (frame = evict_frame(t)) != NULL)
+    return frame;
+
+  for (;;)
   {
-    if (flags & PAL_ZERO)
-      frame = palloc_get_page(PAL_USER | PAL_ZERO);
-    else
-      frame = palloc_get_page(PAL_USER);
+    frame = palloc_get_page(PAL_USER | (flags & PAL_ZERO));
+    if (frame != NULL)
+    {
+      add_frame_to_table(frame);
+      return frame;
+    }
+    frame = evict_frame(NULL);
+    if (frame != NULL)
+      return frame;
+    if (signal_killed(t) || !oom_kill(t))
+      return NULL;
+  }
+}
+
+/* Allocate up to CNT frames into FRAMES, adding all of them to the
+   frame table under one acquisition of frame_table_lock, for a caller
+   that loads several pages at once.  Free frames are taken first.  If
+   EVICT is true and they run short, the rest are evicted in a single
+   sweep of the clock; evicted frames come back zeroed.  Never takes
+   the process past its resident limit and never calls the OOM killer.
+   Returns the number of frames allocated, which may be less than CNT,
+   even 0. */
+size_t
+allocate_frames(enum palloc_flags flags, void *frames[], size_t cnt,
+                bool evict)
+{
+  struct thread *t = process_current();
+  size_t room, got, i;
+
+  ASSERT(flags & PAL_USER);
+  ASSERT(cnt <= FRAME_BATCH);
+  room = at_rss_limit(t) ? 0 : t->rlimit_rss - t->vm_resident;
+  for (got = 0; got < cnt && got < room; got++)
+  {
+    frames[got] = palloc_get_page(PAL_USER | (flags & PAL_ZERO));
+    if (frames[got] == NULL)
+      break;
+  }
+
+  lock_acquire(&frame_table_lock);
+  for (i = 0; i < got; i++)
+    init_frame_entry(get_frame_table_entry(frames[i]), t);
+  if (evict && got < cnt)
+  {
+    /* Frames of other processes while there is room under the
+       limit, then the process's own. */
+    if (got < room)
+      got += evict_frames(NULL, frames + got,
+                          (cnt < room ? cnt : room) - got);
+    if (got < cnt && got >= room)
+      got += evict_frames(t, frames + got, cnt - got);
+  }
+  if (frame_cnt - frame_used_cnt < cleaner_low_water)
+    cond_signal(&cleaner_wake, &frame_table_lock);
+  lock_release(&frame_table_lock);
+  return got;
+}
+
+/* Adds T to the OOM killer's choice in AUX, a struct oom_victim,
+   if T is a process with a higher score, or if it has exited and
+   still holds frames, which beats any score. */
+static void
+oom_consider(struct thread *t, void *aux)
+{
+  struct oom_victim *v = aux;
+  unsigned score;
+
+  if (t->leader == t && t->exited && t->vm_resident > 0)
+  {
+    if (!v->exited)
+    {
+      v->t = t;
+      v->tid = t->tid;
+      v->exited = true;
+    }
+    return;
+  }
+  if (v->exited || t->leader != t || t->pagedir == NULL || t->dying
+      || signal_killed(t))
+    return;
+  score = t->vm_resident + t->vm_swap_slots;
+  if (v->t == NULL || score > v->score)
+  {
+    v->t = t;
+    v->tid = t->tid;
+    v->score = score;
+  }
+}
+
+/* Sends SIGKILL to the process holding the most frames and swap
+   slots, and gives it up to OOM_WAIT ticks to exit and free them, or
+   just waits as long for a process that has exited to free its
+   frames.  The victim may be CUR.  Returns false if it was, or if there is no
+   process left to kill. */
+static bool
+oom_kill(struct thread *cur)
+{
+  struct oom_victim v = {NULL, TID_ERROR, 0, false};
+  enum intr_level old_level;
+  int i;
+
+  old_level = intr_disable();
+  thread_foreach(oom_consider, &v);
+  intr_set_level(old_level);
+  if (v.t == NULL)
+    return false;
+  if (!v.exited)
+  {
+    signal_send(v.tid, SIGKILL);
+    if (v.t == cur)
+      return false;
+  }
+
+  for (i = 0; i < OOM_WAIT; i++)
+  {
+    bool gone;
+
+    timer_sleep(1);
+    old_level = intr_disable();
+    gone = thread_get_by_id(v.tid) != v.t || v.t->vm_resident == 0;
+    intr_set_level(old_level);
+    if (gone)
+      break;
   }
+  return true;
+}
+
+/* Allocates a zeroed run of PTSPAN / PGSIZE frames whose physical
+   address is 4 MB aligned, for a large page of the current process,
+   and adds each frame to the frame table.  Nothing is evicted:
+   returns a null pointer if the user pool has no such run free, or
+   would be left below the page cleaner's low water mark, or the
+   process would pass its resident limit. */
+void *
+frame_allocate_large(void)
+{
+  struct thread *t = process_current();
+  size_t cnt = PTSPAN / PGSIZE;
+  uint8_t *frames;
+  size_t i;
+
+  if ((unsigned) t->vm_resident + cnt > t->rlimit_rss
+      || frame_cnt - frame_used_cnt < cnt + cleaner_low_water)
+    return NULL;
+  frames = palloc_get_aligned(PAL_USER | PAL_ZERO, cnt);
+  if (frames == NULL)
+    return NULL;
+  for (i = 0; i < cnt; i++)
+    add_frame_to_table(frames + i * PGSIZE);
+  return frames;
+}
+
+/* Like allocate_frame(), but returns a null pointer instead of
+   evicting when the user pool is exhausted or the process is at its
+   resident limit */
+void *
+frame_try_allocate(enum palloc_flags flags)
+{
+  void *frame;
+
+  if (at_rss_limit(process_current()))
+    return NULL;
+  frame = palloc_get_page(flags | PAL_USER);
 
-  /* If allocation succeeds, add to the frame table.
-     Otherwise, evict a page to swap space and fail the allocator for now. */
   if (frame != NULL)
     add_frame_to_table(frame);
-  else if ((frame = evict_frame()) == NULL)
-    PANIC("Eviction failed");
-
   return frame;
 }
 
@@ -75,204 +382,1331 @@ free_frame(void *frame)
   palloc_free_page(frame);
 }
 
-/* Set the PTE attribute for a given frame */
+/* Free the CNT frames in FRAMES, removing their entries from the
+   frame table under one acquisition of frame_table_lock */
 void
-set_frame_user_page(void *frame, uint32_t *pte, void *upage)
+free_frames(void *frames[], size_t cnt)
 {
-  struct frame_table_entry *fte;
-  fte = get_frame_table_entry(frame);
-  if (fte != NULL)
-  {
-    fte->pte = pte;
-    fte->user_page = upage;
-  }
+  size_t i;
+
+  lock_acquire(&frame_table_lock);
+  for (i = 0; i < cnt; i++)
+    release_frame_entry(get_frame_table_entry(frames[i]));
+  lock_release(&frame_table_lock);
+  for (i = 0; i < cnt; i++)
+    palloc_free_page(frames[i]);
 }
 
-/* Evict a frame and save its content for later use */
-void *
-evict_frame()
+/* Record that FRAME now holds the page described by SPTE, making it
+   eligible for eviction */
+void
+set_frame_user_page(void *frame, struct suppl_pte *spte)
 {
-  bool result;
-  struct frame_table_entry *fte;
-  struct thread *t = thread_current();
-
-  lock_acquire(&eviction_lock);
+  struct frame_table_entry *fte = get_frame_table_entry(frame);
 
-  fte = select_frame_for_eviction();
-  if (fte == NULL)
-    PANIC("No frame available for eviction.");
+  lock_acquire(&frame_table_lock);
+  fte->spte = spte;
+  fte->user_page = spte->user_vaddr;
+  lock_release(&frame_table_lock);
+}
 
-  result = save_evicted_frame_content(fte);
-  if (!result)
-    PANIC("Failed to save evicted frame content");
-  
-  fte->tid = t->tid;
-  fte->pte = NULL;
-  fte->user_page = NULL;
+/* Pin the frame backing user page UPAGE of thread T so it cannot be
+   evicted.  Returns false if UPAGE is not currently resident.  Pages
+   mapped outside the user pool, such as the shared zero page, are
+   never evicted and count as pinned. */
+bool
+frame_pin_user_page(struct thread *t, void *upage)
+{
+  void *kpage;
 
-  lock_release(&eviction_lock);
+  lock_acquire(&frame_table_lock);
+  kpage = pagedir_get_page(t->pagedir, upage);
+  if (kpage != NULL && is_frame(kpage))
+    get_frame_table_entry(kpage)->pin_cnt++;
+  lock_release(&frame_table_lock);
 
-  return fte->frame;
+  return kpage != NULL;
 }
 
-/* Select a frame to evict */
-static struct frame_table_entry *
-select_frame_for_eviction()
+/* Undo frame_pin_user_page() */
+void
+frame_unpin_user_page(struct thread *t, void *upage)
 {
-  struct frame_table_entry *fte;
-  struct thread *t;
-  struct list_elem *e;
+  void *kpage;
+
+  lock_acquire(&frame_table_lock);
+  kpage = pagedir_get_page(t->pagedir, upage);
+  if (kpage != NULL && is_frame(kpage))
+  {
+    struct frame_table_entry *fte = get_frame_table_entry(kpage);
+    ASSERT(fte->pin_cnt > 0);
+    fte->pin_cnt--;
+  }
+  lock_release(&frame_table_lock);
+}
 
-  struct frame_table_entry *candidate_frame = NULL;
+/* Unmap user page UPAGE of thread T and free its frame, if it is
+   resident in one.  A shared frame stays with its other mappers and
+   is only freed along with its last mapping. */
+void
+frame_release_page(struct thread *t, void *upage)
+{
+  void *kpage;
 
-  int rounds = 1;
-  bool found = false;
-  /* Iterate through the frame table to find a suitable frame to evict */
-  while (!found)
+  lock_acquire(&frame_table_lock);
+  kpage = pagedir_get_page(t->pagedir, upage);
+  if (kpage != NULL && is_frame(kpage))
   {
-    /* Traverse the frame table to locate a frame to evict.
-       Try to find a (0,0) class frame. If not found, set the accessed bit to 0.
-       The maximum number of rounds is 2, ensuring we find a suitable frame. */
-    e = list_head(&frame_table);
-    while ((e = list_next(e)) != list_tail(&frame_table))
+    struct frame_table_entry *fte = get_frame_table_entry(kpage);
+
+    if (fte->shm_refs > 0)
     {
-      fte = list_entry(e, struct frame_table_entry, elem);
-      t = thread_get_by_id(fte->tid);
-      bool accessed = pagedir_is_accessed(t->pagedir, fte->user_page);
-      if (!accessed)
-      {
-        candidate_frame = fte;
-        list_remove(e);
-        list_push_back(&frame_table, e);
-        break;
-      }
-      else
-      {
-        pagedir_set_accessed(t->pagedir, fte->user_page, false);
-      }
+      if (drop_mapping(fte, t, upage))
+        shm_unref(fte);
+      lock_release(&frame_table_lock);
+      return;
+    }
+    if (fte->owner != t || fte->user_page != upage
+        || !list_empty(&fte->mappings))
+    {
+      drop_mapping(fte, t, upage);
+      lock_release(&frame_table_lock);
+      return;
     }
 
-    if (candidate_frame != NULL)
-      found = true;
-    else if (rounds++ == 2)
-      found = true;
+    while (fte->cleaning)
+      cond_wait(&cleaning_done, &frame_table_lock);
+    pagedir_clear_page(t->pagedir, upage);
+    unshare_frame(fte);
+    fte->in_use = false;
+    frame_used_cnt--;
+    t->vm_resident--;
+    palloc_free_page(kpage);
+  }
+  lock_release(&frame_table_lock);
+}
+
+/* If the frame holding the page at offset OFS of INODE is resident,
+   map it at SPTE's page in the current process, WRITABLE or not, and
+   return it.  Otherwise return a null pointer. */
+void *
+frame_share_map(struct inode *inode, off_t ofs, struct suppl_pte *spte,
+                bool writable)
+{
+  struct thread *cur = process_current();
+  struct frame_table_entry key, *fte;
+  struct frame_mapping *m;
+  struct hash_elem *e;
+  void *kpage = NULL;
+
+  key.share_inode = inode;
+  key.share_ofs = ofs;
+
+  lock_acquire(&frame_table_lock);
+  e = hash_find(&share_table, &key.share_elem);
+  if (e != NULL)
+  {
+    fte = hash_entry(e, struct frame_table_entry, share_elem);
+    m = kmem_cache_alloc(&mapping_cache);
+    if (m != NULL
+        && pagedir_set_page(cur->pagedir, spte->user_vaddr, fte->frame,
+                            writable))
+    {
+      m->owner = cur;
+      m->pagedir = cur->pagedir;
+      m->spte = spte;
+      list_push_back(&fte->mappings, &m->elem);
+      spte->is_loaded = true;
+      kpage = fte->frame;
+    }
+    else
+      kmem_cache_free(&mapping_cache, m);
   }
+  lock_release(&frame_table_lock);
 
-  return candidate_frame;
+  return kpage;
 }
 
-/* Save the content of an evicted frame for future use */
+/* Make FRAME, which holds the full page at offset OFS of INODE,
+   available to frame_share_map(), read() and write().  Does nothing
+   if another frame already holds that page. */
+void
+frame_share_register(void *frame, struct inode *inode, off_t ofs)
+{
+  struct frame_table_entry *fte = get_frame_table_entry(frame);
+
+  lock_acquire(&frame_table_lock);
+  fte->share_inode = inode;
+  fte->share_ofs = ofs;
+  if (hash_insert(&share_table, &fte->share_elem) != NULL)
+    fte->share_inode = NULL;
+  else
+    inode_add_cached_pages(inode, 1);
+  lock_release(&frame_table_lock);
+}
+
+/* If the page of INODE holding offset OFS is in the page cache, copy
+   SIZE bytes at OFS, which must not cross into the next page, into
+   BUF and return true.  Otherwise return false. */
+bool
+frame_cache_read(struct inode *inode, off_t ofs, void *buf, size_t size)
+{
+  return cache_copy(inode, ofs, buf, size, false);
+}
+
+/* If the page of INODE holding offset OFS is in the page cache, copy
+   SIZE bytes from BUF into it at OFS, which must not cross into the
+   next page, and return true, so that mappings of the page see data
+   written to the file.  Otherwise return false. */
+bool
+frame_cache_write(struct inode *inode, off_t ofs, const void *buf,
+                  size_t size)
+{
+  return cache_copy(inode, ofs, (void *) buf, size, true);
+}
+
+/* Copy SIZE bytes between BUF and offset OFS of INODE in the page
+   cache, into the page if WRITE.  The frame is marked as cleaning
+   while the lock is dropped for the copy, which keeps it from being
+   evicted or freed.  A write-back of a frame, from eviction with the
+   lock held or from the page cleaner, writes the frame's own
+   content, which is left alone. */
 static bool
-save_evicted_frame_content(struct frame_table_entry *fte)
+cache_copy(struct inode *inode, off_t ofs, void *buf, size_t size,
+           bool write)
 {
-  struct thread *t;
-  struct suppl_pte *spte;
+  struct frame_table_entry key, *fte;
+  struct hash_elem *e;
+  uint8_t *kaddr;
 
-  /* Get the thread corresponding to the frame */
-  t = thread_get_by_id(fte->tid);
+  ASSERT(ofs % PGSIZE + size <= PGSIZE);
+  if (lock_held_by_current_thread(&frame_table_lock))
+    return false;
 
-  /* Get the supplemental page table entry for the frame's user page */
-  spte = get_suppl_pte(&t->suppl_page_table, fte->user_page);
+  key.share_inode = inode;
+  key.share_ofs = ofs - ofs % PGSIZE;
 
-  /* If no supplemental page table entry is found, create one */
-  if (spte == NULL)
+  lock_acquire(&frame_table_lock);
+  for (;;)
   {
-    spte = calloc(1, sizeof *spte);
-    spte->user_vaddr = fte->user_page;
-    spte->type = SWAP;
-    if (!insert_suppl_pte(&t->suppl_page_table, spte))
+    e = hash_find(&share_table, &key.share_elem);
+    if (e == NULL)
+    {
+      lock_release(&frame_table_lock);
       return false;
+    }
+    fte = hash_entry(e, struct frame_table_entry, share_elem);
+    kaddr = (uint8_t *) fte->frame + ofs % PGSIZE;
+    if (kaddr == buf)
+    {
+      lock_release(&frame_table_lock);
+      return true;
+    }
+    if (!fte->cleaning)
+      break;
+    cond_wait(&cleaning_done, &frame_table_lock);
   }
+  fte->cleaning = true;
+  lock_release(&frame_table_lock);
 
-  size_t swap_slot_index;
-  /* If the page is dirty and is a memory-mapped file, write it back to the file.
-     Otherwise, if the page is dirty, move it to the swap space.
-     If the page is clean and not a file, it is a stack page and needs to be moved to swap. */
-  if (pagedir_is_dirty(t->pagedir, spte->user_vaddr) && (spte->type == MMF))
+  if (write)
+    memcpy(kaddr, buf, size);
+  else
+    memcpy(buf, kaddr, size);
+
+  lock_acquire(&frame_table_lock);
+  fte->cleaning = false;
+  cond_broadcast(&cleaning_done, &frame_table_lock);
+  lock_release(&frame_table_lock);
+  return true;
+}
+
+/* Give the current process, a fork of PARENT, the page that PARENT
+   has at SPTE's address, whose supplemental entry PSPTE has already
+   been copied to SPTE.  If the page is resident its frame is shared:
+   writable pages become read-only in both processes, to be copied by
+   frame_break_cow() on the first write.  Otherwise SPTE is updated to
+   PSPTE's current backing store and false is returned. */
+bool
+frame_fork_page(struct thread *parent, struct suppl_pte *pspte,
+                struct suppl_pte *spte)
+{
+  struct thread *cur = process_current();
+  void *upage = spte->user_vaddr;
+  struct frame_mapping *m;
+  void *kpage;
+  bool shared = false;
+
+  m = kmem_cache_alloc(&mapping_cache);
+  if (m == NULL)
+    return false;
+
+  lock_acquire(&frame_table_lock);
+
+  /* Shared frames are never written back by the page cleaner, which
+     keeps the handover in drop_mapping() simple. */
+  for (;;)
   {
-    write_page_back_to_file_wo_lock(spte);
+    kpage = pagedir_get_page(parent->pagedir, upage);
+    if (kpage == NULL || !is_frame(kpage)
+        || !get_frame_table_entry(kpage)->cleaning)
+      break;
+    cond_wait(&cleaning_done, &frame_table_lock);
   }
-  else if (pagedir_is_dirty(t->pagedir, spte->user_vaddr) || (spte->type != FILE))
+  spte->type = pspte->type;
+  spte->swap_slot_index = pspte->swap_slot_index;
+  if (kpage != NULL && is_frame(kpage)
+      && pagedir_set_page(cur->pagedir, upage, kpage, false))
   {
-    swap_slot_index = vm_swap_out(spte->user_vaddr);
-    if (swap_slot_index == SWAP_ERROR)
-      return false;
+    struct frame_table_entry *fte = get_frame_table_entry(kpage);
 
-    spte->type = spte->type | SWAP;
+    m->owner = cur;
+    m->pagedir = cur->pagedir;
+    m->spte = spte;
+    list_push_back(&fte->mappings, &m->elem);
+    if (suppl_pte_writable(pspte))
+    {
+      pagedir_set_writable(parent->pagedir, upage, false);
+      pspte->cow = spte->cow = true;
+    }
+    /* Each mapping goes to swap on its own if evicted, so it must
+       know whether the page differs from its file. */
+    if (pagedir_is_dirty(parent->pagedir, upage))
+      pagedir_set_dirty(cur->pagedir, upage, true);
+    spte->is_loaded = true;
+    shared = true;
   }
+  lock_release(&frame_table_lock);
 
-  memset(fte->frame, 0, PGSIZE);
-  /* Update swap attributes */
-  spte->swap_slot_index = swap_slot_index;
-  spte->swap_writable = *(fte->pte) & PTE_W;
+  if (!shared)
+    kmem_cache_free(&mapping_cache, m);
+  return shared;
+}
 
-  spte->is_loaded = false;
+/* Give the current process a private, writable copy of the page at
+   SPTE's address, which shares a frame copy-on-write.  If no one
+   else maps the frame any more it is simply made writable.  Returns
+   true if the write may be retried. */
+bool
+frame_break_cow(struct suppl_pte *spte)
+{
+  struct thread *t = process_current();
+  void *upage = spte->user_vaddr;
+  struct frame_table_entry *fte;
+  void *kpage, *copy;
+  bool dirty;
+
+  lock_acquire(&frame_table_lock);
+  kpage = pagedir_get_page(t->pagedir, upage);
+  if (kpage == NULL || !is_frame(kpage))
+  {
+    /* Evicted in the meantime; the retry faults it back in. */
+    lock_release(&frame_table_lock);
+    return kpage == NULL;
+  }
+  fte = get_frame_table_entry(kpage);
+  fte->pin_cnt++;
+  lock_release(&frame_table_lock);
+
+  copy = NULL;
+  if (fte->owner != t || !list_empty(&fte->mappings))
+  {
+    copy = allocate_frame(PAL_USER);
+    if (copy == NULL)
+    {
+      lock_acquire(&frame_table_lock);
+      fte->pin_cnt--;
+      lock_release(&frame_table_lock);
+      return false;
+    }
+    memcpy(copy, kpage, PGSIZE);
+  }
 
-  /* Unmap the page from the user's page directory and free the frame */
-  pagedir_clear_page(t->pagedir, spte->user_vaddr);
+  lock_acquire(&frame_table_lock);
+  fte->pin_cnt--;
+  if (fte->owner == t && list_empty(&fte->mappings))
+  {
+    /* The last other mapper went away: keep the frame. */
+    pagedir_set_writable(t->pagedir, upage, true);
+    spte->cow = false;
+    lock_release(&frame_table_lock);
+    if (copy != NULL)
+      free_frame(copy);
+    return true;
+  }
+  ASSERT(copy != NULL);
+  dirty = pagedir_is_dirty(t->pagedir, upage);
+  drop_mapping(fte, t, upage);
+  lock_release(&frame_table_lock);
 
+  /* The page table already exists, so remapping cannot fail. */
+  if (!pagedir_set_page(t->pagedir, upage, copy, true))
+    PANIC("remapping a copy-on-write page failed");
+  pagedir_set_dirty(t->pagedir, upage, dirty);
+  spte->cow = false;
+  set_frame_user_page(copy, spte);
   return true;
 }
 
-/* Add an entry to the frame table */
-static bool
-add_frame_to_table(void *frame)
+/* Allocate a zeroed frame for a page of a shared-memory segment.
+   It belongs to no process, is never evicted, and is freed once
+   frame_shm_release() and frame_shm_unmap() have dropped the
+   segment's reference and those of all its mappings.  Returns a null
+   pointer if memory is short. */
+void *
+frame_shm_alloc(void)
 {
+  void *frame = allocate_frame(PAL_USER | PAL_ZERO);
   struct frame_table_entry *fte;
-  fte = calloc(1, sizeof *fte);
 
-  if (fte == NULL)
-    return false;
+  if (frame == NULL)
+    return NULL;
+  fte = get_frame_table_entry(frame);
+  lock_acquire(&frame_table_lock);
+  fte->owner->vm_resident--;
+  fte->owner = NULL;
+  fte->pagedir = NULL;
+  fte->shm_refs = 1;
+  lock_release(&frame_table_lock);
+  return frame;
+}
 
-  fte->tid = thread_current()->tid;
-  fte->frame = frame;
+/* Map shared-memory FRAME writable at SPTE's page in the current
+   process.  Returns false if memory is short. */
+bool
+frame_shm_map(void *frame, struct suppl_pte *spte)
+{
+  struct thread *cur = process_current();
+  struct frame_table_entry *fte = get_frame_table_entry(frame);
+  struct frame_mapping *m = kmem_cache_alloc(&mapping_cache);
+  bool success = false;
 
+  if (m == NULL)
+    return false;
   lock_acquire(&frame_table_lock);
-  list_push_back(&frame_table, &fte->elem);
+  ASSERT(fte->shm_refs > 0);
+  if (pagedir_set_page(cur->pagedir, spte->user_vaddr, frame, true))
+  {
+    m->owner = cur;
+    m->pagedir = cur->pagedir;
+    m->spte = spte;
+    list_push_back(&fte->mappings, &m->elem);
+    fte->shm_refs++;
+    spte->is_loaded = true;
+    success = true;
+  }
   lock_release(&frame_table_lock);
 
-  return true;
+  if (!success)
+    kmem_cache_free(&mapping_cache, m);
+  return success;
 }
 
-/* Remove an entry from the frame table and free the memory */
-static void
-remove_frame_from_table(void *frame)
+/* Undo frame_shm_map() for T's page UPAGE */
+void
+frame_shm_unmap(struct thread *t, void *upage)
 {
   struct frame_table_entry *fte;
   struct list_elem *e;
+  void *kpage;
 
   lock_acquire(&frame_table_lock);
-  e = list_head(&frame_table);
-  while ((e = list_next(e)) != list_tail(&frame_table))
+  kpage = pagedir_get_page(t->pagedir, upage);
+  ASSERT(kpage != NULL && is_frame(kpage));
+  fte = get_frame_table_entry(kpage);
+  for (e = list_begin(&fte->mappings); e != list_end(&fte->mappings);
+       e = list_next(e))
   {
-    fte = list_entry(e, struct frame_table_entry, elem);
-    if (fte->frame == frame)
+    struct frame_mapping *m = list_entry(e, struct frame_mapping, elem);
+    if (m->owner == t && m->spte->user_vaddr == upage)
     {
       list_remove(e);
-      free(fte);
+      kmem_cache_free(&mapping_cache, m);
       break;
     }
   }
+  pagedir_clear_page(t->pagedir, upage);
+  shm_unref(fte);
   lock_release(&frame_table_lock);
 }
 
-/* Retrieve the frame table entry for a given frame */
-static struct frame_table_entry *
-get_frame_table_entry(void *frame)
+/* Drop the segment's own reference to shared-memory FRAME */
+void
+frame_shm_release(void *frame)
 {
-  struct frame_table_entry *fte;
-  struct list_elem *e;
+  lock_acquire(&frame_table_lock);
+  shm_unref(get_frame_table_entry(frame));
+  lock_release(&frame_table_lock);
+}
+
+/* Wait until any eviction in progress has finished */
+void
+frame_wait_eviction(void)
+{
+  lock_acquire(&frame_table_lock);
+  lock_release(&frame_table_lock);
+}
+
+/* Evict a frame of OWNER, or of any process if OWNER is null, and
+   save its content for later use.  Returns a null pointer if there is
+   no frame that can be evicted. */
+void *
+evict_frame(struct thread *owner)
+{
+  void *frame;
+  size_t got;
 
   lock_acquire(&frame_table_lock);
-  e = list_head(&frame_table);
-  while ((e = list_next(e)) != list_tail(&frame_table))
+  got = evict_frames(owner, &frame, 1);
+  lock_release(&frame_table_lock);
+  return got > 0 ? frame : NULL;
+}
+
+/* Evict up to CNT frames of OWNER, or of any process if OWNER is
+   null, chosen in one sweep of the clock, and give them to the
+   current process.  Stores them in FRAMES and returns how many there
+   are.  Must be called with frame_table_lock held. */
+static size_t
+evict_frames(struct thread *owner, void *frames[], size_t cnt)
+{
+  struct frame_table_entry *victims[FRAME_BATCH];
+  struct thread *t = process_current();
+  size_t victim_cnt, got, i;
+
+  victim_cnt = select_frames_for_eviction(owner, victims, cnt);
+  for (got = i = 0; i < victim_cnt; i++)
+  {
+    struct frame_table_entry *fte = victims[i];
+
+    /* The victims before this one may have taken the swap slots it
+       was counted against. */
+    if (i > 0 && swap_blocked(fte))
+      continue;
+    save_evicted_frame_content(fte);
+
+    fte->owner->vm_evictions++;
+    fte->owner->vm_resident--;
+    t->vm_resident++;
+    fte->owner = t;
+    fte->pagedir = t->pagedir;
+    fte->spte = NULL;
+    fte->user_page = NULL;
+    fte->pin_cnt = 0;
+    fte->age = 0;
+    frames[got++] = fte->frame;
+  }
+
+  if (got > 0)
+    cond_signal(&cleaner_wake, &frame_table_lock);
+  return got;
+}
+
+/* Select up to CNT frames to evict, storing them in VICTIMS from the
+   best choice to the worst, and return how many were found.  The best
+   is the frame with the lowest age, counting accesses since the ager
+   last ran as the newest bit, and among equally old frames a clean
+   one, which needs no write-back.  The sweep starts at the clock hand,
+   stops early once CNT clean, unaccessed frames are found, and leaves
+   the hand just past the farthest frame chosen, so ties are broken
+   round-robin.  Only OWNER's frames are considered if OWNER is
+   nonnull, and never one that would need a swap slot some mapper of
+   it is not allowed. */
+static size_t
+select_frames_for_eviction(struct thread *owner,
+                           struct frame_table_entry *victims[], size_t cnt)
+{
+  unsigned keys[FRAME_BATCH];
+  size_t dists[FRAME_BATCH];
+  size_t found = 0, far = 0;
+  size_t n, i;
+
+  ASSERT(cnt <= FRAME_BATCH);
+  for (n = 0; n < frame_cnt && cnt > 0; n++)
   {
-    fte = list_entry(e, struct frame_table_entry, elem);
-    if (fte->frame == frame)
+    size_t idx = (clock_hand + n) % frame_cnt;
+    struct frame_table_entry *fte = &frame_table[idx];
+    unsigned key;
+
+    if (!fte->in_use || fte->pin_cnt > 0 || fte->cleaning
+        || fte->user_page == NULL
+        || (owner != NULL && fte->owner != owner))
+      continue;
+
+    key = frame_age(fte) << 1;
+    if (pagedir_is_dirty(fte->pagedir, fte->user_page))
+      key |= 1;
+    if ((found == cnt && key >= keys[cnt - 1]) || swap_blocked(fte))
+      continue;
+
+    /* Insert in key order after the equal keys, dropping the worst
+       choice if VICTIMS is full. */
+    i = found < cnt ? found++ : cnt - 1;
+    for (; i > 0 && keys[i - 1] > key; i--)
+    {
+      victims[i] = victims[i - 1];
+      keys[i] = keys[i - 1];
+      dists[i] = dists[i - 1];
+    }
+    victims[i] = fte;
+    keys[i] = key;
+    dists[i] = n;
+    if (found == cnt && keys[cnt - 1] == 0)
       break;
-    fte = NULL;
   }
-  lock_release(&frame_table_lock);
 
-  return fte;
+  for (i = 0; i < found; i++)
+    if (dists[i] > far)
+      far = dists[i];
+  if (found > 0)
+    clock_hand = (clock_hand + far + 1) % frame_cnt;
+  return found;
+}
+
+/* Returns true if SPTE's page, DIRTY or not, goes to a new swap
+   slot when evicted, as save_page() decides. */
+static bool
+page_needs_slot(struct suppl_pte *spte, bool dirty)
+{
+  if (spte->type & MMF)
+    return false;
+  if (!dirty && spte->swap_clean)
+    return false;
+  return dirty || spte->type != FILE;
+}
+
+/* Returns true if evicting FTE would need a swap slot for a process
+   already at its swap limit, or more slots than are free.  Must be
+   called with frame_table_lock held. */
+static bool
+swap_blocked(struct frame_table_entry *fte)
+{
+  size_t slot_cnt = 0;
+  struct list_elem *e;
+
+  if (page_needs_slot(fte->spte,
+                      pagedir_is_dirty(fte->pagedir, fte->user_page)))
+  {
+    if (fte->owner->vm_swap_slots >= fte->owner->rlimit_swap)
+      return true;
+    slot_cnt++;
+  }
+  for (e = list_begin(&fte->mappings); e != list_end(&fte->mappings);
+       e = list_next(e))
+  {
+    struct frame_mapping *m = list_entry(e, struct frame_mapping, elem);
+    if (page_needs_slot(m->spte,
+                        pagedir_is_dirty(m->pagedir, m->spte->user_vaddr)))
+    {
+      if (m->owner->vm_swap_slots >= m->owner->rlimit_swap)
+        return true;
+      slot_cnt++;
+    }
+  }
+  return slot_cnt > vm_swap_free_cnt();
+}
+
+/* Save the content of an evicted frame for future use */
+static void
+save_evicted_frame_content(struct frame_table_entry *fte)
+{
+  struct suppl_pte *spte = fte->spte;
+
+  /* If the page is dirty and is a memory-mapped file, write it back to the file.
+     Otherwise, if the page is dirty, move it to the swap space.
+     Clean file pages are simply dropped and read back from the file;
+     anything else (stack pages, file pages that were swapped before)
+     has no other backing store and also goes to swap, unless the
+     page cleaner already left an up-to-date copy there. */
+  bool dirty = pagedir_is_dirty(fte->pagedir, spte->user_vaddr);
+
+  /* Unmap the page first so the owner cannot modify it while it is
+     being written out.  A fault on it in the meantime waits for us in
+     frame_wait_eviction(). */
+  pagedir_clear_page(fte->pagedir, spte->user_vaddr);
+
+  /* Every other mapping is saved the same way.  Read-only file pages
+     are clean and are simply dropped; copy-on-write pages that have
+     to go to swap get a slot of their own per mapping. */
+  while (!list_empty(&fte->mappings))
+  {
+    struct frame_mapping *m = list_entry(list_pop_front(&fte->mappings),
+                                         struct frame_mapping, elem);
+    bool m_dirty = pagedir_is_dirty(m->pagedir, m->spte->user_vaddr);
+
+    pagedir_clear_page(m->pagedir, m->spte->user_vaddr);
+    save_page(fte, m->spte, m->owner, m_dirty);
+    kmem_cache_free(&mapping_cache, m);
+  }
+  unshare_frame(fte);
+
+  save_page(fte, spte, fte->owner, dirty);
+  memset(fte->frame, 0, PGSIZE);
+}
+
+/* Save FTE's content for OWNER's page SPTE, which is already unmapped
+   and was DIRTY, so that the page can be loaded again.  If swap has
+   filled up since swap_blocked() looked, the page is lost and OWNER
+   is killed. */
+static void
+save_page(struct frame_table_entry *fte, struct suppl_pte *spte,
+          struct thread *owner, bool dirty)
+{
+  if (spte->type & MMF)
+  {
+    if (dirty)
+      write_page_back_to_file_wo_lock(spte, fte->frame);
+  }
+  else if (!dirty && spte->swap_clean)
+  {
+    spte->type = spte->type | SWAP;
+    spte->swap_clean = false;
+  }
+  else if (dirty || spte->type != FILE)
+  {
+    if (spte->swap_clean)
+    {
+      vm_clear_swap_slot(spte->swap_slot_index);
+      spte->swap_clean = false;
+    }
+
+    size_t swap_slot_index = vm_swap_out(fte->frame, owner,
+                                         spte->user_vaddr);
+    if (swap_slot_index == SWAP_ERROR)
+      signal_send(owner->tid, SIGKILL);
+    else
+    {
+      owner->vm_swap_outs++;
+      spte->type = spte->type | SWAP;
+      spte->swap_slot_index = swap_slot_index;
+    }
+  }
+
+  spte->is_loaded = false;
+  spte->cow = false;
+}
+
+/* Returns true if evicting FTE now would have to write it out.
+   Must be called with frame_table_lock held. */
+static bool
+frame_needs_write(struct frame_table_entry *fte)
+{
+  struct suppl_pte *spte = fte->spte;
+
+  if (pagedir_is_dirty(fte->pagedir, fte->user_page))
+    return true;
+  return !(spte->type & MMF) && spte->type != FILE && !spte->swap_clean;
+}
+
+/* Write the CNT frames in BATCH back to their files or to swap
+   without evicting them; the swapped ones go to one cluster of slots
+   where possible.  Called with frame_table_lock held and the frames'
+   cleaning flags set; the lock is dropped during the I/O.  Dirty bits
+   are cleared before writing, so a store that races with the write
+   marks the page dirty again.  Returns false if swap filled up. */
+static bool
+clean_frames(struct frame_table_entry *batch[], size_t cnt)
+{
+  const void *kpages[CLEAN_BATCH];
+  struct thread *owners[CLEAN_BATCH];
+  void *upages[CLEAN_BATCH];
+  struct frame_table_entry *anon[CLEAN_BATCH];
+  size_t slots[CLEAN_BATCH];
+  size_t stale[CLEAN_BATCH];
+  size_t anon_cnt = 0, stale_cnt = 0, written, i;
+
+  for (i = 0; i < cnt; i++)
+  {
+    struct frame_table_entry *fte = batch[i];
+    struct suppl_pte *spte = fte->spte;
+
+    pagedir_set_dirty(fte->pagedir, fte->user_page, false);
+    if (spte->type & MMF)
+      continue;
+    if (spte->swap_clean)
+    {
+      stale[stale_cnt++] = spte->swap_slot_index;
+      spte->swap_clean = false;
+    }
+    kpages[anon_cnt] = fte->frame;
+    owners[anon_cnt] = fte->owner;
+    upages[anon_cnt] = fte->user_page;
+    anon[anon_cnt++] = fte;
+  }
+  lock_release(&frame_table_lock);
+
+  for (i = 0; i < stale_cnt; i++)
+    vm_clear_swap_slot(stale[i]);
+  for (i = 0; i < cnt; i++)
+    if (batch[i]->spte->type & MMF)
+      write_page_back_to_file_wo_lock(batch[i]->spte, batch[i]->frame);
+  written = vm_swap_out_cluster(anon_cnt, kpages, owners, upages, slots);
+
+  lock_acquire(&frame_table_lock);
+  for (i = 0; i < anon_cnt; i++)
+  {
+    if (i < written)
+    {
+      anon[i]->spte->swap_slot_index = slots[i];
+      anon[i]->spte->swap_clean = true;
+      anon[i]->owner->vm_swap_outs++;
+    }
+    else
+      pagedir_set_dirty(anon[i]->pagedir, anon[i]->user_page, true);
+  }
+  return written == anon_cnt;
+}
+
+/* Page cleaner thread.  Sweeps the frame table with its own hand,
+   ahead of the eviction clock, so that allocate_frame() usually
+   finds a frame it can reclaim without blocking on disk writes. */
+static void
+cleaner_daemon(void *aux UNUSED)
+{
+  for (;;)
+  {
+    struct frame_table_entry *batch[CLEAN_BATCH];
+    struct frame_table_entry *fte;
+    size_t reclaimable = 0;
+    size_t batch_cnt = 0;
+    size_t n;
+
+    lock_acquire(&frame_table_lock);
+    while (frame_cnt - frame_used_cnt >= cleaner_low_water)
+      cond_wait(&cleaner_wake, &frame_table_lock);
+
+    for (n = 0; n < frame_cnt && reclaimable < CLEAN_TARGET
+                && batch_cnt < CLEAN_BATCH; n++)
+    {
+      fte = &frame_table[cleaner_hand];
+      if (++cleaner_hand == frame_cnt)
+        cleaner_hand = 0;
+
+      if (!fte->in_use || fte->pin_cnt > 0 || fte->cleaning
+          || fte->user_page == NULL || !list_empty(&fte->mappings)
+          || frame_age(fte) >= 1u << (AGE_BITS - 1))
+        continue;
+
+      if (frame_needs_write(fte))
+      {
+        fte->cleaning = true;
+        batch[batch_cnt++] = fte;
+      }
+      reclaimable++;
+    }
+
+    if (batch_cnt > 0)
+    {
+      clean_frames(batch, batch_cnt);
+      for (n = 0; n < batch_cnt; n++)
+        batch[n]->cleaning = false;
+      cond_broadcast(&cleaning_done, &frame_table_lock);
+    }
+    lock_release(&frame_table_lock);
+
+    timer_sleep(CLEAN_INTERVAL);
+  }
+}
+
+/* Page ager thread */
+static void
+ager_daemon(void *aux UNUSED)
+{
+  for (;;)
+  {
+    struct frame_table_entry *fte;
+
+    timer_sleep(AGE_INTERVAL);
+    lock_acquire(&frame_table_lock);
+    for (fte = frame_table; fte < frame_table + frame_cnt; fte++)
+      if (fte->in_use && fte->user_page != NULL)
+      {
+        /* The frames of a large page share its accessed bit, so
+           they all get the same age. */
+        struct frame_table_entry *end = fte + 1;
+        struct frame_table_entry *f;
+        uint8_t age;
+
+        if (pagedir_is_large(fte->pagedir, fte->user_page))
+          end = fte + PTSPAN / PGSIZE - pt_no(fte->user_page);
+        age = (fte->age >> 1)
+              | (frame_accessed(fte, true) ? 1u << (AGE_BITS - 1) : 0);
+        for (f = fte; f < end; f++)
+          f->age = age;
+        if (age != 0)
+          fte->owner->vm_ws_frames += end - fte;
+        fte = end - 1;
+      }
+    lock_release(&frame_table_lock);
+
+    if (frame_loadctl_enabled)
+      load_control();
+  }
+}
+
+/* Adds process T to the load controller's scan in AUX, a struct
+   load_scan, and starts T's next working set estimate.  Called with
+   interrupts off. */
+static void
+load_consider(struct thread *t, void *aux)
+{
+  struct load_scan *s = aux;
+
+  if (t->leader != t || t->pagedir == NULL)
+    return;
+  if (t->vm_suspended)
+  {
+    if (s->resume == NULL || signal_killed(t)
+        || (!signal_killed(s->resume)
+            && t->priority > s->resume->priority))
+      s->resume = t;
+  }
+  else
+  {
+    t->vm_wss = t->vm_ws_frames + (t->vm_major_faults - t->vm_fault_mark);
+    s->demand += t->vm_wss;
+    s->running++;
+    if (!t->dying && !signal_killed(t)
+        && (s->victim == NULL || t->priority < s->victim->priority
+            || (t->priority == s->victim->priority
+                && t->vm_wss > s->victim->vm_wss)))
+      s->victim = t;
+  }
+  t->vm_ws_frames = 0;
+  t->vm_fault_mark = t->vm_major_faults;
+}
+
+/* Suspends or resumes at most one process, as the working sets
+   estimated by the ager's last pass call for. */
+static void
+load_control(void)
+{
+  struct load_scan s = {0, 0, NULL, NULL};
+  enum intr_level old_level;
+  struct thread *t;
+  tid_t tid;
+
+  old_level = intr_disable();
+  thread_foreach(load_consider, &s);
+  if (s.resume != NULL
+      && (signal_killed(s.resume) || s.running == 0
+          || s.demand + s.resume->vm_wss <= frame_cnt))
+  {
+    s.resume->vm_suspended = false;
+    intr_set_level(old_level);
+    lock_acquire(&frame_table_lock);
+    cond_broadcast(&load_resumed, &frame_table_lock);
+    lock_release(&frame_table_lock);
+    return;
+  }
+  if (s.running < 2 || s.demand <= frame_cnt || s.victim == NULL)
+  {
+    intr_set_level(old_level);
+    return;
+  }
+
+  /* Evict the victim's frames a batch per sweep, as long as it
+     lives. */
+  t = s.victim;
+  tid = t->tid;
+  t->vm_suspended = true;
+  for (;;)
+  {
+    void *frames[FRAME_BATCH];
+    size_t cnt;
+    bool alive;
+
+    alive = thread_get_by_id(tid) == t && !t->dying;
+    intr_set_level(old_level);
+    if (!alive)
+      break;
+    lock_acquire(&frame_table_lock);
+    cnt = evict_frames(t, frames, FRAME_BATCH);
+    lock_release(&frame_table_lock);
+    if (cnt == 0)
+      break;
+    free_frames(frames, cnt);
+    old_level = intr_disable();
+  }
+}
+
+/* Waits while the current process is suspended by the load
+   controller.  Called on page faults from user mode, when the thread
+   holds no locks. */
+void
+frame_load_wait(void)
+{
+  struct thread *p = process_current();
+
+  if (!p->vm_suspended)
+    return;
+  lock_acquire(&frame_table_lock);
+  while (p->vm_suspended)
+    cond_wait(&load_resumed, &frame_table_lock);
+  lock_release(&frame_table_lock);
+}
+
+/* Returns FTE's age with whether it has been accessed since the ager
+   last ran as one more, most significant, bit.  Must be called with
+   frame_table_lock held. */
+static unsigned
+frame_age(struct frame_table_entry *fte)
+{
+  return (frame_accessed(fte, false) ? 1u << AGE_BITS : 0) | fte->age;
+}
+
+/* Returns a hash of the content of PAGE, never 0. */
+static uint32_t
+page_hash(const void *page)
+{
+  const uint32_t *w = page;
+  uint32_t h = 2166136261u;
+  size_t i;
+
+  for (i = 0; i < PGSIZE / sizeof *w; i++)
+    h = (h ^ w[i]) * 16777619u;
+  return h != 0 ? h : 1;
+}
+
+/* Returns true if FTE holds an anonymous page that the page merger
+   may share.  Must be called with frame_table_lock held. */
+static bool
+frame_mergeable(struct frame_table_entry *fte)
+{
+  struct list_elem *e;
+
+  if (!fte->in_use || fte->pin_cnt > 0 || fte->cleaning
+      || fte->user_page == NULL || fte->shm_refs > 0
+      || fte->share_inode != NULL || (fte->spte->type & (MMF | SHM))
+      || pagedir_is_large(fte->pagedir, fte->user_page))
+    return false;
+  for (e = list_begin(&fte->mappings); e != list_end(&fte->mappings);
+       e = list_next(e))
+    if (list_entry(e, struct frame_mapping, elem)->spte->type & MMF)
+      return false;
+  return true;
+}
+
+/* Makes SPTE's page in PD read-only, copy-on-write if the process may
+   write it. */
+static void
+protect_mapping(uint32_t *pd, struct suppl_pte *spte)
+{
+  if (suppl_pte_writable(spte))
+    spte->cow = true;
+  pagedir_set_writable(pd, spte->user_vaddr, false);
+}
+
+/* Makes every mapping of FTE read-only.  A write to any of them then
+   waits for frame_table_lock in frame_break_cow(). */
+static void
+protect_frame(struct frame_table_entry *fte)
+{
+  struct list_elem *e;
+
+  protect_mapping(fte->pagedir, fte->spte);
+  for (e = list_begin(&fte->mappings); e != list_end(&fte->mappings);
+       e = list_next(e))
+  {
+    struct frame_mapping *m = list_entry(e, struct frame_mapping, elem);
+    protect_mapping(m->pagedir, m->spte);
+  }
+}
+
+/* Undoes protect_frame() on FTE if it has a single mapping. */
+static void
+unprotect_frame(struct frame_table_entry *fte)
+{
+  if (list_empty(&fte->mappings) && fte->spte->cow)
+  {
+    fte->spte->cow = false;
+    pagedir_set_writable(fte->pagedir, fte->user_page, true);
+  }
+}
+
+/* Give up frame DUP, which has a single mapping, if it holds the
+   same bytes as frame KEEP, and map KEEP copy-on-write in its place.
+   Must be called with frame_table_lock held. */
+static void
+merge_frame(struct frame_table_entry *keep, struct frame_table_entry *dup)
+{
+  struct frame_mapping *m = kmem_cache_alloc(&mapping_cache);
+  void *upage = dup->user_page;
+  bool dirty;
+
+  if (m == NULL)
+    return;
+
+  /* Neither frame can change once both are read-only. */
+  protect_frame(keep);
+  protect_frame(dup);
+  if (memcmp(keep->frame, dup->frame, PGSIZE))
+  {
+    unprotect_frame(keep);
+    unprotect_frame(dup);
+    kmem_cache_free(&mapping_cache, m);
+    return;
+  }
+
+  /* The page table already exists, so remapping cannot fail. */
+  dirty = pagedir_is_dirty(dup->pagedir, upage);
+  pagedir_clear_page(dup->pagedir, upage);
+  if (!pagedir_set_page(dup->pagedir, upage, keep->frame, false))
+    PANIC("remapping a merged page failed");
+  pagedir_set_dirty(dup->pagedir, upage, dirty);
+  m->owner = dup->owner;
+  m->pagedir = dup->pagedir;
+  m->spte = dup->spte;
+  list_push_back(&keep->mappings, &m->elem);
+
+  dup->in_use = false;
+  frame_used_cnt--;
+  dup->owner->vm_resident--;
+  palloc_free_page(dup->frame);
+}
+
+/* Page merger thread */
+static void
+merge_daemon(void *aux UNUSED)
+{
+  for (;;)
+  {
+    struct frame_table_entry *fte;
+
+    timer_sleep(MERGE_INTERVAL);
+    lock_acquire(&frame_table_lock);
+    for (fte = frame_table; fte < frame_table + frame_cnt; fte++)
+    {
+      struct hash_elem *e;
+      uint32_t h;
+
+      if (!frame_mergeable(fte))
+        continue;
+      h = page_hash(fte->frame);
+      if (h != fte->merge_hash)
+      {
+        fte->merge_hash = h;
+        continue;
+      }
+      e = hash_find(&merge_table, &fte->merge_elem);
+      if (e == NULL)
+        hash_insert(&merge_table, &fte->merge_elem);
+      else if (list_empty(&fte->mappings))
+        merge_frame(hash_entry(e, struct frame_table_entry, merge_elem),
+                    fte);
+    }
+    hash_clear(&merge_table, NULL);
+    lock_release(&frame_table_lock);
+  }
+}
+
+/* Hash function for merge_table */
+static unsigned
+merge_hash(const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_entry(e, struct frame_table_entry, merge_elem)->merge_hash;
+}
+
+/* Comparison function for merge_table: frames are told apart by
+   their hashes, and merge_frame() checks the bytes. */
+static bool
+merge_less(const struct hash_elem *a, const struct hash_elem *b,
+           void *aux UNUSED)
+{
+  return hash_entry(a, struct frame_table_entry, merge_elem)->merge_hash
+         < hash_entry(b, struct frame_table_entry, merge_elem)->merge_hash;
+}
+
+/* Add an entry to the frame table */
+static bool
+add_frame_to_table(void *frame)
+{
+  lock_acquire(&frame_table_lock);
+  init_frame_entry(get_frame_table_entry(frame), process_current());
+  if (frame_cnt - frame_used_cnt < cleaner_low_water)
+    cond_signal(&cleaner_wake, &frame_table_lock);
+  lock_release(&frame_table_lock);
+
+  return true;
+}
+
+/* Fill in FTE for a newly allocated frame owned by T.  Must be called
+   with frame_table_lock held. */
+static void
+init_frame_entry(struct frame_table_entry *fte, struct thread *t)
+{
+  fte->frame = frame_base + (fte - frame_table) * PGSIZE;
+  fte->owner = t;
+  fte->pagedir = t->pagedir;
+  fte->spte = NULL;
+  fte->user_page = NULL;
+  fte->pin_cnt = 0;
+  fte->cleaning = false;
+  fte->share_inode = NULL;
+  list_init(&fte->mappings);
+  fte->shm_refs = 0;
+  fte->merge_hash = 0;
+  fte->age = 0;
+  fte->in_use = true;
+  fte->owner->vm_resident++;
+  frame_used_cnt++;
+}
+
+/* Remove an entry from the frame table */
+static void
+remove_frame_from_table(void *frame)
+{
+  lock_acquire(&frame_table_lock);
+  release_frame_entry(get_frame_table_entry(frame));
+  lock_release(&frame_table_lock);
+}
+
+/* Mark FTE's frame free in the frame table.  Must be called with
+   frame_table_lock held. */
+static void
+release_frame_entry(struct frame_table_entry *fte)
+{
+  unshare_frame(fte);
+  fte->in_use = false;
+  frame_used_cnt--;
+  fte->owner->vm_resident--;
+}
+
+/* Retrieve the frame table entry for a given frame */
+static struct frame_table_entry *
+get_frame_table_entry(void *frame)
+{
+  size_t idx = ((uint8_t *) frame - frame_base) / PGSIZE;
+
+  ASSERT(pg_ofs(frame) == 0);
+  ASSERT((uint8_t *) frame >= frame_base && idx < frame_cnt);
+  return &frame_table[idx];
+}
+
+/* Returns true if KPAGE is a page of the user pool */
+static bool
+is_frame(const void *kpage)
+{
+  return (const uint8_t *) kpage >= frame_base
+         && (const uint8_t *) kpage < frame_base + frame_cnt * PGSIZE;
+}
+
+/* Returns true if any mapping of FTE has been accessed since the
+   accessed bits were last cleared, clearing them as it goes if
+   CLEAR. */
+static bool
+frame_accessed(struct frame_table_entry *fte, bool clear)
+{
+  bool accessed = pagedir_is_accessed(fte->pagedir, fte->user_page);
+  struct list_elem *e;
+
+  if (clear)
+    pagedir_set_accessed(fte->pagedir, fte->user_page, false);
+  for (e = list_begin(&fte->mappings); e != list_end(&fte->mappings);
+       e = list_next(e))
+  {
+    struct frame_mapping *m = list_entry(e, struct frame_mapping, elem);
+    if (pagedir_is_accessed(m->pagedir, m->spte->user_vaddr))
+    {
+      accessed = true;
+      if (clear)
+        pagedir_set_accessed(m->pagedir, m->spte->user_vaddr, false);
+      else
+        break;
+    }
+  }
+  return accessed;
+}
+
+/* Unmap shared frame FTE from T's page UPAGE, handing the frame to
+   its next mapper if T owns it there.  Returns false if T does not
+   map FTE at UPAGE.  Must be called with frame_table_lock held. */
+static bool
+drop_mapping(struct frame_table_entry *fte, struct thread *t, void *upage)
+{
+  struct frame_mapping *m = NULL;
+  struct list_elem *e;
+
+  if (fte->owner == t && fte->user_page == upage)
+  {
+    ASSERT(!list_empty(&fte->mappings));
+    m = list_entry(list_pop_front(&fte->mappings), struct frame_mapping,
+                   elem);
+    t->vm_resident--;
+    m->owner->vm_resident++;
+    fte->owner = m->owner;
+    fte->pagedir = m->pagedir;
+    fte->spte = m->spte;
+    fte->user_page = m->spte->user_vaddr;
+  }
+  else
+  {
+    for (e = list_begin(&fte->mappings); e != list_end(&fte->mappings);
+         e = list_next(e))
+    {
+      struct frame_mapping *cand = list_entry(e, struct frame_mapping, elem);
+      if (cand->owner == t && cand->spte->user_vaddr == upage)
+      {
+        m = cand;
+        list_remove(e);
+        break;
+      }
+    }
+    if (m == NULL)
+      return false;
+  }
+  pagedir_clear_page(t->pagedir, upage);
+  kmem_cache_free(&mapping_cache, m);
+  return true;
+}
+
+/* Drop a reference to shared-memory frame FTE, freeing it with the
+   last.  Must be called with frame_table_lock held. */
+static void
+shm_unref(struct frame_table_entry *fte)
+{
+  ASSERT(fte->shm_refs > 0);
+  if (--fte->shm_refs == 0)
+  {
+    ASSERT(list_empty(&fte->mappings));
+    fte->in_use = false;
+    frame_used_cnt--;
+    palloc_free_page(fte->frame);
+  }
+}
+
+/* Remove FTE from the share table, if it is there.
+   Must be called with frame_table_lock held. */
+static void
+unshare_frame(struct frame_table_entry *fte)
+{
+  if (fte->share_inode != NULL)
+  {
+    hash_delete(&share_table, &fte->share_elem);
+    inode_add_cached_pages(fte->share_inode, -1);
+    fte->share_inode = NULL;
+  }
+}
+
+/* Hash function for share_table */
+static unsigned
+share_hash(const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct frame_table_entry *fte
+    = hash_entry(e, struct frame_table_entry, share_elem);
+  return hash_ptr(fte->share_inode) ^ hash_int(fte->share_ofs);
+}
+
+/* Less function for share_table */
+static bool
+share_less(const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct frame_table_entry *a
+    = hash_entry(a_, struct frame_table_entry, share_elem);
+  const struct frame_table_entry *b
+    = hash_entry(b_, struct frame_table_entry, share_elem);
+
+  if (a->share_inode != b->share_inode)
+    return a->share_inode < b->share_inode;
+  return a->share_ofs < b->share_ofs;
 }
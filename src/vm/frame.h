@@ -1,28 +1,101 @@
 #ifndef VM_FRAME_H
 #define VM_FRAME_H
 
+#include <hash.h>
+#include <list.h>
 #include "threads/thread.h"
+#include "threads/palloc.h"
+#include "filesys/off_t.h"
+
+struct inode;
+struct suppl_pte;
+
+/* An additional mapping of a shared frame */
+struct frame_mapping {
+  struct thread *owner;     /* Mapping thread */
+  uint32_t *pagedir;        /* Its page directory */
+  struct suppl_pte *spte;   /* Its supplemental entry for the page */
+  struct list_elem elem;    /* Element in frame_table_entry's mappings */
+};
 
 /* Structure representing a frame table entry */
 struct frame_table_entry {
   void *frame;              /* Pointer to the frame */
-  tid_t tid;                /* Thread ID associated with the frame */
-  uint32_t *pte;            /* Page table entry */
-  void *user_page;          /* User virtual address */
-  struct list_elem elem;    /* List element for frame table list */
+  struct thread *owner;     /* Thread the frame belongs to */
+  uint32_t *pagedir;        /* Owner's page directory */
+  void *user_page;          /* User virtual address, NULL while loading */
+  struct suppl_pte *spte;   /* Supplemental entry of USER_PAGE */
+  unsigned pin_cnt;         /* Never chosen for eviction if nonzero */
+  bool cleaning;            /* Being written back by the page cleaner,
+                               or copied by read() or write() */
+  bool in_use;              /* Frame currently allocated? */
+  uint8_t age;              /* Accessed bits of recent intervals */
+
+  /* Full pages of files, whether read-only executable pages or pages
+     of memory-mapped files, are shared between processes, keyed by
+     (share_inode, share_ofs).  This page cache also serves read() and
+     write() while the page is resident.  The pages of a forked
+     process are shared too, until either side writes them.  OWNER
+     holds the first mapping; the others are in MAPPINGS. */
+  struct inode *share_inode;  /* Non-null if the frame is shareable */
+  off_t share_ofs;
+  struct hash_elem share_elem;
+  struct list mappings;
+
+  /* A page of a shared-memory segment has no owner and is never
+     evicted.  Each of its mappings is in MAPPINGS. */
+  unsigned shm_refs;        /* Mappings, plus one for the segment */
+
+  /* Page merger state */
+  uint32_t merge_hash;      /* Content hash at the last pass, or 0 */
+  struct hash_elem merge_elem;
 };
 
-extern struct list frame_table;
+/* Most frames allocate_frames() takes at once */
+#define FRAME_BATCH 16
+
+/* Whether the page merger runs (-merge) */
+extern bool frame_merge_enabled;
+
+/* Whether the load controller suspends processes (-loadctl) */
+extern bool frame_loadctl_enabled;
 
 /* Frame allocation functions */
 void frame_table_init(void);
+void frame_cleaner_init(void);
 void *allocate_frame(enum palloc_flags flags);
+size_t allocate_frames(enum palloc_flags flags, void *frames[], size_t cnt,
+                       bool evict);
+void *frame_try_allocate(enum palloc_flags flags);
+void *frame_allocate_large(void);
 void free_frame(void *);
+void free_frames(void *[], size_t);
 
 /* Frame table management functions */
-void set_frame_user_page(void *, uint32_t *, void *);
+void set_frame_user_page(void *, struct suppl_pte *);
+bool frame_pin_user_page(struct thread *, void *);
+void frame_unpin_user_page(struct thread *, void *);
+void frame_release_page(struct thread *, void *);
+
+/* Page cache of resident file pages */
+void *frame_share_map(struct inode *, off_t, struct suppl_pte *, bool);
+void frame_share_register(void *, struct inode *, off_t);
+bool frame_cache_read(struct inode *, off_t, void *, size_t);
+bool frame_cache_write(struct inode *, off_t, const void *, size_t);
+
+/* Copy-on-write sharing between a process and its fork */
+bool frame_fork_page(struct thread *, struct suppl_pte *, struct suppl_pte *);
+bool frame_break_cow(struct suppl_pte *);
+
+/* Pages of shared-memory segments */
+void *frame_shm_alloc(void);
+bool frame_shm_map(void *, struct suppl_pte *);
+void frame_shm_unmap(struct thread *, void *);
+void frame_shm_release(void *);
 
 /* Evict a frame, saving its content to a swap slot or file */
-void *evict_frame(void);
+void *evict_frame(struct thread *);
+void frame_wait_eviction(void);
+void frame_load_wait(void);
 
 #endif /* VM_FRAME_H */
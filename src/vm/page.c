@@ -4,58 +4,72 @@
 #include "threads/vaddr.h"
 #include "userprog/pagedir.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/palloc.h"
+#include "threads/tunable.h"
 #include "filesys/file.h"
 #include "string.h"
+#include <round.h>
+#include "userprog/process.h"
 #include "userprog/syscall.h"
 #include "vm/swap.h"
+#include "vm/spt.h"
+#include "devices/block.h"
 
 /* Function prototypes */
-static bool load_page_file(struct suppl_pte *);
+static bool load_page_file(struct suppl_pte *, void *);
 static bool load_page_swap(struct suppl_pte *);
-static bool load_page_mmf(struct suppl_pte *);
-static void free_suppl_pte(struct hash_elem *, void *UNUSED);
+static bool load_page_mmf(struct suppl_pte *, void *);
+static void mmf_prefetch(struct mmap_region *, size_t, size_t);
+static struct mmap_region *find_region(const void *);
+static void swap_read_around(size_t);
+static void free_suppl_pte(struct suppl_pte *);
+static bool map_zero_page(struct suppl_pte *);
+static bool map_large_page(void *);
+static bool fault_resolved(uint32_t *, const void *, bool);
+static bool break_zero_page(struct suppl_pte *);
+static void unmap_region(struct mmap_region *);
+static bool resolve_fault(const void *, const void *, bool);
+static int map_file(struct file *, void *);
+static bool fork_page(struct thread *, struct suppl_pte *);
+static bool fork_region(struct thread *, struct mmap_region *);
+static bool map_shared_page(void *, uint8_t *, size_t, size_t);
+
+/* -vmstat: print each process's paging statistics when it exits. */
+bool vm_print_stats;
+
+/* -largepages: map 4 MB aligned regions of zero-fill pages with
+   single large pages where frames allow. */
+bool vm_large_pages;
+
+/* Prefetch window sizes, from the mmf_prefetch and exec_prefetch
+   tunables. */
+size_t vm_mmf_prefetch;
+size_t vm_exec_prefetch;
+
+/* One page of zeros, mapped read-only wherever a process reads an
+   anonymous page it has never written.  Comes from the kernel pool, so
+   it is never entered in the frame table or evicted. */
+static void *zero_page;
+
+/* Supplemental page table entries, allocated at their exact size. */
+static struct kmem_cache spte_cache;
 
 /* Initialize the supplemental page table and necessary data structures */
 void 
 vm_page_init(void)
 {
-  return;
-}
-
-/* Hash function for supplemental page table */
-unsigned
-suppl_pt_hash(const struct hash_elem *he, void *aux UNUSED)
-{
-  const struct suppl_pte *vspte;
-  vspte = hash_entry(he, struct suppl_pte, elem);
-  return hash_bytes(&vspte->user_vaddr, sizeof vspte->user_vaddr);
-}
-
-/* Less function for supplemental page table */
-bool
-suppl_pt_less(const struct hash_elem *hea,
-              const struct hash_elem *heb,
-              void *aux UNUSED)
-{
-  const struct suppl_pte *vsptea;
-  const struct suppl_pte *vspteb;
- 
-  vsptea = hash_entry(hea, struct suppl_pte, elem);
-  vspteb = hash_entry(heb, struct suppl_pte, elem);
-
-  return (vsptea->user_vaddr - vspteb->user_vaddr) < 0;
+  vm_mmf_prefetch = tunable_int("mmf_prefetch", MMF_PREFETCH_PAGES, 0, 64);
+  vm_exec_prefetch = tunable_int("exec_prefetch", EXEC_PREFETCH_PAGES, 0, 64);
+  zero_page = palloc_get_page(PAL_ASSERT | PAL_ZERO);
+  kmem_cache_init(&spte_cache, "suppl_pte", sizeof(struct suppl_pte), NULL);
 }
 
 /* Retrieve the supplemental page table entry corresponding to the given user virtual address */
 struct suppl_pte *
-get_suppl_pte(struct hash *ht, void *uvaddr)
+get_suppl_pte(struct spt *spt, void *uvaddr)
 {
-  struct suppl_pte spte;
-  struct hash_elem *e;
-
-  spte.user_vaddr = uvaddr;
-  e = hash_find(ht, &spte.elem);
-  return e != NULL ? hash_entry(e, struct suppl_pte, elem) : NULL;
+  return spt_find(spt, uvaddr);
 }
 
 /* Load page data based on the type defined in struct suppl_pte */
@@ -66,11 +80,20 @@ load_page(struct suppl_pte *spte)
   switch (spte->type)
     {
     case FILE:
-      success = load_page_file(spte);
+      success = load_page_file(spte, NULL);
       break;
     case MMF:
     case MMF | SWAP:
-      success = load_page_mmf(spte);
+      success = load_page_mmf(spte, NULL);
+      if (success)
+        {
+          /* Sequential regions read the next pages along with this one. */
+          struct mmap_region *r = find_region(spte->user_vaddr);
+          if (r != NULL && r->advice == MADV_SEQUENTIAL)
+            mmf_prefetch(r, ((uint8_t *) spte->user_vaddr
+                             - (uint8_t *) r->addr) / PGSIZE + 1,
+                         vm_mmf_prefetch);
+        }
       break;
     case FILE | SWAP:
     case SWAP:
@@ -82,16 +105,35 @@ load_page(struct suppl_pte *spte)
   return success;
 }
 
-/* Load page data from a file into the page defined in struct suppl_pte */
+/* Load page data from a file into the page defined in struct suppl_pte.
+   A prefetch passes the free FRAME it took for the page, which is
+   used or freed; otherwise FRAME is null and one is allocated. */
 static bool
-load_page_file(struct suppl_pte *spte)
+load_page_file(struct suppl_pte *spte, void *frame)
 {
-  struct thread *cur = thread_current();
+  struct thread *cur = process_current();
+  struct inode *inode = file_get_inode(spte->data.file_page.file);
+
+  /* Full read-only pages of a file are shared with every other
+     process that has the same page resident.  Partial pages are not,
+     since another segment may zero a different tail of the same
+     file page. */
+  bool shareable = !spte->data.file_page.writable
+                   && spte->data.file_page.read_bytes == PGSIZE;
+  if (shareable
+      && frame_share_map(inode, spte->data.file_page.ofs, spte, false)
+         != NULL)
+    {
+      if (frame != NULL)
+        free_frame(frame);
+      return true;
+    }
   
   file_seek(spte->data.file_page.file, spte->data.file_page.ofs);
 
   /* Get a page of memory */
-  uint8_t *kpage = allocate_frame(PAL_USER);
+  bool prefetch = frame != NULL;
+  uint8_t *kpage = prefetch ? frame : allocate_frame(PAL_USER);
   if (kpage == NULL)
     return false;
   
@@ -113,27 +155,48 @@ load_page_file(struct suppl_pte *spte)
       free_frame(kpage);
       return false; 
     }
+  set_frame_user_page(kpage, spte);
+  if (shareable)
+    frame_share_register(kpage, inode, spte->data.file_page.ofs);
   
+  if (!prefetch)
+    cur->vm_major_faults++;
   spte->is_loaded = true;
   return true;
 }
 
-/* Load a memory-mapped file page defined in struct suppl_pte */
+/* Load a memory-mapped file page defined in struct suppl_pte.
+   FRAME is as for load_page_file(). */
 static bool
-load_page_mmf(struct suppl_pte *spte)
+load_page_mmf(struct suppl_pte *spte, void *frame)
 {
-  struct thread *cur = thread_current();
+  struct thread *cur = process_current();
+  struct inode *inode = file_get_inode(spte->data.mmf_page.file);
 
-  file_seek(spte->data.mmf_page.file, spte->data.mmf_page.ofs);
+  /* A full page already in the page cache, whether mapped by another
+     process or holding an executable's page, is mapped as it is: no
+     copy and no I/O.  A partial page is not shared, because the zeros
+     past the end of file depend on when it was mapped. */
+  bool shareable = spte->data.mmf_page.read_bytes == PGSIZE;
+  if (shareable
+      && frame_share_map(inode, spte->data.mmf_page.ofs, spte, true) != NULL)
+    {
+      if (frame != NULL)
+        free_frame(frame);
+      if (spte->type & SWAP)
+        spte->type = MMF;
+      return true;
+    }
 
   /* Get a page of memory */
-  uint8_t *kpage = allocate_frame(PAL_USER);
+  bool prefetch = frame != NULL;
+  uint8_t *kpage = prefetch ? frame : allocate_frame(PAL_USER);
   if (kpage == NULL)
     return false;
 
   /* Load this page */
-  if (file_read(spte->data.mmf_page.file, kpage,
-                spte->data.mmf_page.read_bytes)
+  if (file_read_at(spte->data.mmf_page.file, kpage,
+                   spte->data.mmf_page.read_bytes, spte->data.mmf_page.ofs)
       != (int) spte->data.mmf_page.read_bytes)
     {
       free_frame(kpage);
@@ -148,7 +211,12 @@ load_page_mmf(struct suppl_pte *spte)
       free_frame(kpage);
       return false; 
     }
+  set_frame_user_page(kpage, spte);
+  if (shareable)
+    frame_share_register(kpage, inode, spte->data.mmf_page.ofs);
 
+  if (!prefetch)
+    cur->vm_major_faults++;
   spte->is_loaded = true;
   if (spte->type & SWAP)
     spte->type = MMF;
@@ -156,72 +224,131 @@ load_page_mmf(struct suppl_pte *spte)
   return true;
 }
 
-/* Load a swapped page defined in struct suppl_pte */
+/* Load a swapped page defined in struct suppl_pte.  The entry stays
+   in the supplemental page table with its SWAP bit set, since swap is
+   now the page's only backing store.  Its slot is usually kept as a
+   clean copy, so that the page goes back out for free if it is
+   evicted again before it is written. */
 static bool
 load_page_swap(struct suppl_pte *spte)
 {
+  size_t swap_idx = spte->swap_slot_index;
+
   /* Get a page of memory */
   uint8_t *kpage = allocate_frame(PAL_USER);
   if (kpage == NULL)
     return false;
  
+  /* Swap data from disk into memory page */
+  spte->swap_clean = vm_swap_in(spte->swap_slot_index, kpage);
+
   /* Map the user page to given frame */
-  if (!pagedir_set_page(thread_current()->pagedir, spte->user_vaddr, kpage, 
+  if (!pagedir_set_page(process_current()->pagedir, spte->user_vaddr, kpage, 
                         spte->swap_writable))
     {
+      spte->swap_clean = false;
       free_frame(kpage);
       return false;
     }
- 
-  /* Swap data from disk into memory page */
-  vm_swap_in(spte->swap_slot_index, spte->user_vaddr);
+  set_frame_user_page(kpage, spte);
 
-  if (spte->type == SWAP)
+  process_current()->vm_major_faults++;
+  process_current()->vm_swap_ins++;
+  spte->is_loaded = true;
+  swap_read_around(swap_idx);
+  return true;
+}
+
+/* Bring back the current process's other pages swapped out to the
+   same cluster as SWAP_IDX, which were most likely evicted together,
+   as long as free frames are available without evicting anything.
+   They are mapped unaccessed, so they are the first to go again if
+   they turn out not to be needed.  The frames are taken together and
+   the reads are all submitted before waiting for any, so the swap
+   device can merge them. */
+static void
+swap_read_around(size_t swap_idx)
+{
+  struct thread *cur = process_current();
+  size_t slots[SWAP_CLUSTER];
+  void *upages[SWAP_CLUSTER];
+  struct suppl_pte *sptes[SWAP_CLUSTER];
+  void *kpages[SWAP_CLUSTER];
+  struct block_request reqs[SWAP_CLUSTER];
+  size_t cnt, read_cnt, i;
+
+  cnt = vm_swap_cluster_of(swap_idx, cur, slots, upages);
+  read_cnt = 0;
+  for (i = 0; i < cnt; i++)
     {
-      /* After swap in, remove the corresponding entry in supplement page table */
-      hash_delete(&thread_current()->suppl_page_table, &spte->elem);
+      struct suppl_pte *spte = get_suppl_pte(&cur->suppl_page_table,
+                                             upages[i]);
+
+      if (spte == NULL || spte->is_loaded || !(spte->type & SWAP)
+          || spte->swap_slot_index != slots[i])
+        continue;
+      sptes[read_cnt++] = spte;
     }
-  if (spte->type == (FILE | SWAP))
+
+  read_cnt = allocate_frames(PAL_USER, kpages, read_cnt, false);
+  for (i = 0; i < read_cnt; i++)
+    vm_swap_read_async(sptes[i]->swap_slot_index, kpages[i], &reqs[i]);
+
+  for (i = 0; i < read_cnt; i++)
     {
-      spte->type = FILE;
+      struct suppl_pte *spte = sptes[i];
+
+      block_wait(&reqs[i]);
+      if (!pagedir_set_page(cur->pagedir, spte->user_vaddr, kpages[i],
+                            spte->swap_writable))
+        {
+          free_frame(kpages[i]);
+          continue;
+        }
+      spte->swap_clean = vm_swap_keep(spte->swap_slot_index);
+      set_frame_user_page(kpages[i], spte);
+      cur->vm_swap_ins++;
       spte->is_loaded = true;
     }
-
-  return true;
 }
 
-/* Free the given supplemental page table, which is a hash table */
-void free_suppl_pt(struct hash *suppl_pt) 
+/* Tear down the current process's address space in one walk of its
+   supplemental page table SUPPL_PT: each page's frame, frame table
+   entry and swap slot go together with its entry.  Called from
+   process_exit() while the page directory is still live, which
+   then holds no user pages for pagedir_destroy() to free. */
+void free_suppl_pt(struct spt *suppl_pt) 
 {
-  hash_destroy(suppl_pt, free_suppl_pte);
+  struct tlb_batch batch;
+
+  pagedir_batch_begin(&batch);
+  spt_destroy(suppl_pt, free_suppl_pte);
+  pagedir_batch_end(&batch);
 }
 
-/* Free supplemental page entry represented by the given hash element in hash table */
+/* Free supplemental page entry SPTE along with its frame, which
+   leaves the frame table before the swap slot is released.  The
+   zero page is only unmapped. */
 static void
-free_suppl_pte(struct hash_elem *e, void *aux UNUSED)
+free_suppl_pte(struct suppl_pte *spte)
 {
-  struct suppl_pte *spte;
-  spte = hash_entry(e, struct suppl_pte, elem);
-  if (spte->type & SWAP)
+  struct thread *t = process_current();
+
+  if (spte->zero_mapped)
+    pagedir_clear_page(t->pagedir, spte->user_vaddr);
+  else
+    frame_release_page(t, spte->user_vaddr);
+  if (((spte->type & SWAP) && !spte->is_loaded) || spte->swap_clean)
     vm_clear_swap_slot(spte->swap_slot_index);
 
-  free(spte);
+  kmem_cache_free(&spte_cache, spte);
 }
 
 /* Insert the given supplemental page table entry */
 bool 
-insert_suppl_pte(struct hash *spt, struct suppl_pte *spte)
+insert_suppl_pte(struct spt *spt, struct suppl_pte *spte)
 {
-  struct hash_elem *result;
-
-  if (spte == NULL)
-    return false;
-  
-  result = hash_insert(spt, &spte->elem);
-  if (result != NULL)
-    return false;
-  
-  return true;
+  return spte != NULL && spt_insert(spt, spte);
 }
 
 
@@ -231,10 +358,9 @@ suppl_pt_insert_file(struct file *file, off_t ofs, uint8_t *upage,
                      uint32_t read_bytes, uint32_t zero_bytes, bool writable)
 {
   struct suppl_pte *spte; 
-  struct hash_elem *result;
-  struct thread *cur = thread_current();
+  struct thread *cur = process_current();
 
-  spte = calloc(1, sizeof *spte);
+  spte = kmem_cache_zalloc(&spte_cache);
   
   if (spte == NULL)
     return false;
@@ -247,10 +373,13 @@ suppl_pt_insert_file(struct file *file, off_t ofs, uint8_t *upage,
   spte->data.file_page.zero_bytes = zero_bytes;
   spte->data.file_page.writable = writable;
   spte->is_loaded = false;
+  spte->swap_writable = writable;
       
-  result = hash_insert(&cur->suppl_page_table, &spte->elem);
-  if (result != NULL)
-    return false;
+  if (!spt_insert(&cur->suppl_page_table, spte))
+    {
+      kmem_cache_free(&spte_cache, spte);
+      return false;
+    }
 
   return true;
 }
@@ -261,10 +390,9 @@ suppl_pt_insert_mmf(struct file *file, off_t ofs, uint8_t *upage,
                     uint32_t read_bytes)
 {
   struct suppl_pte *spte; 
-  struct hash_elem *result;
-  struct thread *cur = thread_current();
+  struct thread *cur = process_current();
 
-  spte = calloc(1, sizeof *spte);
+  spte = kmem_cache_zalloc(&spte_cache);
       
   if (spte == NULL)
     return false;
@@ -276,48 +404,923 @@ suppl_pt_insert_mmf(struct file *file, off_t ofs, uint8_t *upage,
   spte->data.mmf_page.read_bytes = read_bytes;
   spte->is_loaded = false;
       
-  result = hash_insert(&cur->suppl_page_table, &spte->elem);
-  if (result != NULL)
-    return false;
+  if (!spt_insert(&cur->suppl_page_table, spte))
+    {
+      kmem_cache_free(&spte_cache, spte);
+      return false;
+    }
 
   return true;
 }
 
-/* Write data from a supplemental page entry back to the file if it's dirty */
-void write_page_back_to_file_wo_lock(struct suppl_pte *spte)
+/* Write the page in KPAGE, which backs SPTE, back to its file.
+   It is required if a page is dirty */
+void write_page_back_to_file_wo_lock(struct suppl_pte *spte, void *kpage)
 {
   if (spte->type == MMF)
     {
-      file_seek(spte->data.mmf_page.file, spte->data.mmf_page.ofs);
-      file_write(spte->data.mmf_page.file, 
-                  spte->user_vaddr,
-                  spte->data.mmf_page.read_bytes);
+      file_write_at(spte->data.mmf_page.file, kpage,
+                    spte->data.mmf_page.read_bytes,
+                    spte->data.mmf_page.ofs);
     }
 }
 
 
-/* Grow the stack by one page where the given address points to */
-void grow_stack(void *uvaddr)
+/* Returns a new supplemental entry for the anonymous stack or heap
+   page at UPAGE, or a null pointer if out of memory.  It is typed
+   SWAP: swap is the only place it can go when evicted. */
+static struct suppl_pte *
+new_stack_pte(void *upage)
 {
+  struct suppl_pte *spte = kmem_cache_zalloc(&spte_cache);
+
+  if (spte != NULL)
+    {
+      spte->user_vaddr = upage;
+      spte->type = SWAP;
+      spte->is_loaded = true;
+      spte->swap_writable = true;
+    }
+  return spte;
+}
+
+/* Grow the stack by one page where the given address points to. */
+bool grow_stack(void *uvaddr)
+{
+  struct suppl_pte *spte;
   void *spage;
-  struct thread *t = thread_current();
+  struct thread *t = process_current();
+
+  spte = new_stack_pte(pg_round_down(uvaddr));
+  if (spte == NULL)
+    return false;
+
   spage = allocate_frame(PAL_USER | PAL_ZERO);
   if (spage == NULL)
-    return;
+    {
+      kmem_cache_free(&spte_cache, spte);
+      return false;
+    }
+
+  /* Add the page to the process's address space */
+  if (!pagedir_set_page(t->pagedir, spte->user_vaddr, spage, true)
+      || !insert_suppl_pte(&t->suppl_page_table, spte))
+    {
+      pagedir_clear_page(t->pagedir, spte->user_vaddr);
+      free_frame(spage);
+      kmem_cache_free(&spte_cache, spte);
+      return false;
+    }
+  set_frame_user_page(spage, spte);
+  return true;
+}
+
+/* Read in up to CNT pages from page-aligned UADDR on that come from
+   a file and are not yet resident, in order, as long as free frames
+   last.  Reading them in file order lets the file system's
+   read-ahead fetch the sectors in multi-sector runs.  Pages that are
+   all zeros are left to map the zero page when they fault. */
+void
+vm_prefetch(void *uaddr, size_t cnt)
+{
+  struct thread *t = process_current();
+  uint8_t *upage = uaddr;
+  size_t i;
+
+  ASSERT(pg_ofs(uaddr) == 0);
+
+  lock_acquire(&t->proc_lock);
+  for (; cnt > 0; cnt -= FRAME_BATCH)
+    {
+      struct suppl_pte *sptes[FRAME_BATCH];
+      void *kpages[FRAME_BATCH];
+      size_t want = 0, got;
+
+      for (; want < cnt && want < FRAME_BATCH && is_user_vaddr(upage);
+           upage += PGSIZE)
+        {
+          struct suppl_pte *spte = get_suppl_pte(&t->suppl_page_table,
+                                                 upage);
+          if (spte == NULL || spte->type != FILE || spte->is_loaded
+              || spte->data.file_page.read_bytes == 0)
+            break;
+          sptes[want++] = spte;
+        }
+
+      /* A short batch means the window or free frames ran out. */
+      got = allocate_frames(PAL_USER, kpages, want, false);
+      for (i = 0; i < got && load_page_file(sptes[i], kpages[i]); i++)
+        continue;
+      if (i < got)
+        free_frames(kpages + i + 1, got - i - 1);
+      if (i < FRAME_BATCH || cnt <= FRAME_BATCH)
+        break;
+    }
+  lock_release(&t->proc_lock);
+}
+
+/* Returns true if the process may write SPTE's page */
+bool
+suppl_pte_writable(const struct suppl_pte *spte)
+{
+  if (spte->type & (MMF | SHM))
+    return true;
+  return spte->type & FILE ? spte->data.file_page.writable
+                           : spte->swap_writable;
+}
+
+/* Map the shared zero page read-only at SPTE's address, for a read
+   of a page that is all zeros and has never been written. */
+static bool
+map_zero_page(struct suppl_pte *spte)
+{
+  if (!pagedir_set_page(process_current()->pagedir, spte->user_vaddr,
+                        zero_page, false))
+    return false;
+  spte->zero_mapped = true;
+  spte->is_loaded = true;
+  return true;
+}
+
+/* Give SPTE's page, currently mapped to the zero page, a frame of its
+   own so that it can be written. */
+static bool
+break_zero_page(struct suppl_pte *spte)
+{
+  struct thread *t = process_current();
+  void *kpage;
+
+  if (!suppl_pte_writable(spte))
+    return false;
+  kpage = allocate_frame(PAL_USER | PAL_ZERO);
+  if (kpage == NULL)
+    return false;
+
+  /* The page table already exists, so remapping cannot fail. */
+  pagedir_clear_page(t->pagedir, spte->user_vaddr);
+  if (!pagedir_set_page(t->pagedir, spte->user_vaddr, kpage, true))
+    PANIC("remapping a zero page failed");
+  spte->zero_mapped = false;
+  set_frame_user_page(kpage, spte);
+  return true;
+}
+
+/* Returns true if a fault at UADDR with user stack pointer ESP looks
+   like an access to the stack, which PUSH and PUSHA may make up to
+   32 bytes below %esp. */
+static bool
+is_stack_access(const void *uaddr, const void *esp)
+{
+  return (uint8_t *) uaddr >= (uint8_t *) esp - 32
+         && (uint8_t *) uaddr >= (uint8_t *) PHYS_BASE - STACK_SIZE
+         && is_user_vaddr(uaddr);
+}
+
+/* Returns true if user address UADDR is now mapped in PD such that
+   the access, a write if WRITE, would succeed.  Only reads the page
+   tables, so it may be called without the process lock: if the
+   mapping changes again before the access is retried, the access
+   just faults again. */
+static bool
+fault_resolved(uint32_t *pd, const void *uaddr, bool write)
+{
+  return uaddr != NULL && is_user_vaddr(uaddr)
+         && pagedir_get_page(pd, uaddr) != NULL
+         && (!write || pagedir_is_writable(pd, uaddr));
+}
+
+/* Returns true if UADDR lies in the current process's heap, whose
+   last page is usable in full. */
+static bool
+is_heap_access(const void *uaddr)
+{
+  struct thread *t = process_current();
+
+  return (const uint8_t *) uaddr >= t->heap_start
+         && (const uint8_t *) uaddr < (uint8_t *) pg_round_up(t->heap_brk);
+}
+
+/* Returns true if any of the PAGE_CNT pages at UPAGE lies in the
+   current process's heap. */
+static bool
+overlaps_heap(const uint8_t *upage, size_t page_cnt)
+{
+  struct thread *t = process_current();
+
+  return upage < (uint8_t *) pg_round_up(t->heap_brk)
+         && upage + page_cnt * PGSIZE > t->heap_start;
+}
+
+/* Resolve a fault at user address UADDR for the current process,
+   whose user stack pointer is ESP.  WRITE is true for a write access.
+   Reads of never-written anonymous pages map the shared zero page;
+   writes to it get a frame of their own.  Returns true if the access
+   may now be retried, false if it is invalid.  Faults of a process's
+   threads are resolved one at a time, except that a fault on a page
+   that another thread has mapped in the meantime is retried at once,
+   without taking the process lock. */
+bool
+vm_handle_fault(const void *uaddr, const void *esp, bool write)
+{
+  struct thread *t = process_current();
+  unsigned major_faults;
+  bool success;
+
+  if (fault_resolved(t->pagedir, uaddr, write))
+    return true;
+
+  lock_acquire(&t->proc_lock);
+  major_faults = t->vm_major_faults;
+  success = resolve_fault(uaddr, esp, write);
+
+  /* Anything resolved without reading a page in was a minor fault. */
+  if (success && t->vm_major_faults == major_faults)
+    t->vm_minor_faults++;
+  lock_release(&t->proc_lock);
+  return success;
+}
+
+/* Does the work of vm_handle_fault() */
+static bool
+resolve_fault(const void *uaddr, const void *esp, bool write)
+{
+  struct thread *t = process_current();
+  struct suppl_pte *spte;
+  void *upage = pg_round_down(uaddr);
+
+  if (uaddr == NULL || !is_user_vaddr(uaddr))
+    return false;
+
+  spte = get_suppl_pte(&t->suppl_page_table, upage);
+  if (spte == NULL)
+    {
+      if (!is_stack_access(uaddr, esp) && !is_heap_access(uaddr))
+        return false;
+      if (write)
+        return grow_stack(upage);
+      spte = new_stack_pte(upage);
+      if (spte == NULL || !insert_suppl_pte(&t->suppl_page_table, spte))
+        {
+          kmem_cache_free(&spte_cache, spte);
+          return false;
+        }
+      spte->is_loaded = false;
+      return map_zero_page(spte);
+    }
+
+  /* A present page faults only when written while read-only, unless
+     another thread mapped it while this one waited for the lock. */
+  if (pagedir_get_page(t->pagedir, upage) != NULL)
+    {
+      if (fault_resolved(t->pagedir, uaddr, write))
+        return true;
+      if (spte->zero_mapped)
+        return break_zero_page(spte);
+      return spte->cow && frame_break_cow(spte);
+    }
+
+  /* Still marked loaded but unmapped: another thread is evicting it. */
+  if (spte->is_loaded)
+    {
+      frame_wait_eviction();
+      if (spte->is_loaded)
+        return pagedir_get_page(t->pagedir, upage) != NULL;
+    }
+
+  /* BSS pages not yet touched read as zeros until written. */
+  if (spte->type == FILE && spte->data.file_page.read_bytes == 0)
+    {
+      if (!write)
+        return map_zero_page(spte);
+      if (vm_large_pages && map_large_page(upage))
+        return true;
+    }
+  return load_page(spte);
+}
+
+/* Returns true if SPTE is a writable zero-fill page that has never
+   been touched, which a large page may cover. */
+static bool
+large_page_candidate(const struct suppl_pte *spte)
+{
+  return spte != NULL && spte->type == FILE
+         && spte->data.file_page.read_bytes == 0
+         && spte->data.file_page.writable
+         && !spte->is_loaded && !spte->zero_mapped && !spte->swap_clean;
+}
+
+/* Map the 4 MB aligned region around UPAGE with one large page, if
+   every page in it is a candidate and nothing in it is mapped yet.
+   Returns false otherwise, or if no aligned run of frames is free,
+   and the caller falls back to a 4 kB page.  The large page is
+   split back into 4 kB pages by the first change to any one of
+   them, such as eviction, a fork or process exit. */
+static bool
+map_large_page(void *upage)
+{
+  struct thread *t = process_current();
+  uint8_t *base = (uint8_t *) ((uintptr_t) upage & ~(uintptr_t) (PTSPAN - 1));
+  uint8_t *kpage;
+  size_t i;
+
+  if (!pagedir_can_map_large(t->pagedir, base))
+    return false;
+  for (i = 0; i < PTSPAN / PGSIZE; i++)
+    if (!large_page_candidate(get_suppl_pte(&t->suppl_page_table,
+                                            base + i * PGSIZE)))
+      return false;
+
+  kpage = frame_allocate_large();
+  if (kpage == NULL)
+    return false;
+  if (!pagedir_set_large(t->pagedir, base, kpage, true))
+    {
+      for (i = 0; i < PTSPAN / PGSIZE; i++)
+        free_frame(kpage + i * PGSIZE);
+      return false;
+    }
+  for (i = 0; i < PTSPAN / PGSIZE; i++)
+    {
+      struct suppl_pte *spte = get_suppl_pte(&t->suppl_page_table,
+                                             base + i * PGSIZE);
+      spte->is_loaded = true;
+      set_frame_user_page(kpage + i * PGSIZE, spte);
+    }
+  return true;
+}
+
+/* Map the whole of FILE at page-aligned user address ADDR in the
+   current process.  On success the mapping takes ownership of FILE
+   and its identifier is returned; otherwise returns -1 and the caller
+   keeps FILE. */
+int
+vm_mmap(struct file *file, void *addr)
+{
+  struct thread *t = process_current();
+  int mapid;
+
+  lock_acquire(&t->proc_lock);
+  mapid = map_file(file, addr);
+  lock_release(&t->proc_lock);
+  return mapid;
+}
+
+/* Does the work of vm_mmap() */
+static int
+map_file(struct file *file, void *addr)
+{
+  struct thread *t = process_current();
+  struct mmap_region *r;
+  off_t length = file_length(file);
+  size_t page_cnt = DIV_ROUND_UP(length, PGSIZE);
+  size_t i;
+
+  if (length == 0 || addr == NULL || pg_ofs(addr) != 0
+      || (uint8_t *) addr + page_cnt * PGSIZE > (uint8_t *) PHYS_BASE
+      || (uint8_t *) addr + page_cnt * PGSIZE < (uint8_t *) addr
+      || overlaps_heap(addr, page_cnt))
+    return -1;
+  for (i = 0; i < page_cnt; i++)
+    if (get_suppl_pte(&t->suppl_page_table,
+                      (uint8_t *) addr + i * PGSIZE) != NULL)
+      return -1;
+
+  r = malloc(sizeof *r);
+  if (r == NULL)
+    return -1;
+  r->mapid = t->next_mapid++;
+  r->file = file;
+  r->addr = addr;
+  r->page_cnt = 0;
+  r->advice = MADV_NORMAL;
+  list_push_back(&t->mmap_list, &r->elem);
+
+  for (i = 0; i < page_cnt; i++)
+    {
+      off_t ofs = i * PGSIZE;
+      uint32_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+      if (!suppl_pt_insert_mmf(file, ofs, (uint8_t *) addr + ofs,
+                               read_bytes))
+        {
+          r->file = NULL;
+          unmap_region(r);
+          return -1;
+        }
+      r->page_cnt++;
+    }
+  return r->mapid;
+}
+
+/* Remove the current process's mapping MAPID.  Returns false if there
+   is no such mapping. */
+bool
+vm_munmap(int mapid)
+{
+  struct thread *t = process_current();
+  struct list_elem *e;
+  bool found = false;
+
+  lock_acquire(&t->proc_lock);
+  for (e = list_begin(&t->mmap_list); e != list_end(&t->mmap_list);
+       e = list_next(e))
+    {
+      struct mmap_region *r = list_entry(e, struct mmap_region, elem);
+      if (r->mapid == mapid)
+        {
+          unmap_region(r);
+          found = true;
+          break;
+        }
+    }
+  lock_release(&t->proc_lock);
+  return found;
+}
+
+/* Remove all of the current process's mappings, on exit */
+void
+vm_munmap_all(void)
+{
+  struct thread *t = process_current();
+
+  while (!list_empty(&t->mmap_list))
+    unmap_region(list_entry(list_front(&t->mmap_list),
+                            struct mmap_region, elem));
+}
+
+/* Returns the current process's mapping containing UADDR, if any */
+static struct mmap_region *
+find_region(const void *uaddr)
+{
+  struct thread *t = process_current();
+  struct list_elem *e;
+
+  for (e = list_begin(&t->mmap_list); e != list_end(&t->mmap_list);
+       e = list_next(e))
+    {
+      struct mmap_region *r = list_entry(e, struct mmap_region, elem);
+      if ((uint8_t *) uaddr >= (uint8_t *) r->addr
+          && (uint8_t *) uaddr < (uint8_t *) r->addr + r->page_cnt * PGSIZE)
+        return r;
+    }
+  return NULL;
+}
+
+/* Read up to CNT pages of R starting at page FIRST that are not yet
+   resident, as long as free frames last.  Frames are taken a batch
+   at a time. */
+static void
+mmf_prefetch(struct mmap_region *r, size_t first, size_t cnt)
+{
+  struct thread *t = process_current();
+  size_t end = first + cnt < r->page_cnt ? first + cnt : r->page_cnt;
+  size_t i = first;
+
+  while (i < end)
+    {
+      struct suppl_pte *sptes[FRAME_BATCH];
+      void *kpages[FRAME_BATCH];
+      size_t want = 0, got, j;
+
+      for (; i < end && want < FRAME_BATCH; i++)
+        {
+          struct suppl_pte *spte = get_suppl_pte(&t->suppl_page_table,
+                                                 (uint8_t *) r->addr
+                                                 + i * PGSIZE);
+          if (!spte->is_loaded)
+            sptes[want++] = spte;
+        }
+
+      got = allocate_frames(PAL_USER, kpages, want, false);
+      for (j = 0; j < got && load_page_mmf(sptes[j], kpages[j]); j++)
+        continue;
+      if (j < got)
+        free_frames(kpages + j + 1, got - j - 1);
+      if (j < want)
+        break;
+    }
+}
+
+/* Write back the dirty pages among CNT pages of R starting at page
+   FIRST, then free their frames.  Runs of adjacent dirty pages go to
+   the file in one write, straight from their user addresses, with the
+   pages pinned so the copy cannot fault under file system locks. */
+static void
+release_region_pages(struct mmap_region *r, size_t first, size_t cnt)
+{
+  struct thread *t = process_current();
+  uint8_t *base = r->addr;
+  size_t end = first + cnt;
+  struct tlb_batch batch;
+  size_t i, run;
+
+  /* Pin what is resident, then let any eviction already under way
+     finish: it writes its page back itself.  Anything not pinned
+     after that is not resident and cannot become so. */
+  for (i = first; i < end; i++)
+    frame_pin_user_page(t, base + i * PGSIZE);
+  frame_wait_eviction();
+
+  for (i = first; i < end; i = run)
+    {
+      off_t bytes = 0;
+
+      for (run = i; run < end; run++)
+        {
+          struct suppl_pte *spte
+            = get_suppl_pte(&t->suppl_page_table, base + run * PGSIZE);
+          if (pagedir_get_page(t->pagedir, spte->user_vaddr) == NULL
+              || !pagedir_is_dirty(t->pagedir, spte->user_vaddr))
+            break;
+          bytes += spte->data.mmf_page.read_bytes;
+        }
+      if (bytes > 0)
+        file_write_at(r->file, base + i * PGSIZE, bytes, i * PGSIZE);
+      else
+        run++;
+    }
+
+  pagedir_batch_begin(&batch);
+  for (i = first; i < end; i++)
+    {
+      struct suppl_pte *spte
+        = get_suppl_pte(&t->suppl_page_table, base + i * PGSIZE);
+      frame_release_page(t, spte->user_vaddr);
+      spte->is_loaded = false;
+    }
+  pagedir_batch_end(&batch);
+}
+
+/* Write back the dirty pages of R, free its pages and close its file. */
+static void
+unmap_region(struct mmap_region *r)
+{
+  struct thread *t = process_current();
+  size_t i;
+
+  release_region_pages(r, 0, r->page_cnt);
+  for (i = 0; i < r->page_cnt; i++)
+    {
+      struct suppl_pte *spte
+        = spt_remove(&t->suppl_page_table, (uint8_t *) r->addr + i * PGSIZE);
+      kmem_cache_free(&spte_cache, spte);
+    }
+
+  list_remove(&r->elem);
+  file_close(r->file);
+  free(r);
+}
+
+/* Move the current process's heap break by INCREMENT bytes and
+   return the old break, or (void *) -1 if the heap would shrink
+   below its start or grow into the stack region or a page that is
+   already in use.  Pages are added lazily, as anonymous pages made
+   on first touch; pages given back are freed at once. */
+void *
+vm_sbrk(intptr_t increment)
+{
+  struct thread *t = process_current();
+  uint8_t *old_brk, *new_brk, *upage;
+  void *result = (void *) -1;
+
+  lock_acquire(&t->proc_lock);
+  old_brk = t->heap_brk;
+  new_brk = old_brk + increment;
+  if (increment >= 0)
+    {
+      if (new_brk < old_brk
+          || new_brk > (uint8_t *) PHYS_BASE - STACK_SIZE)
+        goto done;
+      for (upage = pg_round_up(old_brk); upage < new_brk; upage += PGSIZE)
+        if (get_suppl_pte(&t->suppl_page_table, upage) != NULL)
+          goto done;
+    }
   else
     {
-      /* Add the page to the process's address space */
-      if (!pagedir_set_page(t->pagedir, pg_round_down(uvaddr), spage, true))
+      if (new_brk < t->heap_start || new_brk > old_brk)
+        goto done;
+      for (upage = pg_round_up(new_brk); upage < old_brk; upage += PGSIZE)
         {
-          free_frame(spage); 
+          struct suppl_pte *spte = spt_remove(&t->suppl_page_table, upage);
+          if (spte != NULL)
+            free_suppl_pte(spte);
         }
     }
+  t->heap_brk = new_brk;
+  result = old_brk;
+
+done:
+  lock_release(&t->proc_lock);
+  return result;
 }
 
+/* Apply ADVICE to the mapped pages in [UADDR, UADDR + SIZE).
+   MADV_NORMAL and MADV_SEQUENTIAL set the access pattern of every
+   mapping the range touches; MADV_WILLNEED reads the pages in now and
+   MADV_DONTNEED writes them back and frees their frames.  Returns
+   false if ADVICE is unknown or the range is not page-aligned. */
+bool
+vm_madvise(void *uaddr, size_t size, int advice)
+{
+  struct thread *t = process_current();
+  uint8_t *start = uaddr, *end = start + size;
+  struct list_elem *e;
 
+  if (pg_ofs(uaddr) != 0 || end < start
+      || advice < MADV_NORMAL || advice > MADV_DONTNEED)
+    return false;
 
+  lock_acquire(&t->proc_lock);
+  for (e = list_begin(&t->mmap_list); e != list_end(&t->mmap_list);
+       e = list_next(e))
+    {
+      struct mmap_region *r = list_entry(e, struct mmap_region, elem);
+      uint8_t *r_start = r->addr;
+      uint8_t *r_end = r_start + r->page_cnt * PGSIZE;
+      size_t first, last;
 
+      if (end <= r_start || start >= r_end)
+        continue;
+      first = (start > r_start ? start - r_start : 0) / PGSIZE;
+      last = DIV_ROUND_UP((end < r_end ? end : r_end) - r_start, PGSIZE);
 
+      if (advice == MADV_WILLNEED)
+        mmf_prefetch(r, first, last - first);
+      else if (advice == MADV_DONTNEED)
+        release_region_pages(r, first, last - first);
+      else
+        r->advice = advice;
+    }
+  lock_release(&t->proc_lock);
+  return true;
+}
 
+/* Map shared-memory FRAME at UPAGE as page IDX of a mapping of CNT
+   pages in the current process */
+static bool
+map_shared_page(void *frame, uint8_t *upage, size_t idx, size_t cnt)
+{
+  struct spt *spt = &process_current()->suppl_page_table;
+  struct suppl_pte *spte = kmem_cache_zalloc(&spte_cache);
 
+  if (spte == NULL)
+    return false;
+  spte->user_vaddr = upage;
+  spte->type = SHM;
+  spte->data.shm_page.idx = idx;
+  spte->data.shm_page.page_cnt = cnt;
+  if (!insert_suppl_pte(spt, spte))
+    {
+      kmem_cache_free(&spte_cache, spte);
+      return false;
+    }
+  if (!frame_shm_map(frame, spte))
+    {
+      kmem_cache_free(&spte_cache, spt_remove(spt, upage));
+      return false;
+    }
+  return true;
+}
+
+/* Map the CNT shared-memory frames in FRAMES, obtained from
+   frame_shm_alloc(), at page-aligned user address ADDR in the
+   current process.  Returns false if ADDR is not free for them. */
+bool
+vm_map_shared(void *const *frames, size_t cnt, void *addr)
+{
+  struct thread *t = process_current();
+  uint8_t *upage = addr;
+  bool success = true;
+  size_t i;
+
+  if (cnt == 0 || addr == NULL || pg_ofs(addr) != 0
+      || upage + cnt * PGSIZE > (uint8_t *) PHYS_BASE
+      || upage + cnt * PGSIZE < upage || overlaps_heap(upage, cnt))
+    return false;
+
+  lock_acquire(&t->proc_lock);
+  for (i = 0; i < cnt; i++)
+    if (get_suppl_pte(&t->suppl_page_table, upage + i * PGSIZE) != NULL)
+      success = false;
+
+  for (i = 0; success && i < cnt; i++)
+    if (!map_shared_page(frames[i], upage + i * PGSIZE, i, cnt))
+      {
+        success = false;
+        break;
+      }
+
+  /* Undo the pages mapped before a failure. */
+  if (!success)
+    while (i-- > 0)
+      {
+        frame_shm_unmap(t, upage + i * PGSIZE);
+        kmem_cache_free(&spte_cache,
+                        spt_remove(&t->suppl_page_table, upage + i * PGSIZE));
+      }
+  lock_release(&t->proc_lock);
+  return success;
+}
+
+/* Remove the current process's mapping of a shared-memory segment
+   that starts at ADDR.  Returns false if there is none. */
+bool
+vm_unmap_shared(void *addr)
+{
+  struct thread *t = process_current();
+  struct suppl_pte *spte;
+  struct tlb_batch batch;
+  size_t i, cnt;
+
+  lock_acquire(&t->proc_lock);
+  spte = get_suppl_pte(&t->suppl_page_table, addr);
+  if (spte == NULL || spte->type != SHM || pg_ofs(addr) != 0
+      || spte->data.shm_page.idx != 0)
+    {
+      lock_release(&t->proc_lock);
+      return false;
+    }
+  cnt = spte->data.shm_page.page_cnt;
+  pagedir_batch_begin(&batch);
+  for (i = 0; i < cnt; i++)
+    {
+      uint8_t *upage = (uint8_t *) addr + i * PGSIZE;
+
+      frame_shm_unmap(t, upage);
+      kmem_cache_free(&spte_cache, spt_remove(&t->suppl_page_table, upage));
+    }
+  pagedir_batch_end(&batch);
+  lock_release(&t->proc_lock);
+  return true;
+}
+
+/* Copy PARENT's address space into the current process, which is
+   being forked from it and has an empty page directory and
+   supplemental page table.  Resident pages are shared copy-on-write,
+   and shared-memory pages are simply shared; swapped-out ones are
+   read into new frames, and the rest are loaded
+   from their files on demand, the same as in PARENT.  Runs with
+   PARENT's proc_lock held, so only eviction can change its pages
+   meanwhile. */
+bool
+vm_fork(struct thread *parent)
+{
+  struct thread *cur = process_current();
+  struct suppl_pte *pspte;
+  struct list_elem *e;
+
+  for (e = list_begin(&parent->mmap_list); e != list_end(&parent->mmap_list);
+       e = list_next(e))
+    if (!fork_region(parent, list_entry(e, struct mmap_region, elem)))
+      return false;
+  cur->next_mapid = parent->next_mapid;
+  cur->heap_start = parent->heap_start;
+  cur->heap_brk = parent->heap_brk;
+
+  for (pspte = spt_next(&parent->suppl_page_table, NULL); pspte != NULL;
+       pspte = spt_next(&parent->suppl_page_table,
+                        (uint8_t *) pspte->user_vaddr + PGSIZE))
+    if (!(pspte->type & MMF) && !fork_page(parent, pspte))
+      return false;
+  return true;
+}
+
+/* Give the current process its copy of PARENT's page PSPTE */
+static bool
+fork_page(struct thread *parent, struct suppl_pte *pspte)
+{
+  struct thread *cur = process_current();
+  struct suppl_pte *spte = kmem_cache_alloc(&spte_cache);
+  uint8_t *kpage;
+
+  if (spte == NULL)
+    return false;
+  *spte = *pspte;
+  spte->is_loaded = false;
+  spte->swap_clean = false;
+  spte->zero_mapped = false;
+  spte->cow = false;
+  if (spte->type & FILE)
+    spte->data.file_page.file = cur->exec_file;
+  if (!insert_suppl_pte(&cur->suppl_page_table, spte))
+    {
+      kmem_cache_free(&spte_cache, spte);
+      return false;
+    }
+
+  if (pspte->zero_mapped)
+    return map_zero_page(spte);
+  if (spte->type == SHM)
+    return frame_shm_map(pagedir_get_page(parent->pagedir,
+                                          spte->user_vaddr), spte);
+  if (frame_fork_page(parent, pspte, spte))
+    return true;
+  if (!(spte->type & SWAP))
+    return true;
+
+  /* Swapped out: PARENT keeps its slot, so take a copy of it. */
+  kpage = allocate_frame(PAL_USER);
+  if (kpage == NULL)
+    return false;
+  vm_swap_read(spte->swap_slot_index, kpage);
+  if (!pagedir_set_page(cur->pagedir, spte->user_vaddr, kpage,
+                        spte->swap_writable))
+    {
+      free_frame(kpage);
+      return false;
+    }
+  set_frame_user_page(kpage, spte);
+  spte->is_loaded = true;
+  return true;
+}
+
+/* Give the current process its own mapping of the same part of the
+   same file as PARENT's mapping R.  PARENT's dirty pages are written
+   back first, so that the new mapping reads what PARENT sees. */
+static bool
+fork_region(struct thread *parent, struct mmap_region *r)
+{
+  struct thread *cur = process_current();
+  struct mmap_region *copy;
+  size_t i;
+
+  for (i = 0; i < r->page_cnt; i++)
+    {
+      uint8_t *upage = (uint8_t *) r->addr + i * PGSIZE;
+      struct suppl_pte *pspte = get_suppl_pte(&parent->suppl_page_table,
+                                              upage);
 
+      if (!frame_pin_user_page(parent, upage))
+        continue;
+      if (pagedir_is_dirty(parent->pagedir, upage))
+        {
+          write_page_back_to_file_wo_lock(pspte,
+                                          pagedir_get_page(parent->pagedir,
+                                                           upage));
+          pagedir_set_dirty(parent->pagedir, upage, false);
+        }
+      frame_unpin_user_page(parent, upage);
+    }
+
+  copy = malloc(sizeof *copy);
+  if (copy == NULL)
+    return false;
+  copy->file = file_reopen(r->file);
+  if (copy->file == NULL)
+    {
+      free(copy);
+      return false;
+    }
+  copy->mapid = r->mapid;
+  copy->addr = r->addr;
+  copy->page_cnt = 0;
+  copy->advice = r->advice;
+  list_push_back(&cur->mmap_list, &copy->elem);
+
+  for (i = 0; i < r->page_cnt; i++)
+    {
+      struct suppl_pte *pspte
+        = get_suppl_pte(&parent->suppl_page_table,
+                        (uint8_t *) r->addr + i * PGSIZE);
+      if (!suppl_pt_insert_mmf(copy->file, pspte->data.mmf_page.ofs,
+                               pspte->user_vaddr,
+                               pspte->data.mmf_page.read_bytes))
+        return false;
+      copy->page_cnt++;
+    }
+  return true;
+}
+
+/* Store the current process's paging statistics in *ST */
+void
+vm_get_stats(struct vmstat *st)
+{
+  struct thread *t = process_current();
+
+  st->minor_faults = t->vm_minor_faults;
+  st->major_faults = t->vm_major_faults;
+  st->swap_ins = t->vm_swap_ins;
+  st->swap_outs = t->vm_swap_outs;
+  st->evictions = t->vm_evictions;
+  st->resident = t->vm_resident;
+  st->frames = palloc_user_page_cnt();
+  st->swap_slots = t->vm_swap_slots;
+  st->swap_free = vm_swap_free_cnt();
+  st->swap_used = vm_swap_slot_cnt() - st->swap_free;
+}
+
+/* Print the current process's paging statistics, if -vmstat was given */
+void
+vm_print_process_stats(void)
+{
+  struct vmstat st;
+
+  if (!vm_print_stats)
+    return;
+  vm_get_stats(&st);
+  printf("%s: vm: %u minor, %u major faults, %u swap-ins, %u swap-outs, "
+         "%u evictions, %u resident, %u swap slots "
+         "(%u of %u in use)\n", process_current()->name,
+         st.minor_faults, st.major_faults, st.swap_ins, st.swap_outs,
+         st.evictions, st.resident, st.swap_slots,
+         st.swap_used, st.swap_used + st.swap_free);
+}
@@ -3,11 +3,17 @@
 
 #define STACK_SIZE (8 * (1 << 20))
 
+/* The stack region is split into this many slots, each the stack of
+   one of a process's threads; the initial thread's is at the top. */
+#define THREAD_STACK_SIZE (512 * 1024)
+#define THREAD_STACK_CNT (STACK_SIZE / THREAD_STACK_SIZE)
+
 #include <stdio.h>
 #include "threads/thread.h"
 #include "threads/palloc.h"
 #include "lib/kernel/hash.h"
 #include "filesys/file.h"
+#include "lib/user/syscall.h"
 
 /* *****************************************************
  * This file is about supplemental page table management
@@ -20,7 +26,8 @@ enum suppl_pte_type
 {
   SWAP = 001,
   FILE = 002,
-  MMF  = 004
+  MMF  = 004,
+  SHM  = 010          /* Page of a shared-memory segment, always resident */
 };
 
 union suppl_pte_data
@@ -40,6 +47,12 @@ union suppl_pte_data
     off_t ofs;
     uint32_t read_bytes;
   } mmf_page;
+
+  struct
+  {
+    size_t idx;         /* Index of the page in its mapping */
+    size_t page_cnt;    /* Number of pages mapped */
+  } shm_page;
 };
 
 /* supplemental page table entry */
@@ -53,22 +66,37 @@ struct suppl_pte
   /* reserved for possible swapping */
   size_t swap_slot_index;
   bool swap_writable;
+  bool swap_clean;    /* Resident, with an up-to-date copy in swap */
+  bool zero_mapped;   /* Mapped read-only to the shared zero page */
+  bool cow;           /* Writable, but sharing a frame read-only */
+};
 
-  struct hash_elem elem;
+/* A memory-mapped file, in its process's mmap_list */
+struct mmap_region
+{
+  int mapid;
+  struct file *file;        /* Private reopened handle */
+  void *addr;               /* First mapped page */
+  size_t page_cnt;          /* Number of pages mapped */
+  int advice;               /* MADV_NORMAL or MADV_SEQUENTIAL */
+  struct list_elem elem;
 };
 
-/* Initialization of the supplemental page table management provided */
-void vm_page_init(void);
+/* Pages read ahead of each fault in a MADV_SEQUENTIAL mapping, by
+   default and as set by the mmf_prefetch tunable */
+#define MMF_PREFETCH_PAGES 4
+extern size_t vm_mmf_prefetch;
 
-/* Functionalities required by hash table, which is supplemental_pt */
-unsigned suppl_pt_hash (const struct hash_elem *, void * UNUSED);
-bool suppl_pt_less (const struct hash_elem *, 
-		    const struct hash_elem *,
-		    void * UNUSED);
+/* Pages of an executable read in by exec, from its entry point on,
+   by default and as set by the exec_prefetch tunable */
+#define EXEC_PREFETCH_PAGES 8
+extern size_t vm_exec_prefetch;
 
+/* Initialization of the supplemental page table management provided */
+void vm_page_init(void);
 
 /* insert the given suppl pte */
-bool insert_suppl_pte (struct hash *, struct suppl_pte *);
+bool insert_suppl_pte (struct spt *, struct suppl_pte *);
 
 /* Add a file supplemental page table entry to the current thread's
  * supplemental page table */
@@ -79,21 +107,54 @@ bool suppl_pt_insert_file ( struct file *, off_t, uint8_t *,
  * thread's supplemental page table */
 bool suppl_pt_insert_mmf (struct file *, off_t, uint8_t *, uint32_t);
 
-/* Given hash table and its key which is a user virtual address, find the
- * corresponding hash element*/
-struct suppl_pte *get_suppl_pte (struct hash *, void *);
+/* Given a supplemental page table and a user virtual address, find the
+ * corresponding entry */
+struct suppl_pte *get_suppl_pte (struct spt *, void *);
 
 /* Given a suppl_pte struct spte, write data at address spte->uvaddr to
  * file. It is required if a page is dirty */
-void write_page_back_to_file_wo_lock (struct suppl_pte *);
+void write_page_back_to_file_wo_lock (struct suppl_pte *, void *);
 
-/* Free the given supplimental page table, which is a hash table */
-void free_suppl_pt (struct hash *);
+/* Free the given supplimental page table and its entries */
+void free_suppl_pt (struct spt *);
+
+/* Whether the process may write the page */
+bool suppl_pte_writable (const struct suppl_pte *);
 
 /* Load page data to the page defined in struct suppl_pte. */
 bool load_page (struct suppl_pte *);
 
 /* Grow stack by one page where the given address points to */
-void grow_stack (void *);
+bool grow_stack (void *);
+
+/* Read in the file pages of a range before they fault */
+void vm_prefetch (void *, size_t);
+
+/* Large pages for zero-fill regions (-largepages) */
+extern bool vm_large_pages;
+
+/* Paging statistics */
+extern bool vm_print_stats;
+void vm_get_stats (struct vmstat *);
+void vm_print_process_stats (void);
+
+/* Memory-mapped files */
+int vm_mmap (struct file *, void *);
+bool vm_munmap (int);
+void vm_munmap_all (void);
+bool vm_madvise (void *, size_t, int);
+
+/* Heap */
+void *vm_sbrk (intptr_t);
+
+/* Page fault handling */
+bool vm_handle_fault (const void *, const void *, bool);
+
+/* Mappings of shared-memory segments */
+bool vm_map_shared(void *const *, size_t, void *);
+bool vm_unmap_shared(void *);
+
+/* Copy-on-write duplication of a process's address space */
+bool vm_fork (struct thread *);
 
 #endif /* vm/page.h */
@@ -0,0 +1,274 @@
+#include "vm/ring.h"
+#include <list.h>
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/process.h"
+#include "userprog/syscall.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+
+/* Asynchronous I/O rings (ring_setup() in lib/user/syscall.h).  The
+   rings live in one frame from frame_shm_alloc(), which is mapped
+   into the process and which the kernel reaches through its kernel
+   address, so that taking a request or posting a completion never
+   faults.  ring_enter() copies requests out of the submission ring
+   into a queue served by RING_WORKERS kernel threads of the process.
+   These share its address space and open files like its user
+   threads do, so each runs a request just as the system call would
+   have run in the thread that made it, and process_exit() waits for
+   them like for its user threads. */
+
+/* Kernel threads serving each ring. */
+#define RING_WORKERS 4
+
+/* A request taken from the submission ring. */
+struct ring_req
+{
+  struct list_elem elem;        /* In queue or free_reqs. */
+  struct ring_sqe sqe;          /* Copy of the request. */
+};
+
+/* A process's ring, as the kernel sees it. */
+struct io_ring
+{
+  struct ring *shared;          /* The frame shared with the process. */
+  unsigned entries;             /* Slots in each ring. */
+  unsigned sq_head;             /* Our copies of the indexes that only */
+  unsigned cq_tail;             /* the kernel advances. */
+
+  struct lock lock;             /* Guards the members below. */
+  struct condition work_ready;  /* Signaled when queue gains a request. */
+  struct condition completed;   /* Broadcast on each completion. */
+  struct list queue;            /* Requests waiting for a worker. */
+  struct list free_reqs;        /* Unused members of reqs. */
+  unsigned in_flight;           /* Requests taken but not posted. */
+  bool stopping;                /* The process is exiting. */
+
+  tid_t workers[RING_WORKERS];  /* Worker threads, TID_ERROR if none. */
+  struct ring_req reqs[RING_MAX_ENTRIES];
+};
+
+static thread_func ring_worker;
+static int run_request(const struct ring_sqe *);
+static unsigned completions_waiting(const struct io_ring *);
+static void stop_ring(struct io_ring *);
+
+/* Map a ring of ENTRIES slots at page-aligned user address ADDR in
+   the current process and start its workers.  Returns ADDR, or a
+   null pointer on failure. */
+void *
+vm_ring_setup(unsigned entries, void *addr)
+{
+  struct thread *leader = process_current();
+  struct io_ring *r;
+  void *frame;
+  bool success;
+  int started = 0;
+  unsigned i;
+
+  if (entries == 0 || entries > RING_MAX_ENTRIES
+      || (entries & (entries - 1)) != 0 || leader->ring != NULL)
+    return NULL;
+  r = malloc(sizeof *r);
+  if (r == NULL)
+    return NULL;
+  frame = frame_shm_alloc();
+  if (frame == NULL || !vm_map_shared(&frame, 1, addr))
+  {
+    if (frame != NULL)
+      frame_shm_release(frame);
+    free(r);
+    return NULL;
+  }
+
+  r->shared = frame;
+  r->shared->entries = r->entries = entries;
+  r->sq_head = r->cq_tail = 0;
+  lock_init_named(&r->lock, "ring");
+  cond_init(&r->work_ready);
+  cond_init(&r->completed);
+  list_init(&r->queue);
+  list_init(&r->free_reqs);
+  for (i = 0; i < entries; i++)
+    list_push_back(&r->free_reqs, &r->reqs[i].elem);
+  r->in_flight = 0;
+  r->stopping = false;
+  for (i = 0; i < RING_WORKERS; i++)
+  {
+    r->workers[i] = process_kthread_create(ring_worker, r);
+    if (r->workers[i] != TID_ERROR)
+      started++;
+  }
+
+  /* Publish the ring unless another thread beat us to it or the
+     process began to exit, in which case vm_ring_stop() has
+     already looked for a ring to stop. */
+  lock_acquire(&leader->proc_lock);
+  success = started > 0 && leader->ring == NULL && !leader->dying;
+  if (success)
+    leader->ring = r;
+  lock_release(&leader->proc_lock);
+  if (!success)
+  {
+    stop_ring(r);
+    for (i = 0; i < RING_WORKERS; i++)
+      if (r->workers[i] != TID_ERROR)
+        process_thread_join(r->workers[i]);
+    vm_unmap_shared(addr);
+    frame_shm_release(frame);
+    free(r);
+    return NULL;
+  }
+  return addr;
+}
+
+/* Hand up to TO_SUBMIT requests from the current process's
+   submission ring to its workers, then wait until MIN_COMPLETE
+   completions are waiting or none is left in flight.  Returns the
+   number of requests taken, or -1 if the process has no ring. */
+int
+vm_ring_enter(unsigned to_submit, unsigned min_complete)
+{
+  struct io_ring *r = process_current()->ring;
+  struct ring *s;
+  unsigned taken = 0;
+
+  if (r == NULL)
+    return -1;
+  s = r->shared;
+
+  lock_acquire(&r->lock);
+  while (taken < to_submit && s->sq_tail != r->sq_head
+         && r->in_flight + completions_waiting(r) < r->entries)
+  {
+    struct ring_req *req = list_entry(list_pop_front(&r->free_reqs),
+                                      struct ring_req, elem);
+
+    /* Read the request only after its tail. */
+    barrier();
+    req->sqe = s->sq[r->sq_head++ & (r->entries - 1)];
+    s->sq_head = r->sq_head;
+    list_push_back(&r->queue, &req->elem);
+    r->in_flight++;
+    cond_signal(&r->work_ready, &r->lock);
+    taken++;
+  }
+  while (!r->stopping && r->in_flight > 0
+         && completions_waiting(r) < min_complete)
+    cond_wait(&r->completed, &r->lock);
+  lock_release(&r->lock);
+  return taken;
+}
+
+/* Tell the workers of process T's ring, if any, to finish the
+   request they are running and end, and wake any thread waiting in
+   vm_ring_enter().  Called when T begins to exit. */
+void
+vm_ring_stop(struct thread *t)
+{
+  struct io_ring *r;
+
+  lock_acquire(&t->proc_lock);
+  r = t->ring;
+  lock_release(&t->proc_lock);
+  if (r != NULL)
+    stop_ring(r);
+}
+
+/* Free process T's ring, on exit, once its workers have ended. */
+void
+vm_ring_exit(struct thread *t)
+{
+  struct io_ring *r = t->ring;
+
+  if (r == NULL)
+    return;
+  frame_shm_release(r->shared);
+  free(r);
+  t->ring = NULL;
+}
+
+/* Body of a worker thread: run requests from ring R's queue and
+   post their completions until R stops. */
+static void
+ring_worker(void *r_)
+{
+  struct io_ring *r = r_;
+
+  lock_acquire(&r->lock);
+  for (;;)
+  {
+    struct ring_req *req;
+    struct ring_cqe *cqe;
+    int result;
+
+    while (list_empty(&r->queue) && !r->stopping)
+      cond_wait(&r->work_ready, &r->lock);
+    if (r->stopping)
+      break;
+    req = list_entry(list_pop_front(&r->queue), struct ring_req, elem);
+    lock_release(&r->lock);
+    result = run_request(&req->sqe);
+    lock_acquire(&r->lock);
+
+    /* Fill in the completion before its tail moves. */
+    cqe = &r->shared->cq[r->cq_tail++ & (r->entries - 1)];
+    cqe->user_data = req->sqe.user_data;
+    cqe->result = result;
+    barrier();
+    r->shared->cq_tail = r->cq_tail;
+    list_push_back(&r->free_reqs, &req->elem);
+    r->in_flight--;
+    cond_broadcast(&r->completed, &r->lock);
+  }
+  lock_release(&r->lock);
+}
+
+/* Run SQE as the matching system call and return its result.  A bad
+   user buffer kills the process, as it would in the call itself. */
+static int
+run_request(const struct ring_sqe *sqe)
+{
+  switch (sqe->op)
+    {
+    case RING_OP_NOP:
+      return 0;
+    case RING_OP_OPEN:
+      return open(sqe->buf);
+    case RING_OP_READ:
+      return read(sqe->fd, sqe->buf, sqe->len);
+    case RING_OP_WRITE:
+      return write(sqe->fd, sqe->buf, sqe->len);
+    case RING_OP_PREAD:
+      return pread(sqe->fd, sqe->buf, sqe->len, sqe->offset);
+    case RING_OP_PWRITE:
+      return pwrite(sqe->fd, sqe->buf, sqe->len, sqe->offset);
+    case RING_OP_FSYNC:
+      return fsync(sqe->fd) ? 0 : -1;
+    default:
+      return -1;
+    }
+}
+
+/* Returns the number of completions in R that the process has not
+   read yet, as far as its CQ_HEAD tells. */
+static unsigned
+completions_waiting(const struct io_ring *r)
+{
+  unsigned waiting = r->cq_tail - r->shared->cq_head;
+
+  return waiting < r->entries ? waiting : r->entries;
+}
+
+/* Make R's workers end and wake its waiters.  Requests still queued
+   are dropped. */
+static void
+stop_ring(struct io_ring *r)
+{
+  lock_acquire(&r->lock);
+  r->stopping = true;
+  cond_broadcast(&r->work_ready, &r->lock);
+  cond_broadcast(&r->completed, &r->lock);
+  lock_release(&r->lock);
+}
@@ -0,0 +1,11 @@
+#ifndef VM_RING_H
+#define VM_RING_H
+
+struct thread;
+
+void *vm_ring_setup(unsigned entries, void *addr);
+int vm_ring_enter(unsigned to_submit, unsigned min_complete);
+void vm_ring_stop(struct thread *);
+void vm_ring_exit(struct thread *);
+
+#endif /* vm/ring.h */
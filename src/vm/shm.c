@@ -0,0 +1,140 @@
+#include "vm/shm.h"
+#include <round.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "userprog/process.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+
+/* Named shared-memory segments.  Each page of a segment is a frame
+   from frame_shm_alloc(), which the frame table keeps resident and
+   frees once the segment and every mapping of it are gone.  The name
+   lasts until the process that created the segment exits; mappings
+   made before then stay valid until they are unmapped. */
+#define SHM_MAX 16              /* Most segments at once */
+#define SHM_NAME_MAX 14         /* Longest name */
+
+struct shm_segment
+{
+  char name[SHM_NAME_MAX + 1];  /* Empty if the slot is free */
+  struct thread *creator;       /* Process that created it */
+  size_t page_cnt;              /* Number of pages */
+  void **frames;                /* Its PAGE_CNT frames */
+};
+
+static struct shm_segment segments[SHM_MAX];
+
+/* Pages in all segments, which may not exceed a quarter of the
+   user pool, since they are never evicted. */
+static size_t shm_page_cnt;
+
+/* Protects the members above. */
+static struct lock shm_lock;
+
+static struct shm_segment *find_segment(const char *);
+static void destroy_segment(struct shm_segment *);
+
+void
+vm_shm_init(void)
+{
+  lock_init_named(&shm_lock, "shm");
+}
+
+/* Create a zero-filled segment of SIZE bytes named NAME.  Fails if
+   the name is taken, too long or empty, or if memory is short. */
+bool
+vm_shm_create(const char *name, size_t size)
+{
+  size_t page_cnt = DIV_ROUND_UP(size, PGSIZE);
+  struct shm_segment *seg;
+
+  if (*name == '\0' || strlen(name) > SHM_NAME_MAX || page_cnt == 0)
+    return false;
+
+  lock_acquire(&shm_lock);
+  seg = find_segment("");
+  if (seg == NULL || find_segment(name) != NULL
+      || page_cnt > palloc_user_page_cnt() / 4 - shm_page_cnt
+      || (seg->frames = malloc(page_cnt * sizeof *seg->frames)) == NULL)
+  {
+    lock_release(&shm_lock);
+    return false;
+  }
+  for (seg->page_cnt = 0; seg->page_cnt < page_cnt; seg->page_cnt++)
+  {
+    seg->frames[seg->page_cnt] = frame_shm_alloc();
+    if (seg->frames[seg->page_cnt] == NULL)
+    {
+      while (seg->page_cnt > 0)
+        frame_shm_release(seg->frames[--seg->page_cnt]);
+      free(seg->frames);
+      lock_release(&shm_lock);
+      return false;
+    }
+  }
+  strlcpy(seg->name, name, sizeof seg->name);
+  seg->creator = process_current();
+  shm_page_cnt += page_cnt;
+  lock_release(&shm_lock);
+  return true;
+}
+
+/* Map the whole of segment NAME at page-aligned user address ADDR
+   in the current process.  Returns ADDR, or a null pointer if there
+   is no such segment or the pages there are not free. */
+void *
+vm_shm_map(const char *name, void *addr)
+{
+  struct shm_segment *seg;
+  bool success = false;
+
+  lock_acquire(&shm_lock);
+  seg = *name != '\0' ? find_segment(name) : NULL;
+  if (seg != NULL)
+    success = vm_map_shared(seg->frames, seg->page_cnt, addr);
+  lock_release(&shm_lock);
+  return success ? addr : NULL;
+}
+
+/* Remove the names of the segments that process T created, on
+   exit */
+void
+vm_shm_exit(struct thread *t)
+{
+  size_t i;
+
+  lock_acquire(&shm_lock);
+  for (i = 0; i < SHM_MAX; i++)
+    if (segments[i].name[0] != '\0' && segments[i].creator == t)
+      destroy_segment(&segments[i]);
+  lock_release(&shm_lock);
+}
+
+/* Returns the segment named NAME, or a free slot if NAME is empty,
+   or a null pointer if there is none */
+static struct shm_segment *
+find_segment(const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < SHM_MAX; i++)
+    if (!strcmp(segments[i].name, name))
+      return &segments[i];
+  return NULL;
+}
+
+/* Drop SEG's references to its frames and free its slot */
+static void
+destroy_segment(struct shm_segment *seg)
+{
+  size_t i;
+
+  for (i = 0; i < seg->page_cnt; i++)
+    frame_shm_release(seg->frames[i]);
+  free(seg->frames);
+  shm_page_cnt -= seg->page_cnt;
+  seg->name[0] = '\0';
+}
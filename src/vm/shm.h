@@ -0,0 +1,14 @@
+#ifndef VM_SHM_H
+#define VM_SHM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct thread;
+
+void vm_shm_init(void);
+bool vm_shm_create(const char *, size_t);
+void *vm_shm_map(const char *, void *);
+void vm_shm_exit(struct thread *);
+
+#endif /* vm/shm.h */
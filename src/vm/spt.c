@@ -0,0 +1,128 @@
+#include "vm/spt.h"
+#include <debug.h>
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+#include "vm/page.h"
+
+/* Page directory entries that cover user space */
+#define USER_PDE_CNT ((size_t) pd_no(PHYS_BASE))
+
+/* Entries in each leaf page */
+#define LEAF_CNT ((size_t) 1 << PTBITS)
+
+/* Initialize SPT to be empty.  Returns false if out of memory. */
+bool
+spt_init(struct spt *spt)
+{
+  spt->dir = palloc_get_page(PAL_ZERO);
+  spt->cnt = 0;
+  return spt->dir != NULL;
+}
+
+/* Call ACTION, if nonnull, on each entry of SPT in order of
+   address, then free SPT's pages.  The entries themselves belong
+   to ACTION. */
+void
+spt_destroy(struct spt *spt, void (*action)(struct suppl_pte *))
+{
+  size_t pde, pte;
+
+  if (spt->dir == NULL)
+    return;
+  for (pde = 0; pde < USER_PDE_CNT; pde++)
+    {
+      struct suppl_pte **leaf = spt->dir[pde];
+
+      if (leaf == NULL)
+        continue;
+      if (action != NULL)
+        for (pte = 0; pte < LEAF_CNT; pte++)
+          if (leaf[pte] != NULL)
+            action(leaf[pte]);
+      palloc_free_page(leaf);
+    }
+  palloc_free_page(spt->dir);
+  spt->dir = NULL;
+  spt->cnt = 0;
+}
+
+/* Return the entry of SPT for the user page at UPAGE, or a null
+   pointer if there is none.  SPT may be the never-initialized
+   table of a kernel thread. */
+struct suppl_pte *
+spt_find(struct spt *spt, const void *upage)
+{
+  struct suppl_pte **leaf;
+
+  if (spt->dir == NULL || !is_user_vaddr(upage))
+    return NULL;
+  leaf = spt->dir[pd_no(upage)];
+  return leaf != NULL ? leaf[pt_no(upage)] : NULL;
+}
+
+/* Add SPTE to SPT under its user_vaddr.  Returns false if SPT
+   already has an entry there or a leaf page can't be allocated. */
+bool
+spt_insert(struct spt *spt, struct suppl_pte *spte)
+{
+  const void *upage = spte->user_vaddr;
+  struct suppl_pte ***leafp;
+
+  ASSERT(is_user_vaddr(upage));
+  ASSERT(pg_ofs(upage) == 0);
+  leafp = &spt->dir[pd_no(upage)];
+  if (*leafp == NULL)
+    {
+      *leafp = palloc_get_page(PAL_ZERO);
+      if (*leafp == NULL)
+        return false;
+    }
+  if ((*leafp)[pt_no(upage)] != NULL)
+    return false;
+  (*leafp)[pt_no(upage)] = spte;
+  spt->cnt++;
+  return true;
+}
+
+/* Remove and return the entry of SPT for UPAGE, or return a null
+   pointer if there is none.  Leaf pages are kept until
+   spt_destroy(), since munmap and stack growth tend to reuse the
+   same ranges. */
+struct suppl_pte *
+spt_remove(struct spt *spt, const void *upage)
+{
+  struct suppl_pte **leaf;
+  struct suppl_pte *spte;
+
+  ASSERT(is_user_vaddr(upage));
+  leaf = spt->dir[pd_no(upage)];
+  if (leaf == NULL || leaf[pt_no(upage)] == NULL)
+    return NULL;
+  spte = leaf[pt_no(upage)];
+  leaf[pt_no(upage)] = NULL;
+  spt->cnt--;
+  return spte;
+}
+
+/* Return the entry of SPT with the lowest address at or above
+   UPAGE, or a null pointer if there is none.  Skips over unused
+   leaves a page directory entry at a time. */
+struct suppl_pte *
+spt_next(struct spt *spt, const void *upage)
+{
+  size_t pde = pd_no(upage);
+  size_t pte = pt_no(upage);
+
+  for (; pde < USER_PDE_CNT; pde++, pte = 0)
+    {
+      struct suppl_pte **leaf = spt->dir[pde];
+
+      if (leaf == NULL)
+        continue;
+      for (; pte < LEAF_CNT; pte++)
+        if (leaf[pte] != NULL)
+          return leaf[pte];
+    }
+  return NULL;
+}
@@ -0,0 +1,29 @@
+#ifndef VM_SPT_H
+#define VM_SPT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct suppl_pte;
+
+/* Supplemental page table: a two-level radix tree keyed by user
+   page number, laid out like the x86 page directory.  DIR is a
+   page of pointers to leaf pages, each of which holds the entries
+   for the 1024 pages that one page table would map. */
+struct spt
+{
+  struct suppl_pte ***dir;  /* Leaf pages, by page directory index */
+  size_t cnt;               /* Number of entries */
+};
+
+bool spt_init(struct spt *);
+void spt_destroy(struct spt *, void (*)(struct suppl_pte *));
+
+struct suppl_pte *spt_find(struct spt *, const void *);
+bool spt_insert(struct spt *, struct suppl_pte *);
+struct suppl_pte *spt_remove(struct spt *, const void *);
+
+/* In-order iteration */
+struct suppl_pte *spt_next(struct spt *, const void *);
+
+#endif /* vm/spt.h */
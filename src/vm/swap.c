@@ -1,89 +1,504 @@
 #include <bitmap.h>
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "devices/block.h"
+#include "threads/malloc.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
 
 #include "vm/swap.h"
-          
-/* Block device that contains the swap */
-struct block *swap_device;
+#include "vm/zswap.h"
+#include "threads/palloc.h"
 
-/* Bitmap of swap slot availablities and corresponding lock */
-static struct bitmap *swap_map;
+/* Swap devices.  Each device's slots are numbered from its BASE
+   in the one space of slot numbers that the rest of the VM sees,
+   which a device added later extends.  Slots are taken from the
+   devices of the highest priority that have room, a cluster of up
+   to SWAP_CLUSTER slots at a time from each in turn, so that swap
+   I/O is striped across disks of equal priority and their queues
+   work in parallel. */
+struct swap_device
+  {
+    struct block *block;
+    int priority;               /* Higher is used first. */
+    size_t base;                /* First slot, a multiple of SWAP_CLUSTER. */
+    size_t cnt;                 /* Number of slots. */
+    struct bitmap *map;         /* Free slots are true. */
+    size_t free_cnt;            /* Set bits in MAP. */
+    size_t cursor;              /* Next-fit cursor into MAP. */
+    struct swap_slot *slots;    /* CNT slots. */
+  };
+
+/* Most swap devices. */
+#define SWAP_DEVICE_MAX 8
+
+/* Swap devices, in the order added, and the lock for their maps.
+   Entries are only ever appended, so a slot's device can be found
+   without the lock. */
+static struct swap_device devices[SWAP_DEVICE_MAX];
+static size_t device_cnt;
+static size_t next_base;        /* BASE of the next device added. */
+static size_t rotor;            /* Device that gave the last cluster. */
+static struct lock swap_lock;
+static size_t swap_slot_cnt;    /* Slots on all devices. */
+static size_t swap_free_cnt;    /* Free slots on all devices. */
+
+/* Owner and user page of each slot in use, for read-around, and
+   where the compressed tier holds the slot's page instead of the
+   device */
+struct swap_slot
+  {
+    struct thread *owner;
+    void *upage;
+    struct zswap_entry z;
+  };
+
+/* Fraction of the user pool set aside for the compressed tier */
+#define ZSWAP_FRACTION 16
 
 /* Represents how many sectors are needed to store a page */
 static size_t SECTORS_PER_PAGE = PGSIZE / BLOCK_SECTOR_SIZE;
-static size_t swap_size_in_page (void);
+static size_t alloc_slots (size_t cnt);
 
+/* Initializes swap on the devices named in NAMES, the -swap option,
+   or on every swap partition at priority 0 if NAMES is null. */
 void
-vm_swap_init ()
+vm_swap_init (const char *names)
 {
-  /* init the swap device */
-  swap_device = block_get_role (BLOCK_SWAP);
-  if (swap_device == NULL)
+  lock_init_named (&swap_lock, "swap");
+  vm_swap_add_devices (names);
+  if (device_cnt == 0)
     PANIC ("no swap device found, can't initialize swap");
 
-  /* init the swap bitmap */
-  swap_map = bitmap_create (swap_size_in_page ());
-  if (swap_map == NULL)
-    PANIC ("swap bitmap creation failed");
+  zswap_init (palloc_user_page_cnt () / ZSWAP_FRACTION);
+}
+
+/* Adds the devices in NAMES, a comma-separated list of block
+   device names each optionally followed by a colon and a
+   priority, or every swap partition at priority 0 if NAMES is
+   null.  Panics on a name that is not a block device. */
+void
+vm_swap_add_devices (const char *names)
+{
+  char buf[128];
+  char *name, *save_ptr;
+
+  if (names == NULL)
+    {
+      struct block *block;
+
+      for (block = block_first (); block != NULL; block = block_next (block))
+        if (block_type (block) == BLOCK_SWAP && !vm_swap_add (block, 0))
+          printf ("swap: can't use %s\n", block_name (block));
+      return;
+    }
+
+  strlcpy (buf, names, sizeof buf);
+  for (name = strtok_r (buf, ",", &save_ptr); name != NULL;
+       name = strtok_r (NULL, ",", &save_ptr))
+    {
+      char *colon = strchr (name, ':');
+      int priority = 0;
+      struct block *block;
+
+      if (colon != NULL)
+        {
+          *colon = '\0';
+          priority = atoi (colon + 1);
+        }
+      block = block_get_by_name (name);
+      if (block == NULL)
+        PANIC ("No such block device \"%s\"", name);
+      if (!vm_swap_add (block, priority))
+        printf ("swap: can't use %s\n", name);
+    }
+}
+
+/* Adds BLOCK as a swap device with the given PRIORITY, at boot or
+   at any time after.  Returns false if BLOCK is already a swap
+   device, is too small to hold a page, or there are too many swap
+   devices or too little memory. */
+bool
+vm_swap_add (struct block *block, int priority)
+{
+  size_t cnt = block_size (block) / SECTORS_PER_PAGE;
+  struct bitmap *map = cnt > 0 ? bitmap_create (cnt) : NULL;
+  struct swap_slot *slots = cnt > 0 ? calloc (cnt, sizeof *slots) : NULL;
+  bool success;
+  size_t i;
+
+  lock_acquire (&swap_lock);
+  success = map != NULL && slots != NULL && device_cnt < SWAP_DEVICE_MAX;
+  for (i = 0; i < device_cnt; i++)
+    if (devices[i].block == block)
+      success = false;
+  if (success)
+    {
+      struct swap_device *d = &devices[device_cnt];
+
+      bitmap_set_all (map, true);
+      d->block = block;
+      d->priority = priority;
+      d->base = next_base;
+      d->cnt = d->free_cnt = cnt;
+      d->map = map;
+      d->cursor = 0;
+      d->slots = slots;
+      next_base = ROUND_UP (next_base + cnt, SWAP_CLUSTER);
+      swap_slot_cnt += cnt;
+      swap_free_cnt += cnt;
+
+      /* Publish the device only once it is filled in. */
+      barrier ();
+      device_cnt++;
+    }
+  lock_release (&swap_lock);
+
+  if (!success)
+    {
+      if (map != NULL)
+        bitmap_destroy (map);
+      free (slots);
+      return false;
+    }
+  if (block_get_role (BLOCK_SWAP) == NULL)
+    block_set_role (BLOCK_SWAP, block);
+  printf ("swap: using %s, priority %d\n", block_name (block), priority);
+  return true;
+}
 
-  /* initialize all bits to be true */ 
-  bitmap_set_all (swap_map, true);
+/* Returns the device that holds slot SWAP_IDX. */
+static struct swap_device *
+device_of (size_t swap_idx)
+{
+  size_t i;
+
+  for (i = 0; i < device_cnt; i++)
+    if (swap_idx - devices[i].base < devices[i].cnt)
+      return &devices[i];
+  PANIC ("bad swap slot %zu", swap_idx);
 }
 
-/* Find an available swap slot and dump in the given page represented by UVA
+/* Returns the bookkeeping of slot SWAP_IDX. */
+static struct swap_slot *
+slot_of (size_t swap_idx)
+{
+  struct swap_device *d = device_of (swap_idx);
+  return &d->slots[swap_idx - d->base];
+}
+
+/* Returns the first sector of slot SWAP_IDX on its device. */
+static block_sector_t
+sector_of (const struct swap_device *d, size_t swap_idx)
+{
+  return (swap_idx - d->base) * SECTORS_PER_PAGE;
+}
+
+/* Returns how many swap slots are free.  Without swap_lock the
+   answer may be out of date by the time it is used. */
+size_t
+vm_swap_free_cnt (void)
+{
+  return swap_free_cnt;
+}
+
+/* Returns how many swap slots there are on all devices. */
+size_t
+vm_swap_slot_cnt (void)
+{
+  return swap_slot_cnt;
+}
+
+/* Find an available swap slot and dump in the given page represented by
+   KPAGE, which OWNER maps at UPAGE.
    If failed, return SWAP_ERROR
    Otherwise, return the swap slot index */
-/* No inner synchronization, should be used with a sync machanism */
-size_t vm_swap_out (const void *uva)
+size_t vm_swap_out (const void *kpage, struct thread *owner, void *upage)
 {
-  /* find a swap slot and mark it in use */
-  size_t swap_idx = bitmap_scan_and_flip (swap_map, 0, 1, true);
-    
-  if (swap_idx == BITMAP_ERROR)
+  size_t swap_idx;
+
+  if (vm_swap_out_cluster (1, &kpage, &owner, &upage, &swap_idx) == 0)
     return SWAP_ERROR;
+  return swap_idx;
+}
+
+/* Write the CNT pages in KPAGES to swap, in runs of contiguous slots
+   of up to SWAP_CLUSTER so that they can be read back together, each
+   run on the next swap device in turn.  Page I is mapped by OWNERS[I]
+   at UPAGES[I]; its slot is stored in SLOTS[I].
+   Returns the number of pages written, which is less than CNT only if
+   swap is full or the next page's owner is at its swap limit. */
+size_t
+vm_swap_out_cluster (size_t cnt, const void *const kpages[],
+                     struct thread *const owners[], void *const upages[],
+                     size_t slots[])
+{
+  size_t allowed, i;
 
-  /* write the page of data to the swap slot */
-  size_t counter = 0;
-  while (counter < SECTORS_PER_PAGE)
+  lock_acquire (&swap_lock);
+  for (allowed = 0; allowed < cnt; allowed++)
     {
-      block_write (swap_device, swap_idx * SECTORS_PER_PAGE + counter, 
-		   uva + counter * BLOCK_SECTOR_SIZE);
-      counter++;
+      struct thread *owner = owners[allowed];
+      if (owner->vm_swap_slots >= owner->rlimit_swap)
+        break;
+      owner->vm_swap_slots++;
     }
-  return swap_idx;
+  for (i = 0; i < allowed; )
+    {
+      size_t n = allowed - i < SWAP_CLUSTER ? allowed - i : SWAP_CLUSTER;
+      size_t first = alloc_slots (n);
+
+      if (first == BITMAP_ERROR)
+        {
+          n = 1;
+          first = alloc_slots (1);
+          if (first == BITMAP_ERROR)
+            break;
+        }
+      for (; n > 0; n--, i++)
+        {
+          struct swap_slot *slot = slot_of (first);
+
+          slots[i] = first++;
+          slot->owner = owners[i];
+          slot->upage = upages[i];
+        }
+    }
+  cnt = i;
+  for (; i < allowed; i++)
+    owners[i]->vm_swap_slots--;
+  lock_release (&swap_lock);
+
+  /* keep what compresses well in RAM and write the rest of the
+     pages to the swap slots, submitting a cluster at a time so that
+     the devices can merge adjacent slots */
+  for (i = 0; i < cnt; i += SWAP_CLUSTER)
+    {
+      struct block_request reqs[SWAP_CLUSTER];
+      size_t n = cnt - i < SWAP_CLUSTER ? cnt - i : SWAP_CLUSTER;
+      size_t j;
+
+      for (j = 0; j < n; j++)
+        {
+          struct swap_device *d = device_of (slots[i + j]);
+
+          if (zswap_store (kpages[i + j], &slot_of (slots[i + j])->z))
+            continue;
+          block_request_init (&reqs[j], sector_of (d, slots[i + j]),
+                              SECTORS_PER_PAGE, (void *) kpages[i + j],
+                              true, BLOCK_IO_SWAP);
+          block_submit (d->block, &reqs[j]);
+        }
+      for (j = 0; j < n; j++)
+        if (slot_of (slots[i + j])->z.size == 0)
+          block_wait (&reqs[j]);
+    }
+  return cnt;
 }
 
-/* Swap a page of data in swap slot SWAP_IDX to a page starting at UVA */
-void
+/* Swap a page of data in swap slot SWAP_IDX to a page starting at
+   UVA.  Returns true if the slot is kept as a clean copy of the
+   page, as vm_swap_keep() decides, false if it was freed. */
+bool
 vm_swap_in (size_t swap_idx, void *uva)
 {
-  /* swap out the data from swap slot to mem page */
-  size_t counter = 0;
-  while (counter < SECTORS_PER_PAGE)
+  vm_swap_read (swap_idx, uva);
+  return vm_swap_keep (swap_idx);
+}
+
+/* Decide what becomes of slot SWAP_IDX once its page has been read
+   back into a frame.  The slot stays in use as the swap cache, an
+   up-to-date copy that lets the page be evicted again without I/O
+   as long as it is not written, unless it is held by the compressed
+   tier, where keeping it would hold the page in RAM twice, or swap
+   is more than half full, where slots are worth more free.  Returns
+   true if the slot is kept, false if it was freed. */
+bool
+vm_swap_keep (size_t swap_idx)
+{
+  if (slot_of (swap_idx)->z.size == 0
+      && swap_free_cnt > swap_slot_cnt / 2)
+    return true;
+  vm_clear_swap_slot (swap_idx);
+  return false;
+}
+
+/* Copy the page of data in swap slot SWAP_IDX to UVA, keeping the
+   slot in use */
+void
+vm_swap_read (size_t swap_idx, void *uva)
+{
+  struct swap_device *d = device_of (swap_idx);
+  struct swap_slot *slot = &d->slots[swap_idx - d->base];
+
+  if (slot->z.size != 0)
     {
-      block_read (swap_device, swap_idx * SECTORS_PER_PAGE + counter,
-		  uva + counter * BLOCK_SECTOR_SIZE);
-      counter++;
+      zswap_load (&slot->z, uva);
+      return;
     }
-  /* free the corresponding swap slot bit in bitmap */
-  bitmap_flip (swap_map, swap_idx);
+  block_transfer (d->block, sector_of (d, swap_idx),
+                  SECTORS_PER_PAGE, uva, false, BLOCK_IO_SWAP);
+}
+
+/* Start copying the page of data in swap slot SWAP_IDX to KPAGE
+   with request R, keeping the slot in use.  The copy is done once
+   block_wait() on R returns.  A page in the compressed tier is
+   copied at once. */
+void
+vm_swap_read_async (size_t swap_idx, void *kpage, struct block_request *r)
+{
+  struct swap_device *d = device_of (swap_idx);
+  struct swap_slot *slot = &d->slots[swap_idx - d->base];
+
+  block_request_init (r, sector_of (d, swap_idx), SECTORS_PER_PAGE,
+                      kpage, false, BLOCK_IO_SWAP);
+  if (slot->z.size != 0)
+    {
+      zswap_load (&slot->z, kpage);
+      sema_up (&r->done);
+      return;
+    }
+  block_submit (d->block, r);
 }
 
 void vm_clear_swap_slot (size_t swap_idx)
 {
+  struct swap_device *d = device_of (swap_idx);
+  struct swap_slot *slot = &d->slots[swap_idx - d->base];
+
+  zswap_free (&slot->z);
+
   /* free the corresponding swap slot bit in bitmap */
-  bitmap_flip (swap_map, swap_idx);  
+  lock_acquire (&swap_lock);
+  bitmap_flip (d->map, swap_idx - d->base);
+  d->free_cnt++;
+  swap_free_cnt++;
+  if (slot->owner != NULL)
+    slot->owner->vm_swap_slots--;
+  slot->owner = NULL;
+  lock_release (&swap_lock);
+}
+
+/* Release every swap slot that process T still owns, once its
+   address space is gone.  Slots that no page table entry names any
+   more would otherwise stay allocated for good, and keep pointing
+   to T's struct thread after it is freed.  Nothing can give T a new
+   slot by now, so only T's count needs to be read without the
+   lock. */
+void
+vm_swap_exit (struct thread *t)
+{
+  size_t i, j;
+
+  for (i = 0; i < device_cnt && t->vm_swap_slots > 0; i++)
+    {
+      struct swap_device *d = &devices[i];
+
+      for (j = 0; j < d->cnt && t->vm_swap_slots > 0; j++)
+        if (d->slots[j].owner == t)
+          vm_clear_swap_slot (d->base + j);
+    }
+}
+
+/* Store in UPAGES the user pages that OWNER has swapped out to the
+   other slots of SWAP_IDX's aligned cluster of SWAP_CLUSTER slots, and
+   their slots in SLOTS.  Returns how many were found. */
+size_t
+vm_swap_cluster_of (size_t swap_idx, struct thread *owner,
+                    size_t slots[], void *upages[])
+{
+  struct swap_device *d = device_of (swap_idx);
+  size_t first = swap_idx - swap_idx % SWAP_CLUSTER;
+  size_t last = first + SWAP_CLUSTER;
+  size_t cnt = 0;
+  size_t i;
+
+  if (last > d->base + d->cnt)
+    last = d->base + d->cnt;
+
+  lock_acquire (&swap_lock);
+  for (i = first; i < last; i++)
+    if (i != swap_idx && !bitmap_test (d->map, i - d->base)
+        && d->slots[i - d->base].owner == owner)
+      {
+        slots[cnt] = i;
+        upages[cnt] = d->slots[i - d->base].upage;
+        cnt++;
+      }
+  lock_release (&swap_lock);
+  return cnt;
 }
 
-/* Returns how many pages the swap device can contain, which is rounded down */
+/* Returns the first of CNT free contiguous slots on device D,
+   searching from its cursor and then from its start, and marks
+   them in use.  Returns BITMAP_ERROR if there is no such run.
+   Must be called with swap_lock held. */
 static size_t
-swap_size_in_page ()
+alloc_on (struct swap_device *d, size_t cnt)
 {
-  return block_size (swap_device) / SECTORS_PER_PAGE;
+  size_t idx = bitmap_scan_and_flip (d->map, d->cursor, cnt, true);
+
+  if (idx == BITMAP_ERROR && d->cursor != 0)
+    idx = bitmap_scan_and_flip (d->map, 0, cnt, true);
+  if (idx == BITMAP_ERROR)
+    return BITMAP_ERROR;
+  d->cursor = (idx + cnt) % d->cnt;
+  d->free_cnt -= cnt;
+  swap_free_cnt -= cnt;
+  return d->base + idx;
 }
 
+/* Returns the first of CNT free contiguous slots and marks them in
+   use, taking them from the devices of the highest priority that
+   have such a run, round-robin among those of equal priority.
+   Returns BITMAP_ERROR if there is no such run.
+   Must be called with swap_lock held. */
+static size_t
+alloc_slots (size_t cnt)
+{
+  bool above = false;           /* Is PRIORITY an upper bound yet? */
+  int priority = 0;
+
+  for (;;)
+    {
+      bool found = false;
+      int next = 0;
+      size_t i;
+
+      /* The highest priority below the last one tried. */
+      for (i = 0; i < device_cnt; i++)
+        if ((!above || devices[i].priority < priority)
+            && (!found || devices[i].priority > next))
+          {
+            next = devices[i].priority;
+            found = true;
+          }
+      if (!found)
+        return BITMAP_ERROR;
+      priority = next;
+      above = true;
+
+      for (i = 1; i <= device_cnt; i++)
+        {
+          size_t n = (rotor + i) % device_cnt;
+          struct swap_device *d = &devices[n];
+          size_t idx;
+
+          if (d->priority != priority || d->free_cnt < cnt)
+            continue;
+          idx = alloc_on (d, cnt);
+          if (idx != BITMAP_ERROR)
+            {
+              rotor = n;
+              return idx;
+            }
+        }
+    }
+}
@@ -1,16 +1,41 @@
 #ifndef VM_SWAP_H
 #define VM_SWAP_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 #define SWAP_ERROR SIZE_MAX
 
+/* Swap slots are read back in aligned clusters of this many slots */
+#define SWAP_CLUSTER 8
+
+struct thread;
+struct block;
+struct block_request;
+
 /* Swap initialization */
-void vm_swap_init (void);
+void vm_swap_init (const char *names);
+bool vm_swap_add (struct block *, int priority);
+void vm_swap_add_devices (const char *names);
+size_t vm_swap_free_cnt (void);
+size_t vm_swap_slot_cnt (void);
 
 /* Swap a frame into a swap slot */
-size_t vm_swap_out (const void *);
+size_t vm_swap_out (const void *, struct thread *, void *);
+size_t vm_swap_out_cluster (size_t, const void *const [],
+                            struct thread *const [], void *const [],
+                            size_t []);
 
 /* Swap a frame out of a swap slot to mem page */
-void vm_swap_in (size_t, void *);
+bool vm_swap_in (size_t, void *);
+bool vm_swap_keep (size_t);
+void vm_swap_read (size_t, void *);
+void vm_swap_read_async (size_t, void *, struct block_request *);
 
 void vm_clear_swap_slot (size_t);
+void vm_swap_exit (struct thread *);
+
+/* Other slots of a cluster that belong to the same process */
+size_t vm_swap_cluster_of (size_t, struct thread *, size_t [], void *[]);
 #endif /* vm/swap.h */
@@ -0,0 +1,264 @@
+#include "vm/zswap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <round.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Compressed RAM tier in front of the swap device.
+
+   Swapped-out pages are compressed with a small LZ77 codec in the
+   style of LZ4 and kept in a pool of kernel pages, carved into
+   ZSWAP_CHUNK-byte chunks.  Their swap slots stay allocated, but
+   the device is only written for pages that compress worse than
+   ZSWAP_MAX or do not fit in the pool, so reading most pages back
+   is a decompression instead of a transfer. */
+
+/* Pool allocation unit, in bytes. */
+#define ZSWAP_CHUNK 64
+
+/* Most bytes a page may compress to and still be kept. */
+#define ZSWAP_MAX (PGSIZE * 3 / 4)
+
+/* Most pages in the pool, so that chunk numbers fit in 16 bits. */
+#define ZSWAP_PAGES_MAX (65536 / (PGSIZE / ZSWAP_CHUNK))
+
+/* Codec parameters. */
+#define LZ_MIN_MATCH 4          /* Shortest match encoded. */
+#define LZ_HASH_BITS 10         /* Log2 of the match finder's entries. */
+
+/* The pool, a bitmap of its chunks in use, and a lock that also
+   covers the codec's buffers. */
+static uint8_t *pool;
+static struct bitmap *pool_map;
+static struct lock zswap_lock;
+
+/* Offsets in the page of the last place each hash of 4 bytes was
+   seen, and output for a page being compressed. */
+static uint16_t lz_table[1 << LZ_HASH_BITS];
+static uint8_t lz_buf[ZSWAP_MAX];
+
+static size_t lz_compress (const uint8_t *, uint8_t *, size_t max);
+static void lz_decompress (const uint8_t *, uint8_t *);
+
+/* Sets aside PAGE_CNT kernel pages for the pool.  If they cannot
+   be had, every page goes to the swap device. */
+void
+zswap_init (size_t page_cnt)
+{
+  lock_init_named (&zswap_lock, "zswap");
+  if (page_cnt > ZSWAP_PAGES_MAX)
+    page_cnt = ZSWAP_PAGES_MAX;
+  if (page_cnt == 0)
+    return;
+
+  pool = palloc_get_multiple (0, page_cnt);
+  pool_map = bitmap_create (page_cnt * (PGSIZE / ZSWAP_CHUNK));
+  if (pool == NULL || pool_map == NULL)
+    {
+      if (pool != NULL)
+        palloc_free_multiple (pool, page_cnt);
+      if (pool_map != NULL)
+        bitmap_destroy (pool_map);
+      pool = NULL;
+      pool_map = NULL;
+    }
+}
+
+/* Compresses KPAGE into the pool and records where in E.
+   Returns false, leaving E's size 0, if the page compresses
+   poorly or the pool has no room for it. */
+bool
+zswap_store (const void *kpage, struct zswap_entry *e)
+{
+  size_t size, chunk;
+
+  e->size = 0;
+  if (pool == NULL)
+    return false;
+
+  lock_acquire (&zswap_lock);
+  size = lz_compress (kpage, lz_buf, sizeof lz_buf);
+  chunk = BITMAP_ERROR;
+  if (size > 0)
+    chunk = bitmap_scan_and_flip (pool_map, 0,
+                                  DIV_ROUND_UP (size, ZSWAP_CHUNK), false);
+  if (chunk != BITMAP_ERROR)
+    {
+      memcpy (pool + chunk * ZSWAP_CHUNK, lz_buf, size);
+      e->chunk = chunk;
+      e->size = size;
+    }
+  lock_release (&zswap_lock);
+  return e->size != 0;
+}
+
+/* Decompresses the page recorded in E into KPAGE.  E stays
+   valid. */
+void
+zswap_load (const struct zswap_entry *e, void *kpage)
+{
+  ASSERT (e->size != 0);
+
+  /* Chunks in use are not touched by anyone else until
+     zswap_free(). */
+  lz_decompress (pool + e->chunk * ZSWAP_CHUNK, kpage);
+}
+
+/* Releases E's chunks, if it has any. */
+void
+zswap_free (struct zswap_entry *e)
+{
+  if (e->size == 0)
+    return;
+  lock_acquire (&zswap_lock);
+  bitmap_set_multiple (pool_map, e->chunk,
+                       DIV_ROUND_UP (e->size, ZSWAP_CHUNK), false);
+  lock_release (&zswap_lock);
+  e->size = 0;
+}
+
+/* The codec.  A compressed page is a series of sequences, each a
+   token byte whose high and low nibbles hold a count of literals
+   and a match length less LZ_MIN_MATCH; further length bytes if a
+   nibble is 15; the literals; and, unless the literals end the
+   page, a 2-byte little-endian offset back to the match followed
+   by further match length bytes.  A length in further bytes is
+   the sum of a run of 255s and the byte that ends it. */
+
+static uint32_t
+read32 (const uint8_t *p)
+{
+  uint32_t v;
+  memcpy (&v, p, sizeof v);
+  return v;
+}
+
+/* Writes LEN as further length bytes at OP.  Returns the end. */
+static uint8_t *
+put_length (uint8_t *op, size_t len)
+{
+  for (; len >= 255; len -= 255)
+    *op++ = 255;
+  *op++ = len;
+  return op;
+}
+
+/* Reads further length bytes at *IP, advancing it. */
+static size_t
+get_length (const uint8_t **ip)
+{
+  size_t len = 0;
+  uint8_t b;
+
+  do
+    {
+      b = *(*ip)++;
+      len += b;
+    }
+  while (b == 255);
+  return len;
+}
+
+/* Writes at OP, without passing END, a sequence of LIT_CNT
+   literals from LIT followed by a match of MATCH_LEN bytes OFS
+   back, or by nothing if MATCH_LEN is 0.  Returns the end, or a
+   null pointer if it would not fit. */
+static uint8_t *
+put_sequence (uint8_t *op, uint8_t *end, const uint8_t *lit,
+              size_t lit_cnt, size_t ofs, size_t match_len)
+{
+  size_t code = match_len > 0 ? match_len - LZ_MIN_MATCH : 0;
+
+  if ((size_t) (end - op) < 1 + lit_cnt / 255 + 1 + lit_cnt
+                            + 2 + code / 255 + 1)
+    return NULL;
+
+  *op++ = (lit_cnt < 15 ? lit_cnt : 15) << 4 | (code < 15 ? code : 15);
+  if (lit_cnt >= 15)
+    op = put_length (op, lit_cnt - 15);
+  memcpy (op, lit, lit_cnt);
+  op += lit_cnt;
+  if (match_len > 0)
+    {
+      *op++ = ofs & 0xff;
+      *op++ = ofs >> 8;
+      if (code >= 15)
+        op = put_length (op, code - 15);
+    }
+  return op;
+}
+
+/* Compresses the page at SRC into at most MAX bytes at DST.
+   Returns the compressed size, or 0 if it is more than MAX. */
+static size_t
+lz_compress (const uint8_t *src, uint8_t *dst, size_t max)
+{
+  const uint8_t *end = src + PGSIZE;
+  const uint8_t *ip = src, *anchor = src;
+  uint8_t *op = dst;
+
+  memset (lz_table, 0, sizeof lz_table);
+  while (ip + LZ_MIN_MATCH <= end)
+    {
+      uint32_t seq = read32 (ip);
+      size_t h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+      const uint8_t *ref = src + lz_table[h];
+
+      lz_table[h] = ip - src;
+      if (ref < ip && read32 (ref) == seq)
+        {
+          size_t len = LZ_MIN_MATCH;
+
+          while (ip + len < end && ref[len] == ip[len])
+            len++;
+          op = put_sequence (op, dst + max, anchor, ip - anchor,
+                             ip - ref, len);
+          if (op == NULL)
+            return 0;
+          ip += len;
+          anchor = ip;
+        }
+      else
+        ip++;
+    }
+  op = put_sequence (op, dst + max, anchor, end - anchor, 0, 0);
+  return op != NULL ? (size_t) (op - dst) : 0;
+}
+
+/* Decompresses the page at SRC into DST. */
+static void
+lz_decompress (const uint8_t *ip, uint8_t *dst)
+{
+  uint8_t *op = dst;
+  uint8_t *end = dst + PGSIZE;
+
+  for (;;)
+    {
+      unsigned token = *ip++;
+      size_t len = token >> 4;
+      const uint8_t *ref;
+
+      if (len == 15)
+        len += get_length (&ip);
+      memcpy (op, ip, len);
+      op += len;
+      ip += len;
+      if (op >= end)
+        break;
+
+      ref = op - (ip[0] | ip[1] << 8);
+      ip += 2;
+      len = token & 15;
+      if (len == 15)
+        len += get_length (&ip);
+      len += LZ_MIN_MATCH;
+
+      /* Byte by byte, since a match may overlap its own output. */
+      while (len-- > 0)
+        *op++ = *ref++;
+    }
+  ASSERT (op == end);
+}
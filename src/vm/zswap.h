@@ -0,0 +1,21 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Where the compressed RAM tier keeps a page.  SIZE is 0 when
+   the page is not there. */
+struct zswap_entry
+  {
+    uint16_t chunk;             /* First chunk in the pool. */
+    uint16_t size;              /* Compressed bytes. */
+  };
+
+void zswap_init (size_t page_cnt);
+bool zswap_store (const void *kpage, struct zswap_entry *);
+void zswap_load (const struct zswap_entry *, void *kpage);
+void zswap_free (struct zswap_entry *);
+
+#endif /* vm/zswap.h */